@@ -0,0 +1,139 @@
+#include "agc.h"
+#include "esp_log.h"
+#include <string.h>
+#include <math.h>
+
+static const char *TAG = "AGC";
+
+#define AGC_GAIN_SHIFT          12      // Q12 gains: up to 16x fits a 16-bit sample in 32 bits
+#define AGC_UNITY               (1 << AGC_GAIN_SHIFT)
+
+// Frames quieter than this are pauses or background: the gain holds
+#define AGC_GATE_DBFS           -50.0f
+
+// Level tracking per frame, on power so the loud part of each syllable
+// counts and its fading tail hardly does: quick to follow a louder talker
+// (about 200 ms), slow to decide the talker became quieter (about 2 s)
+#define AGC_LEVEL_ATTACK        0.1f
+#define AGC_LEVEL_RELEASE       0.01f
+
+// Largest gain increase per frame (10 dB/s)
+#define AGC_GAIN_RISE_DB        0.2f
+
+// Largest limiter gain increase per block (1 dB per 5 ms)
+#define AGC_LIMITER_RELEASE     ((int32_t)(AGC_UNITY * 1.122f))
+
+static inline int16_t saturate16(int32_t v)
+{
+    if (v > INT16_MAX) {
+        return INT16_MAX;
+    }
+    if (v < INT16_MIN) {
+        return INT16_MIN;
+    }
+    return (int16_t)v;
+}
+
+// Steer the gain from one frame's level
+static void agc_update_gain(agc_t* agc, const int16_t* in, size_t count)
+{
+    int64_t sum = 0;
+    for (size_t n = 0; n < count; n++) {
+        sum += (int32_t)in[n] * in[n];
+    }
+    float mean_square = (float)sum / count;
+    float level_db = mean_square > 0.0f ? 10.0f * log10f(mean_square / (32768.0f * 32768.0f)) : -96.0f;
+    if (level_db < AGC_GATE_DBFS) {
+        return;
+    }
+    agc->stats.speech_frames++;
+
+    float level = powf(10.0f, agc->level_db / 10.0f) * 32768.0f * 32768.0f;
+    float smoothing = level_db > agc->level_db ? AGC_LEVEL_ATTACK : AGC_LEVEL_RELEASE;
+    level += smoothing * (mean_square - level);
+    agc->level_db = 10.0f * log10f(level / (32768.0f * 32768.0f));
+
+    float wanted = AGC_TARGET_DBFS - agc->level_db;
+    if (wanted > AGC_MAX_GAIN_DB) {
+        wanted = AGC_MAX_GAIN_DB;
+    } else if (wanted < AGC_MIN_GAIN_DB) {
+        wanted = AGC_MIN_GAIN_DB;
+    }
+    if (wanted > agc->gain_db + AGC_GAIN_RISE_DB) {
+        wanted = agc->gain_db + AGC_GAIN_RISE_DB;
+    }
+    agc->gain_db = wanted;
+}
+
+void agc_init(agc_t* agc, bool enabled)
+{
+    memset(agc, 0, sizeof(*agc));
+    agc->enabled = enabled;
+    agc->level_db = AGC_GATE_DBFS;     // The first speech frames set the level
+    agc->applied = AGC_UNITY;
+    ESP_LOGI(TAG, "AGC %s: target %d dBFS, gain %d..%d dB, limit %d dBFS", enabled ? "on" : "off",
+             AGC_TARGET_DBFS, AGC_MIN_GAIN_DB, AGC_MAX_GAIN_DB, AGC_LIMIT_DBFS);
+}
+
+void agc_process(agc_t* agc, const int16_t* in, int16_t* out, size_t count)
+{
+    if (count > AGC_FRAME_SAMPLES) {
+        count = AGC_FRAME_SAMPLES;
+    }
+    if (!agc->enabled) {
+        if (out != in) {
+            memcpy(out, in, count * sizeof(int16_t));
+        }
+        return;
+    }
+    agc->stats.frames++;
+    if (count == 0) {
+        return;
+    }
+
+    agc_update_gain(agc, in, count);
+    const int32_t gain = (int32_t)lrintf(powf(10.0f, agc->gain_db / 20.0f) * AGC_UNITY);
+    const int32_t limit = (int32_t)lrintf(powf(10.0f, AGC_LIMIT_DBFS / 20.0f) * 32767.0f);
+
+    for (size_t block = 0; block < count; block += AGC_BLOCK_SAMPLES) {
+        size_t length = count - block < AGC_BLOCK_SAMPLES ? count - block : AGC_BLOCK_SAMPLES;
+
+        int32_t peak = 0;
+        for (size_t n = 0; n < length; n++) {
+            int32_t a = in[block + n] < 0 ? -in[block + n] : in[block + n];
+            if (a > peak) {
+                peak = a;
+            }
+        }
+        int32_t target = gain;
+        if (peak > 0 && (int64_t)peak * gain > (int64_t)limit * AGC_UNITY) {
+            target = (int32_t)(((int64_t)limit * AGC_UNITY) / peak);
+            agc->stats.limited_blocks++;
+        }
+
+        // Down at once for the whole block, up as a ramp that never passes
+        // the target, so no sample of the block goes over the limit
+        int32_t start = agc->applied;
+        int32_t end = target;
+        if (end < start) {
+            start = end;
+        } else {
+            int32_t released = (int32_t)(((int64_t)start * AGC_LIMITER_RELEASE) >> AGC_GAIN_SHIFT);
+            if (end > released) {
+                end = released;
+            }
+        }
+        for (size_t n = 0; n < length; n++) {
+            int32_t g = start + (int32_t)((int64_t)(end - start) * (int32_t)(n + 1) / (int32_t)length);
+            out[block + n] = saturate16((in[block + n] * g + (AGC_UNITY / 2)) >> AGC_GAIN_SHIFT);
+        }
+        agc->applied = end;
+    }
+}
+
+void agc_get_stats(const agc_t* agc, agc_stats_t* stats)
+{
+    memcpy(stats, &agc->stats, sizeof(*stats));
+    stats->gain_db = agc->gain_db;
+    stats->level_dbfs = agc->level_db;
+}
@@ -0,0 +1,75 @@
+#ifndef AGC_H
+#define AGC_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define AGC_FRAME_SAMPLES       160     // Largest block per call (one 20 ms media frame)
+#define AGC_BLOCK_SAMPLES       40      // Limiter block (5 ms)
+#define AGC_TARGET_DBFS         -18     // Speech level the gain steers to
+#define AGC_MAX_GAIN_DB         24
+#define AGC_MIN_GAIN_DB         -12
+#define AGC_LIMIT_DBFS          -1      // Peak ceiling after gain
+
+/**
+ * AGC statistics
+ */
+typedef struct {
+    uint32_t frames;            // Frames processed
+    uint32_t speech_frames;     // Frames loud enough to steer the gain
+    uint32_t limited_blocks;    // 5 ms blocks the limiter pulled below the AGC gain
+    float gain_db;              // Current AGC gain (before the limiter)
+    float level_dbfs;           // Tracked speech level at the input
+} agc_stats_t;
+
+/**
+ * Digital automatic gain control with peak limiter (fixed capacity, no
+ * heap use)
+ *
+ * The speech level is tracked from the power of frames above a gate,
+ * rising quickly and falling slowly, and the gain steers it to
+ * AGC_TARGET_DBFS. Frames below the gate hold the gain, so pauses do not
+ * bring the background up. Gain increases are slew limited; decreases are
+ * not.
+ *
+ * The limiter looks at each 5 ms block before it is scaled: a block whose
+ * peak would cross AGC_LIMIT_DBFS gets the gain that just reaches it, from
+ * its first sample. Afterwards the gain ramps back up within a few blocks.
+ * Gains are applied in fixed point.
+ */
+typedef struct {
+    bool enabled;
+    float level_db;             // Tracked speech level, dBFS
+    float gain_db;              // AGC gain
+    int32_t applied;            // Gain applied to the last sample (Q12), after the limiter
+    agc_stats_t stats;
+} agc_t;
+
+/**
+ * Initialize (or reset) an AGC
+ *
+ * @param agc AGC instance
+ * @param enabled false passes audio through unchanged
+ */
+void agc_init(agc_t* agc, bool enabled);
+
+/**
+ * Apply gain and limiting to a block of audio
+ *
+ * @param agc AGC instance
+ * @param in Input samples
+ * @param out Output samples (may equal @p in)
+ * @param count Number of samples, up to AGC_FRAME_SAMPLES
+ */
+void agc_process(agc_t* agc, const int16_t* in, int16_t* out, size_t count);
+
+/**
+ * Get AGC statistics
+ *
+ * @param agc AGC instance
+ * @param stats Pointer to structure to fill
+ */
+void agc_get_stats(const agc_t* agc, agc_stats_t* stats);
+
+#endif // AGC_H
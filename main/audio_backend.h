@@ -0,0 +1,85 @@
+#ifndef AUDIO_BACKEND_H
+#define AUDIO_BACKEND_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define AUDIO_MAX_BORROWED          3   // Frames the media engine may hold: the longest ptime (60 ms)
+#define AUDIO_CAPTURE_MAX_QUEUED    2   // Complete frames waiting to be borrowed; older ones are dropped
+
+/**
+ * A captured frame lent to the media engine
+ */
+typedef struct {
+    const int16_t* samples;     // Valid until released
+    size_t count;
+    int64_t captured_us;        // esp_timer time the frame was complete
+} audio_frame_t;
+
+/**
+ * Audio device behind audio_handler: 16-bit mono samples at SAMPLE_RATE in
+ * both directions. Capture goes through borrow()/release() or read(),
+ * playback through write(); they run once per 20 ms media tick, must not
+ * block longer than a frame and must not log per call.
+ */
+typedef struct {
+    const char* name;
+    bool (*init)(void);                 // Once, when the backend is selected
+    void (*deinit)(void);               // When another backend is selected
+    void (*start_capture)(void);
+    void (*stop_capture)(void);
+    void (*start_playback)(void);
+    void (*stop_playback)(void);
+    size_t (*read)(int16_t* samples, size_t count);         // Samples captured
+    size_t (*write)(const int16_t* samples, size_t count);  // Samples accepted
+
+    // Zero-copy capture (optional, replaces read): lend the oldest complete
+    // frame not yet lent, in place. Up to AUDIO_MAX_BORROWED frames may be
+    // out at once; release() returns the oldest. Must not block.
+    bool (*borrow)(audio_frame_t* frame);
+    void (*release)(void);
+    uint32_t (*overruns)(void);         // Frames dropped because capture was not collected in time
+} audio_backend_t;
+
+/**
+ * I2S codec on the pins from gpio_handler.h, DMA ring of DMA_BUF_COUNT
+ * buffers of one frame each. Capture lends the DMA buffers themselves.
+ */
+extern const audio_backend_t audio_backend_i2s;
+
+/**
+ * WAV or raw file source and sink (host tests, SPIFFS); see
+ * audio_backend_file_configure()
+ */
+extern const audio_backend_t audio_backend_file;
+
+/**
+ * Playback is captured again after AUDIO_LOOPBACK_DELAY_FRAMES
+ */
+extern const audio_backend_t audio_backend_loopback;
+
+/**
+ * Silence in, everything written is dropped
+ */
+extern const audio_backend_t audio_backend_null;
+
+#define AUDIO_LOOPBACK_DELAY_FRAMES 4   // 80 ms, like a short acoustic path
+
+/**
+ * Files for audio_backend_file; call before selecting it. A source starting
+ * with a RIFF header is read as 16-bit PCM WAV, anything else as raw
+ * little-endian 16-bit samples. The sink is written as WAV.
+ *
+ * @param capture_path Source file, NULL for silence
+ * @param playback_path Sink file (created), NULL to drop playback
+ * @param loop Rewind the source at its end instead of returning silence
+ */
+void audio_backend_file_configure(const char* capture_path, const char* playback_path, bool loop);
+
+/**
+ * true once a non-looping source is used up
+ */
+bool audio_backend_file_eof(void);
+
+#endif // AUDIO_BACKEND_H
@@ -0,0 +1,245 @@
+#include "audio_backend.h"
+#include "audio_handler.h"
+#include "esp_log.h"
+#include <stdio.h>
+#include <string.h>
+
+static const char *TAG = "AUDIO_FILE";
+
+#define WAV_HEADER_SIZE     44
+#define FILE_PATH_LEN       128
+
+static char capture_path[FILE_PATH_LEN];
+static char playback_path[FILE_PATH_LEN];
+static bool loop_source = false;
+
+static FILE* source = NULL;
+static long source_data_start = 0;
+static long source_data_end = -1;       // -1 = up to the end of the file
+static bool source_eof = false;
+static FILE* sink = NULL;
+static uint32_t sink_samples = 0;
+
+static uint16_t get16(const uint8_t* p)
+{
+    return p[0] | (p[1] << 8);
+}
+
+static uint32_t get32(const uint8_t* p)
+{
+    return p[0] | (p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static void put16(uint8_t* p, uint16_t v)
+{
+    p[0] = v;
+    p[1] = v >> 8;
+}
+
+static void put32(uint8_t* p, uint32_t v)
+{
+    p[0] = v;
+    p[1] = v >> 8;
+    p[2] = v >> 16;
+    p[3] = v >> 24;
+}
+
+// Locate the data chunk of a WAV source; a file without RIFF header is raw
+static bool open_source(void)
+{
+    source = fopen(capture_path, "rb");
+    if (!source) {
+        ESP_LOGE(TAG, "Cannot open %s", capture_path);
+        return false;
+    }
+
+    uint8_t riff[12];
+    if (fread(riff, 1, sizeof(riff), source) != sizeof(riff) ||
+        memcmp(riff, "RIFF", 4) != 0 || memcmp(riff + 8, "WAVE", 4) != 0) {
+        rewind(source);
+        ESP_LOGI(TAG, "Capture from %s (raw 16-bit)", capture_path);
+        return true;
+    }
+
+    uint8_t chunk[8];
+    while (fread(chunk, 1, sizeof(chunk), source) == sizeof(chunk)) {
+        uint32_t size = get32(chunk + 4);
+        if (memcmp(chunk, "fmt ", 4) == 0 && size >= 16) {
+            uint8_t fmt[16];
+            if (fread(fmt, 1, sizeof(fmt), source) != sizeof(fmt)) {
+                break;
+            }
+            if (get16(fmt) != 1 || get16(fmt + 2) != CHANNELS || get32(fmt + 4) != SAMPLE_RATE ||
+                get16(fmt + 14) != BITS_PER_SAMPLE) {
+                ESP_LOGW(TAG, "%s is not %d Hz mono 16-bit PCM - playing it as such anyway",
+                         capture_path, SAMPLE_RATE);
+            }
+            fseek(source, (long)(size - sizeof(fmt) + (size & 1)), SEEK_CUR);
+        } else if (memcmp(chunk, "data", 4) == 0) {
+            source_data_start = ftell(source);
+            source_data_end = source_data_start + (long)size;
+            ESP_LOGI(TAG, "Capture from %s (WAV, %lu samples)", capture_path,
+                     (unsigned long)(size / sizeof(int16_t)));
+            return true;
+        } else {
+            fseek(source, (long)(size + (size & 1)), SEEK_CUR);
+        }
+    }
+
+    ESP_LOGE(TAG, "%s: no WAV data chunk", capture_path);
+    fclose(source);
+    source = NULL;
+    return false;
+}
+
+// Header sizes are patched whenever playback stops, so the file is valid
+// after every call
+static void finish_sink(void)
+{
+    uint8_t header[WAV_HEADER_SIZE];
+    uint32_t data_bytes = sink_samples * sizeof(int16_t);
+    memcpy(header, "RIFF", 4);
+    put32(header + 4, 36 + data_bytes);
+    memcpy(header + 8, "WAVEfmt ", 8);
+    put32(header + 16, 16);
+    put16(header + 20, 1);                      // PCM
+    put16(header + 22, CHANNELS);
+    put32(header + 24, SAMPLE_RATE);
+    put32(header + 28, SAMPLE_RATE * CHANNELS * BITS_PER_SAMPLE / 8);
+    put16(header + 32, CHANNELS * BITS_PER_SAMPLE / 8);
+    put16(header + 34, BITS_PER_SAMPLE);
+    memcpy(header + 36, "data", 4);
+    put32(header + 40, data_bytes);
+
+    fseek(sink, 0, SEEK_SET);
+    fwrite(header, 1, sizeof(header), sink);
+    fseek(sink, 0, SEEK_END);
+    fflush(sink);
+}
+
+void audio_backend_file_configure(const char* capture, const char* playback, bool loop)
+{
+    snprintf(capture_path, sizeof(capture_path), "%s", capture ? capture : "");
+    snprintf(playback_path, sizeof(playback_path), "%s", playback ? playback : "");
+    loop_source = loop;
+}
+
+bool audio_backend_file_eof(void)
+{
+    return source_eof;
+}
+
+static void file_deinit(void);
+
+static bool file_init(void)
+{
+    source_data_start = 0;
+    source_data_end = -1;
+    source_eof = false;
+    sink_samples = 0;
+
+    if (capture_path[0] && !open_source()) {
+        return false;
+    }
+    if (playback_path[0]) {
+        sink = fopen(playback_path, "w+b");
+        if (!sink) {
+            ESP_LOGE(TAG, "Cannot create %s", playback_path);
+            file_deinit();
+            return false;
+        }
+        finish_sink();
+        ESP_LOGI(TAG, "Playback to %s", playback_path);
+    }
+    return true;
+}
+
+static void file_deinit(void)
+{
+    if (source) {
+        fclose(source);
+        source = NULL;
+    }
+    if (sink) {
+        finish_sink();
+        fclose(sink);
+        sink = NULL;
+    }
+}
+
+static void file_stop_playback(void)
+{
+    if (sink) {
+        finish_sink();
+    }
+}
+
+static size_t file_read(int16_t* samples, size_t count)
+{
+    size_t got = 0;
+    bool rewound = false;
+    while (source && !source_eof && got < count) {
+        size_t wanted = count - got;
+        if (source_data_end >= 0) {
+            size_t left = (size_t)(source_data_end - ftell(source)) / sizeof(int16_t);
+            if (wanted > left) {
+                wanted = left;
+            }
+        }
+
+        uint8_t bytes[2 * DMA_BUF_LEN];
+        if (wanted > DMA_BUF_LEN) {
+            wanted = DMA_BUF_LEN;
+        }
+        size_t n = wanted ? fread(bytes, sizeof(int16_t), wanted, source) : 0;
+        for (size_t i = 0; i < n; i++) {
+            samples[got + i] = (int16_t)get16(bytes + 2 * i);
+        }
+        got += n;
+
+        if (n < wanted || wanted == 0) {
+            // Nothing read right after a rewind: the source holds no samples
+            if (loop_source && !(rewound && n == 0)) {
+                fseek(source, source_data_start, SEEK_SET);
+                rewound = true;
+            } else {
+                source_eof = true;
+                ESP_LOGI(TAG, "End of %s", capture_path);
+            }
+        }
+    }
+
+    // A finished (or missing) source keeps delivering silence like a quiet room
+    memset(samples + got, 0, (count - got) * sizeof(int16_t));
+    return count;
+}
+
+static size_t file_write(const int16_t* samples, size_t count)
+{
+    if (!sink) {
+        return count;
+    }
+    uint8_t bytes[2 * DMA_BUF_LEN];
+    size_t done = 0;
+    while (done < count) {
+        size_t chunk = count - done < DMA_BUF_LEN ? count - done : DMA_BUF_LEN;
+        for (size_t i = 0; i < chunk; i++) {
+            put16(bytes + 2 * i, (uint16_t)samples[done + i]);
+        }
+        if (fwrite(bytes, sizeof(int16_t), chunk, sink) != chunk) {
+            break;
+        }
+        done += chunk;
+    }
+    sink_samples += done;
+    return done;
+}
+
+const audio_backend_t audio_backend_file = {
+    .name = "file",
+    .init = file_init,
+    .deinit = file_deinit,
+    .stop_playback = file_stop_playback,
+    .read = file_read,
+    .write = file_write,
+};
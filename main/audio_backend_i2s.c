@@ -0,0 +1,262 @@
+#include "audio_backend.h"
+#include "audio_handler.h"
+#include "gpio_handler.h"
+#include "esp_log.h"
+#include "esp_attr.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "driver/i2s_std.h"
+
+static const char *TAG = "AUDIO_I2S";
+
+// A write waits at most two frames: the media task must never hang on a
+// codec that stopped clocking
+#define I2S_IO_TIMEOUT_MS   40
+
+static i2s_chan_handle_t tx_handle = NULL;
+static i2s_chan_handle_t rx_handle = NULL;
+static bool rx_enabled = false;
+static bool tx_enabled = false;
+static uint32_t io_errors = 0;
+
+// Capture is lent straight out of the DMA buffers. The receive interrupt
+// queues each buffer as the DMA completes it; the media task borrows them in
+// order and returns them once encoded. A buffer stays intact until the DMA
+// comes round to it again, DMA_BUF_COUNT frames later, so at most
+// CAPTURE_MAX_HELD are kept: one is being written and one is spare.
+#define CAPTURE_MAX_HELD    (DMA_BUF_COUNT - 2)
+
+typedef struct {
+    const int16_t* samples;
+    uint16_t count;
+    int64_t captured_us;
+} capture_slot_t;
+
+static capture_slot_t capture_ring[DMA_BUF_COUNT];
+static uint8_t capture_head = 0;    // Oldest held buffer
+static uint8_t capture_held = 0;    // Buffers queued or lent
+static uint8_t capture_lent = 0;    // The first capture_lent held buffers are out on loan
+static uint32_t capture_overruns = 0;
+static portMUX_TYPE capture_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static void i2s_stop_capture(void);
+
+// Drop the oldest buffer that is not lent out (call with capture_lock held)
+static void IRAM_ATTR capture_drop_oldest_queued(void)
+{
+    for (uint8_t i = capture_lent; i + 1 < capture_held; i++) {
+        capture_ring[(capture_head + i) % DMA_BUF_COUNT] = capture_ring[(capture_head + i + 1) % DMA_BUF_COUNT];
+    }
+    capture_held--;
+    capture_overruns++;
+}
+
+static bool IRAM_ATTR on_capture(i2s_chan_handle_t handle, i2s_event_data_t* event, void* user_ctx)
+{
+    int64_t now = esp_timer_get_time();
+    portENTER_CRITICAL_ISR(&capture_lock);
+    if (capture_held >= CAPTURE_MAX_HELD) {
+        if (capture_held == capture_lent) {
+            // Everything is on loan: the new frame has nowhere to go
+            capture_overruns++;
+            portEXIT_CRITICAL_ISR(&capture_lock);
+            return false;
+        }
+        capture_drop_oldest_queued();
+    }
+    capture_slot_t* slot = &capture_ring[(capture_head + capture_held) % DMA_BUF_COUNT];
+    slot->samples = (const int16_t*)event->dma_buf;
+    slot->count = event->size / sizeof(int16_t);
+    slot->captured_us = now;
+    capture_held++;
+    portEXIT_CRITICAL_ISR(&capture_lock);
+    return false;
+}
+
+static void i2s_deinit(void);
+
+static bool i2s_init(void)
+{
+    // Full duplex on one controller. DMA_BUF_COUNT descriptors of one 20 ms
+    // frame each: capture can fall that far behind before samples are lost.
+    // auto_clear plays silence instead of the last buffer on an underrun.
+    i2s_chan_config_t chan_cfg = I2S_CHANNEL_DEFAULT_CONFIG(I2S_NUM_0, I2S_ROLE_MASTER);
+    chan_cfg.dma_desc_num = DMA_BUF_COUNT;
+    chan_cfg.dma_frame_num = DMA_BUF_LEN;
+    chan_cfg.auto_clear = true;
+
+    esp_err_t ret = i2s_new_channel(&chan_cfg, &tx_handle, &rx_handle);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to create I2S channels: %s", esp_err_to_name(ret));
+        return false;
+    }
+
+    i2s_std_config_t std_cfg = {
+        .clk_cfg = I2S_STD_CLK_DEFAULT_CONFIG(SAMPLE_RATE),
+        .slot_cfg = I2S_STD_PHILIPS_SLOT_DEFAULT_CONFIG(I2S_DATA_BIT_WIDTH_16BIT, I2S_SLOT_MODE_MONO),
+        .gpio_cfg = {
+            .mclk = I2S_GPIO_UNUSED,
+            .bclk = I2S_SCK_PIN,
+            .ws = I2S_WS_PIN,
+            .dout = I2S_SD_OUT_PIN,
+            .din = I2S_SD_IN_PIN,
+            .invert_flags = {
+                .mclk_inv = false,
+                .bclk_inv = false,
+                .ws_inv = false,
+            },
+        },
+    };
+    ret = i2s_channel_init_std_mode(tx_handle, &std_cfg);
+    if (ret == ESP_OK) {
+        ret = i2s_channel_init_std_mode(rx_handle, &std_cfg);
+    }
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to configure I2S: %s", esp_err_to_name(ret));
+        i2s_deinit();
+        return false;
+    }
+
+    i2s_event_callbacks_t callbacks = {
+        .on_recv = on_capture,
+    };
+    ret = i2s_channel_register_event_callback(rx_handle, &callbacks, NULL);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to register I2S receive callback: %s", esp_err_to_name(ret));
+        i2s_deinit();
+        return false;
+    }
+
+    ESP_LOGI(TAG, "I2S ready: %d Hz, DMA %d x %d frames", SAMPLE_RATE, DMA_BUF_COUNT, DMA_BUF_LEN);
+    return true;
+}
+
+static void i2s_deinit(void)
+{
+    if (rx_handle) {
+        i2s_stop_capture();
+        i2s_del_channel(rx_handle);
+        rx_handle = NULL;
+    }
+    if (tx_handle) {
+        if (tx_enabled) {
+            i2s_channel_disable(tx_handle);
+        }
+        i2s_del_channel(tx_handle);
+        tx_handle = NULL;
+    }
+    rx_enabled = false;
+    tx_enabled = false;
+}
+
+static void i2s_start_capture(void)
+{
+    if (rx_handle && !rx_enabled && i2s_channel_enable(rx_handle) == ESP_OK) {
+        // Nothing borrowed can survive a restart of the DMA
+        portENTER_CRITICAL(&capture_lock);
+        capture_head = 0;
+        capture_held = 0;
+        capture_lent = 0;
+        portEXIT_CRITICAL(&capture_lock);
+        rx_enabled = true;
+        ESP_LOGI(TAG, "Audio recording started");
+    }
+}
+
+static void i2s_stop_capture(void)
+{
+    if (rx_handle && rx_enabled) {
+        i2s_channel_disable(rx_handle);
+        rx_enabled = false;
+        ESP_LOGI(TAG, "Audio recording stopped");
+    }
+}
+
+static void i2s_start_playback(void)
+{
+    if (tx_handle && !tx_enabled && i2s_channel_enable(tx_handle) == ESP_OK) {
+        tx_enabled = true;
+        ESP_LOGI(TAG, "Audio playback started");
+    }
+}
+
+static void i2s_stop_playback(void)
+{
+    if (tx_handle && tx_enabled) {
+        i2s_channel_disable(tx_handle);
+        tx_enabled = false;
+        ESP_LOGI(TAG, "Audio playback stopped");
+    }
+}
+
+// Errors are logged once per 50 (one second of media ticks)
+static void io_error(const char* what, esp_err_t ret)
+{
+    if (io_errors++ % 50 == 0) {
+        ESP_LOGE(TAG, "I2S %s error: %s (%lu so far)", what, esp_err_to_name(ret), (unsigned long)io_errors);
+    }
+}
+
+static bool i2s_borrow(audio_frame_t* frame)
+{
+    bool ok = false;
+    portENTER_CRITICAL(&capture_lock);
+    // Bounded capture-to-wire latency: frames waiting longer are dropped
+    while (capture_held - capture_lent > AUDIO_CAPTURE_MAX_QUEUED) {
+        capture_drop_oldest_queued();
+    }
+    if (rx_enabled && capture_held > capture_lent && capture_lent < AUDIO_MAX_BORROWED) {
+        const capture_slot_t* slot = &capture_ring[(capture_head + capture_lent) % DMA_BUF_COUNT];
+        frame->samples = slot->samples;
+        frame->count = slot->count;
+        frame->captured_us = slot->captured_us;
+        capture_lent++;
+        ok = true;
+    }
+    portEXIT_CRITICAL(&capture_lock);
+    return ok;
+}
+
+static void i2s_release(void)
+{
+    portENTER_CRITICAL(&capture_lock);
+    if (capture_lent > 0) {
+        capture_head = (capture_head + 1) % DMA_BUF_COUNT;
+        capture_held--;
+        capture_lent--;
+    }
+    portEXIT_CRITICAL(&capture_lock);
+}
+
+static uint32_t i2s_overruns(void)
+{
+    return capture_overruns;
+}
+
+static size_t i2s_write(const int16_t* samples, size_t count)
+{
+    if (!tx_enabled) {
+        return 0;
+    }
+    size_t bytes_written = 0;
+    esp_err_t ret = i2s_channel_write(tx_handle, samples, count * sizeof(int16_t), &bytes_written,
+                                      pdMS_TO_TICKS(I2S_IO_TIMEOUT_MS));
+    if (ret != ESP_OK && ret != ESP_ERR_TIMEOUT) {
+        io_error("write", ret);
+    }
+    return bytes_written / sizeof(int16_t);
+}
+
+const audio_backend_t audio_backend_i2s = {
+    .name = "i2s",
+    .init = i2s_init,
+    .deinit = i2s_deinit,
+    .start_capture = i2s_start_capture,
+    .stop_capture = i2s_stop_capture,
+    .start_playback = i2s_start_playback,
+    .stop_playback = i2s_stop_playback,
+    .write = i2s_write,
+    .borrow = i2s_borrow,
+    .release = i2s_release,
+    .overruns = i2s_overruns,
+};
@@ -0,0 +1,53 @@
+#include "audio_backend.h"
+#include "audio_handler.h"
+#include <string.h>
+
+// Fixed delay line: capture starts with AUDIO_LOOPBACK_DELAY_FRAMES of
+// silence, then returns what playback wrote. Room for two extra frames
+// absorbs a tick where the media engine writes before it reads. Only the
+// media task touches the ring.
+#define LOOPBACK_SAMPLES    ((AUDIO_LOOPBACK_DELAY_FRAMES + 2) * DMA_BUF_LEN)
+
+static int16_t ring[LOOPBACK_SAMPLES];
+static size_t head = 0;     // Next sample to read
+static size_t fill = 0;
+
+static void loopback_start_capture(void)
+{
+    memset(ring, 0, sizeof(ring));
+    head = 0;
+    fill = AUDIO_LOOPBACK_DELAY_FRAMES * DMA_BUF_LEN;
+}
+
+static size_t loopback_read(int16_t* samples, size_t count)
+{
+    size_t available = count < fill ? count : fill;
+    for (size_t i = 0; i < available; i++) {
+        samples[i] = ring[(head + i) % LOOPBACK_SAMPLES];
+    }
+    head = (head + available) % LOOPBACK_SAMPLES;
+    fill -= available;
+
+    // Like a microphone, capture never runs dry: pad with silence
+    memset(samples + available, 0, (count - available) * sizeof(int16_t));
+    return count;
+}
+
+static size_t loopback_write(const int16_t* samples, size_t count)
+{
+    size_t space = LOOPBACK_SAMPLES - fill;
+    size_t accepted = count < space ? count : space;
+    size_t tail = (head + fill) % LOOPBACK_SAMPLES;
+    for (size_t i = 0; i < accepted; i++) {
+        ring[(tail + i) % LOOPBACK_SAMPLES] = samples[i];
+    }
+    fill += accepted;
+    return accepted;
+}
+
+const audio_backend_t audio_backend_loopback = {
+    .name = "loopback",
+    .start_capture = loopback_start_capture,
+    .read = loopback_read,
+    .write = loopback_write,
+};
@@ -1,102 +1,145 @@
 #include "audio_handler.h"
-#include "gpio_handler.h"
 #include "esp_log.h"
-#include "freertos/FreeRTOS.h"
-#include "driver/i2s_std.h"
+#include "esp_timer.h"
+#include <string.h>
 
 static const char *TAG = "AUDIO";
-static i2s_chan_handle_t tx_handle = NULL;
-static i2s_chan_handle_t rx_handle = NULL;
-static bool audio_hardware_present = false;
+static const audio_backend_t *backend = &audio_backend_null;
+
+// Frames lent out for backends without borrow(): read() fills the next of
+// these, so such backends still cost exactly one copy
+static int16_t read_frames[AUDIO_MAX_BORROWED][DMA_BUF_LEN];
+static uint8_t read_head = 0;       // Oldest frame lent out
+static uint8_t read_borrowed = 0;
+
+static audio_capture_stats_t capture_stats = {0};
 
 void audio_handler_init(void)
 {
-    ESP_LOGW(TAG, "Audio handler initializing - hardware not connected, using dummy mode");
-    audio_hardware_present = false;
-    ESP_LOGI(TAG, "Audio handler initialized (dummy mode)");
+#if AUDIO_I2S_ENABLED
+    audio_handler_set_backend(&audio_backend_i2s);
+#else
+    ESP_LOGW(TAG, "Audio hardware not connected - using the null backend");
+    audio_handler_set_backend(&audio_backend_null);
+#endif
+}
+
+bool audio_handler_set_backend(const audio_backend_t *next)
+{
+    if (!next) {
+        return false;
+    }
+    if (backend->deinit) {
+        backend->deinit();
+    }
+
+    bool ok = !next->init || next->init();
+    if (!ok) {
+        ESP_LOGE(TAG, "Audio backend %s failed to initialize - using null", next->name);
+        next = &audio_backend_null;
+    }
+    backend = next;
+    ESP_LOGI(TAG, "Audio backend: %s", backend->name);
+    return ok;
+}
+
+const char *audio_handler_backend_name(void)
+{
+    return backend->name;
 }
 
 void audio_start_recording(void)
 {
-    if (audio_hardware_present) {
-        ESP_LOGI(TAG, "Audio recording started");
-        if (rx_handle) {
-            i2s_channel_enable(rx_handle);
-        }
-    } else {
-        ESP_LOGW(TAG, "Audio recording started (dummy - hardware not connected)");
+    read_head = 0;
+    read_borrowed = 0;
+    if (backend->start_capture) {
+        backend->start_capture();
     }
 }
 
 void audio_stop_recording(void)
 {
-    if (audio_hardware_present) {
-        ESP_LOGI(TAG, "Audio recording stopped");
-        if (rx_handle) {
-            i2s_channel_disable(rx_handle);
-        }
-    } else {
-        ESP_LOGW(TAG, "Audio recording stopped (dummy - hardware not connected)");
+    if (backend->stop_capture) {
+        backend->stop_capture();
     }
 }
 
 void audio_start_playback(void)
 {
-    if (audio_hardware_present) {
-        ESP_LOGI(TAG, "Audio playback started");
-        if (tx_handle) {
-            i2s_channel_enable(tx_handle);
-        }
-    } else {
-        ESP_LOGW(TAG, "Audio playback started (dummy - hardware not connected)");
+    if (backend->start_playback) {
+        backend->start_playback();
     }
 }
 
 void audio_stop_playback(void)
 {
-    if (audio_hardware_present) {
-        ESP_LOGI(TAG, "Audio playback stopped");
-        if (tx_handle) {
-            i2s_channel_disable(tx_handle);
-        }
-    } else {
-        ESP_LOGW(TAG, "Audio playback stopped (dummy - hardware not connected)");
+    if (backend->stop_playback) {
+        backend->stop_playback();
     }
 }
 
 size_t audio_read(int16_t *buffer, size_t length)
 {
-    if (audio_hardware_present) {
-        size_t bytes_read = 0;
-        if (rx_handle) {
-            esp_err_t ret = i2s_channel_read(rx_handle, buffer, length * sizeof(int16_t), &bytes_read, portMAX_DELAY);
-            if (ret != ESP_OK) {
-                ESP_LOGE(TAG, "I2S read error: %s", esp_err_to_name(ret));
-                return 0;
-            }
+    if (backend->read) {
+        return backend->read(buffer, length);
+    }
+
+    // Zero-copy backend: copy out of borrowed frames
+    size_t total = 0;
+    audio_frame_t frame;
+    while (total < length && audio_capture_borrow(&frame)) {
+        size_t n = frame.count < length - total ? frame.count : length - total;
+        memcpy(buffer + total, frame.samples, n * sizeof(int16_t));
+        audio_capture_release();
+        total += n;
+    }
+    return total;
+}
+
+bool audio_capture_borrow(audio_frame_t *frame)
+{
+    bool ok = false;
+    if (backend->borrow) {
+        ok = backend->borrow(frame);
+    } else if (read_borrowed < AUDIO_MAX_BORROWED) {
+        int16_t *buf = read_frames[(read_head + read_borrowed) % AUDIO_MAX_BORROWED];
+        size_t n = backend->read(buf, DMA_BUF_LEN);
+        if (n > 0) {
+            frame->samples = buf;
+            frame->count = n;
+            frame->captured_us = esp_timer_get_time();
+            read_borrowed++;
+            ok = true;
         }
-        return bytes_read / sizeof(int16_t);
+    }
+
+    if (ok) {
+        capture_stats.frames++;
     } else {
-        ESP_LOGW(TAG, "Audio read (dummy - hardware not connected) - returning silence");
-        memset(buffer, 0, length * sizeof(int16_t));
-        return length;
+        capture_stats.underruns++;
     }
+    return ok;
 }
 
-size_t audio_write(const int16_t *buffer, size_t length)
+void audio_capture_release(void)
 {
-    if (audio_hardware_present) {
-        size_t bytes_written = 0;
-        if (tx_handle) {
-            esp_err_t ret = i2s_channel_write(tx_handle, buffer, length * sizeof(int16_t), &bytes_written, portMAX_DELAY);
-            if (ret != ESP_OK) {
-                ESP_LOGE(TAG, "I2S write error: %s", esp_err_to_name(ret));
-                return 0;
-            }
+    if (backend->borrow) {
+        if (backend->release) {
+            backend->release();
         }
-        return bytes_written / sizeof(int16_t);
-    } else {
-        ESP_LOGW(TAG, "Audio write (dummy - hardware not connected) - ignoring data");
-        return length;
+    } else if (read_borrowed > 0) {
+        read_head = (read_head + 1) % AUDIO_MAX_BORROWED;
+        read_borrowed--;
     }
-}
\ No newline at end of file
+}
+
+void audio_get_capture_stats(audio_capture_stats_t *stats)
+{
+    *stats = capture_stats;
+    stats->overruns = backend->overruns ? backend->overruns() : 0;
+}
+
+size_t audio_write(const int16_t *buffer, size_t length)
+{
+    return backend->write(buffer, length);
+}
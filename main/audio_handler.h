@@ -1,13 +1,19 @@
 #ifndef AUDIO_HANDLER_H
 #define AUDIO_HANDLER_H
 
-#include "driver/i2s_std.h"
+#include <stdint.h>
+#include <stddef.h>
+#include "audio_backend.h"
 
 #define SAMPLE_RATE     8000
 #define BITS_PER_SAMPLE 16
 #define CHANNELS        1
-#define DMA_BUF_COUNT   8
-#define DMA_BUF_LEN     1024
+#define DMA_BUF_COUNT   8       // I2S DMA descriptors per direction
+#define DMA_BUF_LEN     160     // Frames per DMA buffer: one 20 ms media frame
+
+// The codec board is not fitted yet: until then the null backend stands in
+// for the I2S one
+#define AUDIO_I2S_ENABLED   0
 
 typedef struct {
     int16_t *buffer;
@@ -15,6 +21,21 @@ typedef struct {
 } audio_buffer_t;
 
 void audio_handler_init(void);
+
+/**
+ * Switch the audio device (e.g. to audio_backend_file on the host or
+ * audio_backend_loopback for a test). Call while no call is running.
+ *
+ * @return false if the backend failed to initialize; the null backend is
+ *         used instead
+ */
+bool audio_handler_set_backend(const audio_backend_t *backend);
+
+/**
+ * Name of the backend in use ("i2s", "file", "loopback", "null")
+ */
+const char *audio_handler_backend_name(void);
+
 void audio_start_recording(void);
 void audio_stop_recording(void);
 void audio_start_playback(void);
@@ -22,4 +43,29 @@ void audio_stop_playback(void);
 size_t audio_read(int16_t *buffer, size_t length);
 size_t audio_write(const int16_t *buffer, size_t length);
 
-#endif
\ No newline at end of file
+/**
+ * Borrow the next captured frame without copying it (non-blocking). With a
+ * backend that only has read(), the frame is read into one of
+ * AUDIO_MAX_BORROWED internal buffers.
+ *
+ * @return false if no frame is ready (counted as an underrun)
+ */
+bool audio_capture_borrow(audio_frame_t *frame);
+
+/**
+ * Give back the oldest borrowed frame
+ */
+void audio_capture_release(void);
+
+/**
+ * Capture counters since boot
+ */
+typedef struct {
+    uint32_t frames;        // Frames borrowed
+    uint32_t underruns;     // Borrow attempts with no frame ready
+    uint32_t overruns;      // Frames the backend dropped before they were borrowed
+} audio_capture_stats_t;
+
+void audio_get_capture_stats(audio_capture_stats_t *stats);
+
+#endif
@@ -0,0 +1,186 @@
+#include "call_trace.h"
+#include "esp_attr.h"
+#include "esp_cpu.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include <string.h>
+
+// Raw records live in internal RAM: the doorbell ISR writes here and must
+// not touch PSRAM while the flash cache may be disabled
+#define CALL_TRACE_RING_SIZE        256     // Records (power of two)
+#define CALL_TRACE_EXPORT_MAGIC     "CTR1"
+
+// A press more than this long after the last call start begins a new call;
+// presses within it (bounce, impatient visitors) belong to the current one
+#define CALL_TRACE_CALL_GAP_US      (10 * 1000 * 1000)
+
+static DRAM_ATTR call_trace_record_t ring[CALL_TRACE_RING_SIZE];
+static uint32_t ring_count = 0;     // Total records written; ring index is count % size
+
+static call_trace_call_t current_call;
+static uint32_t call_start_us = 0;
+static call_trace_hist_t histograms[CALL_TRACE_EVENT_COUNT];
+
+static portMUX_TYPE trace_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static const char* const event_names[CALL_TRACE_EVENT_COUNT] = {
+    [CALL_TRACE_DOORBELL_ISR] = "doorbell_isr",
+    [CALL_TRACE_DOORBELL_DEQUEUE] = "doorbell_dequeue",
+    [CALL_TRACE_MAKE_CALL] = "make_call",
+    [CALL_TRACE_INVITE_SENT] = "invite_sent",
+    [CALL_TRACE_RESPONSE_100] = "response_100",
+    [CALL_TRACE_RESPONSE_180] = "response_18x",
+    [CALL_TRACE_RESPONSE_200] = "response_200",
+    [CALL_TRACE_RTP_START] = "rtp_start",
+    [CALL_TRACE_RTP_FIRST_TX] = "rtp_first_tx",
+    [CALL_TRACE_RTP_FIRST_RX] = "rtp_first_rx",
+};
+
+const char* call_trace_event_name(call_trace_event_t event)
+{
+    if ((unsigned)event < CALL_TRACE_EVENT_COUNT) {
+        return event_names[event];
+    }
+    return "unknown";
+}
+
+// Open a new per-call breakdown starting at now_us (trace_lock held)
+static void IRAM_ATTR call_trace_begin_call(uint32_t now_us)
+{
+    current_call.call_id++;
+    current_call.complete = false;
+    for (int i = 0; i < CALL_TRACE_EVENT_COUNT; i++) {
+        current_call.offset_us[i] = UINT32_MAX;
+    }
+    call_start_us = now_us;
+}
+
+// Add a call's offset for one event to its histogram (trace_lock held)
+static void IRAM_ATTR call_trace_hist_add(call_trace_event_t event, uint32_t offset_us)
+{
+    call_trace_hist_t* hist = &histograms[event];
+    uint32_t ms = offset_us / 1000;
+    int bucket = 0;
+    while (ms > 1 && bucket < CALL_TRACE_HIST_BUCKETS - 1) {
+        ms >>= 1;
+        bucket++;
+    }
+    hist->buckets[bucket]++;
+    if (hist->count == 0 || offset_us < hist->min_us) {
+        hist->min_us = offset_us;
+    }
+    if (offset_us > hist->max_us) {
+        hist->max_us = offset_us;
+    }
+    hist->sum_us += offset_us;
+    hist->count++;
+}
+
+void IRAM_ATTR call_trace_point(call_trace_event_t event, uint16_t arg)
+{
+    if ((unsigned)event >= CALL_TRACE_EVENT_COUNT) {
+        return;
+    }
+
+    uint32_t now_us = (uint32_t)esp_timer_get_time();
+
+    portENTER_CRITICAL_SAFE(&trace_lock);
+
+    call_trace_record_t* record = &ring[ring_count % CALL_TRACE_RING_SIZE];
+    record->time_us = now_us;
+    record->event = (uint8_t)event;
+    record->core = (uint8_t)esp_cpu_get_core_id();
+    record->arg = arg;
+    ring_count++;
+
+    // A press starts a call; so does a call placed without one (web UI,
+    // BOOT button) unless it follows the press that started it
+    if (event == CALL_TRACE_DOORBELL_ISR || event == CALL_TRACE_MAKE_CALL) {
+        if (current_call.call_id == 0 || current_call.complete ||
+            now_us - call_start_us > CALL_TRACE_CALL_GAP_US ||
+            (event == CALL_TRACE_MAKE_CALL && current_call.offset_us[event] != UINT32_MAX)) {
+            call_trace_begin_call(now_us);
+        }
+    }
+
+    // First occurrence per call only: retransmissions, authenticated INVITE
+    // retries and later RTP packets stay in the raw ring
+    if (current_call.call_id != 0 && !current_call.complete &&
+        current_call.offset_us[event] == UINT32_MAX) {
+        uint32_t offset_us = now_us - call_start_us;
+        current_call.offset_us[event] = offset_us;
+        call_trace_hist_add(event, offset_us);
+        if (event == CALL_TRACE_RTP_FIRST_RX) {
+            current_call.complete = true;
+        }
+    }
+
+    portEXIT_CRITICAL_SAFE(&trace_lock);
+}
+
+void call_trace_get_last_call(call_trace_call_t* call)
+{
+    if (!call) {
+        return;
+    }
+    portENTER_CRITICAL(&trace_lock);
+    memcpy(call, &current_call, sizeof(*call));
+    portEXIT_CRITICAL(&trace_lock);
+}
+
+void call_trace_get_histogram(call_trace_event_t event, call_trace_hist_t* hist)
+{
+    if (!hist || (unsigned)event >= CALL_TRACE_EVENT_COUNT) {
+        return;
+    }
+    portENTER_CRITICAL(&trace_lock);
+    memcpy(hist, &histograms[event], sizeof(*hist));
+    portEXIT_CRITICAL(&trace_lock);
+}
+
+size_t call_trace_export_size(void)
+{
+    return 8 + sizeof(ring);
+}
+
+size_t call_trace_export(uint8_t* buf, size_t size)
+{
+    if (!buf || size < 8) {
+        return 0;
+    }
+
+    size_t max_records = (size - 8) / sizeof(call_trace_record_t);
+    uint8_t* out = buf + 8;
+
+    // Copy in chunks so interrupts are never held off for the whole ring
+    portENTER_CRITICAL(&trace_lock);
+    uint32_t end = ring_count;
+    portEXIT_CRITICAL(&trace_lock);
+
+    uint32_t available = end < CALL_TRACE_RING_SIZE ? end : CALL_TRACE_RING_SIZE;
+    if (available > max_records) {
+        available = max_records;
+    }
+
+    uint16_t count = 0;
+    for (uint32_t pos = end - available; pos != end; pos++) {
+        portENTER_CRITICAL(&trace_lock);
+        // Skip records overwritten since we sampled the end
+        bool valid = ring_count - pos <= CALL_TRACE_RING_SIZE;
+        if (valid) {
+            memcpy(out, &ring[pos % CALL_TRACE_RING_SIZE], sizeof(call_trace_record_t));
+        }
+        portEXIT_CRITICAL(&trace_lock);
+        if (valid) {
+            out += sizeof(call_trace_record_t);
+            count++;
+        }
+    }
+
+    memcpy(buf, CALL_TRACE_EXPORT_MAGIC, 4);
+    buf[4] = (uint8_t)(count & 0xFF);
+    buf[5] = (uint8_t)(count >> 8);
+    buf[6] = (uint8_t)sizeof(call_trace_record_t);
+    buf[7] = 0;
+    return 8 + (size_t)count * sizeof(call_trace_record_t);
+}
@@ -0,0 +1,99 @@
+#ifndef CALL_TRACE_H
+#define CALL_TRACE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * Trace points on the path from a doorbell press to two-way audio, in the
+ * order they normally occur. IDs are part of the binary export format:
+ * append new ones before CALL_TRACE_EVENT_COUNT, never renumber.
+ */
+typedef enum {
+    CALL_TRACE_DOORBELL_ISR = 0,    // GPIO interrupt (arg: bell)
+    CALL_TRACE_DOORBELL_DEQUEUE,    // doorbell_task took the event (arg: bell)
+    CALL_TRACE_MAKE_CALL,           // sip_client_make_call()
+    CALL_TRACE_INVITE_SENT,         // INVITE handed to sendto() (arg: 1 if authenticated)
+    CALL_TRACE_RESPONSE_100,        // 100 Trying
+    CALL_TRACE_RESPONSE_180,        // 180 Ringing / 183 Session Progress (arg: status)
+    CALL_TRACE_RESPONSE_200,        // 200 OK to the INVITE
+    CALL_TRACE_RTP_START,           // rtp_start_session()
+    CALL_TRACE_RTP_FIRST_TX,        // First RTP packet sent
+    CALL_TRACE_RTP_FIRST_RX,        // First RTP packet received
+    CALL_TRACE_EVENT_COUNT
+} call_trace_event_t;
+
+#define CALL_TRACE_HIST_BUCKETS     16      // Bucket i: [2^i, 2^(i+1)) ms since the call start; 0 also takes < 1 ms
+
+/**
+ * One raw trace record (also the binary export record, little endian)
+ */
+typedef struct __attribute__((packed)) {
+    uint32_t time_us;       // esp_timer time, low 32 bits
+    uint8_t event;          // call_trace_event_t
+    uint8_t core;           // CPU that recorded it
+    uint16_t arg;           // Event specific
+} call_trace_record_t;
+
+/**
+ * Breakdown of one call: microseconds from the call start (doorbell
+ * interrupt, or sip_client_make_call() for calls started elsewhere) to the
+ * first occurrence of each event; UINT32_MAX if it did not occur
+ */
+typedef struct {
+    uint32_t call_id;                               // Counts calls since boot, 0 = none yet
+    bool complete;                                  // First RTP packet received
+    uint32_t offset_us[CALL_TRACE_EVENT_COUNT];
+} call_trace_call_t;
+
+/**
+ * Running histogram of the time from call start to one event
+ */
+typedef struct {
+    uint32_t count;
+    uint32_t min_us;
+    uint32_t max_us;
+    uint64_t sum_us;
+    uint32_t buckets[CALL_TRACE_HIST_BUCKETS];
+} call_trace_hist_t;
+
+/**
+ * Record a trace point. ISR safe, never blocks.
+ *
+ * @param event Trace point
+ * @param arg Event specific value
+ */
+void call_trace_point(call_trace_event_t event, uint16_t arg);
+
+/**
+ * Name of a trace point for the JSON API ("doorbell_isr", ...)
+ */
+const char* call_trace_event_name(call_trace_event_t event);
+
+/**
+ * Copy the breakdown of the current or last call
+ */
+void call_trace_get_last_call(call_trace_call_t* call);
+
+/**
+ * Copy the histogram of one event over all calls since boot
+ */
+void call_trace_get_histogram(call_trace_event_t event, call_trace_hist_t* hist);
+
+/**
+ * Binary export: an 8-byte header ("CTR1", record count as uint16, record
+ * size as uint16) followed by the raw records, oldest first
+ *
+ * @param buf Output buffer
+ * @param size Buffer size; call_trace_export_size() bytes hold everything
+ * @return Bytes written
+ */
+size_t call_trace_export(uint8_t* buf, size_t size);
+
+/**
+ * Buffer size needed for a full export
+ */
+size_t call_trace_export_size(void);
+
+#endif // CALL_TRACE_H
@@ -0,0 +1,707 @@
+#include "dns_cache.h"
+#include "esp_log.h"
+#include "esp_random.h"
+#include "lwip/netdb.h"
+#include "lwip/dns.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include <string.h>
+#include <stdio.h>
+
+static const char *TAG = "DNS_CACHE";
+
+#define DNS_CACHE_ENTRIES           8
+#define DNS_CACHE_NAME_LEN          64
+#define DNS_SRV_SERVICE_LEN         12      // "_sips._tcp"
+
+// TTL handling (seconds)
+#define DNS_CACHE_MIN_TTL_S         30      // Floor so tiny TTLs don't cause query storms
+#define DNS_CACHE_MAX_TTL_S         3600
+#define DNS_CACHE_DEFAULT_TTL_S     300     // getaddrinfo() fallback does not report a TTL
+#define DNS_CACHE_NEGATIVE_TTL_S    30
+
+// Refresh when this share of the TTL has elapsed, but only for names used
+// within the idle window - names nobody asks for are left to expire
+#define DNS_CACHE_REFRESH_PERCENT   80
+#define DNS_CACHE_IDLE_MS           (30 * 60 * 1000)
+
+#define DNS_QUERY_TIMEOUT_MS        2000
+#define DNS_PACKET_SIZE             512
+
+#define DNS_TYPE_A                  1
+#define DNS_TYPE_CNAME              5
+#define DNS_TYPE_SRV                33
+#define DNS_CLASS_IN                1
+
+#define DNS_REFRESH_TASK_STACK      4096
+#define DNS_REFRESH_TASK_PRIORITY   2
+#define DNS_REFRESH_MAX_SLEEP_MS    60000
+
+// DNS header structure
+#pragma pack(push, 1)
+typedef struct {
+    uint16_t id;
+    uint16_t flags;
+    uint16_t qdcount;
+    uint16_t ancount;
+    uint16_t nscount;
+    uint16_t arcount;
+} dns_header_t;
+#pragma pack(pop)
+
+typedef struct {
+    bool used;
+    bool negative;          // Lookup failed - cached to avoid hammering the resolver
+    bool refreshing;        // Background refresh in progress
+    bool stale;             // Served, but due for a lookup now (expired negative, SRV change, flush)
+    char name[DNS_CACHE_NAME_LEN];
+    struct in_addr addr;
+    uint16_t srv_port;      // Port from SRV record, 0 if none
+    uint32_t resolved_ms;
+    uint32_t ttl_ms;
+    uint32_t last_used_ms;
+} dns_cache_entry_t;
+
+typedef struct {
+    bool ok;
+    struct in_addr addr;
+    uint16_t srv_port;
+    uint32_t ttl_s;
+} dns_lookup_result_t;
+
+static dns_cache_entry_t cache[DNS_CACHE_ENTRIES];
+static SemaphoreHandle_t cache_mutex = NULL;
+static TaskHandle_t refresh_task_handle = NULL;
+static char srv_service[DNS_SRV_SERVICE_LEN] = "";   // Empty: no SRV lookup
+
+static uint32_t now_ms(void)
+{
+    return xTaskGetTickCount() * portTICK_PERIOD_MS;
+}
+
+static uint32_t clamp_ttl(uint32_t ttl_s)
+{
+    if (ttl_s < DNS_CACHE_MIN_TTL_S) {
+        return DNS_CACHE_MIN_TTL_S;
+    }
+    if (ttl_s > DNS_CACHE_MAX_TTL_S) {
+        return DNS_CACHE_MAX_TTL_S;
+    }
+    return ttl_s;
+}
+
+// ============================================================================
+// Wire format helpers
+// ============================================================================
+
+// Encode a dotted name as DNS labels; returns bytes written or 0 on overflow
+static size_t dns_encode_name(const char* name, uint8_t* out, size_t out_size)
+{
+    size_t pos = 0;
+    const char* label = name;
+
+    while (*label) {
+        const char* dot = strchr(label, '.');
+        size_t len = dot ? (size_t)(dot - label) : strlen(label);
+        if (len == 0 || len > 63 || pos + len + 2 > out_size) {
+            return 0;
+        }
+        out[pos++] = (uint8_t)len;
+        memcpy(out + pos, label, len);
+        pos += len;
+        if (!dot) {
+            break;
+        }
+        label = dot + 1;
+    }
+
+    if (pos + 1 > out_size) {
+        return 0;
+    }
+    out[pos++] = 0;
+    return pos;
+}
+
+// Read a (possibly compressed) name starting at offset; returns the offset
+// just past the name in the record, or 0 on malformed input
+static size_t dns_read_name(const uint8_t* msg, size_t msg_len, size_t offset,
+                            char* out, size_t out_size)
+{
+    size_t end = 0;
+    size_t out_pos = 0;
+    int jumps = 0;
+
+    while (offset < msg_len) {
+        uint8_t len = msg[offset];
+
+        if (len == 0) {
+            if (out && out_size > 0) {
+                out[out_pos < out_size ? out_pos : out_size - 1] = '\0';
+            }
+            return end ? end : offset + 1;
+        }
+
+        if ((len & 0xC0) == 0xC0) {
+            if (offset + 1 >= msg_len || ++jumps > 16) {
+                return 0;
+            }
+            if (!end) {
+                end = offset + 2;
+            }
+            offset = ((len & 0x3F) << 8) | msg[offset + 1];
+            continue;
+        }
+
+        if (offset + 1 + len > msg_len) {
+            return 0;
+        }
+        if (out) {
+            if (out_pos + len + 1 >= out_size) {
+                return 0;
+            }
+            if (out_pos > 0) {
+                out[out_pos++] = '.';
+            }
+            memcpy(out + out_pos, msg + offset + 1, len);
+            out_pos += len;
+        }
+        offset += 1 + len;
+    }
+    return 0;
+}
+
+static uint16_t read_u16(const uint8_t* p)
+{
+    return (uint16_t)((p[0] << 8) | p[1]);
+}
+
+static uint32_t read_u32(const uint8_t* p)
+{
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+// Send one query to the first configured DNS server and wait for the answer
+static int dns_query(const char* name, uint16_t qtype, uint8_t* response, size_t response_size)
+{
+    const ip_addr_t* server = dns_getserver(0);
+    if (!server || !IP_IS_V4(server) || ip_2_ip4(server)->addr == 0) {
+        return -1;
+    }
+
+    uint8_t query[DNS_PACKET_SIZE];
+    dns_header_t* header = (dns_header_t*)query;
+    memset(header, 0, sizeof(*header));
+    uint16_t id = esp_random() & 0xFFFF;
+    header->id = htons(id);
+    header->flags = htons(0x0100);  // Recursion desired
+    header->qdcount = htons(1);
+
+    size_t pos = sizeof(dns_header_t);
+    size_t name_len = dns_encode_name(name, query + pos, sizeof(query) - pos - 4);
+    if (name_len == 0) {
+        return -1;
+    }
+    pos += name_len;
+    query[pos++] = qtype >> 8;
+    query[pos++] = qtype & 0xFF;
+    query[pos++] = 0;
+    query[pos++] = DNS_CLASS_IN;
+
+    int sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (sock < 0) {
+        return -1;
+    }
+
+    struct timeval tv = {
+        .tv_sec = DNS_QUERY_TIMEOUT_MS / 1000,
+        .tv_usec = (DNS_QUERY_TIMEOUT_MS % 1000) * 1000,
+    };
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+    struct sockaddr_in server_addr = {
+        .sin_family = AF_INET,
+        .sin_port = htons(DNS_SERVER_PORT),
+        .sin_addr.s_addr = ip_2_ip4(server)->addr,
+    };
+
+    int received = -1;
+    if (sendto(sock, query, pos, 0, (struct sockaddr*)&server_addr, sizeof(server_addr)) == (int)pos) {
+        // Ignore stray datagrams that don't match our query ID
+        for (int attempt = 0; attempt < 3; attempt++) {
+            received = recv(sock, response, response_size, 0);
+            if (received < (int)sizeof(dns_header_t)) {
+                received = -1;
+                break;
+            }
+            if (read_u16(response) == id) {
+                break;
+            }
+            received = -1;
+        }
+    }
+
+    close(sock);
+    return received;
+}
+
+// Parse answers: A records (minimum TTL across the chain) or the best SRV record
+static bool dns_parse_response(const uint8_t* msg, int msg_len, uint16_t qtype,
+                               dns_lookup_result_t* result, char* srv_target, size_t srv_target_size)
+{
+    if (msg_len < (int)sizeof(dns_header_t)) {
+        return false;
+    }
+
+    uint16_t flags = read_u16(msg + 2);
+    if ((flags & 0x8000) == 0 || (flags & 0x000F) != 0) {
+        return false;   // Not a response, or NXDOMAIN/SERVFAIL/...
+    }
+
+    uint16_t qdcount = read_u16(msg + 4);
+    uint16_t ancount = read_u16(msg + 6);
+    size_t offset = sizeof(dns_header_t);
+
+    for (int i = 0; i < qdcount; i++) {
+        offset = dns_read_name(msg, msg_len, offset, NULL, 0);
+        if (offset == 0 || offset + 4 > (size_t)msg_len) {
+            return false;
+        }
+        offset += 4;
+    }
+
+    bool found = false;
+    uint32_t min_ttl = UINT32_MAX;
+    uint16_t best_priority = UINT16_MAX;
+    uint16_t best_weight = 0;
+
+    for (int i = 0; i < ancount; i++) {
+        offset = dns_read_name(msg, msg_len, offset, NULL, 0);
+        if (offset == 0 || offset + 10 > (size_t)msg_len) {
+            break;
+        }
+        uint16_t type = read_u16(msg + offset);
+        uint32_t ttl = read_u32(msg + offset + 4);
+        uint16_t rdlength = read_u16(msg + offset + 8);
+        offset += 10;
+        if (offset + rdlength > (size_t)msg_len) {
+            break;
+        }
+
+        if (type == DNS_TYPE_CNAME && qtype == DNS_TYPE_A) {
+            if (ttl < min_ttl) {
+                min_ttl = ttl;
+            }
+        } else if (type == DNS_TYPE_A && qtype == DNS_TYPE_A && rdlength == 4 && !found) {
+            memcpy(&result->addr.s_addr, msg + offset, 4);
+            if (ttl < min_ttl) {
+                min_ttl = ttl;
+            }
+            found = true;
+        } else if (type == DNS_TYPE_SRV && qtype == DNS_TYPE_SRV && rdlength > 6) {
+            uint16_t priority = read_u16(msg + offset);
+            uint16_t weight = read_u16(msg + offset + 2);
+            // Lowest priority wins; among equals the highest weight
+            if (priority < best_priority || (priority == best_priority && weight > best_weight)) {
+                if (dns_read_name(msg, msg_len, offset + 6, srv_target, srv_target_size)) {
+                    best_priority = priority;
+                    best_weight = weight;
+                    result->srv_port = read_u16(msg + offset + 4);
+                    min_ttl = ttl;
+                    found = true;
+                }
+            }
+        }
+
+        offset += rdlength;
+    }
+
+    if (found) {
+        result->ok = true;
+        result->ttl_s = clamp_ttl(min_ttl);
+    }
+    return found;
+}
+
+// ============================================================================
+// Lookup (blocking - runs in the refresh task)
+// ============================================================================
+
+static bool dns_lookup_a(const char* host, dns_lookup_result_t* result)
+{
+    uint8_t response[DNS_PACKET_SIZE];
+    int len = dns_query(host, DNS_TYPE_A, response, sizeof(response));
+    if (len > 0) {
+        return dns_parse_response(response, len, DNS_TYPE_A, result, NULL, 0);
+    }
+
+    // No usable DNS server for a raw query (or it timed out): let lwIP try,
+    // which also covers names only its resolver knows about
+    struct addrinfo hints;
+    struct addrinfo *info = NULL;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_DGRAM;
+    hints.ai_protocol = IPPROTO_UDP;
+
+    int ret = getaddrinfo(host, NULL, &hints, &info);
+    if (ret != 0 || info == NULL) {
+        if (info) {
+            freeaddrinfo(info);
+        }
+        return false;
+    }
+
+    result->addr = ((struct sockaddr_in*)info->ai_addr)->sin_addr;
+    result->ttl_s = DNS_CACHE_DEFAULT_TTL_S;
+    result->ok = true;
+    freeaddrinfo(info);
+    return true;
+}
+
+static dns_lookup_result_t dns_lookup(const char* host, const char* service)
+{
+    dns_lookup_result_t result = {0};
+
+    if (service[0] != '\0') {
+        char srv_name[DNS_CACHE_NAME_LEN + DNS_SRV_SERVICE_LEN];
+        char target[DNS_CACHE_NAME_LEN];
+        uint8_t response[DNS_PACKET_SIZE];
+
+        snprintf(srv_name, sizeof(srv_name), "%s.%s", service, host);
+        int len = dns_query(srv_name, DNS_TYPE_SRV, response, sizeof(response));
+        if (len > 0 && dns_parse_response(response, len, DNS_TYPE_SRV, &result, target, sizeof(target))) {
+            uint32_t srv_ttl = result.ttl_s;
+            uint16_t srv_port = result.srv_port;
+            memset(&result, 0, sizeof(result));
+            if (dns_lookup_a(target, &result)) {
+                result.srv_port = srv_port;
+                if (srv_ttl < result.ttl_s) {
+                    result.ttl_s = srv_ttl;
+                }
+                ESP_LOGI(TAG, "SRV %s -> %s:%u", srv_name, target, srv_port);
+                return result;
+            }
+        }
+        // No SRV record: fall back to a plain A lookup (RFC 3263)
+        memset(&result, 0, sizeof(result));
+    }
+
+    dns_lookup_a(host, &result);
+    return result;
+}
+
+// ============================================================================
+// Cache
+// ============================================================================
+
+// Caller holds cache_mutex
+static dns_cache_entry_t* cache_find(const char* host)
+{
+    for (int i = 0; i < DNS_CACHE_ENTRIES; i++) {
+        if (cache[i].used && strcmp(cache[i].name, host) == 0) {
+            return &cache[i];
+        }
+    }
+    return NULL;
+}
+
+// Caller holds cache_mutex; reuses a free slot or evicts the least recently used
+static dns_cache_entry_t* cache_alloc(const char* host)
+{
+    dns_cache_entry_t* victim = &cache[0];
+    for (int i = 0; i < DNS_CACHE_ENTRIES; i++) {
+        if (!cache[i].used) {
+            victim = &cache[i];
+            break;
+        }
+        if (cache[i].last_used_ms < victim->last_used_ms) {
+            victim = &cache[i];
+        }
+    }
+
+    memset(victim, 0, sizeof(*victim));
+    victim->used = true;
+    strncpy(victim->name, host, sizeof(victim->name) - 1);
+    victim->last_used_ms = now_ms();
+    return victim;
+}
+
+// Caller holds cache_mutex
+static void cache_store(dns_cache_entry_t* entry, const dns_lookup_result_t* result)
+{
+    entry->resolved_ms = now_ms();
+    entry->refreshing = false;
+    entry->stale = false;
+
+    if (result->ok) {
+        entry->negative = false;
+        entry->addr = result->addr;
+        entry->srv_port = result->srv_port;
+        entry->ttl_ms = result->ttl_s * 1000;
+    } else if (!entry->negative && entry->ttl_ms > 0) {
+        // Refresh of a good entry failed: keep serving the old address and
+        // retry after the negative TTL rather than dropping it
+        entry->ttl_ms = DNS_CACHE_NEGATIVE_TTL_S * 1000;
+    } else {
+        entry->negative = true;
+        entry->ttl_ms = DNS_CACHE_NEGATIVE_TTL_S * 1000;
+    }
+}
+
+// Caller holds cache_mutex (or the cache is not shared yet). Every entry is
+// looked up again in the background and served as it is until then.
+static void cache_mark_stale(void)
+{
+    for (int i = 0; i < DNS_CACHE_ENTRIES; i++) {
+        if (cache[i].used) {
+            cache[i].stale = true;
+        }
+    }
+}
+
+static bool cache_is_expired(const dns_cache_entry_t* entry, uint32_t now)
+{
+    return (now - entry->resolved_ms) >= entry->ttl_ms;
+}
+
+static bool cache_needs_refresh(const dns_cache_entry_t* entry, uint32_t now)
+{
+    if (!entry->used || entry->refreshing) {
+        return false;
+    }
+    if (entry->stale) {
+        return true;
+    }
+    if (entry->negative) {
+        return false;
+    }
+    if ((now - entry->last_used_ms) > DNS_CACHE_IDLE_MS) {
+        return false;
+    }
+    return (now - entry->resolved_ms) >= (entry->ttl_ms / 100) * DNS_CACHE_REFRESH_PERCENT;
+}
+
+static void dns_refresh_task(void *pvParameters __attribute__((unused)))
+{
+    ESP_LOGI(TAG, "DNS refresh task started");
+
+    while (1) {
+        uint32_t sleep_ms = DNS_REFRESH_MAX_SLEEP_MS;
+        char name[DNS_CACHE_NAME_LEN] = {0};
+        char service[DNS_SRV_SERVICE_LEN] = "";
+
+        // Pick one entry due for refresh and work out when the next one is due
+        xSemaphoreTake(cache_mutex, portMAX_DELAY);
+        uint32_t now = now_ms();
+        for (int i = 0; i < DNS_CACHE_ENTRIES; i++) {
+            dns_cache_entry_t* entry = &cache[i];
+            if (!entry->used || entry->refreshing) {
+                continue;
+            }
+            bool due = cache_needs_refresh(entry, now) ||
+                       entry->ttl_ms == 0;     // Waiting for its first lookup
+            if (due && name[0] == '\0') {
+                entry->refreshing = true;
+                strncpy(name, entry->name, sizeof(name) - 1);
+                memcpy(service, srv_service, sizeof(service));
+                continue;
+            }
+            if (!entry->negative && (now - entry->last_used_ms) <= DNS_CACHE_IDLE_MS) {
+                uint32_t refresh_at = (entry->ttl_ms / 100) * DNS_CACHE_REFRESH_PERCENT;
+                uint32_t age = now - entry->resolved_ms;
+                uint32_t remaining = (age >= refresh_at) ? 0 : refresh_at - age;
+                if (remaining < sleep_ms) {
+                    sleep_ms = remaining;
+                }
+            }
+        }
+        xSemaphoreGive(cache_mutex);
+
+        if (name[0] != '\0') {
+            dns_lookup_result_t result = dns_lookup(name, service);
+
+            xSemaphoreTake(cache_mutex, portMAX_DELAY);
+            dns_cache_entry_t* entry = cache_find(name);
+            if (entry) {
+                cache_store(entry, &result);
+                // The SRV service changed during the lookup: do it again
+                entry->stale = strcmp(service, srv_service) != 0;
+            }
+            xSemaphoreGive(cache_mutex);
+
+            if (result.ok) {
+                ESP_LOGD(TAG, "Resolved %s -> %s (TTL %lu s)", name, inet_ntoa(result.addr),
+                         (unsigned long)result.ttl_s);
+            } else {
+                ESP_LOGW(TAG, "DNS lookup failed for %s (cached for %d s)", name, DNS_CACHE_NEGATIVE_TTL_S);
+            }
+            continue;   // Look for more work before sleeping
+        }
+
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(sleep_ms > 0 ? sleep_ms : 1));
+    }
+}
+
+void dns_cache_init(void)
+{
+    if (cache_mutex) {
+        return;
+    }
+
+    cache_mutex = xSemaphoreCreateMutex();
+    if (!cache_mutex) {
+        ESP_LOGE(TAG, "Failed to create DNS cache mutex");
+        return;
+    }
+
+    BaseType_t result = xTaskCreatePinnedToCore(
+        dns_refresh_task,
+        "dns_refresh",
+        DNS_REFRESH_TASK_STACK,
+        NULL,
+        DNS_REFRESH_TASK_PRIORITY,
+        &refresh_task_handle,
+        1
+    );
+    if (result != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create DNS refresh task - lookups will block the caller");
+        refresh_task_handle = NULL;
+    }
+
+    ESP_LOGI(TAG, "DNS cache initialized (%d entries)", DNS_CACHE_ENTRIES);
+}
+
+bool dns_cache_resolve(const char* host, uint16_t port, struct sockaddr_in* addr)
+{
+    if (!host || !host[0] || !addr) {
+        return false;
+    }
+
+    memset(addr, 0, sizeof(*addr));
+    addr->sin_family = AF_INET;
+    addr->sin_port = htons(port);
+
+    // IP literals never touch the resolver
+    if (inet_pton(AF_INET, host, &addr->sin_addr) == 1) {
+        return true;
+    }
+
+    if (strlen(host) >= DNS_CACHE_NAME_LEN) {
+        ESP_LOGE(TAG, "%s: name too long for the cache", host);
+        return false;
+    }
+
+    if (!cache_mutex || !refresh_task_handle) {
+        // No refresh task to hand the lookup to - resolve on the caller
+        dns_lookup_result_t result = dns_lookup(host, srv_service);
+        if (!result.ok) {
+            return false;
+        }
+        addr->sin_addr = result.addr;
+        if (result.srv_port) {
+            addr->sin_port = htons(result.srv_port);
+        }
+        return true;
+    }
+
+    xSemaphoreTake(cache_mutex, portMAX_DELAY);
+    uint32_t now = now_ms();
+    dns_cache_entry_t* entry = cache_find(host);
+    bool found = false;
+    bool kick = false;
+
+    if (!entry) {
+        // Miss: ttl_ms == 0 has the refresh task look it up, this attempt fails
+        cache_alloc(host);
+        kick = true;
+        ESP_LOGI(TAG, "%s not cached yet - resolving in the background", host);
+    } else if (entry->ttl_ms > 0) {
+        entry->last_used_ms = now;
+        bool expired = cache_is_expired(entry, now);
+
+        if (entry->negative) {
+            // Still negative until the refresh task has asked again
+            if (expired && !entry->stale && !entry->refreshing) {
+                entry->stale = true;
+                kick = true;
+            }
+            ESP_LOGD(TAG, "%s: negative cache hit", host);
+        } else {
+            // Hit - serve even if stale, the refresh task renews it
+            addr->sin_addr = entry->addr;
+            if (entry->srv_port) {
+                addr->sin_port = htons(entry->srv_port);
+            }
+            found = true;
+            kick = (expired || cache_needs_refresh(entry, now)) && !entry->refreshing;
+        }
+    }
+    xSemaphoreGive(cache_mutex);
+
+    if (kick) {
+        xTaskNotifyGive(refresh_task_handle);
+    }
+    return found;
+}
+
+void dns_cache_prefetch(const char* host)
+{
+    struct in_addr literal;
+    if (!host || !host[0] || !cache_mutex || !refresh_task_handle ||
+        strlen(host) >= DNS_CACHE_NAME_LEN || inet_pton(AF_INET, host, &literal) == 1) {
+        return;
+    }
+
+    xSemaphoreTake(cache_mutex, portMAX_DELAY);
+    if (!cache_find(host)) {
+        // ttl_ms == 0 marks the entry as waiting for its first lookup
+        cache_alloc(host);
+    }
+    xSemaphoreGive(cache_mutex);
+
+    xTaskNotifyGive(refresh_task_handle);
+}
+
+void dns_cache_set_srv_service(const char* service)
+{
+    if (!service) {
+        service = "";
+    }
+    if (strcmp(srv_service, service) == 0) {
+        return;
+    }
+
+    // Entries resolved for another service keep its port until they are
+    // looked up again; they are still served meanwhile
+    if (cache_mutex) {
+        xSemaphoreTake(cache_mutex, portMAX_DELAY);
+    }
+    snprintf(srv_service, sizeof(srv_service), "%s", service);
+    cache_mark_stale();
+    if (cache_mutex) {
+        xSemaphoreGive(cache_mutex);
+    }
+    if (refresh_task_handle) {
+        xTaskNotifyGive(refresh_task_handle);
+    }
+
+    if (service[0] != '\0') {
+        ESP_LOGI(TAG, "SRV lookup enabled (%s)", service);
+    } else {
+        ESP_LOGI(TAG, "SRV lookup disabled");
+    }
+}
+
+void dns_cache_flush(void)
+{
+    if (!cache_mutex) {
+        return;
+    }
+    xSemaphoreTake(cache_mutex, portMAX_DELAY);
+    cache_mark_stale();
+    xSemaphoreGive(cache_mutex);
+    if (refresh_task_handle) {
+        xTaskNotifyGive(refresh_task_handle);
+    }
+}
@@ -0,0 +1,61 @@
+#ifndef DNS_CACHE_H
+#define DNS_CACHE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "lwip/sockets.h"
+
+/**
+ * @brief Initialize the resolver cache and start its background refresh task
+ *
+ * Entries keep the TTL from the DNS answer (clamped), failed lookups are
+ * cached negatively for a short time, and entries that are still in use
+ * are refreshed in the background before they expire so the signalling
+ * path does not wait on the resolver.
+ */
+void dns_cache_init(void);
+
+/**
+ * @brief Resolve a host name through the cache
+ *
+ * Never waits on the network. Fresh entries are returned immediately,
+ * expired ones are still returned (serve-stale) while a background refresh
+ * runs. A name not cached yet, or cached as failed, returns false and is
+ * looked up in the background for a later attempt.
+ *
+ * With an SRV service set the name is first looked up as <service>.<host>
+ * (e.g. _sip._tcp.<host>); the SRV target's port overrides @p port.
+ *
+ * @param host Host name or dotted IPv4 literal
+ * @param port Port to use when no SRV record supplies one
+ * @param addr Receives the resolved address and port
+ * @return true if an address is available now
+ */
+bool dns_cache_resolve(const char* host, uint16_t port, struct sockaddr_in* addr);
+
+/**
+ * @brief Resolve a host name in the background so a later lookup hits the cache
+ *
+ * @param host Host name
+ */
+void dns_cache_prefetch(const char* host);
+
+/**
+ * @brief Set the SRV service tried before A records for subsequent resolutions
+ *
+ * The service follows the transport: "_sip._udp", "_sip._tcp" or
+ * "_sips._tcp" (RFC 3263). Changing the setting has every cached name looked
+ * up again in the background; the entries are served as they are meanwhile.
+ *
+ * @param service Service and protocol labels, NULL or "" to disable SRV lookup
+ */
+void dns_cache_set_srv_service(const char* service);
+
+/**
+ * @brief Look every cached name up again (e.g. after a network or configuration change)
+ *
+ * Like dns_cache_set_srv_service(), the entries are served until then.
+ */
+void dns_cache_flush(void);
+
+#endif // DNS_CACHE_H
@@ -0,0 +1,406 @@
+#include "echo_canceller.h"
+#include "esp_log.h"
+#include <string.h>
+#include <math.h>
+
+static const char *TAG = "AEC";
+
+// Samples enter the transforms scaled by 2^6, so a 64-point spectrum of
+// full-scale audio stays below 2^27 and products of two fit in 2^55
+#define AEC_SAMPLE_SHIFT        6
+#define AEC_COEFF_SHIFT         24      // Q24 filter coefficients
+
+// Step size (Q15) of the per-bin normalised update
+#define AEC_STEP_Q15            16384
+
+// Per-bin, per-partition power of a far end at about -60 dBFS: quieter
+// bins do not get larger steps
+#define AEC_REGULARIZATION      ((int64_t)1 << 28)
+
+// Clamp on the scaled bin correlation so it times the step fits in 64 bits
+#define AEC_MAX_CORRELATION     ((int64_t)1 << 38)
+
+// Far-end peak below which there is no echo worth adapting to
+#define AEC_FAR_ACTIVE_LEVEL    64
+
+// Adaptation stays held for 30 ms after the last double-talk sample
+#define AEC_HANGOVER_SAMPLES    240
+
+// Foreground update test: the residual reduction (foreground minus
+// background energy) against the energy of the difference between the
+// two echo estimates, per frame and averaged over about 2 and 6 frames
+#define AEC_UPDATE_SHORT_VAR    0.5f
+#define AEC_UPDATE_LONG_VAR     0.25f
+
+// A background that leaves more residual by this factor of the same test
+// has adapted on near-end speech
+#define AEC_RESTORE_VAR         4.0f
+
+// ERLE smoothing per frame with only far-end speech
+#define AEC_ERLE_SMOOTHING      0.1f
+
+static inline int16_t saturate16(int32_t v)
+{
+    if (v > INT16_MAX) {
+        return INT16_MAX;
+    }
+    if (v < INT16_MIN) {
+        return INT16_MIN;
+    }
+    return (int16_t)v;
+}
+
+static inline int32_t saturate32(int64_t v)
+{
+    if (v > INT32_MAX) {
+        return INT32_MAX;
+    }
+    if (v < INT32_MIN) {
+        return INT32_MIN;
+    }
+    return (int32_t)v;
+}
+
+// Complete a real signal's spectrum from bins 0..AEC_FFT_SIZE/2
+static void aec_mirror_bins(fft_complex_t* spectrum)
+{
+    spectrum[0].im = 0;
+    spectrum[AEC_FFT_SIZE / 2].im = 0;
+    for (int f = AEC_FFT_SIZE / 2 + 1; f < AEC_FFT_SIZE; f++) {
+        spectrum[f].re = spectrum[AEC_FFT_SIZE - f].re;
+        spectrum[f].im = -spectrum[AEC_FFT_SIZE - f].im;
+    }
+}
+
+// Spectrum of the far end over the previous and the current block
+// (overlap-save); it replaces the oldest partition's
+static void aec_far_block(aec_t* aec, const int16_t* far)
+{
+    fft_complex_t* x = aec->scratch;
+    int32_t peak = 0;
+    for (int n = 0; n < AEC_FFT_SIZE; n++) {
+        int32_t v = far[n - AEC_BLOCK_SAMPLES];
+        x[n].re = v * (1 << AEC_SAMPLE_SHIFT);
+        x[n].im = 0;
+        if (n >= AEC_BLOCK_SAMPLES) {
+            int32_t a = v < 0 ? -v : v;
+            if (a > peak) {
+                peak = a;
+            }
+        }
+    }
+    fft_forward(x, AEC_FFT_SIZE);
+
+    aec->far_head = (aec->far_head + aec->partitions - 1) % aec->partitions;
+    fft_complex_t* slot = aec->far_spectra[aec->far_head];
+    for (int f = 0; f < AEC_BINS; f++) {
+        aec->far_power[f] -= (int64_t)slot[f].re * slot[f].re + (int64_t)slot[f].im * slot[f].im;
+        slot[f] = x[f];
+        aec->far_power[f] += (int64_t)x[f].re * x[f].re + (int64_t)x[f].im * x[f].im;
+    }
+    aec->far_peaks[aec->far_head] = (int16_t)(peak > INT16_MAX ? INT16_MAX : peak);
+}
+
+// Echo estimate of one block: sum over partitions of coefficients times
+// the far-end spectrum of that many blocks ago, back to the time domain
+static void aec_estimate(aec_t* aec, fft_complex_t (*filter)[AEC_BINS], int32_t* echo)
+{
+    fft_complex_t* y = aec->scratch;
+    for (int f = 0; f < AEC_BINS; f++) {
+        int64_t re = 0;
+        int64_t im = 0;
+        for (uint16_t k = 0; k < aec->partitions; k++) {
+            const fft_complex_t* w = &filter[k][f];
+            const fft_complex_t* x = &aec->far_spectra[(aec->far_head + k) % aec->partitions][f];
+            re += (int64_t)w->re * x->re - (int64_t)w->im * x->im;
+            im += (int64_t)w->re * x->im + (int64_t)w->im * x->re;
+        }
+        y[f].re = saturate32(re >> AEC_COEFF_SHIFT);
+        y[f].im = saturate32(im >> AEC_COEFF_SHIFT);
+    }
+    aec_mirror_bins(y);
+    fft_inverse(y, AEC_FFT_SIZE);
+
+    // Overlap-save: the second half is the linear convolution
+    for (int n = 0; n < AEC_BLOCK_SAMPLES; n++) {
+        echo[n] = (y[AEC_BLOCK_SAMPLES + n].re + (1 << (AEC_SAMPLE_SHIFT - 1))) >> AEC_SAMPLE_SHIFT;
+    }
+}
+
+// Drop the circular-convolution part of one partition's coefficients (the
+// gradient constraint); one partition per block keeps the cost at two
+// transforms
+static void aec_constrain(aec_t* aec, fft_complex_t* coefficients)
+{
+    fft_complex_t* w = aec->scratch;
+    memcpy(w, coefficients, AEC_BINS * sizeof(fft_complex_t));
+    aec_mirror_bins(w);
+    fft_inverse(w, AEC_FFT_SIZE);
+    for (int n = 0; n < AEC_FFT_SIZE; n++) {
+        if (n >= AEC_BLOCK_SAMPLES) {
+            w[n].re = 0;
+        }
+        w[n].im = 0;
+    }
+    fft_forward(w, AEC_FFT_SIZE);
+    memcpy(coefficients, w, AEC_BINS * sizeof(fft_complex_t));
+}
+
+// Background update from one block of its residual: every partition moves
+// along the correlation of its far-end spectrum with the residual spectrum,
+// normalised per bin by the far-end power across all partitions
+static void aec_adapt(aec_t* aec, const int16_t* residual)
+{
+    fft_complex_t* e = aec->scratch;
+    for (int n = 0; n < AEC_FFT_SIZE; n++) {
+        e[n].re = n < AEC_BLOCK_SAMPLES ? 0 : residual[n - AEC_BLOCK_SAMPLES] * (1 << AEC_SAMPLE_SHIFT);
+        e[n].im = 0;
+    }
+    fft_forward(e, AEC_FFT_SIZE);
+
+    // Step per bin as mantissa and shift: the power is brought to 30 bits
+    // so one 64-bit division per bin gives a 25-bit reciprocal
+    int32_t step[AEC_BINS];
+    uint8_t shift[AEC_BINS];
+    const int64_t regularization = AEC_REGULARIZATION * aec->partitions;
+    for (int f = 0; f < AEC_BINS; f++) {
+        int64_t power = aec->far_power[f] + regularization;
+        int bits = 64 - __builtin_clzll((uint64_t)power);
+        shift[f] = (uint8_t)(bits > 30 ? bits - 30 : 0);
+        step[f] = (int32_t)(((int64_t)AEC_STEP_Q15 << 39) / (power >> shift[f]));
+    }
+
+    for (uint16_t k = 0; k < aec->partitions; k++) {
+        fft_complex_t* w = aec->background[k];
+        const fft_complex_t* x = aec->far_spectra[(aec->far_head + k) % aec->partitions];
+        for (int f = 0; f < AEC_BINS; f++) {
+            // conj(X) * E
+            int64_t re = ((int64_t)x[f].re * e[f].re + (int64_t)x[f].im * e[f].im) >> shift[f];
+            int64_t im = ((int64_t)x[f].re * e[f].im - (int64_t)x[f].im * e[f].re) >> shift[f];
+            re = re > AEC_MAX_CORRELATION ? AEC_MAX_CORRELATION : (re < -AEC_MAX_CORRELATION ? -AEC_MAX_CORRELATION : re);
+            im = im > AEC_MAX_CORRELATION ? AEC_MAX_CORRELATION : (im < -AEC_MAX_CORRELATION ? -AEC_MAX_CORRELATION : im);
+            w[f].re += (int32_t)((re * step[f]) >> 30);
+            w[f].im += (int32_t)((im * step[f]) >> 30);
+        }
+    }
+
+    aec_constrain(aec, aec->background[aec->constrain_next]);
+    aec->constrain_next = (aec->constrain_next + 1) % aec->partitions;
+}
+
+static void aec_reset_decision(aec_t* aec)
+{
+    aec->diff_avg_short = 0.0f;
+    aec->diff_avg_long = 0.0f;
+    aec->diff_var_short = 0.0f;
+    aec->diff_var_long = 0.0f;
+}
+
+void aec_init(aec_t* aec, const aec_config_t* config)
+{
+    memset(aec, 0, sizeof(*aec));
+    aec->config = *config;
+
+    if (aec->config.tail_ms < AEC_MIN_TAIL_MS) {
+        aec->config.tail_ms = AEC_MIN_TAIL_MS;
+    } else if (aec->config.tail_ms > AEC_MAX_TAIL_MS) {
+        aec->config.tail_ms = AEC_MAX_TAIL_MS;
+    }
+    if (aec->config.delay_ms > AEC_MAX_DELAY_MS) {
+        aec->config.delay_ms = AEC_MAX_DELAY_MS;
+    }
+    if (aec->config.dt_threshold_pct < 10) {
+        aec->config.dt_threshold_pct = 10;
+    } else if (aec->config.dt_threshold_pct > 100) {
+        aec->config.dt_threshold_pct = 100;
+    }
+
+    // Whole partitions, rounded up
+    uint32_t tail_samples = (uint32_t)aec->config.tail_ms * AEC_SAMPLE_RATE / 1000;
+    aec->partitions = (tail_samples + AEC_BLOCK_SAMPLES - 1) / AEC_BLOCK_SAMPLES;
+    aec->delay = aec->config.delay_ms * AEC_SAMPLE_RATE / 1000;
+
+    ESP_LOGI(TAG, "Echo canceller %s: tail %u ms (%u partitions), delay %u ms, double-talk at %u%% of far end",
+             aec->config.enabled ? "on" : "off", aec->config.tail_ms, aec->partitions,
+             aec->config.delay_ms, aec->config.dt_threshold_pct);
+}
+
+void aec_far_end(aec_t* aec, const int16_t* samples, size_t count)
+{
+    if (count > AEC_FRAME_SAMPLES) {
+        count = AEC_FRAME_SAMPLES;
+    }
+    memmove(aec->history, aec->history + count, (AEC_HISTORY_SAMPLES - count) * sizeof(int16_t));
+    if (samples) {
+        memcpy(aec->history + AEC_HISTORY_SAMPLES - count, samples, count * sizeof(int16_t));
+    } else {
+        memset(aec->history + AEC_HISTORY_SAMPLES - count, 0, count * sizeof(int16_t));
+    }
+    aec->far_total += count;
+}
+
+void aec_skip(aec_t* aec, size_t count)
+{
+    aec->near_total += count;
+}
+
+void aec_process(aec_t* aec, const int16_t* capture, int16_t* out, size_t count)
+{
+    if (count > AEC_FRAME_SAMPLES) {
+        count = AEC_FRAME_SAMPLES;
+    }
+    aec->stats.frames++;
+
+    // Pair the capture with the far end. Playout that never arrived counts
+    // as silence; a far end too far ahead (capture lost without aec_skip)
+    // gives up the samples that no longer fit. Either way the far-end
+    // spectra no longer line up and start over.
+    bool resync = false;
+    int64_t missing = aec->near_total + (int64_t)count - aec->delay - aec->far_total;
+    while (missing > 0) {
+        size_t n = missing > AEC_FRAME_SAMPLES ? AEC_FRAME_SAMPLES : (size_t)missing;
+        aec_far_end(aec, NULL, n);
+        missing -= n;
+        resync = true;
+    }
+    int64_t start = aec->near_total - aec->delay - (aec->far_total - AEC_HISTORY_SAMPLES);
+    if (start < AEC_BLOCK_SAMPLES) {
+        aec->near_total += AEC_BLOCK_SAMPLES - start;
+        start = AEC_BLOCK_SAMPLES;
+        resync = true;
+    }
+    if (resync) {
+        memset(aec->far_spectra, 0, sizeof(aec->far_spectra));
+        memset(aec->far_peaks, 0, sizeof(aec->far_peaks));
+        memset(aec->far_power, 0, sizeof(aec->far_power));
+        aec->stats.resyncs++;
+    }
+    aec->near_total += count;
+
+    if (!aec->config.enabled) {
+        if (out != capture) {
+            memcpy(out, capture, count * sizeof(int16_t));
+        }
+        return;
+    }
+
+    const int16_t* far = aec->history + start;    // Far-end sample paired with capture[0]
+    const size_t processed = count - count % AEC_BLOCK_SAMPLES;
+
+    int16_t residual[AEC_FRAME_SAMPLES];
+    int16_t background_residual[AEC_BLOCK_SAMPLES];
+    int32_t echo[AEC_BLOCK_SAMPLES];
+    int32_t background_echo[AEC_BLOCK_SAMPLES];
+    int64_t near_sum = 0;
+    int64_t foreground_sum = 0;
+    int64_t background_sum = 0;
+    int64_t disagreement_sum = 0;
+    bool far_active = false;
+    bool adapted = false;
+    bool double_talk = false;
+
+    for (size_t block = 0; block < processed; block += AEC_BLOCK_SAMPLES) {
+        aec_far_block(aec, far + block);
+
+        // Geigel double-talk reference: far-end peak over the whole tail
+        int32_t far_peak = 0;
+        for (uint16_t k = 0; k < aec->partitions; k++) {
+            if (aec->far_peaks[k] > far_peak) {
+                far_peak = aec->far_peaks[k];
+            }
+        }
+        const bool block_active = far_peak >= AEC_FAR_ACTIVE_LEVEL;
+        const int32_t dt_level = far_peak * aec->config.dt_threshold_pct / 100;
+        bool block_double_talk = false;
+
+        aec_estimate(aec, aec->foreground, echo);
+        aec_estimate(aec, aec->background, background_echo);
+
+        for (int n = 0; n < AEC_BLOCK_SAMPLES; n++) {
+            int32_t d = capture[block + n];
+            int32_t e = saturate16(d - echo[n]);
+            int32_t eb = saturate16(d - background_echo[n]);
+            residual[block + n] = (int16_t)e;
+            background_residual[n] = (int16_t)eb;
+            near_sum += d * d;
+            foreground_sum += e * e;
+            background_sum += eb * eb;
+            disagreement_sum += (e - eb) * (e - eb);
+
+            if ((d < 0 ? -d : d) > dt_level) {
+                aec->hangover = AEC_HANGOVER_SAMPLES;
+            }
+            if (aec->hangover > 0) {
+                aec->hangover--;
+                block_double_talk = true;
+            }
+        }
+
+        if (!block_active) {
+            continue;
+        }
+        far_active = true;
+        if (block_double_talk) {
+            double_talk = true;
+            continue;
+        }
+        aec_adapt(aec, background_residual);
+        adapted = true;
+    }
+
+    if (adapted) {
+        aec->stats.adapt_frames++;
+    }
+    if (far_active && double_talk) {
+        aec->stats.double_talk_frames++;
+    }
+
+    // Two-path decision, only while there is echo to judge the filters by
+    if (far_active) {
+        float sff = (float)foreground_sum;
+        float diff = sff - (float)background_sum;
+        float disagreement = sff * (float)disagreement_sum;
+        aec->diff_avg_short = 0.6f * aec->diff_avg_short + 0.4f * diff;
+        aec->diff_avg_long = 0.85f * aec->diff_avg_long + 0.15f * diff;
+        aec->diff_var_short = 0.36f * aec->diff_var_short + 0.16f * disagreement;
+        aec->diff_var_long = 0.7225f * aec->diff_var_long + 0.0225f * disagreement;
+
+        if (diff * fabsf(diff) > disagreement ||
+            aec->diff_avg_short * fabsf(aec->diff_avg_short) > AEC_UPDATE_SHORT_VAR * aec->diff_var_short ||
+            aec->diff_avg_long * fabsf(aec->diff_avg_long) > AEC_UPDATE_LONG_VAR * aec->diff_var_long) {
+            memcpy(aec->foreground, aec->background, sizeof(aec->foreground));
+            aec_reset_decision(aec);
+            aec->stats.updates++;
+        } else if (-diff * fabsf(diff) > AEC_RESTORE_VAR * disagreement) {
+            memcpy(aec->background, aec->foreground, sizeof(aec->background));
+            aec_reset_decision(aec);
+            aec->stats.restores++;
+        }
+    }
+
+    // Never send something louder than the microphone picked up
+    if (foreground_sum > near_sum) {
+        aec->stats.bypass_frames++;
+        if (out != capture) {
+            memcpy(out, capture, count * sizeof(int16_t));
+        }
+        return;
+    }
+    memcpy(out, residual, processed * sizeof(int16_t));
+    if (out != capture) {
+        memcpy(out + processed, capture + processed, (count - processed) * sizeof(int16_t));
+    }
+
+    if (far_active && !double_talk) {
+        aec->near_power += AEC_ERLE_SMOOTHING * ((float)near_sum / processed - aec->near_power);
+        aec->error_power += AEC_ERLE_SMOOTHING * ((float)foreground_sum / processed - aec->error_power);
+        if (aec->error_power > 0.0f && aec->near_power > 0.0f) {
+            aec->stats.erle_db = 10.0f * log10f(aec->near_power / aec->error_power);
+        }
+    }
+}
+
+void aec_get_stats(const aec_t* aec, aec_stats_t* stats)
+{
+    memcpy(stats, &aec->stats, sizeof(*stats));
+}
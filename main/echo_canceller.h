@@ -0,0 +1,144 @@
+#ifndef ECHO_CANCELLER_H
+#define ECHO_CANCELLER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "fft.h"
+
+#define AEC_SAMPLE_RATE         8000
+#define AEC_FRAME_SAMPLES       160     // Largest block per call (one 20 ms media frame)
+#define AEC_BLOCK_SAMPLES       32      // Filter partition and processing block (4 ms)
+#define AEC_FFT_SIZE            (2 * AEC_BLOCK_SAMPLES)
+#define AEC_BINS                (AEC_FFT_SIZE / 2 + 1)
+#define AEC_MIN_TAIL_MS         16
+#define AEC_MAX_TAIL_MS         128
+#define AEC_MAX_DELAY_MS        160     // A full I2S TX DMA ring
+#define AEC_MAX_PARTITIONS      (AEC_MAX_TAIL_MS * AEC_SAMPLE_RATE / 1000 / AEC_BLOCK_SAMPLES)
+#define AEC_MAX_DELAY_SAMPLES   (AEC_MAX_DELAY_MS * AEC_SAMPLE_RATE / 1000)
+#define AEC_MAX_LEAD_FRAMES     4       // Far-end frames that may wait for their capture
+
+// Far-end history: one block before the current one (overlap-save), bulk
+// delay and frames not yet paired
+#define AEC_HISTORY_SAMPLES     (AEC_BLOCK_SAMPLES + AEC_MAX_DELAY_SAMPLES + (AEC_MAX_LEAD_FRAMES + 1) * AEC_FRAME_SAMPLES)
+
+#define AEC_DEFAULT_TAIL_MS     64
+#define AEC_DEFAULT_DELAY_MS    0
+#define AEC_DEFAULT_DT_PCT      50      // Geigel threshold: assumes at least 6 dB echo return loss
+
+/**
+ * Echo canceller settings
+ */
+typedef struct {
+    bool enabled;               // false passes the capture through (the far end is still tracked)
+    uint16_t tail_ms;           // Echo path length the filter covers, AEC_MIN_TAIL_MS..AEC_MAX_TAIL_MS
+    uint16_t delay_ms;          // Bulk delay from playout to the start of the echo, 0..AEC_MAX_DELAY_MS
+    uint8_t dt_threshold_pct;   // Near end above this share of the far-end peak is double-talk
+} aec_config_t;
+
+/**
+ * Echo canceller statistics
+ */
+typedef struct {
+    uint32_t frames;            // Capture frames processed
+    uint32_t adapt_frames;      // Frames the background filter adapted in
+    uint32_t double_talk_frames;// Far end active but adaptation held by double-talk
+    uint32_t bypass_frames;     // Output was worse than the capture: capture sent unchanged
+    uint32_t updates;           // Background filter copied to the foreground
+    uint32_t restores;          // Background diverged and was reset to the foreground
+    uint32_t resyncs;           // Far end and capture lost alignment and were re-paired
+    float erle_db;              // Echo return loss enhancement while only the far end talks
+} aec_stats_t;
+
+/**
+ * Partitioned-block frequency-domain echo canceller (fixed capacity, no
+ * heap use)
+ *
+ * The echo path is split into AEC_BLOCK_SAMPLES partitions adapted per
+ * frequency bin, each bin with its own step normalisation (multidelay
+ * filter); this keeps converging on speech where time-domain NLMS stalls.
+ * Spectra and Q24 coefficients are fixed point. Blocks divide the media
+ * frame, so no latency is added.
+ *
+ * A background filter adapts continuously; the foreground filter that
+ * produces the output only takes its coefficients when the background
+ * leaves significantly less residual than the two filters' disagreement
+ * would explain (the test Speex's MDF canceller uses). Near-end speech the
+ * double-talk detector misses can only spoil the background, which is then
+ * restored from the foreground.
+ *
+ * The capture and the far end (what was played out) are two sample streams
+ * that start together: capture sample n is paired with far-end sample
+ * n - delay.
+ */
+typedef struct {
+    aec_config_t config;
+    uint16_t partitions;
+    uint16_t delay;                                         // Bulk delay in samples
+    uint16_t far_head;                                      // Slot of the newest far-end spectrum
+    uint16_t constrain_next;                                // Partition due for the gradient constraint
+    fft_complex_t far_spectra[AEC_MAX_PARTITIONS][AEC_BINS];
+    int16_t far_peaks[AEC_MAX_PARTITIONS];                  // Per block, same slots (Geigel reference)
+    int64_t far_power[AEC_BINS];                            // Summed over all partitions
+    fft_complex_t background[AEC_MAX_PARTITIONS][AEC_BINS]; // Q24, partition 0 = most recent block
+    fft_complex_t foreground[AEC_MAX_PARTITIONS][AEC_BINS];
+    fft_complex_t scratch[AEC_FFT_SIZE];
+    int16_t history[AEC_HISTORY_SAMPLES];                   // Far end, newest sample last
+    int64_t far_total;                                      // Far-end samples pushed
+    int64_t near_total;                                     // Capture samples processed or skipped
+    uint16_t hangover;                                      // Samples adaptation stays held after double-talk
+    float diff_avg_short;                                   // Residual reduction by the background, two time scales
+    float diff_avg_long;
+    float diff_var_short;                                   // ... and what filter disagreement alone would explain
+    float diff_var_long;
+    float near_power;                                       // Smoothed for the ERLE estimate
+    float error_power;
+    aec_stats_t stats;
+} aec_t;
+
+/**
+ * Initialize (or reset) an echo canceller
+ *
+ * @param aec Echo canceller instance
+ * @param config Settings; out-of-range values are clamped
+ */
+void aec_init(aec_t* aec, const aec_config_t* config);
+
+/**
+ * Add far-end audio in the order it is played out
+ *
+ * @param aec Echo canceller instance
+ * @param samples Played samples, NULL for silence
+ * @param count Number of samples (at most AEC_FRAME_SAMPLES)
+ */
+void aec_far_end(aec_t* aec, const int16_t* samples, size_t count);
+
+/**
+ * Remove the echo from a block of capture
+ *
+ * @param aec Echo canceller instance
+ * @param capture Microphone samples
+ * @param out Echo-cancelled samples (may equal @p capture)
+ * @param count Number of samples, a multiple of AEC_BLOCK_SAMPLES up to
+ *              AEC_FRAME_SAMPLES (a partial block at the end is passed through)
+ */
+void aec_process(aec_t* aec, const int16_t* capture, int16_t* out, size_t count);
+
+/**
+ * Capture samples were lost before they reached the canceller; keeps the
+ * far-end pairing of the ones that follow
+ *
+ * @param aec Echo canceller instance
+ * @param count Number of samples lost
+ */
+void aec_skip(aec_t* aec, size_t count);
+
+/**
+ * Get echo canceller statistics
+ *
+ * @param aec Echo canceller instance
+ * @param stats Pointer to structure to fill
+ */
+void aec_get_stats(const aec_t* aec, aec_stats_t* stats);
+
+#endif // ECHO_CANCELLER_H
@@ -0,0 +1,81 @@
+#include "fft.h"
+#include <stdbool.h>
+#include <math.h>
+
+// Q15 twiddles e^(-2*pi*i*k/FFT_MAX_SIZE) for k < FFT_MAX_SIZE / 2; smaller
+// transforms step through the table. Stored in 32 bits so 1.0 is exact: a
+// 32767 would shrink every butterfly by 2^-15. Filled on first use: every
+// caller writes the same values, so a race between two first users is
+// harmless.
+static int32_t twiddle_cos[FFT_MAX_SIZE / 2];
+static int32_t twiddle_sin[FFT_MAX_SIZE / 2];
+static volatile bool twiddles_ready = false;
+
+static void fft_make_twiddles(void)
+{
+    for (int k = 0; k < FFT_MAX_SIZE / 2; k++) {
+        double angle = 2.0 * M_PI * k / FFT_MAX_SIZE;
+        twiddle_cos[k] = (int32_t)lrint(cos(angle) * 32768.0);
+        twiddle_sin[k] = (int32_t)lrint(-sin(angle) * 32768.0);
+    }
+    twiddles_ready = true;
+}
+
+static void fft_bit_reverse(fft_complex_t* data, uint16_t n)
+{
+    for (uint16_t i = 1, j = 0; i < n; i++) {
+        uint16_t bit = n >> 1;
+        for (; j & bit; bit >>= 1) {
+            j ^= bit;
+        }
+        j |= bit;
+        if (i < j) {
+            fft_complex_t t = data[i];
+            data[i] = data[j];
+            data[j] = t;
+        }
+    }
+}
+
+// Decimation in time; the inverse conjugates the twiddles and halves every
+// stage so the result is scaled by 1/n without extra headroom
+static void fft_transform(fft_complex_t* data, uint16_t n, bool inverse)
+{
+    if (!twiddles_ready) {
+        fft_make_twiddles();
+    }
+    fft_bit_reverse(data, n);
+
+    const int shift = inverse ? 1 : 0;
+    const int64_t round = inverse ? (1 << 15) : (1 << 14);
+    for (uint16_t half = 1; half < n; half <<= 1) {
+        uint16_t step = FFT_MAX_SIZE / (2 * half);
+        for (uint16_t k = 0; k < half; k++) {
+            int32_t wr = twiddle_cos[k * step];
+            int32_t wi = inverse ? -twiddle_sin[k * step] : twiddle_sin[k * step];
+            for (uint16_t i = k; i < n; i += 2 * half) {
+                fft_complex_t* a = &data[i];
+                fft_complex_t* b = &data[i + half];
+                // b * w in Q15, kept at full precision until the final shift
+                int64_t tr = (int64_t)b->re * wr - (int64_t)b->im * wi;
+                int64_t ti = (int64_t)b->re * wi + (int64_t)b->im * wr;
+                int64_t ar = (int64_t)a->re * 32768;
+                int64_t ai = (int64_t)a->im * 32768;
+                a->re = (int32_t)((ar + tr + round) >> (15 + shift));
+                a->im = (int32_t)((ai + ti + round) >> (15 + shift));
+                b->re = (int32_t)((ar - tr + round) >> (15 + shift));
+                b->im = (int32_t)((ai - ti + round) >> (15 + shift));
+            }
+        }
+    }
+}
+
+void fft_forward(fft_complex_t* data, uint16_t n)
+{
+    fft_transform(data, n, false);
+}
+
+void fft_inverse(fft_complex_t* data, uint16_t n)
+{
+    fft_transform(data, n, true);
+}
@@ -0,0 +1,34 @@
+#ifndef FFT_H
+#define FFT_H
+
+#include <stdint.h>
+
+#define FFT_MAX_SIZE    256     // Largest transform, a power of two
+
+/**
+ * Complex sample in whatever fixed-point scale the caller chose
+ */
+typedef struct {
+    int32_t re;
+    int32_t im;
+} fft_complex_t;
+
+/**
+ * In-place radix-2 forward FFT with Q15 twiddles, unscaled: values grow by
+ * up to @p n, so inputs must stay below 2^(31 - log2 n).
+ *
+ * @param data n complex values, replaced by the spectrum
+ * @param n Transform size, a power of two up to FFT_MAX_SIZE
+ */
+void fft_forward(fft_complex_t* data, uint16_t n);
+
+/**
+ * In-place inverse FFT scaled by 1/n (halved at every stage), so
+ * fft_inverse(fft_forward(x)) == x up to rounding
+ *
+ * @param data n complex values, replaced by the signal
+ * @param n Transform size, a power of two up to FFT_MAX_SIZE
+ */
+void fft_inverse(fft_complex_t* data, uint16_t n);
+
+#endif // FFT_H
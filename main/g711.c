@@ -0,0 +1,190 @@
+#include "g711.h"
+#include "esp_attr.h"
+
+/*
+ * Table-driven G.711 codec.
+ *
+ * Encoders follow the ITU-T G.191 reference (ulaw_compress/alaw_compress) but
+ * replace the segment search loop with a 128-entry bit-length table, so every
+ * sample costs one small table lookup and a few shifts. Decoders are plain
+ * 256-entry tables generated from the reference expanders.
+ *
+ * Tables live in internal RAM: they are hit for every sample at 8 kHz and
+ * must not depend on the flash cache.
+ */
+
+// Number of significant bits of i (0..7) for i in 0..127
+static const DRAM_ATTR uint8_t seg_table[128] = {
+    0, 1, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 4, 4, 4, 4,
+    5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5,
+    6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6,
+    6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6,
+    7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7,
+    7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7,
+    7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7,
+    7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7
+};
+
+// μ-law decode table (G.191 ulaw_expand)
+static const DRAM_ATTR int16_t ulaw_decode_table[256] = {
+    -32124, -31100, -30076, -29052, -28028, -27004, -25980, -24956,
+    -23932, -22908, -21884, -20860, -19836, -18812, -17788, -16764,
+    -15996, -15484, -14972, -14460, -13948, -13436, -12924, -12412,
+    -11900, -11388, -10876, -10364,  -9852,  -9340,  -8828,  -8316,
+     -7932,  -7676,  -7420,  -7164,  -6908,  -6652,  -6396,  -6140,
+     -5884,  -5628,  -5372,  -5116,  -4860,  -4604,  -4348,  -4092,
+     -3900,  -3772,  -3644,  -3516,  -3388,  -3260,  -3132,  -3004,
+     -2876,  -2748,  -2620,  -2492,  -2364,  -2236,  -2108,  -1980,
+     -1884,  -1820,  -1756,  -1692,  -1628,  -1564,  -1500,  -1436,
+     -1372,  -1308,  -1244,  -1180,  -1116,  -1052,   -988,   -924,
+      -876,   -844,   -812,   -780,   -748,   -716,   -684,   -652,
+      -620,   -588,   -556,   -524,   -492,   -460,   -428,   -396,
+      -372,   -356,   -340,   -324,   -308,   -292,   -276,   -260,
+      -244,   -228,   -212,   -196,   -180,   -164,   -148,   -132,
+      -120,   -112,   -104,    -96,    -88,    -80,    -72,    -64,
+       -56,    -48,    -40,    -32,    -24,    -16,     -8,      0,
+     32124,  31100,  30076,  29052,  28028,  27004,  25980,  24956,
+     23932,  22908,  21884,  20860,  19836,  18812,  17788,  16764,
+     15996,  15484,  14972,  14460,  13948,  13436,  12924,  12412,
+     11900,  11388,  10876,  10364,   9852,   9340,   8828,   8316,
+      7932,   7676,   7420,   7164,   6908,   6652,   6396,   6140,
+      5884,   5628,   5372,   5116,   4860,   4604,   4348,   4092,
+      3900,   3772,   3644,   3516,   3388,   3260,   3132,   3004,
+      2876,   2748,   2620,   2492,   2364,   2236,   2108,   1980,
+      1884,   1820,   1756,   1692,   1628,   1564,   1500,   1436,
+      1372,   1308,   1244,   1180,   1116,   1052,    988,    924,
+       876,    844,    812,    780,    748,    716,    684,    652,
+       620,    588,    556,    524,    492,    460,    428,    396,
+       372,    356,    340,    324,    308,    292,    276,    260,
+       244,    228,    212,    196,    180,    164,    148,    132,
+       120,    112,    104,     96,     88,     80,     72,     64,
+        56,     48,     40,     32,     24,     16,      8,      0
+};
+
+// A-law decode table (G.191 alaw_expand)
+static const DRAM_ATTR int16_t alaw_decode_table[256] = {
+     -5504,  -5248,  -6016,  -5760,  -4480,  -4224,  -4992,  -4736,
+     -7552,  -7296,  -8064,  -7808,  -6528,  -6272,  -7040,  -6784,
+     -2752,  -2624,  -3008,  -2880,  -2240,  -2112,  -2496,  -2368,
+     -3776,  -3648,  -4032,  -3904,  -3264,  -3136,  -3520,  -3392,
+    -22016, -20992, -24064, -23040, -17920, -16896, -19968, -18944,
+    -30208, -29184, -32256, -31232, -26112, -25088, -28160, -27136,
+    -11008, -10496, -12032, -11520,  -8960,  -8448,  -9984,  -9472,
+    -15104, -14592, -16128, -15616, -13056, -12544, -14080, -13568,
+      -344,   -328,   -376,   -360,   -280,   -264,   -312,   -296,
+      -472,   -456,   -504,   -488,   -408,   -392,   -440,   -424,
+       -88,    -72,   -120,   -104,    -24,     -8,    -56,    -40,
+      -216,   -200,   -248,   -232,   -152,   -136,   -184,   -168,
+     -1376,  -1312,  -1504,  -1440,  -1120,  -1056,  -1248,  -1184,
+     -1888,  -1824,  -2016,  -1952,  -1632,  -1568,  -1760,  -1696,
+      -688,   -656,   -752,   -720,   -560,   -528,   -624,   -592,
+      -944,   -912,  -1008,   -976,   -816,   -784,   -880,   -848,
+      5504,   5248,   6016,   5760,   4480,   4224,   4992,   4736,
+      7552,   7296,   8064,   7808,   6528,   6272,   7040,   6784,
+      2752,   2624,   3008,   2880,   2240,   2112,   2496,   2368,
+      3776,   3648,   4032,   3904,   3264,   3136,   3520,   3392,
+     22016,  20992,  24064,  23040,  17920,  16896,  19968,  18944,
+     30208,  29184,  32256,  31232,  26112,  25088,  28160,  27136,
+     11008,  10496,  12032,  11520,   8960,   8448,   9984,   9472,
+     15104,  14592,  16128,  15616,  13056,  12544,  14080,  13568,
+       344,    328,    376,    360,    280,    264,    312,    296,
+       472,    456,    504,    488,    408,    392,    440,    424,
+        88,     72,    120,    104,     24,      8,     56,     40,
+       216,    200,    248,    232,    152,    136,    184,    168,
+      1376,   1312,   1504,   1440,   1120,   1056,   1248,   1184,
+      1888,   1824,   2016,   1952,   1632,   1568,   1760,   1696,
+       688,    656,    752,    720,    560,    528,    624,    592,
+       944,    912,   1008,    976,    816,    784,    880,    848
+};
+
+uint8_t g711_ulaw_encode(int16_t sample)
+{
+    // Magnitude in 14-bit domain plus bias (one's complement for negatives,
+    // as in the reference), clipped to 13 bits
+    int32_t magnitude = (sample < 0) ? ((~sample) >> 2) + 33 : (sample >> 2) + 33;
+    if (magnitude > 0x1FFF) {
+        magnitude = 0x1FFF;
+    }
+
+    uint32_t segment = seg_table[magnitude >> 6] + 1;
+    uint32_t mantissa = (magnitude >> segment) & 0x0F;
+    uint8_t code = (uint8_t)(((8 - segment) << 4) | (0x0F - mantissa));
+
+    return (sample >= 0) ? (code | 0x80) : code;
+}
+
+int16_t g711_ulaw_decode(uint8_t code)
+{
+    return ulaw_decode_table[code];
+}
+
+uint8_t g711_alaw_encode(int16_t sample)
+{
+    // 12-bit magnitude (one's complement for negatives, as in the reference)
+    uint32_t magnitude = (sample < 0) ? ((~sample) >> 4) : (sample >> 4);
+    uint32_t code;
+
+    if (magnitude > 15) {
+        uint32_t exponent = seg_table[magnitude >> 4];
+        code = (exponent << 4) | ((magnitude >> (exponent - 1)) & 0x0F);
+    } else {
+        code = magnitude;
+    }
+
+    if (sample >= 0) {
+        code |= 0x80;
+    }
+    return (uint8_t)(code ^ 0x55);
+}
+
+int16_t g711_alaw_decode(uint8_t code)
+{
+    return alaw_decode_table[code];
+}
+
+// Block loops are kept branch-free per sample with restrict pointers so the
+// compiler can unroll and pipeline them; the per-sample work is a table
+// lookup, which has no vector form on the ESP32-S3, so the gain comes from
+// unrolling rather than SIMD lanes
+void g711_encode_block(g711_law_t law, const int16_t* restrict in, uint8_t* restrict out, size_t count)
+{
+    if (law == G711_ALAW) {
+        for (size_t i = 0; i < count; i++) {
+            out[i] = g711_alaw_encode(in[i]);
+        }
+    } else {
+        for (size_t i = 0; i < count; i++) {
+            out[i] = g711_ulaw_encode(in[i]);
+        }
+    }
+}
+
+void g711_decode_block(g711_law_t law, const uint8_t* restrict in, int16_t* restrict out, size_t count)
+{
+    const int16_t* table = (law == G711_ALAW) ? alaw_decode_table : ulaw_decode_table;
+    size_t i = 0;
+
+    for (; i + 4 <= count; i += 4) {
+        out[i]     = table[in[i]];
+        out[i + 1] = table[in[i + 1]];
+        out[i + 2] = table[in[i + 2]];
+        out[i + 3] = table[in[i + 3]];
+    }
+    for (; i < count; i++) {
+        out[i] = table[in[i]];
+    }
+}
+
+bool g711_law_from_payload_type(uint8_t payload_type, g711_law_t* law)
+{
+    switch (payload_type) {
+        case G711_PT_PCMU:
+            *law = G711_ULAW;
+            return true;
+        case G711_PT_PCMA:
+            *law = G711_ALAW;
+            return true;
+        default:
+            return false;
+    }
+}
@@ -0,0 +1,69 @@
+#ifndef G711_H
+#define G711_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+// Static RTP payload types (RFC 3551)
+#define G711_PT_PCMU    0
+#define G711_PT_PCMA    8
+
+/**
+ * G.711 companding law
+ */
+typedef enum {
+    G711_ULAW,  // PCMU
+    G711_ALAW   // PCMA
+} g711_law_t;
+
+/**
+ * Encode one 16-bit linear sample to μ-law (ITU-T G.711 / G.191 compatible)
+ */
+uint8_t g711_ulaw_encode(int16_t sample);
+
+/**
+ * Decode one μ-law byte to a 16-bit linear sample
+ */
+int16_t g711_ulaw_decode(uint8_t code);
+
+/**
+ * Encode one 16-bit linear sample to A-law (ITU-T G.711 / G.191 compatible)
+ */
+uint8_t g711_alaw_encode(int16_t sample);
+
+/**
+ * Decode one A-law byte to a 16-bit linear sample
+ */
+int16_t g711_alaw_decode(uint8_t code);
+
+/**
+ * Encode a block of samples (typically one 160-sample frame)
+ *
+ * @param law Companding law
+ * @param in Linear PCM input
+ * @param out Encoded output (count bytes)
+ * @param count Number of samples
+ */
+void g711_encode_block(g711_law_t law, const int16_t* in, uint8_t* out, size_t count);
+
+/**
+ * Decode a block of G.711 bytes (typically one 160-byte frame)
+ *
+ * @param law Companding law
+ * @param in Encoded input
+ * @param out Linear PCM output (count samples)
+ * @param count Number of bytes
+ */
+void g711_decode_block(g711_law_t law, const uint8_t* in, int16_t* out, size_t count);
+
+/**
+ * Map an RTP payload type to its G.711 law
+ *
+ * @param payload_type RTP payload type
+ * @param law Receives the law for PCMU/PCMA
+ * @return true if the payload type is PCMU or PCMA
+ */
+bool g711_law_from_payload_type(uint8_t payload_type, g711_law_t* law);
+
+#endif // G711_H
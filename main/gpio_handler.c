@@ -6,6 +6,7 @@
 #include "freertos/queue.h"
 #include "sip_client.h"
 #include "auth_manager.h"
+#include "call_trace.h"
 
 static const char *TAG = "GPIO";
 static bool light_state = false;
@@ -29,6 +30,7 @@ static void doorbell_task(void *arg)
     
     while (1) {
         if (xQueueReceive(doorbell_queue, &event, portMAX_DELAY)) {
+            call_trace_point(CALL_TRACE_DOORBELL_DEQUEUE, event.bell);
             TickType_t current_time = xTaskGetTickCount();
             int bell_index = (event.bell == DOORBELL_1) ? 0 : 1;
             
@@ -65,6 +67,8 @@ static void IRAM_ATTR doorbell_isr_handler(void* arg)
 {
     doorbell_t bell = (doorbell_t)(int)arg;
     BaseType_t xHigherPriorityTaskWoken = pdFALSE;
+
+    call_trace_point(CALL_TRACE_DOORBELL_ISR, bell);
     
     // Send event to queue for processing in task context
     doorbell_event_t event = { .bell = bell };
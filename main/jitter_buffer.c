@@ -0,0 +1,369 @@
+#include "jitter_buffer.h"
+#include "esp_log.h"
+#include <string.h>
+
+static const char *TAG = "JITTER";
+
+#define JB_SLOT_MASK        (JB_SLOT_COUNT - 1)
+
+// Playout delay covers this many multiples of the measured jitter
+#define JB_JITTER_MULTIPLIER 3
+
+// Delay grows immediately but only shrinks after this many consecutive
+// packets asked for less (about 2 s at 20 ms), so it does not flap
+#define JB_DECREASE_HOLD_PACKETS 100
+
+// A packet this far (about 40 s) from the playout point means the sender
+// restarted its timestamps
+#define JB_RESET_FRAMES 0x1000
+
+// Packets remembered for duplicate detection (bits in seen_seqs)
+#define JB_SEQ_HISTORY  64
+
+// Frame number distance with 16-bit wraparound (positive if a is after b)
+static inline int16_t seq_diff(uint16_t a, uint16_t b)
+{
+    return (int16_t)(a - b);
+}
+
+// Record a packet's sequence number; true if it was received before.
+// Anything older than the history is let through: its frames are late or
+// already buffered, and the frame checks deal with both.
+static bool jb_seen(jitter_buffer_t* jb, uint16_t seq)
+{
+    if (!jb->have_seq) {
+        jb->have_seq = true;
+        jb->highest_rtp_seq = seq;
+        jb->seen_seqs = 1;
+        return false;
+    }
+
+    int16_t ahead = seq_diff(seq, jb->highest_rtp_seq);
+    if (ahead > 0) {
+        jb->seen_seqs = ahead < JB_SEQ_HISTORY ? (jb->seen_seqs << ahead) | 1 : 1;
+        jb->highest_rtp_seq = seq;
+        return false;
+    }
+    if (-ahead >= JB_SEQ_HISTORY) {
+        return false;
+    }
+    uint64_t bit = (uint64_t)1 << -ahead;
+    if (jb->seen_seqs & bit) {
+        return true;
+    }
+    jb->seen_seqs |= bit;
+    return false;
+}
+
+static void jb_flush(jitter_buffer_t* jb)
+{
+    for (int i = 0; i < JB_SLOT_COUNT; i++) {
+        jb->slots[i].used = false;
+    }
+    jb->frames_buffered = 0;
+    jb->playing = false;
+}
+
+// RFC 3550 A.8 interarrival jitter, kept in microseconds
+static void jb_update_jitter(jitter_buffer_t* jb, uint32_t timestamp, int64_t arrival_us)
+{
+    if (jb->have_last) {
+        int64_t arrival_delta = arrival_us - jb->last_arrival_us;
+        int64_t media_delta = ((int64_t)(int32_t)(timestamp - jb->last_timestamp) * 1000000) / jb->clock_rate;
+        int64_t d = arrival_delta - media_delta;
+        if (d < 0) {
+            d = -d;
+        }
+        jb->jitter_us = (uint32_t)((int64_t)jb->jitter_us + (d - (int64_t)jb->jitter_us) / 16);
+    }
+    jb->have_last = true;
+    jb->last_arrival_us = arrival_us;
+    jb->last_timestamp = timestamp;
+}
+
+// Playout delay = one packet + k * jitter, rounded up to whole frames
+static void jb_adapt_target(jitter_buffer_t* jb)
+{
+    uint32_t frame_us = (uint32_t)jb->frame_ms * 1000;
+    uint32_t needed_us = JB_JITTER_MULTIPLIER * jb->jitter_us;
+    uint16_t target = jb->packet_frames + (needed_us + frame_us - 1) / frame_us;
+
+    if (target < JB_MIN_DELAY_FRAMES) {
+        target = JB_MIN_DELAY_FRAMES;
+    } else if (target > JB_MAX_DELAY_FRAMES) {
+        target = JB_MAX_DELAY_FRAMES;
+    }
+
+    if (target < jb->target_frames) {
+        if (++jb->decrease_count < JB_DECREASE_HOLD_PACKETS) {
+            return;
+        }
+        target = jb->target_frames - 1;
+    }
+    jb->decrease_count = 0;
+
+    if (target != jb->target_frames) {
+        ESP_LOGD(TAG, "Playout delay %u -> %u ms (jitter %lu us)",
+                 jb->target_frames * jb->frame_ms, target * jb->frame_ms,
+                 (unsigned long)jb->jitter_us);
+        jb->target_frames = target;
+    }
+}
+
+// Move the playout point on by one frame
+static void jb_advance(jitter_buffer_t* jb)
+{
+    jb->next_seq++;
+    jb->next_timestamp += jb->frame_samples;
+}
+
+// Drop the slot at next_seq and advance the playout point by one frame
+static void jb_skip_frame(jitter_buffer_t* jb)
+{
+    jb_slot_t* slot = &jb->slots[jb->next_seq & JB_SLOT_MASK];
+    if (slot->used && slot->seq == jb->next_seq) {
+        slot->used = false;
+        jb->frames_buffered--;
+        jb->stats.discarded++;
+    }
+    jb_advance(jb);
+}
+
+// Frame number of a timestamp and the sample offset into that frame
+static uint16_t jb_frame_of(const jitter_buffer_t* jb, uint32_t timestamp, uint16_t* offset)
+{
+    int32_t samples = (int32_t)(timestamp - jb->base_timestamp);
+    int32_t frame = samples >= 0 ? samples / jb->frame_samples
+                                 : -((-samples + jb->frame_samples - 1) / jb->frame_samples);
+    *offset = (uint16_t)(samples - frame * jb->frame_samples);
+    return (uint16_t)frame;
+}
+
+// Make room for frames first..last; false if the whole packet is too late
+static bool jb_place(jitter_buffer_t* jb, uint16_t first, uint16_t last, uint32_t first_timestamp)
+{
+    if (seq_diff(first, jb->next_seq) < 0) {
+        if (jb->playing) {
+            // Frames whose playout slot has passed are skipped when stored
+            return seq_diff(last, jb->next_seq) >= 0;
+        }
+        // Reordered during prefill - start playout earlier if it still fits
+        if (seq_diff(jb->highest_seq, first) >= JB_SLOT_COUNT) {
+            return false;
+        }
+        jb->next_seq = first;
+        jb->next_timestamp = first_timestamp;
+    }
+
+    // Overflow: advance playout so the new packet fits
+    while (seq_diff(last, jb->next_seq) >= JB_SLOT_COUNT) {
+        jb_skip_frame(jb);
+    }
+    return true;
+}
+
+// A packet came too late for the delay: raise it by up to one packet and
+// hold playout until the buffer has caught up with it
+static void jb_late(jitter_buffer_t* jb, uint16_t first)
+{
+    uint16_t behind = (uint16_t)seq_diff(jb->next_seq, first);
+    if (behind > jb->packet_frames) {
+        behind = jb->packet_frames;
+    }
+    uint16_t target = jb->target_frames + behind;
+    jb->target_frames = target > JB_MAX_DELAY_FRAMES ? JB_MAX_DELAY_FRAMES : target;
+    jb->decrease_count = 0;
+    jb->stretching = true;
+    jb->stats.late++;
+}
+
+void jb_init(jitter_buffer_t* jb, uint32_t clock_rate, uint16_t frame_ms)
+{
+    memset(jb, 0, sizeof(*jb));
+    jb->clock_rate = clock_rate ? clock_rate : 8000;
+    jb->frame_ms = frame_ms ? frame_ms : 10;
+    jb->frame_samples = (uint16_t)(jb->clock_rate * jb->frame_ms / 1000);
+    if (jb->frame_samples == 0 || jb->frame_samples > JB_MAX_PAYLOAD) {
+        jb->frame_samples = JB_MAX_PAYLOAD;
+        jb->frame_ms = (uint16_t)(JB_MAX_PAYLOAD * 1000 / jb->clock_rate);
+    }
+    jb->packet_frames = 1;
+    jb->target_frames = JB_MIN_DELAY_FRAMES;
+}
+
+bool jb_put(jitter_buffer_t* jb, uint16_t seq, uint32_t timestamp, uint8_t payload_type,
+            const uint8_t* payload, size_t len, int64_t arrival_us)
+{
+    if (len == 0 || len > (size_t)JB_MAX_PACKET_FRAMES * jb->frame_samples) {
+        jb->stats.discarded++;
+        return false;
+    }
+
+    // A repeated packet must not count as late once its frames have played,
+    // or raise the delay through a bogus jitter sample
+    if (jb_seen(jb, seq)) {
+        jb->stats.discarded++;
+        return false;
+    }
+
+    // Frames one packet can leave waiting for the next: a packet that ends
+    // part way into a frame leaves that one unfinished too
+    jb->packet_frames = (uint16_t)((len + jb->frame_samples - 1) / jb->frame_samples);
+    if (len % jb->frame_samples != 0) {
+        jb->packet_frames++;
+    }
+    jb_update_jitter(jb, timestamp, arrival_us);
+    jb_adapt_target(jb);
+
+    bool restart = jb->frames_buffered == 0 && !jb->playing;
+    int32_t ahead = (int32_t)(timestamp - jb->next_timestamp);
+    if (!restart && (ahead > JB_RESET_FRAMES * jb->frame_samples || ahead < -JB_RESET_FRAMES * jb->frame_samples)) {
+        // Sender restarted its timestamps - start over
+        ESP_LOGW(TAG, "Timestamp jump by %ld samples, resetting", (long)ahead);
+        jb->stats.discarded += jb->frames_buffered;
+        jb_flush(jb);
+        jb->seen_seqs = 1;
+        jb->highest_rtp_seq = seq;
+        restart = true;
+    }
+    if (restart) {
+        // Empty and not playing: this packet defines the playout point
+        jb->base_timestamp = timestamp;
+        jb->next_timestamp = timestamp;
+        jb->next_seq = 0;
+        jb->highest_seq = 0;
+        jb->stretching = false;
+    }
+
+    uint16_t offset;
+    uint16_t first = jb_frame_of(jb, timestamp, &offset);
+    uint16_t last = jb_frame_of(jb, timestamp + (uint32_t)len - 1, &offset);
+    if (!jb_place(jb, first, last, timestamp - offset)) {
+        if (jb->playing) {
+            jb_late(jb, first);
+        } else {
+            jb->stats.discarded++;
+        }
+        return false;
+    }
+
+    bool stored = false;
+    bool late = false;
+    bool dropped = false;
+    size_t done = 0;
+    while (done < len) {
+        uint16_t frame = jb_frame_of(jb, timestamp + (uint32_t)done, &offset);
+        size_t count = jb->frame_samples - offset;
+        if (count > len - done) {
+            count = len - done;
+        }
+
+        jb_slot_t* slot = &jb->slots[frame & JB_SLOT_MASK];
+        if (seq_diff(frame, jb->next_seq) < 0) {
+            late = true;                // Its playout slot has passed
+        } else if (slot->used && slot->seq == frame) {
+            if (offset == slot->len) {
+                // Rest of a frame an earlier packet ended in
+                memcpy(slot->payload + offset, payload + done, count);
+                slot->len += count;
+                stored = true;
+            } else {
+                dropped = true;         // Duplicate
+            }
+        } else if (offset == 0) {
+            if (slot->used) {
+                // Stale frame from a previous lap of the ring
+                jb->frames_buffered--;
+                jb->stats.discarded++;
+            }
+            slot->used = true;
+            slot->seq = frame;
+            slot->timestamp = timestamp + (uint32_t)done;
+            slot->payload_type = payload_type;
+            slot->len = count;
+            memcpy(slot->payload, payload + done, count);
+            jb->frames_buffered++;
+            stored = true;
+            if (seq_diff(frame, jb->highest_seq) > 0) {
+                jb->highest_seq = frame;
+            }
+        } else {
+            dropped = true;             // Rest of a frame whose start was lost
+        }
+        done += count;
+    }
+
+    if (late) {
+        jb_late(jb, first);
+    }
+    if (dropped) {
+        jb->stats.discarded++;
+    }
+    if (stored) {
+        jb->stats.received++;
+    }
+    return stored;
+}
+
+jb_result_t jb_get(jitter_buffer_t* jb, uint8_t* payload, size_t* len, uint8_t* payload_type)
+{
+    if (!jb->playing) {
+        if (jb->frames_buffered == 0 || jb->frames_buffered < jb->target_frames) {
+            return JB_FRAME_BUFFERING;
+        }
+        jb->playing = true;
+    }
+
+    // After a late packet: play nothing until the raised delay is buffered
+    if (jb->stretching) {
+        if (jb->frames_buffered != 0 && jb->frames_buffered < jb->target_frames) {
+            jb->stats.lost++;
+            return JB_FRAME_MISSING;
+        }
+        jb->stretching = false;
+    }
+
+    // Delay went down (or a burst arrived): shed one frame per tick so the
+    // reduction is spread out instead of a single audible jump. Right after
+    // a packet arrives the buffer holds up to a packet more than the target.
+    if (jb->frames_buffered > jb->target_frames + jb->packet_frames) {
+        jb_skip_frame(jb);
+    }
+
+    jb_slot_t* slot = &jb->slots[jb->next_seq & JB_SLOT_MASK];
+    if (slot->used && slot->seq == jb->next_seq) {
+        memcpy(payload, slot->payload, slot->len);
+        *len = slot->len;
+        if (payload_type) {
+            *payload_type = slot->payload_type;
+        }
+        slot->used = false;
+        jb->frames_buffered--;
+        jb_advance(jb);
+        jb->stats.played++;
+        return JB_FRAME_OK;
+    }
+
+    if (jb->frames_buffered == 0) {
+        // Underrun: nothing left to play, go back to prefill
+        jb->playing = false;
+        jb->stats.rebuffers++;
+        return JB_FRAME_BUFFERING;
+    }
+
+    // Frame lost (or still in flight) but later ones are queued - move on
+    jb_advance(jb);
+    jb->stats.lost++;
+    return JB_FRAME_MISSING;
+}
+
+void jb_get_stats(const jitter_buffer_t* jb, jb_stats_t* stats)
+{
+    if (!stats) {
+        return;
+    }
+    memcpy(stats, &jb->stats, sizeof(*stats));
+    stats->depth = jb->frames_buffered;
+    stats->target_delay_ms = jb->target_frames * jb->frame_ms;
+    stats->jitter_us = jb->jitter_us;
+}
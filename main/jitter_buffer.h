@@ -0,0 +1,132 @@
+#ifndef JITTER_BUFFER_H
+#define JITTER_BUFFER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// The buffer holds frames of a fixed duration, whatever the sender's
+// packetization: each packet is split into frames numbered by RTP
+// timestamp. Payloads are one byte per sample (G.711).
+// Slot count must be a power of two (slot index = frame number & (count - 1))
+#define JB_SLOT_COUNT           64
+#define JB_MAX_PAYLOAD          80      // One 10 ms frame of G.711 at 8 kHz
+#define JB_MAX_PACKET_FRAMES    12      // Longest packet accepted (120 ms)
+#define JB_MIN_DELAY_FRAMES     1
+#define JB_MAX_DELAY_FRAMES     (JB_SLOT_COUNT - 2 * JB_MAX_PACKET_FRAMES)
+
+/**
+ * Result of a playout request
+ */
+typedef enum {
+    JB_FRAME_OK,        // Frame copied to caller
+    JB_FRAME_MISSING,   // Playout running but the frame for this tick was lost or late
+    JB_FRAME_BUFFERING  // Buffer is (re)filling to its target delay - nothing to play
+} jb_result_t;
+
+/**
+ * Jitter buffer statistics
+ */
+typedef struct {
+    uint32_t received;          // Packets accepted into the buffer
+    uint32_t played;            // Frames handed to playout (frame_ms each)
+    uint32_t lost;              // Playout ticks with no frame available
+    uint32_t late;              // Packets that arrived after their playout time
+    uint32_t discarded;         // Duplicates, overflow and delay-reduction drops
+    uint32_t rebuffers;         // Underruns that restarted prefill
+    uint16_t depth;             // Frames currently buffered
+    uint16_t target_delay_ms;   // Current adaptive playout delay
+    uint32_t jitter_us;         // RFC 3550 interarrival jitter estimate
+} jb_stats_t;
+
+typedef struct {
+    bool used;
+    uint16_t seq;               // Frame number
+    uint32_t timestamp;
+    uint8_t payload_type;
+    uint16_t len;
+    uint8_t payload[JB_MAX_PAYLOAD];
+} jb_slot_t;
+
+/**
+ * Jitter buffer instance (fixed capacity, no heap use)
+ */
+typedef struct {
+    jb_slot_t slots[JB_SLOT_COUNT];
+    uint32_t clock_rate;        // RTP clock rate (Hz)
+    uint16_t frame_ms;          // Duration of one buffered frame
+    uint16_t frame_samples;     // Samples (bytes) per frame
+    uint16_t packet_frames;     // Frames in the last packet received (one more if it ends mid-frame)
+    bool playing;               // Prefill done, playout running
+    bool have_last;             // Jitter estimator initialized
+    bool stretching;            // Holding playout until a raised delay is buffered
+    uint32_t base_timestamp;    // RTP timestamp of frame number 0
+    uint32_t next_timestamp;    // RTP timestamp of frame next_seq
+    uint16_t next_seq;          // Next frame number to play out
+    uint16_t highest_seq;       // Highest frame number buffered
+    int64_t last_arrival_us;    // Arrival time of the previous packet
+    uint32_t last_timestamp;    // RTP timestamp of the previous packet
+    uint32_t jitter_us;         // Interarrival jitter (microseconds)
+    uint16_t target_frames;     // Adaptive playout delay in frames
+    uint16_t decrease_count;    // Packets in a row that wanted a smaller delay
+    uint16_t frames_buffered;   // Occupied slots
+    bool have_seq;              // Packet history initialized
+    uint16_t highest_rtp_seq;   // Highest RTP sequence number received
+    uint64_t seen_seqs;         // Bit n: highest_rtp_seq - n was received
+    jb_stats_t stats;
+} jitter_buffer_t;
+
+/**
+ * Initialize (or reset) a jitter buffer
+ *
+ * @param jb Jitter buffer instance
+ * @param clock_rate RTP clock rate in Hz (8000 for G.711)
+ * @param frame_ms Duration of a buffered frame in ms, at most JB_MAX_PAYLOAD
+ *                 samples (10 for 80-sample frames). Packets may carry any
+ *                 number of samples; playout takes one frame per call.
+ */
+void jb_init(jitter_buffer_t* jb, uint32_t clock_rate, uint16_t frame_ms);
+
+/**
+ * Insert a received RTP packet
+ * Drops a packet whose sequence number was seen in the last 64, before it
+ * can touch the jitter estimate or count as late. Otherwise updates the
+ * jitter estimate, splits the payload into frames at their RTP timestamps,
+ * discards duplicate and late frames and adapts the playout delay; a late
+ * packet raises it at once. A frame split across packets is completed by
+ * the next one.
+ *
+ * @param jb Jitter buffer instance
+ * @param seq RTP sequence number (host order), for duplicate detection;
+ *            frames are ordered by timestamp
+ * @param timestamp RTP timestamp (host order)
+ * @param payload_type RTP payload type
+ * @param payload Encoded payload
+ * @param len Payload length in bytes, up to JB_MAX_PACKET_FRAMES frames
+ * @param arrival_us Local arrival time in microseconds
+ * @return true if any frame of the packet was buffered
+ */
+bool jb_put(jitter_buffer_t* jb, uint16_t seq, uint32_t timestamp, uint8_t payload_type,
+            const uint8_t* payload, size_t len, int64_t arrival_us);
+
+/**
+ * Take the frame due for this playout tick (call once per frame_ms)
+ *
+ * @param jb Jitter buffer instance
+ * @param payload Destination for the encoded payload (JB_MAX_PAYLOAD bytes)
+ * @param len Receives the payload length (less than a frame if the packet
+ *            carrying its end was lost)
+ * @param payload_type Receives the payload type
+ * @return JB_FRAME_OK, JB_FRAME_MISSING or JB_FRAME_BUFFERING
+ */
+jb_result_t jb_get(jitter_buffer_t* jb, uint8_t* payload, size_t* len, uint8_t* payload_type);
+
+/**
+ * Get jitter buffer statistics
+ *
+ * @param jb Jitter buffer instance
+ * @param stats Pointer to structure to fill
+ */
+void jb_get_stats(const jitter_buffer_t* jb, jb_stats_t* stats);
+
+#endif // JITTER_BUFFER_H
@@ -0,0 +1,537 @@
+#include "media_engine.h"
+#include "audio_handler.h"
+#include "rtp_handler.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "nvs.h"
+#include <string.h>
+#include <inttypes.h>
+
+static const char *TAG = "MEDIA";
+
+// NVS namespace for the capture processing settings
+#define NVS_NAMESPACE "media_dsp"
+
+#define MEDIA_FRAME_PERIOD_US   (MEDIA_FRAME_MS * 1000)
+
+// Media task runs on Core 1 next to the SIP task, but above it in priority so
+// signalling work can never delay a frame
+#define MEDIA_TASK_STACK_SIZE   4096
+#define MEDIA_TASK_PRIORITY     6
+#define MEDIA_TASK_CORE         1
+
+static TaskHandle_t media_task_handle = NULL;
+static esp_timer_handle_t frame_timer = NULL;
+static SemaphoreHandle_t pipeline_mutex = NULL;
+static volatile bool engine_running = false;
+static volatile media_direction_t direction = MEDIA_DIR_SENDRECV;
+static volatile uint32_t last_rx_ms = 0;
+static uint16_t packet_samples = MEDIA_FRAME_SAMPLES;  // Negotiated ptime in samples
+static media_engine_stats_t stats = {0};
+static int64_t last_tick_us = 0;
+static uint64_t capture_to_wire_sum_us = 0;
+
+// Captured frames stay where the audio backend put them (the I2S DMA
+// buffers) until one packet's worth (ptime) is held; they are then encoded
+// straight into the RTP packet and given back
+#define MEDIA_MAX_FRAMES        (MEDIA_MAX_PTIME_MS / MEDIA_FRAME_MS)
+static const int16_t* tx_frames[MEDIA_MAX_FRAMES];
+static size_t tx_counts[MEDIA_MAX_FRAMES];
+static size_t tx_frame_count = 0;
+static size_t tx_borrowed = 0;              // Held frames still owned by the backend
+static size_t tx_fill = 0;                  // Samples held
+static int64_t tx_first_capture_us = 0;     // Capture time of the oldest held frame
+
+// Receive buffer lives in BSS so the media task stack stays small
+static int16_t rx_frame[MEDIA_FRAME_SAMPLES];
+
+// Capture processing: echo canceller (fed every tick with what was played
+// out), noise suppressor, AGC. With any stage on, a captured frame is
+// processed into a media-owned buffer and its DMA buffer goes back at once.
+static media_dsp_config_t dsp_config = {
+    .aec = {
+        .enabled = true,
+        .tail_ms = AEC_DEFAULT_TAIL_MS,
+        .delay_ms = AEC_DEFAULT_DELAY_MS,
+        .dt_threshold_pct = AEC_DEFAULT_DT_PCT,
+    },
+    .ns_enabled = true,
+    .agc_enabled = true,
+};
+static aec_t aec;
+static ns_t ns;
+static agc_t agc;
+static int16_t dsp_frames[MEDIA_MAX_FRAMES][MEDIA_FRAME_SAMPLES];
+static uint32_t aec_overruns = 0;           // Capture overruns already passed to aec_skip()
+
+#define MEDIA_DSP_ACTIVE()      (dsp_config.aec.enabled || dsp_config.ns_enabled || dsp_config.agc_enabled)
+
+#define MEDIA_DIR_SENDS(d)      ((d) == MEDIA_DIR_SENDRECV || (d) == MEDIA_DIR_SENDONLY)
+#define MEDIA_DIR_RECEIVES(d)   ((d) == MEDIA_DIR_SENDRECV || (d) == MEDIA_DIR_RECVONLY)
+
+static const char* direction_name(media_direction_t dir)
+{
+    switch (dir) {
+        case MEDIA_DIR_SENDRECV: return "send/receive";
+        case MEDIA_DIR_RECVONLY: return "receive only";
+        case MEDIA_DIR_SENDONLY: return "send only";
+        case MEDIA_DIR_INACTIVE: return "inactive";
+    }
+    return "?";
+}
+
+// esp_timer callback (timer task context): wake the media task for one frame
+static void frame_timer_callback(void* arg)
+{
+    (void)arg;
+    xTaskNotifyGive(media_task_handle);
+}
+
+// Give back every captured frame held for the next packet
+static void media_release_frames(void)
+{
+    while (tx_borrowed > 0) {
+        audio_capture_release();
+        tx_borrowed--;
+    }
+    tx_frame_count = 0;
+    tx_fill = 0;
+}
+
+// Start the capture processing over. Capture comes before playout in every
+// pass, so the far end starts a frame ahead; without it the first capture
+// frame would have nothing to pair with.
+static void media_dsp_reset(void)
+{
+    aec_init(&aec, &dsp_config.aec);
+    aec_far_end(&aec, NULL, MEDIA_FRAME_SAMPLES);
+    ns_init(&ns, dsp_config.ns_enabled);
+    agc_init(&agc, dsp_config.agc_enabled);
+
+    audio_capture_stats_t capture;
+    audio_get_capture_stats(&capture);
+    aec_overruns = capture.overruns;
+}
+
+// Echo canceller -> noise suppressor -> AGC on one captured frame
+static void media_dsp_process(const audio_frame_t* frame, int16_t* out)
+{
+    aec_process(&aec, frame->samples, out, frame->count);
+    ns_process(&ns, out, out, frame->count);
+    agc_process(&agc, out, out, frame->count);
+}
+
+// One pass of the media pipeline: capture -> encode -> send, receive -> decode -> playout
+static void media_process_frame(void)
+{
+    // Capture and send; early media and hold keep the capture path running so
+    // the answer or resume does not have to wait for the microphone to settle.
+    // Borrowing never blocks: no frame ready is an underrun.
+    audio_frame_t frame;
+    bool captured = audio_capture_borrow(&frame);
+
+    // Frames the backend dropped never reach the canceller; keep the
+    // capture paired with the playout that was heard while they were taken
+    audio_capture_stats_t capture;
+    audio_get_capture_stats(&capture);
+    if (capture.overruns != aec_overruns) {
+        aec_skip(&aec, (size_t)(capture.overruns - aec_overruns) * MEDIA_FRAME_SAMPLES);
+        aec_overruns = capture.overruns;
+    }
+
+    if (!captured) {
+        stats.capture_underruns++;
+    } else if (!MEDIA_DIR_SENDS(direction)) {
+        // Still processed and thrown away: early media trains the echo
+        // filter, the noise estimate and the speech level
+        if (MEDIA_DSP_ACTIVE()) {
+            media_dsp_process(&frame, dsp_frames[0]);
+        } else {
+            aec_skip(&aec, frame.count);
+        }
+        media_release_frames();
+        audio_capture_release();
+    } else {
+        if (tx_frame_count == 0) {
+            tx_first_capture_us = frame.captured_us;
+        }
+        if (MEDIA_DSP_ACTIVE()) {
+            media_dsp_process(&frame, dsp_frames[tx_frame_count]);
+            audio_capture_release();
+            tx_frames[tx_frame_count] = dsp_frames[tx_frame_count];
+        } else {
+            aec_skip(&aec, frame.count);
+            tx_frames[tx_frame_count] = frame.samples;
+            tx_borrowed++;
+        }
+        tx_counts[tx_frame_count] = frame.count;
+        tx_frame_count++;
+        tx_fill += frame.count;
+
+        if (tx_fill >= packet_samples || tx_frame_count == MEDIA_MAX_FRAMES) {
+            if (rtp_send_audio_frames(tx_frames, tx_counts, tx_frame_count) > 0) {
+                stats.frames_sent++;
+                uint32_t latency_us = (uint32_t)(esp_timer_get_time() - tx_first_capture_us);
+                stats.capture_to_wire_us = latency_us;
+                if (latency_us > stats.max_capture_to_wire_us) {
+                    stats.max_capture_to_wire_us = latency_us;
+                }
+                capture_to_wire_sum_us += latency_us;
+            } else {
+                stats.send_errors++;
+            }
+            media_release_frames();
+        }
+    }
+
+    // Receive and play out; the socket is drained in every direction so
+    // stray packets do not pile up while on hold
+    int samples_received = rtp_receive_audio(rx_frame, MEDIA_FRAME_SAMPLES);
+    uint32_t now_ms = xTaskGetTickCount() * portTICK_PERIOD_MS;
+    if (!MEDIA_DIR_RECEIVES(direction)) {
+        // Silence is expected: keep the RTP timeout from firing
+        last_rx_ms = now_ms;
+    } else if (samples_received > 0) {
+        last_rx_ms = now_ms;
+        stats.frames_received++;
+        audio_write(rx_frame, samples_received);
+        aec_far_end(&aec, rx_frame, samples_received);
+        return;
+    }
+    aec_far_end(&aec, NULL, MEDIA_FRAME_SAMPLES);
+}
+
+static void media_task(void *pvParameters __attribute__((unused)))
+{
+    ESP_LOGI(TAG, "Media task started on Core %d", MEDIA_TASK_CORE);
+
+    while (1) {
+        // Block until the next 20 ms tick; a count > 1 means ticks were missed
+        uint32_t pending = ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+        if (xSemaphoreTake(pipeline_mutex, portMAX_DELAY) != pdTRUE) {
+            continue;
+        }
+
+        if (engine_running) {
+            int64_t start_us = esp_timer_get_time();
+
+            if (pending > 1) {
+                stats.missed_ticks += pending - 1;
+            }
+
+            if (last_tick_us > 0) {
+                int64_t deviation = (start_us - last_tick_us) - MEDIA_FRAME_PERIOD_US;
+                if (deviation < 0) {
+                    deviation = -deviation;
+                }
+                if ((uint32_t)deviation > stats.max_tick_jitter_us) {
+                    stats.max_tick_jitter_us = (uint32_t)deviation;
+                }
+            }
+            last_tick_us = start_us;
+
+            media_process_frame();
+
+            uint32_t cycle_us = (uint32_t)(esp_timer_get_time() - start_us);
+            if (cycle_us > stats.max_cycle_us) {
+                stats.max_cycle_us = cycle_us;
+            }
+        }
+
+        xSemaphoreGive(pipeline_mutex);
+    }
+}
+
+void media_engine_init(void)
+{
+    if (media_task_handle) {
+        return;
+    }
+
+    pipeline_mutex = xSemaphoreCreateMutex();
+    if (!pipeline_mutex) {
+        ESP_LOGE(TAG, "Failed to create pipeline mutex");
+        return;
+    }
+
+    media_engine_load_dsp_config();
+
+    BaseType_t result = xTaskCreatePinnedToCore(
+        media_task,
+        "media_task",
+        MEDIA_TASK_STACK_SIZE,
+        NULL,
+        MEDIA_TASK_PRIORITY,
+        &media_task_handle,
+        MEDIA_TASK_CORE
+    );
+    if (result != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create media task");
+        media_task_handle = NULL;
+        return;
+    }
+
+    const esp_timer_create_args_t timer_args = {
+        .callback = frame_timer_callback,
+        .arg = NULL,
+        .dispatch_method = ESP_TIMER_TASK,
+        .name = "media_frame",
+        .skip_unhandled_events = true,
+    };
+    if (esp_timer_create(&timer_args, &frame_timer) != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to create media frame timer");
+        frame_timer = NULL;
+        return;
+    }
+
+    ESP_LOGI(TAG, "Media engine initialized (%d ms frames)", MEDIA_FRAME_MS);
+}
+
+bool media_engine_start(const char* remote_ip, uint16_t remote_port, uint16_t local_port)
+{
+    if (!media_task_handle || !frame_timer) {
+        ESP_LOGE(TAG, "Media engine not initialized");
+        return false;
+    }
+
+    if (engine_running) {
+        ESP_LOGW(TAG, "Media engine already running");
+        return true;
+    }
+
+    if (!rtp_start_session(remote_ip, remote_port, local_port)) {
+        return false;
+    }
+
+    audio_start_recording();
+    audio_start_playback();
+
+    xSemaphoreTake(pipeline_mutex, portMAX_DELAY);
+    memset(&stats, 0, sizeof(stats));
+    last_tick_us = 0;
+    capture_to_wire_sum_us = 0;
+    tx_frame_count = 0;
+    tx_borrowed = 0;
+    tx_fill = 0;
+    media_dsp_reset();
+    last_rx_ms = xTaskGetTickCount() * portTICK_PERIOD_MS;
+    engine_running = true;
+    xSemaphoreGive(pipeline_mutex);
+
+    esp_timer_start_periodic(frame_timer, MEDIA_FRAME_PERIOD_US);
+
+    ESP_LOGI(TAG, "Media engine started: %s:%u (local port %u), ptime %u ms, %s", remote_ip, remote_port,
+             local_port, packet_samples * MEDIA_FRAME_MS / MEDIA_FRAME_SAMPLES, direction_name(direction));
+    return true;
+}
+
+void media_engine_set_direction(media_direction_t new_direction)
+{
+    if (direction == new_direction) {
+        return;
+    }
+    if (new_direction == MEDIA_DIR_SENDRECV && engine_running) {
+        last_rx_ms = xTaskGetTickCount() * portTICK_PERIOD_MS;
+    }
+    direction = new_direction;
+    ESP_LOGI(TAG, "Media direction: %s", direction_name(new_direction));
+}
+
+void media_engine_set_codec(uint8_t audio_pt, uint8_t event_pt, uint16_t ptime_ms)
+{
+    // Whole frames only, never longer than asked for, within what we can buffer
+    uint16_t frames = ptime_ms / MEDIA_FRAME_MS;
+    if (frames < 1) {
+        frames = 1;
+    } else if (frames > MEDIA_MAX_PTIME_MS / MEDIA_FRAME_MS) {
+        frames = MEDIA_MAX_PTIME_MS / MEDIA_FRAME_MS;
+    }
+
+    if (!pipeline_mutex) {
+        return;
+    }
+
+    xSemaphoreTake(pipeline_mutex, portMAX_DELAY);
+    packet_samples = frames * MEDIA_FRAME_SAMPLES;
+    media_release_frames();
+    rtp_set_payload_types(audio_pt, event_pt);
+    xSemaphoreGive(pipeline_mutex);
+
+    if (frames * MEDIA_FRAME_MS != ptime_ms) {
+        ESP_LOGW(TAG, "ptime %u ms not supported, using %u ms", ptime_ms, frames * MEDIA_FRAME_MS);
+    }
+}
+
+bool media_engine_set_remote(const char* remote_ip, uint16_t remote_port)
+{
+    if (!engine_running) {
+        return false;
+    }
+    return rtp_set_remote(remote_ip, remote_port);
+}
+
+void media_engine_stop(void)
+{
+    if (!engine_running) {
+        // Make sure a half-started session does not leak its socket
+        rtp_stop_session();
+        direction = MEDIA_DIR_SENDRECV;
+        packet_samples = MEDIA_FRAME_SAMPLES;
+        return;
+    }
+
+    esp_timer_stop(frame_timer);
+
+    // Wait for an in-flight pass to finish before tearing down RTP and audio
+    xSemaphoreTake(pipeline_mutex, portMAX_DELAY);
+    engine_running = false;
+    media_release_frames();
+    xSemaphoreGive(pipeline_mutex);
+
+    audio_stop_recording();
+    audio_stop_playback();
+    rtp_stop_session();
+    last_rx_ms = 0;
+    direction = MEDIA_DIR_SENDRECV;
+    packet_samples = MEDIA_FRAME_SAMPLES;
+
+    ESP_LOGI(TAG, "Media engine stopped: sent=%" PRIu32 ", received=%" PRIu32 ", missed ticks=%" PRIu32
+             ", max jitter=%" PRIu32 " us, max cycle=%" PRIu32 " us, capture underruns=%" PRIu32
+             ", capture to wire avg %" PRIu32 " / max %" PRIu32 " us",
+             stats.frames_sent, stats.frames_received, stats.missed_ticks,
+             stats.max_tick_jitter_us, stats.max_cycle_us, stats.capture_underruns,
+             stats.frames_sent ? (uint32_t)(capture_to_wire_sum_us / stats.frames_sent) : 0,
+             stats.max_capture_to_wire_us);
+}
+
+void media_engine_load_dsp_config(void)
+{
+    nvs_handle_t nvs_handle;
+    if (nvs_open(NVS_NAMESPACE, NVS_READONLY, &nvs_handle) != ESP_OK) {
+        ESP_LOGI(TAG, "No capture processing settings saved, using defaults");
+        return;
+    }
+
+    uint8_t value;
+    uint16_t value16;
+    if (nvs_get_u8(nvs_handle, "aec_en", &value) == ESP_OK) {
+        dsp_config.aec.enabled = (value != 0);
+    }
+    if (nvs_get_u16(nvs_handle, "aec_tail", &value16) == ESP_OK) {
+        dsp_config.aec.tail_ms = value16;
+    }
+    if (nvs_get_u16(nvs_handle, "aec_delay", &value16) == ESP_OK) {
+        dsp_config.aec.delay_ms = value16;
+    }
+    if (nvs_get_u8(nvs_handle, "aec_dt", &value) == ESP_OK) {
+        dsp_config.aec.dt_threshold_pct = value;
+    }
+    if (nvs_get_u8(nvs_handle, "ns_en", &value) == ESP_OK) {
+        dsp_config.ns_enabled = (value != 0);
+    }
+    if (nvs_get_u8(nvs_handle, "agc_en", &value) == ESP_OK) {
+        dsp_config.agc_enabled = (value != 0);
+    }
+    nvs_close(nvs_handle);
+
+    ESP_LOGI(TAG, "Capture processing: echo canceller %s (tail %u ms, delay %u ms), noise suppressor %s, AGC %s",
+             dsp_config.aec.enabled ? "on" : "off", dsp_config.aec.tail_ms, dsp_config.aec.delay_ms,
+             dsp_config.ns_enabled ? "on" : "off", dsp_config.agc_enabled ? "on" : "off");
+}
+
+bool media_engine_save_dsp_config(const media_dsp_config_t* config)
+{
+    if (!config) {
+        return false;
+    }
+
+    if (pipeline_mutex) {
+        xSemaphoreTake(pipeline_mutex, portMAX_DELAY);
+    }
+    dsp_config = *config;
+    if (engine_running) {
+        // Held frames were processed (or borrowed) under the old settings:
+        // drop the partial packet and start the stages over
+        media_release_frames();
+        media_dsp_reset();
+    }
+    if (pipeline_mutex) {
+        xSemaphoreGive(pipeline_mutex);
+    }
+
+    nvs_handle_t nvs_handle;
+    esp_err_t err = nvs_open(NVS_NAMESPACE, NVS_READWRITE, &nvs_handle);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to open NVS: %s", esp_err_to_name(err));
+        return false;
+    }
+    err = nvs_set_u8(nvs_handle, "aec_en", config->aec.enabled ? 1 : 0);
+    if (err == ESP_OK) {
+        err = nvs_set_u16(nvs_handle, "aec_tail", config->aec.tail_ms);
+    }
+    if (err == ESP_OK) {
+        err = nvs_set_u16(nvs_handle, "aec_delay", config->aec.delay_ms);
+    }
+    if (err == ESP_OK) {
+        err = nvs_set_u8(nvs_handle, "aec_dt", config->aec.dt_threshold_pct);
+    }
+    if (err == ESP_OK) {
+        err = nvs_set_u8(nvs_handle, "ns_en", config->ns_enabled ? 1 : 0);
+    }
+    if (err == ESP_OK) {
+        err = nvs_set_u8(nvs_handle, "agc_en", config->agc_enabled ? 1 : 0);
+    }
+    if (err == ESP_OK) {
+        err = nvs_commit(nvs_handle);
+    }
+    nvs_close(nvs_handle);
+
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to save capture processing settings: %s", esp_err_to_name(err));
+        return false;
+    }
+    return true;
+}
+
+void media_engine_get_dsp_config(media_dsp_config_t* config)
+{
+    if (config) {
+        *config = dsp_config;
+    }
+}
+
+void media_engine_get_dsp_stats(media_dsp_stats_t* out)
+{
+    if (!out) {
+        return;
+    }
+    aec_get_stats(&aec, &out->aec);
+    ns_get_stats(&ns, &out->ns);
+    agc_get_stats(&agc, &out->agc);
+}
+
+bool media_engine_is_running(void)
+{
+    return engine_running;
+}
+
+uint32_t media_engine_get_last_rx_ms(void)
+{
+    return last_rx_ms;
+}
+
+void media_engine_get_stats(media_engine_stats_t* out)
+{
+    if (!out) {
+        return;
+    }
+    memcpy(out, &stats, sizeof(*out));
+    out->avg_capture_to_wire_us = stats.frames_sent ? (uint32_t)(capture_to_wire_sum_us / stats.frames_sent) : 0;
+    audio_capture_stats_t capture;
+    audio_get_capture_stats(&capture);
+    out->capture_overruns = capture.overruns;
+}
@@ -0,0 +1,174 @@
+#ifndef MEDIA_ENGINE_H
+#define MEDIA_ENGINE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "echo_canceller.h"
+#include "noise_suppressor.h"
+#include "agc.h"
+
+// Media is moved in fixed 20 ms frames (160 samples at 8 kHz)
+#define MEDIA_FRAME_MS          20
+#define MEDIA_FRAME_SAMPLES     160
+#define MEDIA_MAX_PTIME_MS      60      // Longest packetization we send (3 frames)
+
+/**
+ * Which way audio flows
+ */
+typedef enum {
+    MEDIA_DIR_SENDRECV = 0,     // Answered call
+    MEDIA_DIR_RECVONLY,         // Early media: play the remote ringback/announcement;
+                                // capture keeps running but nothing is sent
+    MEDIA_DIR_SENDONLY,         // Remote put us on hold: send, do not play out
+    MEDIA_DIR_INACTIVE          // Neither direction
+} media_direction_t;
+
+/**
+ * Media engine statistics for the current (or last) call
+ */
+typedef struct {
+    uint32_t frames_sent;          // RTP audio packets sent
+    uint32_t frames_received;      // Audio frames decoded and played out
+    uint32_t send_errors;          // rtp_send_audio() failures
+    uint32_t capture_underruns;    // Ticks where capture had no frame ready
+    uint32_t capture_overruns;     // Captured frames dropped before the media task took them (since boot)
+    uint32_t capture_to_wire_us;   // Oldest sample of the last packet: capture complete -> sendto()
+    uint32_t avg_capture_to_wire_us;
+    uint32_t max_capture_to_wire_us;
+    uint32_t missed_ticks;         // Ticks that arrived while the previous pass was still running
+    uint32_t max_cycle_us;         // Longest capture/send/receive/playout pass
+    uint32_t max_tick_jitter_us;   // Largest deviation of a tick from the 20 ms period
+} media_engine_stats_t;
+
+/**
+ * Capture processing settings, applied in this order to every captured frame
+ */
+typedef struct {
+    aec_config_t aec;           // Echo canceller
+    bool ns_enabled;            // Noise suppressor (adds 10 ms of delay)
+    bool agc_enabled;           // Automatic gain control with limiter
+} media_dsp_config_t;
+
+/**
+ * Capture processing statistics for the current (or last) call
+ */
+typedef struct {
+    aec_stats_t aec;
+    ns_stats_t ns;
+    agc_stats_t agc;
+} media_dsp_stats_t;
+
+/**
+ * Initialize the media engine
+ * Creates the media task (pinned to Core 1) and the 20 ms pacing timer.
+ * Must be called once before media_engine_start().
+ */
+void media_engine_init(void);
+
+/**
+ * Start media for a call
+ * Opens the RTP session, starts audio capture/playout and arms the 20 ms
+ * timer that drives the capture -> encode -> send and receive -> decode ->
+ * playout pipeline.
+ *
+ * @param remote_ip Remote RTP address (dotted IPv4)
+ * @param remote_port Remote RTP port
+ * @param local_port Local RTP port to bind
+ * @return true if the RTP session was opened and the engine is running
+ */
+bool media_engine_start(const char* remote_ip, uint16_t remote_port, uint16_t local_port);
+
+/**
+ * Set the audio direction
+ * May be called before media_engine_start() (early media) and while running
+ * (answer). Switching to send/receive restarts the RTP timeout reference, since
+ * early media may legitimately have been silent. Reset to send/receive by
+ * media_engine_stop().
+ *
+ * @param direction New direction
+ */
+void media_engine_set_direction(media_direction_t direction);
+
+/**
+ * Set the negotiated codec
+ * Call before media_engine_start(), or while running when a new SDP changes
+ * the codec. Reset to PCMU/101 with 20 ms packets by media_engine_stop().
+ *
+ * @param audio_pt G.711 payload type to send (0 = PCMU, 8 = PCMA)
+ * @param event_pt telephone-event payload type, RTP_PT_NONE if not negotiated
+ * @param ptime_ms Packetization to send; rounded down to whole 20 ms frames,
+ *                 at least one and at most MEDIA_MAX_PTIME_MS (sdp_negotiate()
+ *                 already hands over a supported value)
+ */
+void media_engine_set_codec(uint8_t audio_pt, uint8_t event_pt, uint16_t ptime_ms);
+
+/**
+ * Move the remote RTP endpoint of a running session
+ *
+ * @param remote_ip Remote RTP address (dotted IPv4)
+ * @param remote_port Remote RTP port
+ * @return true if the address is valid
+ */
+bool media_engine_set_remote(const char* remote_ip, uint16_t remote_port);
+
+/**
+ * Stop media for the current call
+ * Disarms the timer, stops audio and closes the RTP session. Safe to call
+ * when the engine is not running.
+ */
+void media_engine_stop(void);
+
+/**
+ * Load the capture processing settings from NVS (defaults: all stages on)
+ * Called by media_engine_init().
+ */
+void media_engine_load_dsp_config(void);
+
+/**
+ * Save and apply the capture processing settings
+ * Takes effect at once: a running call starts the stages over (and drops a
+ * partly collected packet).
+ *
+ * @param config Settings; out-of-range echo canceller values are clamped
+ *               when applied
+ * @return true if the settings were stored in NVS
+ */
+bool media_engine_save_dsp_config(const media_dsp_config_t* config);
+
+/**
+ * Get the capture processing settings
+ *
+ * @param config Pointer to structure to fill
+ */
+void media_engine_get_dsp_config(media_dsp_config_t* config);
+
+/**
+ * Get capture processing statistics
+ *
+ * @param stats Pointer to structure to fill
+ */
+void media_engine_get_dsp_stats(media_dsp_stats_t* stats);
+
+/**
+ * Check if the media engine is running
+ *
+ * @return true while a call's media pipeline is active
+ */
+bool media_engine_is_running(void);
+
+/**
+ * Get the tick count (in ms) of the last received audio frame
+ * Used by the signalling loop for RTP timeout detection.
+ *
+ * @return Milliseconds since boot of last audio frame, 0 if none yet
+ */
+uint32_t media_engine_get_last_rx_ms(void);
+
+/**
+ * Get media engine statistics
+ *
+ * @param stats Pointer to structure to fill
+ */
+void media_engine_get_stats(media_engine_stats_t* stats);
+
+#endif // MEDIA_ENGINE_H
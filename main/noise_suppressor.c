@@ -0,0 +1,172 @@
+#include "noise_suppressor.h"
+#include "esp_log.h"
+#include <string.h>
+#include <math.h>
+
+static const char *TAG = "NS";
+
+// Windowed samples enter the transform scaled by 2^7: below 2^22, so the
+// 256-point spectrum stays below 2^30
+#define NS_SAMPLE_SHIFT         7
+
+// Input power smoothing per hop, and how fast the noise estimate may rise
+// (about 6 dB/s, so gusts and passing cars are caught up with within a
+// second); it falls with the smoothed power at once
+#define NS_POWER_SMOOTHING      0.7f
+#define NS_NOISE_RISE           1.015f
+
+// Following the minimum of the smoothed power reads the noise about 3 dB
+// low; the gains use it this much higher
+#define NS_NOISE_BIAS           2.0f
+
+// The first 200 ms are taken as noise to start the estimate from
+#define NS_STARTUP_HOPS         20
+
+// Decision-directed a-priori SNR weight and the gain floor (-15 dB)
+#define NS_PRIOR_WEIGHT         0.98f
+#define NS_GAIN_FLOOR           0.18f
+
+// Keeps the SNRs finite on digital silence
+#define NS_MIN_POWER            1.0f
+
+// Square-root Hann, periodic: squared, overlapping halves sum to one.
+// Filled on first use like the FFT twiddles.
+static int16_t ns_window[NS_WINDOW_SAMPLES];
+static volatile bool ns_window_ready = false;
+
+static void ns_make_window(void)
+{
+    for (int n = 0; n < NS_WINDOW_SAMPLES; n++) {
+        ns_window[n] = (int16_t)lrintf(sinf((float)M_PI * (n + 0.5f) / NS_WINDOW_SAMPLES) * 32767.0f);
+    }
+    ns_window_ready = true;
+}
+
+static inline int16_t saturate16(int32_t v)
+{
+    if (v > INT16_MAX) {
+        return INT16_MAX;
+    }
+    if (v < INT16_MIN) {
+        return INT16_MIN;
+    }
+    return (int16_t)v;
+}
+
+// One 10 ms hop: analysis over the last 20 ms, per-bin gain, overlap-add
+static void ns_hop(ns_t* ns, const int16_t* in, int16_t* out)
+{
+    memmove(ns->input, ns->input + NS_HOP_SAMPLES, NS_HOP_SAMPLES * sizeof(int16_t));
+    memcpy(ns->input + NS_HOP_SAMPLES, in, NS_HOP_SAMPLES * sizeof(int16_t));
+
+    fft_complex_t* x = ns->spectrum;
+    for (int n = 0; n < NS_WINDOW_SAMPLES; n++) {
+        int32_t v = ((int32_t)ns->input[n] * ns_window[n] + (1 << 14)) >> 15;
+        x[n].re = v * (1 << NS_SAMPLE_SHIFT);
+        x[n].im = 0;
+    }
+    memset(&x[NS_WINDOW_SAMPLES], 0, (NS_FFT_SIZE - NS_WINDOW_SAMPLES) * sizeof(fft_complex_t));
+    fft_forward(x, NS_FFT_SIZE);
+
+    const bool startup = ns->hops < NS_STARTUP_HOPS;
+    int16_t gain[NS_BINS];
+    float gain_sum = 0.0f;
+    for (int f = 0; f < NS_BINS; f++) {
+        float re = (float)x[f].re;
+        float im = (float)x[f].im;
+        float p = re * re + im * im + NS_MIN_POWER;
+
+        ns->power[f] += (1.0f - NS_POWER_SMOOTHING) * (p - ns->power[f]);
+        if (startup) {
+            ns->noise[f] += (p - ns->noise[f]) / (ns->hops + 1);
+        } else if (ns->power[f] < ns->noise[f]) {
+            ns->noise[f] = ns->power[f];
+        } else {
+            ns->noise[f] *= NS_NOISE_RISE;
+        }
+
+        float noise = ns->noise[f] * NS_NOISE_BIAS;
+        float posterior = p / noise;
+        float excess = posterior > 1.0f ? posterior - 1.0f : 0.0f;
+        float prior = NS_PRIOR_WEIGHT * ns->clean[f] / noise + (1.0f - NS_PRIOR_WEIGHT) * excess;
+        float g = prior / (1.0f + prior);
+        if (g < NS_GAIN_FLOOR) {
+            g = NS_GAIN_FLOOR;
+        }
+        ns->clean[f] = g * g * p;
+        gain[f] = (int16_t)(g * 32767.0f);
+        gain_sum += g;
+    }
+
+    for (int f = 0; f < NS_FFT_SIZE; f++) {
+        int32_t g = gain[f < NS_BINS ? f : NS_FFT_SIZE - f];
+        x[f].re = (int32_t)(((int64_t)x[f].re * g) >> 15);
+        x[f].im = (int32_t)(((int64_t)x[f].im * g) >> 15);
+    }
+    fft_inverse(x, NS_FFT_SIZE);
+
+    // Synthesis window, then add the previous hop's tail; the zero-padded
+    // part past the window is dropped
+    for (int n = 0; n < NS_WINDOW_SAMPLES; n++) {
+        int32_t y = (x[n].re + (1 << (NS_SAMPLE_SHIFT - 1))) >> NS_SAMPLE_SHIFT;
+        int32_t windowed = (y * ns_window[n] + (1 << 14)) >> 15;
+        if (n < NS_HOP_SAMPLES) {
+            out[n] = saturate16(ns->overlap[n] + windowed);
+        } else {
+            ns->overlap[n - NS_HOP_SAMPLES] = windowed;
+        }
+    }
+
+    ns->hops++;
+    ns->attenuation_db = 20.0f * log10f(gain_sum / NS_BINS);
+}
+
+void ns_init(ns_t* ns, bool enabled)
+{
+    if (!ns_window_ready) {
+        ns_make_window();
+    }
+    memset(ns, 0, sizeof(*ns));
+    ns->enabled = enabled;
+    ESP_LOGI(TAG, "Noise suppressor %s", enabled ? "on" : "off");
+}
+
+void ns_process(ns_t* ns, const int16_t* in, int16_t* out, size_t count)
+{
+    if (count > NS_FRAME_SAMPLES) {
+        count = NS_FRAME_SAMPLES;
+    }
+    if (!ns->enabled) {
+        if (out != in) {
+            memcpy(out, in, count * sizeof(int16_t));
+        }
+        return;
+    }
+
+    size_t processed = 0;
+    for (; processed + NS_HOP_SAMPLES <= count; processed += NS_HOP_SAMPLES) {
+        ns_hop(ns, in + processed, out + processed);
+    }
+    if (out != in) {
+        memcpy(out + processed, in + processed, (count - processed) * sizeof(int16_t));
+    }
+}
+
+void ns_get_stats(const ns_t* ns, ns_stats_t* stats)
+{
+    stats->hops = ns->hops;
+    stats->attenuation_db = ns->attenuation_db;
+
+    // Parseval over the whole spectrum (both halves), then back to a
+    // time-domain mean square through the transform scaling and the
+    // squared window's mean of one half. The estimate is bias corrected
+    // like the gains use it.
+    float sum = 0.0f;
+    for (int f = 0; f < NS_BINS; f++) {
+        sum += (f == 0 || f == NS_BINS - 1) ? ns->noise[f] : 2.0f * ns->noise[f];
+    }
+    sum *= NS_NOISE_BIAS;
+    float scale = (float)(1 << NS_SAMPLE_SHIFT);
+    float mean_square = sum / NS_FFT_SIZE / (scale * scale) / (NS_WINDOW_SAMPLES / 2);
+    stats->noise_floor_db = mean_square > 0.0f ? 10.0f * log10f(mean_square / (32768.0f * 32768.0f)) : -96.0f;
+}
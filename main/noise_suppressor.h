@@ -0,0 +1,76 @@
+#ifndef NOISE_SUPPRESSOR_H
+#define NOISE_SUPPRESSOR_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "fft.h"
+
+#define NS_FRAME_SAMPLES        160     // Largest block per call (one 20 ms media frame)
+#define NS_HOP_SAMPLES          80      // 10 ms analysis hop; also the added delay
+#define NS_WINDOW_SAMPLES       (2 * NS_HOP_SAMPLES)
+#define NS_FFT_SIZE             256     // Window zero-padded to a power of two
+#define NS_BINS                 (NS_FFT_SIZE / 2 + 1)
+
+/**
+ * Noise suppressor statistics
+ */
+typedef struct {
+    uint32_t hops;              // 10 ms analysis hops processed
+    float noise_floor_db;       // Estimated noise level, dBFS
+    float attenuation_db;       // Average gain over all bins in the last hop (<= 0)
+} ns_stats_t;
+
+/**
+ * Wiener noise suppressor (fixed capacity, no heap use)
+ *
+ * Each 10 ms hop is windowed with a square-root Hann window over the last
+ * 20 ms and transformed with the fixed-point FFT. The noise spectrum is
+ * tracked per bin by following the smoothed power down at once and up
+ * slowly, so steady wind, traffic and hum are learned while speech, which
+ * does not last, is not. Each bin is scaled by a Wiener gain with a
+ * decision-directed a-priori SNR (Ephraim-Malah), which keeps the residual
+ * noise from turning into musical tones, and floored so the background is
+ * reduced rather than removed. Overlap-add brings the output back at a
+ * 10 ms delay.
+ */
+typedef struct {
+    bool enabled;
+    int16_t input[NS_WINDOW_SAMPLES];       // Last 20 ms of input, newest last
+    int32_t overlap[NS_HOP_SAMPLES];        // Second half of the previous hop's output
+    fft_complex_t spectrum[NS_FFT_SIZE];
+    float power[NS_BINS];                   // Smoothed input power
+    float noise[NS_BINS];                   // Noise power estimate
+    float clean[NS_BINS];                   // Previous hop's output power (decision-directed SNR)
+    uint32_t hops;
+    float attenuation_db;
+} ns_t;
+
+/**
+ * Initialize (or reset) a noise suppressor
+ *
+ * @param ns Noise suppressor instance
+ * @param enabled false passes audio through unchanged and undelayed
+ */
+void ns_init(ns_t* ns, bool enabled);
+
+/**
+ * Suppress noise in a block of audio; output is NS_HOP_SAMPLES behind input
+ *
+ * @param ns Noise suppressor instance
+ * @param in Input samples
+ * @param out Output samples (may equal @p in)
+ * @param count Number of samples, a multiple of NS_HOP_SAMPLES up to
+ *              NS_FRAME_SAMPLES (a partial hop at the end is passed through)
+ */
+void ns_process(ns_t* ns, const int16_t* in, int16_t* out, size_t count);
+
+/**
+ * Get noise suppressor statistics
+ *
+ * @param ns Noise suppressor instance
+ * @param stats Pointer to structure to fill
+ */
+void ns_get_stats(const ns_t* ns, ns_stats_t* stats);
+
+#endif // NOISE_SUPPRESSOR_H
@@ -0,0 +1,633 @@
+#include "rtcp.h"
+#include "esp_log.h"
+#include "esp_random.h"
+#include "lwip/sockets.h"
+#include "freertos/FreeRTOS.h"
+#include <string.h>
+#include <stdio.h>
+#include <fcntl.h>
+#include <sys/time.h>
+
+static const char *TAG = "RTCP";
+
+// Sequence number tracking (RFC 3550 A.1)
+#define RTP_SEQ_MOD             (1u << 16)
+#define MAX_DROPOUT             3000
+#define MAX_MISORDER            100
+
+#define RTCP_BANDWIDTH_FRACTION 0.05f       // Of the session bandwidth
+#define RTCP_COMPENSATION       1.21828f    // e - 3/2 (RFC 3550 6.3.1)
+#define RTCP_UDP_IP_OVERHEAD    28
+#define NTP_UNIX_OFFSET         2208988800u // 1900 -> 1970
+#define RTCP_MAX_RTT_MS         10000       // Larger LSR/DLSR results are clock steps, not round trips
+#define RTCP_PACKETIZATION_MS   20
+
+typedef struct {
+    bool active;
+    int sock;
+    struct sockaddr_in remote;
+    uint32_t ssrc;
+    uint32_t clock_rate;
+    int64_t start_us;
+    uint64_t ntp_base;              // NTP time (32.32) at start_us
+    char cname[24];
+
+    // Our stream
+    uint32_t tx_packets;
+    uint32_t tx_octets;
+    uint32_t tx_last_timestamp;
+    int64_t tx_last_us;
+    bool sent_this_interval;
+    bool sent_last_interval;
+
+    // Remote stream (RFC 3550 A.1, A.3, A.8)
+    bool have_source;
+    uint32_t remote_ssrc;
+    uint16_t max_seq;
+    uint32_t cycles;
+    uint32_t base_seq;
+    uint32_t bad_seq;
+    uint32_t received;
+    uint32_t expected_prior;
+    uint32_t received_prior;
+    bool have_transit;
+    uint32_t transit;
+    uint32_t jitter_q4;             // Timestamp units, scaled by 16
+
+    // Last SR from the remote, echoed as LSR/DLSR
+    uint32_t last_sr_ntp;           // Middle 32 bits of its NTP timestamp
+    int64_t last_sr_us;
+
+    // Transmission interval
+    int64_t next_report_us;
+    bool initial;
+    float avg_rtcp_size;
+
+    uint32_t playout_delay_ms;
+    uint64_t rtt_sum_ms;
+    uint32_t rtt_samples;
+    uint32_t rx_max_jitter_ms;
+    float min_mos;
+
+    rtcp_quality_t quality;         // Working copy, published once per poll
+} rtcp_session_t;
+
+static rtcp_session_t session = { .sock = -1 };
+static rtcp_quality_t published;
+static rtcp_call_summary_t history[RTCP_CALL_HISTORY];
+static uint32_t call_count = 0;
+static portMUX_TYPE quality_lock = portMUX_INITIALIZER_UNLOCKED;
+static uint8_t tx_buf[RTCP_PACKET_MAX_SIZE];
+static uint8_t rx_buf[RTCP_PACKET_MAX_SIZE];
+
+static void put32(uint8_t* p, uint32_t v)
+{
+    p[0] = v >> 24;
+    p[1] = v >> 16;
+    p[2] = v >> 8;
+    p[3] = v;
+}
+
+static uint32_t get32(const uint8_t* p)
+{
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+// NTP timestamp (32.32) for an esp_timer time: the wall clock at the session
+// start plus the monotonic time since, so an NTP step mid-call cannot
+// corrupt the round trip
+static uint64_t ntp_at(int64_t now_us)
+{
+    uint64_t elapsed = (uint64_t)(now_us - session.start_us);
+    uint64_t seconds = elapsed / 1000000;
+    uint64_t fraction = ((elapsed % 1000000) << 32) / 1000000;
+    return session.ntp_base + (seconds << 32) + fraction;
+}
+
+static uint32_t ntp_middle(uint64_t ntp)
+{
+    return (uint32_t)(ntp >> 16);
+}
+
+static uint32_t jitter_ms(uint32_t timestamp_units)
+{
+    return (uint32_t)((uint64_t)timestamp_units * 1000 / session.clock_rate);
+}
+
+// RFC 3550 6.3.1 for two members. With two members the sender/receiver
+// split of the RTCP bandwidth never applies; at G.711 rates n * C stays
+// far below Tmin, which therefore sets the pace.
+static int64_t report_interval_us(void)
+{
+    float rtcp_bw = RTCP_BANDWIDTH_BPS / 8.0f * RTCP_BANDWIDTH_FRACTION;
+    float t = session.avg_rtcp_size * 2 / rtcp_bw;
+    float t_min = (session.initial ? RTCP_MIN_INTERVAL_MS / 2 : RTCP_MIN_INTERVAL_MS) / 1000.0f;
+    if (t < t_min) {
+        t = t_min;
+    }
+    float factor = 0.5f + (esp_random() % 1000) / 1000.0f;
+    return (int64_t)(t * factor / RTCP_COMPENSATION * 1000000.0f);
+}
+
+static void init_seq(uint16_t seq)
+{
+    session.base_seq = seq;
+    session.max_seq = seq;
+    session.bad_seq = RTP_SEQ_MOD + 1;
+    session.cycles = 0;
+    session.received = 0;
+    session.received_prior = 0;
+    session.expected_prior = 0;
+}
+
+// RFC 3550 A.1 without probation: the remote has been chosen by signalling
+static bool update_seq(uint16_t seq)
+{
+    uint16_t udelta = seq - session.max_seq;
+    if (udelta < MAX_DROPOUT) {
+        if (seq < session.max_seq) {
+            session.cycles += RTP_SEQ_MOD;
+        }
+        session.max_seq = seq;
+    } else if (udelta <= RTP_SEQ_MOD - MAX_MISORDER) {
+        // Large jump: accept it once the next packet confirms the new sequence
+        if (seq != session.bad_seq) {
+            session.bad_seq = (seq + 1) & (RTP_SEQ_MOD - 1);
+            return false;
+        }
+        init_seq(seq);
+    }
+    // else duplicate or reordered: counted, sequence unchanged
+    session.received++;
+    return true;
+}
+
+static uint32_t expected_packets(void)
+{
+    if (!session.have_source) {
+        return 0;
+    }
+    return session.cycles + session.max_seq - session.base_seq + 1;
+}
+
+static int32_t cumulative_lost(void)
+{
+    int32_t lost = (int32_t)(expected_packets() - session.received);
+    // 24-bit signed field
+    if (lost > 0x7FFFFF) {
+        lost = 0x7FFFFF;
+    } else if (lost < -0x800000) {
+        lost = -0x800000;
+    }
+    return lost;
+}
+
+// Fraction lost since the previous report (RFC 3550 A.3); advances the interval
+static uint8_t interval_fraction_lost(void)
+{
+    uint32_t expected = expected_packets();
+    uint32_t expected_interval = expected - session.expected_prior;
+    uint32_t received_interval = session.received - session.received_prior;
+    session.expected_prior = expected;
+    session.received_prior = session.received;
+
+    int32_t lost_interval = (int32_t)(expected_interval - received_interval);
+    if (expected_interval == 0 || lost_interval <= 0) {
+        return 0;
+    }
+    return (uint8_t)(((uint32_t)lost_interval << 8) / expected_interval);
+}
+
+float rtcp_mos_estimate(uint32_t one_way_delay_ms, float loss_pct)
+{
+    float d = (float)one_way_delay_ms;
+    float id = 0.024f * d + (d > 177.3f ? 0.11f * (d - 177.3f) : 0.0f);
+    // Ie_eff = Ie + (95 - Ie) * Ppl / (Ppl / BurstR + Bpl) with random loss
+    float ie_eff = 95.0f * loss_pct / (loss_pct + 4.3f);
+    float r = 93.2f - id - ie_eff;
+    if (r <= 0.0f) {
+        return 1.0f;
+    }
+    if (r >= 100.0f) {
+        return 4.5f;
+    }
+    return 1.0f + 0.035f * r + 7e-6f * r * (r - 60.0f) * (100.0f - r);
+}
+
+// Mouth-to-ear delay of the audio we play: network, playout buffer and one
+// packet of capture on the far side
+static uint32_t rx_delay_ms(void)
+{
+    uint32_t network = session.quality.rtt_valid ? session.quality.rtt_ms / 2 : 0;
+    return network + session.playout_delay_ms + RTCP_PACKETIZATION_MS;
+}
+
+// For the remote we only know its jitter; assume it buffers twice that
+static uint32_t tx_delay_ms(void)
+{
+    uint32_t network = session.quality.rtt_valid ? session.quality.rtt_ms / 2 : 0;
+    return network + 2 * session.quality.tx_jitter_ms + RTCP_PACKETIZATION_MS;
+}
+
+static size_t write_report_block(uint8_t* p, int64_t now_us)
+{
+    uint8_t fraction = interval_fraction_lost();
+    int32_t lost = cumulative_lost();
+
+    put32(p, session.remote_ssrc);
+    put32(p + 4, ((uint32_t)fraction << 24) | ((uint32_t)lost & 0xFFFFFF));
+    put32(p + 8, session.cycles + session.max_seq);
+    put32(p + 12, session.jitter_q4 >> 4);
+    uint32_t dlsr = 0;
+    if (session.last_sr_us != 0) {
+        dlsr = (uint32_t)(((uint64_t)(now_us - session.last_sr_us) << 16) / 1000000);
+    }
+    put32(p + 16, session.last_sr_ntp);
+    put32(p + 20, session.last_sr_ntp ? dlsr : 0);
+
+    // Listening quality over the interval just reported
+    rtcp_quality_t* q = &session.quality;
+    q->rx_fraction_lost = fraction;
+    q->mos_rx = rtcp_mos_estimate(rx_delay_ms(), fraction * 100.0f / 256.0f);
+    if (q->mos_rx < session.min_mos) {
+        session.min_mos = q->mos_rx;
+    }
+    return 24;
+}
+
+// Compound packet: SR or RR with a block for the remote source, SDES CNAME,
+// and BYE when leaving
+static size_t build_report(int64_t now_us, bool bye)
+{
+    uint8_t* p = tx_buf;
+    int blocks = session.have_source ? 1 : 0;
+    // A sender report while we sent RTP since the report before the last one
+    bool sender = session.sent_this_interval || session.sent_last_interval;
+
+    size_t len = sender ? 28 : 8;
+    p[0] = 0x80 | blocks;
+    p[1] = sender ? RTCP_PT_SR : RTCP_PT_RR;
+    put32(p + 4, session.ssrc);
+    if (sender) {
+        uint64_t ntp = ntp_at(now_us);
+        uint32_t rtp_now = session.tx_last_timestamp +
+            (uint32_t)((now_us - session.tx_last_us) * session.clock_rate / 1000000);
+        put32(p + 8, (uint32_t)(ntp >> 32));
+        put32(p + 12, (uint32_t)ntp);
+        put32(p + 16, rtp_now);
+        put32(p + 20, session.tx_packets);
+        put32(p + 24, session.tx_octets);
+    }
+    if (blocks) {
+        len += write_report_block(p + len, now_us);
+    }
+    p[2] = 0;
+    p[3] = len / 4 - 1;
+
+    // SDES: one chunk with the CNAME, null-terminated and padded to 32 bits
+    uint8_t* sdes = p + len;
+    size_t cname_len = strlen(session.cname);
+    size_t sdes_len = 4 + 4 + 2 + cname_len + 1;
+    sdes_len = (sdes_len + 3) & ~(size_t)3;
+    memset(sdes, 0, sdes_len);
+    sdes[0] = 0x81;
+    sdes[1] = RTCP_PT_SDES;
+    sdes[3] = sdes_len / 4 - 1;
+    put32(sdes + 4, session.ssrc);
+    sdes[8] = 1; // CNAME
+    sdes[9] = cname_len;
+    memcpy(sdes + 10, session.cname, cname_len);
+    len += sdes_len;
+
+    if (bye) {
+        uint8_t* b = p + len;
+        b[0] = 0x81;
+        b[1] = RTCP_PT_BYE;
+        b[2] = 0;
+        b[3] = 1;
+        put32(b + 4, session.ssrc);
+        len += 8;
+    }
+    return len;
+}
+
+static void send_report(int64_t now_us, bool bye)
+{
+    size_t len = build_report(now_us, bye);
+    if (sendto(session.sock, tx_buf, len, 0, (struct sockaddr*)&session.remote, sizeof(session.remote)) < 0) {
+        ESP_LOGD(TAG, "RTCP send failed");
+    } else {
+        session.quality.reports_sent++;
+    }
+
+    session.avg_rtcp_size += ((len + RTCP_UDP_IP_OVERHEAD) - session.avg_rtcp_size) / 16.0f;
+    session.sent_last_interval = session.sent_this_interval;
+    session.sent_this_interval = false;
+    session.initial = false;
+}
+
+// Report block from the remote: how our stream arrives there
+static void read_report_block(const uint8_t* p, int64_t now_us)
+{
+    if (get32(p) != session.ssrc) {
+        return;
+    }
+    rtcp_quality_t* q = &session.quality;
+    uint32_t loss_word = get32(p + 4);
+    int32_t lost = (int32_t)(loss_word << 8) >> 8;
+    q->tx_report_seen = true;
+    q->tx_fraction_lost = loss_word >> 24;
+    q->tx_lost = lost;
+    q->tx_jitter_ms = jitter_ms(get32(p + 12));
+
+    uint32_t lsr = get32(p + 16);
+    uint32_t dlsr = get32(p + 20);
+    if (lsr != 0) {
+        // RTT = A - LSR - DLSR in 1/65536 s (RFC 3550 6.4.1)
+        uint32_t rtt = ntp_middle(ntp_at(now_us)) - lsr - dlsr;
+        uint32_t rtt_ms = (uint32_t)(((uint64_t)rtt * 1000) >> 16);
+        if ((int32_t)rtt >= 0 && rtt_ms <= RTCP_MAX_RTT_MS) {
+            q->rtt_valid = true;
+            q->rtt_ms = rtt_ms;
+            if (rtt_ms > q->max_rtt_ms) {
+                q->max_rtt_ms = rtt_ms;
+            }
+            session.rtt_sum_ms += rtt_ms;
+            session.rtt_samples++;
+        }
+    }
+    q->mos_tx = rtcp_mos_estimate(tx_delay_ms(), q->tx_fraction_lost * 100.0f / 256.0f);
+}
+
+static void handle_packet(const uint8_t* buf, size_t len, int64_t now_us)
+{
+    session.avg_rtcp_size += ((len + RTCP_UDP_IP_OVERHEAD) - session.avg_rtcp_size) / 16.0f;
+    bool counted = false;
+
+    // Walk the compound packet
+    while (len >= 4) {
+        uint8_t count = buf[0] & 0x1F;
+        uint8_t type = buf[1];
+        size_t packet_len = ((size_t)((buf[2] << 8) | buf[3]) + 1) * 4;
+        if ((buf[0] >> 6) != 2 || packet_len > len) {
+            ESP_LOGD(TAG, "Malformed RTCP packet");
+            return;
+        }
+
+        const uint8_t* blocks = NULL;
+        if (type == RTCP_PT_SR && packet_len >= 28) {
+            session.last_sr_ntp = (uint32_t)((((uint64_t)get32(buf + 8) << 32) | get32(buf + 12)) >> 16);
+            session.last_sr_us = now_us;
+            blocks = buf + 28;
+        } else if (type == RTCP_PT_RR && packet_len >= 8) {
+            blocks = buf + 8;
+        } else if (type == RTCP_PT_BYE) {
+            ESP_LOGI(TAG, "Remote sent RTCP BYE");
+        }
+
+        if (blocks) {
+            if (!counted) {
+                session.quality.reports_received++;
+                counted = true;
+            }
+            for (uint8_t i = 0; i < count && blocks + 24 <= buf + packet_len; i++, blocks += 24) {
+                read_report_block(blocks, now_us);
+            }
+        }
+        buf += packet_len;
+        len -= packet_len;
+    }
+}
+
+static void publish(int64_t now_us)
+{
+    rtcp_quality_t* q = &session.quality;
+    q->duration_ms = (uint32_t)((now_us - session.start_us) / 1000);
+    q->remote_ssrc = session.remote_ssrc;
+    q->rx_packets = session.received;
+    q->rx_expected = expected_packets();
+    q->rx_lost = cumulative_lost();
+    q->rx_jitter_ms = jitter_ms(session.jitter_q4 >> 4);
+    if (q->rx_jitter_ms > session.rx_max_jitter_ms) {
+        session.rx_max_jitter_ms = q->rx_jitter_ms;
+    }
+    q->tx_packets = session.tx_packets;
+    q->tx_octets = session.tx_octets;
+
+    portENTER_CRITICAL(&quality_lock);
+    published = *q;
+    portEXIT_CRITICAL(&quality_lock);
+}
+
+static bool set_address(struct sockaddr_in* addr, const char* ip, uint16_t port)
+{
+    memset(addr, 0, sizeof(*addr));
+    addr->sin_family = AF_INET;
+    addr->sin_port = htons(port);
+    return inet_pton(AF_INET, ip, &addr->sin_addr) > 0;
+}
+
+bool rtcp_start(const char* remote_ip, uint16_t remote_port, uint16_t local_port,
+                uint32_t ssrc, uint32_t clock_rate, int64_t now_us)
+{
+    if (session.active) {
+        rtcp_stop(now_us);
+    }
+
+    memset(&session, 0, sizeof(session));
+    session.sock = -1;
+    if (!set_address(&session.remote, remote_ip, remote_port)) {
+        ESP_LOGE(TAG, "Invalid remote IP address: %s", remote_ip);
+        return false;
+    }
+
+    int sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (sock < 0) {
+        ESP_LOGE(TAG, "Failed to create RTCP socket");
+        return false;
+    }
+    struct sockaddr_in local_addr;
+    memset(&local_addr, 0, sizeof(local_addr));
+    local_addr.sin_family = AF_INET;
+    local_addr.sin_addr.s_addr = INADDR_ANY;
+    local_addr.sin_port = htons(local_port);
+    if (bind(sock, (struct sockaddr*)&local_addr, sizeof(local_addr)) < 0) {
+        ESP_LOGE(TAG, "Failed to bind RTCP socket to port %d", local_port);
+        close(sock);
+        return false;
+    }
+    int flags = fcntl(sock, F_GETFL, 0);
+    fcntl(sock, F_SETFL, flags | O_NONBLOCK);
+
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    session.ntp_base = ((uint64_t)((uint32_t)tv.tv_sec + NTP_UNIX_OFFSET) << 32) +
+                       (((uint64_t)tv.tv_usec << 32) / 1000000);
+
+    session.sock = sock;
+    session.ssrc = ssrc;
+    session.clock_rate = clock_rate;
+    session.start_us = now_us;
+    session.tx_last_us = now_us;
+    session.initial = true;
+    session.avg_rtcp_size = 80.0f; // Our own first compound (SR, block, SDES) with headers
+    session.min_mos = 4.5f;
+    snprintf(session.cname, sizeof(session.cname), "doorstation-%08lx", (unsigned long)ssrc);
+    session.next_report_us = now_us + report_interval_us();
+
+    session.quality.active = true;
+    session.quality.local_ssrc = ssrc;
+    session.quality.mos_rx = 4.5f;
+    session.quality.mos_tx = 1.0f;
+    session.active = true;
+    publish(now_us);
+
+    ESP_LOGI(TAG, "RTCP to %s:%u (local port %u)", remote_ip, remote_port, local_port);
+    return true;
+}
+
+void rtcp_set_remote(const char* remote_ip, uint16_t remote_port)
+{
+    struct sockaddr_in addr;
+    if (session.active && set_address(&addr, remote_ip, remote_port)) {
+        session.remote = addr;
+    }
+}
+
+void rtcp_stop(int64_t now_us)
+{
+    if (!session.active) {
+        return;
+    }
+    send_report(now_us, true);
+    close(session.sock);
+    session.sock = -1;
+    session.active = false;
+    publish(now_us);
+
+    const rtcp_quality_t* q = &session.quality;
+    rtcp_call_summary_t summary = {
+        .call_id = ++call_count,
+        .duration_ms = q->duration_ms,
+        .rx_packets = q->rx_packets,
+        .rx_lost = q->rx_lost,
+        .rx_loss_pct = q->rx_expected ? (q->rx_lost > 0 ? q->rx_lost : 0) * 100.0f / q->rx_expected : 0.0f,
+        .rx_max_jitter_ms = session.rx_max_jitter_ms,
+        .tx_lost = q->tx_lost,
+        .tx_loss_pct = q->tx_packets ? (q->tx_lost > 0 ? q->tx_lost : 0) * 100.0f / q->tx_packets : 0.0f,
+        .rtt_valid = session.rtt_samples > 0,
+        .avg_rtt_ms = session.rtt_samples ? (uint32_t)(session.rtt_sum_ms / session.rtt_samples) : 0,
+        .max_rtt_ms = q->max_rtt_ms,
+        .min_mos = session.min_mos,
+    };
+    uint32_t network = summary.rtt_valid ? summary.avg_rtt_ms / 2 : 0;
+    summary.mos = rtcp_mos_estimate(network + session.playout_delay_ms + RTCP_PACKETIZATION_MS,
+                                    summary.rx_loss_pct);
+
+    portENTER_CRITICAL(&quality_lock);
+    memmove(&history[1], &history[0], sizeof(history) - sizeof(history[0]));
+    history[0] = summary;
+    published.active = false;
+    portEXIT_CRITICAL(&quality_lock);
+
+    ESP_LOGI(TAG, "Call %lu: %lu ms, rx %lu packets, lost %ld (%.1f%%), max jitter %lu ms, "
+             "rtt avg %lu / max %lu ms, MOS %.2f (min %.2f)",
+             (unsigned long)summary.call_id, (unsigned long)summary.duration_ms,
+             (unsigned long)summary.rx_packets, (long)summary.rx_lost, summary.rx_loss_pct,
+             (unsigned long)summary.rx_max_jitter_ms, (unsigned long)summary.avg_rtt_ms,
+             (unsigned long)summary.max_rtt_ms, summary.mos, summary.min_mos);
+}
+
+void rtcp_on_rtp_sent(uint32_t rtp_timestamp, size_t payload_len, int64_t now_us)
+{
+    if (!session.active) {
+        return;
+    }
+    session.tx_packets++;
+    session.tx_octets += payload_len;
+    session.tx_last_timestamp = rtp_timestamp;
+    session.tx_last_us = now_us;
+    session.sent_this_interval = true;
+}
+
+void rtcp_on_rtp_received(uint32_t ssrc, uint16_t seq, uint32_t rtp_timestamp, bool audio, int64_t arrival_us)
+{
+    if (!session.active) {
+        return;
+    }
+
+    if (!session.have_source || ssrc != session.remote_ssrc) {
+        // First packet, or the remote restarted its stream (e.g. early media
+        // from an announcement server, then the callee)
+        if (session.have_source) {
+            ESP_LOGI(TAG, "Remote SSRC changed to %08lx", (unsigned long)ssrc);
+        }
+        session.have_source = true;
+        session.remote_ssrc = ssrc;
+        session.have_transit = false;
+        session.jitter_q4 = 0;
+        session.last_sr_ntp = 0;
+        session.last_sr_us = 0;
+        init_seq(seq);
+    }
+
+    if (!update_seq(seq) || !audio) {
+        return;
+    }
+
+    // Interarrival jitter (RFC 3550 A.8) in timestamp units
+    uint32_t arrival = (uint32_t)((uint64_t)arrival_us * session.clock_rate / 1000000);
+    uint32_t transit = arrival - rtp_timestamp;
+    if (session.have_transit) {
+        int32_t d = (int32_t)(transit - session.transit);
+        if (d < 0) {
+            d = -d;
+        }
+        session.jitter_q4 += d - ((session.jitter_q4 + 8) >> 4);
+    }
+    session.transit = transit;
+    session.have_transit = true;
+}
+
+void rtcp_poll(int64_t now_us, uint32_t playout_delay_ms)
+{
+    if (!session.active) {
+        return;
+    }
+    session.playout_delay_ms = playout_delay_ms;
+
+    for (int i = 0; i < 4; i++) {
+        int received = recvfrom(session.sock, rx_buf, sizeof(rx_buf), MSG_DONTWAIT, NULL, NULL);
+        if (received <= 0) {
+            break;
+        }
+        handle_packet(rx_buf, received, now_us);
+    }
+
+    if (now_us >= session.next_report_us) {
+        send_report(now_us, false);
+        session.next_report_us = now_us + report_interval_us();
+    }
+    publish(now_us);
+}
+
+void rtcp_get_quality(rtcp_quality_t* quality)
+{
+    if (!quality) {
+        return;
+    }
+    portENTER_CRITICAL(&quality_lock);
+    *quality = published;
+    portEXIT_CRITICAL(&quality_lock);
+}
+
+bool rtcp_get_call_summary(int index, rtcp_call_summary_t* summary)
+{
+    if (!summary || index < 0 || index >= RTCP_CALL_HISTORY || (uint32_t)index >= call_count) {
+        return false;
+    }
+    portENTER_CRITICAL(&quality_lock);
+    *summary = history[index];
+    portEXIT_CRITICAL(&quality_lock);
+    return true;
+}
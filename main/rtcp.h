@@ -0,0 +1,147 @@
+#ifndef RTCP_H
+#define RTCP_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// RTCP runs next to RTP on port + 1 (RFC 3550 section 11); we never offer
+// a=rtcp or rtcp-mux, so the remote uses the same rule
+#define RTCP_PORT_OFFSET        1
+#define RTCP_PACKET_MAX_SIZE    256
+#define RTCP_MIN_INTERVAL_MS    5000    // RFC 3550 Tmin
+#define RTCP_BANDWIDTH_BPS      87200   // G.711 at 20 ms with IP/UDP/RTP headers
+#define RTCP_CALL_HISTORY       8       // Per-call summaries kept since boot
+
+// RTCP packet types (RFC 3550 section 12.1)
+#define RTCP_PT_SR              200
+#define RTCP_PT_RR              201
+#define RTCP_PT_SDES            202
+#define RTCP_PT_BYE             203
+
+/**
+ * Live quality of the current (or last) call
+ *
+ * "rx" describes the audio we receive, measured locally. "tx" describes
+ * our audio as the remote reports it in the report blocks of its SR/RR.
+ */
+typedef struct {
+    bool active;
+    uint32_t local_ssrc;
+    uint32_t remote_ssrc;           // 0 until the first RTP packet
+    uint32_t duration_ms;
+
+    uint32_t rx_packets;            // Audio packets received
+    uint32_t rx_expected;           // From the extended highest sequence number
+    int32_t rx_lost;                // Cumulative, negative with duplicates (RFC 3550 A.3)
+    uint8_t rx_fraction_lost;       // Last report interval, 1/256 units
+    uint32_t rx_jitter_ms;          // RFC 3550 interarrival jitter
+
+    uint32_t tx_packets;
+    uint32_t tx_octets;
+    bool tx_report_seen;            // The remote sent a report block about us
+    int32_t tx_lost;
+    uint8_t tx_fraction_lost;
+    uint32_t tx_jitter_ms;
+
+    bool rtt_valid;
+    uint32_t rtt_ms;                // Last LSR/DLSR round trip
+    uint32_t max_rtt_ms;
+
+    float mos_rx;                   // E-model estimate for what the resident hears
+    float mos_tx;                   // ... and for what the remote hears (1.0 until reported)
+
+    uint32_t reports_sent;          // Compound SR or RR packets
+    uint32_t reports_received;
+} rtcp_quality_t;
+
+/**
+ * Summary of a finished call
+ */
+typedef struct {
+    uint32_t call_id;               // Counts calls with media since boot
+    uint32_t duration_ms;
+    uint32_t rx_packets;
+    int32_t rx_lost;
+    float rx_loss_pct;
+    uint32_t rx_max_jitter_ms;
+    int32_t tx_lost;                // As last reported by the remote
+    float tx_loss_pct;
+    bool rtt_valid;
+    uint32_t avg_rtt_ms;
+    uint32_t max_rtt_ms;
+    float min_mos;                  // Lowest listening MOS at any report interval
+    float mos;                      // Listening MOS over the whole call
+} rtcp_call_summary_t;
+
+/**
+ * Open the RTCP socket on @p local_port and start reporting to
+ * @p remote_ip:@p remote_port. Quality counters are reset.
+ *
+ * @param ssrc SSRC of our RTP stream
+ * @param clock_rate RTP clock rate of the audio (8000 for G.711)
+ * @param now_us esp_timer time
+ * @return true if the socket is open
+ */
+bool rtcp_start(const char* remote_ip, uint16_t remote_port, uint16_t local_port,
+                uint32_t ssrc, uint32_t clock_rate, int64_t now_us);
+
+/**
+ * Send a BYE, close the socket and add the call to the summary history
+ */
+void rtcp_stop(int64_t now_us);
+
+/**
+ * Move the report destination (the remote RTP port + RTCP_PORT_OFFSET)
+ */
+void rtcp_set_remote(const char* remote_ip, uint16_t remote_port);
+
+/**
+ * An RTP packet was sent
+ *
+ * @param rtp_timestamp Timestamp of the packet
+ * @param payload_len Payload octets
+ */
+void rtcp_on_rtp_sent(uint32_t rtp_timestamp, size_t payload_len, int64_t now_us);
+
+/**
+ * An RTP packet was received: sequence tracking (RFC 3550 A.1) and, for
+ * audio, interarrival jitter (A.8). Telephone-events repeat the timestamp
+ * of the event start, so they count for loss but not for jitter.
+ */
+void rtcp_on_rtp_received(uint32_t ssrc, uint16_t seq, uint32_t rtp_timestamp, bool audio, int64_t arrival_us);
+
+/**
+ * Read incoming RTCP and send our report when the interval is due. Call
+ * once per media tick.
+ *
+ * @param playout_delay_ms Current jitter buffer delay, part of the
+ *                         mouth-to-ear delay in the MOS estimate
+ */
+void rtcp_poll(int64_t now_us, uint32_t playout_delay_ms);
+
+/**
+ * Copy the live values of the current (or last) call
+ */
+void rtcp_get_quality(rtcp_quality_t* quality);
+
+/**
+ * Copy a finished call summary
+ *
+ * @param index 0 = most recent
+ * @return false if there is no such call
+ */
+bool rtcp_get_call_summary(int index, rtcp_call_summary_t* summary);
+
+/**
+ * E-model (ITU-T G.107) MOS estimate for G.711 without packet loss
+ * concealment: Ie = 0, Bpl = 4.3 (G.113 Appendix I), delay impairment by
+ * the simplified Id of Cole and Rosenbluth
+ *
+ * @param one_way_delay_ms Mouth-to-ear delay
+ * @param loss_pct Packet loss in percent
+ * @return MOS between 1.0 and 4.5
+ */
+float rtcp_mos_estimate(uint32_t one_way_delay_ms, float loss_pct);
+
+#endif // RTCP_H
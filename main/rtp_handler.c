@@ -1,5 +1,11 @@
 #include "rtp_handler.h"
+#include "jitter_buffer.h"
+#include "rtcp.h"
+#include "g711.h"
+#include "call_trace.h"
 #include "esp_log.h"
+#include "esp_random.h"
+#include "esp_timer.h"
 #include "lwip/sockets.h"
 #include "lwip/netdb.h"
 #include "freertos/FreeRTOS.h"
@@ -17,6 +23,38 @@ static uint32_t timestamp = 0;
 static uint32_t ssrc = 0;
 static bool session_active = false;
 
+// Negotiated payload types (defaults match our SDP offer)
+#define RTP_DEFAULT_EVENT_PT    101
+static uint8_t tx_audio_pt = G711_PT_PCMU;
+static g711_law_t tx_law = G711_ULAW;
+static uint8_t event_pt = RTP_DEFAULT_EVENT_PT;
+
+// Transmit path: packets are built in place in a static ring of MTU-sized
+// buffers. sendto() copies into a pbuf before returning, so a slot is free
+// again as soon as its send completes; the ring only has to cover callers
+// on different tasks (media task audio, DTMF from the SIP/web side).
+typedef struct {
+    uint8_t data[RTP_PACKET_MAX_SIZE];
+} rtp_packet_slot_t;
+
+static rtp_packet_slot_t tx_pool[RTP_PACKET_POOL_SIZE];
+static uint8_t tx_pool_next = 0;
+static portMUX_TYPE tx_lock = portMUX_INITIALIZER_UNLOCKED;
+
+// Receive path: packets of any packetization are drained from the socket into
+// the jitter buffer as 10 ms frames, and as many frames as the media tick asks
+// for are played out
+#define RTP_RX_FRAME_MS         10
+#define RTP_RX_FRAME_SAMPLES    (8000 * RTP_RX_FRAME_MS / 1000)
+static jitter_buffer_t jitter_buffer;
+static uint8_t rx_packet[RTP_PACKET_MAX_SIZE];
+static uint8_t rx_payload[JB_MAX_PAYLOAD];
+static uint32_t packets_sent = 0;
+static uint32_t packets_received = 0;
+
+// Upper bound on packets drained per tick so a flood cannot stall the media task
+#define RTP_MAX_DRAIN_PER_TICK  16
+
 // Telephone-event callback
 static telephone_event_callback_t telephone_event_callback = NULL;
 
@@ -28,65 +66,6 @@ static void rtp_process_telephone_event(const rtp_header_t* header, const uint8_
 static char rtp_map_event_to_char(uint8_t event_code);
 static uint8_t rtp_map_char_to_event(char dtmf_char);
 
-// G.711 μ-law encoding table (simplified)
-static const int16_t mulaw_decode_table[256] = {
-    -32124,-31100,-30076,-29052,-28028,-27004,-25980,-24956,
-    -23932,-22908,-21884,-20860,-19836,-18812,-17788,-16764,
-    -15996,-15484,-14972,-14460,-13948,-13436,-12924,-12412,
-    -11900,-11388,-10876,-10364, -9852, -9340, -8828, -8316,
-     -7932, -7676, -7420, -7164, -6908, -6652, -6396, -6140,
-     -5884, -5628, -5372, -5116, -4860, -4604, -4348, -4092,
-     -3900, -3772, -3644, -3516, -3388, -3260, -3132, -3004,
-     -2876, -2748, -2620, -2492, -2364, -2236, -2108, -1980,
-     -1884, -1820, -1756, -1692, -1628, -1564, -1500, -1436,
-     -1372, -1308, -1244, -1180, -1116, -1052,  -988,  -924,
-      -876,  -844,  -812,  -780,  -748,  -716,  -684,  -652,
-      -620,  -588,  -556,  -524,  -492,  -460,  -428,  -396,
-      -372,  -356,  -340,  -324,  -308,  -292,  -276,  -260,
-      -244,  -228,  -212,  -196,  -180,  -164,  -148,  -132,
-      -120,  -112,  -104,   -96,   -88,   -80,   -72,   -64,
-       -56,   -48,   -40,   -32,   -24,   -16,    -8,     0,
-     32124, 31100, 30076, 29052, 28028, 27004, 25980, 24956,
-     23932, 22908, 21884, 20860, 19836, 18812, 17788, 16764,
-     15996, 15484, 14972, 14460, 13948, 13436, 12924, 12412,
-     11900, 11388, 10876, 10364,  9852,  9340,  8828,  8316,
-      7932,  7676,  7420,  7164,  6908,  6652,  6396,  6140,
-      5884,  5628,  5372,  5116,  4860,  4604,  4348,  4092,
-      3900,  3772,  3644,  -3516,  3388,  3260,  3132,  3004,
-      2876,  2748,  2620,  2492,  2364,  2236,  2108,  1980,
-      1884,  1820,  1756,  1692,  1628,  -1564,  1500,  1436,
-      1372,  1308,  1244,  1180,  1116,  1052,   988,   924,
-       876,   844,   812,   780,   748,   716,   684,   652,
-       620,   588,   556,   524,   492,   460,   428,   396,
-       372,   356,   340,   324,   308,   292,   276,   260,
-       244,   228,   212,   196,   180,   164,   148,   132,
-       120,   112,   104,    96,    88,    80,    72,    64,
-        56,    48,    40,    32,    24,    16,     8,     0
-};
-
-// Simple μ-law encoder
-static uint8_t linear_to_mulaw(int16_t sample)
-{
-    const uint16_t MULAW_MAX = 0x1FFF;
-    const uint16_t MULAW_BIAS = 33;
-    uint16_t mask = 0x1000;
-    uint8_t sign = (sample < 0) ? 0x80 : 0;
-    uint8_t position = 12;
-    uint8_t lsb = 0;
-    
-    if (sign)
-        sample = -sample;
-    
-    sample += MULAW_BIAS;
-    if (sample > MULAW_MAX)
-        sample = MULAW_MAX;
-    
-    for (; ((sample & mask) != mask && position >= 5); mask >>= 1, position--);
-    
-    lsb = (sample >> (position - 4)) & 0x0f;
-    return (~(sign | ((position - 5) << 4) | lsb));
-}
-
 void rtp_init(void)
 {
     ESP_LOGI(TAG, "RTP handler initialized");
@@ -102,6 +81,7 @@ bool rtp_start_session(const char* remote_ip, uint16_t remote_port, uint16_t loc
         return true;
     }
     
+    call_trace_point(CALL_TRACE_RTP_START, local_port);
     ESP_LOGI(TAG, "Starting RTP session: %s:%d (local port: %d)", remote_ip, remote_port, local_port);
     
     // Create UDP socket
@@ -142,145 +122,302 @@ bool rtp_start_session(const char* remote_ip, uint16_t remote_port, uint16_t loc
     int flags = fcntl(rtp_socket, F_GETFL, 0);
     fcntl(rtp_socket, F_SETFL, flags | O_NONBLOCK);
     
+    jb_init(&jitter_buffer, 8000, RTP_RX_FRAME_MS);
+    packets_sent = 0;
+    packets_received = 0;
+
+    // Without RTCP the call still works; only the quality reports are missing
+    if (!rtcp_start(remote_ip, remote_port + RTCP_PORT_OFFSET, local_port + RTCP_PORT_OFFSET,
+                    ssrc, 8000, esp_timer_get_time())) {
+        ESP_LOGW(TAG, "RTCP unavailable for this call");
+    }
+    
     session_active = true;
     ESP_LOGI(TAG, "RTP session started successfully");
     return true;
 }
 
+void rtp_set_payload_types(uint8_t audio_pt, uint8_t telephone_event_pt)
+{
+    g711_law_t law;
+    if (!g711_law_from_payload_type(audio_pt, &law)) {
+        ESP_LOGW(TAG, "Unsupported audio payload type %u - keeping PCMU", audio_pt);
+        audio_pt = G711_PT_PCMU;
+        law = G711_ULAW;
+    }
+    tx_audio_pt = audio_pt;
+    tx_law = law;
+    event_pt = telephone_event_pt;
+    ESP_LOGI(TAG, "Payload types: audio %u, telephone-event %u", tx_audio_pt, event_pt);
+}
+
+bool rtp_set_remote(const char* remote_ip, uint16_t remote_port)
+{
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(remote_port);
+    if (inet_pton(AF_INET, remote_ip, &addr.sin_addr) <= 0) {
+        ESP_LOGE(TAG, "Invalid remote IP address: %s", remote_ip);
+        return false;
+    }
+
+    portENTER_CRITICAL(&tx_lock);
+    bool changed = memcmp(&addr, &remote_addr, sizeof(addr)) != 0;
+    remote_addr = addr;
+    portEXIT_CRITICAL(&tx_lock);
+
+    if (changed) {
+        ESP_LOGI(TAG, "RTP remote moved to %s:%d", remote_ip, remote_port);
+        rtcp_set_remote(remote_ip, remote_port + RTCP_PORT_OFFSET);
+    }
+    return true;
+}
+
 void rtp_stop_session(void)
 {
     if (!session_active) {
         return;
     }
     
-    ESP_LOGI(TAG, "Stopping RTP session");
-    
+    jb_stats_t jb_stats;
+    jb_get_stats(&jitter_buffer, &jb_stats);
+    ESP_LOGI(TAG, "Stopping RTP session: sent=%lu, received=%lu, played=%lu, lost=%lu, late=%lu, "
+             "discarded=%lu, rebuffers=%lu, jitter=%lu us, playout delay=%u ms",
+             (unsigned long)packets_sent, (unsigned long)packets_received,
+             (unsigned long)jb_stats.played, (unsigned long)jb_stats.lost,
+             (unsigned long)jb_stats.late, (unsigned long)jb_stats.discarded,
+             (unsigned long)jb_stats.rebuffers, (unsigned long)jb_stats.jitter_us,
+             jb_stats.target_delay_ms);
+    
+    rtcp_stop(esp_timer_get_time());
     if (rtp_socket >= 0) {
         close(rtp_socket);
         rtp_socket = -1;
     }
     
+    tx_audio_pt = G711_PT_PCMU;
+    tx_law = G711_ULAW;
+    event_pt = RTP_DEFAULT_EVENT_PT;
     session_active = false;
 }
 
-int rtp_send_audio(const int16_t* samples, size_t sample_count)
+uint8_t* rtp_packet_begin(rtp_packet_t* packet, uint8_t payload_type, bool marker)
 {
-    if (!session_active || rtp_socket < 0) {
-        return -1;
-    }
-    
-    // Allocate buffer for RTP packet (header + payload)
-    size_t packet_size = sizeof(rtp_header_t) + sample_count;
-    uint8_t* packet = malloc(packet_size);
     if (!packet) {
-        ESP_LOGE(TAG, "Failed to allocate RTP packet buffer");
-        return -1;
+        return NULL;
     }
-    
-    // Build RTP header
-    rtp_header_t* header = (rtp_header_t*)packet;
-    header->version = 2;
-    header->padding = 0;
-    header->extension = 0;
-    header->csrc_count = 0;
-    header->marker = 0;
-    header->payload_type = 0; // PCMU (G.711 μ-law)
-    header->sequence = htons(sequence_number++);
+
+    // Claim a slot and a sequence number atomically
+    portENTER_CRITICAL(&tx_lock);
+    uint8_t* data = tx_pool[tx_pool_next].data;
+    tx_pool_next = (tx_pool_next + 1) % RTP_PACKET_POOL_SIZE;
+    uint16_t seq = sequence_number++;
+    portEXIT_CRITICAL(&tx_lock);
+
+    rtp_header_t* header = (rtp_header_t*)data;
+    header->vpxcc = RTP_VERSION << 6;   // No padding, extension or CSRCs
+    header->mpt = (marker ? 0x80 : 0) | (payload_type & 0x7F);
+    header->sequence = htons(seq);
     header->timestamp = htonl(timestamp);
     header->ssrc = htonl(ssrc);
-    
-    // Encode audio samples to μ-law
-    uint8_t* payload = packet + sizeof(rtp_header_t);
-    for (size_t i = 0; i < sample_count; i++) {
-        payload[i] = linear_to_mulaw(samples[i]);
+
+    packet->data = data;
+    packet->payload_len = 0;
+    return data + sizeof(rtp_header_t);
+}
+
+int rtp_packet_send(rtp_packet_t* packet, size_t payload_len, uint32_t timestamp_advance)
+{
+    if (!session_active || rtp_socket < 0 || !packet || !packet->data) {
+        return -1;
     }
-    
-    // Send packet
-    int sent = sendto(rtp_socket, packet, packet_size, 0,
-                     (struct sockaddr*)&remote_addr, sizeof(remote_addr));
-    
-    free(packet);
-    
+    if (payload_len > RTP_PACKET_MAX_PAYLOAD) {
+        ESP_LOGE(TAG, "RTP payload too large: %zu bytes", payload_len);
+        return -1;
+    }
+
+    // The remote address may be moved by rtp_set_remote() (early media -> answer)
+    struct sockaddr_in dest;
+    portENTER_CRITICAL(&tx_lock);
+    dest = remote_addr;
+    portEXIT_CRITICAL(&tx_lock);
+
+    packet->payload_len = payload_len;
+    int sent = sendto(rtp_socket, packet->data, sizeof(rtp_header_t) + payload_len, 0,
+                      (struct sockaddr*)&dest, sizeof(dest));
+    uint32_t packet_timestamp = ntohl(((const rtp_header_t*)packet->data)->timestamp);
+    packet->data = NULL;
+
     if (sent < 0) {
-        ESP_LOGE(TAG, "Failed to send RTP packet");
         return -1;
     }
-    
-    // Update timestamp (8000 Hz sample rate)
-    timestamp += sample_count;
-    
+
+    rtcp_on_rtp_sent(packet_timestamp, payload_len, esp_timer_get_time());
+
+    timestamp += timestamp_advance;
     return sent;
 }
 
-int rtp_receive_audio(int16_t* samples, size_t max_samples)
+int rtp_send_audio(const int16_t* samples, size_t sample_count)
+{
+    return rtp_send_audio_frames(&samples, &sample_count, 1);
+}
+
+int rtp_send_audio_frames(const int16_t* const* frames, const size_t* counts, size_t frame_count)
 {
     if (!session_active || rtp_socket < 0) {
-        ESP_LOGD(TAG, "RTP receive: Session not active or socket invalid");
         return -1;
     }
 
-    uint8_t buffer[1500]; // MTU size
-    struct sockaddr_in from_addr;
-    socklen_t from_len = sizeof(from_addr);
+    // Encode with the negotiated law straight from the capture buffers into
+    // the pooled packet
+    rtp_packet_t packet;
+    uint8_t* payload = rtp_packet_begin(&packet, tx_audio_pt, false);
+    size_t sample_count = 0;
+    for (size_t i = 0; i < frame_count; i++) {
+        size_t n = counts[i];
+        if (sample_count + n > RTP_PACKET_MAX_PAYLOAD) {
+            n = RTP_PACKET_MAX_PAYLOAD - sample_count;
+        }
+        g711_encode_block(tx_law, frames[i], payload + sample_count, n);
+        sample_count += n;
+    }
 
-    int received = recvfrom(rtp_socket, buffer, sizeof(buffer), MSG_DONTWAIT,
-                             (struct sockaddr*)&from_addr, &from_len);
+    // 8000 Hz clock: one timestamp unit per sample
+    int sent = rtp_packet_send(&packet, sample_count, sample_count);
+    if (sent < 0) {
+        ESP_LOGE(TAG, "Failed to send RTP packet");
+        return -1;
+    }
 
-    if (received <= 0) {
-        ESP_LOGD(TAG, "RTP receive: No data available (recvfrom returned %d)", received);
-        return 0; // No data available
+    if (packets_sent++ == 0) {
+        call_trace_point(CALL_TRACE_RTP_FIRST_TX, tx_audio_pt);
     }
+    return sent;
+}
 
-    // Log packet reception for debugging
-    char log_msg[128];
-    snprintf(log_msg, sizeof(log_msg), "RTP packet received: %d bytes from %s:%d", received,
-             inet_ntoa(from_addr.sin_addr), ntohs(from_addr.sin_port));
-    ESP_LOGI(TAG, "%s", log_msg);
-    
-    if (received < sizeof(rtp_header_t)) {
-        ESP_LOGW(TAG, "Received packet too small");
-        return 0;
+// Drain everything queued on the socket into the jitter buffer
+static void rtp_drain_socket(void)
+{
+    for (int i = 0; i < RTP_MAX_DRAIN_PER_TICK; i++) {
+        struct sockaddr_in from_addr;
+        socklen_t from_len = sizeof(from_addr);
+
+        int received = recvfrom(rtp_socket, rx_packet, sizeof(rx_packet), MSG_DONTWAIT,
+                                (struct sockaddr*)&from_addr, &from_len);
+        if (received <= 0) {
+            return; // Socket empty
+        }
+
+        int64_t arrival_us = esp_timer_get_time();
+
+        // Per-packet logging stays at debug level - this runs 50 times per second
+        ESP_LOGD(TAG, "RTP packet received: %d bytes from %s:%d", received,
+                 inet_ntoa(from_addr.sin_addr), ntohs(from_addr.sin_port));
+
+        if (received < (int)sizeof(rtp_header_t)) {
+            ESP_LOGW(TAG, "Received packet too small");
+            continue;
+        }
+
+        const rtp_header_t* header = (const rtp_header_t*)rx_packet;
+        if (RTP_HDR_VERSION(header) != RTP_VERSION) {
+            ESP_LOGD(TAG, "Ignoring non-RTP packet (version %d)", RTP_HDR_VERSION(header));
+            continue;
+        }
+
+        // Skip CSRC list and header extension, strip padding
+        size_t header_size = sizeof(rtp_header_t) + RTP_HDR_CSRC_COUNT(header) * 4;
+        if (RTP_HDR_EXTENSION(header) && (size_t)received >= header_size + 4) {
+            uint16_t ext_words = (rx_packet[header_size + 2] << 8) | rx_packet[header_size + 3];
+            header_size += 4 + ext_words * 4;
+        }
+        if ((size_t)received <= header_size) {
+            continue;
+        }
+        size_t payload_size = received - header_size;
+        if (RTP_HDR_PADDING(header)) {
+            uint8_t pad = rx_packet[received - 1];
+            if (pad >= payload_size) {
+                continue;
+            }
+            payload_size -= pad;
+        }
+        const uint8_t* payload = rx_packet + header_size;
+
+        uint8_t payload_type = RTP_HDR_PAYLOAD_TYPE(header);
+        rtcp_on_rtp_received(ntohl(header->ssrc), ntohs(header->sequence), ntohl(header->timestamp),
+                             payload_type != event_pt, arrival_us);
+        if (packets_received++ == 0) {
+            call_trace_point(CALL_TRACE_RTP_FIRST_RX, payload_type);
+        }
+
+        ESP_LOGD(TAG, "RTP packet received: payload_type=%d, payload_size=%zu", payload_type, payload_size);
+
+        if (payload_type == event_pt) {
+            // RFC 4733 telephone-event - handled on arrival, not played out
+            rtp_process_telephone_event(header, payload, payload_size);
+            continue;
+        }
+
+        if (payload_type != G711_PT_PCMU && payload_type != G711_PT_PCMA) {
+            // Unknown payload type - treat as PCMU for compatibility
+            ESP_LOGW(TAG, "Unknown RTP payload type: %d - treating as PCMU", payload_type);
+        }
+
+        jb_put(&jitter_buffer, ntohs(header->sequence), ntohl(header->timestamp), payload_type,
+               payload, payload_size, arrival_us);
     }
-    
-    // Parse RTP header
-    const rtp_header_t* header = (const rtp_header_t*)buffer;
-    const uint8_t* payload = buffer + sizeof(rtp_header_t);
-    size_t payload_size = received - sizeof(rtp_header_t);
-    
-    // Extract payload type from RTP header
-    uint8_t payload_type = header->payload_type;
-    
-    char rtp_log[128];
-    snprintf(rtp_log, sizeof(rtp_log), "RTP packet received: payload_type=%d, payload_size=%zu", payload_type, payload_size);
-    ESP_LOGI(TAG, "%s", rtp_log);
-    
-    // Route by payload type
-    if (payload_type == 101) {
-        // RFC 4733 telephone-event
-        rtp_process_telephone_event(header, payload, payload_size);
-        return 0; // No audio samples to return
-    } else if (payload_type == 0 || payload_type == 8) {
-        // Audio payload (PCMU=0, PCMA=8)
-        // Decode μ-law to linear PCM
-        size_t sample_count = (payload_size < max_samples) ? payload_size : max_samples;
-        for (size_t i = 0; i < sample_count; i++) {
-            samples[i] = mulaw_decode_table[payload[i]];
+}
+
+int rtp_receive_audio(int16_t* samples, size_t max_samples)
+{
+    if (!session_active || rtp_socket < 0) {
+        ESP_LOGD(TAG, "RTP receive: Session not active or socket invalid");
+        return -1;
+    }
+
+    rtp_drain_socket();
+    rtcp_poll(esp_timer_get_time(), jitter_buffer.target_frames * jitter_buffer.frame_ms);
+
+    // One buffered frame per 10 ms of the tick; a lost frame (or the lost
+    // end of a short one) plays as silence next to those that arrived
+    size_t produced = 0;
+    bool played = false;
+    while (produced + RTP_RX_FRAME_SAMPLES <= max_samples) {
+        size_t payload_size = 0;
+        uint8_t payload_type = 0;
+        jb_result_t result = jb_get(&jitter_buffer, rx_payload, &payload_size, &payload_type);
+        if (result == JB_FRAME_BUFFERING) {
+            break;
         }
-        return sample_count;
-    } else {
-        // Unknown payload type - treat as PCMU for compatibility
-        char unknown_log[128];
-        snprintf(unknown_log, sizeof(unknown_log), "Unknown RTP payload type: %d - treating as PCMU", payload_type);
-        ESP_LOGW(TAG, "%s", unknown_log);
-        // Fall through to PCMU handling
+        if (result == JB_FRAME_OK) {
+            // Decode with the law matching the payload type (unknown types
+            // were accepted as PCMU on receive)
+            g711_law_t law;
+            if (!g711_law_from_payload_type(payload_type, &law)) {
+                law = G711_ULAW;
+            }
+            g711_decode_block(law, rx_payload, samples + produced, payload_size);
+            played = true;
+        } else {
+            payload_size = 0;
+        }
+        memset(samples + produced + payload_size, 0, (RTP_RX_FRAME_SAMPLES - payload_size) * sizeof(int16_t));
+        produced += RTP_RX_FRAME_SAMPLES;
     }
+    return played ? (int)produced : 0; // 0: buffering, or every frame was lost/late
+}
 
-    // Handle as PCMU (G.711 μ-law)
-    size_t sample_count = (payload_size < max_samples) ? payload_size : max_samples;
-    for (size_t i = 0; i < sample_count; i++) {
-        samples[i] = mulaw_decode_table[payload[i]];
+void rtp_get_stats(rtp_stats_t* stats)
+{
+    if (!stats) {
+        return;
     }
-    return sample_count;
+    stats->packets_sent = packets_sent;
+    stats->packets_received = packets_received;
+    jb_get_stats(&jitter_buffer, &stats->jitter_buffer);
 }
 
 // NEW: Send RFC 4733 telephone-event DTMF digit
@@ -298,48 +435,30 @@ int rtp_send_dtmf(char dtmf_digit)
         return -1;
     }
     
-    ESP_LOGI(TAG, "Sending DTMF via RFC 4733: %c (event code %d)", dtmf_digit, event_code);
-    
-    // Allocate buffer for RTP telephone-event packet
-    size_t packet_size = sizeof(rtp_header_t) + sizeof(rtp_telephone_event_t);
-    uint8_t* packet = malloc(packet_size);
-    if (!packet) {
-        ESP_LOGE(TAG, "Failed to allocate DTMF packet buffer");
+    if (event_pt == RTP_PT_NONE) {
+        ESP_LOGW(TAG, "Cannot send DTMF: telephone-event not negotiated");
         return -1;
     }
     
-    // Build RTP header for telephone-event
-    rtp_header_t* header = (rtp_header_t*)packet;
-    header->version = 2;
-    header->padding = 0;
-    header->extension = 0;
-    header->csrc_count = 0;
-    header->marker = 0;
-    header->payload_type = 101; // RFC 4733 telephone-event
-    header->sequence = htons(sequence_number++);
-    header->timestamp = htonl(timestamp);
-    header->ssrc = htonl(ssrc);
+    ESP_LOGI(TAG, "Sending DTMF via RFC 4733: %c (event code %d)", dtmf_digit, event_code);
+    
+    // Build RTP header for telephone-event (RFC 4733) in a pooled packet
+    rtp_packet_t packet;
+    uint8_t* payload = rtp_packet_begin(&packet, event_pt, false);
     
     // Build telephone-event payload
-    rtp_telephone_event_t* event = (rtp_telephone_event_t*)(packet + sizeof(rtp_header_t));
+    rtp_telephone_event_t* event = (rtp_telephone_event_t*)payload;
     event->event = event_code;
     event->e_r_volume = 0x80 | 10; // End bit set, volume 10 (default)
     event->duration = htons(160); // 20ms duration at 8000Hz (20ms * 8000 / 1000)
     
-    // Send packet
-    int sent = sendto(rtp_socket, packet, packet_size, 0,
-                     (struct sockaddr*)&remote_addr, sizeof(remote_addr));
-    
-    free(packet);
-    
+    // Send packet, advancing the timestamp by 20ms worth of samples at 8000Hz
+    int sent = rtp_packet_send(&packet, sizeof(rtp_telephone_event_t), 160);
     if (sent < 0) {
         ESP_LOGE(TAG, "Failed to send DTMF RTP packet");
         return -1;
     }
     
-    // Update timestamp for next packet
-    timestamp += 160; // 20ms worth of samples at 8000Hz
-    
     ESP_LOGI(TAG, "DTMF sent successfully via RFC 4733: %c", dtmf_digit);
     return sent;
 }
@@ -409,7 +528,7 @@ static void rtp_process_telephone_event(const rtp_header_t* header, const uint8_
 {
     // Check packet size before parsing (minimum 4 bytes for RFC 4733)
     if (payload_size < sizeof(rtp_telephone_event_t)) {
-        ESP_LOGE(TAG, "Malformed telephone-event: packet too small (%d bytes, expected %d)", 
+        ESP_LOGE(TAG, "Malformed telephone-event: packet too small (%zu bytes, expected %zu)", 
                  payload_size, sizeof(rtp_telephone_event_t));
         return; // Continue processing without crashing
     }
@@ -4,20 +4,28 @@
 #include <stdint.h>
 #include <stdbool.h>
 #include <stddef.h>
+#include "jitter_buffer.h"
 
-// RTP header structure
+// RTP header structure. The first two octets are kept whole and read with
+// the RTP_HDR_* accessors: bit-field order is up to the compiler, and
+// fields declared in wire order read the wrong bits on the little-endian
+// ESP32.
 typedef struct {
-    uint8_t version:2;      // Version (2)
-    uint8_t padding:1;      // Padding flag
-    uint8_t extension:1;    // Extension flag
-    uint8_t csrc_count:4;   // CSRC count
-    uint8_t marker:1;       // Marker bit
-    uint8_t payload_type:7; // Payload type
+    uint8_t vpxcc;          // Version(2) Padding(1) Extension(1) CSRC count(4)
+    uint8_t mpt;            // Marker(1) Payload type(7)
     uint16_t sequence;      // Sequence number
     uint32_t timestamp;     // Timestamp
     uint32_t ssrc;          // Synchronization source
 } __attribute__((packed)) rtp_header_t;
 
+#define RTP_VERSION                 2
+#define RTP_HDR_VERSION(h)          ((h)->vpxcc >> 6)
+#define RTP_HDR_PADDING(h)          (((h)->vpxcc >> 5) & 0x01)
+#define RTP_HDR_EXTENSION(h)        (((h)->vpxcc >> 4) & 0x01)
+#define RTP_HDR_CSRC_COUNT(h)       ((h)->vpxcc & 0x0F)
+#define RTP_HDR_MARKER(h)           ((h)->mpt >> 7)
+#define RTP_HDR_PAYLOAD_TYPE(h)     ((h)->mpt & 0x7F)
+
 // RFC 4733 telephone-event packet structure
 typedef struct {
     uint8_t event;        // Event code (0-15 for DTMF)
@@ -43,6 +51,28 @@ typedef struct {
 #define DTMF_EVENT_C    14
 #define DTMF_EVENT_D    15
 
+// Transmit packet pool: RTP packets are built in place in static MTU-sized
+// buffers so the send path never touches the heap
+#define RTP_PACKET_MAX_SIZE     1500
+#define RTP_PACKET_MAX_PAYLOAD  (RTP_PACKET_MAX_SIZE - sizeof(rtp_header_t))
+#define RTP_PACKET_POOL_SIZE    4
+
+// No payload type negotiated (e.g. the remote offered no telephone-event)
+#define RTP_PT_NONE             0xFF
+
+// Handle to a pooled packet between rtp_packet_begin() and rtp_packet_send()
+typedef struct {
+    uint8_t* data;          // Start of the RTP header inside the pool
+    size_t payload_len;     // Payload bytes written after the header
+} rtp_packet_t;
+
+// RTP session statistics
+typedef struct {
+    uint32_t packets_sent;          // RTP audio packets sent
+    uint32_t packets_received;      // RTP packets received (audio and telephone-event)
+    jb_stats_t jitter_buffer;       // Receive jitter buffer depth, delay, late/discard counters
+} rtp_stats_t;
+
 // Callback function pointer type for telephone-events
 typedef void (*telephone_event_callback_t)(uint8_t event);
 
@@ -52,15 +82,38 @@ void rtp_init(void);
 // Start RTP session
 bool rtp_start_session(const char* remote_ip, uint16_t remote_port, uint16_t local_port);
 
+// Set the negotiated payload types: audio_pt selects the G.711 law we send,
+// telephone_event_pt (or RTP_PT_NONE) is used for RFC 4733 in both directions.
+// Reset to PCMU and 101 when the session stops.
+void rtp_set_payload_types(uint8_t audio_pt, uint8_t telephone_event_pt);
+
+// Point a running session at a new remote address (e.g. the answer differs
+// from the early media SDP)
+bool rtp_set_remote(const char* remote_ip, uint16_t remote_port);
+
 // Stop RTP session
 void rtp_stop_session(void);
 
+// Claim a pooled packet and build its header (next sequence number, current
+// timestamp); returns where the payload must be encoded
+uint8_t* rtp_packet_begin(rtp_packet_t* packet, uint8_t payload_type, bool marker);
+
+// Send a packet from rtp_packet_begin() and advance the RTP timestamp
+int rtp_packet_send(rtp_packet_t* packet, size_t payload_len, uint32_t timestamp_advance);
+
 // Send audio data via RTP
 int rtp_send_audio(const int16_t* samples, size_t sample_count);
 
+// Send one audio packet made of several capture frames, encoded straight
+// from where they were captured (no intermediate PCM copy)
+int rtp_send_audio_frames(const int16_t* const* frames, const size_t* counts, size_t frame_count);
+
 // Receive audio data via RTP
 int rtp_receive_audio(int16_t* samples, size_t max_samples);
 
+// Get RTP and jitter buffer statistics for the current (or last) session
+void rtp_get_stats(rtp_stats_t* stats);
+
 // Check if RTP session is active
 bool rtp_is_active(void);
 
@@ -0,0 +1,393 @@
+#include "sdp.h"
+#include "g711.h"
+#include <string.h>
+#include <strings.h>
+
+typedef struct {
+    const char* name;
+    uint8_t len;
+    sdp_codec_t codec;
+} sdp_codec_entry_t;
+
+static const sdp_codec_entry_t codec_table[] = {
+    { "PCMU",            4,  SDP_CODEC_PCMU },
+    { "PCMA",            4,  SDP_CODEC_PCMA },
+    { "telephone-event", 15, SDP_CODEC_TELEPHONE_EVENT },
+};
+
+// Our offer, in preference order
+static const sdp_codec_t offer_codecs[] = { SDP_CODEC_PCMU, SDP_CODEC_PCMA };
+
+static sdp_codec_t lookup_codec(const char* name, size_t len)
+{
+    for (size_t i = 0; i < sizeof(codec_table) / sizeof(codec_table[0]); i++) {
+        if (codec_table[i].len == len && strncasecmp(codec_table[i].name, name, len) == 0) {
+            return codec_table[i].codec;
+        }
+    }
+    return SDP_CODEC_UNKNOWN;
+}
+
+const char* sdp_codec_name(sdp_codec_t codec)
+{
+    for (size_t i = 0; i < sizeof(codec_table) / sizeof(codec_table[0]); i++) {
+        if (codec_table[i].codec == codec) {
+            return codec_table[i].name;
+        }
+    }
+    return "unknown";
+}
+
+static uint8_t static_payload_type(sdp_codec_t codec)
+{
+    return codec == SDP_CODEC_PCMA ? G711_PT_PCMA : G711_PT_PCMU;
+}
+
+// Parse an unsigned decimal number; returns -1 if there is none
+static long parse_number(const char* p, const char* end, const char** after)
+{
+    long value = -1;
+    while (p < end && *p == ' ') {
+        p++;
+    }
+    while (p < end && *p >= '0' && *p <= '9') {
+        value = (value < 0 ? 0 : value * 10) + (*p - '0');
+        if (value > 0xFFFFFF) {
+            return -1;
+        }
+        p++;
+    }
+    if (after) {
+        *after = p;
+    }
+    return value;
+}
+
+static bool token_equals(const char* p, const char* end, const char* token)
+{
+    size_t len = strlen(token);
+    return (size_t)(end - p) == len && memcmp(p, token, len) == 0;
+}
+
+static sdp_format_t* find_format(sdp_media_t* media, long payload_type)
+{
+    for (int i = 0; i < media->format_count; i++) {
+        if (media->formats[i].payload_type == payload_type) {
+            return &media->formats[i];
+        }
+    }
+    return NULL;
+}
+
+// "c=IN IP4 <address>[/ttl]"; IPv6 is not supported and leaves the address unset
+static void parse_connection(const char* p, const char* end, char* address)
+{
+    if (end - p < 8 || memcmp(p, "IN IP4 ", 7) != 0) {
+        return;
+    }
+    p += 7;
+    const char* stop = p;
+    while (stop < end && *stop != '/' && *stop != ' ') {
+        stop++;
+    }
+    if (stop > p && (size_t)(stop - p) < SDP_ADDRESS_LEN) {
+        memcpy(address, p, stop - p);
+        address[stop - p] = '\0';
+    }
+}
+
+// "m=audio <port>[/<count>] <proto> <fmt> ..."
+static void parse_media_line(const char* p, const char* end, sdp_media_t* media)
+{
+    const char* after;
+    long port = parse_number(p + 6, end, &after);
+    if (port < 0 || port > 65535) {
+        return;
+    }
+    if (after < end && *after == '/') {
+        parse_number(after + 1, end, &after);
+    }
+
+    // Skip the transport protocol
+    while (after < end && *after == ' ') {
+        after++;
+    }
+    while (after < end && *after != ' ') {
+        after++;
+    }
+
+    media->has_audio = true;
+    media->port = (uint16_t)port;
+    while (after < end && media->format_count < SDP_MAX_FORMATS) {
+        long payload_type = parse_number(after, end, &after);
+        if (payload_type < 0 || payload_type > 127) {
+            break;
+        }
+        sdp_format_t* format = &media->formats[media->format_count++];
+        format->payload_type = (uint8_t)payload_type;
+        format->clock_rate = 8000;
+        // Static assignments (RFC 3551) apply unless an rtpmap says otherwise
+        format->codec = payload_type == G711_PT_PCMU ? SDP_CODEC_PCMU :
+                        payload_type == G711_PT_PCMA ? SDP_CODEC_PCMA : SDP_CODEC_UNKNOWN;
+    }
+}
+
+// "a=rtpmap:<pt> <encoding>/<clock>[/<channels>]"
+static void parse_rtpmap(const char* p, const char* end, sdp_media_t* media)
+{
+    const char* after;
+    long payload_type = parse_number(p, end, &after);
+    sdp_format_t* format = find_format(media, payload_type);
+    if (!format) {
+        return;
+    }
+
+    while (after < end && *after == ' ') {
+        after++;
+    }
+    const char* slash = memchr(after, '/', end - after);
+    if (!slash) {
+        return;
+    }
+    format->codec = lookup_codec(after, slash - after);
+    long clock_rate = parse_number(slash + 1, end, NULL);
+    if (clock_rate > 0) {
+        format->clock_rate = (uint32_t)clock_rate;
+    }
+}
+
+static bool parse_direction(const char* p, const char* end, sdp_direction_t* direction)
+{
+    if (token_equals(p, end, "sendrecv")) {
+        *direction = SDP_DIR_SENDRECV;
+    } else if (token_equals(p, end, "sendonly")) {
+        *direction = SDP_DIR_SENDONLY;
+    } else if (token_equals(p, end, "recvonly")) {
+        *direction = SDP_DIR_RECVONLY;
+    } else if (token_equals(p, end, "inactive")) {
+        *direction = SDP_DIR_INACTIVE;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+bool sdp_parse(const char* sdp, size_t len, sdp_media_t* media)
+{
+    if (!sdp || !media) {
+        return false;
+    }
+    memset(media, 0, sizeof(*media));
+
+    const char* end = sdp + len;
+    const char* p = sdp;
+    char session_address[SDP_ADDRESS_LEN] = {0};
+    sdp_direction_t session_direction = SDP_DIR_SENDRECV;
+    bool media_direction_set = false;
+
+    // 0 = session level, 1 = inside the first m=audio, 2 = inside any other m= section
+    int section = 0;
+
+    while (p < end) {
+        const char* nl = memchr(p, '\n', end - p);
+        const char* next = nl ? nl + 1 : end;
+        const char* eol = nl ? nl : end;
+        if (eol > p && eol[-1] == '\r') {
+            eol--;
+        }
+
+        if (eol - p >= 2 && p[1] == '=') {
+            const char* value = p + 2;
+            switch (p[0]) {
+                case 'm':
+                    if (!media->has_audio && eol - value >= 6 && memcmp(value, "audio ", 6) == 0) {
+                        parse_media_line(value, eol, media);
+                        section = 1;
+                    } else {
+                        section = 2;
+                    }
+                    break;
+                case 'c':
+                    if (section == 0) {
+                        parse_connection(value, eol, session_address);
+                    } else if (section == 1) {
+                        parse_connection(value, eol, media->address);
+                    }
+                    break;
+                case 'a':
+                    if (section == 2) {
+                        break;
+                    }
+                    if (eol - value > 7 && memcmp(value, "rtpmap:", 7) == 0) {
+                        if (section == 1) {
+                            parse_rtpmap(value + 7, eol, media);
+                        }
+                    } else if (eol - value > 6 && memcmp(value, "ptime:", 6) == 0) {
+                        long ptime = parse_number(value + 6, eol, NULL);
+                        if (ptime > 0 && ptime <= 1000) {
+                            media->ptime = (uint16_t)ptime;
+                        }
+                    } else if (section == 0) {
+                        parse_direction(value, eol, &session_direction);
+                    } else if (parse_direction(value, eol, &media->direction)) {
+                        media_direction_set = true;
+                    }
+                    break;
+                default:
+                    break;
+            }
+        }
+        p = next;
+    }
+
+    if (!media->has_audio) {
+        return false;
+    }
+    if (media->address[0] == '\0') {
+        memcpy(media->address, session_address, sizeof(session_address));
+    }
+    if (!media_direction_set) {
+        media->direction = session_direction;
+    }
+    return true;
+}
+
+bool sdp_negotiate(const sdp_media_t* remote, sdp_negotiated_t* result)
+{
+    memset(result, 0, sizeof(*result));
+    result->event_pt = SDP_PT_NONE;
+
+    if (!remote->has_audio || remote->port == 0 || remote->address[0] == '\0') {
+        return false;
+    }
+
+    for (int i = 0; i < remote->format_count; i++) {
+        const sdp_format_t* format = &remote->formats[i];
+        if (format->clock_rate != 8000) {
+            continue;
+        }
+        if ((format->codec == SDP_CODEC_PCMU || format->codec == SDP_CODEC_PCMA) &&
+            result->codec == SDP_CODEC_UNKNOWN) {
+            result->codec = format->codec;
+            result->audio_pt = format->payload_type;
+        } else if (format->codec == SDP_CODEC_TELEPHONE_EVENT && result->event_pt == SDP_PT_NONE) {
+            result->event_pt = format->payload_type;
+        }
+    }
+    if (result->codec == SDP_CODEC_UNKNOWN) {
+        return false;
+    }
+
+    uint16_t ptime = remote->ptime ? remote->ptime : SDP_DEFAULT_PTIME_MS;
+    ptime -= ptime % SDP_PTIME_STEP_MS;
+    if (ptime < SDP_PTIME_STEP_MS) {
+        ptime = SDP_PTIME_STEP_MS;
+    } else if (ptime > SDP_MAX_PTIME_MS) {
+        ptime = SDP_MAX_PTIME_MS;
+    }
+    result->ptime = ptime;
+    result->remote_ptime = remote->ptime;
+    memcpy(result->address, remote->address, sizeof(result->address));
+    result->port = remote->port;
+
+    // Mirror the remote direction; c=0.0.0.0 is the RFC 2543 way to put us on hold
+    switch (remote->direction) {
+        case SDP_DIR_SENDONLY: result->direction = SDP_DIR_RECVONLY; break;
+        case SDP_DIR_RECVONLY: result->direction = SDP_DIR_SENDONLY; break;
+        case SDP_DIR_INACTIVE: result->direction = SDP_DIR_INACTIVE; break;
+        default:               result->direction = SDP_DIR_SENDRECV; break;
+    }
+    if (strcmp(remote->address, "0.0.0.0") == 0) {
+        result->direction = (result->direction == SDP_DIR_SENDRECV || result->direction == SDP_DIR_RECVONLY) ?
+                            SDP_DIR_RECVONLY : SDP_DIR_INACTIVE;
+    }
+    return true;
+}
+
+static const char* direction_attribute(sdp_direction_t direction)
+{
+    switch (direction) {
+        case SDP_DIR_SENDONLY: return "a=sendonly\r\n";
+        case SDP_DIR_RECVONLY: return "a=recvonly\r\n";
+        case SDP_DIR_INACTIVE: return "a=inactive\r\n";
+        default:               return "a=sendrecv\r\n";
+    }
+}
+
+// v=, o=, s=, c=, t= and the start of the m= line (up to the port)
+static void write_session(sip_writer_t* w, const sdp_local_t* local)
+{
+    sip_writer_append(w, "v=0\r\no=- ");
+    sip_writer_append_uint(w, local->session_id);
+    sip_writer_append_n(w, " ", 1);
+    sip_writer_append_uint(w, local->session_version);
+    sip_writer_append(w, " IN IP4 ");
+    sip_writer_append(w, local->address);
+    sip_writer_append(w, "\r\ns=");
+    sip_writer_append(w, local->session_name);
+    sip_writer_append(w, "\r\nc=IN IP4 ");
+    sip_writer_append(w, local->address);
+    sip_writer_append(w, "\r\nt=0 0\r\nm=audio ");
+    sip_writer_append_uint(w, local->port);
+    sip_writer_append(w, " RTP/AVP");
+}
+
+static void write_rtpmap(sip_writer_t* w, uint8_t payload_type, sdp_codec_t codec)
+{
+    sip_writer_append(w, "a=rtpmap:");
+    sip_writer_append_uint(w, payload_type);
+    sip_writer_append_n(w, " ", 1);
+    sip_writer_append(w, sdp_codec_name(codec));
+    sip_writer_append(w, "/8000\r\n");
+    if (codec == SDP_CODEC_TELEPHONE_EVENT) {
+        sip_writer_append(w, "a=fmtp:");
+        sip_writer_append_uint(w, payload_type);
+        sip_writer_append(w, " 0-15\r\n");
+    }
+}
+
+static void write_trailer(sip_writer_t* w, const sdp_local_t* local)
+{
+    sip_writer_append(w, "a=ptime:");
+    sip_writer_append_uint(w, SDP_DEFAULT_PTIME_MS);
+    sip_writer_append(w, "\r\n");
+    sip_writer_append(w, direction_attribute(local->direction));
+}
+
+void sdp_write_offer(sip_writer_t* w, const sdp_local_t* local)
+{
+    const size_t codec_count = sizeof(offer_codecs) / sizeof(offer_codecs[0]);
+
+    write_session(w, local);
+    for (size_t i = 0; i < codec_count; i++) {
+        sip_writer_append_n(w, " ", 1);
+        sip_writer_append_uint(w, static_payload_type(offer_codecs[i]));
+    }
+    sip_writer_append_n(w, " ", 1);
+    sip_writer_append_uint(w, SDP_DEFAULT_EVENT_PT);
+    sip_writer_append(w, "\r\n");
+
+    for (size_t i = 0; i < codec_count; i++) {
+        write_rtpmap(w, static_payload_type(offer_codecs[i]), offer_codecs[i]);
+    }
+    write_rtpmap(w, SDP_DEFAULT_EVENT_PT, SDP_CODEC_TELEPHONE_EVENT);
+    write_trailer(w, local);
+}
+
+void sdp_write_answer(sip_writer_t* w, const sdp_local_t* local, const sdp_negotiated_t* negotiated)
+{
+    write_session(w, local);
+    sip_writer_append_n(w, " ", 1);
+    sip_writer_append_uint(w, negotiated->audio_pt);
+    if (negotiated->event_pt != SDP_PT_NONE) {
+        sip_writer_append_n(w, " ", 1);
+        sip_writer_append_uint(w, negotiated->event_pt);
+    }
+    sip_writer_append(w, "\r\n");
+
+    write_rtpmap(w, negotiated->audio_pt, negotiated->codec);
+    if (negotiated->event_pt != SDP_PT_NONE) {
+        write_rtpmap(w, negotiated->event_pt, SDP_CODEC_TELEPHONE_EVENT);
+    }
+    write_trailer(w, local);
+}
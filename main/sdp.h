@@ -0,0 +1,132 @@
+#ifndef SDP_H
+#define SDP_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "sip_writer.h"
+
+#define SDP_MAX_FORMATS         12
+#define SDP_ADDRESS_LEN         48
+#define SDP_DEFAULT_PTIME_MS    20      // Advertised in a=ptime; we receive any packetization
+#define SDP_PTIME_STEP_MS       20      // We send whole media frames...
+#define SDP_MAX_PTIME_MS        60      // ...up to this many ms per packet
+#define SDP_DEFAULT_EVENT_PT    101     // telephone-event payload type in our offers
+#define SDP_PT_NONE             0xFF    // No payload type negotiated
+
+/**
+ * Encodings we can use (anything else is carried as UNKNOWN)
+ */
+typedef enum {
+    SDP_CODEC_UNKNOWN = 0,
+    SDP_CODEC_PCMU,
+    SDP_CODEC_PCMA,
+    SDP_CODEC_TELEPHONE_EVENT
+} sdp_codec_t;
+
+/**
+ * Stream direction (RFC 4566 §6, RFC 3264 §5.1)
+ */
+typedef enum {
+    SDP_DIR_SENDRECV = 0,
+    SDP_DIR_SENDONLY,
+    SDP_DIR_RECVONLY,
+    SDP_DIR_INACTIVE
+} sdp_direction_t;
+
+/**
+ * One payload type of the m= line
+ */
+typedef struct {
+    uint8_t payload_type;
+    sdp_codec_t codec;
+    uint32_t clock_rate;
+} sdp_format_t;
+
+/**
+ * Audio stream of a parsed session description (first m=audio line)
+ */
+typedef struct {
+    bool has_audio;
+    char address[SDP_ADDRESS_LEN];          // c= address; media level overrides session level
+    uint16_t port;                          // 0 = stream rejected/disabled
+    uint16_t ptime;                         // a=ptime in ms, 0 if absent
+    sdp_direction_t direction;              // As seen by the sender of the SDP
+    uint8_t format_count;
+    sdp_format_t formats[SDP_MAX_FORMATS];  // In m= line order (sender's preference)
+} sdp_media_t;
+
+/**
+ * Result of offer/answer for the audio stream
+ */
+typedef struct {
+    sdp_codec_t codec;                  // PCMU or PCMA
+    uint8_t audio_pt;                   // Payload type for the codec
+    uint8_t event_pt;                   // telephone-event payload type, SDP_PT_NONE if not negotiated
+    uint16_t ptime;                     // Packetization we send (ms), see sdp_negotiate()
+    uint16_t remote_ptime;              // a=ptime the remote asked for, 0 if absent
+    sdp_direction_t direction;          // Our direction
+    char address[SDP_ADDRESS_LEN];      // Where to send RTP
+    uint16_t port;
+} sdp_negotiated_t;
+
+/**
+ * Local parameters for the SDP we generate
+ */
+typedef struct {
+    const char* address;        // o= and c= address
+    uint16_t port;              // RTP port
+    uint32_t session_id;
+    uint32_t session_version;   // Incremented for every changed SDP in a session
+    const char* session_name;
+    sdp_direction_t direction;
+} sdp_local_t;
+
+/**
+ * Parse a session description in place (no allocation, no copy of the body)
+ *
+ * @param sdp SDP text (need not be NUL-terminated)
+ * @param len Length of the text
+ * @param media Filled with the first audio stream
+ * @return true if the text was SDP with an m=audio line
+ */
+bool sdp_parse(const char* sdp, size_t len, sdp_media_t* media);
+
+/**
+ * Pick codec, telephone-event payload type, ptime, direction and remote
+ * address from the remote offer or answer
+ *
+ * The first usable codec in the remote's m= order wins: for an offer that
+ * honours the offerer's preference, for an answer it is the answerer's choice
+ * out of our offer.
+ *
+ * The remote's a=ptime is what it wants to receive. We send whole
+ * SDP_PTIME_STEP_MS frames, so ptime is the longest of those not above the
+ * request (at least one frame, at most SDP_MAX_PTIME_MS): 30 ms becomes 20,
+ * 10 ms becomes 20 as we cannot go shorter. Receiving is not limited, the
+ * jitter buffer takes any packetization.
+ *
+ * @param remote Parsed remote SDP
+ * @param result Negotiated parameters
+ * @return false if the stream was rejected or has no codec in common (488)
+ */
+bool sdp_negotiate(const sdp_media_t* remote, sdp_negotiated_t* result);
+
+/**
+ * Append an offer with all supported codecs in our preference order
+ * (PCMU, PCMA) plus telephone-event
+ */
+void sdp_write_offer(sip_writer_t* w, const sdp_local_t* local);
+
+/**
+ * Append the answer to a negotiated offer: the chosen codec and the
+ * offerer's telephone-event payload type
+ */
+void sdp_write_answer(sip_writer_t* w, const sdp_local_t* local, const sdp_negotiated_t* negotiated);
+
+/**
+ * Name of a codec for logging ("PCMU", ...)
+ */
+const char* sdp_codec_name(sdp_codec_t codec);
+
+#endif // SDP_H
@@ -1,21 +1,34 @@
 #include "sip_client.h"
 #include "led_handler.h"
-#include "audio_handler.h"
 #include "dtmf_decoder.h"
 #include "rtp_handler.h"
+#include "media_engine.h"
+#include "dns_cache.h"
+#include "sip_parser.h"
+#include "sip_writer.h"
+#include "sip_transaction.h"
+#include "sip_transport.h"
+#include "sip_keepalive.h"
+#include "sip_registrar.h"
+#include "sip_dialog_table.h"
+#include "sdp.h"
+#include "sip_log.h"
+#include "call_trace.h"
 #include "ntp_sync.h"
 #include "ntp_log.h"
 #include "esp_log.h"
+#include "esp_attr.h"
 #include "esp_netif.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "freertos/queue.h"
 #include "lwip/sockets.h"
-#include "lwip/netdb.h"
 #include "nvs_flash.h"
 #include "nvs.h"
 #include "mbedtls/md5.h"
 #include "esp_random.h"
 #include <inttypes.h>
+#include <strings.h>
 
 // Suppress format-truncation warnings for SIP message construction throughout this file
 // SIP URIs can be long but our buffers (2048-3072 bytes) are sized appropriately
@@ -25,7 +38,6 @@
 static const char *TAG = "SIP";
 static sip_state_t current_state = SIP_STATE_IDLE;
 static sip_config_t sip_config = {0};
-static int sip_socket = -1;
 static TaskHandle_t sip_task_handle = NULL;
 static bool registration_requested = false;
 static bool reinit_requested = false;
@@ -33,11 +45,8 @@ static uint32_t auto_register_delay_ms = 5000; // Wait 5 seconds after init
 static uint32_t init_timestamp = 0;
 static uint32_t call_start_timestamp = 0;
 static uint32_t call_timeout_ms = 30000; // 30 second call timeout
-static uint32_t last_message_timestamp = 0; // Track when we last sent a SIP message
-static uint32_t sip_response_timeout_ms = 3000; // 3 second timeout for SIP responses
 static uint32_t connection_retry_delay_ms = 10000; // 10 seconds before retrying connection
 static uint32_t last_connection_retry_timestamp = 0;
-static uint32_t last_rtp_received_timestamp = 0;
 static const uint32_t rtp_timeout_ms = 5000; // 5 seconds
 
 // State names for logging (global to avoid stack issues)
@@ -47,17 +56,6 @@ static const char* state_names[] = {
     "AUTH_FAILED", "NETWORK_ERROR", "TIMEOUT"
 };
 
-// SIP Log buffer for web interface
-#define SIP_LOG_MAX_ENTRIES 50
-#define SIP_LOG_MAX_MESSAGE_LEN 256
-
-static sip_log_entry_t sip_log_buffer[SIP_LOG_MAX_ENTRIES];
-static int sip_log_write_index = 0;
-static int sip_log_count = 0;
-static SemaphoreHandle_t sip_log_mutex = NULL;
-
-
-
 // SIP authentication challenge structure
 typedef struct {
     char realm[128];
@@ -65,98 +63,191 @@ typedef struct {
     char qop[32];
     char opaque[128];
     char algorithm[32];
+    bool stale;         // Server rejected an outdated nonce, not the credentials
     bool valid;
 } sip_auth_challenge_t;
 
 static sip_auth_challenge_t last_auth_challenge = {0};
 
-// Store authentication challenge for INVITE messages
-static sip_auth_challenge_t invite_auth_challenge = {0};
-static bool has_invite_auth_challenge = false;
-
 // Store public IP from 401 response for NAT traversal
 static char public_ip[16] = {0};
 
 // Track INVITE authentication attempts to prevent infinite loops
-static int invite_auth_attempt_count = 0;
 static const int MAX_INVITE_AUTH_ATTEMPTS = 1; // Only retry once for INVITE
 
-// Store INVITE transaction IDs at file scope for branch matching
-static int initial_invite_call_id = 0;
-static int initial_invite_from_tag = 0;
-static int initial_invite_branch = 0;
-static int auth_invite_branch = 0;
-static int initial_invite_cseq = 1;
-static char invite_call_id_str[128] = {0};
+// Established dialogs (RFC 3261 §12), answered by us or by a target we
+// called. Requests and responses within a dialog are routed by Call-ID and
+// our tag; the session holding the audio path is call_session, and an
+// ending one stays until its BYE is answered.
+#define SIP_MAX_SESSIONS        4
+
+typedef enum {
+    SIP_SESSION_FREE = 0,
+    SIP_SESSION_CONFIRMED,      // 2xx sent or received
+    SIP_SESSION_ENDING          // BYE sent, waiting for its response
+} sip_session_state_t;
+
+typedef struct {
+    sip_session_state_t state;
+    bool incoming;                      // We answered the INVITE (UAS)
+    sip_dialog_t dialog;                // Header values, formatted once per call
+    uint32_t invite_cseq;               // CSeq of the INVITE last answered in the dialog
+    uint32_t ack_branch;                // Outgoing: Via branch of the ACK for the 2xx
+    bool ack_pending;                   // Our 2xx to a (re-)INVITE not ACKed yet
+    uint32_t remote_cseq;               // Highest CSeq received from the remote side
+    uint32_t sdp_session_id;            // o= of every SDP we send in the session
+    uint32_t sdp_version;
+} sip_session_t;
+
+static EXT_RAM_BSS_ATTR sip_session_t sessions[SIP_MAX_SESSIONS];
+static sip_dialog_table_t session_table;    // (Call-ID, our tag) -> sessions index
+static sip_session_t* call_session = NULL;  // Session with the audio path, NULL between calls
+
+// Outgoing call legs: a bell rings every target in its comma-separated list
+// in parallel, each leg with its own dialog and INVITE transaction. The
+// first 200 OK wins and becomes the call's session; the other legs are
+// cancelled, or ACKed and sent BYE if they answered as well.
+#define SIP_MAX_FORK_TARGETS    4       // Targets rung per call
+#define SIP_MAX_CALL_LEGS       6       // Pool: a new call can start while the last one's CANCELs finish
+
+typedef enum {
+    SIP_LEG_FREE = 0,
+    SIP_LEG_CALLING,        // INVITE sent, no response yet
+    SIP_LEG_PROCEEDING,     // Provisional response received, may be cancelled
+    SIP_LEG_CANCELLING,     // CANCEL sent, waiting for the 487
+    SIP_LEG_ENDING          // Answered after losing: ACKed, BYE sent
+} sip_leg_state_t;
+
+typedef struct {
+    sip_leg_state_t state;
+    uint32_t fork_id;                   // Call the leg belongs to
+    bool cancel_pending;                // Lost before any provisional: CANCEL once one arrives
+    sip_dialog_t dialog;
+    uint32_t invite_branch;             // Via branch of the INVITE, reused by its CANCEL
+    uint32_t ack_branch;                // Via branch of the ACK for a losing 2xx
+    uint32_t sdp_session_id;            // o= of our offer
+    sip_auth_challenge_t auth;          // Challenge answered by the next INVITE
+    int auth_attempts;
+    uint32_t invite_sent_ms;
+    bool has_early_answer;              // A provisional response carried usable SDP
+    bool early_media;                   // The running early media is this leg's
+    sdp_negotiated_t early_answer;      // Stands for the answer if the 200 OK has no SDP
+} sip_call_leg_t;
+
+static EXT_RAM_BSS_ATTR sip_call_leg_t call_legs[SIP_MAX_CALL_LEGS];
+static sip_dialog_table_t leg_table;    // (Call-ID, From tag) -> call_legs index
+static uint32_t fork_id = 0;            // Current outgoing call
 
 // Track authentication state to prevent infinite loops
 static int auth_attempt_count = 0;
 static const int MAX_AUTH_ATTEMPTS = 3;
 
-// Store Call-ID and From tag from initial REGISTER for reuse in authenticated REGISTER
-static char initial_call_id[128] = {0};
-static char initial_from_tag[32] = {0};
+// Call-ID and From tag of the initial REGISTER, reused by the authenticated REGISTER
+// and by every refresh of the binding
+static sip_dialog_t reg_dialog = {0};
 static bool has_initial_transaction_ids = false;
 
+// Registration refresh: re-REGISTER at 80% of the granted expiry with the cached
+// nonce (next nc), so a refresh normally needs no 401 round-trip
+#define SIP_REGISTER_EXPIRES_S          3600
+#define SIP_REGISTER_MIN_EXPIRES_S      60
+#define SIP_REGISTER_MAX_EXPIRES_S      86400   // Longer grants are refreshed as if a day
+#define SIP_REGISTER_REFRESH_PERCENT    80
+#define SIP_REGISTER_RETRY_MS           30000   // Refresh retry when one times out during a call
+static uint32_t reg_granted_timestamp = 0;      // When the registrar last accepted us
+static uint32_t reg_refresh_ms = 0;             // Refresh delay from then on (0 = none scheduled)
+static bool reg_refreshing = false;             // Refresh in flight; the state stays REGISTERED
+static uint32_t reg_nonce_count = 0;            // Requests sent with last_auth_challenge.nonce
+
+// Registrar failover (see sip_registrar.c): a REGISTER unanswered this long
+// moves to another registrar that answers its probes, without waiting for
+// the transaction to time out
+#define SIP_REGISTER_FAILOVER_MS        4000
+#define SIP_PROBE_CALL_ID_PREFIX        "probe-"        // Call-ID of standby registrar probes
+static uint32_t reg_sent_timestamp = 0;         // REGISTER in flight, unanswered (0 = none)
+
+// TCP/TLS: the registrar's binding points at our connection, so when it
+// breaks we register again over a new one right away
+static bool reconnect_pending = false;
+static uint32_t reconnect_timestamp = 0;        // When the connection was lost (0 = not reconnecting)
+
+// All outgoing messages are built here (SIP task only)
+#define SIP_TX_BUFFER_SIZE 2048
+
+// Local RTP port offered in every SDP
+#define SIP_RTP_PORT            5004
+static char sip_tx_buffer[SIP_TX_BUFFER_SIZE];
+
+// Pre-armed INVITEs: while registered and idle, the INVITE to each doorbell
+// target is built ahead of time (dialog strings, SDP offer and, once we hold
+// a nonce, the Authorization header). Call-ID, tag, branch and SDP session id
+// are fixed-width numbers, so a press only copies the template and rewrites
+// digits in place; a pre-authenticated one also recomputes the digest.
+#define SIP_PREARM_SLOTS        4       // Targets of both bells, in list order
+#define SIP_PREARM_ID_DIGITS    10      // Width of sip_new_fixed_id() values
+
+typedef struct {
+    bool valid;
+    uint32_t generation;                // prearm_generation it was built for
+    char uri[128];                      // Formatted target it was built for
+    sip_dialog_t dialog;                // Becomes the leg's dialog, ids patched per call
+    char invite[SIP_TX_BUFFER_SIZE];
+    int len;
+    // Offsets of the patched fields in invite[] (0 = not present)
+    uint16_t branch_pos;
+    uint16_t tag_pos;
+    uint16_t call_id_pos;
+    uint16_t session_id_pos;
+    uint16_t response_pos;
+    uint16_t nc_pos;
+    uint16_t cnonce_pos;
+    uint16_t dialog_tag_pos;            // In dialog.from
+    bool register_nonce;                // Authorized with the REGISTER nonce (nc shared with it)
+} sip_prearm_t;
+
+static EXT_RAM_BSS_ATTR sip_prearm_t prearm[SIP_PREARM_SLOTS];
+static uint32_t prearm_generation = 1;          // Bumped when addresses or nonces change
+static sip_auth_challenge_t prearm_challenge = {0}; // Last INVITE challenge, kept across calls
+static uint32_t prearm_nonce_count = 0;         // Requests sent with prearm_challenge.nonce
+
 // Forward declarations
 static bool sip_client_register_auth(sip_auth_challenge_t* challenge);
-static void send_ack_for_error_response(const char* response_buffer);
-
-// Track last error response to detect retransmissions
-static char last_error_call_id[128] = {0};
-static char last_error_via_branch[64] = {0};
-static uint32_t last_error_timestamp = 0;
-
-// SIP INVITE template removed - built inline in sip_client_make_call()
-
-// Helper function to add log entry (thread-safe, synchronous with yielding)
-// Logs to both serial console and web interface
-static void sip_add_log_entry(const char* type, const char* message)
-{
-    // Log to serial console first
-    if (strcmp(type, "error") == 0) {
-        NTP_LOGE(TAG, "%s", message);
-    } else if (strcmp(type, "info") == 0) {
-        NTP_LOGI(TAG, "%s", message);
-    } else if (strcmp(type, "sent") == 0 || strcmp(type, "received") == 0) {
-        NTP_LOGI(TAG, "[%s] %s", type, message);  // Changed from LOGD to LOGI for visibility
-    } else {
-        NTP_LOGI(TAG, "[%s] %s", type, message);
-    }
-    
-    // Yield to other tasks after serial logging
-    taskYIELD();
-    
-    // Add to web log buffer
-    if (!sip_log_mutex) {
-        sip_log_mutex = xSemaphoreCreateMutex();
-    }
-    
-    if (xSemaphoreTake(sip_log_mutex, pdMS_TO_TICKS(10)) == pdTRUE) {
-        sip_log_entry_t* entry = &sip_log_buffer[sip_log_write_index];
-        
-        // Use NTP timestamp if available, otherwise fall back to tick count
-        if (ntp_is_synced()) {
-            entry->timestamp = ntp_get_timestamp_ms();
-        } else {
-            entry->timestamp = xTaskGetTickCount() * portTICK_PERIOD_MS;
-        }
-        
-        strncpy(entry->type, type, sizeof(entry->type) - 1);
-        entry->type[sizeof(entry->type) - 1] = '\0';
-        strncpy(entry->message, message, sizeof(entry->message) - 1);
-        entry->message[sizeof(entry->message) - 1] = '\0';
-        
-        sip_log_write_index = (sip_log_write_index + 1) % SIP_LOG_MAX_ENTRIES;
-        if (sip_log_count < SIP_LOG_MAX_ENTRIES) {
-            sip_log_count++;
-        }
-        
-        xSemaphoreGive(sip_log_mutex);
-    }
-    
-    // Yield again after web log update
-    taskYIELD();
+static void sip_refresh_registration(void);
+static void send_ack_for_error_response(const sip_message_t* response);
+static void sip_do_make_call(const char* targets);
+static void sip_do_hangup(void);
+static void sip_do_send_dtmf(char dtmf_digit);
+static void sip_do_disconnect(void);
+
+// Commands from other tasks (web, GPIO) are queued and executed by the SIP task,
+// which blocks in select() on the SIP socket and a loopback wake socket
+typedef enum {
+    SIP_CMD_REGISTER,
+    SIP_CMD_REINIT,
+    SIP_CMD_CALL,
+    SIP_CMD_HANGUP,
+    SIP_CMD_DTMF,
+    SIP_CMD_DISCONNECT
+} sip_cmd_type_t;
+
+typedef struct {
+    sip_cmd_type_t type;
+    char arg[SIP_TARGET_LIST_LEN];  // Call target list or DTMF digit
+} sip_cmd_t;
+
+#define SIP_CMD_QUEUE_LENGTH    8
+#define SIP_LOOP_MAX_WAIT_MS    5000  // Upper bound on select() timeout
+
+static QueueHandle_t sip_cmd_queue = NULL;
+static int sip_wake_socket = -1;
+static struct sockaddr_in sip_wake_addr;
+
+// SIP INVITE template removed - built inline in sip_do_make_call()
+
+// Log to the SIP log ring (web interface and, via its drain task, the console)
+static inline void sip_add_log_entry(sip_log_type_t type, const char* message)
+{
+    sip_log_write(type, message);
 }
 
 // Calculate MD5 hash and convert to hex string
@@ -200,32 +291,26 @@ static bool extract_quoted_value(const char* header, const char* key, char* dest
     return true;
 }
 
-// Helper to extract received IP from Via header
-static bool extract_received_ip(const char* via_header, char* dest, size_t dest_size) {
-    const char* received_start = strstr(via_header, "received=");
-    if (!received_start) {
-        return false;
-    }
-    received_start += 9; // Skip "received="
-    const char* received_end = strpbrk(received_start, ";\r\n ");
-    if (!received_end) {
-        return false;
-    }
-    size_t len = received_end - received_start;
-    if (len >= dest_size) {
-        len = dest_size - 1;
+// Helper to extract received IP from the top Via header
+static bool extract_received_ip(const sip_message_t* msg, char* dest, size_t dest_size) {
+    return sip_header_copy_param(sip_msg_header(msg, SIP_HDR_VIA), "received", dest, dest_size);
+}
+
+// Public port the server saw, from the top Via rport (0 if it did not fill it in)
+static uint16_t extract_rport(const sip_message_t* msg) {
+    char value[8];
+    if (!sip_header_copy_param(sip_msg_header(msg, SIP_HDR_VIA), "rport", value, sizeof(value))) {
+        return 0;
     }
-    strncpy(dest, received_start, len);
-    dest[len] = '\0';
-    return true;
+    return (uint16_t)strtoul(value, NULL, 10);
 }
 
 // Parse WWW-Authenticate header
-static sip_auth_challenge_t parse_www_authenticate(const char* buffer) {
+static sip_auth_challenge_t parse_www_authenticate(const sip_message_t* msg) {
     sip_auth_challenge_t challenge = {0};
     
-    const char* auth_header = strstr(buffer, "WWW-Authenticate:");
-    if (!auth_header) {
+    char auth_header[512];
+    if (!sip_msg_copy_header(msg, SIP_HDR_WWW_AUTHENTICATE, auth_header, sizeof(auth_header))) {
         return challenge;
     }
     
@@ -248,25 +333,32 @@ static sip_auth_challenge_t parse_www_authenticate(const char* buffer) {
         if (*algo_start == '"') {
             algo_start++;
         }
-        const char* algo_end = strpbrk(algo_start, "\",\r\n ");
-        if (algo_end) {
-            size_t algo_len = algo_end - algo_start;
-            if (algo_len < sizeof(challenge.algorithm)) {
-                strncpy(challenge.algorithm, algo_start, algo_len);
-                challenge.algorithm[algo_len] = '\0';
-            }
+        size_t algo_len = strcspn(algo_start, "\",\r\n ");
+        if (algo_len < sizeof(challenge.algorithm)) {
+            strncpy(challenge.algorithm, algo_start, algo_len);
+            challenge.algorithm[algo_len] = '\0';
         }
     } else {
         strcpy(challenge.algorithm, "MD5");
     }
     
+    // stale=true: the nonce expired, retry with the new one without counting a failure
+    const char* stale_start = strstr(auth_header, "stale=");
+    if (stale_start) {
+        stale_start += 6;
+        if (*stale_start == '"') {
+            stale_start++;
+        }
+        challenge.stale = (strncasecmp(stale_start, "true", 4) == 0);
+    }
+    
     challenge.valid = (strlen(challenge.realm) > 0 && strlen(challenge.nonce) > 0);
     
     if (challenge.valid) {
         char log_msg[256];
         snprintf(log_msg, sizeof(log_msg), "Auth challenge parsed: realm=%s, qop=%s, algorithm=%s", 
                  challenge.realm, challenge.qop, challenge.algorithm);
-        sip_add_log_entry("info", log_msg);
+        sip_add_log_entry(SIP_LOG_INFO, log_msg);
     }
     
     return challenge;
@@ -294,13 +386,13 @@ static void calculate_digest_response(
     static char response_input[512];
 
     // Simplified logging to avoid format-truncation warnings with long URIs
-    sip_add_log_entry("info", "Calculating digest response");
+    sip_add_log_entry(SIP_LOG_INFO, "Calculating digest response");
 
     // Calculate HA1 = MD5(username:realm:password)
     snprintf(ha1_input, sizeof(ha1_input), "%s:%s:%s", username, realm, password);
     calculate_md5_hex(ha1_input, ha1);
     // Log HA1 safely
-    sip_add_log_entry("info", "HA1 calculated");
+    sip_add_log_entry(SIP_LOG_INFO, "HA1 calculated");
 
     // Calculate HA2 = MD5(method:uri)
     // According to RFC 3261, for digest authentication:
@@ -309,7 +401,7 @@ static void calculate_digest_response(
     snprintf(ha2_input, sizeof(ha2_input), "%s:%s", method, uri);
     calculate_md5_hex(ha2_input, ha2);
     // Log HA2 safely
-    sip_add_log_entry("info", "HA2 calculated");
+    sip_add_log_entry(SIP_LOG_INFO, "HA2 calculated");
 
     // Calculate response
     if (qop && strlen(qop) > 0 && strcmp(qop, "auth") == 0) {
@@ -317,47 +409,114 @@ static void calculate_digest_response(
         snprintf(response_input, sizeof(response_input),
                  "%s:%s:%s:%s:%s:%s", ha1, nonce, nc, cnonce, qop, ha2);
         // Log response input safely
-        sip_add_log_entry("info", "Response input (with qop): calculated");
+        sip_add_log_entry(SIP_LOG_INFO, "Response input (with qop): calculated");
     } else {
         // Without qop: MD5(HA1:nonce:HA2)
         snprintf(response_input, sizeof(response_input),
                  "%s:%s:%s", ha1, nonce, ha2);
         // Log response input safely
-        sip_add_log_entry("info", "Response input (no qop): calculated");
+        sip_add_log_entry(SIP_LOG_INFO, "Response input (no qop): calculated");
     }
 
     calculate_md5_hex(response_input, response_out);
-    sip_add_log_entry("info", "Digest response calculated");
+    sip_add_log_entry(SIP_LOG_INFO, "Digest response calculated");
+}
+
+// Append the Authorization header for a digest challenge
+// No spaces after the commas - matches the format softphones send
+static void sip_write_authorization(sip_writer_t* w, const sip_auth_challenge_t* challenge,
+                                    const char* uri, const char* response,
+                                    const char* nc, const char* cnonce)
+{
+    sip_writer_append(w, "Authorization: Digest username=\"");
+    sip_writer_append(w, sip_config.username);
+    sip_writer_append(w, "\",realm=\"");
+    sip_writer_append(w, challenge->realm);
+    sip_writer_append(w, "\",nonce=\"");
+    sip_writer_append(w, challenge->nonce);
+    sip_writer_append(w, "\",uri=\"");
+    sip_writer_append(w, uri);
+    sip_writer_append(w, "\",response=\"");
+    sip_writer_append(w, response);
+    sip_writer_append(w, "\"");
+
+    if (strlen(challenge->qop) > 0) {
+        sip_writer_append(w, ",qop=");
+        sip_writer_append(w, challenge->qop);
+        sip_writer_append(w, ",nc=");
+        sip_writer_append(w, nc);
+        sip_writer_append(w, ",cnonce=\"");
+        sip_writer_append(w, cnonce);
+        sip_writer_append(w, "\"");
+    }
+    if (strlen(challenge->opaque) > 0) {
+        sip_writer_append(w, ",opaque=\"");
+        sip_writer_append(w, challenge->opaque);
+        sip_writer_append(w, "\"");
+    }
+    if (strlen(challenge->algorithm) > 0 && strcmp(challenge->algorithm, "MD5") != 0) {
+        sip_writer_append(w, ",algorithm=");
+        sip_writer_append(w, challenge->algorithm);
+    }
+    sip_writer_append(w, "\r\n");
 }
 
-// Helper function to resolve hostname to IP address using getaddrinfo
+// Helper function to resolve hostname to IP address
+// Goes through the resolver cache and never waits on DNS: stale entries are
+// served while they refresh in the background, and a name not resolved yet
+// fails this attempt (the retransmission or retry after it finds it cached)
 static bool resolve_hostname(const char* hostname, struct sockaddr_in* addr, uint16_t port)
 {
-    struct addrinfo hints;
-    struct addrinfo *result = NULL;
-    
-    memset(&hints, 0, sizeof(hints));
-    hints.ai_family = AF_INET;        // IPv4
-    hints.ai_socktype = SOCK_DGRAM;   // UDP
-    hints.ai_protocol = IPPROTO_UDP;
-    
-    int ret = getaddrinfo(hostname, NULL, &hints, &result);
-    if (ret != 0 || result == NULL) {
-        ESP_LOGE(TAG, "DNS lookup failed for %s: %d", hostname, ret);
-        if (result) {
-            freeaddrinfo(result);
-        }
+    if (!dns_cache_resolve(hostname, port, addr)) {
+        ESP_LOGE(TAG, "No address for %s (yet)", hostname);
         return false;
     }
-    
-    // Copy the resolved address
-    memcpy(addr, result->ai_addr, sizeof(struct sockaddr_in));
-    addr->sin_port = htons(port);
-    
-    freeaddrinfo(result);
     return true;
 }
 
+// Registrar in use: the server setting may list several ("host[:port]",
+// comma-separated, in order of preference), see sip_registrar.c
+static const char* sip_server(void)
+{
+    const sip_registrar_t* r = sip_registrar_get(sip_registrar_active());
+    return r ? r->host : sip_config.server;
+}
+
+// Registrar port: from the list entry, else as configured, but 5061 for TLS
+// when left at the SIP default
+static uint16_t sip_server_port(void)
+{
+    const sip_registrar_t* r = sip_registrar_get(sip_registrar_active());
+    if (r && r->port != 0) {
+        return r->port;
+    }
+    if (sip_config.transport == SIP_TRANSPORT_TLS && sip_config.port == 5060) {
+        return SIP_TLS_DEFAULT_PORT;
+    }
+    return (uint16_t)sip_config.port;
+}
+
+// SRV service for the configured transport (RFC 3263 §4.1)
+static const char* sip_srv_service(void)
+{
+    switch (sip_config.transport) {
+        case SIP_TRANSPORT_TCP: return "_sip._tcp";
+        case SIP_TRANSPORT_TLS: return "_sips._tcp";
+        default:                return "_sip._udp";
+    }
+}
+
+// Take the registrar list from the configuration and warm the resolver for
+// all of them, so a failover does not wait on DNS
+static void sip_load_registrars(void)
+{
+    dns_cache_set_srv_service(sip_config.dns_srv ? sip_srv_service() : NULL);
+    sip_registrar_set_list(sip_config.server);
+    for (int i = 0; i < sip_registrar_count(); i++) {
+        dns_cache_prefetch(sip_registrar_get(i)->host);
+    }
+}
+
 // Helper function to get local IP address
 static bool get_local_ip(char* ip_str, size_t max_len)
 {
@@ -376,6 +535,187 @@ static bool get_local_ip(char* ip_str, size_t max_len)
     ESP_LOGW(TAG, "Failed to get IP address");
     return false;
 }
+
+// Local IP with the usual fallback
+static void get_local_ip_or_default(char* ip_str, size_t max_len)
+{
+    if (!get_local_ip(ip_str, max_len)) {
+        snprintf(ip_str, max_len, "192.168.1.100");
+    }
+}
+
+// Call-ID, tag and branch numbers (hardware RNG, kept positive for the %d logs)
+static uint32_t sip_new_id(void)
+{
+    return esp_random() & 0x7FFFFFFF;
+}
+
+// Same, but always SIP_PREARM_ID_DIGITS decimal digits so it can be
+// rewritten in place in a pre-armed INVITE
+static uint32_t sip_new_fixed_id(void)
+{
+    return 1000000000u + esp_random() % 3000000000u;
+}
+
+// Write a sip_new_fixed_id() value over the digits at dst (no terminator)
+static void sip_put_fixed_id(char* dst, uint32_t id)
+{
+    for (int i = SIP_PREARM_ID_DIGITS - 1; i >= 0; i--) {
+        dst[i] = (char)('0' + id % 10);
+        id /= 10;
+    }
+}
+
+// Forget every outgoing call leg (their transactions are gone)
+static void sip_fork_reset(void)
+{
+    memset(call_legs, 0, sizeof(call_legs));
+    sip_dialog_table_clear(&leg_table);
+}
+
+// Forget every session; the peers notice the missing media or time out
+static void sip_session_reset(void)
+{
+    memset(sessions, 0, sizeof(sessions));
+    sip_dialog_table_clear(&session_table);
+    call_session = NULL;
+}
+
+// Close the SIP transport; pending transactions, call legs and sessions die with it
+static void sip_close_socket(void)
+{
+    sip_transport_close();
+    sip_keepalive_stop();
+    reconnect_pending = false;
+    reconnect_timestamp = 0;
+    sip_txn_reset();
+    sip_fork_reset();
+    sip_session_reset();
+}
+
+// Open the configured transport (UDP is bound to port 5060, TCP and TLS
+// connect on first use) with the transaction timers to match
+static bool sip_open_socket(void)
+{
+    if (!sip_transport_open(sip_config.transport)) {
+        sip_add_log_entry(SIP_LOG_ERROR, "Failed to open SIP transport");
+        return false;
+    }
+    sip_txn_set_reliable(sip_transport_reliable());
+
+    char log_msg[64];
+    snprintf(log_msg, sizeof(log_msg), "SIP transport %s opened", sip_transport_name());
+    sip_add_log_entry(SIP_LOG_INFO, log_msg);
+    return true;
+}
+
+// Bring up the TCP/TLS connection before addresses are formatted: Via and
+// Contact carry its local port (no-op for UDP)
+static bool sip_connect_transport(void)
+{
+    struct sockaddr_in server_addr;
+    if (!resolve_hostname(sip_server(), &server_addr, sip_server_port())) {
+        return false;
+    }
+    return sip_transport_connect(sip_server(), &server_addr);
+}
+
+// The TCP/TLS connection broke (peer closed it or a send failed). Handled
+// from the task loop by sip_reconnect(), never from inside a send.
+static void sip_connection_lost(void)
+{
+    if (reconnect_pending) {
+        return;
+    }
+    reconnect_pending = true;
+    if (reconnect_timestamp == 0) {
+        reconnect_timestamp = xTaskGetTickCount() * portTICK_PERIOD_MS;
+    }
+
+    char log_msg[64];
+    snprintf(log_msg, sizeof(log_msg), "SIP %s connection lost", sip_transport_name());
+    sip_add_log_entry(SIP_LOG_WARNING, log_msg);
+}
+
+// The active registrar did not answer. Returns true if another one was
+// chosen to register with right away instead of retrying this one.
+static bool sip_fail_over(void)
+{
+    if (sip_registrar_count() < 2) {
+        return false;
+    }
+    const char* failed = sip_server();
+    char log_msg[160];
+    snprintf(log_msg, sizeof(log_msg), "Registrar %s not answering", failed);
+
+    int previous = sip_registrar_active();
+    if (sip_registrar_on_failure(previous, xTaskGetTickCount() * portTICK_PERIOD_MS) == previous) {
+        sip_add_log_entry(SIP_LOG_WARNING, log_msg);
+        return false;
+    }
+    snprintf(log_msg + strlen(log_msg), sizeof(log_msg) - strlen(log_msg), " - failing over to %s", sip_server());
+    sip_add_log_entry(SIP_LOG_WARNING, log_msg);
+    return true;
+}
+
+// Keep-alive answers double as round-trip samples of the active registrar
+static void sip_registrar_sample(uint32_t answered_before)
+{
+    sip_keepalive_stats_t keepalive;
+    sip_keepalive_get_stats(&keepalive);
+    if (keepalive.probes_answered != answered_before) {
+        sip_registrar_on_answer(sip_registrar_active(), keepalive.last_rtt_ms);
+    }
+}
+
+static uint32_t sip_keepalive_answered(void)
+{
+    sip_keepalive_stats_t keepalive;
+    sip_keepalive_get_stats(&keepalive);
+    return keepalive.probes_answered;
+}
+
+// Transport for the transaction layer: send to the SIP server
+static int sip_transmit(const char* data, size_t len)
+{
+    if (!sip_transport_is_open()) {
+        return -1;
+    }
+
+    struct sockaddr_in server_addr;
+    if (!resolve_hostname(sip_server(), &server_addr, sip_server_port())) {
+        return -1;
+    }
+
+    int sent = sip_transport_send(sip_server(), &server_addr, data, len);
+    if (sent < 0) {
+        ESP_LOGE(TAG, "Error sending SIP message: %d", sent);
+        if (sip_transport_reliable()) {
+            sip_connection_lost();
+        }
+    }
+    return sent;
+}
+
+// Finish a message built with sip_writer and send it through the transaction layer
+// Returns bytes sent, or -1 on overflow, DNS or socket failure
+static int sip_send_message(sip_writer_t* w, const char* what)
+{
+    int len = sip_writer_finish(w);
+    if (len < 0) {
+        char err_msg[96];
+        snprintf(err_msg, sizeof(err_msg), "%s too large for transmit buffer", what);
+        sip_add_log_entry(SIP_LOG_ERROR, err_msg);
+        return -1;
+    }
+
+    int sent = sip_txn_send(w->buf, len, xTaskGetTickCount() * portTICK_PERIOD_MS);
+    if (sent < 0) {
+        ESP_LOGE(TAG, "Error sending %s: %d", what, sent);
+    }
+    return sent;
+}
+
 // SIP request headers structure for parsing
 typedef struct {
     char call_id[128];
@@ -388,109 +728,32 @@ typedef struct {
     bool valid;
 } sip_request_headers_t;
 
-// Extract common SIP headers from a request message
-// This helper function reduces code duplication across request handlers
-static sip_request_headers_t extract_request_headers(const char* buffer) {
+// Copy the headers needed to answer or ACK a message out of the parsed index
+static sip_request_headers_t extract_request_headers(const sip_message_t* msg) {
     sip_request_headers_t headers = {0};
     
-    if (!buffer) {
+    if (!msg) {
         return headers;
     }
     
-    // Extract Call-ID
-    const char* cid_ptr = strstr(buffer, "Call-ID:");
-    if (cid_ptr) {
-        cid_ptr += 8;  // Skip "Call-ID:"
-        while (*cid_ptr == ' ') cid_ptr++;  // Skip whitespace
-        const char* cid_term = strstr(cid_ptr, "\r\n");
-        if (cid_term && cid_ptr) {
-            size_t len = cid_term - cid_ptr;
-            if (len > 0 && len < sizeof(headers.call_id)) {
-                strncpy(headers.call_id, cid_ptr, len);
-                headers.call_id[len] = '\0';
-            }
-        }
-    }
-    
-    // Extract Via (first Via header only)
-    const char* via_ptr = strstr(buffer, "Via:");
-    if (via_ptr) {
-        via_ptr += 4;  // Skip "Via:"
-        while (*via_ptr == ' ') via_ptr++;  // Skip whitespace
-        const char* via_term = strstr(via_ptr, "\r\n");
-        if (via_term && via_ptr) {
-            size_t len = via_term - via_ptr;
-            if (len > 0 && len < sizeof(headers.via_header)) {
-                strncpy(headers.via_header, via_ptr, len);
-                headers.via_header[len] = '\0';
-            }
-        }
-    }
-    
-    // Extract From
-    const char* from_ptr = strstr(buffer, "From:");
-    if (from_ptr) {
-        from_ptr += 5;  // Skip "From:"
-        while (*from_ptr == ' ') from_ptr++;  // Skip whitespace
-        const char* from_term = strstr(from_ptr, "\r\n");
-        if (from_term && from_ptr) {
-            size_t len = from_term - from_ptr;
-            if (len > 0 && len < sizeof(headers.from_header)) {
-                strncpy(headers.from_header, from_ptr, len);
-                headers.from_header[len] = '\0';
-            }
-        }
-    }
-    
-    // Extract To
-    const char* to_ptr = strstr(buffer, "To:");
-    if (to_ptr) {
-        to_ptr += 3;  // Skip "To:"
-        while (*to_ptr == ' ') to_ptr++;  // Skip whitespace
-        const char* to_term = strstr(to_ptr, "\r\n");
-        if (to_term && to_ptr) {
-            size_t len = to_term - to_ptr;
-            if (len > 0 && len < sizeof(headers.to_header)) {
-                strncpy(headers.to_header, to_ptr, len);
-                headers.to_header[len] = '\0';
-            }
-        }
-    }
-    
-    // Extract Contact (optional)
-    const char* contact_ptr = strstr(buffer, "Contact:");
-    if (contact_ptr) {
-        contact_ptr += 8;  // Skip "Contact:"
-        while (*contact_ptr == ' ') contact_ptr++;  // Skip whitespace
-        const char* contact_term = strstr(contact_ptr, "\r\n");
-        if (contact_term && contact_ptr) {
-            size_t len = contact_term - contact_ptr;
-            if (len > 0 && len < sizeof(headers.contact)) {
-                strncpy(headers.contact, contact_ptr, len);
-                headers.contact[len] = '\0';
-            }
-        }
-    }
+    sip_msg_copy_header(msg, SIP_HDR_CALL_ID, headers.call_id, sizeof(headers.call_id));
+    sip_msg_copy_header(msg, SIP_HDR_VIA, headers.via_header, sizeof(headers.via_header));  // Top Via only
+    sip_msg_copy_header(msg, SIP_HDR_FROM, headers.from_header, sizeof(headers.from_header));
+    sip_msg_copy_header(msg, SIP_HDR_TO, headers.to_header, sizeof(headers.to_header));
+    sip_msg_copy_header(msg, SIP_HDR_CONTACT, headers.contact, sizeof(headers.contact));
     
-    // Extract CSeq number and method
-    const char* cseq_ptr = strstr(buffer, "CSeq:");
-    if (cseq_ptr) {
-        cseq_ptr += 5;  // Skip "CSeq:"
-        while (*cseq_ptr == ' ') cseq_ptr++;  // Skip whitespace
-        headers.cseq_num = atoi(cseq_ptr);
-        
-        // Extract method from CSeq line
-        const char* method_ptr = cseq_ptr;
-        while (*method_ptr && *method_ptr != ' ') method_ptr++;  // Skip number
-        if (*method_ptr == ' ') {
-            method_ptr++;  // Skip space
-            const char* method_end = strstr(method_ptr, "\r\n");
-            if (method_end && method_ptr) {
-                size_t len = method_end - method_ptr;
-                if (len > 0 && len < sizeof(headers.cseq_method)) {
-                    strncpy(headers.cseq_method, method_ptr, len);
-                    headers.cseq_method[len] = '\0';
-                }
+    // CSeq number was parsed with the message; keep the method token as received
+    headers.cseq_num = msg->cseq_num;
+    const sip_header_t* cseq = sip_msg_header(msg, SIP_HDR_CSEQ);
+    if (cseq) {
+        const char* method = memchr(cseq->value, ' ', cseq->value_len);
+        if (method) {
+            const char* end = cseq->value + cseq->value_len;
+            while (method < end && *method == ' ') method++;
+            size_t len = end - method;
+            if (len > 0 && len < sizeof(headers.cseq_method)) {
+                memcpy(headers.cseq_method, method, len);
+                headers.cseq_method[len] = '\0';
             }
         }
     }
@@ -517,78 +780,41 @@ static void send_sip_response(int code, const char* reason,
         return;
     }
     
-    if (sip_socket < 0) {
+    if (!sip_transport_is_open()) {
         ESP_LOGW(TAG, "Cannot send response: socket not available");
         return;
     }
     
-    // Allocate response buffer on stack (static to avoid stack overflow)
-    static char response[2048];
-    int len = 0;
-    
-    // Status line
-    len += snprintf(response + len, sizeof(response) - len,
-                   "SIP/2.0 %d %s\r\n", code, reason);
+    sip_writer_t w;
+    sip_writer_init(&w, sip_tx_buffer, sizeof(sip_tx_buffer));
+    sip_writer_status_line(&w, code, reason);
     
-    // Mandatory headers (Via, From, To, Call-ID, CSeq)
-    len += snprintf(response + len, sizeof(response) - len,
-                   "Via: %s\r\n"
-                   "From: %s\r\n"
-                   "To: %s\r\n"
-                   "Call-ID: %s\r\n"
-                   "CSeq: %d %s\r\n",
-                   req_headers->via_header,
-                   req_headers->from_header,
-                   req_headers->to_header,
-                   req_headers->call_id,
-                   req_headers->cseq_num,
-                   req_headers->cseq_method);
+    // Mandatory headers (Via, From, To, Call-ID, CSeq) echoed from the request
+    sip_writer_header(&w, "Via", req_headers->via_header);
+    sip_writer_header(&w, "From", req_headers->from_header);
+    sip_writer_header(&w, "To", req_headers->to_header);
+    sip_writer_header(&w, "Call-ID", req_headers->call_id);
+    sip_writer_cseq(&w, (uint32_t)req_headers->cseq_num, req_headers->cseq_method);
     
-    // Extra headers (if provided)
-    if (extra_headers && strlen(extra_headers) > 0) {
-        len += snprintf(response + len, sizeof(response) - len,
-                       "%s", extra_headers);
+    if (extra_headers) {
+        sip_writer_append(&w, extra_headers);
     }
+    sip_writer_header(&w, "User-Agent", SIP_USER_AGENT);
     
-    // User-Agent header
-    len += snprintf(response + len, sizeof(response) - len,
-                   "User-Agent: ESP32-Doorbell/1.0\r\n");
-    
-    // Content (if body provided)
-    if (body && strlen(body) > 0) {
-        len += snprintf(response + len, sizeof(response) - len,
-                       "Content-Length: %d\r\n\r\n%s",
-                       strlen(body), body);
-    } else {
-        len += snprintf(response + len, sizeof(response) - len,
-                       "Content-Length: 0\r\n\r\n");
-    }
-    
-    // Check for buffer overflow
-    if (len >= sizeof(response)) {
-        ESP_LOGE(TAG, "Response buffer overflow (%d bytes)", len);
-        sip_add_log_entry("error", "Response too large - buffer overflow");
-        return;
+    if (body && body[0] != '\0') {
+        sip_writer_begin_body(&w, NULL);
+        sip_writer_append(&w, body);
     }
     
-    // Send response
-    struct sockaddr_in server_addr;
-    if (resolve_hostname(sip_config.server, &server_addr, (uint16_t)sip_config.port)) {
-        int sent = sendto(sip_socket, response, len, 0,
-                         (struct sockaddr*)&server_addr, sizeof(server_addr));
-        
-        if (sent > 0) {
-            char log_msg[128];
-            snprintf(log_msg, sizeof(log_msg), "%d %s sent (%d bytes)", code, reason, sent);
-            sip_add_log_entry("sent", log_msg);
-        } else {
-            char err_msg[128];
-            snprintf(err_msg, sizeof(err_msg), "Failed to send %d %s: error %d", code, reason, sent);
-            sip_add_log_entry("error", err_msg);
-        }
+    int sent = sip_send_message(&w, "response");
+    if (sent > 0) {
+        char log_msg[128];
+        snprintf(log_msg, sizeof(log_msg), "%d %s sent (%d bytes)", code, reason, sent);
+        sip_add_log_entry(SIP_LOG_SENT, log_msg);
     } else {
-        ESP_LOGE(TAG, "DNS lookup failed when sending response");
-        sip_add_log_entry("error", "DNS lookup failed for response");
+        char err_msg[128];
+        snprintf(err_msg, sizeof(err_msg), "Failed to send %d %s", code, reason);
+        sip_add_log_entry(SIP_LOG_ERROR, err_msg);
     }
 }
 
@@ -597,189 +823,2359 @@ static void send_sip_response(int code, const char* reason,
 // UAC must send ACK for ALL final responses to INVITE, including errors
 // This stops the server from retransmitting the error response
 // CRITICAL: ACK must use same Call-ID, From tag, and CSeq as the INVITE
-static void send_ack_for_error_response(const char* response_buffer) {
-    if (!response_buffer) {
-        sip_add_log_entry("error", "Cannot send ACK: no response buffer");
+static void send_ack_for_error_response(const sip_message_t* response) {
+    if (!response) {
+        sip_add_log_entry(SIP_LOG_ERROR, "Cannot send ACK: no response");
         return;
     }
     
     // Extract headers from the error response using helper function
-    sip_request_headers_t headers = extract_request_headers(response_buffer);
+    sip_request_headers_t headers = extract_request_headers(response);
     if (!headers.valid) {
-        sip_add_log_entry("error", "Cannot send ACK: failed to extract headers from error response");
+        sip_add_log_entry(SIP_LOG_ERROR, "Cannot send ACK: failed to extract headers from error response");
         return;
     }
     
-    // Extract To tag from the response (if present)
-    char to_tag[32] = {0};
-    const char* to_hdr = strstr(response_buffer, "To:");
-    if (to_hdr) {
-        const char* tag_ptr = strstr(to_hdr, "tag=");
-        if (tag_ptr) {
-            tag_ptr += 4;
-            const char* tag_term = strpbrk(tag_ptr, ";\r\n ");
-            if (tag_term) {
-                size_t tag_length = tag_term - tag_ptr;
-                if (tag_length < sizeof(to_tag)) {
-                    strncpy(to_tag, tag_ptr, tag_length);
-                    to_tag[tag_length] = '\0';
-                }
-            }
-        }
-    }
-    
-    // Build ACK using extracted transaction identifiers
-    // RFC 3261: ACK for non-2xx response to INVITE uses the same top Via header as the INVITE.
-    // The server echoes this header in the response, so we can reuse it directly.
-    static char ack_msg[1024];
-    
-    // Extract Request-URI from To header
+    // RFC 3261: ACK for non-2xx response to INVITE uses the same top Via header as the INVITE
+    // and the To header (with tag) of the response. The server echoes both, so reuse them directly.
+    // The Request-URI is that of the INVITE, i.e. the URI in the To header.
     char request_uri[128] = {0};
-    const char* uri_start = strstr(headers.to_header, "<sip:");
-    if (uri_start) {
-        uri_start += 1;  // Skip '<'
-        const char* uri_end = strchr(uri_start, '>');
-        if (uri_end) {
-            size_t uri_len = uri_end - uri_start;
-            if (uri_len < sizeof(request_uri)) {
-                strncpy(request_uri, uri_start, uri_len);
-                request_uri[uri_len] = '\0';
-            }
-        }
-    }
-    
-    if (strlen(request_uri) == 0) {
+    if (!sip_header_copy_uri(sip_msg_header(response, SIP_HDR_TO), request_uri, sizeof(request_uri))) {
         // Fallback: construct from username and server
         snprintf(request_uri, sizeof(request_uri), "sip:%s@%s",
-                 sip_config.username, sip_config.server);
+                 sip_config.username, sip_server());
     }
     
-    // Build the To header with tag if present
-    char to_header_with_tag[300];
-    if (strlen(to_tag) > 0) {
-        // To header already has tag - use as-is
-        snprintf(to_header_with_tag, sizeof(to_header_with_tag), "%s", headers.to_header);
+    sip_writer_t w;
+    sip_writer_init(&w, sip_tx_buffer, sizeof(sip_tx_buffer));
+    sip_writer_request_line(&w, "ACK", request_uri);
+    sip_writer_header(&w, "Via", headers.via_header);
+    sip_writer_append(&w, "Max-Forwards: 70\r\n");
+    sip_writer_header(&w, "From", headers.from_header);
+    sip_writer_header(&w, "To", headers.to_header);
+    sip_writer_header(&w, "Call-ID", headers.call_id);
+    sip_writer_cseq(&w, (uint32_t)headers.cseq_num, "ACK");  // Same CSeq number as INVITE, but method is ACK
+    sip_writer_header(&w, "User-Agent", SIP_USER_AGENT);
+    
+    if (sip_send_message(&w, "ACK") > 0) {
+        char log_msg[256];
+        snprintf(log_msg, sizeof(log_msg),
+                 "ACK sent for Call-ID=%s (CSeq=%d)",
+                 headers.call_id, headers.cseq_num);
+        sip_add_log_entry(SIP_LOG_SENT, log_msg);
     } else {
-        // No tag in response - use without tag
-        snprintf(to_header_with_tag, sizeof(to_header_with_tag), "%s", headers.to_header);
+        sip_add_log_entry(SIP_LOG_ERROR, "Failed to send ACK for error response");
     }
-    
-    snprintf(ack_msg, sizeof(ack_msg),
-            "ACK %s SIP/2.0\r\n"
-            "Via: %s\r\n"
-            "Max-Forwards: 70\r\n"
-            "From: %s\r\n"
-            "To: %s\r\n"
-            "Call-ID: %s\r\n"
-            "CSeq: %d ACK\r\n"
-            "User-Agent: ESP32-Doorbell/1.0\r\n"
-            "Content-Length: 0\r\n\r\n",
-            request_uri,
-            headers.via_header,
-            headers.from_header,
-            to_header_with_tag,
-            headers.call_id,
-            headers.cseq_num);  // Same CSeq number as INVITE, but method is ACK
-    
-    struct sockaddr_in server_addr;
-    if (resolve_hostname(sip_config.server, &server_addr, (uint16_t)sip_config.port)) {
-        int sent = sendto(sip_socket, ack_msg, strlen(ack_msg), 0,
-                         (struct sockaddr*)&server_addr, sizeof(server_addr));
-        
-        if (sent > 0) {
-            char log_msg[256];
-            snprintf(log_msg, sizeof(log_msg),
-                     "ACK sent for Call-ID=%s (CSeq=%d)",
-                     headers.call_id, headers.cseq_num);
-            sip_add_log_entry("sent", log_msg);
-        } else {
-            sip_add_log_entry("error", "Failed to send ACK for error response");
+}
+
+// Milliseconds until the earliest pending signalling deadline
+static uint32_t sip_next_deadline_ms(void)
+{
+    uint32_t now = xTaskGetTickCount() * portTICK_PERIOD_MS;
+    uint32_t wait = SIP_LOOP_MAX_WAIT_MS;
+
+    if (registration_requested || reinit_requested) {
+        return 0;
+    }
+
+#define SIP_DEADLINE(start, period) do { \
+        uint32_t elapsed = now - (start); \
+        uint32_t remaining = (elapsed >= (period)) ? 0 : (period) - elapsed; \
+        if (remaining < wait) wait = remaining; \
+    } while (0)
+
+    if ((current_state == SIP_STATE_CALLING || current_state == SIP_STATE_RINGING) &&
+        call_start_timestamp > 0) {
+        SIP_DEADLINE(call_start_timestamp, call_timeout_ms);
+    }
+    uint32_t last_rtp_received_ms = media_engine_get_last_rx_ms();
+    if (current_state == SIP_STATE_CONNECTED && last_rtp_received_ms > 0) {
+        SIP_DEADLINE(last_rtp_received_ms, rtp_timeout_ms);
+    }
+    if (reg_refresh_ms > 0 && sip_is_registered()) {
+        SIP_DEADLINE(reg_granted_timestamp, reg_refresh_ms);
+    }
+    uint32_t txn_wait = sip_txn_next_timer_ms(now);
+    if (txn_wait < wait) {
+        wait = txn_wait;
+    }
+    if (sip_is_registered() && sip_transport_is_connected()) {
+        uint32_t keepalive_wait = sip_keepalive_next_ms(now);
+        if (keepalive_wait < wait) {
+            wait = keepalive_wait;
         }
     }
+    if (sip_transport_is_open() && !sip_transport_reliable()) {
+        uint32_t probe_wait = sip_registrar_next_ms(now);
+        if (probe_wait < wait) {
+            wait = probe_wait;
+        }
+    }
+    if (reg_sent_timestamp > 0 && sip_registrar_count() > 1) {
+        SIP_DEADLINE(reg_sent_timestamp, SIP_REGISTER_FAILOVER_MS);
+    }
+    if (last_connection_retry_timestamp > 0) {
+        SIP_DEADLINE(last_connection_retry_timestamp, connection_retry_delay_ms);
+    }
+    if (init_timestamp > 0 && current_state == SIP_STATE_IDLE && sip_config.configured) {
+        SIP_DEADLINE(init_timestamp, auto_register_delay_ms);
+    }
+
+#undef SIP_DEADLINE
+
+    return wait;
 }
 
-// SIP task runs on Core 1 (APP CPU) to avoid interfering with WiFi on Core 0
-static void sip_task(void *pvParameters __attribute__((unused)))
+// Block in select() on the SIP socket and the wake socket for at most timeout_ms
+static void sip_wait_for_event(uint32_t timeout_ms)
 {
-    // Allocate buffer on heap instead of static to avoid memory issues
-    const size_t buffer_size = 1536;  // Reduced from 2048 to 1536 bytes
-    char *buffer = malloc(buffer_size);
-    if (!buffer) {
-        ESP_LOGE(TAG, "Failed to allocate SIP receive buffer");
-        vTaskDelete(NULL);
+    fd_set read_fds;
+    FD_ZERO(&read_fds);
+    int max_fd = -1;
+
+    int sip_fd = sip_transport_fd();
+    if (sip_fd >= 0) {
+        FD_SET(sip_fd, &read_fds);
+        max_fd = sip_fd;
+    }
+    if (sip_wake_socket >= 0) {
+        FD_SET(sip_wake_socket, &read_fds);
+        if (sip_wake_socket > max_fd) {
+            max_fd = sip_wake_socket;
+        }
+    }
+
+    if (max_fd < 0) {
+        vTaskDelay(pdMS_TO_TICKS(timeout_ms));
         return;
     }
-    int len;
 
-    // Declare local_ip at the top for scope
-    char local_ip[16];
-    
-    sip_add_log_entry("info", "SIP task started on Core 1");
-    
-    while (1) {
-        // Longer delay to minimize CPU usage - SIP doesn't need fast polling
-        // 1000ms (1 second) reduces system load significantly
-        vTaskDelay(pdMS_TO_TICKS(1000));
-        
-        // Yield to WiFi and other high-priority tasks
-        taskYIELD();
-        
-        // Handle reinitialization request (from web interface)
-        if (reinit_requested) {
-            reinit_requested = false;
-            sip_add_log_entry("info", "Processing reinitialization request");
-            
-            // Close socket if open
-            if (sip_socket >= 0) {
-                close(sip_socket);
-                sip_socket = -1;
-                sip_add_log_entry("info", "SIP socket closed for reinit");
-            }
-            
-            // Stop RTP if active
-            if (rtp_is_active()) {
-                rtp_stop_session();
-                sip_add_log_entry("info", "RTP session stopped for reinit");
+    struct timeval tv = {
+        .tv_sec = timeout_ms / 1000,
+        .tv_usec = (timeout_ms % 1000) * 1000,
+    };
+    int ready = select(max_fd + 1, &read_fds, NULL, NULL, &tv);
+    if (ready < 0) {
+        // Socket closed under us (reinit/disconnect) - avoid spinning
+        vTaskDelay(pdMS_TO_TICKS(10));
+        return;
+    }
+
+    if (ready > 0 && sip_wake_socket >= 0 && FD_ISSET(sip_wake_socket, &read_fds)) {
+        char drain[16];
+        while (recv(sip_wake_socket, drain, sizeof(drain), MSG_DONTWAIT) > 0) {
+        }
+    }
+}
+
+// Queue a command for the SIP task and wake it
+static bool sip_post_command(sip_cmd_type_t type, const char* arg)
+{
+    if (!sip_cmd_queue || !sip_task_handle) {
+        return false;
+    }
+
+    sip_cmd_t cmd = { .type = type };
+    if (arg) {
+        strncpy(cmd.arg, arg, sizeof(cmd.arg) - 1);
+    }
+
+    if (xQueueSend(sip_cmd_queue, &cmd, 0) != pdTRUE) {
+        sip_add_log_entry(SIP_LOG_ERROR, "SIP command queue full - command dropped");
+        return false;
+    }
+
+    if (sip_wake_socket >= 0) {
+        sendto(sip_wake_socket, "w", 1, 0, (struct sockaddr*)&sip_wake_addr, sizeof(sip_wake_addr));
+    }
+    return true;
+}
+
+// True when running on the SIP task (commands can execute inline)
+static bool sip_in_task_context(void)
+{
+    return sip_task_handle == NULL || xTaskGetCurrentTaskHandle() == sip_task_handle;
+}
+
+static void sip_process_commands(void)
+{
+    sip_cmd_t cmd;
+    while (sip_cmd_queue && xQueueReceive(sip_cmd_queue, &cmd, 0) == pdTRUE) {
+        switch (cmd.type) {
+            case SIP_CMD_REGISTER:
+                registration_requested = true;
+                break;
+            case SIP_CMD_REINIT:
+                reinit_requested = true;
+                break;
+            case SIP_CMD_CALL:
+                sip_do_make_call(cmd.arg);
+                break;
+            case SIP_CMD_HANGUP:
+                sip_do_hangup();
+                break;
+            case SIP_CMD_DTMF:
+                sip_do_send_dtmf(cmd.arg[0]);
+                break;
+            case SIP_CMD_DISCONNECT:
+                sip_do_disconnect();
+                break;
+        }
+    }
+}
+
+// Loopback UDP socket used only to interrupt select() when a command is posted
+static bool sip_create_wake_socket(void)
+{
+    sip_wake_socket = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (sip_wake_socket < 0) {
+        return false;
+    }
+
+    memset(&sip_wake_addr, 0, sizeof(sip_wake_addr));
+    sip_wake_addr.sin_family = AF_INET;
+    sip_wake_addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    sip_wake_addr.sin_port = 0;
+
+    socklen_t addr_len = sizeof(sip_wake_addr);
+    if (bind(sip_wake_socket, (struct sockaddr*)&sip_wake_addr, sizeof(sip_wake_addr)) < 0 ||
+        getsockname(sip_wake_socket, (struct sockaddr*)&sip_wake_addr, &addr_len) < 0) {
+        close(sip_wake_socket);
+        sip_wake_socket = -1;
+        return false;
+    }
+    return true;
+}
+
+// Local SDP parameters for a new call; the session id is fresh per call
+static sdp_local_t sip_sdp_local(const char* ip, const char* session_name)
+{
+    sdp_local_t local = {
+        .address = ip,
+        .port = SIP_RTP_PORT,
+        .session_id = sip_new_id(),
+        .session_version = 0,
+        .session_name = session_name,
+        .direction = SDP_DIR_SENDRECV,
+    };
+    return local;
+}
+
+// Turn a configured target into a request URI: add "sip:" and, for a bare
+// extension, "@server"
+static void sip_format_target_uri(const char* target, char* uri, size_t size)
+{
+    if (strncmp(target, "sip:", 4) == 0) {
+        snprintf(uri, size, "%s", target);
+    } else if (strchr(target, '@') != NULL) {
+        snprintf(uri, size, "sip:%s", target);
+    } else {
+        snprintf(uri, size, "sip:%s@%s", target, sip_server());
+    }
+}
+
+// Everything after the Authorization header of an INVITE: Allow, User-Agent
+// and our SDP offer
+static void sip_write_invite_offer(sip_writer_t* w, const char* contact_ip, uint32_t session_id)
+{
+    sip_writer_append(w,
+                      "Allow: " SIP_ALLOW_METHODS "\r\n"
+                      "User-Agent: " SIP_USER_AGENT "\r\n");
+    sip_writer_begin_body(w, "application/sdp");
+    sdp_local_t local = sip_sdp_local(contact_ip, "ESP32 Doorbell Call");
+    local.session_id = session_id;
+    sdp_write_offer(w, &local);
+}
+
+// Offset of the digits of id after prefix in text, 0 if not found
+static uint16_t sip_prearm_find_id(const char* text, const char* prefix, uint32_t id)
+{
+    char needle[48];
+    int len = snprintf(needle, sizeof(needle), "%s%lu", prefix, (unsigned long)id);
+    const char* found = strstr(text, needle);
+    return found ? (uint16_t)(found - text + len - SIP_PREARM_ID_DIGITS) : 0;
+}
+
+// Offset of the value after key in the Authorization header, 0 if not found
+static uint16_t sip_prearm_find_auth(const char* text, const char* key)
+{
+    const char* auth = strstr(text, "\r\nAuthorization: ");
+    const char* found = auth ? strstr(auth, key) : NULL;
+    return found ? (uint16_t)(found - text + strlen(key)) : 0;
+}
+
+// Build the INVITE template for one target (SIP task, while idle)
+static void sip_prearm_build(sip_prearm_t* p, const char* uri)
+{
+    memset(p, 0, sizeof(*p));
+    snprintf(p->uri, sizeof(p->uri), "%s", uri);
+    p->generation = prearm_generation;
+
+    char local_ip[16];
+    get_local_ip_or_default(local_ip, sizeof(local_ip));
+    const char* contact_ip = (strlen(public_ip) > 0) ? public_ip : local_ip;
+
+    uint32_t branch = sip_new_fixed_id();
+    uint32_t tag = sip_new_fixed_id();
+    uint32_t call_number = sip_new_fixed_id();
+    uint32_t session_id = sip_new_fixed_id();
+
+    char call_id[64];
+    snprintf(call_id, sizeof(call_id), "%lu@%s", (unsigned long)call_number, local_ip);
+    sip_dialog_init(&p->dialog, sip_config.username, sip_server(), local_ip, contact_ip,
+                    sip_transport_name(), sip_transport_local_port(), uri, call_id, tag);
+
+    // Prefer the nonce of the last INVITE challenge; the registrar's nonce
+    // is accepted for INVITEs by most servers and a 401 falls back anyway
+    const sip_auth_challenge_t* challenge = NULL;
+    if (prearm_challenge.valid) {
+        challenge = &prearm_challenge;
+    } else if (last_auth_challenge.valid) {
+        challenge = &last_auth_challenge;
+        p->register_nonce = true;
+    }
+
+    sip_writer_t w;
+    sip_writer_init(&w, p->invite, sizeof(p->invite));
+    sip_writer_dialog_request(&w, &p->dialog, "INVITE", p->dialog.cseq, branch);
+    if (challenge) {
+        sip_write_authorization(&w, challenge, p->dialog.request_uri,
+                                "00000000000000000000000000000000", "00000000", "0000000000000000");
+    }
+    sip_write_invite_offer(&w, contact_ip, session_id);
+    int len = sip_writer_finish(&w);
+    if (len < 0) {
+        sip_add_log_entry(SIP_LOG_WARNING, "Pre-armed INVITE too large - calls use the normal path");
+        return;
+    }
+
+    p->len = len;
+    p->branch_pos = sip_prearm_find_id(p->invite, "branch=z9hG4bK", branch);
+    p->tag_pos = sip_prearm_find_id(p->invite, ";tag=", tag);
+    p->call_id_pos = sip_prearm_find_id(p->invite, "\r\nCall-ID: ", call_number);
+    p->session_id_pos = sip_prearm_find_id(p->invite, "\r\no=- ", session_id);
+    p->dialog_tag_pos = sip_prearm_find_id(p->dialog.from, ";tag=", tag);
+    if (challenge) {
+        p->response_pos = sip_prearm_find_auth(p->invite, ",response=\"");
+        if (strlen(challenge->qop) > 0) {
+            p->nc_pos = sip_prearm_find_auth(p->invite, ",nc=");
+            p->cnonce_pos = sip_prearm_find_auth(p->invite, ",cnonce=\"");
+        }
+    }
+    p->valid = p->branch_pos && p->tag_pos && p->call_id_pos && p->session_id_pos &&
+               p->dialog_tag_pos && (!challenge || p->response_pos) &&
+               (!challenge || strlen(challenge->qop) == 0 || (p->nc_pos && p->cnonce_pos));
+
+    // Warm the resolver so the press does not wait on DNS
+    struct sockaddr_in server_addr;
+    resolve_hostname(sip_server(), &server_addr, sip_server_port());
+
+    char log_msg[192];
+    snprintf(log_msg, sizeof(log_msg), "INVITE to %s pre-armed (%s, %d bytes)%s", uri,
+             challenge ? (p->register_nonce ? "registrar nonce" : "INVITE nonce") : "no credentials",
+             len, p->valid ? "" : " - fields not found, not used");
+    sip_add_log_entry(p->valid ? SIP_LOG_INFO : SIP_LOG_WARNING, log_msg);
+}
+
+// Split a comma-separated target list into formatted request URIs
+static int sip_split_targets(const char* targets, char uris[][128], int max_uris)
+{
+    char list[SIP_TARGET_LIST_LEN];
+    snprintf(list, sizeof(list), "%s", targets);
+
+    int count = 0;
+    char* save = NULL;
+    for (char* target = strtok_r(list, ",", &save); target && count < max_uris;
+         target = strtok_r(NULL, ",", &save)) {
+        while (*target == ' ') {
+            target++;
+        }
+        size_t len = strlen(target);
+        while (len > 0 && target[len - 1] == ' ') {
+            target[--len] = '\0';
+        }
+        if (len > 0) {
+            sip_format_target_uri(target, uris[count++], 128);
+        }
+    }
+    return count;
+}
+
+// Keep the pre-armed INVITEs in step with the targets, our addresses and the
+// nonce; cheap when nothing changed
+static void sip_prearm_refresh(void)
+{
+    char uris[SIP_PREARM_SLOTS][128];
+    int count = sip_split_targets(sip_config.apartment1_uri, uris, SIP_PREARM_SLOTS);
+    count += sip_split_targets(sip_config.apartment2_uri, uris + count, SIP_PREARM_SLOTS - count);
+
+    for (int i = 0; i < SIP_PREARM_SLOTS; i++) {
+        if (i >= count) {
+            prearm[i].valid = false;
+            prearm[i].uri[0] = '\0';
+            continue;
+        }
+        if (prearm[i].generation != prearm_generation || strcmp(prearm[i].uri, uris[i]) != 0) {
+            sip_prearm_build(&prearm[i], uris[i]);
+        }
+    }
+}
+
+// Send the pre-armed INVITE to uri as a new leg. Returns false, with
+// nothing sent, if there is no up-to-date template for it.
+static bool sip_leg_send_prearmed(sip_call_leg_t* leg, const char* uri)
+{
+    sip_prearm_t* p = NULL;
+    for (int i = 0; i < SIP_PREARM_SLOTS; i++) {
+        if (prearm[i].valid && prearm[i].generation == prearm_generation &&
+            strcmp(prearm[i].uri, uri) == 0) {
+            p = &prearm[i];
+            break;
+        }
+    }
+    if (!p) {
+        return false;
+    }
+
+    memcpy(sip_tx_buffer, p->invite, p->len);
+    leg->dialog = p->dialog;
+
+    uint32_t tag = sip_new_fixed_id();
+    uint32_t call_number = sip_new_fixed_id();
+    leg->invite_branch = sip_new_fixed_id();
+    sip_put_fixed_id(sip_tx_buffer + p->branch_pos, leg->invite_branch);
+    sip_put_fixed_id(sip_tx_buffer + p->tag_pos, tag);
+    sip_put_fixed_id(sip_tx_buffer + p->call_id_pos, call_number);
+    leg->sdp_session_id = sip_new_fixed_id();
+    sip_put_fixed_id(sip_tx_buffer + p->session_id_pos, leg->sdp_session_id);
+    sip_put_fixed_id(leg->dialog.from + p->dialog_tag_pos, tag);
+    sip_put_fixed_id(leg->dialog.call_id, call_number);
+
+    bool authenticated = p->response_pos != 0;
+    if (authenticated) {
+        const sip_auth_challenge_t* challenge = p->register_nonce ? &last_auth_challenge : &prearm_challenge;
+        uint32_t* nonce_count = p->register_nonce ? &reg_nonce_count : &prearm_nonce_count;
+        char nc_str[12];
+        char cnonce[17];
+        char response[33];
+        (*nonce_count)++;
+        snprintf(nc_str, sizeof(nc_str), "%08lx", (unsigned long)*nonce_count);
+        generate_cnonce(cnonce, sizeof(cnonce));
+        calculate_digest_response(sip_config.username, sip_config.password, challenge->realm,
+                                  challenge->nonce, "INVITE", leg->dialog.request_uri,
+                                  challenge->qop, nc_str, cnonce, response);
+        memcpy(sip_tx_buffer + p->response_pos, response, 32);
+        if (p->nc_pos) {
+            memcpy(sip_tx_buffer + p->nc_pos, nc_str, 8);
+            memcpy(sip_tx_buffer + p->cnonce_pos, cnonce, 16);
+        }
+    }
+
+    int sent = sip_txn_send(sip_tx_buffer, p->len, xTaskGetTickCount() * portTICK_PERIOD_MS);
+    if (sent < 0) {
+        return false;
+    }
+
+    call_trace_point(CALL_TRACE_INVITE_SENT, authenticated ? 1 : 0);
+
+    char log_msg[256];
+    snprintf(log_msg, sizeof(log_msg), "Pre-armed INVITE sent to %s (%d bytes%s), Call-ID=%s",
+             uri, sent, authenticated ? ", authenticated" : "", leg->dialog.call_id);
+    sip_add_log_entry(SIP_LOG_SENT, log_msg);
+    return true;
+}
+
+// Negotiate the SDP body of an INVITE or its answer. Returns false if the
+// message carries no audio SDP or nothing we can use (no common codec,
+// stream rejected).
+static bool sip_negotiate_remote_sdp(const sip_message_t* msg, sdp_negotiated_t* negotiated)
+{
+    sdp_media_t remote;
+    if (msg->body_len == 0 || !sdp_parse(msg->body, msg->body_len, &remote)) {
+        return false;
+    }
+
+    char sdp_log[SIP_LOG_MAX_MESSAGE_LEN];
+    snprintf(sdp_log, sizeof(sdp_log), "Remote SDP: %.*s", (int)msg->body_len, msg->body);
+    sip_add_log_entry(SIP_LOG_INFO, sdp_log);
+
+    if (!sdp_negotiate(&remote, negotiated)) {
+        sip_add_log_entry(SIP_LOG_ERROR, "Remote SDP has no usable audio stream (no common codec or rejected)");
+        return false;
+    }
+
+    snprintf(sdp_log, sizeof(sdp_log), "Negotiated %s (PT %u), telephone-event %s, ptime %u ms, RTP to %s:%u",
+             sdp_codec_name(negotiated->codec), negotiated->audio_pt,
+             negotiated->event_pt == SDP_PT_NONE ? "none" : "yes", negotiated->ptime,
+             negotiated->address, negotiated->port);
+    sip_add_log_entry(SIP_LOG_INFO, sdp_log);
+    if (negotiated->remote_ptime && negotiated->remote_ptime != negotiated->ptime) {
+        snprintf(sdp_log, sizeof(sdp_log), "Remote asked for ptime %u ms, sending %u ms packets",
+                 negotiated->remote_ptime, negotiated->ptime);
+        sip_add_log_entry(SIP_LOG_WARNING, sdp_log);
+    }
+    return true;
+}
+
+// Hand a negotiated codec and direction to the media engine
+static void sip_configure_media(const sdp_negotiated_t* negotiated)
+{
+    media_engine_set_codec(negotiated->audio_pt,
+                           negotiated->event_pt == SDP_PT_NONE ? RTP_PT_NONE : negotiated->event_pt,
+                           negotiated->ptime);
+
+    media_direction_t direction;
+    switch (negotiated->direction) {
+        case SDP_DIR_SENDONLY: direction = MEDIA_DIR_SENDONLY; break;
+        case SDP_DIR_RECVONLY: direction = MEDIA_DIR_RECVONLY; break;
+        case SDP_DIR_INACTIVE: direction = MEDIA_DIR_INACTIVE; break;
+        default:               direction = MEDIA_DIR_SENDRECV; break;
+    }
+    media_engine_set_direction(direction);
+}
+
+// 180/183 with SDP: the leg keeps the answer; the first leg to send one
+// opens RTP and audio receive-only so the visitor hears the ringback and
+// the 200 OK only has to switch direction
+static void sip_start_early_media(sip_call_leg_t* leg, const sip_message_t* msg)
+{
+    if (msg->cseq_method != SIP_METHOD_INVITE || msg->body_len == 0) {
+        return;
+    }
+
+    sdp_negotiated_t negotiated;
+    if (!sip_negotiate_remote_sdp(msg, &negotiated)) {
+        return;
+    }
+    leg->early_answer = negotiated;
+    leg->has_early_answer = true;
+    if (media_engine_is_running()) {
+        return;
+    }
+
+    // Whatever the SDP says, nothing is sent before the 200 OK
+    sip_configure_media(&negotiated);
+    media_engine_set_direction(MEDIA_DIR_RECVONLY);
+    if (media_engine_start(negotiated.address, negotiated.port, SIP_RTP_PORT)) {
+        leg->early_media = true;
+        sip_add_log_entry(SIP_LOG_INFO, "Early media started (receive only)");
+    } else {
+        media_engine_set_direction(MEDIA_DIR_SENDRECV);
+        sip_add_log_entry(SIP_LOG_ERROR, "Failed to start early media");
+    }
+}
+
+// Our tag in a dialog ("...;tag=<n>" in the From we send)
+static const char* sip_dialog_local_tag(const sip_dialog_t* d)
+{
+    const char* tag = strstr(d->from, ";tag=");
+    return tag ? tag + 5 : "";
+}
+
+// Open a session for an established dialog and index it by our tag
+static sip_session_t* sip_session_alloc(const sip_dialog_t* dialog, bool incoming)
+{
+    for (int i = 0; i < SIP_MAX_SESSIONS; i++) {
+        sip_session_t* s = &sessions[i];
+        if (s->state != SIP_SESSION_FREE) {
+            continue;
+        }
+        const char* tag = sip_dialog_local_tag(dialog);
+        if (!sip_dialog_table_insert(&session_table, dialog->call_id, strlen(dialog->call_id),
+                                     tag, strlen(tag), i)) {
+            break;
+        }
+        memset(s, 0, sizeof(*s));
+        s->state = SIP_SESSION_CONFIRMED;
+        s->incoming = incoming;
+        s->dialog = *dialog;
+        return s;
+    }
+    sip_add_log_entry(SIP_LOG_ERROR, "No free session");
+    return NULL;
+}
+
+static void sip_session_free(sip_session_t* s)
+{
+    const char* tag = sip_dialog_local_tag(&s->dialog);
+    sip_dialog_table_remove(&session_table, s->dialog.call_id, strlen(s->dialog.call_id),
+                            tag, strlen(tag));
+    if (s == call_session) {
+        call_session = NULL;
+    }
+    memset(s, 0, sizeof(*s));
+}
+
+// Session a message belongs to: its Call-ID and our tag, which is the From
+// tag of a response and the To tag of a request
+static sip_session_t* sip_session_find(const sip_message_t* msg)
+{
+    const sip_header_t* call_id = sip_msg_header(msg, SIP_HDR_CALL_ID);
+    const char* tag;
+    size_t tag_len;
+    if (!call_id || !sip_header_param(sip_msg_header(msg, msg->is_response ? SIP_HDR_FROM : SIP_HDR_TO),
+                                      "tag", &tag, &tag_len)) {
+        return NULL;
+    }
+    int index = sip_dialog_table_find(&session_table, call_id->value, call_id->value_len, tag, tag_len);
+    return index >= 0 ? &sessions[index] : NULL;
+}
+
+// Session by Call-ID alone (CANCEL and transaction timeouts carry no tag of ours)
+static sip_session_t* sip_session_find_call_id(const char* call_id)
+{
+    for (int i = 0; i < SIP_MAX_SESSIONS; i++) {
+        if (sessions[i].state != SIP_SESSION_FREE && strcmp(sessions[i].dialog.call_id, call_id) == 0) {
+            return &sessions[i];
+        }
+    }
+    return NULL;
+}
+
+// Session of a request within a dialog, or NULL after rejecting it: 481 if
+// there is no such dialog, 500 if its CSeq is out of order (RFC 3261 §12.2.2)
+static sip_session_t* sip_session_for_request(const sip_message_t* msg,
+                                              const sip_request_headers_t* headers)
+{
+    char log_msg[128];
+    sip_session_t* s = sip_session_find(msg);
+    if (!s) {
+        snprintf(log_msg, sizeof(log_msg), "%.*s for unknown dialog - sending 481",
+                 msg->method_name_len, msg->method_name);
+        sip_add_log_entry(SIP_LOG_INFO, log_msg);
+        send_sip_response(481, "Call/Transaction Does Not Exist", headers, NULL, NULL);
+        return NULL;
+    }
+    if ((uint32_t)msg->cseq_num < s->remote_cseq) {
+        snprintf(log_msg, sizeof(log_msg), "%.*s with CSeq %d after %lu - sending 500",
+                 msg->method_name_len, msg->method_name, msg->cseq_num, (unsigned long)s->remote_cseq);
+        sip_add_log_entry(SIP_LOG_WARNING, log_msg);
+        send_sip_response(500, "Server Internal Error", headers, NULL, NULL);
+        return NULL;
+    }
+    s->remote_cseq = (uint32_t)msg->cseq_num;
+    return s;
+}
+
+// ACK for a 2xx is its own transaction with the INVITE's CSeq number; it is
+// repeated unchanged for every retransmission of the 200 OK
+static void sip_session_send_ack(sip_session_t* s)
+{
+    if (s->ack_branch == 0) {
+        s->ack_branch = sip_new_id();
+    }
+
+    sip_writer_t w;
+    sip_writer_init(&w, sip_tx_buffer, sizeof(sip_tx_buffer));
+    sip_writer_dialog_request(&w, &s->dialog, "ACK", s->invite_cseq, s->ack_branch);
+    sip_writer_header(&w, "User-Agent", SIP_USER_AGENT);
+    if (sip_send_message(&w, "ACK") > 0) {
+        sip_add_log_entry(SIP_LOG_SENT, "ACK sent");
+    }
+}
+
+// End a session with BYE (next CSeq, new branch). It is freed once the BYE
+// is answered or times out, or at once if it cannot be sent.
+static bool sip_session_send_bye(sip_session_t* s)
+{
+    if (s == call_session) {
+        call_session = NULL;
+    }
+    s->dialog.cseq++;
+    sip_writer_t w;
+    sip_writer_init(&w, sip_tx_buffer, sizeof(sip_tx_buffer));
+    sip_writer_dialog_request(&w, &s->dialog, "BYE", s->dialog.cseq, sip_new_id());
+    sip_writer_header(&w, "User-Agent", SIP_USER_AGENT);
+    if (sip_send_message(&w, "BYE") <= 0) {
+        sip_session_free(s);
+        return false;
+    }
+    s->state = SIP_SESSION_ENDING;
+    return true;
+}
+
+// 200 OK with our SDP answer to an INVITE or re-INVITE within session s
+static bool sip_session_send_answer(sip_session_t* s, const sip_request_headers_t* headers,
+                                    const sdp_negotiated_t* negotiated)
+{
+    char local_ip[16];
+    get_local_ip_or_default(local_ip, sizeof(local_ip));
+    // Same address as the SDP offer we sent, for a session we started
+    const char* sdp_ip = (!s->incoming && strlen(public_ip) > 0) ? public_ip : local_ip;
+
+    sip_writer_t w;
+    sip_writer_init(&w, sip_tx_buffer, sizeof(sip_tx_buffer));
+    sip_writer_status_line(&w, 200, "OK");
+    sip_writer_header(&w, "Via", headers->via_header);
+    sip_writer_header(&w, "From", headers->from_header);
+    sip_writer_header(&w, "To", s->dialog.from);
+    sip_writer_header(&w, "Call-ID", headers->call_id);
+    sip_writer_cseq(&w, (uint32_t)headers->cseq_num, "INVITE");
+    sip_writer_header(&w, "Contact", s->dialog.contact);
+    sip_writer_header(&w, "User-Agent", SIP_USER_AGENT);
+    sip_writer_begin_body(&w, "application/sdp");
+    sdp_local_t local = sip_sdp_local(sdp_ip, "ESP32 Doorbell");
+    local.session_id = s->sdp_session_id;
+    local.session_version = s->sdp_version;
+    local.direction = negotiated->direction;
+    sdp_write_answer(&w, &local, negotiated);
+
+    if (sip_send_message(&w, "200 OK") <= 0) {
+        sip_add_log_entry(SIP_LOG_ERROR, "Failed to send 200 OK");
+        return false;
+    }
+    sip_add_log_entry(SIP_LOG_SENT, "200 OK response to INVITE");
+
+    // Retransmitted by the transaction layer until the ACK arrives
+    s->invite_cseq = (uint32_t)headers->cseq_num;
+    s->ack_pending = true;
+    return true;
+}
+
+static void sip_leg_free(sip_call_leg_t* leg)
+{
+    const char* tag = sip_dialog_local_tag(&leg->dialog);
+    sip_dialog_table_remove(&leg_table, leg->dialog.call_id, strlen(leg->dialog.call_id),
+                            tag, strlen(tag));
+    memset(leg, 0, sizeof(*leg));
+}
+
+static sip_call_leg_t* sip_leg_alloc(void)
+{
+    for (int i = 0; i < SIP_MAX_CALL_LEGS; i++) {
+        if (call_legs[i].state == SIP_LEG_FREE) {
+            return &call_legs[i];
+        }
+    }
+    return NULL;
+}
+
+// Leg a response belongs to: its Call-ID and our From tag
+static sip_call_leg_t* sip_leg_find(const sip_message_t* msg)
+{
+    const sip_header_t* call_id = sip_msg_header(msg, SIP_HDR_CALL_ID);
+    const char* tag;
+    size_t tag_len;
+    if (!call_id || !sip_header_param(sip_msg_header(msg, SIP_HDR_FROM), "tag", &tag, &tag_len)) {
+        return NULL;
+    }
+    int index = sip_dialog_table_find(&leg_table, call_id->value, call_id->value_len, tag, tag_len);
+    return index >= 0 ? &call_legs[index] : NULL;
+}
+
+// Leg by Call-ID alone (transaction timeouts carry nothing else)
+static sip_call_leg_t* sip_leg_find_call_id(const char* call_id)
+{
+    for (int i = 0; i < SIP_MAX_CALL_LEGS; i++) {
+        if (call_legs[i].state != SIP_LEG_FREE && strcmp(call_legs[i].dialog.call_id, call_id) == 0) {
+            return &call_legs[i];
+        }
+    }
+    return NULL;
+}
+
+// The outgoing call is still looking for an answer
+static bool sip_fork_ringing(void)
+{
+    return current_state == SIP_STATE_CALLING || current_state == SIP_STATE_RINGING;
+}
+
+// Legs of the current call that may still answer
+static int sip_fork_pending_legs(void)
+{
+    int count = 0;
+    for (int i = 0; i < SIP_MAX_CALL_LEGS; i++) {
+        const sip_call_leg_t* leg = &call_legs[i];
+        if (leg->fork_id == fork_id && !leg->cancel_pending &&
+            (leg->state == SIP_LEG_CALLING || leg->state == SIP_LEG_PROCEEDING)) {
+            count++;
+        }
+    }
+    return count;
+}
+
+// Build and send a leg's INVITE; with a stored challenge it carries the
+// digest (an auth retry keeps Call-ID, From tag and CSeq, new branch)
+static bool sip_leg_send_invite(sip_call_leg_t* leg)
+{
+    char local_ip[16];
+    get_local_ip_or_default(local_ip, sizeof(local_ip));
+    const char* contact_ip = (strlen(public_ip) > 0) ? public_ip : local_ip;
+
+    leg->invite_branch = sip_new_id();
+
+    sip_writer_t w;
+    sip_writer_init(&w, sip_tx_buffer, sizeof(sip_tx_buffer));
+    sip_writer_dialog_request(&w, &leg->dialog, "INVITE", leg->dialog.cseq, leg->invite_branch);
+
+    bool authenticated = leg->auth.valid;
+    if (authenticated) {
+        char cnonce[17];
+        char nc_str[12];
+        // The leg's nonce is the pre-arm nonce (set on its 401), so the
+        // count is shared with pre-armed INVITEs
+        uint32_t nonce_count = 1;
+        if (strcmp(leg->auth.nonce, prearm_challenge.nonce) == 0) {
+            nonce_count = ++prearm_nonce_count;
+        }
+        snprintf(nc_str, sizeof(nc_str), "%08lx", (unsigned long)nonce_count);
+        generate_cnonce(cnonce, sizeof(cnonce));
+
+        // The digest URI MUST match the Request-URI (the target being called)
+        char digest_inputs[384];
+        snprintf(digest_inputs, sizeof(digest_inputs),
+                 "INVITE digest inputs: username=%s, realm=%s, method=INVITE, uri=%s, qop=%s, nc=%s, Call-ID=%s",
+                 sip_config.username, leg->auth.realm, leg->dialog.request_uri,
+                 leg->auth.qop[0] ? leg->auth.qop : "(empty)", nc_str, leg->dialog.call_id);
+        sip_add_log_entry(SIP_LOG_INFO, digest_inputs);
+
+        char response[33];
+        calculate_digest_response(sip_config.username, sip_config.password, leg->auth.realm,
+                                  leg->auth.nonce, "INVITE", leg->dialog.request_uri,
+                                  leg->auth.qop, nc_str, cnonce, response);
+        sip_write_authorization(&w, &leg->auth, leg->dialog.request_uri, response, nc_str, cnonce);
+    }
+
+    // An auth retry repeats the offer unchanged
+    if (leg->sdp_session_id == 0) {
+        leg->sdp_session_id = sip_new_id();
+    }
+    sip_write_invite_offer(&w, contact_ip, leg->sdp_session_id);
+
+    int sent = sip_send_message(&w, "INVITE");
+    if (sent < 0) {
+        return false;
+    }
+
+    call_trace_point(CALL_TRACE_INVITE_SENT, authenticated ? 1 : 0);
+    if (authenticated) {
+        leg->auth_attempts++;
+    }
+
+    char log_msg[256];
+    snprintf(log_msg, sizeof(log_msg), "%sINVITE sent to %s (%d bytes), Call-ID=%s",
+             authenticated ? "Authenticated " : "", leg->dialog.request_uri, sent, leg->dialog.call_id);
+    sip_add_log_entry(SIP_LOG_SENT, log_msg);
+    return true;
+}
+
+// Open a leg of the current call to uri: the pre-armed INVITE when there is
+// one, else a freshly built one
+static bool sip_leg_start(sip_call_leg_t* leg, const char* uri)
+{
+    memset(leg, 0, sizeof(*leg));
+    if (current_state != SIP_STATE_REGISTERED || !sip_leg_send_prearmed(leg, uri)) {
+        char local_ip[16];
+        get_local_ip_or_default(local_ip, sizeof(local_ip));
+        const char* contact_ip = (strlen(public_ip) > 0) ? public_ip : local_ip;
+
+        char call_id[64];
+        snprintf(call_id, sizeof(call_id), "%lu@%s", (unsigned long)sip_new_id(), local_ip);
+        sip_dialog_init(&leg->dialog, sip_config.username, sip_server(), local_ip, contact_ip,
+                        sip_transport_name(), sip_transport_local_port(), uri, call_id, sip_new_id());
+        if (!sip_leg_send_invite(leg)) {
+            memset(leg, 0, sizeof(*leg));
+            return false;
+        }
+    }
+
+    leg->state = SIP_LEG_CALLING;
+    leg->fork_id = fork_id;
+    leg->invite_sent_ms = xTaskGetTickCount() * portTICK_PERIOD_MS;
+
+    const char* tag = sip_dialog_local_tag(&leg->dialog);
+    if (!sip_dialog_table_insert(&leg_table, leg->dialog.call_id, strlen(leg->dialog.call_id),
+                                 tag, strlen(tag), (int)(leg - call_legs))) {
+        sip_add_log_entry(SIP_LOG_WARNING, "Call leg table full - responses to this leg will be ignored");
+    }
+    return true;
+}
+
+// CANCEL a leg's INVITE: same Request-URI, Call-ID, From, To, CSeq number
+// and Via branch (RFC 3261 §9.1). A leg without a provisional response yet
+// must not be cancelled; it is cancelled when the first one arrives.
+static void sip_leg_cancel(sip_call_leg_t* leg)
+{
+    if (leg->state == SIP_LEG_CALLING) {
+        leg->cancel_pending = true;
+        return;
+    }
+    if (leg->state != SIP_LEG_PROCEEDING) {
+        return;
+    }
+    leg->cancel_pending = false;
+    leg->state = SIP_LEG_CANCELLING;
+
+    sip_writer_t w;
+    sip_writer_init(&w, sip_tx_buffer, sizeof(sip_tx_buffer));
+    sip_writer_request_line(&w, "CANCEL", leg->dialog.request_uri);
+    sip_writer_via(&w, leg->dialog.transport, leg->dialog.via_sent_by, leg->invite_branch);
+    sip_writer_append(&w, "Max-Forwards: 70\r\n");
+    sip_writer_header(&w, "From", leg->dialog.from);
+    sip_writer_header(&w, "To", leg->dialog.to);
+    sip_writer_header(&w, "Call-ID", leg->dialog.call_id);
+    sip_writer_cseq(&w, leg->dialog.cseq, "CANCEL");
+    sip_writer_header(&w, "User-Agent", SIP_USER_AGENT);
+
+    char log_msg[192];
+    snprintf(log_msg, sizeof(log_msg), "CANCEL sent to %s", leg->dialog.request_uri);
+    if (sip_send_message(&w, "CANCEL") > 0) {
+        sip_add_log_entry(SIP_LOG_SENT, log_msg);
+    }
+}
+
+// Cancel every leg of the current call that has not answered
+static void sip_fork_cancel_all(void)
+{
+    for (int i = 0; i < SIP_MAX_CALL_LEGS; i++) {
+        if (call_legs[i].fork_id == fork_id) {
+            sip_leg_cancel(&call_legs[i]);
+        }
+    }
+}
+
+// ACK for a 2xx on a leg we do not want, with the INVITE's CSeq number
+static void sip_leg_send_ack(sip_call_leg_t* leg, uint32_t cseq)
+{
+    if (leg->ack_branch == 0) {
+        leg->ack_branch = sip_new_id();
+    }
+    sip_writer_t w;
+    sip_writer_init(&w, sip_tx_buffer, sizeof(sip_tx_buffer));
+    sip_writer_dialog_request(&w, &leg->dialog, "ACK", cseq, leg->ack_branch);
+    sip_writer_header(&w, "User-Agent", SIP_USER_AGENT);
+    sip_send_message(&w, "ACK");
+}
+
+// A leg answered after another one won (or after the call was given up):
+// the dialog exists, so ACK it and end it with BYE
+static void sip_leg_hang_up(sip_call_leg_t* leg, const sip_message_t* msg)
+{
+    const char* to_tag;
+    size_t to_tag_len;
+    if (sip_header_param(sip_msg_header(msg, SIP_HDR_TO), "tag", &to_tag, &to_tag_len)) {
+        sip_dialog_set_remote_tag(&leg->dialog, to_tag, to_tag_len);
+    }
+    sip_header_copy_uri(sip_msg_header(msg, SIP_HDR_CONTACT), leg->dialog.request_uri,
+                        sizeof(leg->dialog.request_uri));
+    sip_leg_send_ack(leg, (uint32_t)msg->cseq_num);
+
+    leg->dialog.cseq++;
+    sip_writer_t w;
+    sip_writer_init(&w, sip_tx_buffer, sizeof(sip_tx_buffer));
+    sip_writer_dialog_request(&w, &leg->dialog, "BYE", leg->dialog.cseq, sip_new_id());
+    sip_writer_header(&w, "User-Agent", SIP_USER_AGENT);
+    sip_send_message(&w, "BYE");
+    leg->state = SIP_LEG_ENDING;
+
+    char log_msg[192];
+    snprintf(log_msg, sizeof(log_msg), "%s answered too late - ACK and BYE sent", leg->dialog.request_uri);
+    sip_add_log_entry(SIP_LOG_INFO, log_msg);
+}
+
+// Close the SIP socket after a 500/503 and reconnect after the retry delay
+static void sip_reconnect_after_server_error(void)
+{
+    if (sip_transport_is_open()) {
+        sip_close_socket();
+        sip_add_log_entry(SIP_LOG_INFO, "SIP socket closed after server error");
+    }
+
+    last_connection_retry_timestamp = xTaskGetTickCount() * portTICK_PERIOD_MS;
+    sip_add_log_entry(SIP_LOG_INFO, "Connection retry scheduled in 10 seconds after server error");
+}
+
+// No leg is left to answer: back to REGISTERED. status is the last final
+// response, 0 if the last leg timed out.
+static void sip_fork_failed(int status)
+{
+    char log_msg[96];
+    snprintf(log_msg, sizeof(log_msg), "Call failed - no target answered (last status %d)", status);
+    sip_add_log_entry(SIP_LOG_ERROR, log_msg);
+
+    if (status == 0 || status == 403 || status == 404) {
+        led_handler_set_state(LED_STATE_ERROR);
+    }
+    current_state = SIP_STATE_REGISTERED;
+    call_start_timestamp = 0;
+
+    // Drop early media, if any
+    media_engine_stop();
+
+    if (status == 500 || status == 503) {
+        sip_reconnect_after_server_error();
+    }
+}
+
+// First 200 OK: the leg becomes the call, every other leg is cancelled
+static void sip_fork_connect(sip_call_leg_t* leg, const sip_message_t* msg)
+{
+    char answer_log[192];
+    snprintf(answer_log, sizeof(answer_log), "Call answered by %s after %lu ms",
+             leg->dialog.request_uri,
+             (unsigned long)(xTaskGetTickCount() * portTICK_PERIOD_MS - leg->invite_sent_ms));
+    sip_add_log_entry(SIP_LOG_INFO, answer_log);
+
+    sip_session_t* session = sip_session_alloc(&leg->dialog, false);
+    if (!session) {
+        sip_leg_hang_up(leg, msg);
+        sip_fork_cancel_all();
+        sip_fork_failed(0);
+        return;
+    }
+    session->invite_cseq = leg->dialog.cseq;
+    session->sdp_session_id = leg->sdp_session_id;
+    call_session = session;
+    const bool early_media = leg->early_media;
+    const bool has_early_answer = leg->has_early_answer;
+    const sdp_negotiated_t early_answer = leg->early_answer;
+    sip_leg_free(leg);
+    sip_fork_cancel_all();
+
+    // The 200 OK completes the dialog: remote tag and remote target
+    const char* to_tag;
+    size_t to_tag_len;
+    if (sip_header_param(sip_msg_header(msg, SIP_HDR_TO), "tag", &to_tag, &to_tag_len)) {
+        sip_dialog_set_remote_tag(&session->dialog, to_tag, to_tag_len);
+    }
+    sip_header_copy_uri(sip_msg_header(msg, SIP_HDR_CONTACT), session->dialog.request_uri,
+                        sizeof(session->dialog.request_uri));
+
+    sip_session_send_ack(session);
+
+    // Codec and remote RTP address from the SDP answer; a 200 OK without
+    // SDP repeats the one the leg sent in its 183
+    sdp_negotiated_t negotiated;
+    bool has_answer = sip_negotiate_remote_sdp(msg, &negotiated);
+    if (!has_answer && msg->body_len == 0 && has_early_answer) {
+        negotiated = early_answer;
+        has_answer = true;
+    }
+    if (!has_answer && msg->body_len > 0) {
+        // An answer we cannot use: the dialog exists now, so end it with BYE
+        current_state = SIP_STATE_CONNECTED;
+        call_start_timestamp = 0;
+        sip_add_log_entry(SIP_LOG_ERROR, "SDP answer not acceptable - hanging up");
+        sip_do_hangup();
+        return;
+    }
+    current_state = SIP_STATE_CONNECTED;
+    call_start_timestamp = 0; // Clear timeout
+    led_handler_set_state(LED_STATE_CALL_ACTIVE);
+    sip_add_log_entry(SIP_LOG_INFO, "Call connected - State: CONNECTED");
+
+    // Reset DTMF decoder state for new call
+    dtmf_reset_call_state();
+
+    // Early media from this leg already warmed up RTP and audio: only
+    // follow a changed answer address and start sending. Early media from a
+    // leg that lost carries another stream (SSRC, sequence, address), so it
+    // is restarted towards the winner.
+    if (media_engine_is_running()) {
+        if (early_media && has_answer) {
+            sip_configure_media(&negotiated);
+            media_engine_set_remote(negotiated.address, negotiated.port);
+            sip_add_log_entry(SIP_LOG_INFO, "Early media session switched to the answered stream");
+            return;
+        }
+        sip_add_log_entry(SIP_LOG_INFO, "Early media came from another target - restarting media");
+        media_engine_stop();
+    }
+
+    if (!has_answer) {
+        // No SDP at all: fall back to PCMU towards the SIP server
+        sip_add_log_entry(SIP_LOG_WARNING, "200 OK without SDP - sending PCMU to the SIP server");
+        memset(&negotiated, 0, sizeof(negotiated));
+        snprintf(negotiated.address, sizeof(negotiated.address), "%s", sip_server());
+        negotiated.port = SIP_RTP_PORT;
+    } else {
+        sip_configure_media(&negotiated);
+    }
+
+    // Start RTP and the media pipeline
+    if (media_engine_start(negotiated.address, negotiated.port, SIP_RTP_PORT)) {
+        sip_add_log_entry(SIP_LOG_INFO, "Media engine started");
+    } else {
+        sip_add_log_entry(SIP_LOG_ERROR, "Failed to start media engine");
+    }
+}
+
+// 401 on a leg: answer the challenge once with a new INVITE on the same leg
+static bool sip_leg_retry_auth(sip_call_leg_t* leg, const sip_message_t* msg)
+{
+    if (leg->auth_attempts >= MAX_INVITE_AUTH_ATTEMPTS) {
+        char err_msg[192];
+        snprintf(err_msg, sizeof(err_msg),
+                 "Max INVITE auth attempts (%d) exceeded for %s - last nonce=%s",
+                 MAX_INVITE_AUTH_ATTEMPTS, leg->dialog.request_uri, leg->auth.nonce);
+        sip_add_log_entry(SIP_LOG_ERROR, err_msg);
+        return false;
+    }
+
+    sip_auth_challenge_t challenge = parse_www_authenticate(msg);
+    if (!challenge.valid) {
+        sip_add_log_entry(SIP_LOG_ERROR, "Failed to parse INVITE auth challenge");
+        return false;
+    }
+    leg->auth = challenge;
+
+    // Later calls go out pre-authenticated with this nonce; the retry below
+    // takes nc 1 from the fresh count
+    if (strcmp(prearm_challenge.nonce, challenge.nonce) != 0) {
+        prearm_challenge = challenge;
+        prearm_nonce_count = 0;
+        prearm_generation++;
+    }
+
+    if (!sip_leg_send_invite(leg)) {
+        return false;
+    }
+    leg->state = SIP_LEG_CALLING;
+    return true;
+}
+
+// A response to one of our INVITEs, or to a leg's CANCEL or BYE
+static void sip_leg_handle_response(sip_call_leg_t* leg, const sip_message_t* msg)
+{
+    int status = msg->status_code;
+
+    if (msg->cseq_method == SIP_METHOD_CANCEL) {
+        // The INVITE's 487 (or a 200 that crossed the CANCEL) follows
+        return;
+    }
+    if (msg->cseq_method == SIP_METHOD_BYE) {
+        if (status >= 200) {
+            sip_leg_free(leg);
+        }
+        return;
+    }
+
+    bool current = leg->fork_id == fork_id && sip_fork_ringing();
+
+    if (status < 200) {
+        if (leg->state == SIP_LEG_CALLING) {
+            leg->state = SIP_LEG_PROCEEDING;
+        }
+        if (leg->cancel_pending || (!current && leg->state == SIP_LEG_PROCEEDING)) {
+            sip_leg_cancel(leg);
+            return;
+        }
+        if (!current || status == 100) {
+            return;
+        }
+
+        char log_msg[192];
+        if (current_state == SIP_STATE_CALLING && status == 180) {
+            current_state = SIP_STATE_RINGING;
+            led_handler_set_state(LED_STATE_RINGING);
+        }
+        snprintf(log_msg, sizeof(log_msg), "%d %.*s from %s", status, msg->reason_len, msg->reason,
+                 leg->dialog.request_uri);
+        sip_add_log_entry(SIP_LOG_INFO, log_msg);
+
+        // Early media from the first leg that offers it
+        sip_start_early_media(leg, msg);
+        return;
+    }
+
+    if (status < 300) {
+        if (current && leg->state != SIP_LEG_CANCELLING && !leg->cancel_pending) {
+            sip_fork_connect(leg, msg);
+        } else if (leg->state == SIP_LEG_ENDING) {
+            // Our ACK was lost: repeat it
+            sip_leg_send_ack(leg, (uint32_t)msg->cseq_num);
+        } else {
+            sip_leg_hang_up(leg, msg);
+        }
+        return;
+    }
+
+    // Final failure; retransmissions are ACKed by the INVITE transaction
+    send_ack_for_error_response(msg);
+
+    if (status == 401 && current && leg->state != SIP_LEG_CANCELLING && !leg->cancel_pending &&
+        sip_leg_retry_auth(leg, msg)) {
+        return;
+    }
+
+    char log_msg[192];
+    snprintf(log_msg, sizeof(log_msg), "%s: %d %.*s", leg->dialog.request_uri, status,
+             msg->reason_len, msg->reason);
+    sip_add_log_entry(status == 487 ? SIP_LOG_INFO : SIP_LOG_ERROR, log_msg);
+
+    sip_leg_free(leg);
+    if (current && sip_fork_pending_legs() == 0) {
+        sip_fork_failed(status);
+    }
+}
+
+// The call's session is gone (BYE received, or the dialog no longer exists):
+// back to REGISTERED
+static void sip_call_ended(const char* reason)
+{
+    current_state = SIP_STATE_REGISTERED;
+    call_start_timestamp = 0; // Clear timeout
+    led_handler_set_state(LED_STATE_IDLE);
+
+    // Reset DTMF decoder state when call ends
+    dtmf_reset_call_state();
+
+    media_engine_stop();
+    char log_msg[128];
+    snprintf(log_msg, sizeof(log_msg), "%s - RTP session stopped - State changed to REGISTERED", reason);
+    sip_add_log_entry(SIP_LOG_INFO, log_msg);
+}
+
+// A response to a BYE or INFO we sent within a session. Any final response
+// to the BYE ends the session; 481 or 408 to anything else means the dialog
+// no longer exists at the other end (RFC 3261 §12.2.1.2).
+static void sip_session_handle_response(sip_session_t* s, const sip_message_t* msg)
+{
+    if (msg->status_code < 200) {
+        return;
+    }
+    if (msg->cseq_method == SIP_METHOD_BYE) {
+        sip_session_free(s);
+        return;
+    }
+    if (msg->status_code != 481 && msg->status_code != 408) {
+        return;
+    }
+
+    bool was_call = s == call_session;
+    sip_session_free(s);
+    if (was_call) {
+        sip_call_ended("Dialog gone at the remote end");
+    }
+}
+
+// Responses to INVITEs: per leg while the call rings, then per session
+static void sip_handle_invite_response(const sip_message_t* msg)
+{
+    sip_call_leg_t* leg = sip_leg_find(msg);
+    if (leg) {
+        sip_leg_handle_response(leg, msg);
+        return;
+    }
+
+    // The INVITE transaction ends with the first 2xx, so retransmissions
+    // (our ACK was lost) reach us here and are ACKed again
+    sip_session_t* session = sip_session_find(msg);
+    if (session && !session->incoming && msg->status_code >= 200 && msg->status_code < 300 &&
+        (uint32_t)msg->cseq_num == session->invite_cseq) {
+        sip_add_log_entry(SIP_LOG_INFO, "200 OK retransmission - repeating ACK");
+        sip_session_send_ack(session);
+        return;
+    }
+
+    char log_msg[128];
+    snprintf(log_msg, sizeof(log_msg), "%d to an INVITE of no current call leg ignored", msg->status_code);
+    sip_add_log_entry(SIP_LOG_INFO, log_msg);
+}
+
+// Whether a Contact URI is the one we register: compared up to the URI
+// parameters, which registrars may reorder or drop
+static bool sip_contact_is_ours(const char* uri)
+{
+    const char* ours = reg_dialog.contact[0] == '<' ? reg_dialog.contact + 1 : reg_dialog.contact;
+    size_t ours_len = strcspn(ours, ";>");
+    size_t uri_len = strcspn(uri, ";>");
+    return ours_len > 0 && uri_len == ours_len && strncasecmp(uri, ours, ours_len) == 0;
+}
+
+// Expires parameter of our binding in a REGISTER response. The 200 OK lists
+// every binding of the address-of-record, one per Contact header or comma
+// separated in one, and other devices' expiries must not set our refresh.
+static bool sip_our_contact_expires(const sip_message_t* msg, char* value, size_t value_size)
+{
+    for (int i = 0; i < msg->header_count; i++) {
+        const sip_header_t* h = &msg->headers[i];
+        if (h->id != SIP_HDR_CONTACT) {
+            continue;
+        }
+        const char* p = h->value;
+        const char* end = h->value + h->value_len;
+        while (p < end) {
+            // One binding: up to the next comma outside <...> and quotes
+            const char* q = p;
+            bool in_quotes = false;
+            int angle_depth = 0;
+            while (q < end && (in_quotes || angle_depth > 0 || *q != ',')) {
+                if (*q == '"') {
+                    in_quotes = !in_quotes;
+                } else if (!in_quotes && *q == '<') {
+                    angle_depth++;
+                } else if (!in_quotes && *q == '>') {
+                    angle_depth--;
+                }
+                q++;
+            }
+            while (p < q && *p == ' ') {
+                p++;
+            }
+            sip_header_t binding = { .id = SIP_HDR_CONTACT, .value = p, .value_len = (uint16_t)(q - p) };
+            char uri[96];
+            if (sip_header_copy_uri(&binding, uri, sizeof(uri)) && sip_contact_is_ours(uri)) {
+                return sip_header_copy_param(&binding, "expires", value, value_size);
+            }
+            p = q + 1;
+        }
+    }
+    return false;
+}
+
+// Expiry granted by the registrar: our Contact's expires parameter, else the
+// Expires header, else what we asked for; kept within sane bounds
+static uint32_t sip_granted_expires(const sip_message_t* msg)
+{
+    char value[12];
+    if (!sip_our_contact_expires(msg, value, sizeof(value)) &&
+        !sip_msg_copy_header(msg, SIP_HDR_EXPIRES, value, sizeof(value))) {
+        return SIP_REGISTER_EXPIRES_S;
+    }
+
+    long expires = strtol(value, NULL, 10);
+    if (expires < SIP_REGISTER_MIN_EXPIRES_S) {
+        expires = SIP_REGISTER_MIN_EXPIRES_S;
+    } else if (expires > SIP_REGISTER_MAX_EXPIRES_S) {
+        expires = SIP_REGISTER_MAX_EXPIRES_S;
+    }
+    return (uint32_t)expires;
+}
+
+static void sip_handle_200_ok(const sip_message_t* msg)
+{
+    if (msg->cseq_method == SIP_METHOD_REGISTER &&
+        (current_state == SIP_STATE_REGISTERING || reg_refreshing)) {
+        uint32_t expires = sip_granted_expires(msg);
+        reg_granted_timestamp = xTaskGetTickCount() * portTICK_PERIOD_MS;
+        reg_refresh_ms = expires * 10 * SIP_REGISTER_REFRESH_PERCENT;
+        auth_attempt_count = 0;  // Reset counter on success
+        prearm_generation++;     // Addresses may have changed: rebuild the INVITE templates
+
+        // Keep the path to the registrar open from here on
+        char received[16] = {0};
+        extract_received_ip(msg, received, sizeof(received));
+        sip_keepalive_start(sip_transport_reliable(), received, extract_rport(msg), reg_granted_timestamp);
+
+        char log_msg[128];
+        if (reconnect_timestamp > 0) {
+            snprintf(log_msg, sizeof(log_msg), "Registered again over %s %lu ms after the connection was lost",
+                     sip_transport_name(),
+                     (unsigned long)(xTaskGetTickCount() * portTICK_PERIOD_MS - reconnect_timestamp));
+            sip_add_log_entry(SIP_LOG_INFO, log_msg);
+            reconnect_timestamp = 0;
+        }
+        if (reg_refreshing) {
+            reg_refreshing = false;
+            snprintf(log_msg, sizeof(log_msg), "Registration refreshed (expires %lus, next refresh in %lus)",
+                     (unsigned long)expires, (unsigned long)(reg_refresh_ms / 1000));
+            sip_add_log_entry(SIP_LOG_INFO, log_msg);
+            return;
+        }
+
+        current_state = SIP_STATE_REGISTERED;
+        led_handler_set_state(LED_STATE_SIP_REGISTERED);
+        snprintf(log_msg, sizeof(log_msg), "SIP registration successful (expires %lus, refresh in %lus)",
+                 (unsigned long)expires, (unsigned long)(reg_refresh_ms / 1000));
+        sip_add_log_entry(SIP_LOG_INFO, log_msg);
+        return;
+    }
+
+    char log_msg[96];
+    snprintf(log_msg, sizeof(log_msg), "200 OK for %s ignored in state %s",
+             sip_method_name(msg->cseq_method), state_names[current_state]);
+    sip_add_log_entry(SIP_LOG_INFO, log_msg);
+}
+
+static void sip_handle_401_register(const sip_message_t* msg)
+{
+    sip_auth_challenge_t challenge = parse_www_authenticate(msg);
+
+    // A stale nonce is not a credentials failure - just answer the new challenge
+    if (challenge.valid && challenge.stale) {
+        sip_add_log_entry(SIP_LOG_INFO, "Nonce stale - re-authenticating with the new nonce");
+    } else {
+        auth_attempt_count++;
+    }
+
+    char auth_log_msg[128];
+    snprintf(auth_log_msg, sizeof(auth_log_msg), "Authentication required (attempt %d/%d), parsing challenge",
+             auth_attempt_count, MAX_AUTH_ATTEMPTS);
+    sip_add_log_entry(SIP_LOG_INFO, auth_log_msg);
+
+    // Check if we've exceeded max attempts (prevent infinite loop)
+    if (auth_attempt_count > MAX_AUTH_ATTEMPTS) {
+        sip_add_log_entry(SIP_LOG_ERROR, "Max authentication attempts exceeded - authentication failed");
+        led_handler_set_state(LED_STATE_ERROR);
+        current_state = SIP_STATE_AUTH_FAILED;
+        auth_attempt_count = 0;
+        has_initial_transaction_ids = false;
+        reg_refreshing = false;
+        return;
+    }
+
+    // Extract public IP from Via header for NAT traversal
+    if (extract_received_ip(msg, public_ip, sizeof(public_ip))) {
+        char log_msg[128];
+        snprintf(log_msg, sizeof(log_msg), "Public IP extracted from 401: %s", public_ip);
+        sip_add_log_entry(SIP_LOG_INFO, log_msg);
+    } else {
+        sip_add_log_entry(SIP_LOG_INFO, "No received IP in 401 response");
+    }
+
+    if (challenge.valid) {
+        // A new nonce restarts the nonce count
+        if (strcmp(challenge.nonce, last_auth_challenge.nonce) != 0) {
+            reg_nonce_count = 0;
+            prearm_generation++;
+        }
+        last_auth_challenge = challenge;
+
+        // Send authenticated REGISTER
+        sip_client_register_auth(&last_auth_challenge);
+    } else {
+        sip_add_log_entry(SIP_LOG_ERROR, "Failed to parse auth challenge");
+        led_handler_set_state(LED_STATE_ERROR);
+        current_state = SIP_STATE_AUTH_FAILED;
+        auth_attempt_count = 0;
+        has_initial_transaction_ids = false;
+        reg_refreshing = false;
+        memset(&last_auth_challenge, 0, sizeof(last_auth_challenge));
+        sip_add_log_entry(SIP_LOG_ERROR, "State changed to AUTH_FAILED");
+    }
+}
+
+static void sip_handle_401(const sip_message_t* msg)
+{
+    if (msg->cseq_method == SIP_METHOD_REGISTER &&
+        (current_state == SIP_STATE_REGISTERING || reg_refreshing)) {
+        sip_handle_401_register(msg);
+        return;
+    }
+
+    char ignore_msg[128];
+    snprintf(ignore_msg, sizeof(ignore_msg),
+             "Ignoring unexpected 401 in state %s",
+             state_names[current_state]);
+    sip_add_log_entry(SIP_LOG_INFO, ignore_msg);
+
+    sip_request_headers_t headers = extract_request_headers(msg);
+    if (headers.valid) {
+        char debug_log[512];
+        snprintf(debug_log, sizeof(debug_log),
+                 "Unexpected 401: Call-ID=%s, Expected: %s, Via=%s, CSeq=%d %s",
+                 headers.call_id, call_session ? call_session->dialog.call_id : "none", headers.via_header,
+                 headers.cseq_num, headers.cseq_method);
+        sip_add_log_entry(SIP_LOG_INFO, debug_log);
+    } else {
+        sip_add_log_entry(SIP_LOG_ERROR, "Failed to extract headers from unexpected 401");
+    }
+}
+
+// 500 and 503: drop the current transaction and reconnect after the retry delay
+static void sip_handle_server_failure(const sip_message_t* msg)
+{
+    char debug_msg[128];
+    snprintf(debug_msg, sizeof(debug_msg),
+             "%d error - Current state: %s, Socket: %d, Auth attempts: %d",
+             msg->status_code, state_names[current_state], sip_transport_fd(), auth_attempt_count);
+    sip_add_log_entry(SIP_LOG_ERROR, debug_msg);
+
+    if (current_state == SIP_STATE_REGISTERING) {
+        auth_attempt_count = 0;
+        has_initial_transaction_ids = false;
+        current_state = SIP_STATE_DISCONNECTED;
+    } else if (msg->status_code == 500) {
+        sip_add_log_entry(SIP_LOG_ERROR, "500 in other state - entering error state");
+        current_state = SIP_STATE_ERROR;
+    }
+
+    // Close socket so retry mechanism can recreate it
+    sip_reconnect_after_server_error();
+}
+
+// Register with the (newly) active registrar from scratch: its own Call-ID,
+// nonce and, over TCP/TLS, connection. Never during a call.
+static void sip_switch_registrar(void)
+{
+    sip_keepalive_stop();
+    sip_txn_reset();
+    if (sip_transport_reliable()) {
+        sip_transport_disconnect();
+    }
+    reconnect_pending = false;
+    reg_sent_timestamp = 0;
+    last_auth_challenge.valid = false;
+    prearm_challenge.valid = false;
+    has_initial_transaction_ids = false;
+    sip_client_register();
+}
+
+// Probe the standby registrars over UDP so a failover can pick one that
+// answers, and the preferred one is noticed when it is back. The OPTIONS
+// bypasses the transaction layer: a lost one counts as a failure instead
+// of being retransmitted.
+static void sip_probe_registrars(void)
+{
+    int index = sip_registrar_probe_due(xTaskGetTickCount() * portTICK_PERIOD_MS);
+    if (index < 0) {
+        return;
+    }
+    const sip_registrar_t* r = sip_registrar_get(index);
+    struct sockaddr_in addr;
+    if (!resolve_hostname(r->host, &addr, r->port ? r->port : (uint16_t)sip_config.port)) {
+        return;
+    }
+
+    char local_ip[16];
+    get_local_ip_or_default(local_ip, sizeof(local_ip));
+    char sent_by[32];
+    snprintf(sent_by, sizeof(sent_by), "%s:%u", local_ip, sip_transport_local_port());
+    char uri[80];
+    snprintf(uri, sizeof(uri), "sip:%s", r->host);
+    char value[128];
+
+    sip_writer_t w;
+    sip_writer_init(&w, sip_tx_buffer, sizeof(sip_tx_buffer));
+    sip_writer_request_line(&w, "OPTIONS", uri);
+    sip_writer_via(&w, sip_transport_name(), sent_by, sip_new_id());
+    sip_writer_append(&w, "Max-Forwards: 70\r\n");
+    snprintf(value, sizeof(value), "<sip:%s@%s>;tag=%lu", sip_config.username, r->host, (unsigned long)sip_new_id());
+    sip_writer_header(&w, "From", value);
+    snprintf(value, sizeof(value), "<%s>", uri);
+    sip_writer_header(&w, "To", value);
+    snprintf(value, sizeof(value), SIP_PROBE_CALL_ID_PREFIX "%d-%lu@%s", index, (unsigned long)sip_new_id(), local_ip);
+    sip_writer_header(&w, "Call-ID", value);
+    sip_writer_cseq(&w, 1, "OPTIONS");
+    sip_writer_append(&w, "User-Agent: " SIP_USER_AGENT "\r\n");
+    int len = sip_writer_finish(&w);
+    if (len > 0) {
+        sip_transport_send(r->host, &addr, w.buf, len);
+    }
+}
+
+// Keep-alive probes failed or the NAT binding moved: the registrar can no
+// longer reach us. TCP/TLS gets a new connection (and registers over it),
+// UDP refreshes the registration from the new binding.
+static void sip_keepalive_reregister(const char* received)
+{
+    if (sip_transport_reliable()) {
+        sip_transport_disconnect();
+        sip_connection_lost();
+        return;
+    }
+
+    if (received && received[0] != '\0') {
+        snprintf(public_ip, sizeof(public_ip), "%s", received);
+    }
+    if (reg_refreshing) {
+        return;
+    }
+    char local_ip[16];
+    get_local_ip_or_default(local_ip, sizeof(local_ip));
+    const char* contact_ip = (strlen(public_ip) > 0) ? public_ip : local_ip;
+    sip_dialog_set_address(&reg_dialog, sip_config.username, local_ip, contact_ip,
+                           sip_transport_name(), sip_transport_local_port());
+    sip_add_log_entry(SIP_LOG_WARNING, "Registrar unreachable or NAT binding changed - registering again");
+    sip_refresh_registration();
+}
+
+// Send the keep-alive the scheduler asks for. A CRLF goes out as is; an
+// OPTIONS runs in the registration's Call-ID as a normal client transaction.
+static void sip_keepalive_run(void)
+{
+    switch (sip_keepalive_poll(xTaskGetTickCount() * portTICK_PERIOD_MS)) {
+        case SIP_KEEPALIVE_SEND_CRLF:
+            sip_transmit("\r\n\r\n", 4);
+            break;
+
+        case SIP_KEEPALIVE_SEND_OPTIONS: {
+            reg_dialog.cseq++;
+            sip_writer_t w;
+            sip_writer_init(&w, sip_tx_buffer, sizeof(sip_tx_buffer));
+            sip_writer_dialog_request(&w, &reg_dialog, "OPTIONS", reg_dialog.cseq, sip_new_id());
+            sip_writer_append(&w, "User-Agent: " SIP_USER_AGENT "\r\n");
+            sip_send_message(&w, "OPTIONS keep-alive");
+            break;
+        }
+
+        case SIP_KEEPALIVE_REREGISTER:
+            // Probes lost: the registrar may be down rather than the path
+            if (current_state == SIP_STATE_REGISTERED && sip_fail_over()) {
+                sip_switch_registrar();
+            } else {
+                sip_keepalive_reregister(NULL);
+            }
+            break;
+
+        default:
+            break;
+    }
+}
+
+static void sip_handle_response(const sip_message_t* msg)
+{
+    uint32_t now = xTaskGetTickCount() * portTICK_PERIOD_MS;
+
+    // Keep-alive and standby registrar probes: any answer proves the path,
+    // whatever the status
+    if (msg->cseq_method == SIP_METHOD_OPTIONS) {
+        char call_id[64];
+        if (sip_msg_copy_header(msg, SIP_HDR_CALL_ID, call_id, sizeof(call_id)) &&
+            strncmp(call_id, SIP_PROBE_CALL_ID_PREFIX, strlen(SIP_PROBE_CALL_ID_PREFIX)) == 0) {
+            sip_registrar_on_probe_answer(atoi(call_id + strlen(SIP_PROBE_CALL_ID_PREFIX)), now);
+            return;
+        }
+
+        char received[16] = {0};
+        extract_received_ip(msg, received, sizeof(received));
+        uint32_t answered = sip_keepalive_answered();
+        sip_keepalive_action_t action = sip_keepalive_on_response(received, extract_rport(msg), now);
+        sip_registrar_sample(answered);
+        if (action == SIP_KEEPALIVE_REREGISTER) {
+            sip_keepalive_reregister(received);
+        }
+        return;
+    }
+
+    // The registrar answered; a round trip counts only if no retransmission
+    // went out before the answer (Karn's algorithm)
+    if (msg->cseq_method == SIP_METHOD_REGISTER && reg_sent_timestamp > 0) {
+        uint32_t rtt = now - reg_sent_timestamp;
+        sip_registrar_on_answer(sip_registrar_active(),
+                                (sip_transport_reliable() || rtt < SIP_TXN_T1_MS) ? rtt : SIP_REGISTRAR_NO_RTT);
+        reg_sent_timestamp = 0;
+    }
+
+    // A refresh rejected with anything but a challenge ends the binding;
+    // the cases below report it like any other registration failure
+    if (reg_refreshing && msg->cseq_method == SIP_METHOD_REGISTER &&
+        msg->status_code >= 300 && msg->status_code != 401) {
+        reg_refreshing = false;
+        reg_refresh_ms = 0;
+    }
+
+    if (msg->cseq_method == SIP_METHOD_INVITE) {
+        if (msg->status_code == 100) {
+            call_trace_point(CALL_TRACE_RESPONSE_100, 100);
+        } else if (msg->status_code == 180 || msg->status_code == 183) {
+            call_trace_point(CALL_TRACE_RESPONSE_180, (uint16_t)msg->status_code);
+        } else if (msg->status_code == 200) {
+            call_trace_point(CALL_TRACE_RESPONSE_200, 200);
+        }
+        sip_handle_invite_response(msg);
+        return;
+    }
+
+    // CANCELs, and BYEs ending a leg that answered too late
+    if (msg->cseq_method == SIP_METHOD_CANCEL || msg->cseq_method == SIP_METHOD_BYE) {
+        sip_call_leg_t* leg = sip_leg_find(msg);
+        if (leg) {
+            sip_leg_handle_response(leg, msg);
+            return;
+        }
+    }
+
+    // BYE and INFO within a session
+    if (msg->cseq_method == SIP_METHOD_BYE || msg->cseq_method == SIP_METHOD_INFO) {
+        sip_session_t* session = sip_session_find(msg);
+        if (session) {
+            sip_session_handle_response(session, msg);
+            return;
+        }
+    }
+
+    switch (msg->status_code) {
+        case 100:
+            sip_add_log_entry(SIP_LOG_INFO, "Server processing request (100 Trying)");
+            break;
+
+        case 200:
+            sip_handle_200_ok(msg);
+            break;
+
+        case 401:
+            sip_handle_401(msg);
+            break;
+
+        case 403:
+            led_handler_set_state(LED_STATE_ERROR);
+            sip_add_log_entry(SIP_LOG_ERROR, "SIP forbidden - State: AUTH_FAILED");
+            current_state = SIP_STATE_AUTH_FAILED;
+            break;
+
+        case 404:
+            led_handler_set_state(LED_STATE_ERROR);
+            sip_add_log_entry(SIP_LOG_ERROR, "SIP target not found");
+            current_state = SIP_STATE_ERROR;
+            break;
+
+        case 408:
+            sip_add_log_entry(SIP_LOG_ERROR, "SIP request timeout");
+            current_state = SIP_STATE_TIMEOUT;
+            break;
+
+        case 500:
+        case 503:
+            sip_handle_server_failure(msg);
+            break;
+
+        default: {
+            char log_msg[128];
+            snprintf(log_msg, sizeof(log_msg), "Response %d %.*s for %s",
+                     msg->status_code, msg->reason_len, msg->reason, sip_method_name(msg->cseq_method));
+            sip_add_log_entry(msg->status_code >= 300 ? SIP_LOG_ERROR : SIP_LOG_INFO, log_msg);
+            break;
+        }
+    }
+}
+
+static void sip_handle_options(const sip_message_t* msg)
+{
+    sip_add_log_entry(SIP_LOG_RECEIVED, "OPTIONS request received");
+
+    sip_request_headers_t headers = extract_request_headers(msg);
+    if (!headers.valid) {
+        sip_add_log_entry(SIP_LOG_ERROR, "Failed to parse OPTIONS headers");
+        return;
+    }
+
+    // Advertise supported methods
+    send_sip_response(200, "OK", &headers,
+                      "Allow: INVITE, ACK, BYE, CANCEL, OPTIONS, INFO\r\n"
+                      "Accept: application/sdp, application/dtmf-relay\r\n"
+                      "Accept-Encoding: identity\r\n"
+                      "Accept-Language: en\r\n"
+                      "Supported: \r\n",
+                      NULL);
+
+    sip_add_log_entry(SIP_LOG_INFO, "OPTIONS response sent - capabilities advertised (INFO method supported)");
+}
+
+static void sip_handle_cancel(const sip_message_t* msg)
+{
+    sip_add_log_entry(SIP_LOG_RECEIVED, "CANCEL request received");
+
+    sip_request_headers_t headers = extract_request_headers(msg);
+    if (!headers.valid) {
+        sip_add_log_entry(SIP_LOG_ERROR, "Failed to parse CANCEL headers");
+        return;
+    }
+
+    // We answer INVITEs at once, so a CANCEL always crosses our 200 OK: it
+    // has no effect and the caller ends the call with BYE (RFC 3261 §9.2)
+    sip_session_t* session = sip_session_find_call_id(headers.call_id);
+    if (session && session->incoming) {
+        send_sip_response(200, "OK", &headers, NULL, NULL);
+        sip_add_log_entry(SIP_LOG_INFO, "CANCEL after the call was answered - no effect");
+    } else {
+        sip_add_log_entry(SIP_LOG_INFO, "CANCEL for unknown transaction - sending 481");
+        send_sip_response(481, "Call/Transaction Does Not Exist", &headers, NULL, NULL);
+    }
+}
+
+// INFO: DTMF relay (application/dtmf-relay or application/dtmf, RFC 2976)
+static void sip_handle_info(const sip_message_t* msg)
+{
+    sip_add_log_entry(SIP_LOG_RECEIVED, "INFO request received");
+
+    sip_request_headers_t headers = extract_request_headers(msg);
+    if (!headers.valid) {
+        sip_add_log_entry(SIP_LOG_ERROR, "Failed to parse INFO headers");
+        return;
+    }
+
+    sip_session_t* session = sip_session_for_request(msg, &headers);
+    if (!session) {
+        return;
+    }
+
+    char content_type[64] = {0};
+    sip_msg_copy_header(msg, SIP_HDR_CONTENT_TYPE, content_type, sizeof(content_type));
+
+    if (strncasecmp(content_type, "application/dtmf", 16) == 0) {
+        char body[128];
+        size_t body_len = msg->body_len < sizeof(body) - 1 ? msg->body_len : sizeof(body) - 1;
+        memcpy(body, msg->body, body_len);
+        body[body_len] = '\0';
+
+        const char* signal_line = strstr(body, "Signal=");
+        if (signal_line) {
+            char dtmf_signal = signal_line[7];
+            int dtmf_duration = 0;
+            const char* duration_line = strstr(body, "Duration=");
+            if (duration_line) {
+                dtmf_duration = atoi(duration_line + 9);
+            }
+
+            uint8_t event_code = 255; // Invalid
+            switch (dtmf_signal) {
+                case '0': event_code = DTMF_EVENT_0; break;
+                case '1': event_code = DTMF_EVENT_1; break;
+                case '2': event_code = DTMF_EVENT_2; break;
+                case '3': event_code = DTMF_EVENT_3; break;
+                case '4': event_code = DTMF_EVENT_4; break;
+                case '5': event_code = DTMF_EVENT_5; break;
+                case '6': event_code = DTMF_EVENT_6; break;
+                case '7': event_code = DTMF_EVENT_7; break;
+                case '8': event_code = DTMF_EVENT_8; break;
+                case '9': event_code = DTMF_EVENT_9; break;
+                case '*': event_code = DTMF_EVENT_STAR; break;
+                case '#': event_code = DTMF_EVENT_HASH; break;
+                case 'A': case 'a': event_code = DTMF_EVENT_A; break;
+                case 'B': case 'b': event_code = DTMF_EVENT_B; break;
+                case 'C': case 'c': event_code = DTMF_EVENT_C; break;
+                case 'D': case 'd': event_code = DTMF_EVENT_D; break;
+                default: break;
+            }
+
+            if (event_code > DTMF_EVENT_D) {
+                char invalid_signal[64];
+                snprintf(invalid_signal, sizeof(invalid_signal),
+                         "Invalid DTMF signal in INFO: '%c'", dtmf_signal);
+                sip_add_log_entry(SIP_LOG_WARNING, invalid_signal);
+            } else {
+                char dtmf_log[128];
+                snprintf(dtmf_log, sizeof(dtmf_log),
+                         "DTMF via INFO: signal='%c', duration=%d ms",
+                         dtmf_signal, dtmf_duration);
+                sip_add_log_entry(SIP_LOG_INFO, dtmf_log);
+
+                if (session == call_session && current_state == SIP_STATE_CONNECTED) {
+                    dtmf_process_telephone_event(event_code);
+                } else {
+                    char state_warning[128];
+                    snprintf(state_warning, sizeof(state_warning),
+                             "DTMF INFO received but not in CONNECTED state (state=%s)",
+                             state_names[current_state]);
+                    sip_add_log_entry(SIP_LOG_WARNING, state_warning);
+                }
+            }
+        } else {
+            sip_add_log_entry(SIP_LOG_INFO, "INFO with DTMF content-type but no Signal line");
+        }
+    } else if (strlen(content_type) > 0) {
+        char content_log[96];
+        snprintf(content_log, sizeof(content_log), "INFO with Content-Type: %s", content_type);
+        sip_add_log_entry(SIP_LOG_INFO, content_log);
+    }
+
+    send_sip_response(200, "OK", &headers, NULL, NULL);
+    sip_add_log_entry(SIP_LOG_SENT, "200 OK response to INFO");
+}
+
+// User part of a SIP URI: "sip:201@pbx;transport=udp" -> "201"
+static size_t sip_uri_user(const char* uri, const char** user)
+{
+    const char* colon = strchr(uri, ':');
+    *user = colon ? colon + 1 : uri;
+    return strcspn(*user, "@;>");
+}
+
+// The caller of an incoming INVITE is one of the targets the ringing call
+// is calling
+static bool sip_fork_calls_user(const sip_message_t* msg)
+{
+    char from_uri[128];
+    if (!sip_header_copy_uri(sip_msg_header(msg, SIP_HDR_FROM), from_uri, sizeof(from_uri))) {
+        return false;
+    }
+    const char* caller;
+    size_t caller_len = sip_uri_user(from_uri, &caller);
+
+    for (int i = 0; i < SIP_MAX_CALL_LEGS; i++) {
+        const sip_call_leg_t* leg = &call_legs[i];
+        if (leg->state == SIP_LEG_FREE || leg->fork_id != fork_id) {
+            continue;
+        }
+        const char* target;
+        size_t target_len = sip_uri_user(leg->dialog.request_uri, &target);
+        if (target_len == caller_len && strncmp(target, caller, caller_len) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// re-INVITE: a new offer within a session (hold, resume, codec or address
+// change). We never send re-INVITEs, so the only glare is a second one
+// arriving before the ACK completed the previous exchange: 491, and the
+// other side retries after a random delay (RFC 3261 §14.1).
+static void sip_handle_reinvite(const sip_message_t* msg, const sip_request_headers_t* headers)
+{
+    sip_session_t* session = sip_session_for_request(msg, headers);
+    if (!session) {
+        return;
+    }
+    if (session->state != SIP_SESSION_CONFIRMED) {
+        sip_add_log_entry(SIP_LOG_INFO, "re-INVITE for a session being ended - sending 481");
+        send_sip_response(481, "Call/Transaction Does Not Exist", headers, NULL, NULL);
+        return;
+    }
+    if (session->ack_pending) {
+        sip_add_log_entry(SIP_LOG_INFO, "re-INVITE before the ACK of the previous one - sending 491");
+        send_sip_response(491, "Request Pending", headers, NULL, NULL);
+        return;
+    }
+
+    // Refused offers leave the session as it was (RFC 3261 §14.2)
+    sdp_negotiated_t negotiated;
+    if (!sip_negotiate_remote_sdp(msg, &negotiated)) {
+        send_sip_response(488, "Not Acceptable Here", headers, NULL, NULL);
+        sip_add_log_entry(SIP_LOG_INFO, "488 Not Acceptable Here sent - re-INVITE rejected, session unchanged");
+        return;
+    }
+
+    // Target refresh
+    sip_header_copy_uri(sip_msg_header(msg, SIP_HDR_CONTACT), session->dialog.request_uri,
+                        sizeof(session->dialog.request_uri));
+
+    session->sdp_version++;
+    if (!sip_session_send_answer(session, headers, &negotiated)) {
+        return;
+    }
+
+    if (session == call_session && media_engine_is_running()) {
+        sip_configure_media(&negotiated);
+        media_engine_set_remote(negotiated.address, negotiated.port);
+    }
+    sip_add_log_entry(SIP_LOG_INFO, "re-INVITE answered - session updated");
+}
+
+static void sip_handle_invite(const sip_message_t* msg)
+{
+    sip_add_log_entry(SIP_LOG_INFO, "Incoming INVITE detected");
+
+    char state_log[128];
+    snprintf(state_log, sizeof(state_log), "Processing INVITE in state: %s", state_names[current_state]);
+    sip_add_log_entry(SIP_LOG_INFO, state_log);
+
+    sip_request_headers_t headers = extract_request_headers(msg);
+    if (!headers.valid) {
+        sip_add_log_entry(SIP_LOG_ERROR, "Failed to parse INVITE headers");
+        return;
+    }
+
+    // A To tag puts it inside an existing dialog
+    const char* to_tag;
+    size_t to_tag_len;
+    if (sip_header_param(sip_msg_header(msg, SIP_HDR_TO), "tag", &to_tag, &to_tag_len)) {
+        sip_handle_reinvite(msg, &headers);
+        return;
+    }
+
+    // Glare: a target we are ringing calls the door at the same moment.
+    // Always resolved the same way: their call counts as the answer, and
+    // the outgoing legs are cancelled.
+    if (sip_fork_ringing() && sip_fork_calls_user(msg)) {
+        sip_add_log_entry(SIP_LOG_INFO, "Call from a target being rung - cancelling the outgoing call");
+        sip_fork_cancel_all();
+        media_engine_stop();
+        current_state = SIP_STATE_REGISTERED;
+        call_start_timestamp = 0;
+    }
+
+    // One call at a time
+    if (current_state != SIP_STATE_IDLE && current_state != SIP_STATE_REGISTERED) {
+        char busy_msg[128];
+        snprintf(busy_msg, sizeof(busy_msg), "Busy - cannot accept call (state: %s) - sending 486", state_names[current_state]);
+        sip_add_log_entry(SIP_LOG_INFO, busy_msg);
+        send_sip_response(486, "Busy Here", &headers, NULL, NULL);
+        return;
+    }
+
+    led_handler_set_state(LED_STATE_CALL_INCOMING);
+    sip_add_log_entry(SIP_LOG_INFO, "Processing incoming call");
+
+    // RFC 3261 §20.32: we support no extensions, so any Require gets 420 Bad Extension
+    char required_ext[128];
+    if (sip_msg_copy_header(msg, SIP_HDR_REQUIRE, required_ext, sizeof(required_ext))) {
+        char log_msg[192];
+        snprintf(log_msg, sizeof(log_msg),
+                 "INVITE requires unsupported extension: %s - rejecting with 420", required_ext);
+        sip_add_log_entry(SIP_LOG_ERROR, log_msg);
+
+        char unsupported_hdr[160];
+        snprintf(unsupported_hdr, sizeof(unsupported_hdr), "Unsupported: %s\r\n", required_ext);
+        send_sip_response(420, "Bad Extension", &headers, unsupported_hdr, NULL);
+
+        sip_add_log_entry(SIP_LOG_INFO, "420 Bad Extension sent - INVITE rejected");
+        led_handler_set_state(LED_STATE_IDLE);
+        return;
+    }
+
+    // RFC 3264 §6: answer with the offerer's preferred codec we support, or
+    // refuse the call with 488 when there is none. An INVITE without an offer
+    // would need the offer in the 200 OK and the answer in the ACK, which we
+    // do not handle - treat it like an unusable offer.
+    sdp_negotiated_t negotiated;
+    if (!sip_negotiate_remote_sdp(msg, &negotiated)) {
+        send_sip_response(488, "Not Acceptable Here", &headers, NULL, NULL);
+        sip_add_log_entry(SIP_LOG_INFO, "488 Not Acceptable Here sent - INVITE rejected");
+        led_handler_set_state(LED_STATE_IDLE);
+        return;
+    }
+
+    char local_ip[16];
+    get_local_ip_or_default(local_ip, sizeof(local_ip));
+
+    // Set up the dialog as UAS: our side is the To of the INVITE plus a new
+    // tag, the remote side is its From (SIP task only, too big for the stack)
+    static sip_dialog_t dialog;
+    memset(&dialog, 0, sizeof(dialog));
+    sip_dialog_set_address(&dialog, sip_config.username, local_ip, local_ip,
+                           sip_transport_name(), sip_transport_local_port());
+    snprintf(dialog.from, sizeof(dialog.from), "%s;tag=%lu", headers.to_header, (unsigned long)sip_new_id());
+    snprintf(dialog.to, sizeof(dialog.to), "%s", headers.from_header);
+    snprintf(dialog.call_id, sizeof(dialog.call_id), "%s", headers.call_id);
+    if (!sip_header_copy_uri(sip_msg_header(msg, SIP_HDR_CONTACT), dialog.request_uri,
+                             sizeof(dialog.request_uri))) {
+        sip_header_copy_uri(sip_msg_header(msg, SIP_HDR_FROM), dialog.request_uri,
+                            sizeof(dialog.request_uri));
+    }
+    dialog.cseq = 1;
+
+    sip_session_t* session = sip_session_alloc(&dialog, true);
+    if (!session) {
+        send_sip_response(486, "Busy Here", &headers, NULL, NULL);
+        led_handler_set_state(LED_STATE_IDLE);
+        return;
+    }
+    session->remote_cseq = (uint32_t)headers.cseq_num;
+    session->sdp_session_id = sip_new_id();
+
+    if (!sip_session_send_answer(session, &headers, &negotiated)) {
+        sip_session_free(session);
+        led_handler_set_state(LED_STATE_IDLE);
+        return;
+    }
+
+    call_session = session;
+    current_state = SIP_STATE_CONNECTED;
+    call_start_timestamp = 0;
+    led_handler_set_state(LED_STATE_CALL_ACTIVE);
+    sip_add_log_entry(SIP_LOG_INFO, "Incoming call answered - State: CONNECTED");
+
+    // Reset DTMF decoder state for new call
+    dtmf_reset_call_state();
+
+    sip_configure_media(&negotiated);
+    if (media_engine_start(negotiated.address, negotiated.port, SIP_RTP_PORT)) {
+        sip_add_log_entry(SIP_LOG_INFO, "Media engine started");
+    } else {
+        sip_add_log_entry(SIP_LOG_ERROR, "Failed to start media engine");
+    }
+}
+
+// ACK for our 2xx completes the offer/answer exchange of the INVITE
+static void sip_handle_ack(const sip_message_t* msg)
+{
+    sip_session_t* session = sip_session_find(msg);
+    if (session && (uint32_t)msg->cseq_num == session->invite_cseq) {
+        session->ack_pending = false;
+    }
+}
+
+static void sip_handle_bye(const sip_message_t* msg)
+{
+    sip_add_log_entry(SIP_LOG_INFO, "BYE message detected - processing call termination");
+
+    // 200 OK echoes the request's Via/From/To/Call-ID/CSeq
+    sip_request_headers_t headers = extract_request_headers(msg);
+    if (!headers.valid) {
+        sip_add_log_entry(SIP_LOG_ERROR, "Failed to parse BYE headers");
+        return;
+    }
+
+    sip_session_t* session = sip_session_for_request(msg, &headers);
+    if (!session) {
+        return;
+    }
+    send_sip_response(200, "OK", &headers, NULL, NULL);
+
+    // Also answers a BYE that crossed ours
+    bool was_call = session == call_session;
+    sip_session_free(session);
+    if (was_call) {
+        sip_call_ended("Call ended by remote party");
+    }
+}
+
+static void sip_handle_unsupported(const sip_message_t* msg)
+{
+    char log_msg[128];
+    snprintf(log_msg, sizeof(log_msg), "%.*s method not implemented - sending 501",
+             msg->method_name_len, msg->method_name);
+    sip_add_log_entry(SIP_LOG_INFO, log_msg);
+
+    sip_request_headers_t headers = extract_request_headers(msg);
+    if (!headers.valid) {
+        snprintf(log_msg, sizeof(log_msg), "Failed to parse %.*s headers",
+                 msg->method_name_len, msg->method_name);
+        sip_add_log_entry(SIP_LOG_ERROR, log_msg);
+        return;
+    }
+
+    send_sip_response(501, "Not Implemented", &headers,
+                      "Allow: INVITE, ACK, BYE, CANCEL, OPTIONS, INFO\r\n", NULL);
+}
+
+static void sip_handle_request(const sip_message_t* msg)
+{
+    switch (msg->method) {
+        case SIP_METHOD_INVITE:
+            sip_handle_invite(msg);
+            break;
+        case SIP_METHOD_ACK:
+            sip_handle_ack(msg);
+            break;
+        case SIP_METHOD_BYE:
+            sip_handle_bye(msg);
+            break;
+        case SIP_METHOD_CANCEL:
+            sip_handle_cancel(msg);
+            break;
+        case SIP_METHOD_OPTIONS:
+            sip_handle_options(msg);
+            break;
+        case SIP_METHOD_INFO:
+            sip_handle_info(msg);
+            break;
+        default:
+            sip_handle_unsupported(msg);
+            break;
+    }
+}
+
+// Parse a received datagram once and dispatch on status code or method
+static void sip_handle_message(const char* buffer, int len)
+{
+    // CRLF keep-alive (RFC 5626) - nothing to process
+    if (strspn(buffer, "\r\n") == (size_t)len) {
+        return;
+    }
+
+    sip_add_log_entry(SIP_LOG_RECEIVED, "SIP message received");
+
+    char log_msg[SIP_LOG_MAX_MESSAGE_LEN];
+    snprintf(log_msg, sizeof(log_msg), "Full received: %s", buffer);
+    sip_add_log_entry(SIP_LOG_RECEIVED, log_msg);
+
+    sip_message_t msg;
+    if (!sip_parse_message(buffer, len, &msg)) {
+        sip_add_log_entry(SIP_LOG_ERROR, "Malformed SIP message ignored");
+        return;
+    }
+
+    // Retransmissions are answered by the transaction layer
+    if (sip_txn_receive(&msg, xTaskGetTickCount() * portTICK_PERIOD_MS) == SIP_TXN_ABSORBED) {
+        sip_add_log_entry(SIP_LOG_INFO, "Retransmission absorbed by transaction layer");
+        return;
+    }
+
+    char state_log[128];
+    snprintf(state_log, sizeof(state_log), "Processing message in state: %s", state_names[current_state]);
+    sip_add_log_entry(SIP_LOG_INFO, state_log);
+
+    if (msg.is_response) {
+        sip_handle_response(&msg);
+    } else {
+        sip_handle_request(&msg);
+    }
+}
+
+// Transaction timer B/F/H expired: all retransmissions went unanswered
+static void sip_handle_transaction_timeout(sip_method_t method, bool server, int status_code,
+                                           const char* call_id)
+{
+    // Unanswered keep-alive probes are counted by the keep-alive scheduler
+    if (!server && method == SIP_METHOD_OPTIONS) {
+        return;
+    }
+
+    char log_msg[128];
+    snprintf(log_msg, sizeof(log_msg), "%s %s transaction timed out after %d ms (last status %d)",
+             sip_method_name(method), server ? "server" : "client", SIP_TXN_TIMEOUT_MS, status_code);
+    sip_add_log_entry(SIP_LOG_ERROR, log_msg);
+
+    if (server) {
+        // Our 200 OK to an INVITE was never ACKed - the dialog is dead (RFC 3261 §13.3.1.4)
+        sip_session_t* session = sip_session_find_call_id(call_id);
+        if (method == SIP_METHOD_INVITE && status_code < 300 && session && session->ack_pending) {
+            if (session == call_session) {
+                sip_do_hangup();
+            } else {
+                sip_session_send_bye(session);
+            }
+        }
+        return;
+    }
+
+    // A BYE nobody answered: the session is over anyway
+    if (method == SIP_METHOD_BYE) {
+        sip_session_t* session = sip_session_find_call_id(call_id);
+        if (session && session->state == SIP_SESSION_ENDING) {
+            sip_session_free(session);
+            return;
+        }
+    }
+
+    if (method == SIP_METHOD_INVITE || method == SIP_METHOD_BYE) {
+        // A leg that never answered (or never confirmed our BYE) is gone; the
+        // call fails once no leg is left. The registration is unaffected.
+        sip_call_leg_t* leg = sip_leg_find_call_id(call_id);
+        if (leg && (method == SIP_METHOD_INVITE || leg->state == SIP_LEG_ENDING)) {
+            bool current = leg->fork_id == fork_id && sip_fork_ringing();
+            sip_leg_free(leg);
+            if (current && method == SIP_METHOD_INVITE && sip_fork_pending_legs() == 0) {
+                sip_fork_failed(0);
+            }
+        }
+        return;
+    }
+
+    if (method != SIP_METHOD_REGISTER) {
+        return;
+    }
+
+    // Keep a call alive and try the refresh again shortly
+    if (reg_refreshing && current_state != SIP_STATE_REGISTERED) {
+        reg_refreshing = false;
+        reg_granted_timestamp = xTaskGetTickCount() * portTICK_PERIOD_MS;
+        reg_refresh_ms = SIP_REGISTER_RETRY_MS;
+        sip_add_log_entry(SIP_LOG_INFO, "Registration refresh will be retried after the call");
+        return;
+    }
+    reg_refreshing = false;
+    reg_refresh_ms = 0;
+    reg_sent_timestamp = 0;
+
+    // Another registrar answers: register there now instead of retrying this one
+    if (sip_fail_over()) {
+        sip_switch_registrar();
+        return;
+    }
+
+    // Registrar unreachable: reset the connection and schedule a retry
+    sip_close_socket();
+    sip_add_log_entry(SIP_LOG_INFO, "SIP socket closed due to timeout");
+
+    current_state = SIP_STATE_DISCONNECTED;
+    auth_attempt_count = 0;
+    has_initial_transaction_ids = false;
+
+    last_connection_retry_timestamp = xTaskGetTickCount() * portTICK_PERIOD_MS;
+    sip_add_log_entry(SIP_LOG_INFO, "Connection retry scheduled in 10 seconds");
+}
+
+// Register again over a new connection after sip_connection_lost(). Idle, a
+// fresh REGISTER; during a call, a refresh in the existing binding so the
+// call is not disturbed. Calls and transactions survive: requests within a
+// dialog simply go out over the new connection.
+static void sip_reconnect(void)
+{
+    reconnect_pending = false;
+
+    if (!sip_is_registered() && current_state != SIP_STATE_REGISTERING) {
+        reconnect_timestamp = 0;
+        return;
+    }
+
+    if (!sip_connect_transport()) {
+        if ((current_state == SIP_STATE_REGISTERED || current_state == SIP_STATE_REGISTERING) && sip_fail_over()) {
+            sip_switch_registrar();
+            return;
+        }
+        if (current_state == SIP_STATE_REGISTERED || current_state == SIP_STATE_REGISTERING) {
+            sip_close_socket();
+            current_state = SIP_STATE_DISCONNECTED;
+            last_connection_retry_timestamp = xTaskGetTickCount() * portTICK_PERIOD_MS;
+            sip_add_log_entry(SIP_LOG_ERROR, "Reconnect failed - connection retry scheduled in 10 seconds");
+        } else {
+            reg_granted_timestamp = xTaskGetTickCount() * portTICK_PERIOD_MS;
+            reg_refresh_ms = SIP_REGISTER_RETRY_MS;
+            sip_add_log_entry(SIP_LOG_ERROR, "Reconnect failed - retrying after the call");
+        }
+        return;
+    }
+
+    if (current_state == SIP_STATE_REGISTERED || current_state == SIP_STATE_REGISTERING) {
+        sip_client_register();
+        return;
+    }
+
+    char local_ip[16];
+    get_local_ip_or_default(local_ip, sizeof(local_ip));
+    const char* contact_ip = (strlen(public_ip) > 0) ? public_ip : local_ip;
+    sip_dialog_set_address(&reg_dialog, sip_config.username, local_ip, contact_ip,
+                           sip_transport_name(), sip_transport_local_port());
+    sip_refresh_registration();
+}
+
+// SIP task runs on Core 1 (APP CPU) to avoid interfering with WiFi on Core 0
+static void sip_task(void *pvParameters __attribute__((unused)))
+{
+    // Allocate buffer on heap instead of static to avoid memory issues
+    const size_t buffer_size = SIP_TRANSPORT_MAX_MESSAGE;  // TCP/TLS messages may exceed a datagram
+    char *buffer = malloc(buffer_size);
+    if (!buffer) {
+        ESP_LOGE(TAG, "Failed to allocate SIP receive buffer");
+        vTaskDelete(NULL);
+        return;
+    }
+    int len;
+
+    sip_add_log_entry(SIP_LOG_INFO, "SIP task started on Core 1");
+    
+    while (1) {
+        // Sleep until a datagram arrives, a command is posted or the next
+        // timer (call/response/RTP timeout, retry, auto-registration) is due
+        sip_wait_for_event(sip_next_deadline_ms());
+        
+        // Execute commands queued by other tasks
+        sip_process_commands();
+        
+        // Handle reinitialization request (from web interface)
+        if (reinit_requested) {
+            reinit_requested = false;
+            sip_add_log_entry(SIP_LOG_INFO, "Processing reinitialization request");
+            
+            // Close socket if open
+            if (sip_transport_is_open()) {
+                sip_close_socket();
+                sip_add_log_entry(SIP_LOG_INFO, "SIP socket closed for reinit");
+            }
+            
+            // Stop media if active
+            if (media_engine_is_running()) {
+                media_engine_stop();
+                sip_add_log_entry(SIP_LOG_INFO, "Media engine stopped for reinit");
             }
             
-            // Reload configuration from NVS
+            // Reload configuration from NVS (server may have changed)
             sip_config = sip_load_config();
+            dns_cache_flush();
+            sip_load_registrars();
             
             if (sip_config.configured) {
                 char log_msg[128];
                 snprintf(log_msg, sizeof(log_msg), "Configuration reloaded: %s@%s", 
                          sip_config.username, sip_config.server);
-                sip_add_log_entry("info", log_msg);
+                sip_add_log_entry(SIP_LOG_INFO, log_msg);
                 
-                // Create new socket
-                sip_socket = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
-                if (sip_socket >= 0) {
-                    // Bind socket to port 5060
-                    struct sockaddr_in local_addr;
-                    memset(&local_addr, 0, sizeof(local_addr));
-                    local_addr.sin_family = AF_INET;
-                    local_addr.sin_addr.s_addr = INADDR_ANY;
-                    local_addr.sin_port = htons(5060);
-                    
-                    if (bind(sip_socket, (struct sockaddr*)&local_addr, sizeof(local_addr)) == 0) {
-                        sip_add_log_entry("info", "SIP socket recreated and bound");
-                        current_state = SIP_STATE_IDLE;
-                        
-                        // Trigger auto-registration after delay
-                        init_timestamp = xTaskGetTickCount() * portTICK_PERIOD_MS;
-                        sip_add_log_entry("info", "Auto-registration scheduled");
-                    } else {
-                        sip_add_log_entry("error", "Failed to bind socket after reinit");
-                        close(sip_socket);
-                        sip_socket = -1;
-                        current_state = SIP_STATE_ERROR;
-                    }
+                // Open the (possibly changed) transport
+                if (sip_open_socket()) {
+                    current_state = SIP_STATE_IDLE;
+
+                    // Trigger auto-registration after delay
+                    init_timestamp = xTaskGetTickCount() * portTICK_PERIOD_MS;
+                    sip_add_log_entry(SIP_LOG_INFO, "Auto-registration scheduled");
                 } else {
-                    sip_add_log_entry("error", "Failed to create socket after reinit");
                     current_state = SIP_STATE_ERROR;
                 }
             } else {
-                sip_add_log_entry("info", "No configuration found after reinit");
+                sip_add_log_entry(SIP_LOG_INFO, "No configuration found after reinit");
                 current_state = SIP_STATE_DISCONNECTED;
             }
         }
@@ -790,66 +3186,36 @@ static void sip_task(void *pvParameters __attribute__((unused)))
             uint32_t elapsed = xTaskGetTickCount() * portTICK_PERIOD_MS - call_start_timestamp;
             if (elapsed >= call_timeout_ms) {
                 led_handler_set_state(LED_STATE_ERROR);
-                sip_add_log_entry("error", "Call timeout - no response from server");
+                sip_add_log_entry(SIP_LOG_ERROR, "Call timeout - no response from server");
+                sip_fork_cancel_all();
                 call_start_timestamp = 0;
                 current_state = SIP_STATE_REGISTERED;
-                audio_stop_recording();
-                audio_stop_playback();
-                rtp_stop_session();
+                media_engine_stop();
             }
         }
 
-        // Check for RTP timeout
-        if (current_state == SIP_STATE_CONNECTED && last_rtp_received_timestamp > 0) {
-            uint32_t elapsed_rtp = xTaskGetTickCount() * portTICK_PERIOD_MS - last_rtp_received_timestamp;
+        // Check for RTP timeout (last audio frame is tracked by the media engine)
+        uint32_t last_rtp_received_ms = media_engine_get_last_rx_ms();
+        if (current_state == SIP_STATE_CONNECTED && last_rtp_received_ms > 0) {
+            uint32_t elapsed_rtp = xTaskGetTickCount() * portTICK_PERIOD_MS - last_rtp_received_ms;
             if (elapsed_rtp >= rtp_timeout_ms) {
                 led_handler_set_state(LED_STATE_ERROR);
-                sip_add_log_entry("error", "RTP timeout - no audio received for 5 seconds. Hanging up.");
-                sip_client_hangup();
-                last_rtp_received_timestamp = 0; // Reset timestamp
+                sip_add_log_entry(SIP_LOG_ERROR, "RTP timeout - no audio received for 5 seconds. Hanging up.");
+                sip_do_hangup();
             }
         }
 
-        // Check for SIP response timeout (no response to any sent message)
-        if (last_message_timestamp > 0 && sip_socket >= 0) {
-            uint32_t elapsed = xTaskGetTickCount() * portTICK_PERIOD_MS - last_message_timestamp;
-            if (elapsed >= sip_response_timeout_ms) {
-                sip_add_log_entry("error", "SIP response timeout - no response from server for 3 seconds");
-
-                // Reset connection and schedule retry
-                if (sip_socket >= 0) {
-                    close(sip_socket);
-                    sip_socket = -1;
-                    sip_add_log_entry("info", "SIP socket closed due to timeout");
-                }
-
-                // Clear any pending states
-                if (current_state == SIP_STATE_REGISTERING) {
-                    current_state = SIP_STATE_DISCONNECTED;
-                    auth_attempt_count = 0;
-                    has_initial_transaction_ids = false;
-                } else if (current_state == SIP_STATE_CALLING || current_state == SIP_STATE_RINGING) {
-                    current_state = SIP_STATE_REGISTERED;
-                    call_start_timestamp = 0;
-                    audio_stop_recording();
-                    audio_stop_playback();
-                    rtp_stop_session();
-                } else if (current_state == SIP_STATE_REGISTERED) {
-                    // If we were registered, go to disconnected state
-                    current_state = SIP_STATE_DISCONNECTED;
-                }
-
-                // Clear authentication challenges
-                has_invite_auth_challenge = false;
-                memset(&invite_auth_challenge, 0, sizeof(invite_auth_challenge));
-                invite_auth_attempt_count = 0;
-
-                last_connection_retry_timestamp = xTaskGetTickCount() * portTICK_PERIOD_MS;
-                last_message_timestamp = 0;
-                sip_add_log_entry("info", "Connection retry scheduled in 10 seconds");
+        // Refresh the registration before the registrar lets it expire
+        if (reg_refresh_ms > 0 && sip_is_registered() && sip_transport_is_open()) {
+            uint32_t elapsed = xTaskGetTickCount() * portTICK_PERIOD_MS - reg_granted_timestamp;
+            if (elapsed >= reg_refresh_ms) {
+                sip_refresh_registration();
             }
         }
 
+        // Retransmissions and transaction timeouts (RFC 3261 timers A-K)
+        sip_txn_process(xTaskGetTickCount() * portTICK_PERIOD_MS);
+
         // Check if it's time to retry connection after timeout
         if (last_connection_retry_timestamp > 0) {
             uint32_t elapsed = xTaskGetTickCount() * portTICK_PERIOD_MS - last_connection_retry_timestamp;
@@ -861,49 +3227,30 @@ static void sip_task(void *pvParameters __attribute__((unused)))
                          "Retrying SIP connection: current_state=%s, socket=%d, configured=%d",
                          (current_state < sizeof(state_names)/sizeof(state_names[0])) ?
                          state_names[current_state] : "UNKNOWN",
-                         sip_socket, sip_config.configured ? 1 : 0);
-                sip_add_log_entry("info", retry_debug);
+                         sip_transport_fd(), sip_config.configured ? 1 : 0);
+                sip_add_log_entry(SIP_LOG_INFO, retry_debug);
 
                 // Recreate socket and try to register again
-                if (sip_socket < 0) {
-                    sip_add_log_entry("info", "Creating new socket for retry");
-                    sip_socket = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
-                    if (sip_socket >= 0) {
-                        struct sockaddr_in local_addr;
-                        memset(&local_addr, 0, sizeof(local_addr));
-                        local_addr.sin_family = AF_INET;
-                        local_addr.sin_addr.s_addr = INADDR_ANY;
-                        local_addr.sin_port = htons(5060);
-
-                        if (bind(sip_socket, (struct sockaddr*)&local_addr, sizeof(local_addr)) == 0) {
-                            char bind_msg[128];
-                            snprintf(bind_msg, sizeof(bind_msg),
-                                     "Socket recreated (fd=%d), changing state to IDLE", sip_socket);
-                            sip_add_log_entry("info", bind_msg);
-                            current_state = SIP_STATE_IDLE;
-
-                            // Trigger auto-registration
-                            init_timestamp = xTaskGetTickCount() * portTICK_PERIOD_MS;
-                            sip_add_log_entry("info", "Auto-registration timestamp set - will trigger in next loop iteration");
-                        } else {
-                            sip_add_log_entry("error", "Failed to bind socket after timeout - will retry later");
-                            close(sip_socket);
-                            sip_socket = -1;
-                            // Reschedule retry
-                            last_connection_retry_timestamp = xTaskGetTickCount() * portTICK_PERIOD_MS;
-                        }
+                if (!sip_transport_is_open()) {
+                    sip_add_log_entry(SIP_LOG_INFO, "Creating new socket for retry");
+                    if (sip_open_socket()) {
+                        sip_add_log_entry(SIP_LOG_INFO, "Socket recreated, changing state to IDLE");
+                        current_state = SIP_STATE_IDLE;
+
+                        // Trigger auto-registration
+                        init_timestamp = xTaskGetTickCount() * portTICK_PERIOD_MS;
+                        sip_add_log_entry(SIP_LOG_INFO, "Auto-registration timestamp set - will trigger in next loop iteration");
                     } else {
-                        sip_add_log_entry("error", "Failed to create socket after timeout - will retry later");
+                        sip_add_log_entry(SIP_LOG_ERROR, "Failed to open socket after timeout - will retry later");
                         // Reschedule retry
                         last_connection_retry_timestamp = xTaskGetTickCount() * portTICK_PERIOD_MS;
                     }
                 } else {
                     char socket_msg[128];
                     snprintf(socket_msg, sizeof(socket_msg),
-                             "Socket already exists (fd=%d) during retry - closing and recreating", sip_socket);
-                    sip_add_log_entry("info", socket_msg);
-                    close(sip_socket);
-                    sip_socket = -1;
+                             "Socket already exists (fd=%d) during retry - closing and recreating", sip_transport_fd());
+                    sip_add_log_entry(SIP_LOG_INFO, socket_msg);
+                    sip_close_socket();
                     // Let next iteration handle recreation
                     last_connection_retry_timestamp = xTaskGetTickCount() * portTICK_PERIOD_MS;
                 }
@@ -919,12 +3266,12 @@ static void sip_task(void *pvParameters __attribute__((unused)))
             char auto_reg_msg[256];
             snprintf(auto_reg_msg, sizeof(auto_reg_msg),
                      "Auto-registration triggered: state=%s, socket=%d, configured=%d",
-                     state_names[current_state], sip_socket, sip_config.configured ? 1 : 0);
-            sip_add_log_entry("info", auto_reg_msg);
+                     state_names[current_state], sip_transport_fd(), sip_config.configured ? 1 : 0);
+            sip_add_log_entry(SIP_LOG_INFO, auto_reg_msg);
             
             init_timestamp = 0; // Clear flag so we only try once
             registration_requested = true;
-            sip_add_log_entry("info", "registration_requested flag set to true");
+            sip_add_log_entry(SIP_LOG_INFO, "registration_requested flag set to true");
         }
         
         // Check if registration was requested (manual or auto)
@@ -933,1406 +3280,87 @@ static void sip_task(void *pvParameters __attribute__((unused)))
             snprintf(reg_debug, sizeof(reg_debug),
                      "Processing registration: state=%s, socket=%d, configured=%d",
                      (current_state < sizeof(state_names)/sizeof(state_names[0])) ?
-                     state_names[current_state] : "UNKNOWN", sip_socket, sip_config.configured ? 1 : 0);
-            sip_add_log_entry("info", reg_debug);
-            
-            registration_requested = false;
-            
-            // Recreate socket if it was closed
-            if (sip_socket < 0) {
-                sip_add_log_entry("info", "Socket closed - recreating before registration");
-                
-                sip_socket = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
-                if (sip_socket < 0) {
-                    ESP_LOGE(TAG, "Error creating SIP socket");
-                    sip_add_log_entry("error", "Failed to create SIP socket");
-                    current_state = SIP_STATE_ERROR;
-                    sip_add_log_entry("error", "State changed to ERROR");
-                    continue;
-                }
-                
-                // Bind socket to port 5060
-                struct sockaddr_in local_addr;
-                memset(&local_addr, 0, sizeof(local_addr));
-                local_addr.sin_family = AF_INET;
-                local_addr.sin_addr.s_addr = INADDR_ANY;
-                local_addr.sin_port = htons(5060);
-                
-                if (bind(sip_socket, (struct sockaddr*)&local_addr, sizeof(local_addr)) < 0) {
-                    ESP_LOGE(TAG, "Error binding SIP socket to port 5060");
-                    sip_add_log_entry("error", "Failed to bind socket to port 5060");
-                    close(sip_socket);
-                    sip_socket = -1;
+                     state_names[current_state] : "UNKNOWN", sip_transport_fd(), sip_config.configured ? 1 : 0);
+            sip_add_log_entry(SIP_LOG_INFO, reg_debug);
+            
+            registration_requested = false;
+            
+            // Recreate socket if it was closed
+            if (!sip_transport_is_open()) {
+                sip_add_log_entry(SIP_LOG_INFO, "Socket closed - recreating before registration");
+
+                if (!sip_open_socket()) {
                     current_state = SIP_STATE_ERROR;
-                    sip_add_log_entry("error", "State changed to ERROR");
+                    sip_add_log_entry(SIP_LOG_ERROR, "State changed to ERROR");
                     continue;
                 }
                 
-                sip_add_log_entry("info", "Socket recreated and bound - ready for registration");
+                sip_add_log_entry(SIP_LOG_INFO, "Socket recreated - ready for registration");
             } else {
                 char socket_ok_msg[128];
                 snprintf(socket_ok_msg, sizeof(socket_ok_msg),
-                         "Socket already exists (fd=%d) - proceeding with registration", sip_socket);
-                sip_add_log_entry("info", socket_ok_msg);
+                         "Socket already exists (fd=%d) - proceeding with registration", sip_transport_fd());
+                sip_add_log_entry(SIP_LOG_INFO, socket_ok_msg);
             }
             
-            sip_add_log_entry("info", "Calling sip_client_register()");
+            sip_add_log_entry(SIP_LOG_INFO, "Calling sip_client_register()");
             sip_client_register();
-            sip_add_log_entry("info", "sip_client_register() completed");
+            sip_add_log_entry(SIP_LOG_INFO, "sip_client_register() completed");
         }
         
-        if (sip_socket >= 0) {
-            len = recv(sip_socket, buffer, buffer_size - 1, MSG_DONTWAIT);
-            if (len > 0) {
-                buffer[len] = '\0';
-
-                // Reset timeout timestamp when we receive any response
-                last_message_timestamp = 0;
-
-                sip_add_log_entry("received", "SIP message received");
-
-                // Log received message (full for debugging)
-                char log_msg[SIP_LOG_MAX_MESSAGE_LEN];
-ESP_LOGI(TAG, "log_msg at line 992: %p", (void*)&log_msg);
-                snprintf(log_msg, sizeof(log_msg), "Full received: %s", buffer);
-                sip_add_log_entry("received", log_msg);
-                
-                // Enhanced SIP message processing with better error handling
-                // Check response codes first (more specific than method names)
-                char state_log[128];
-                snprintf(state_log, sizeof(state_log), "Processing message in state: %s", state_names[current_state]);
-                sip_add_log_entry("info", state_log);
-
-                if (strstr(buffer, "SIP/2.0 200 OK")) {
-                    if (current_state == SIP_STATE_REGISTERING) {
-                        current_state = SIP_STATE_REGISTERED;
-                        auth_attempt_count = 0;  // Reset counter on success
-                        has_initial_transaction_ids = false;  // Clear stored IDs
-                        led_handler_set_state(LED_STATE_SIP_REGISTERED);
-                        sip_add_log_entry("info", "SIP registration successful");
-                    } else if (current_state == SIP_STATE_CALLING || current_state == SIP_STATE_RINGING) {
-                        // Clear stored INVITE auth challenge on successful call
-                        has_invite_auth_challenge = false;
-                        memset(&invite_auth_challenge, 0, sizeof(invite_auth_challenge));
-                        invite_auth_attempt_count = 0;  // Reset counter
-                        
-                        char success_log[128];
-                        snprintf(success_log, sizeof(success_log),
-                                 "INVITE authentication successful after %d attempt(s)",
-                                 invite_auth_attempt_count + 1);
-                        sip_add_log_entry("info", success_log);
-
-                        // Call accepted - send ACK and start audio
-                        sip_add_log_entry("info", "Call accepted (200 OK)");
-
-                        // Extract To tag for ACK
-                        char to_tag[32] = {0};
-                        const char* to_hdr = strstr(buffer, "To:");
-                        if (to_hdr) {
-                            const char* tag_ptr = strstr(to_hdr, "tag=");
-                            if (tag_ptr) {
-                                tag_ptr += 4;
-                                const char* tag_term = strpbrk(tag_ptr, ";\r\n ");
-                                if (tag_term) {
-                                    size_t tag_length = tag_term - tag_ptr;
-                                    if (tag_length < sizeof(to_tag)) {
-                                        strncpy(to_tag, tag_ptr, tag_length);
-                                        to_tag[tag_length] = '\0';
-                                    }
-                                }
-                            }
-                        }
-                        
-                        // Send ACK to complete call setup
-                        static char ack_msg[768];  // Increased buffer size
-                        if (!get_local_ip(local_ip, sizeof(local_ip))) {
-                            strcpy(local_ip, "192.168.1.100");
-                        }
-                        
-                        // Extract Call-ID and CSeq for ACK
-                        char call_id[128] = {0};  // Increased buffer size
-                        const char* cid_start = strstr(buffer, "Call-ID:");
-                        if (cid_start) {
-                            cid_start += 8;
-                            while (*cid_start == ' ') {
-                                cid_start++;
-                            }
-                            const char* cid_end = strstr(cid_start, "\r\n");
-                            if (cid_end && cid_start && *cid_start != '\0') {
-                                size_t cid_len = cid_end - cid_start;
-                                if (cid_len > 0 && cid_len < sizeof(call_id)) {
-                                    strncpy(call_id, cid_start, cid_len);
-                                    call_id[cid_len] = '\0';
-                                }
-                            }
-                        }
-                        
-                        // Build ACK message
-                        snprintf(ack_msg, sizeof(ack_msg),
-                                "ACK sip:%s@%s SIP/2.0\r\n"
-                                "Via: SIP/2.0/UDP %s:5060;branch=z9hG4bK%d\r\n"
-                                "From: <sip:%s@%s>;tag=%d\r\n"
-                                "To: <sip:%s@%s>;tag=%s\r\n"
-                                "Call-ID: %s\r\n"
-                                "CSeq: %d ACK\r\n"
-                                "Max-Forwards: 70\r\n"
-                                "Content-Length: 0\r\n\r\n",
-                                sip_config.username, sip_config.server,
-                                local_ip, rand(),
-                                sip_config.username, sip_config.server, initial_invite_from_tag,
-                                sip_config.username, sip_config.server, to_tag,
-                                call_id,
-                                initial_invite_cseq);
-                        
-                        // Send ACK
-                        struct sockaddr_in server_addr;
-                        if (resolve_hostname(sip_config.server, &server_addr, (uint16_t)sip_config.port)) {
-                            sendto(sip_socket, ack_msg, strlen(ack_msg), 0,
-                                  (struct sockaddr*)&server_addr, sizeof(server_addr));
-                            sip_add_log_entry("sent", "ACK sent");
-                        }
-                        
-                        // Extract remote RTP port from SDP (simplified - assumes port 5004)
-                        // In a full implementation, parse the SDP m= line
-                        uint16_t remote_rtp_port = 5004;
-                        const char* sdp_start = strstr(buffer, "\r\n\r\n");
-                        if (sdp_start) {
-                            // Log the SDP for debugging
-                            const char* sdp_end = strstr(sdp_start, "\r\n\r\n");
-                            if (sdp_end) {
-                                size_t sdp_len = sdp_end - sdp_start;
-                                char sdp_log[512];
-                                snprintf(sdp_log, sizeof(sdp_log), "Remote SDP: %.*s", (int)sdp_len, sdp_start);
-                                sip_add_log_entry("info", sdp_log);
-                            }
-
-                            const char* m_line = strstr(sdp_start, "m=audio ");
-                            if (m_line) {
-                                m_line += 8;
-                                int port_val = atoi(m_line);
-                                if (port_val > 0 && port_val <= 65535) {
-                                    remote_rtp_port = (uint16_t)port_val;
-                                }
-                            }
-                        }
-                        
-                        // Parse remote IP from SDP c= line
-                        char remote_ip[64] = {0};
-                        const char* c_line = strstr(sdp_start, "c=IN IP4 ");
-                        if (c_line) {
-                            c_line += 9;  // Skip "c=IN IP4 "
-                            const char* ip_end = strstr(c_line, "\r\n");
-                            if (ip_end) {
-                                size_t ip_len = ip_end - c_line;
-                                if (ip_len < sizeof(remote_ip)) {
-                                    strncpy(remote_ip, c_line, ip_len);
-                                    remote_ip[ip_len] = '\0';
-                                }
-                            }
-                        }
-                        if (strlen(remote_ip) == 0) {
-                            // Fallback to SIP server IP
-                            strncpy(remote_ip, sip_config.server, sizeof(remote_ip) - 1);
-                            remote_ip[sizeof(remote_ip) - 1] = '\0';
-                        }
-
-                        char ip_log[128];
-                        snprintf(ip_log, sizeof(ip_log), "RTP remote IP parsed from SDP: %s (port: %d)", remote_ip, remote_rtp_port);
-                        sip_add_log_entry("info", ip_log);
-                        
-                        // Start RTP session
-                        if (rtp_start_session(remote_ip, remote_rtp_port, 5004)) {
-                            sip_add_log_entry("info", "RTP session started");
-                        } else {
-                            sip_add_log_entry("error", "Failed to start RTP session");
-                        }
-                        
-                        // Start audio
-                        current_state = SIP_STATE_CONNECTED;
-                        call_start_timestamp = 0; // Clear timeout
-                        last_rtp_received_timestamp = xTaskGetTickCount() * portTICK_PERIOD_MS;
-                        led_handler_set_state(LED_STATE_CALL_ACTIVE);
-                        sip_add_log_entry("info", "Call connected - State: CONNECTED");
-                        
-                        // Reset DTMF decoder state for new call
-                        dtmf_reset_call_state();
-                        
-                        audio_start_recording();
-                        audio_start_playback();
-                    }
-                } else if (strstr(buffer, "SIP/2.0 180 Ringing")) {
-                    if (current_state == SIP_STATE_CALLING) {
-                        current_state = SIP_STATE_RINGING;
-                        led_handler_set_state(LED_STATE_RINGING);
-                        sip_add_log_entry("info", "Call ringing (180 Ringing)");
-                    }
-                } else if (strstr(buffer, "SIP/2.0 183 Session Progress")) {
-                    if (current_state == SIP_STATE_CALLING) {
-                        sip_add_log_entry("info", "Session progress (183)");
-                    }
-                } else if (strstr(buffer, "SIP/2.0 401 Unauthorized")) {
-                    if (current_state == SIP_STATE_REGISTERING) {
-                        auth_attempt_count++;
-
-                        ESP_LOGI(TAG, "log_msg at line 1171: %p", (void*)&log_msg);
-                        char auth_log_msg[128];
-                        snprintf(auth_log_msg, sizeof(auth_log_msg), "Authentication required (attempt %d/%d), parsing challenge",
-                                 auth_attempt_count, MAX_AUTH_ATTEMPTS);
-                        sip_add_log_entry("info", auth_log_msg);
-
-                        // Check if we've exceeded max attempts (prevent infinite loop)
-                        if (auth_attempt_count > MAX_AUTH_ATTEMPTS) {
-                            sip_add_log_entry("error", "Max authentication attempts exceeded - authentication failed");
-                            led_handler_set_state(LED_STATE_ERROR);
-                            current_state = SIP_STATE_AUTH_FAILED;
-                            auth_attempt_count = 0;
-                            has_initial_transaction_ids = false;
-                            // Don't return - let the task continue to handle other operations
-                            // The task should not return, as per FreeRTOS requirements
-                            continue;
-                        }
-
-                        // Parse authentication challenge
-                        last_auth_challenge = parse_www_authenticate(buffer);
-
-                        // Extract public IP from Via header for NAT traversal
-                        const char* via_header = strstr(buffer, "Via:");
-                        if (via_header) {
-                            if (extract_received_ip(via_header, public_ip, sizeof(public_ip))) {
-                                char log_msg[128];
-                                snprintf(log_msg, sizeof(log_msg), "Public IP extracted from 401: %s", public_ip);
-                                sip_add_log_entry("info", log_msg);
-                            } else {
-                                sip_add_log_entry("info", "No received IP in 401 response");
-                            }
-                        }
-
-                        if (last_auth_challenge.valid) {
-                            // Send authenticated REGISTER
-                            sip_client_register_auth(&last_auth_challenge);
-                        } else {
-                            sip_add_log_entry("error", "Failed to parse auth challenge");
-                            led_handler_set_state(LED_STATE_ERROR);
-                            current_state = SIP_STATE_AUTH_FAILED;
-                            auth_attempt_count = 0;
-                            has_initial_transaction_ids = false;
-                            sip_add_log_entry("error", "State changed to AUTH_FAILED");
-                        }
-                    } else if (current_state == SIP_STATE_CALLING) {
-                        // Per RFC 3261, a UAC must send an ACK for all final responses to an INVITE, including a 401.
-                        // This stops the server from retransmitting the 401 challenge.
-                        send_ack_for_error_response(buffer);
-
-                        // CRITICAL: Check if this 401 is for our authenticated INVITE or a retransmission
-                        // initial_invite_branch = first INVITE without auth
-                        // auth_invite_branch = authenticated INVITE (only set when retry happens)
-                        
-                        const char* via_ptr = strstr(buffer, "Via:");
-
-                        if (via_ptr && has_invite_auth_challenge && auth_invite_branch != 0) {
-                            // We've sent an authenticated INVITE - check if this 401 is for it
-                            const char* branch_param = strstr(via_ptr, "branch=z9hG4bK");
-                            if (branch_param) {
-                                branch_param += 14; // Skip "branch=z9hG4bK"
-                                // Extract just the numeric part
-                                int received_branch = atoi(branch_param);
-
-                                char branch_log[256];
-                                snprintf(branch_log, sizeof(branch_log),
-                                         "401 response branch=%d, initial=%d, auth=%d",
-                                         received_branch, initial_invite_branch, auth_invite_branch);
-                                sip_add_log_entry("info", branch_log);
-
-                                // If this 401 is for the initial INVITE (before auth), it's a retransmission
-                                if (received_branch == initial_invite_branch && received_branch != auth_invite_branch) {
-                                    sip_add_log_entry("info", "401 is retransmission of initial challenge - ignoring");
-                                    continue;
-                                }
-                            }
-                        }
-
-                        // Extract headers to check Call-ID for debugging
-                        sip_request_headers_t headers = extract_request_headers(buffer);
-                        char debug_log[256];
-                        snprintf(debug_log, sizeof(debug_log), "401 Call-ID: %s, Expected: %s", headers.call_id, invite_call_id_str);
-                        sip_add_log_entry("info", debug_log);
-
-                        // Check if Call-ID matches
-                        if (strcmp(headers.call_id, invite_call_id_str) != 0) {
-                            sip_add_log_entry("info", "Call-ID mismatch in 401 - ignoring");
-                            continue;
-                        }
-
-                        // Check if we've exceeded max attempts
-                        if (invite_auth_attempt_count >= MAX_INVITE_AUTH_ATTEMPTS) {
-                            char err_msg[256];
-                            snprintf(err_msg, sizeof(err_msg),
-                                     "Max INVITE auth attempts (%d) exceeded - giving up on this call",
-                                     MAX_INVITE_AUTH_ATTEMPTS);
-                            sip_add_log_entry("error", err_msg);
-                            current_state = SIP_STATE_REGISTERED;
-                            call_start_timestamp = 0;
-                            has_invite_auth_challenge = false;
-                            invite_auth_attempt_count = 0;
-                            
-                            // Log the authentication failure details for debugging
-                            char fail_debug[512];
-                            snprintf(fail_debug, sizeof(fail_debug),
-                                     "INVITE auth failed - Last attempt used: nonce=%s, calculated response=%s",
-                                     invite_auth_challenge.nonce, "see previous log");
-                            sip_add_log_entry("error", fail_debug);
-                            continue;
-                        }
-                        
-                        // Parse the new authentication challenge
-                        sip_auth_challenge_t new_challenge = parse_www_authenticate(buffer);
-                        if (new_challenge.valid) {
-                            // Update the stored challenge with the latest one from server
-                            // Only reset counter if this is a genuinely NEW nonce (different from previous)
-                            if (!has_invite_auth_challenge ||
-                                strcmp(invite_auth_challenge.nonce, new_challenge.nonce) != 0) {
-                                char log_msg[256];
-                                snprintf(log_msg, sizeof(log_msg),
-                                         "New INVITE auth challenge (nonce changed) - resetting attempt counter");
-                                sip_add_log_entry("info", log_msg);
-                                invite_auth_attempt_count = 0;
-                            }
-                            
-                            invite_auth_challenge = new_challenge;
-                            has_invite_auth_challenge = true;
-                            sip_add_log_entry("info", "INVITE authentication challenge updated - will retry with auth");
-
-                            // Extract the target URI from the To header in the 401 response
-                            static char retry_uri[128] = {0};
-                            const char* to_header = strstr(buffer, "To: ");
-                            if (to_header) {
-                                to_header += 4; // Skip "To: "
-                                const char* uri_start = strstr(to_header, "<sip:");
-                                if (uri_start) {
-                                    uri_start += 1; // Skip "<"
-                                    const char* uri_end = strstr(uri_start, ">");
-                                    if (uri_end) {
-                                        size_t uri_len = uri_end - uri_start;
-                                        if (uri_len < sizeof(retry_uri)) {
-                                            strncpy(retry_uri, uri_start, uri_len);
-                                            retry_uri[uri_len] = '\0';
-                                            
-                                            char retry_log[256];
-                                            snprintf(retry_log, sizeof(retry_log),
-                                                     "Retrying INVITE with auth (attempt %d/%d) to %s",
-                                                     invite_auth_attempt_count + 1, MAX_INVITE_AUTH_ATTEMPTS, retry_uri);
-                                            sip_add_log_entry("info", retry_log);
-                                            sip_client_make_call(retry_uri);
-                                        }
-                                    }
-                                }
-                            }
-                        } else {
-                            sip_add_log_entry("error", "Failed to parse INVITE auth challenge");
-                            current_state = SIP_STATE_REGISTERED;
-                            call_start_timestamp = 0;
-                            has_invite_auth_challenge = false;
-                            invite_auth_attempt_count = 0;
-                        }
-                    } else {
-                        // Received 401 but not in REGISTERING or CALLING state
-                        // Check if this is a retransmission of the initial INVITE 401
-                        const char* via_ptr = strstr(buffer, "Via:");
-
-                        if (via_ptr && initial_invite_branch != 0) {
-                            const char* branch_param = strstr(via_ptr, "branch=z9hG4bK");
-                            if (branch_param) {
-                                branch_param += 14; // Skip "branch=z9hG4bK"
-                                int received_branch = atoi(branch_param);
-
-                                char branch_log[256];
-                                snprintf(branch_log, sizeof(branch_log),
-                                         "401 in CONNECTED: received branch=%d, initial=%d, auth=%d",
-                                         received_branch, initial_invite_branch, auth_invite_branch);
-                                sip_add_log_entry("info", branch_log);
-
-                                // If this 401 is for the initial INVITE (before auth), it's a retransmission
-                                if (received_branch == initial_invite_branch && received_branch != auth_invite_branch) {
-                                    // Extract headers for debugging
-                                    sip_request_headers_t headers = extract_request_headers(buffer);
-                                    char debug_log[256];
-                                    snprintf(debug_log, sizeof(debug_log), "401 retransmission Call-ID: %s, Expected: %s", headers.call_id, invite_call_id_str);
-                                    sip_add_log_entry("info", debug_log);
-                                    sip_add_log_entry("info", "401 in CONNECTED is retransmission of initial challenge - ignoring");
-                                } else {
-                                    // Not a retransmission - log details for further investigation
-                                    char ignore_msg[128];
-                                    snprintf(ignore_msg, sizeof(ignore_msg),
-                                             "Ignoring unexpected 401 in state %s (not retransmission)",
-                                             (current_state < sizeof(state_names)/sizeof(state_names[0])) ?
-                                             state_names[current_state] : "UNKNOWN");
-                                    sip_add_log_entry("info", ignore_msg);
-
-                                    // Enhanced logging for debugging
-                                    sip_request_headers_t headers = extract_request_headers(buffer);
-                                    if (headers.valid) {
-                                        char debug_log[512];
-                                        snprintf(debug_log, sizeof(debug_log),
-                                                 "Unexpected 401 in CONNECTED: Call-ID=%s, Branch=%s, CSeq=%d %s, From=%s, To=%s",
-                                                 headers.call_id, headers.via_header, headers.cseq_num, headers.cseq_method,
-                                                 headers.from_header, headers.to_header);
-                                        sip_add_log_entry("info", debug_log);
-
-                                        // Compare with stored INVITE transaction IDs
-                                        snprintf(debug_log, sizeof(debug_log),
-                                                 "Stored INVITE IDs: Call-ID=%d@local_ip, Branch=%d, CSeq=%d",
-                                                 initial_invite_call_id, initial_invite_branch, initial_invite_cseq);
-                                        sip_add_log_entry("info", debug_log);
-                                    } else {
-                                        sip_add_log_entry("error", "Failed to extract headers from unexpected 401 in CONNECTED state");
-                                    }
-                                }
-                            } else {
-                                // Not a retransmission - log details for further investigation
-                                char ignore_msg[128];
-                                snprintf(ignore_msg, sizeof(ignore_msg),
-                                         "Ignoring unexpected 401 in state %s (not retransmission)",
-                                         (current_state < sizeof(state_names)/sizeof(state_names[0])) ?
-                                         state_names[current_state] : "UNKNOWN");
-                                sip_add_log_entry("info", ignore_msg);
-
-                                // Enhanced logging for debugging
-                                sip_request_headers_t headers = extract_request_headers(buffer);
-                                if (headers.valid) {
-                                    char debug_log[512];
-                                    snprintf(debug_log, sizeof(debug_log),
-                                             "Unexpected 401 in CONNECTED: Call-ID=%s, Branch=%s, CSeq=%d %s, From=%s, To=%s",
-                                             headers.call_id, headers.via_header, headers.cseq_num, headers.cseq_method,
-                                             headers.from_header, headers.to_header);
-                                    sip_add_log_entry("info", debug_log);
-
-                                    // Compare with stored INVITE transaction IDs
-                                    snprintf(debug_log, sizeof(debug_log),
-                                             "Stored INVITE IDs: Call-ID=%d@local_ip, Branch=%d, CSeq=%d",
-                                             initial_invite_call_id, initial_invite_branch, initial_invite_cseq);
-                                    sip_add_log_entry("info", debug_log);
-                                } else {
-                                    sip_add_log_entry("error", "Failed to extract headers from unexpected 401 in CONNECTED state");
-                                }
-                            }
-                        } else {
-                            // Not a retransmission - log details for further investigation
-                            char ignore_msg[128];
-                            snprintf(ignore_msg, sizeof(ignore_msg),
-                                     "Ignoring unexpected 401 in state %s (not retransmission)",
-                                     (current_state < sizeof(state_names)/sizeof(state_names[0])) ?
-                                     state_names[current_state] : "UNKNOWN");
-                            sip_add_log_entry("info", ignore_msg);
-
-                            // Enhanced logging for debugging
-                            sip_request_headers_t headers = extract_request_headers(buffer);
-                            if (headers.valid) {
-                                char debug_log[512];
-                                snprintf(debug_log, sizeof(debug_log),
-                                         "Unexpected 401 in CONNECTED: Call-ID=%s, Expected: %s, Branch=%s, CSeq=%d %s, From=%s, To=%s",
-                                         headers.call_id, invite_call_id_str, headers.via_header, headers.cseq_num, headers.cseq_method,
-                                         headers.from_header, headers.to_header);
-                                sip_add_log_entry("info", debug_log);
-
-                                // Compare with stored INVITE transaction IDs
-                                snprintf(debug_log, sizeof(debug_log),
-                                         "Stored INVITE IDs: Call-ID=%d@local_ip, Branch=%d, CSeq=%d",
-                                         initial_invite_call_id, initial_invite_branch, initial_invite_cseq);
-                                sip_add_log_entry("info", debug_log);
-                            } else {
-                                sip_add_log_entry("error", "Failed to extract headers from unexpected 401 in CONNECTED state");
-                            }
-                        }
-                    }
-                } else if (strstr(buffer, "SIP/2.0 100 Trying")) {
-                    // Provisional response, just log it
-                    sip_add_log_entry("info", "Server processing request (100 Trying)");
-                } else if (strstr(buffer, "SIP/2.0 403 Forbidden")) {
-                    led_handler_set_state(LED_STATE_ERROR);
-                    sip_add_log_entry("error", "SIP forbidden - State: AUTH_FAILED");
-                    if (current_state == SIP_STATE_CALLING || current_state == SIP_STATE_RINGING) {
-                        // Send ACK to stop retransmissions
-                        send_ack_for_error_response(buffer);
-                        
-                        // Clear INVITE authentication state
-                        has_invite_auth_challenge = false;
-                        memset(&invite_auth_challenge, 0, sizeof(invite_auth_challenge));
-                        invite_auth_attempt_count = 0;
-                        
-                        call_start_timestamp = 0; // Clear timeout
-                        current_state = SIP_STATE_REGISTERED; // Return to registered state
-                    } else {
-                        led_handler_set_state(LED_STATE_ERROR);
-                        current_state = SIP_STATE_AUTH_FAILED;
-                    }
-                } else if (strstr(buffer, "SIP/2.0 404 Not Found")) {
-                    led_handler_set_state(LED_STATE_ERROR);
-                    sip_add_log_entry("error", "SIP target not found");
-                    if (current_state == SIP_STATE_CALLING || current_state == SIP_STATE_RINGING) {
-                        // Send ACK to stop retransmissions
-                        send_ack_for_error_response(buffer);
-                        
-                        // Clear INVITE authentication state
-                        has_invite_auth_challenge = false;
-                        memset(&invite_auth_challenge, 0, sizeof(invite_auth_challenge));
-                        invite_auth_attempt_count = 0;
-                        
-                        call_start_timestamp = 0; // Clear timeout
-                        current_state = SIP_STATE_REGISTERED; // Return to registered state
-                    } else {
-                        led_handler_set_state(LED_STATE_ERROR);
-                        current_state = SIP_STATE_ERROR;
-                    }
-                } else if (strstr(buffer, "SIP/2.0 408 Request Timeout")) {
-                    sip_add_log_entry("error", "SIP request timeout");
-                    if (current_state == SIP_STATE_CALLING || current_state == SIP_STATE_RINGING) {
-                        // Send ACK to stop retransmissions
-                        send_ack_for_error_response(buffer);
-                        
-                        // Clear INVITE authentication state
-                        has_invite_auth_challenge = false;
-                        memset(&invite_auth_challenge, 0, sizeof(invite_auth_challenge));
-                        invite_auth_attempt_count = 0;
-                        
-                        call_start_timestamp = 0; // Clear timeout
-                        current_state = SIP_STATE_REGISTERED; // Return to registered state
-                    } else {
-                        current_state = SIP_STATE_TIMEOUT;
-                    }
-                } else if (strstr(buffer, "SIP/2.0 486 Busy Here")) {
-                    sip_add_log_entry("info", "SIP target busy");
-                    
-                    // Send ACK to stop retransmissions
-                    send_ack_for_error_response(buffer);
-                    
-                    // Clear INVITE authentication state
-                    has_invite_auth_challenge = false;
-                    memset(&invite_auth_challenge, 0, sizeof(invite_auth_challenge));
-                    invite_auth_attempt_count = 0;
-                    
-                    call_start_timestamp = 0; // Clear timeout
-                    current_state = SIP_STATE_REGISTERED;
-                } else if (strstr(buffer, "SIP/2.0 487 Request Terminated")) {
-                    sip_add_log_entry("info", "SIP request terminated");
-                    
-                    // Send ACK to stop retransmissions
-                    send_ack_for_error_response(buffer);
-                    
-                    // Clear INVITE authentication state
-                    has_invite_auth_challenge = false;
-                    memset(&invite_auth_challenge, 0, sizeof(invite_auth_challenge));
-                    invite_auth_attempt_count = 0;
-                    
-                    call_start_timestamp = 0; // Clear timeout
-                    current_state = SIP_STATE_REGISTERED;
-                } else if (strstr(buffer, "SIP/2.0 500 Internal Server Error")) {
-                    // Handle 500 Internal Server Error from SIP server
-                    sip_add_log_entry("error", "SIP 500 Internal Server Error received");
-                    
-                    char debug_msg[256];
-                    snprintf(debug_msg, sizeof(debug_msg),
-                             "500 Error - Current state: %s, Socket: %d, Auth attempts: %d",
-                             (current_state < sizeof(state_names)/sizeof(state_names[0])) ?
-                             state_names[current_state] : "UNKNOWN",
-                             sip_socket, auth_attempt_count);
-                    sip_add_log_entry("error", debug_msg);
-                    
-                    // Clear any pending states and authentication
-                    if (current_state == SIP_STATE_REGISTERING) {
-                        sip_add_log_entry("error", "500 during REGISTER - clearing auth state");
-                        auth_attempt_count = 0;
-                        has_initial_transaction_ids = false;
-                        current_state = SIP_STATE_DISCONNECTED;
-                    } else if (current_state == SIP_STATE_CALLING || current_state == SIP_STATE_RINGING) {
-                } else if (strncmp(buffer, "OPTIONS ", 8) == 0) {
-                    // Handle OPTIONS request (capability query / keepalive)
-                    sip_add_log_entry("received", "OPTIONS request received");
-                    
-                    // Extract headers using helper function
-                    sip_request_headers_t headers = extract_request_headers(buffer);
-                    
-                    if (!headers.valid) {
-                        sip_add_log_entry("error", "Failed to parse OPTIONS headers");
-                        continue;
-                    }
-                    
-                    // Build Allow header with supported methods
-                    char extra_headers[256];
-                    snprintf(extra_headers, sizeof(extra_headers),
-                            "Allow: INVITE, ACK, BYE, CANCEL, OPTIONS, INFO\r\n"
-                            "Accept: application/sdp, application/dtmf-relay\r\n"
-                            "Accept-Encoding: identity\r\n"
-                            "Accept-Language: en\r\n"
-                            "Supported: \r\n");
-                    
-                    // Send 200 OK response using helper function
-                    send_sip_response(200, "OK", &headers, extra_headers, NULL);
-                    
-                    sip_add_log_entry("info", "OPTIONS response sent - capabilities advertised (INFO method supported)");
-                } else if (strncmp(buffer, "CANCEL ", 7) == 0) {
-                    // Handle CANCEL request (call cancellation before answer)
-                    sip_add_log_entry("received", "CANCEL request received");
-                    
-                    // Extract headers using helper function
-                    sip_request_headers_t headers = extract_request_headers(buffer);
-                    
-                    if (!headers.valid) {
-                        sip_add_log_entry("error", "Failed to parse CANCEL headers");
-                        continue;
-                    }
-                    
-                    // CANCEL is only valid if we have an ongoing INVITE transaction
-                    if (current_state == SIP_STATE_CALLING || current_state == SIP_STATE_RINGING) {
-                        // Send 200 OK to CANCEL
-                        send_sip_response(200, "OK", &headers, NULL, NULL);
-                        
-                        // TODO: Also send 487 Request Terminated to original INVITE
-                        // (Would require storing INVITE transaction details)
-                        
-                        // Clear call state
-                        current_state = SIP_STATE_REGISTERED;
-                        call_start_timestamp = 0;
-                        
-                        // Stop any audio/RTP that might have started
-                        audio_stop_recording();
-                        audio_stop_playback();
-                        rtp_stop_session();
-                        
-                        sip_add_log_entry("info", "Call cancelled by remote party - returned to REGISTERED");
-                    } else {
-                        // No matching transaction - send 481 Call/Transaction Does Not Exist
-                        sip_add_log_entry("info", "CANCEL for unknown transaction - sending 481");
-                        send_sip_response(481, "Call/Transaction Does Not Exist", &headers, NULL, NULL);
-                    }
-                        sip_add_log_entry("error", "500 during call setup - returning to registered");
-                        call_start_timestamp = 0;
-                        has_invite_auth_challenge = false;
-                        invite_auth_attempt_count = 0;
-                        current_state = SIP_STATE_REGISTERED;
-                        audio_stop_recording();
-                        audio_stop_playback();
-                        rtp_stop_session();
-                    } else {
-                        sip_add_log_entry("error", "500 in other state - entering error state");
-                        current_state = SIP_STATE_ERROR;
-                    }
-                    
-                    // Close socket so retry mechanism can recreate it
-                    if (sip_socket >= 0) {
-                        close(sip_socket);
-                        sip_socket = -1;
-                        sip_add_log_entry("info", "SIP socket closed after 500 error");
-                    }
-                    
-                    // Schedule connection retry
-                    last_connection_retry_timestamp = xTaskGetTickCount() * portTICK_PERIOD_MS;
-                    sip_add_log_entry("info", "Connection retry scheduled in 10 seconds after 500 error");
-                } else if (strstr(buffer, "SIP/2.0 503 Service Unavailable")) {
-                    // Handle 503 Service Unavailable (server overloaded/down)
-                    sip_add_log_entry("error", "SIP 503 Service Unavailable");
-                    
-                    if (current_state == SIP_STATE_REGISTERING) {
-                        auth_attempt_count = 0;
-                        has_initial_transaction_ids = false;
-                        current_state = SIP_STATE_DISCONNECTED;
-                    } else if (current_state == SIP_STATE_CALLING || current_state == SIP_STATE_RINGING) {
-                        call_start_timestamp = 0;
-                        current_state = SIP_STATE_REGISTERED;
-                        audio_stop_recording();
-                        audio_stop_playback();
-                        rtp_stop_session();
-                    }
-                    
-                    // Close socket so retry mechanism can recreate it
-                    if (sip_socket >= 0) {
-                        close(sip_socket);
-                        sip_socket = -1;
-                        sip_add_log_entry("info", "SIP socket closed after 503 error");
-                    }
-                    
-                    last_connection_retry_timestamp = xTaskGetTickCount() * portTICK_PERIOD_MS;
-                    sip_add_log_entry("info", "Connection retry scheduled in 10 seconds after 503 error");
-                } else if (strstr(buffer, "SIP/2.0 603 Decline")) {
-                    // Check if this is a retransmission of a 603 we've already handled
-                    sip_request_headers_t headers = extract_request_headers(buffer);
-
-                    if (headers.valid) {
-                        // Extract Via branch for retransmission detection
-                        char via_branch[64] = {0};
-                        const char* branch_ptr = strstr(headers.via_header, "branch=");
-                        if (branch_ptr) {
-                            branch_ptr += 7;  // Skip "branch="
-                            const char* branch_end = strpbrk(branch_ptr, ";\r\n ");
-                            if (branch_end) {
-                                size_t branch_len = branch_end - branch_ptr;
-                                if (branch_len < sizeof(via_branch)) {
-                                    strncpy(via_branch, branch_ptr, branch_len);
-                                    via_branch[branch_len] = '\0';
-                                }
-                            }
-                        }
-
-                        // Check if this is a retransmission (same Call-ID and branch within 10 seconds)
-                        uint32_t current_time = xTaskGetTickCount() * portTICK_PERIOD_MS;
-                        
-                        if (strlen(last_error_call_id) > 0 &&
-                            strcmp(last_error_call_id, headers.call_id) == 0 &&
-                            strcmp(last_error_via_branch, via_branch) == 0 &&
-                            (current_time - last_error_timestamp) < 10000) {
-                            sip_add_log_entry("info", "603 Decline is a retransmission - ignoring to prevent loop");
-                        } else {
-                            // This is a new error response - process it
-                            sip_add_log_entry("info", "Call declined by remote party");
-
-                            // Store this error response info for retransmission detection
-                            strncpy(last_error_call_id, headers.call_id, sizeof(last_error_call_id) - 1);
-                            strncpy(last_error_via_branch, via_branch, sizeof(last_error_via_branch) - 1);
-                            last_error_timestamp = current_time;
-
-                            // Send ACK to stop retransmissions (RFC 3261 requirement)
-                            send_ack_for_error_response(buffer);
-
-                            // Clear INVITE authentication state to prevent retransmission loops
-                            has_invite_auth_challenge = false;
-                            memset(&invite_auth_challenge, 0, sizeof(invite_auth_challenge));
-                            invite_auth_attempt_count = 0;
-
-                            call_start_timestamp = 0; // Clear timeout
-                            current_state = SIP_STATE_REGISTERED;
-
-                            sip_add_log_entry("info", "INVITE authentication state cleared - ready for new call");
-                        }
-                    } else {
-                        // Failed to parse headers - send ACK anyway to be safe
-                        sip_add_log_entry("error", "Failed to parse 603 headers - sending ACK anyway");
-                        send_ack_for_error_response(buffer);
-                    }
-                } else if (strncmp(buffer, "INFO ", 5) == 0) {
-                    // Handle INFO request (DTMF signaling, keepalive, etc.)
-                    sip_add_log_entry("received", "INFO request received");
-
-                    // Extract headers using helper function
-                    sip_request_headers_t headers = extract_request_headers(buffer);
-
-                    if (!headers.valid) {
-                        sip_add_log_entry("error", "Failed to parse INFO headers");
-                        continue;
-                    }
+        // A datagram, or every complete message buffered on the TCP/TLS connection
+        while ((len = sip_transport_receive(buffer, buffer_size)) > 0) {
+            sip_handle_message(buffer, len);
+        }
+        if (len < 0) {
+            sip_connection_lost();
+        }
+        if (sip_transport_pong_received()) {
+            uint32_t answered = sip_keepalive_answered();
+            sip_keepalive_on_pong(xTaskGetTickCount() * portTICK_PERIOD_MS);
+            sip_registrar_sample(answered);
+        }
 
-                    // Extract Content-Type and body for DTMF analysis
-                    const char* content_type = strstr(buffer, "Content-Type:");
-                    const char* body_start = strstr(buffer, "\r\n\r\n");
-                    char dtmf_signal = '\0';
-                    int dtmf_duration = 0;
-
-                    if (content_type && body_start) {
-                        body_start += 4;  // Skip "\r\n\r\n"
-
-                        // Check for DTMF relay content type
-                        if (strstr(content_type, "application/dtmf-relay") ||
-                            strstr(content_type, "application/dtmf")) {
-
-                            // Parse DTMF signal from body
-                            const char* signal_line = strstr(body_start, "Signal=");
-                            if (signal_line) {
-                                signal_line += 7;  // Skip "Signal="
-                                dtmf_signal = *signal_line;
-
-                                // Validate DTMF character
-                                if ((dtmf_signal >= '0' && dtmf_signal <= '9') ||
-                                    dtmf_signal == '*' || dtmf_signal == '#' ||
-                                    (dtmf_signal >= 'A' && dtmf_signal <= 'D') ||
-                                    (dtmf_signal >= 'a' && dtmf_signal <= 'd')) {
-
-                                    // Extract duration if present
-                                    const char* duration_line = strstr(body_start, "Duration=");
-                                    if (duration_line) {
-                                        duration_line += 9;  // Skip "Duration="
-                                        dtmf_duration = atoi(duration_line);
-                                    }
-
-                                    char dtmf_log[128];
-                                    snprintf(dtmf_log, sizeof(dtmf_log),
-                                             "DTMF via INFO: signal='%c', duration=%d ms",
-                                             dtmf_signal, dtmf_duration);
-                                    sip_add_log_entry("info", dtmf_log);
-
-                                    // Process DTMF if we're in a connected call
-                                    if (current_state == SIP_STATE_CONNECTED) {
-                                        // Convert to event code for DTMF decoder
-                                        uint8_t event_code = 0;
-                                        switch (dtmf_signal) {
-                                            case '0': event_code = 0; break;
-                                            case '1': event_code = 1; break;
-                                            case '2': event_code = 2; break;
-                                            case '3': event_code = 3; break;
-                                            case '4': event_code = 4; break;
-                                            case '5': event_code = 5; break;
-                                            case '6': event_code = 6; break;
-                                            case '7': event_code = 7; break;
-                                            case '8': event_code = 8; break;
-                                            case '9': event_code = 9; break;
-                                            case '*': event_code = 10; break;
-                                            case '#': event_code = 11; break;
-                                            case 'A': case 'a': event_code = 12; break;
-                                            case 'B': case 'b': event_code = 13; break;
-                                            case 'C': case 'c': event_code = 14; break;
-                                            case 'D': case 'd': event_code = 15; break;
-                                            default:
-                                                sip_add_log_entry("warning", "Invalid DTMF signal in INFO packet");
-                                                event_code = 255;  // Invalid
-                                                break;
-                                        }
-
-                                        if (event_code <= 15) {
-                                            // Process as telephone-event
-                                            dtmf_process_telephone_event(event_code);
-                                        }
-                                    } else {
-                                        char state_warning[128];
-                                        snprintf(state_warning, sizeof(state_warning),
-                                                 "DTMF INFO received but not in CONNECTED state (state=%s)",
-                                                 (current_state < sizeof(state_names)/sizeof(state_names[0])) ?
-                                                 state_names[current_state] : "UNKNOWN");
-                                        sip_add_log_entry("warning", state_warning);
-                                    }
-                                } else {
-                                    char invalid_signal[64];
-                                    snprintf(invalid_signal, sizeof(invalid_signal),
-                                             "Invalid DTMF signal in INFO: '%c'", dtmf_signal);
-                                    sip_add_log_entry("warning", invalid_signal);
-                                }
-                            } else {
-                                sip_add_log_entry("info", "INFO with DTMF content-type but no Signal line");
-                            }
-                        } else {
-                            // Log other INFO content types
-                            char content_log[128];
-                            const char* ct_end = strstr(content_type, "\r\n");
-                            if (ct_end) {
-                                size_t ct_len = ct_end - content_type;
-                                if (ct_len < sizeof(content_log)) {
-                                    strncpy(content_log, content_type, ct_len);
-                                    content_log[ct_len] = '\0';
-                                    sip_add_log_entry("info", content_log);
-                                }
-                            }
-                        }
-                    }
+        if (sip_is_registered() && sip_transport_is_connected() && !reconnect_pending) {
+            sip_keepalive_run();
+        }
+        if (sip_transport_is_open() && !sip_transport_reliable()) {
+            sip_probe_registrars();
+        }
 
-                    // Send 200 OK response to INFO
-                    send_sip_response(200, "OK", &headers, NULL, NULL);
-                    sip_add_log_entry("sent", "200 OK response to INFO");
-                } else if (strncmp(buffer, "INVITE ", 7) == 0) {
-                    // Check for INVITE request (not response)
-                    sip_add_log_entry("info", "Incoming INVITE detected");
-
-                    // Log current state for debugging
-                    const char* current_state_name = (current_state < sizeof(state_names)/sizeof(state_names[0])) ?
-                                                    state_names[current_state] : "UNKNOWN";
-                    char state_log[128];
-                    snprintf(state_log, sizeof(state_log), "Processing INVITE in state: %s", current_state_name);
-                    sip_add_log_entry("info", state_log);
-
-                    // Only accept if we're in IDLE or REGISTERED state
-                    if (current_state != SIP_STATE_IDLE && current_state != SIP_STATE_REGISTERED) {
-                        char busy_msg[128];
-                        snprintf(busy_msg, sizeof(busy_msg), "Busy - cannot accept call (state: %s)", current_state_name);
-                        sip_add_log_entry("error", busy_msg);
-                        // Send 486 Busy Here response would be implemented here
-                        continue;
-                    }
-                    
-                    led_handler_set_state(LED_STATE_CALL_INCOMING);
-                    sip_add_log_entry("info", "Processing incoming call");
-                    
-                    
-                    // Check for Require header early - reject if it requires unsupported extensions
-                    // RFC 3261 §20.32: If we don't support a required extension, send 420 Bad Extension
-                    const char* require_hdr = strstr(buffer, "Require:");
-                    if (require_hdr) {
-                        // Extract required extensions
-                        require_hdr += 8;  // Skip "Require:"
-                        while (*require_hdr == ' ') require_hdr++;  // Skip whitespace
-                        const char* require_end = strstr(require_hdr, "\r\n");
-                        
-                        if (require_end) {
-                            char required_ext[256];
-                            size_t len = require_end - require_hdr;
-                            if (len < sizeof(required_ext)) {
-                                strncpy(required_ext, require_hdr, len);
-                                required_ext[len] = '\0';
-                                
-                                char log_msg[256];
-                                snprintf(log_msg, sizeof(log_msg),
-                                         "INVITE requires unsupported extension: %s - rejecting with 420", required_ext);
-                                sip_add_log_entry("error", log_msg);
-                                
-                                // Extract headers for response
-                                sip_request_headers_t headers = extract_request_headers(buffer);
-                                
-                                if (headers.valid) {
-                                    // Build Unsupported header
-                                    char unsupported_hdr[512];
-                                    snprintf(unsupported_hdr, sizeof(unsupported_hdr),
-                                             "Unsupported: %s\r\n", required_ext);
-                                    
-                                    // Send 420 Bad Extension
-                                    send_sip_response(420, "Bad Extension", &headers, unsupported_hdr, NULL);
-                                    
-                                    sip_add_log_entry("info", "420 Bad Extension sent - INVITE rejected");
-                                } else {
-                                    sip_add_log_entry("error", "Failed to parse headers for 420 response");
-                                }
-                                
-                                continue;  // Don't process this INVITE further
-                            }
-                        }
-                    }
-                    // Extract headers for response
-                    static char call_id[128] = {0};
-                    static char from_header[256] = {0};
-                    static char to_header[256] = {0};
-                    static char via_header[256] = {0};
-                    int cseq_num = 1;
-                    
-                    // Extract Call-ID
-                    const char* cid_ptr = strstr(buffer, "Call-ID:");
-                    if (cid_ptr) {
-                        cid_ptr += 8;
-                        while (*cid_ptr == ' ') {
-                            cid_ptr++;
-                        }
-                        const char* cid_term = strstr(cid_ptr, "\r\n");
-                        if (cid_term && cid_ptr && *cid_ptr != '\0') {
-                            size_t cid_length = cid_term - cid_ptr;
-                            if (cid_length > 0 && cid_length < sizeof(call_id)) {
-                                strncpy(call_id, cid_ptr, cid_length);
-                                call_id[cid_length] = '\0';
-                            }
-                        }
-                    }
-                    
-                    // Extract From
-                    const char* from_ptr = strstr(buffer, "From:");
-                    if (from_ptr) {
-                        from_ptr += 5;
-                        while (*from_ptr == ' ') {
-                            from_ptr++;
-                        }
-} else if (strncmp(buffer, "INFO ", 5) == 0) {
-                    // Handle RFC 2976 INFO method for DTMF relay (secure alternative to audio tones)
-                    sip_add_log_entry("received", "RFC 2976 INFO method received");
-                    
-                    // Extract headers using helper function
-                    sip_request_headers_t headers = extract_request_headers(buffer);
-                    
-                    if (!headers.valid) {
-                        sip_add_log_entry("error", "Failed to parse INFO headers");
-                        continue;
-                    }
-                    
-                    // Check Content-Type for DTMF relay
-                    const char* content_type = strstr(buffer, "Content-Type:");
-                    if (content_type && strstr(content_type, "application/dtmf-relay")) {
-                        // Process DTMF relay message
-                        sip_add_log_entry("info", "Processing DTMF relay INFO message");
-                        
-                        // Extract Signal and Duration from body
-                        const char* body_start = strstr(buffer, "\r\n\r\n");
-                        if (body_start) {
-                            body_start += 4; // Skip \r\n\r\n
-                            
-                            char signal[8] = {0};
-                            char duration[8] = {0};
-                            
-                            // Parse Signal= parameter
-                            const char* signal_line = strstr(body_start, "Signal=");
-                            if (signal_line) {
-                                signal_line += 7; // Skip "Signal="
-                                const char* signal_end = strpbrk(signal_line, "\r\n; ");
-                                if (signal_end) {
-                                    size_t signal_len = signal_end - signal_line;
-                                    if (signal_len < sizeof(signal)) {
-                                        strncpy(signal, signal_line, signal_len);
-                                        signal[signal_len] = '\0';
-                                    }
-                                } else {
-                                    strncpy(signal, signal_line, sizeof(signal) - 1);
-                                }
-                            }
-                            
-                            // Parse Duration= parameter
-                            const char* duration_line = strstr(body_start, "Duration=");
-                            if (duration_line) {
-                                duration_line += 9; // Skip "Duration="
-                                const char* duration_end = strpbrk(duration_line, "\r\n; ");
-                                if (duration_end) {
-                                    size_t duration_len = duration_end - duration_line;
-                                    if (duration_len < sizeof(duration)) {
-                                        strncpy(duration, duration_line, duration_len);
-                                        duration[duration_len] = '\0';
-                                    }
-                                } else {
-                                    strncpy(duration, duration_line, sizeof(duration) - 1);
-                                }
-                            }
-                            
-                            char dtmf_log[128];
-                            snprintf(dtmf_log, sizeof(dtmf_log), "DTMF relay: Signal=%s, Duration=%s", signal, duration);
-                            sip_add_log_entry("info", dtmf_log);
-                            
-                            // Process DTMF character if valid
-                            if (strlen(signal) == 1) {
-                                char dtmf_char = signal[0];
-                                ESP_LOGI(TAG, "DTMF from INFO: %c", dtmf_char);
-                                
-                                // Convert to event code and process via RFC 4733 handler
-                                uint8_t event_code = 255; // Invalid
-                                switch(dtmf_char) {
-                                    case '0': event_code = DTMF_EVENT_0; break;
-                                    case '1': event_code = DTMF_EVENT_1; break;
-                                    case '2': event_code = DTMF_EVENT_2; break;
-                                    case '3': event_code = DTMF_EVENT_3; break;
-                                    case '4': event_code = DTMF_EVENT_4; break;
-                                    case '5': event_code = DTMF_EVENT_5; break;
-                                    case '6': event_code = DTMF_EVENT_6; break;
-                                    case '7': event_code = DTMF_EVENT_7; break;
-                                    case '8': event_code = DTMF_EVENT_8; break;
-                                    case '9': event_code = DTMF_EVENT_9; break;
-                                    case '*': event_code = DTMF_EVENT_STAR; break;
-                                    case '#': event_code = DTMF_EVENT_HASH; break;
-                                    case 'A': case 'a': event_code = DTMF_EVENT_A; break;
-                                    case 'B': case 'b': event_code = DTMF_EVENT_B; break;
-                                    case 'C': case 'c': event_code = DTMF_EVENT_C; break;
-                                    case 'D': case 'd': event_code = DTMF_EVENT_D; break;
-                                    default:
-                                        ESP_LOGW(TAG, "Invalid DTMF character in INFO: %c", dtmf_char);
-                                        break;
-                                }
-                                
-                                if (event_code <= DTMF_EVENT_D) {
-                                    // Process via RFC 4733 handler (end bit set for INFO method)
-                                    dtmf_process_telephone_event(event_code);
-                                    sip_add_log_entry("info", "DTMF processed via RFC 2976 INFO method");
-                                }
-                            }
-                        }
-                        
-                        // Send 200 OK response for INFO
-                        send_sip_response(200, "OK", &headers, NULL, NULL);
-                        sip_add_log_entry("sent", "200 OK response to INFO DTMF relay");
-                    } else {
-                        // INFO method for non-DTMF purposes - send 501 Not Implemented
-                        sip_add_log_entry("info", "INFO method not supported for non-DTMF purposes");
-                        char allow_header[128];
-                        snprintf(allow_header, sizeof(allow_header),
-                                "Allow: INVITE, ACK, BYE, CANCEL, OPTIONS\r\n"
-                                "Accept: application/dtmf-relay\r\n");
-                        send_sip_response(501, "Not Implemented", &headers, allow_header, NULL);
-                    }
-                } else if (strncmp(buffer, "UPDATE ", 7) == 0 ||
-                           strncmp(buffer, "PRACK ", 6) == 0 ||
-                           strncmp(buffer, "SUBSCRIBE ", 10) == 0 ||
-                           strncmp(buffer, "NOTIFY ", 7) == 0 ||
-                           strncmp(buffer, "MESSAGE ", 8) == 0 ||
-                           strncmp(buffer, "REFER ", 6) == 0) {
-                    // Handle other unsupported SIP methods with proper error response
-                    
-                    // Extract method name from request line
-                    char method[32] = {0};
-                    const char* space = strchr(buffer, ' ');
-                    if (space) {
-                        size_t len = space - buffer;
-                        if (len < sizeof(method)) {
-                            strncpy(method, buffer, len);
-                            method[len] = '\0';
-                        }
-                    }
-                    
-                    char log_msg[128];
-                    snprintf(log_msg, sizeof(log_msg), "%s method not implemented - sending 501", method);
-                    sip_add_log_entry("info", log_msg);
-                    
-                    // Extract headers using helper function
-                    sip_request_headers_t headers = extract_request_headers(buffer);
-                    
-                    if (!headers.valid) {
-                        char err_msg[128];
-                        snprintf(err_msg, sizeof(err_msg), "Failed to parse %s headers", method);
-                        sip_add_log_entry("error", err_msg);
-                        continue;
-                    }
-                    
-                    // Build Allow header showing what we DO support
-                    char allow_header[128];
-                    snprintf(allow_header, sizeof(allow_header),
-                            "Allow: INVITE, ACK, BYE, CANCEL, OPTIONS, INFO\r\n");
-                    
-                    // Send 501 Not Implemented response
-                    send_sip_response(501, "Not Implemented", &headers, allow_header, NULL);
-                    
-                    snprintf(log_msg, sizeof(log_msg), "%s not implemented - 501 sent with supported methods", method);
-                    sip_add_log_entry("info", log_msg);
-                        const char* from_term = strstr(from_ptr, "\r\n");
-                        if (from_term && from_ptr && *from_ptr != '\0') {
-                            size_t from_length = from_term - from_ptr;
-                            if (from_length > 0 && from_length < sizeof(from_header)) {
-                                strncpy(from_header, from_ptr, from_length);
-                                from_header[from_length] = '\0';
-                            }       
-                        }
-                    }
-                    
-                    // Extract To
-                    const char* to_ptr = strstr(buffer, "To:");
-                    if (to_ptr) {
-                        to_ptr += 3;
-                        while (*to_ptr == ' ') {
-                            to_ptr++;
-                        }
-                        const char* to_term = strstr(to_ptr, "\r\n");
-                        if (to_term && to_ptr && *to_ptr != '\0') {
-                            size_t to_length = to_term - to_ptr;
-                            if (to_length > 0 && to_length < sizeof(to_header)) {
-                                strncpy(to_header, to_ptr, to_length);
-                                to_header[to_length] = '\0';
-                            }
-                        }
-                    }
-                    
-                    // Extract Via
-                    const char* via_ptr = strstr(buffer, "Via:");
-                    if (via_ptr) {
-                        via_ptr += 4;
-                        while (*via_ptr == ' ') {
-                            via_ptr++;
-                        }
-                        const char* via_term = strstr(via_ptr, "\r\n");
-                        if (via_term && via_ptr && *via_ptr != '\0') {
-                            size_t via_length = via_term - via_ptr;
-                            if (via_length > 0 && via_length < sizeof(via_header)) {
-                                strncpy(via_header, via_ptr, via_length);
-                                via_header[via_length] = '\0';
-                            }
-                        }
-                    }
-                    
-                    // Extract CSeq
-                    const char* cseq_ptr = strstr(buffer, "CSeq:");
-                    if (cseq_ptr) {
-                        cseq_ptr += 5;
-                        while (*cseq_ptr == ' ') {
-                            cseq_ptr++;
-                        }
-                        cseq_num = atoi(cseq_ptr);
-                    }
-                    
-                    
-                    // Create SDP for response
-                    static char sdp[256];
-                    snprintf(sdp, sizeof(sdp), 
-                             "v=0\r\n"
-                             "o=- %d 0 IN IP4 %s\r\n"
-                             "s=ESP32 Doorbell\r\n"
-                             "c=IN IP4 %s\r\n"
-                             "t=0 0\r\n"
-                             "m=audio 5004 RTP/AVP 0 8 101\r\n"
-                             "a=rtpmap:0 PCMU/8000\r\n"
-                             "a=rtpmap:8 PCMA/8000\r\n"
-                             "a=rtpmap:101 telephone-event/8000\r\n"
-                             "a=fmtp:101 0-15\r\n"
-                             "a=sendrecv\r\n",
-                             rand(), local_ip, local_ip);
-                    
-                    // Add tag to To header if not present
-                    char to_with_tag[300];
-                    if (strstr(to_header, "tag=") == NULL) {
-                        snprintf(to_with_tag, sizeof(to_with_tag), "%s;tag=%d", to_header, rand());
-                    } else {
-                        strncpy(to_with_tag, to_header, sizeof(to_with_tag) - 1);
-                        to_with_tag[sizeof(to_with_tag) - 1] = '\0';
-                    }
-                    
-                    // Build 200 OK response
-                    static char response[1536];
-                    snprintf(response, sizeof(response),
-                             "SIP/2.0 200 OK\r\n"
-                             "Via: %s\r\n"
-                             "From: %s\r\n"
-                             "To: %s\r\n"
-                             "Call-ID: %s\r\n"
-                             "CSeq: %d INVITE\r\n"
-                             "Contact: <sip:%s@%s:5060>\r\n"
-                             "Content-Type: application/sdp\r\n"
-                             "Content-Length: %d\r\n\r\n%s",
-                             via_header,
-                             from_header,
-                             to_with_tag,
-                             call_id,
-                             cseq_num,
-                             sip_config.username, local_ip,
-                             strlen(sdp), sdp);
-                    
-                    // Send 200 OK
-                    struct sockaddr_in server_addr;
-
-                    if (resolve_hostname(sip_config.server, &server_addr, (uint16_t)sip_config.port)) {
-                        int sent = sendto(sip_socket, response, strlen(response), 0,
-                                          (struct sockaddr*)&server_addr, sizeof(server_addr));
-                        if (sent > 0) {
-                            sip_add_log_entry("sent", "200 OK response to INVITE");
-
-                            // Start RTP session
-                            char remote_ip[64];
-                            strncpy(remote_ip, sip_config.server, sizeof(remote_ip) - 1);
-                            remote_ip[sizeof(remote_ip) - 1] = '\0';
-
-                            char rtp_log[128];
-                            snprintf(rtp_log, sizeof(rtp_log), "Starting RTP session to %s:5004", remote_ip);
-                            sip_add_log_entry("info", rtp_log);
-
-                            if (rtp_start_session(remote_ip, 5004, 5004)) {
-                                sip_add_log_entry("info", "RTP session started");
-                            } else {
-                                sip_add_log_entry("error", "Failed to start RTP session");
-                            }
-
-                            // Update state
-                            current_state = SIP_STATE_CONNECTED;
-                            call_start_timestamp = 0;
-                            led_handler_set_state(LED_STATE_CALL_ACTIVE);
-                            sip_add_log_entry("info", "Incoming call answered - State: CONNECTED");
-
-                            // Reset DTMF decoder state for new call
-                            dtmf_reset_call_state();
-
-                            audio_start_recording();
-                            audio_start_playback();
-                        } else {
-                            sip_add_log_entry("error", "Failed to send 200 OK");
-                        }
-                    } else {
-                        sip_add_log_entry("error", "DNS lookup failed");
-                    }
-                } else if (strncmp(buffer, "BYE sip:", 8) == 0 || strncmp(buffer, "BYE ", 4) == 0) {
-                    // Check for BYE request (not response)
-                    sip_add_log_entry("info", "BYE message detected - processing call termination");
-                    
-                    // Send 200 OK response to BYE
-                    static char bye_response[768];  // Increased buffer size
-                    char local_ip[16];
-                    if (!get_local_ip(local_ip, sizeof(local_ip))) {
-                        strcpy(local_ip, "192.168.1.100");
-                    }
-                    
-                    // Extract Call-ID and CSeq for response
-                    char call_id[128] = {0};  // Increased buffer size
-                    int cseq_num = 1;
-                    const char* bye_cid_ptr = strstr(buffer, "Call-ID:");
-                    if (bye_cid_ptr) {
-                        bye_cid_ptr += 8;
-                        while (*bye_cid_ptr == ' ') {
-                            bye_cid_ptr++;
-                        }
-                        const char* bye_cid_term = strstr(bye_cid_ptr, "\r\n");
-                        if (bye_cid_term) {
-                            size_t bye_cid_len = bye_cid_term - bye_cid_ptr;
-                            if (bye_cid_len < sizeof(call_id)) {
-                                strncpy(call_id, bye_cid_ptr, bye_cid_len);
-                                call_id[bye_cid_len] = '\0';
-                            }
-                        }
-                    }
-                    
-                    const char* bye_cseq_ptr = strstr(buffer, "CSeq:");
-                    if (bye_cseq_ptr) {
-                        bye_cseq_ptr += 5;
-                        while (*bye_cseq_ptr == ' ') {
-                            bye_cseq_ptr++;
-                        }
-                        cseq_num = atoi(bye_cseq_ptr);
-                    }
-                    
-                    snprintf(bye_response, sizeof(bye_response),
-                            "SIP/2.0 200 OK\r\n"
-                            "Via: SIP/2.0/UDP %s:5060\r\n"
-                            "From: <sip:%s@%s>\r\n"
-                            "To: <sip:%s@%s>\r\n"
-                            "Call-ID: %s\r\n"
-                            "CSeq: %d BYE\r\n"
-                            "Content-Length: 0\r\n\r\n",
-                            local_ip,
-                            sip_config.username, sip_config.server,
-                            sip_config.username, sip_config.server,
-                            call_id, cseq_num);
-                    
-                    struct sockaddr_in server_addr;
-                    if (resolve_hostname(sip_config.server, &server_addr, (uint16_t)sip_config.port)) {
-                        sendto(sip_socket, bye_response, strlen(bye_response), 0,
-                              (struct sockaddr*)&server_addr, sizeof(server_addr));
-                        sip_add_log_entry("sent", "200 OK response to BYE");
-                    }
-                    
-                    current_state = SIP_STATE_REGISTERED;
-                    call_start_timestamp = 0; // Clear timeout
-                    led_handler_set_state(LED_STATE_IDLE);
-
-                    // Reset DTMF decoder state when call ends
-                    dtmf_reset_call_state();
-
-                    audio_stop_recording();
-                    audio_stop_playback();
-                    rtp_stop_session();
-                    sip_add_log_entry("info", "RTP session stopped - State changed to REGISTERED");
-                }
+        // Registrar silent: with another one available, do not wait for the
+        // transaction to time out
+        if (reg_sent_timestamp > 0 && sip_registrar_count() > 1 &&
+            (current_state == SIP_STATE_REGISTERING || current_state == SIP_STATE_REGISTERED) &&
+            xTaskGetTickCount() * portTICK_PERIOD_MS - reg_sent_timestamp >= SIP_REGISTER_FAILOVER_MS) {
+            reg_sent_timestamp = 0;
+            if (sip_fail_over()) {
+                sip_switch_registrar();
             }
         }
-        
-        // Audio processing during active call
-        if (current_state == SIP_STATE_CONNECTED && rtp_is_active()) {
-            // Send audio (20ms frames at 8kHz = 160 samples)
-            int16_t tx_buffer[160];
-            size_t samples_read = audio_read(tx_buffer, 160);
-            if (samples_read > 0) {
-                // Send audio via RTP
-                int sent = rtp_send_audio(tx_buffer, samples_read);
-                if (sent > 0) {
-                    char rtp_log[128];
-                    snprintf(rtp_log, sizeof(rtp_log), "RTP audio sent: %d samples (%d bytes)", samples_read, sent);
-                    sip_add_log_entry("info", rtp_log);
-                } else {
-                    char rtp_log[128];
-                    snprintf(rtp_log, sizeof(rtp_log), "RTP send failed: %d", sent);
-                    sip_add_log_entry("error", rtp_log);
-                }
-            } else {
-                char rtp_log[128];
-                snprintf(rtp_log, sizeof(rtp_log), "Audio read returned 0 samples");
-                sip_add_log_entry("info", rtp_log);
-            }
-            
-            // Receive audio
-            int16_t rx_buffer[160];
-            int samples_received = rtp_receive_audio(rx_buffer, 160);
-            if (samples_received > 0) {
-                // Update RTP timestamp on packet receive for timeout tracking
-                last_rtp_received_timestamp = xTaskGetTickCount() * portTICK_PERIOD_MS;
-                char rtp_log[128];
-                snprintf(rtp_log, sizeof(rtp_log), "RTP audio packet received: %d samples, timestamp updated", samples_received);
-                sip_add_log_entry("info", rtp_log);
-                // Play received audio
-                audio_write(rx_buffer, samples_received);
-            } else if (samples_received == 0) {
-                char rtp_log[128];
-                snprintf(rtp_log, sizeof(rtp_log), "RTP receive: No packets received (samples_received=0)");
-                sip_add_log_entry("info", rtp_log);
-            } else {
-                char rtp_log[128];
-                snprintf(rtp_log, sizeof(rtp_log), "RTP receive: Error (samples_received=%d)", samples_received);
-                sip_add_log_entry("error", rtp_log);
+
+        // Sticky return: back to the primary registrar once it answers again
+        if (current_state == SIP_STATE_REGISTERED && !reg_refreshing && reg_sent_timestamp == 0) {
+            int preferred = sip_registrar_preferred();
+            if (preferred >= 0) {
+                sip_registrar_use(preferred);
+                char log_msg[128];
+                snprintf(log_msg, sizeof(log_msg), "Registrar %s answers again - registering with it", sip_server());
+                sip_add_log_entry(SIP_LOG_INFO, log_msg);
+                sip_switch_registrar();
             }
         }
+
+        if (reconnect_pending) {
+            sip_reconnect();
+        }
+
+        // Idle and registered: have the doorbell INVITEs ready to go before
+        // sleeping, so the press that wakes us finds them (a 200 to REGISTER
+        // or the end of a call is handled above, in this same pass)
+        if (current_state == SIP_STATE_REGISTERED && sip_transport_is_open()) {
+            sip_prearm_refresh();
+        }
     }
     
     ESP_LOGI(TAG, "SIP task ended");
@@ -2342,10 +3370,18 @@ ESP_LOGI(TAG, "log_msg at line 992: %p", (void*)&log_msg);
 
 void sip_client_init(void)
 {
-    sip_add_log_entry("info", "Initializing SIP client");
+    sip_log_init();
+    sip_add_log_entry(SIP_LOG_INFO, "Initializing SIP client");
 
-    // Initialize RTP handler
+    // Initialize RTP handler and the media engine that drives it
     rtp_init();
+    media_engine_init();
+
+    // Resolver cache keeps DNS out of the call setup path
+    dns_cache_init();
+
+    // Retransmissions (UDP only) and retransmission absorption
+    sip_txn_init(sip_transmit, sip_handle_transaction_timeout);
 
     // Set initial state
     current_state = SIP_STATE_IDLE;
@@ -2357,7 +3393,10 @@ void sip_client_init(void)
         char log_msg[128];
         snprintf(log_msg, sizeof(log_msg), "SIP configuration loaded: %s@%s",
                   sip_config.username, sip_config.server);
-        sip_add_log_entry("info", log_msg);
+        sip_add_log_entry(SIP_LOG_INFO, log_msg);
+
+        // Warm the resolver cache before the first REGISTER/INVITE needs it
+        sip_load_registrars();
 
         // Check IP status before creating socket
         char local_ip[16];
@@ -2367,30 +3406,20 @@ void sip_client_init(void)
             ESP_LOGI(TAG, "SIP init: No IP available yet");
         }
 
-        // Create socket
-        sip_socket = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
-        if (sip_socket < 0) {
-            ESP_LOGE(TAG, "Error creating SIP socket");
+        // Create socket (UDP: bound to port 5060 so we can receive responses)
+        if (!sip_open_socket()) {
+            ESP_LOGE(TAG, "Error opening SIP transport");
             current_state = SIP_STATE_ERROR;
             return;
         }
-        
-        // Bind socket to port 5060 so we can receive responses
-        struct sockaddr_in local_addr;
-        memset(&local_addr, 0, sizeof(local_addr));
-        local_addr.sin_family = AF_INET;
-        local_addr.sin_addr.s_addr = INADDR_ANY;  // Listen on all interfaces
-        local_addr.sin_port = htons(5060);  // SIP port
-        
-        if (bind(sip_socket, (struct sockaddr*)&local_addr, sizeof(local_addr)) < 0) {
-            ESP_LOGE(TAG, "Error binding SIP socket to port 5060");
-            close(sip_socket);
-            sip_socket = -1;
-            current_state = SIP_STATE_ERROR;
-            return;
+
+        // Command queue and wake socket let other tasks interrupt the SIP task's select()
+        if (!sip_cmd_queue) {
+            sip_cmd_queue = xQueueCreate(SIP_CMD_QUEUE_LENGTH, sizeof(sip_cmd_t));
+        }
+        if (sip_wake_socket < 0 && !sip_create_wake_socket()) {
+            ESP_LOGW(TAG, "Failed to create SIP wake socket - commands wait for next timeout");
         }
-        
-        sip_add_log_entry("info", "SIP socket bound to port 5060");
 
         // Create SIP task pinned to Core 1 (APP CPU)
         // This isolates SIP from WiFi which runs on Core 0 (PRO CPU)
@@ -2408,8 +3437,7 @@ void sip_client_init(void)
         
         if (result != pdPASS) {
             ESP_LOGE(TAG, "Failed to create SIP task");
-            close(sip_socket);
-            sip_socket = -1;
+            sip_close_socket();
             current_state = SIP_STATE_ERROR;
             return;
         }
@@ -2419,11 +3447,11 @@ void sip_client_init(void)
         // Set timestamp for delayed auto-registration
         // This gives WiFi time to stabilize before attempting registration
         init_timestamp = xTaskGetTickCount() * portTICK_PERIOD_MS;
-        ESP_LOGI(TAG, "SIP client ready. Auto-registration will start in %lu ms", auto_register_delay_ms);
-        sip_add_log_entry("info", "SIP client ready. Auto-registration scheduled.");
+        ESP_LOGI(TAG, "SIP client ready. Auto-registration will start in %lu ms", (unsigned long)auto_register_delay_ms);
+        sip_add_log_entry(SIP_LOG_INFO, "SIP client ready. Auto-registration scheduled.");
     } else {
         ESP_LOGI(TAG, "No SIP configuration found");
-        sip_add_log_entry("info", "No SIP configuration found");
+        sip_add_log_entry(SIP_LOG_INFO, "No SIP configuration found");
         current_state = SIP_STATE_DISCONNECTED;
     }
 
@@ -2437,9 +3465,13 @@ void sip_client_deinit(void)
         sip_task_handle = NULL;
     }
     
-    if (sip_socket >= 0) {
-        close(sip_socket);
-        sip_socket = -1;
+    if (sip_transport_is_open()) {
+        sip_close_socket();
+    }
+    
+    if (sip_wake_socket >= 0) {
+        close(sip_wake_socket);
+        sip_wake_socket = -1;
     }
     
     ESP_LOGI(TAG, "SIP Client deinitialized");
@@ -2447,16 +3479,19 @@ void sip_client_deinit(void)
 
 bool sip_client_register(void)
 {
-    if (!sip_config.configured || sip_socket < 0) {
+    if (!sip_config.configured || !sip_transport_is_open()) {
         current_state = SIP_STATE_ERROR;
         return false;
     }
 
-    sip_add_log_entry("info", "Starting SIP registration");
+    sip_add_log_entry(SIP_LOG_INFO, "Starting SIP registration");
     current_state = SIP_STATE_REGISTERING;
+    sip_registrar_select(xTaskGetTickCount() * portTICK_PERIOD_MS);
     
     // Reset auth attempt counter for new registration
     auth_attempt_count = 0;
+    reg_refreshing = false;
+    reg_refresh_ms = 0;
 
     // Clear public IP for new registration
     memset(public_ip, 0, sizeof(public_ip));
@@ -2466,16 +3501,32 @@ bool sip_client_register(void)
     // DNS lookup (no watchdog needed - SIP task not monitored)
     char dns_msg[128];
     snprintf(dns_msg, sizeof(dns_msg), "Performing DNS lookup for %s:%d",
-             sip_config.server, sip_config.port);
-    sip_add_log_entry("info", dns_msg);
+             sip_server(), sip_server_port());
+    sip_add_log_entry(SIP_LOG_INFO, dns_msg);
     
-    if (!resolve_hostname(sip_config.server, &server_addr, (uint16_t)sip_config.port)) {
-        sip_add_log_entry("error", "DNS lookup failed - cannot resolve hostname");
+    if (!resolve_hostname(sip_server(), &server_addr, sip_server_port())) {
+        if (sip_fail_over()) {
+            return sip_client_register();
+        }
+        sip_add_log_entry(SIP_LOG_ERROR, "DNS lookup failed - cannot resolve hostname");
         current_state = SIP_STATE_ERROR;
         return false;
     }
     
-    sip_add_log_entry("info", "DNS lookup successful - server resolved");
+    sip_add_log_entry(SIP_LOG_INFO, "DNS lookup successful - server resolved");
+
+    // TCP/TLS: connect now, Via and Contact need the connection's port
+    if (!sip_transport_connect(sip_server(), &server_addr)) {
+        if (sip_fail_over()) {
+            sip_transport_disconnect();
+            return sip_client_register();
+        }
+        sip_add_log_entry(SIP_LOG_ERROR, "Cannot connect to SIP server - connection retry scheduled in 10 seconds");
+        sip_close_socket();
+        current_state = SIP_STATE_DISCONNECTED;
+        last_connection_retry_timestamp = xTaskGetTickCount() * portTICK_PERIOD_MS;
+        return false;
+    }
 
     // Get local IP address
     char local_ip[16];
@@ -2486,64 +3537,44 @@ bool sip_client_register(void)
         ESP_LOGI(TAG, "Using local IP: %s", local_ip);
     }
 
-    // Create REGISTER message (use static to avoid stack allocation)
-    static char register_msg[1024];
-    int branch_id = rand();
-    int from_tag = rand();
-    int call_id = rand();
-    
-    // Store Call-ID and From tag for reuse in authenticated REGISTER
-    snprintf(initial_call_id, sizeof(initial_call_id), "%d@%s", call_id, local_ip);
-    snprintf(initial_from_tag, sizeof(initial_from_tag), "%d", from_tag);
+    // Call-ID and From tag stay the same for the authenticated REGISTER
+    char call_id[64];
+    snprintf(call_id, sizeof(call_id), "%lu@%s", (unsigned long)sip_new_id(), local_ip);
+    char aor[96];
+    snprintf(aor, sizeof(aor), "sip:%s@%s", sip_config.username, sip_server());
+    sip_dialog_init(&reg_dialog, sip_config.username, sip_server(), local_ip, local_ip,
+                    sip_transport_name(), sip_transport_local_port(), aor, call_id, sip_new_id());
+    snprintf(reg_dialog.request_uri, sizeof(reg_dialog.request_uri), "sip:%s", sip_server());
     has_initial_transaction_ids = true;
     
     char log_msg[256];
-    snprintf(log_msg, sizeof(log_msg), "Initial REGISTER: Call-ID=%s, From-tag=%s",
-             initial_call_id, initial_from_tag);
-    sip_add_log_entry("info", log_msg);
-    
-    // Use public IP for Contact header if available (critical for inbound calls)
-    const char* contact_ip = (strlen(public_ip) > 0) ? public_ip : local_ip;
-
-    snprintf(register_msg, sizeof(register_msg),
-             "REGISTER sip:%s SIP/2.0\r\n"
-             "Via: SIP/2.0/UDP %s:5060;branch=z9hG4bK%d;rport\r\n"
-             "Max-Forwards: 70\r\n"
-             "From: <sip:%s@%s>;tag=%s\r\n"
-             "To: <sip:%s@%s>\r\n"
-             "Call-ID: %s\r\n"
-             "CSeq: 1 REGISTER\r\n"
-             "Contact: <sip:%s@%s:5060>\r\n"
-             "Expires: 3600\r\n"
-             "Allow: INVITE, ACK, CANCEL, BYE, NOTIFY, REFER, MESSAGE, OPTIONS, INFO, SUBSCRIBE\r\n"
-             "User-Agent: ESP32-Doorbell/1.0\r\n"
-             "Content-Length: 0\r\n\r\n",
-             sip_config.server, local_ip, branch_id,
-             sip_config.username, sip_config.server, initial_from_tag,
-             sip_config.username, sip_config.server,
-             initial_call_id,
-             sip_config.username, contact_ip);
-
-    int sent = sendto(sip_socket, register_msg, strlen(register_msg), 0,
-                       (struct sockaddr*)&server_addr, sizeof(server_addr));
-
+    snprintf(log_msg, sizeof(log_msg), "Initial REGISTER: Call-ID=%s, From=%s",
+             reg_dialog.call_id, reg_dialog.from);
+    sip_add_log_entry(SIP_LOG_INFO, log_msg);
+
+    sip_writer_t w;
+    sip_writer_init(&w, sip_tx_buffer, sizeof(sip_tx_buffer));
+    sip_writer_dialog_request(&w, &reg_dialog, "REGISTER", reg_dialog.cseq, sip_new_id());
+    sip_writer_header_uint(&w, "Expires", SIP_REGISTER_EXPIRES_S);
+    sip_writer_append(&w,
+                      "Allow: " SIP_ALLOW_METHODS "\r\n"
+                      "User-Agent: " SIP_USER_AGENT "\r\n");
+
+    int sent = sip_send_message(&w, "REGISTER");
     if (sent < 0) {
-        char err_msg[64];
-        snprintf(err_msg, sizeof(err_msg), "Error sending REGISTER message: %d", sent);
-        ESP_LOGE(TAG, "%s", err_msg);
         current_state = SIP_STATE_ERROR;
         return false;
     }
+    reg_sent_timestamp = xTaskGetTickCount() * portTICK_PERIOD_MS;
 
-    last_message_timestamp = xTaskGetTickCount() * portTICK_PERIOD_MS;
-    sip_add_log_entry("sent", "REGISTER message sent");
+    sip_add_log_entry(SIP_LOG_SENT, "REGISTER message sent");
     return true;
 }
 
 // Send authenticated REGISTER with digest authentication
 static bool sip_client_register_auth(sip_auth_challenge_t* challenge)
 {
-    if (!sip_config.configured || sip_socket < 0 || !challenge || !challenge->valid) {
+    if (!sip_config.configured || !sip_transport_is_open() || !challenge || !challenge->valid) {
         current_state = SIP_STATE_ERROR;
         return false;
     }
@@ -2554,7 +3585,7 @@ static bool sip_client_register_auth(sip_auth_challenge_t* challenge)
 
     // Check if we have stored transaction IDs from initial REGISTER
     if (!has_initial_transaction_ids) {
-        sip_add_log_entry("error", "No initial transaction IDs stored - cannot authenticate");
+        sip_add_log_entry(SIP_LOG_ERROR, "No initial transaction IDs stored - cannot authenticate");
         current_state = SIP_STATE_ERROR;
         return false;
     }
@@ -2562,7 +3593,7 @@ static bool sip_client_register_auth(sip_auth_challenge_t* challenge)
 
     struct sockaddr_in server_addr;
 
-    if (!resolve_hostname(sip_config.server, &server_addr, (uint16_t)sip_config.port)) {
+    if (!resolve_hostname(sip_server(), &server_addr, sip_server_port())) {
         current_state = SIP_STATE_ERROR;
         return false;
     }
@@ -2571,24 +3602,23 @@ static bool sip_client_register_auth(sip_auth_challenge_t* challenge)
     // Generate cnonce and nc
     char cnonce[17];
     char nc_str[12];
-    // Increment nonce count for each authentication attempt
-    int nc_value = auth_attempt_count + 1;
-    if (nc_value > 99999999) nc_value = 1; // Prevent overflow
-    sprintf(nc_str, "%08d", nc_value);
-    nc_str[8] = '\0'; // Ensure null termination (8 digits + null = 9 chars)
+    // nc counts every request sent with this nonce (RFC 2617 §3.2.2), so a
+    // refresh can reuse the nonce without a new challenge
+    reg_nonce_count++;
+    snprintf(nc_str, sizeof(nc_str), "%08lx", (unsigned long)reg_nonce_count);
     generate_cnonce(cnonce, sizeof(cnonce));
 
     // Add debug logging for REGISTER authentication parameters
     char debug_msg[256];
     snprintf(debug_msg, sizeof(debug_msg), "REGISTER Auth attempt %d: nonce='%s', nc='%s', cnonce='%s'",
-             auth_attempt_count + 1, challenge->nonce, nc_str, cnonce);
-    sip_add_log_entry("info", debug_msg);
+             auth_attempt_count, challenge->nonce, nc_str, cnonce);
+    sip_add_log_entry(SIP_LOG_INFO, debug_msg);
 
     // Calculate digest response
     char response[33];
     char register_uri[256];
     // For REGISTER, the URI should be "sip:domain" format
-    snprintf(register_uri, sizeof(register_uri), "sip:%s", sip_config.server);
+    snprintf(register_uri, sizeof(register_uri), "sip:%s", sip_server());
     calculate_digest_response(
         sip_config.username,
         sip_config.password,
@@ -2605,456 +3635,158 @@ static bool sip_client_register_auth(sip_auth_challenge_t* challenge)
     // Log the calculated response for debugging
     char response_debug[128];
     snprintf(response_debug, sizeof(response_debug), "REGISTER digest response: %s", response);
-    sip_add_log_entry("info", response_debug);
+    sip_add_log_entry(SIP_LOG_INFO, response_debug);
     
     // Log digest calculation for debugging
     snprintf(log_msg, sizeof(log_msg), "Digest calculated: response=%s", response);
-    sip_add_log_entry("info", log_msg);
-
-    // Get local IP address
-    if (!get_local_ip(local_ip, sizeof(local_ip))) {
-        strcpy(local_ip, "192.168.1.100"); // Fallback
-    }
-
-    // Build authenticated REGISTER message (use static to avoid stack allocation)
-    static char register_msg[1536];
-    int branch = rand();  // New branch for new transaction
-
+    sip_add_log_entry(SIP_LOG_INFO, log_msg);
 
     // Use public IP if available (for NAT traversal), else local IP
+    get_local_ip_or_default(local_ip, sizeof(local_ip));
     const char* contact_ip = (strlen(public_ip) > 0) ? public_ip : local_ip;
 
     char ip_log[128];
     snprintf(ip_log, sizeof(ip_log), "Using contact IP: %s (public: %s, local: %s)",
               contact_ip, public_ip, local_ip);
-    sip_add_log_entry("info", ip_log);
-
-    // CRITICAL FIX: Build Authorization header WITHOUT spaces after commas
-    // This matches the softphone format exactly
-    int len = snprintf(register_msg, sizeof(register_msg),
-        "REGISTER sip:%s SIP/2.0\r\n"
-        "Via: SIP/2.0/UDP %s:5060;branch=z9hG4bK%d;rport\r\n"
-        "Max-Forwards: 70\r\n"
-        "From: <sip:%s@%s>;tag=%s\r\n"
-        "To: <sip:%s@%s>\r\n"
-        "Call-ID: %s\r\n"
-        "CSeq: 2 REGISTER\r\n"
-        "Contact: <sip:%s@%s:5060>\r\n"
-        "Authorization: Digest username=\"%s\",realm=\"%s\",nonce=\"%s\",uri=\"sip:%s\",response=\"%s\"",
-        sip_config.server, contact_ip, branch,
-        sip_config.username, sip_config.server, initial_from_tag,  // REUSE stored tag
-        sip_config.username, sip_config.server,
-        initial_call_id,  // REUSE stored Call-ID
-        sip_config.username, contact_ip,  // Use public IP for Contact header
-        sip_config.username, challenge->realm, challenge->nonce, sip_config.server, response
-    );
-
-    // Add qop parameters if present (NO spaces after commas)
-    if (strlen(challenge->qop) > 0) {
-        len += snprintf(register_msg + len, sizeof(register_msg) - len,
-            ",qop=%s,nc=%s,cnonce=\"%s\"", challenge->qop, nc_str, cnonce);
-    }
-
-    // Add opaque if present (NO space after comma)
-    if (strlen(challenge->opaque) > 0) {
-        len += snprintf(register_msg + len, sizeof(register_msg) - len,
-            ",opaque=\"%s\"", challenge->opaque);
-    }
-
-    // Add algorithm if not MD5 (NO space after comma)
-    if (strlen(challenge->algorithm) > 0 && strcmp(challenge->algorithm, "MD5") != 0) {
-        len += snprintf(register_msg + len, sizeof(register_msg) - len,
-            ",algorithm=%s", challenge->algorithm);
-    }
-
-    // Complete the message
-    len += snprintf(register_msg + len, sizeof(register_msg) - len,
-        "\r\n"
-        "Expires: 3600\r\n"
-        "Allow: INVITE, ACK, CANCEL, BYE, NOTIFY, REFER, MESSAGE, OPTIONS, INFO, SUBSCRIBE\r\n"
-        "User-Agent: ESP32-Doorbell/1.0\r\n"
-        "Content-Length: 0\r\n\r\n"
-    );
-
-    int sent = sendto(sip_socket, register_msg, len, 0,
-                       (struct sockaddr*)&server_addr, sizeof(server_addr));
-
+    sip_add_log_entry(SIP_LOG_INFO, ip_log);
+
+    // Same Call-ID and From tag as the initial REGISTER, next CSeq, new branch
+    sip_dialog_set_address(&reg_dialog, sip_config.username, contact_ip, contact_ip,
+                           sip_transport_name(), sip_transport_local_port());
+    reg_dialog.cseq++;
+
+    sip_writer_t w;
+    sip_writer_init(&w, sip_tx_buffer, sizeof(sip_tx_buffer));
+    sip_writer_dialog_request(&w, &reg_dialog, "REGISTER", reg_dialog.cseq, sip_new_id());
+    sip_write_authorization(&w, challenge, register_uri, response, nc_str, cnonce);
+    sip_writer_header_uint(&w, "Expires", SIP_REGISTER_EXPIRES_S);
+    sip_writer_append(&w,
+                      "Allow: " SIP_ALLOW_METHODS "\r\n"
+                      "User-Agent: " SIP_USER_AGENT "\r\n");
+
+    int sent = sip_send_message(&w, "authenticated REGISTER");
     if (sent < 0) {
-        ESP_LOGE(TAG, "Error sending authenticated REGISTER: %d", sent);
-        sip_add_log_entry("error", "Failed to send authenticated REGISTER");
+        sip_add_log_entry(SIP_LOG_ERROR, "Failed to send authenticated REGISTER");
         current_state = SIP_STATE_ERROR;
         return false;
     }
 
-    last_message_timestamp = xTaskGetTickCount() * portTICK_PERIOD_MS;
+    reg_sent_timestamp = xTaskGetTickCount() * portTICK_PERIOD_MS;
+
     snprintf(log_msg, sizeof(log_msg), "Authenticated REGISTER sent (%d bytes)", sent);
-    sip_add_log_entry("info", log_msg);
+    sip_add_log_entry(SIP_LOG_INFO, log_msg);
     return true;
 }
 
-void sip_client_make_call(const char* uri)
+// Re-REGISTER in the existing registration dialog before the binding expires.
+// With a cached challenge the request is authenticated up front (same nonce,
+// next nc); the registrar only challenges again if the nonce has gone stale.
+static void sip_refresh_registration(void)
 {
-    // Allow calls only when IDLE or REGISTERED, or when retrying with authentication
-    if (current_state != SIP_STATE_IDLE && current_state != SIP_STATE_REGISTERED &&
-        !(has_invite_auth_challenge && invite_auth_attempt_count < MAX_INVITE_AUTH_ATTEMPTS)) {
-        char state_log[128];
-        snprintf(state_log, sizeof(state_log),
-                 "Cannot make call - current state: %s, auth_count: %d",
-                 (current_state < sizeof(state_names)/sizeof(state_names[0])) ?
-                 state_names[current_state] : "UNKNOWN",
-                 invite_auth_attempt_count);
-        sip_add_log_entry("error", state_log);
-        return;
-    }
+    reg_refreshing = true;
+    reg_refresh_ms = 0;
+    auth_attempt_count = 0;
 
-    if (!sip_config.configured) {
-        sip_add_log_entry("error", "Cannot make call - SIP not configured");
+    if (last_auth_challenge.valid) {
+        sip_add_log_entry(SIP_LOG_INFO, "Refreshing registration with cached nonce");
+        sip_client_register_auth(&last_auth_challenge);
         return;
     }
 
-    if (sip_socket < 0) {
-        sip_add_log_entry("error", "Cannot make call - socket not available");
-        return;
+    sip_add_log_entry(SIP_LOG_INFO, "Refreshing registration");
+    reg_dialog.cseq++;
+
+    sip_writer_t w;
+    sip_writer_init(&w, sip_tx_buffer, sizeof(sip_tx_buffer));
+    sip_writer_dialog_request(&w, &reg_dialog, "REGISTER", reg_dialog.cseq, sip_new_id());
+    sip_writer_header_uint(&w, "Expires", SIP_REGISTER_EXPIRES_S);
+    sip_writer_append(&w,
+                      "Allow: " SIP_ALLOW_METHODS "\r\n"
+                      "User-Agent: " SIP_USER_AGENT "\r\n");
+    if (sip_send_message(&w, "REGISTER refresh") > 0) {
+        reg_sent_timestamp = xTaskGetTickCount() * portTICK_PERIOD_MS;
+        sip_add_log_entry(SIP_LOG_SENT, "REGISTER refresh sent");
     }
+}
 
-    // Format URI if needed (add sip: prefix if missing)
-    static char formatted_uri[128];
-    if (strncmp(uri, "sip:", 4) != 0) {
-        // URI doesn't have sip: prefix, add it
-        if (strchr(uri, '@') != NULL) {
-            // Has @ symbol, use as-is with sip: prefix
-            snprintf(formatted_uri, sizeof(formatted_uri), "sip:%s", uri);
-        } else {
-            // No @ symbol, add @server
-            snprintf(formatted_uri, sizeof(formatted_uri), "sip:%s@%s", uri, sip_config.server);
-        }
-        uri = formatted_uri;
+static void sip_do_make_call(const char* targets)
+{
+    // Allow calls only when IDLE or REGISTERED
+    if (current_state != SIP_STATE_IDLE && current_state != SIP_STATE_REGISTERED) {
+        char state_log[128];
+        snprintf(state_log, sizeof(state_log), "Cannot make call - current state: %s",
+                 (current_state < sizeof(state_names)/sizeof(state_names[0])) ?
+                 state_names[current_state] : "UNKNOWN");
+        sip_add_log_entry(SIP_LOG_ERROR, state_log);
+        return;
     }
 
-    char log_msg[256];  // Increased buffer size to accommodate full URI
-    snprintf(log_msg, sizeof(log_msg), "Initiating call to %s", uri);
-    sip_add_log_entry("info", log_msg);
-
-    // Only change state and set timestamp for initial call, not for auth retries
-    if (invite_auth_attempt_count == 0) {
-        current_state = SIP_STATE_CALLING;
-        led_handler_set_state(LED_STATE_CALL_OUTGOING);
-        call_start_timestamp = xTaskGetTickCount() * portTICK_PERIOD_MS;
+    if (!sip_config.configured) {
+        sip_add_log_entry(SIP_LOG_ERROR, "Cannot make call - SIP not configured");
+        return;
     }
 
-    // Get local IP address
-    char local_ip[16];
-    if (!get_local_ip(local_ip, sizeof(local_ip))) {
-        strcpy(local_ip, "192.168.1.100"); // Fallback
+    if (!sip_transport_is_open()) {
+        sip_add_log_entry(SIP_LOG_ERROR, "Cannot make call - socket not available");
+        return;
     }
 
-    // Create SDP session description
-    // Use public IP for NAT traversal if available, otherwise local IP
-    const char* sdp_ip = (strlen(public_ip) > 0) ? public_ip : local_ip;
-    static char sdp[256];
-    snprintf(sdp, sizeof(sdp),
-             "v=0\r\n"
-             "o=- %d 0 IN IP4 %s\r\n"
-             "s=ESP32 Doorbell Call\r\n"
-             "c=IN IP4 %s\r\n"
-             "t=0 0\r\n"
-             "m=audio 5004 RTP/AVP 0 8 101\r\n"
-             "a=rtpmap:0 PCMU/8000\r\n"
-             "a=rtpmap:8 PCMA/8000\r\n"
-             "a=rtpmap:101 telephone-event/8000\r\n"
-             "a=fmtp:101 0-15\r\n"
-             "a=sendrecv\r\n",
-             rand(), sdp_ip, sdp_ip);
-
-    // Create INVITE message (large buffer for authenticated INVITE with long URIs)
-    static char invite_msg[3072];
-    int len = 0;  // Declare len at function scope
-
-    // NOTE: INVITE transaction IDs are defined at file scope (lines 79-83)
-    // Don't redeclare them here - use the file-scope variables
-
-    // CRITICAL FIX: Only generate NEW IDs if this is a FRESH call (no auth challenge exists)
-    // If we have an auth challenge, we're retrying and must REUSE the stored IDs
-    if (!has_invite_auth_challenge) {
-        // This is a fresh call - generate new transaction IDs
-        initial_invite_call_id = rand();
-        initial_invite_from_tag = rand();
-        initial_invite_branch = rand();
-        auth_invite_branch = 0;  // Will be set when auth retry happens
-        initial_invite_cseq = 1;  // First INVITE always uses CSeq 1
-
-        char init_log[256];
-        snprintf(init_log, sizeof(init_log),
-                 "INVITE fresh call: generating NEW Call-ID=%d, From-tag=%d, Branch=%d, CSeq=%d",
-                 initial_invite_call_id, initial_invite_from_tag, initial_invite_branch, initial_invite_cseq);
-        sip_add_log_entry("info", init_log);
-    } else {
-        // This is an auth retry - REUSE stored transaction IDs
-        // Generate NEW branch for authenticated INVITE (per RFC 3261)
-        auth_invite_branch = rand();
-
-        char reuse_log[256];
-        snprintf(reuse_log, sizeof(reuse_log),
-                 "INVITE auth retry: REUSING Call-ID=%d, From-tag=%d (CSeq=%d), NEW Branch=%d",
-                 initial_invite_call_id, initial_invite_from_tag, initial_invite_cseq, auth_invite_branch);
-        sip_add_log_entry("info", reuse_log);
+    // Every target in the list rings at once (add sip: and @server as needed)
+    static char uris[SIP_MAX_FORK_TARGETS][128];
+    int count = sip_split_targets(targets, uris, SIP_MAX_FORK_TARGETS);
+    if (count == 0) {
+        sip_add_log_entry(SIP_LOG_ERROR, "Cannot make call - no target");
+        return;
     }
 
-    // Store the Call-ID string for debugging
-    snprintf(invite_call_id_str, sizeof(invite_call_id_str), "%d@%s", initial_invite_call_id, local_ip);
-
-    int call_id = initial_invite_call_id;
-    int tag = initial_invite_from_tag;
-    int branch = has_invite_auth_challenge ? auth_invite_branch : initial_invite_branch;
-
-    // Check if we have stored authentication challenge for INVITE
-    if (has_invite_auth_challenge && invite_auth_challenge.valid && invite_auth_attempt_count < MAX_INVITE_AUTH_ATTEMPTS) {
-        sip_add_log_entry("info", "Using stored INVITE authentication challenge for retry");
-        // Generate cnonce and nc for INVITE authentication
-        char cnonce[17];
-        char nc_str[12];
-        // Increment nonce count for each authentication attempt
-        int nc_value = invite_auth_attempt_count + 1;
-        if (nc_value > 99999999) nc_value = 1; // Prevent overflow
-        sprintf(nc_str, "%08d", nc_value);
-        nc_str[8] = '\0'; // Ensure null termination (8 digits + null = 9 chars)
-        generate_cnonce(cnonce, sizeof(cnonce));
-
-        // Add debug logging for authentication parameters
-        char debug_msg[512];
-        snprintf(debug_msg, sizeof(debug_msg),
-                 "INVITE Auth retry %d: nonce='%.20s...', nc='%s', cnonce='%s', Call-ID=%d, From-tag=%d",
-                 invite_auth_attempt_count + 1, invite_auth_challenge.nonce, nc_str, cnonce,
-                 call_id, tag);
-        sip_add_log_entry("info", debug_msg);
-
-        // Calculate digest response for INVITE
-        char response[33];
-        // CRITICAL FIX: The digest URI MUST match the Request-URI (the target being called)
-        // Use the actual target URI, not our own username
-        // Limit to 64 bytes to satisfy format-truncation checks
-        char invite_uri_for_digest[64];
-        strncpy(invite_uri_for_digest, uri, sizeof(invite_uri_for_digest) - 1);
-        invite_uri_for_digest[sizeof(invite_uri_for_digest) - 1] = '\0';
-
-        // Log complete digest calculation inputs for debugging
-        char digest_inputs[512];
-        snprintf(digest_inputs, sizeof(digest_inputs),
-                 "INVITE digest inputs: username=%s, realm=%s, method=INVITE, uri=%s, qop=%s, nc=%s",
-                 sip_config.username, invite_auth_challenge.realm, invite_uri_for_digest,
-                 invite_auth_challenge.qop[0] ? invite_auth_challenge.qop : "(empty)", nc_str);
-        sip_add_log_entry("info", digest_inputs);
-
-        calculate_digest_response(
-            sip_config.username,
-            sip_config.password,
-            invite_auth_challenge.realm,
-            invite_auth_challenge.nonce,
-            "INVITE",
-            invite_uri_for_digest,  // Use target URI for digest calculation
-            invite_auth_challenge.qop,
-            nc_str,
-            cnonce,
-            response
-        );
-
-        // Log the calculated response for debugging
-        char response_debug[128];
-        snprintf(response_debug, sizeof(response_debug), "INVITE digest response: %s", response);
-        sip_add_log_entry("info", response_debug);
-
-        // CRITICAL: Log CSeq value being used for debugging
-        // RFC 3261 Section 8.1.3.5: CSeq should remain SAME for auth retry
-        char cseq_log[128];
-        snprintf(cseq_log, sizeof(cseq_log),
-                 "INVITE CSeq for auth retry: %d (should be SAME as initial, not incremented)",
-                 initial_invite_cseq);
-        sip_add_log_entry("info", cseq_log);
-
-        // Build INVITE message with Authorization header
-        // Using truncated URIs to satisfy compiler format-truncation checks
-        char safe_uri[64];
-        strncpy(safe_uri, uri, sizeof(safe_uri) - 1);
-        safe_uri[sizeof(safe_uri) - 1] = '\0';
-
-        // Use public IP for Contact header if available (for NAT traversal)
-        const char* contact_ip = (strlen(public_ip) > 0) ? public_ip : local_ip;
-
-        len = snprintf(invite_msg, sizeof(invite_msg),
-            "INVITE %s SIP/2.0\r\n"
-            "Via: SIP/2.0/UDP %s:5060;branch=z9hG4bK%d;rport\r\n"
-            "Max-Forwards: 70\r\n"
-            "From: <sip:%s@%s>;tag=%d\r\n"
-            "To: <%s>\r\n"
-            "Call-ID: %d@%s\r\n"
-            "CSeq: %d INVITE\r\n"
-            "Contact: <sip:%s@%s:5060>\r\n"
-            "Authorization: Digest username=\"%s\",realm=\"%s\",nonce=\"%s\",uri=\"%s\",response=\"%s\"",
-            safe_uri, local_ip, branch,
-            sip_config.username, sip_config.server, tag,
-            safe_uri,
-            call_id, local_ip,
-            initial_invite_cseq,  // CRITICAL FIX: Use SAME CSeq as initial INVITE, not incremented
-            sip_config.username, contact_ip,
-            sip_config.username, invite_auth_challenge.realm, invite_auth_challenge.nonce, invite_uri_for_digest, response
-        );
-
-        // Add qop parameters if present (NO spaces after commas)
-        if (strlen(invite_auth_challenge.qop) > 0) {
-            len += snprintf(invite_msg + len, sizeof(invite_msg) - len,
-                ",qop=%s,nc=%s,cnonce=\"%s\"", invite_auth_challenge.qop, nc_str, cnonce);
-        }
-
-        // Add opaque if present (NO space after comma)
-        if (strlen(invite_auth_challenge.opaque) > 0) {
-            len += snprintf(invite_msg + len, sizeof(invite_msg) - len,
-                ",opaque=\"%s\"", invite_auth_challenge.opaque);
+    fork_id++;
+    int legs = 0;
+    for (int i = 0; i < count; i++) {
+        sip_call_leg_t* leg = sip_leg_alloc();
+        if (!leg) {
+            sip_add_log_entry(SIP_LOG_WARNING, "No free call leg - remaining targets not called");
+            break;
         }
-
-        // Add algorithm if not MD5 (NO space after comma)
-        if (strlen(invite_auth_challenge.algorithm) > 0 && strcmp(invite_auth_challenge.algorithm, "MD5") != 0) {
-            len += snprintf(invite_msg + len, sizeof(invite_msg) - len,
-                ",algorithm=%s", invite_auth_challenge.algorithm);
-        }
-
-        // Complete the message
-        len += snprintf(invite_msg + len, sizeof(invite_msg) - len,
-            "\r\n"
-            "Allow: INVITE, ACK, CANCEL, BYE, NOTIFY, REFER, MESSAGE, OPTIONS, INFO, SUBSCRIBE\r\n"
-            "User-Agent: ESP32-Doorbell/1.0\r\n"
-            "Content-Type: application/sdp\r\n"
-            "Content-Length: %d\r\n\r\n%s",
-            strlen(sdp), sdp);
-
-        {
-            char invite_log_msg[128];
-            snprintf(invite_log_msg, sizeof(invite_log_msg), "INVITE len=%d, strlen=%zu", len, strlen(invite_msg));
-            sip_add_log_entry("info", invite_log_msg);
+        if (sip_leg_start(leg, uris[i])) {
+            legs++;
         }
-        invite_auth_attempt_count++;
-        sip_add_log_entry("info", "Sending authenticated INVITE");
-
-    } else {
-        // Build INVITE message without authentication (first attempt)
-        // Use public IP for Contact header if available (for NAT traversal)
-        const char* contact_ip = (strlen(public_ip) > 0) ? public_ip : local_ip;
-
-        len = snprintf(invite_msg, sizeof(invite_msg),
-            "INVITE %s SIP/2.0\r\n"
-            "Via: SIP/2.0/UDP %s:5060;branch=z9hG4bK%d;rport\r\n"
-            "Max-Forwards: 70\r\n"
-            "From: <sip:%s@%s>;tag=%d\r\n"
-            "To: <%s>\r\n"
-            "Call-ID: %d@%s\r\n"
-            "CSeq: %d INVITE\r\n"
-            "Contact: <sip:%s@%s:5060>\r\n"
-            "Allow: INVITE, ACK, CANCEL, BYE, NOTIFY, REFER, MESSAGE, OPTIONS, INFO, SUBSCRIBE\r\n"
-            "User-Agent: ESP32-Doorbell/1.0\r\n"
-            "Content-Type: application/sdp\r\n"
-            "Content-Length: %d\r\n\r\n%s",
-            uri, local_ip, branch,
-            sip_config.username, sip_config.server, tag,
-            uri,
-            call_id, local_ip,
-            initial_invite_cseq,  // Use stored CSeq value
-            sip_config.username, contact_ip,
-            strlen(sdp), sdp);
-    }
-
-    // Resolve server address
-    struct sockaddr_in server_addr;
-
-    if (!resolve_hostname(sip_config.server, &server_addr, (uint16_t)sip_config.port)) {
-        sip_add_log_entry("error", "DNS lookup failed for call");
-        current_state = SIP_STATE_ERROR;
-        return;
     }
 
-    // Send INVITE message
-    int sent = sendto(sip_socket, invite_msg, len, 0,
-                      (struct sockaddr*)&server_addr, sizeof(server_addr));
-
-    if (sent < 0) {
-        ESP_LOGE(TAG, "Error sending INVITE message: %d", sent);
-        sip_add_log_entry("error", "Failed to send INVITE");
+    if (legs == 0) {
+        sip_add_log_entry(SIP_LOG_ERROR, "Failed to send INVITE");
         current_state = SIP_STATE_ERROR;
         return;
     }
 
-    last_message_timestamp = xTaskGetTickCount() * portTICK_PERIOD_MS;
+    current_state = SIP_STATE_CALLING;
+    led_handler_set_state(LED_STATE_CALL_OUTGOING);
+    call_start_timestamp = xTaskGetTickCount() * portTICK_PERIOD_MS;
 
-    // Reuse log_msg buffer for INVITE sent message
-    snprintf(log_msg, sizeof(log_msg), "INVITE sent to %s (%d bytes)", uri, sent);
-    sip_add_log_entry("sent", log_msg);
+    char log_msg[256];
+    snprintf(log_msg, sizeof(log_msg), "Calling %s (%d target%s)", targets, legs, legs > 1 ? "s in parallel" : "");
+    sip_add_log_entry(SIP_LOG_INFO, log_msg);
 }
 
-void sip_client_hangup(void)
+static void sip_do_hangup(void)
 {
     if (current_state == SIP_STATE_CONNECTED || current_state == SIP_STATE_CALLING || current_state == SIP_STATE_RINGING) {
         ESP_LOGI(TAG, "Ending call");
-        sip_add_log_entry("info", "Sending BYE to end call");
+        sip_add_log_entry(SIP_LOG_INFO, "Sending BYE to end call");
         
-        // Clear INVITE authentication state when call ends
-        has_invite_auth_challenge = false;
-        memset(&invite_auth_challenge, 0, sizeof(invite_auth_challenge));
-        invite_auth_attempt_count = 0;
-        
-        // Stop audio and RTP first
-        audio_stop_recording();
-        audio_stop_playback();
-        rtp_stop_session();
-        // Reset RTP timestamp on call termination
-        last_rtp_received_timestamp = 0;
-        sip_add_log_entry("info", "RTP timestamp reset on call hangup");
+        // Stop media first
+        media_engine_stop();
         
         // Send BYE message if we have an active call
-        if (current_state == SIP_STATE_CONNECTED && sip_socket >= 0) {
-            static char bye_msg[512];
-            char local_ip[16];
-            if (!get_local_ip(local_ip, sizeof(local_ip))) {
-                strcpy(local_ip, "192.168.1.100");
-            }
-
-            // Use public IP for Contact header if available (for NAT traversal)
-            const char* contact_ip = (strlen(public_ip) > 0) ? public_ip : local_ip;
-
-            int call_id = rand();
-            int tag = rand();
-            int branch = rand();
-
-            snprintf(bye_msg, sizeof(bye_msg),
-                    "BYE sip:%s@%s SIP/2.0\r\n"
-                    "Via: SIP/2.0/UDP %s:5060;branch=z9hG4bK%d;rport\r\n"
-                    "Max-Forwards: 70\r\n"
-                    "From: <sip:%s@%s>;tag=%d\r\n"
-                    "To: <sip:%s@%s>\r\n"
-                    "Call-ID: %d@%s\r\n"
-                    "CSeq: 2 BYE\r\n"
-                    "Contact: <sip:%s@%s:5060>\r\n"
-                    "User-Agent: ESP32-Doorbell/1.0\r\n"
-                    "Content-Length: 0\r\n\r\n",
-                    sip_config.username, sip_config.server,
-                    contact_ip, branch,
-                    sip_config.username, sip_config.server, tag,
-                    sip_config.username, sip_config.server,
-                    call_id, local_ip,
-                    sip_config.username, contact_ip);
-            
-            // Send BYE
-            struct sockaddr_in server_addr;
-            if (resolve_hostname(sip_config.server, &server_addr, (uint16_t)sip_config.port)) {
-                int sent = sendto(sip_socket, bye_msg, strlen(bye_msg), 0,
-                                 (struct sockaddr*)&server_addr, sizeof(server_addr));
-                if (sent > 0) {
-                    sip_add_log_entry("sent", "BYE message sent");
-                } else {
-                    sip_add_log_entry("error", "Failed to send BYE");
-                }
+        if (current_state == SIP_STATE_CONNECTED && call_session && sip_transport_is_open()) {
+            if (sip_session_send_bye(call_session)) {
+                sip_add_log_entry(SIP_LOG_SENT, "BYE message sent");
+            } else {
+                sip_add_log_entry(SIP_LOG_ERROR, "Failed to send BYE");
             }
         } else if (current_state == SIP_STATE_CALLING || current_state == SIP_STATE_RINGING) {
             // Send CANCEL for calls that haven't been answered yet
-            sip_add_log_entry("info", "Canceling outgoing call");
-            // CANCEL message implementation would go here
+            sip_add_log_entry(SIP_LOG_INFO, "Canceling outgoing call");
+            sip_fork_cancel_all();
         }
         
         // Return to registered state
@@ -3064,7 +3796,7 @@ void sip_client_hangup(void)
         // Reset DTMF decoder state when call ends
         dtmf_reset_call_state();
         
-        sip_add_log_entry("info", "Call ended - State: REGISTERED");
+        sip_add_log_entry(SIP_LOG_INFO, "Call ended - State: REGISTERED");
     }
 }
 
@@ -3079,11 +3811,11 @@ void sip_client_answer_call(void)
     }
 }
 
-void sip_client_send_dtmf(char dtmf_digit)
+static void sip_do_send_dtmf(char dtmf_digit)
 {
     if (current_state == SIP_STATE_CONNECTED) {
         ESP_LOGI(TAG, "Sending DTMF: %c", dtmf_digit);
-        sip_add_log_entry("info", "Sending DTMF - State: DTMF_SENDING");
+        sip_add_log_entry(SIP_LOG_INFO, "Sending DTMF - State: DTMF_SENDING");
         current_state = SIP_STATE_DTMF_SENDING;
 
         // Validate DTMF character
@@ -3103,7 +3835,7 @@ void sip_client_send_dtmf(char dtmf_digit)
             if (rtp_result > 0) {
                 rtp_success = true;
                 ESP_LOGI(TAG, "DTMF %c sent via RFC 4733 RTP", dtmf_digit);
-                sip_add_log_entry("info", "DTMF sent via RFC 4733 telephone-event");
+                sip_add_log_entry(SIP_LOG_INFO, "DTMF sent via RFC 4733 telephone-event");
             } else {
                 ESP_LOGW(TAG, "Failed to send DTMF via RFC 4733");
             }
@@ -3111,63 +3843,68 @@ void sip_client_send_dtmf(char dtmf_digit)
             ESP_LOGW(TAG, "RTP not active, cannot send DTMF via RFC 4733");
         }
 
-        // Method 2: Try RFC 2976 INFO method via SIP (backup)
-        char local_ip[16];
-        if (!get_local_ip(local_ip, sizeof(local_ip))) {
-            strcpy(local_ip, "192.168.1.100"); // Fallback
+        // Method 2: Try RFC 2976 INFO method via SIP (backup), within the call's dialog
+        sip_session_t* session = call_session;
+        sip_writer_t w;
+        sip_writer_init(&w, sip_tx_buffer, sizeof(sip_tx_buffer));
+        if (session) {
+            session->dialog.cseq++;
+            sip_writer_dialog_request(&w, &session->dialog, "INFO", session->dialog.cseq, sip_new_id());
+            sip_writer_begin_body(&w, "application/dtmf-relay");
+            char info_body[] = "Signal=?\r\nDuration=100\r\n";
+            info_body[7] = dtmf_digit;
+            sip_writer_append(&w, info_body);
         }
-        
-        char info_body[64];
-        snprintf(info_body, sizeof(info_body), "Signal=%c\r\nDuration=100\r\n", dtmf_digit);
-
-        static char info_msg[512];
-        int info_len = strlen(info_body);
-        int cseq = 1; // Sequence number for INFO request
-        int len = snprintf(info_msg, sizeof(info_msg),
-            "INFO sip:%s@%s SIP/2.0\r\n"
-            "Via: SIP/2.0/UDP %s:5060;branch=z9hG4bK%d;rport\r\n"
-            "Max-Forwards: 70\r\n"
-            "From: <sip:%s@%s>;tag=%d\r\n"
-            "To: <sip:%s@%s>\r\n"
-            "Call-ID: %d@%s\r\n"
-            "CSeq: %d INFO\r\n"
-            "Content-Type: application/dtmf-relay\r\n"
-            "Content-Length: %d\r\n\r\n%s",
-            sip_config.username, sip_config.server,
-            local_ip, rand(),
-            sip_config.username, sip_config.server, rand(),
-            sip_config.username, sip_config.server,
-            rand(), local_ip,
-            cseq, info_len, info_body);
-        
-        struct sockaddr_in server_addr;
-        if (resolve_hostname(sip_config.server, &server_addr, (uint16_t)sip_config.port)) {
-            int sent = sendto(sip_socket, info_msg, len, 0,
-                             (struct sockaddr*)&server_addr, sizeof(server_addr));
-            if (sent > 0) {
-                info_success = true;
-                ESP_LOGI(TAG, "DTMF %c sent via RFC 2976 INFO", dtmf_digit);
-                sip_add_log_entry("info", "DTMF sent via RFC 2976 INFO method");
-            } else {
-                ESP_LOGW(TAG, "Failed to send DTMF via INFO method");
-            }
+
+        if (session && sip_send_message(&w, "INFO") > 0) {
+            info_success = true;
+            ESP_LOGI(TAG, "DTMF %c sent via RFC 2976 INFO", dtmf_digit);
+            sip_add_log_entry(SIP_LOG_INFO, "DTMF sent via RFC 2976 INFO method");
+        } else {
+            ESP_LOGW(TAG, "Failed to send DTMF via INFO method");
         }
 
         // Log final result
         if (rtp_success || info_success) {
             ESP_LOGI(TAG, "DTMF %c sent successfully", dtmf_digit);
-            sip_add_log_entry("info", "DTMF sent successfully");
+            sip_add_log_entry(SIP_LOG_INFO, "DTMF sent successfully");
         } else {
             ESP_LOGE(TAG, "Failed to send DTMF via any method");
-            sip_add_log_entry("error", "DTMF sending failed");
+            sip_add_log_entry(SIP_LOG_ERROR, "DTMF sending failed");
         }
 
         // Return to connected state after DTMF
         current_state = SIP_STATE_CONNECTED;
-        sip_add_log_entry("info", "DTMF sending complete - State: CONNECTED");
+        sip_add_log_entry(SIP_LOG_INFO, "DTMF sending complete - State: CONNECTED");
     } else {
         ESP_LOGW(TAG, "Cannot send DTMF - Not in connected state (%d)", current_state);
-        sip_add_log_entry("error", "Cannot send DTMF - not in connected state");
+        sip_add_log_entry(SIP_LOG_ERROR, "Cannot send DTMF - not in connected state");
+    }
+}
+
+void sip_client_make_call(const char* uri)
+{
+    if (!uri) {
+        return;
+    }
+    call_trace_point(CALL_TRACE_MAKE_CALL, 0);
+    if (sip_in_task_context() || !sip_post_command(SIP_CMD_CALL, uri)) {
+        sip_do_make_call(uri);
+    }
+}
+
+void sip_client_hangup(void)
+{
+    if (sip_in_task_context() || !sip_post_command(SIP_CMD_HANGUP, NULL)) {
+        sip_do_hangup();
+    }
+}
+
+void sip_client_send_dtmf(char dtmf_digit)
+{
+    char arg[2] = { dtmf_digit, '\0' };
+    if (sip_in_task_context() || !sip_post_command(SIP_CMD_DTMF, arg)) {
+        sip_do_send_dtmf(dtmf_digit);
     }
 }
 
@@ -3180,20 +3917,20 @@ bool sip_client_test_connection(void)
         return false;
     }
 
-    if (sip_socket < 0) {
+    if (!sip_transport_is_open()) {
         ESP_LOGE(TAG, "SIP socket not available");
         return false;
     }
 
     // For testing purposes, we'll just check if we can resolve the hostname
     struct sockaddr_in test_addr;
-    if (!resolve_hostname(sip_config.server, &test_addr, (uint16_t)sip_config.port)) {
-        ESP_LOGE(TAG, "Cannot resolve hostname: %s", sip_config.server);
+    if (!resolve_hostname(sip_server(), &test_addr, sip_server_port())) {
+        ESP_LOGE(TAG, "Cannot resolve hostname: %s", sip_server());
         return false;
     }
 
     char reachable_msg[128];
-    snprintf(reachable_msg, sizeof(reachable_msg), "SIP server %s is reachable", sip_config.server);
+    snprintf(reachable_msg, sizeof(reachable_msg), "SIP server %s is reachable", sip_server());
     ESP_LOGI(TAG, "%s", reachable_msg);
     return true;
 }
@@ -3224,7 +3961,7 @@ void sip_get_status(char* buffer, size_t buffer_size)
         user_status = "Not Registered";
     }
 
-    char server[64] = {0};
+    char server[SIP_SERVER_LIST_LEN] = {0};
     char username[32] = {0};
     char apt1[64] = {0};
     char apt2[64] = {0};
@@ -3235,6 +3972,33 @@ void sip_get_status(char* buffer, size_t buffer_size)
     strncpy(apt1, sip_config.apartment1_uri, sizeof(apt1) - 1);
     strncpy(apt2, sip_config.apartment2_uri, sizeof(apt2) - 1);
 
+    // Receive jitter buffer of the current (or last) call
+    rtp_stats_t rtp_stats;
+    rtp_get_stats(&rtp_stats);
+
+    // Keep-alive probing of the registrar, round trips as "[n,n,...]"
+    sip_keepalive_stats_t keepalive;
+    sip_keepalive_get_stats(&keepalive);
+    char rtt_histogram[64];
+    int pos = snprintf(rtt_histogram, sizeof(rtt_histogram), "[");
+    for (int i = 0; i < SIP_KEEPALIVE_RTT_BUCKETS; i++) {
+        pos += snprintf(rtt_histogram + pos, sizeof(rtt_histogram) - pos, "%s%u",
+                        i > 0 ? "," : "", keepalive.rtt_histogram[i]);
+    }
+    snprintf(rtt_histogram + pos, sizeof(rtt_histogram) - pos, "]");
+
+    // Registrar list with the failover scores
+    char registrars[SIP_REGISTRAR_MAX * 112];
+    pos = snprintf(registrars, sizeof(registrars), "[");
+    for (int i = 0; i < sip_registrar_count(); i++) {
+        const sip_registrar_t* r = sip_registrar_get(i);
+        pos += snprintf(registrars + pos, sizeof(registrars) - pos,
+                        "%s{\"host\": \"%s\", \"active\": %s, \"rtt_ms\": %ld, \"failures\": %lu}",
+                        i > 0 ? "," : "", r->host, i == sip_registrar_active() ? "true" : "false",
+                        r->srtt_ms == SIP_REGISTRAR_NO_RTT ? -1L : (long)r->srtt_ms, (unsigned long)r->failures);
+    }
+    snprintf(registrars + pos, sizeof(registrars) - pos, "]");
+
     snprintf(buffer, buffer_size,
              "{"
              "\"state\": \"%s\","
@@ -3245,7 +4009,28 @@ void sip_get_status(char* buffer, size_t buffer_size)
              "\"username\": \"%s\","
              "\"apartment1\": \"%s\","
              "\"apartment2\": \"%s\","
-             "\"port\": %d"
+             "\"port\": %d,"
+             "\"transport\": \"%s\","
+             "\"registrars\": %s,"
+             "\"keepalive\": {"
+             "\"running\": %s,"
+             "\"interval_ms\": %lu,"
+             "\"interval_learned\": %s,"
+             "\"last_rtt_ms\": %lu,"
+             "\"rtt_histogram\": %s,"
+             "\"probes_sent\": %lu,"
+             "\"probes_lost\": %lu,"
+             "\"binding_changes\": %lu,"
+             "\"reregisters\": %lu"
+             "},"
+             "\"jitter_buffer\": {"
+             "\"depth\": %u,"
+             "\"playout_delay_ms\": %u,"
+             "\"jitter_us\": %lu,"
+             "\"lost\": %lu,"
+             "\"late\": %lu,"
+             "\"discarded\": %lu"
+             "}"
              "}",
              state_name,
              user_status,
@@ -3255,7 +4040,24 @@ void sip_get_status(char* buffer, size_t buffer_size)
              username,
              apt1,
              apt2,
-             sip_config.port);
+             sip_server_port(),
+             sip_get_transport(),
+             registrars,
+             keepalive.running ? "true" : "false",
+             (unsigned long)keepalive.interval_ms,
+             keepalive.interval_learned ? "true" : "false",
+             (unsigned long)keepalive.last_rtt_ms,
+             rtt_histogram,
+             (unsigned long)keepalive.probes_sent,
+             (unsigned long)keepalive.probes_lost,
+             (unsigned long)keepalive.binding_changes,
+             (unsigned long)keepalive.reregisters,
+             rtp_stats.jitter_buffer.depth,
+             rtp_stats.jitter_buffer.target_delay_ms,
+             (unsigned long)rtp_stats.jitter_buffer.jitter_us,
+             (unsigned long)rtp_stats.jitter_buffer.lost,
+             (unsigned long)rtp_stats.jitter_buffer.late,
+             (unsigned long)rtp_stats.jitter_buffer.discarded);
 }
 
 sip_state_t sip_client_get_state(void)
@@ -3264,7 +4066,8 @@ sip_state_t sip_client_get_state(void)
 }
 
 void sip_save_config(const char* server, const char* username, const char* password,
-                     const char* apt1, const char* apt2, int port)
+                     const char* apt1, const char* apt2, int port, sip_transport_type_t transport,
+                     bool dns_srv)
 {
     char save_msg[128];
     snprintf(save_msg, sizeof(save_msg), "Saving SIP configuration: %s@%s", username, server);
@@ -3280,6 +4083,8 @@ void sip_save_config(const char* server, const char* username, const char* passw
         nvs_set_str(nvs_handle, "apt1", apt1);
         nvs_set_str(nvs_handle, "apt2", apt2);
         nvs_set_u16(nvs_handle, "port", (uint16_t)port);
+        nvs_set_u8(nvs_handle, "transport", (uint8_t)transport);
+        nvs_set_u8(nvs_handle, "dns_srv", dns_srv ? 1 : 0);
         nvs_set_u8(nvs_handle, "configured", 1);
 
         nvs_commit(nvs_handle);
@@ -3320,6 +4125,15 @@ sip_config_t sip_load_config(void)
             uint16_t port_val = 5060;
             nvs_get_u16(nvs_handle, "port", &port_val);
             config.port = (int)port_val;
+
+            uint8_t transport = SIP_TRANSPORT_UDP;
+            nvs_get_u8(nvs_handle, "transport", &transport);
+            config.transport = transport <= SIP_TRANSPORT_TLS ? (sip_transport_type_t)transport
+                                                              : SIP_TRANSPORT_UDP;
+
+            uint8_t dns_srv = 0;
+            nvs_get_u8(nvs_handle, "dns_srv", &dns_srv);
+            config.dns_srv = dns_srv != 0;
             
             config.configured = true;
         }
@@ -3330,34 +4144,6 @@ sip_config_t sip_load_config(void)
 }
 
 // Get log entries for web interface
-int sip_get_log_entries(sip_log_entry_t* entries, int max_entries, uint64_t since_timestamp)
-{
-    if (!sip_log_mutex || !entries) {
-        return 0;
-    }
-    
-    int count = 0;
-    
-    if (xSemaphoreTake(sip_log_mutex, pdMS_TO_TICKS(100)) == pdTRUE) {
-        int start_index = (sip_log_write_index - sip_log_count + SIP_LOG_MAX_ENTRIES) % SIP_LOG_MAX_ENTRIES;
-        
-        int i = 0;
-        while (i < sip_log_count && count < max_entries) {
-            int index = (start_index + i) % SIP_LOG_MAX_ENTRIES;
-            // Use > to exclude entries at exactly since_timestamp (already seen)
-            if (sip_log_buffer[index].timestamp > since_timestamp) {
-                memcpy(&entries[count], &sip_log_buffer[index], sizeof(sip_log_entry_t));
-                count++;
-            }
-            i++;
-        }
-        
-        xSemaphoreGive(sip_log_mutex);
-    }
-    
-    return count;
-}
-
 // Additional functions for web interface
 bool sip_is_registered(void)
 {
@@ -3438,24 +4224,52 @@ void sip_set_target2(const char* target)
     }
 }
 
+const char* sip_get_transport(void)
+{
+    switch (sip_config.transport) {
+        case SIP_TRANSPORT_TCP: return "tcp";
+        case SIP_TRANSPORT_TLS: return "tls";
+        default:                return "udp";
+    }
+}
+
+void sip_set_transport(const char* transport)
+{
+    if (transport) {
+        sip_config.transport = sip_transport_from_string(transport);
+    }
+}
+
+bool sip_get_dns_srv(void)
+{
+    return sip_config.dns_srv;
+}
+
+void sip_set_dns_srv(bool enabled)
+{
+    sip_config.dns_srv = enabled;
+}
+
 void sip_reinit(void)
 {
     ESP_LOGI(TAG, "SIP reinitialization requested");
-    sip_add_log_entry("info", "SIP reinitialization requested");
+    sip_add_log_entry(SIP_LOG_INFO, "SIP reinitialization requested");
     
-    // Set flag to trigger reinit from SIP task context (has more stack)
+    // Trigger reinit from SIP task context (has more stack)
     // Don't do heavy operations from HTTP handler context
-    reinit_requested = true;
+    if (!sip_post_command(SIP_CMD_REINIT, NULL)) {
+        reinit_requested = true;
+    }
 }
 
 bool sip_test_configuration(void)
 {
     ESP_LOGI(TAG, "Testing SIP configuration");
-    sip_add_log_entry("info", "Testing SIP configuration");
+    sip_add_log_entry(SIP_LOG_INFO, "Testing SIP configuration");
 
     if (!sip_config.configured) {
         ESP_LOGE(TAG, "No SIP configuration available for testing");
-        sip_add_log_entry("error", "No SIP configuration available");
+        sip_add_log_entry(SIP_LOG_ERROR, "No SIP configuration available");
         return false;
     }
 
@@ -3466,60 +4280,61 @@ bool sip_test_configuration(void)
     // Don't do DNS lookup or network operations here to avoid blocking
     if (strlen(sip_config.server) == 0 || strlen(sip_config.username) == 0) {
         ESP_LOGE(TAG, "Invalid SIP configuration");
-        sip_add_log_entry("error", "Invalid SIP configuration");
+        sip_add_log_entry(SIP_LOG_ERROR, "Invalid SIP configuration");
         return false;
     }
 
     ESP_LOGI(TAG, "SIP configuration validation passed");
-    sip_add_log_entry("info", "SIP configuration validation passed");
+    sip_add_log_entry(SIP_LOG_INFO, "SIP configuration validation passed");
     return true;
 }
 
 // Connect to SIP server (start registration)
 bool sip_connect(void)
 {
-    sip_add_log_entry("info", "SIP connect requested");
+    sip_add_log_entry(SIP_LOG_INFO, "SIP connect requested");
     
     if (!sip_config.configured) {
         ESP_LOGE(TAG, "Cannot connect: SIP not configured");
-        sip_add_log_entry("error", "Cannot connect: SIP not configured");
+        sip_add_log_entry(SIP_LOG_ERROR, "Cannot connect: SIP not configured");
         return false;
     }
     
     if (current_state == SIP_STATE_REGISTERED) {
-        sip_add_log_entry("info", "Already registered to SIP server");
+        sip_add_log_entry(SIP_LOG_INFO, "Already registered to SIP server");
         return true;
     }
     
     // If disconnected, change state to idle so registration can proceed
     if (current_state == SIP_STATE_DISCONNECTED) {
         current_state = SIP_STATE_IDLE;
-        sip_add_log_entry("info", "State changed from DISCONNECTED to IDLE - Reconnecting");
+        sip_add_log_entry(SIP_LOG_INFO, "State changed from DISCONNECTED to IDLE - Reconnecting");
     }
     
-    // Set flag to trigger registration in SIP task (non-blocking)
-    registration_requested = true;
-    sip_add_log_entry("info", "SIP registration queued");
+    // Trigger registration in SIP task (non-blocking)
+    if (!sip_post_command(SIP_CMD_REGISTER, NULL)) {
+        registration_requested = true;
+    }
+    sip_add_log_entry(SIP_LOG_INFO, "SIP registration queued");
     
     return true;
 }
 
-// Disconnect from SIP server
-void sip_disconnect(void)
+// Disconnect from SIP server (SIP task context)
+static void sip_do_disconnect(void)
 {
-    sip_add_log_entry("info", "SIP disconnect requested");
+    sip_add_log_entry(SIP_LOG_INFO, "SIP disconnect requested");
     
     // Send REGISTER with Expires: 0 to unregister (if registered)
-    if (current_state == SIP_STATE_REGISTERED && sip_socket >= 0) {
-        sip_add_log_entry("info", "Sending unregister message");
+    if (current_state == SIP_STATE_REGISTERED && sip_transport_is_open()) {
+        sip_add_log_entry(SIP_LOG_INFO, "Sending unregister message");
         // Unregister implementation would send REGISTER with Expires: 0
     }
     
     // Close socket
-    if (sip_socket >= 0) {
-        close(sip_socket);
-        sip_socket = -1;
-        sip_add_log_entry("info", "SIP socket closed");
+    if (sip_transport_is_open()) {
+        sip_close_socket();
+        sip_add_log_entry(SIP_LOG_INFO, "SIP socket closed");
     }
     
     // Clear registration flag
@@ -3527,7 +4342,15 @@ void sip_disconnect(void)
     
     // Update state
     current_state = SIP_STATE_DISCONNECTED;
-    sip_add_log_entry("info", "SIP client disconnected");
+    sip_add_log_entry(SIP_LOG_INFO, "SIP client disconnected");
+}
+
+// Disconnect from SIP server
+void sip_disconnect(void)
+{
+    if (sip_in_task_context() || !sip_post_command(SIP_CMD_DISCONNECT, NULL)) {
+        sip_do_disconnect();
+    }
 }
 
 #pragma GCC diagnostic pop
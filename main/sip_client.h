@@ -4,14 +4,26 @@
 #include <stddef.h>
 #include <stdbool.h>
 #include <stdint.h>
+#include "sip_log.h"     // sip_log_entry_t, sip_get_log_entries()
+#include "sip_transport.h"
+
+// A bell's target: one URI or extension, or several separated by commas
+// that ring in parallel ("201,202,sip:frontdoor@pbx.local")
+#define SIP_TARGET_LIST_LEN 160
+
+// Registrars: "host[:port]" entries separated by commas, in order of
+// preference ("pbx1.example.com,pbx2.example.com:5070")
+#define SIP_SERVER_LIST_LEN 128
 
 typedef struct {
-    char server[64];
+    char server[SIP_SERVER_LIST_LEN];
     char username[32];
     char password[32];
-    char apartment1_uri[64];
-    char apartment2_uri[64];
+    char apartment1_uri[SIP_TARGET_LIST_LEN];
+    char apartment2_uri[SIP_TARGET_LIST_LEN];
     int port;
+    sip_transport_type_t transport;
+    bool dns_srv;               // Look the registrars up by SRV record first (RFC 3263)
     bool configured;
 } sip_config_t;
 
@@ -41,7 +53,8 @@ sip_state_t sip_client_get_state(void);
 bool sip_client_test_connection(void);
 void sip_get_status(char* buffer, size_t buffer_size);
 void sip_save_config(const char* server, const char* username, const char* password,
-                     const char* apt1, const char* apt2, int port);
+                     const char* apt1, const char* apt2, int port, sip_transport_type_t transport,
+                     bool dns_srv);
 sip_config_t sip_load_config(void);
 
 // Additional getter/setter functions for web interface
@@ -51,22 +64,18 @@ const char* sip_get_username(void);
 const char* sip_get_password(void);
 const char* sip_get_target1(void);  // Returns apartment1_uri
 const char* sip_get_target2(void);  // Returns apartment2_uri
+const char* sip_get_transport(void); // "udp", "tcp" or "tls"
+bool sip_get_dns_srv(void);
 void sip_set_server(const char* server);
 void sip_set_username(const char* username);
 void sip_set_password(const char* password);
 void sip_set_target1(const char* target);
 void sip_set_target2(const char* target);
+void sip_set_transport(const char* transport);
+void sip_set_dns_srv(bool enabled);
 void sip_reinit(void);
 bool sip_test_configuration(void);
 
-// Log management
-typedef struct {
-    uint64_t timestamp;  // Changed to uint64_t to support NTP timestamps
-    char type[16];
-    char message[256];
-} sip_log_entry_t;
-
-int sip_get_log_entries(sip_log_entry_t* entries, int max_entries, uint64_t since_timestamp);
 
 // Connection management
 bool sip_connect(void);
@@ -0,0 +1,119 @@
+#include "sip_dialog_table.h"
+#include <string.h>
+
+#define SLOT_EMPTY      0
+#define SLOT_USED       1
+#define SLOT_DELETED    2   // Keeps probe chains through it intact
+
+#define SLOT_MASK       (SIP_DIALOG_TABLE_SLOTS - 1)
+
+// FNV-1a over the Call-ID, a separator and the tag
+static uint32_t key_hash(const char* call_id, size_t call_id_len, const char* tag, size_t tag_len)
+{
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < call_id_len; i++) {
+        hash = (hash ^ (uint8_t)call_id[i]) * 16777619u;
+    }
+    hash = (hash ^ 0xFF) * 16777619u;
+    for (size_t i = 0; i < tag_len; i++) {
+        hash = (hash ^ (uint8_t)tag[i]) * 16777619u;
+    }
+    return hash;
+}
+
+static bool key_equals(const sip_dialog_slot_t* slot, uint32_t hash, const char* call_id,
+                       size_t call_id_len, const char* tag, size_t tag_len)
+{
+    return slot->hash == hash &&
+           strncmp(slot->call_id, call_id, call_id_len) == 0 && slot->call_id[call_id_len] == '\0' &&
+           strncmp(slot->tag, tag, tag_len) == 0 && slot->tag[tag_len] == '\0';
+}
+
+// Index of the slot holding the key, or -1
+static int key_find(const sip_dialog_table_t* table, uint32_t hash, const char* call_id,
+                    size_t call_id_len, const char* tag, size_t tag_len)
+{
+    if (call_id_len >= SIP_DIALOG_CALL_ID_LEN || tag_len >= SIP_DIALOG_TAG_LEN) {
+        return -1;
+    }
+    for (int probe = 0; probe < SIP_DIALOG_TABLE_SLOTS; probe++) {
+        int i = (int)((hash + probe) & SLOT_MASK);
+        const sip_dialog_slot_t* slot = &table->slots[i];
+        if (slot->state == SLOT_EMPTY) {
+            return -1;
+        }
+        if (slot->state == SLOT_USED && key_equals(slot, hash, call_id, call_id_len, tag, tag_len)) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+void sip_dialog_table_clear(sip_dialog_table_t* table)
+{
+    memset(table, 0, sizeof(*table));
+}
+
+bool sip_dialog_table_insert(sip_dialog_table_t* table, const char* call_id, size_t call_id_len,
+                             const char* tag, size_t tag_len, int value)
+{
+    if (call_id_len >= SIP_DIALOG_CALL_ID_LEN || tag_len >= SIP_DIALOG_TAG_LEN || value < 0) {
+        return false;
+    }
+
+    uint32_t hash = key_hash(call_id, call_id_len, tag, tag_len);
+    int existing = key_find(table, hash, call_id, call_id_len, tag, tag_len);
+    if (existing >= 0) {
+        table->slots[existing].value = (int16_t)value;
+        return true;
+    }
+    if (table->count >= SIP_DIALOG_TABLE_SLOTS - 1) {
+        return false;
+    }
+
+    // First empty or deleted slot on the probe chain
+    for (int probe = 0; probe < SIP_DIALOG_TABLE_SLOTS; probe++) {
+        sip_dialog_slot_t* slot = &table->slots[(hash + probe) & SLOT_MASK];
+        if (slot->state != SLOT_USED) {
+            slot->state = SLOT_USED;
+            slot->value = (int16_t)value;
+            slot->hash = hash;
+            memcpy(slot->call_id, call_id, call_id_len);
+            slot->call_id[call_id_len] = '\0';
+            memcpy(slot->tag, tag, tag_len);
+            slot->tag[tag_len] = '\0';
+            table->count++;
+            return true;
+        }
+    }
+    return false;
+}
+
+int sip_dialog_table_find(const sip_dialog_table_t* table, const char* call_id, size_t call_id_len,
+                          const char* tag, size_t tag_len)
+{
+    int i = key_find(table, key_hash(call_id, call_id_len, tag, tag_len),
+                     call_id, call_id_len, tag, tag_len);
+    return i >= 0 ? table->slots[i].value : -1;
+}
+
+void sip_dialog_table_remove(sip_dialog_table_t* table, const char* call_id, size_t call_id_len,
+                             const char* tag, size_t tag_len)
+{
+    int i = key_find(table, key_hash(call_id, call_id_len, tag, tag_len),
+                     call_id, call_id_len, tag, tag_len);
+    if (i < 0) {
+        return;
+    }
+    table->slots[i].state = SLOT_DELETED;
+    table->count--;
+
+    // A deleted slot followed by an empty one ends no chain: free it, and
+    // the deleted slots before it, so lookups stay short over many calls
+    if (table->slots[(i + 1) & SLOT_MASK].state == SLOT_EMPTY) {
+        while (table->slots[i].state == SLOT_DELETED) {
+            table->slots[i].state = SLOT_EMPTY;
+            i = (i - 1) & SLOT_MASK;
+        }
+    }
+}
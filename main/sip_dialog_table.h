@@ -0,0 +1,67 @@
+#ifndef SIP_DIALOG_TABLE_H
+#define SIP_DIALOG_TABLE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define SIP_DIALOG_TABLE_SLOTS      16      // Power of two; keep it at most half full
+#define SIP_DIALOG_CALL_ID_LEN      128     // Including the terminator
+#define SIP_DIALOG_TAG_LEN          48      // Including the terminator
+
+/**
+ * One index entry: the key is stored, so a lookup needs no access to the
+ * objects being indexed
+ */
+typedef struct {
+    uint8_t state;                          // Empty, used or deleted
+    int16_t value;
+    uint32_t hash;
+    char call_id[SIP_DIALOG_CALL_ID_LEN];
+    char tag[SIP_DIALOG_TAG_LEN];
+} sip_dialog_slot_t;
+
+/**
+ * Fixed-size hash index from (Call-ID, local tag) to a slot number in a
+ * caller-owned array of dialogs or call legs. Open addressing with linear
+ * probing, no allocation; messages are looked up with the header values as
+ * they sit in the receive buffer.
+ */
+typedef struct {
+    sip_dialog_slot_t slots[SIP_DIALOG_TABLE_SLOTS];
+    uint8_t count;
+} sip_dialog_table_t;
+
+/**
+ * Remove every entry
+ */
+void sip_dialog_table_clear(sip_dialog_table_t* table);
+
+/**
+ * Add a key, or change the value of an existing one
+ *
+ * @param call_id Call-ID (need not be NUL-terminated)
+ * @param call_id_len Call-ID length
+ * @param tag Our tag in the dialog (From tag of requests we send)
+ * @param tag_len Tag length
+ * @param value Non-negative value returned by lookups
+ * @return false if the key is too long or the table is full
+ */
+bool sip_dialog_table_insert(sip_dialog_table_t* table, const char* call_id, size_t call_id_len,
+                             const char* tag, size_t tag_len, int value);
+
+/**
+ * Look up a key
+ *
+ * @return The value, or -1 if the key is not in the table
+ */
+int sip_dialog_table_find(const sip_dialog_table_t* table, const char* call_id, size_t call_id_len,
+                          const char* tag, size_t tag_len);
+
+/**
+ * Remove a key if present
+ */
+void sip_dialog_table_remove(sip_dialog_table_t* table, const char* call_id, size_t call_id_len,
+                             const char* tag, size_t tag_len);
+
+#endif // SIP_DIALOG_TABLE_H
@@ -0,0 +1,229 @@
+#include "sip_keepalive.h"
+#include "esp_log.h"
+#include <stdio.h>
+#include <string.h>
+
+static const char *TAG = "SIP_KEEPALIVE";
+
+// Once the UDP interval is learned, only every third probe is an OPTIONS
+// (round trip and binding check); the others are a bare CRLF that keeps
+// the binding open in 4 bytes
+#define UDP_OPTIONS_EVERY       3
+#define UDP_GROW_AFTER          2       // Probes with an unchanged binding before the interval grows
+
+const uint16_t sip_keepalive_rtt_bucket_ms[SIP_KEEPALIVE_RTT_BUCKETS - 1] = {
+    20, 50, 100, 200, 500, 1000, 2000
+};
+
+typedef struct {
+    bool running;
+    bool stream;
+    bool pong_supported;
+    bool pong_seen;                 // At least one pong on this kind of transport
+    bool learned;
+    uint32_t interval;
+    uint32_t good_streak;
+
+    uint32_t next_probe_at;
+    bool outstanding;
+    sip_keepalive_action_t probe;   // Kind of the probe in flight
+    uint32_t probe_sent_at;
+    uint32_t probe_count;
+    uint32_t lost_streak;
+
+    // Public address of our binding as the registrar reports it
+    char received[16];
+    uint16_t rport;
+
+    uint8_t rtt_ring[SIP_KEEPALIVE_RTT_WINDOW];     // Bucket of each recent round trip
+    uint8_t rtt_pos;
+    uint8_t rtt_count;
+
+    sip_keepalive_stats_t stats;
+} keepalive_t;
+
+static keepalive_t ka = {0};
+
+static bool time_reached(uint32_t now, uint32_t deadline)
+{
+    return (int32_t)(now - deadline) >= 0;
+}
+
+static void record_rtt(uint32_t rtt)
+{
+    uint8_t bucket = 0;
+    while (bucket < SIP_KEEPALIVE_RTT_BUCKETS - 1 && rtt >= sip_keepalive_rtt_bucket_ms[bucket]) {
+        bucket++;
+    }
+
+    // Rolling window: the sample falling out of the ring leaves its bucket
+    if (ka.rtt_count == SIP_KEEPALIVE_RTT_WINDOW) {
+        ka.stats.rtt_histogram[ka.rtt_ring[ka.rtt_pos]]--;
+    } else {
+        ka.rtt_count++;
+    }
+    ka.rtt_ring[ka.rtt_pos] = bucket;
+    ka.rtt_pos = (ka.rtt_pos + 1) % SIP_KEEPALIVE_RTT_WINDOW;
+    ka.stats.rtt_histogram[bucket]++;
+    ka.stats.last_rtt_ms = rtt;
+}
+
+static void probe_answered(uint32_t now)
+{
+    record_rtt(now - ka.probe_sent_at);
+    ka.stats.probes_answered++;
+    ka.outstanding = false;
+    ka.lost_streak = 0;
+    ka.next_probe_at = now + ka.interval;
+}
+
+void sip_keepalive_start(bool stream, const char* received, uint16_t rport, uint32_t now_ms)
+{
+    if (stream != ka.stream || ka.interval == 0) {
+        // New kind of path: learn it from scratch
+        memset(&ka, 0, sizeof(ka));
+        ka.stream = stream;
+        ka.pong_supported = stream;
+        ka.interval = stream ? SIP_KEEPALIVE_STREAM_MS : SIP_KEEPALIVE_UDP_INITIAL_MS;
+    }
+
+    ka.running = true;
+    ka.outstanding = false;
+    ka.lost_streak = 0;
+    ka.next_probe_at = now_ms + ka.interval;
+    snprintf(ka.received, sizeof(ka.received), "%s", received ? received : "");
+    ka.rport = rport;
+}
+
+void sip_keepalive_stop(void)
+{
+    ka.running = false;
+    ka.outstanding = false;
+}
+
+sip_keepalive_action_t sip_keepalive_poll(uint32_t now_ms)
+{
+    if (!ka.running) {
+        return SIP_KEEPALIVE_IDLE;
+    }
+
+    if (ka.outstanding) {
+        if (!time_reached(now_ms, ka.probe_sent_at + SIP_KEEPALIVE_TIMEOUT_MS)) {
+            return SIP_KEEPALIVE_IDLE;
+        }
+        ka.outstanding = false;
+
+        if (ka.probe == SIP_KEEPALIVE_SEND_CRLF && !ka.pong_seen) {
+            // Registrar without RFC 5626 pongs: probe with OPTIONS instead
+            ESP_LOGI(TAG, "No CRLF pong from registrar - probing with OPTIONS");
+            ka.pong_supported = false;
+            ka.next_probe_at = now_ms;
+        } else {
+            ka.stats.probes_lost++;
+            ka.lost_streak++;
+            ESP_LOGW(TAG, "Keep-alive probe lost (%lu in a row)", (unsigned long)ka.lost_streak);
+            if (ka.lost_streak >= SIP_KEEPALIVE_MAX_LOST) {
+                ka.lost_streak = 0;
+                ka.stats.reregisters++;
+                ka.next_probe_at = now_ms + ka.interval;
+                return SIP_KEEPALIVE_REREGISTER;
+            }
+            ka.next_probe_at = now_ms + SIP_KEEPALIVE_RETRY_MS;
+        }
+    }
+
+    if (!time_reached(now_ms, ka.next_probe_at)) {
+        return SIP_KEEPALIVE_IDLE;
+    }
+
+    ka.probe_count++;
+    ka.stats.probes_sent++;
+    if (ka.stream) {
+        ka.probe = ka.pong_supported ? SIP_KEEPALIVE_SEND_CRLF : SIP_KEEPALIVE_SEND_OPTIONS;
+    } else if (!ka.learned || ka.lost_streak > 0 || ka.probe_count % UDP_OPTIONS_EVERY == 0) {
+        ka.probe = SIP_KEEPALIVE_SEND_OPTIONS;
+    } else {
+        // Nothing answers a CRLF over UDP: it only refreshes the binding
+        ka.next_probe_at = now_ms + ka.interval;
+        return SIP_KEEPALIVE_SEND_CRLF;
+    }
+
+    ka.outstanding = true;
+    ka.probe_sent_at = now_ms;
+    return ka.probe;
+}
+
+void sip_keepalive_on_pong(uint32_t now_ms)
+{
+    if (!ka.running || !ka.outstanding || ka.probe != SIP_KEEPALIVE_SEND_CRLF) {
+        return;
+    }
+    ka.pong_seen = true;
+    probe_answered(now_ms);
+}
+
+sip_keepalive_action_t sip_keepalive_on_response(const char* received, uint16_t rport, uint32_t now_ms)
+{
+    if (!ka.running || !ka.outstanding || ka.probe != SIP_KEEPALIVE_SEND_OPTIONS) {
+        return SIP_KEEPALIVE_IDLE;
+    }
+    uint32_t interval = ka.interval;
+    probe_answered(now_ms);
+
+    if (ka.stream || rport == 0) {
+        return SIP_KEEPALIVE_IDLE;
+    }
+
+    const char* address = received ? received : "";
+    bool changed = ka.rport != 0 && (ka.rport != rport || strcmp(ka.received, address) != 0);
+    snprintf(ka.received, sizeof(ka.received), "%s", address);
+    ka.rport = rport;
+
+    if (changed) {
+        // The NAT forgot us within the interval: the registrar still routes
+        // calls to the old binding. Settle 20% below the interval that failed.
+        ka.stats.binding_changes++;
+        ka.stats.reregisters++;
+        ka.learned = true;
+        ka.good_streak = 0;
+        ka.interval = interval * 4 / 5;
+        if (ka.interval < SIP_KEEPALIVE_UDP_MIN_MS) {
+            ka.interval = SIP_KEEPALIVE_UDP_MIN_MS;
+        }
+        ka.next_probe_at = now_ms + ka.interval;
+        ESP_LOGW(TAG, "NAT binding changed after %lu ms - keep-alive every %lu ms",
+                 (unsigned long)interval, (unsigned long)ka.interval);
+        return SIP_KEEPALIVE_REREGISTER;
+    }
+
+    if (!ka.learned && ++ka.good_streak >= UDP_GROW_AFTER) {
+        ka.good_streak = 0;
+        ka.interval += SIP_KEEPALIVE_UDP_STEP_MS;
+        if (ka.interval >= SIP_KEEPALIVE_UDP_MAX_MS) {
+            // The NAT keeps idle bindings at least this long: stop growing
+            ka.interval = SIP_KEEPALIVE_UDP_MAX_MS;
+            ka.learned = true;
+        }
+        ka.next_probe_at = now_ms + ka.interval;
+    }
+    return SIP_KEEPALIVE_IDLE;
+}
+
+uint32_t sip_keepalive_next_ms(uint32_t now_ms)
+{
+    if (!ka.running) {
+        return UINT32_MAX;
+    }
+    uint32_t deadline = ka.outstanding ? ka.probe_sent_at + SIP_KEEPALIVE_TIMEOUT_MS : ka.next_probe_at;
+    return time_reached(now_ms, deadline) ? 0 : deadline - now_ms;
+}
+
+void sip_keepalive_get_stats(sip_keepalive_stats_t* stats)
+{
+    *stats = ka.stats;
+    stats->running = ka.running;
+    stats->stream = ka.stream;
+    stats->pong_supported = ka.pong_supported;
+    stats->interval_learned = ka.learned;
+    stats->interval_ms = ka.interval;
+}
@@ -0,0 +1,94 @@
+#ifndef SIP_KEEPALIVE_H
+#define SIP_KEEPALIVE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// UDP: probe interval grows from the initial value while the NAT keeps our
+// binding, and settles below the first interval that lost it
+#define SIP_KEEPALIVE_UDP_INITIAL_MS    20000
+#define SIP_KEEPALIVE_UDP_MIN_MS        10000
+#define SIP_KEEPALIVE_UDP_MAX_MS        120000
+#define SIP_KEEPALIVE_UDP_STEP_MS       5000
+// TCP/TLS: the connection is the binding; NATs keep those for minutes (RFC 5626 §4.4.1)
+#define SIP_KEEPALIVE_STREAM_MS         90000
+#define SIP_KEEPALIVE_TIMEOUT_MS        10000   // Probe without answer counts as lost
+#define SIP_KEEPALIVE_RETRY_MS          5000    // Next probe after a lost one
+#define SIP_KEEPALIVE_MAX_LOST          2       // Consecutive lost probes before re-registering
+
+#define SIP_KEEPALIVE_RTT_BUCKETS       8
+#define SIP_KEEPALIVE_RTT_WINDOW        64      // Probes kept in the histogram
+
+/**
+ * What the SIP task should do next
+ */
+typedef enum {
+    SIP_KEEPALIVE_IDLE = 0,
+    SIP_KEEPALIVE_SEND_CRLF,        // Send "\r\n\r\n" to the registrar (a pong is expected on TCP/TLS)
+    SIP_KEEPALIVE_SEND_OPTIONS,     // Send an OPTIONS probe to the registrar
+    SIP_KEEPALIVE_REREGISTER        // Probes lost or NAT binding changed: register again now
+} sip_keepalive_action_t;
+
+typedef struct {
+    bool running;
+    bool stream;                    // Probing a TCP/TLS connection
+    bool pong_supported;            // Registrar answers CRLF pings (stream only)
+    bool interval_learned;          // UDP: NAT binding lifetime found (or above the maximum), interval fixed
+    uint32_t interval_ms;
+    uint32_t last_rtt_ms;
+    uint32_t probes_sent;
+    uint32_t probes_answered;
+    uint32_t probes_lost;
+    uint32_t binding_changes;       // Public address or port seen by the registrar changed
+    uint32_t reregisters;
+    uint16_t rtt_histogram[SIP_KEEPALIVE_RTT_BUCKETS];  // Last SIP_KEEPALIVE_RTT_WINDOW round trips
+} sip_keepalive_stats_t;
+
+/**
+ * Upper bounds (ms, exclusive) of all but the last histogram bucket
+ */
+extern const uint16_t sip_keepalive_rtt_bucket_ms[SIP_KEEPALIVE_RTT_BUCKETS - 1];
+
+/**
+ * Registered (or refreshed): probe one interval from now. The learned UDP
+ * interval and the histogram are kept unless the transport kind changed.
+ *
+ * @param stream true for TCP/TLS
+ * @param received Public address the registrar saw (Via received), or NULL
+ * @param rport Public port the registrar saw (Via rport), 0 if unknown
+ */
+void sip_keepalive_start(bool stream, const char* received, uint16_t rport, uint32_t now_ms);
+
+/**
+ * Stop probing (registration lost, socket closed)
+ */
+void sip_keepalive_stop(void);
+
+/**
+ * Run the scheduler: start a probe when one is due, declare an unanswered
+ * one lost. A SEND action means the probe is now in flight.
+ */
+sip_keepalive_action_t sip_keepalive_poll(uint32_t now_ms);
+
+/**
+ * CRLF pong received on the connection
+ */
+void sip_keepalive_on_pong(uint32_t now_ms);
+
+/**
+ * Response to an OPTIONS probe (any status proves the path)
+ *
+ * @param received Via received parameter of the response, or NULL
+ * @param rport Via rport value of the response, 0 if absent
+ * @return SIP_KEEPALIVE_REREGISTER if the NAT binding changed, else IDLE
+ */
+sip_keepalive_action_t sip_keepalive_on_response(const char* received, uint16_t rport, uint32_t now_ms);
+
+/**
+ * Milliseconds until sip_keepalive_poll() has something to do, UINT32_MAX if stopped
+ */
+uint32_t sip_keepalive_next_ms(uint32_t now_ms);
+
+void sip_keepalive_get_stats(sip_keepalive_stats_t* stats);
+
+#endif // SIP_KEEPALIVE_H
@@ -0,0 +1,280 @@
+#include "sip_log.h"
+#include "ntp_sync.h"
+#include "ntp_log.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include <string.h>
+
+static const char *TAG = "SIP_LOG";
+
+// The ring is split into blocks and records never straddle a block, so every
+// block start is a record boundary: a reader can resynchronise at the oldest
+// block that has not been overwritten yet. Positions are free-running byte
+// counters; the ring size divides 2^32 so they map onto the ring across wrap.
+// At init every block holds a pad record and writing starts one lap in, so
+// "one ring size back" is always a valid place to start reading.
+//
+// Readers (web API, console drain task) take no lock: a record is accepted
+// when its commit field matches its position before and after the copy and
+// the writer has not come round to it again.
+#define SIP_LOG_RING_SIZE       (32 * 1024)
+#define SIP_LOG_RING_MASK       (SIP_LOG_RING_SIZE - 1)
+#define SIP_LOG_BLOCK_SIZE      1024
+#define SIP_LOG_BLOCK_MASK      (SIP_LOG_BLOCK_SIZE - 1)
+#define SIP_LOG_ALIGN(n)        (((n) + 7u) & ~7u)
+
+#define SIP_LOG_TYPE_PAD        0xFF    // Skip to the next block
+#define SIP_LOG_WRITING         1u      // commit while a record is written (positions are 8-aligned)
+
+// Console drain task: lowest priority, prints whatever was logged since its last pass
+#define SIP_LOG_DRAIN_PERIOD_MS 100
+#define SIP_LOG_DRAIN_STACK     3072
+#define SIP_LOG_DRAIN_PRIORITY  1
+
+typedef struct {
+    uint32_t commit;    // Position of this record, stored last; anything else means not (yet) valid
+    uint32_t seq;
+    uint64_t time_us;   // esp_timer time of the write
+    uint8_t type;
+    uint8_t reserved;
+    uint16_t len;       // Message length without terminator
+} sip_log_record_t;
+
+#define SIP_LOG_HEADER_SIZE     SIP_LOG_ALIGN(sizeof(sip_log_record_t))
+
+static uint8_t* ring = NULL;
+static uint32_t write_pos = 0;
+static uint32_t next_seq = 0;
+static portMUX_TYPE write_lock = portMUX_INITIALIZER_UNLOCKED;
+
+// Wall clock minus esp_timer time, fixed once NTP has synced so a record's
+// timestamp is the same on every read (the web UI polls with ?since=)
+static int64_t epoch_offset_ms = 0;
+
+static const char* const type_names[] = {
+    [SIP_LOG_INFO] = "info",
+    [SIP_LOG_WARNING] = "warning",
+    [SIP_LOG_ERROR] = "error",
+    [SIP_LOG_SENT] = "sent",
+    [SIP_LOG_RECEIVED] = "received",
+};
+
+const char* sip_log_type_name(sip_log_type_t type)
+{
+    if ((unsigned)type < sizeof(type_names) / sizeof(type_names[0])) {
+        return type_names[type];
+    }
+    return "info";
+}
+
+void sip_log_write(sip_log_type_t type, const char* message)
+{
+    if (!ring || !message) {
+        return;
+    }
+
+    size_t len = strnlen(message, SIP_LOG_MAX_MESSAGE_LEN - 1);
+    uint32_t size = SIP_LOG_ALIGN(SIP_LOG_HEADER_SIZE + len);
+
+    // Writers are serialised by a spinlock held for one header and one
+    // memcpy (no yielding, no waiting on readers); readers never take it
+    portENTER_CRITICAL_SAFE(&write_lock);
+
+    // A record that would cross a block boundary starts at the next block
+    uint32_t start = write_pos;
+    uint32_t room = SIP_LOG_BLOCK_SIZE - (start & SIP_LOG_BLOCK_MASK);
+    if (room < size) {
+        if (room >= SIP_LOG_HEADER_SIZE) {
+            sip_log_record_t* pad = (sip_log_record_t*)(ring + (start & SIP_LOG_RING_MASK));
+            __atomic_store_n(&pad->commit, SIP_LOG_WRITING, __ATOMIC_RELAXED);
+            __atomic_thread_fence(__ATOMIC_SEQ_CST);
+            pad->type = SIP_LOG_TYPE_PAD;
+            pad->len = 0;
+            __atomic_store_n(&pad->commit, start, __ATOMIC_RELEASE);
+        }
+        start += room;
+    }
+
+    // Publish the new end before overwriting, and invalidate the record
+    // before touching its body: a reader copying the old data at this spot
+    // sees either change on its second look and drops the copy
+    __atomic_store_n(&write_pos, start + size, __ATOMIC_RELAXED);
+    sip_log_record_t* record = (sip_log_record_t*)(ring + (start & SIP_LOG_RING_MASK));
+    __atomic_store_n(&record->commit, SIP_LOG_WRITING, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+    record->seq = next_seq++;
+    record->time_us = (uint64_t)esp_timer_get_time();
+    record->type = (uint8_t)type;
+    record->len = (uint16_t)len;
+    memcpy((uint8_t*)record + SIP_LOG_HEADER_SIZE, message, len);
+    __atomic_store_n(&record->commit, start, __ATOMIC_RELEASE);
+
+    portEXIT_CRITICAL_SAFE(&write_lock);
+}
+
+// Convert a record time to the timestamp readers see
+static uint64_t sip_log_timestamp_ms(uint64_t time_us)
+{
+    if (epoch_offset_ms == 0 && ntp_is_synced()) {
+        epoch_offset_ms = (int64_t)ntp_get_timestamp_ms() - esp_timer_get_time() / 1000;
+    }
+    return (uint64_t)((int64_t)(time_us / 1000) + epoch_offset_ms);
+}
+
+// Oldest position a reader can still start from; the block holding
+// head - RING_SIZE may be partly overwritten, so start at the next one
+static uint32_t sip_log_oldest_pos(void)
+{
+    uint32_t head = __atomic_load_n(&write_pos, __ATOMIC_ACQUIRE);
+    return ((head - SIP_LOG_RING_SIZE) + SIP_LOG_BLOCK_MASK) & ~(uint32_t)SIP_LOG_BLOCK_MASK;
+}
+
+// Read the record at *pos and advance *pos past it. Returns false at the end
+// of the committed data. A reader that was overtaken by the writers restarts
+// at the oldest valid position.
+static bool sip_log_read_record(uint32_t* pos, sip_log_entry_t* entry, sip_log_type_t* type)
+{
+    for (;;) {
+        uint32_t p = *pos;
+        uint32_t head = __atomic_load_n(&write_pos, __ATOMIC_ACQUIRE);
+        if (p == head) {
+            return false;
+        }
+        if (head - p > SIP_LOG_RING_SIZE) {
+            *pos = sip_log_oldest_pos();
+            continue;
+        }
+
+        uint32_t room = SIP_LOG_BLOCK_SIZE - (p & SIP_LOG_BLOCK_MASK);
+        if (room < SIP_LOG_HEADER_SIZE) {
+            *pos = p + room;
+            continue;
+        }
+
+        const sip_log_record_t* record = (const sip_log_record_t*)(ring + (p & SIP_LOG_RING_MASK));
+        if (__atomic_load_n(&record->commit, __ATOMIC_ACQUIRE) != p) {
+            // Reserved but still being written
+            return false;
+        }
+
+        sip_log_record_t header;
+        memcpy(&header, record, sizeof(header));
+        size_t len = header.len < SIP_LOG_MAX_MESSAGE_LEN ? header.len : SIP_LOG_MAX_MESSAGE_LEN - 1;
+        if (header.type != SIP_LOG_TYPE_PAD) {
+            memcpy(entry->message, (const uint8_t*)record + SIP_LOG_HEADER_SIZE, len);
+        }
+
+        // Valid only if no writer touched this space while we copied
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&record->commit, __ATOMIC_RELAXED) != p) {
+            return false;
+        }
+        if (__atomic_load_n(&write_pos, __ATOMIC_RELAXED) - p > SIP_LOG_RING_SIZE) {
+            *pos = sip_log_oldest_pos();
+            continue;
+        }
+
+        if (header.type == SIP_LOG_TYPE_PAD) {
+            *pos = p + room;
+            continue;
+        }
+
+        *pos = p + SIP_LOG_ALIGN(SIP_LOG_HEADER_SIZE + header.len);
+        entry->message[len] = '\0';
+        entry->seq = header.seq;
+        entry->timestamp = sip_log_timestamp_ms(header.time_us);
+        strncpy(entry->type, sip_log_type_name((sip_log_type_t)header.type), sizeof(entry->type) - 1);
+        entry->type[sizeof(entry->type) - 1] = '\0';
+        if (type) {
+            *type = (sip_log_type_t)header.type;
+        }
+        return true;
+    }
+}
+
+int sip_get_log_entries(sip_log_entry_t* entries, int max_entries, uint64_t since_timestamp)
+{
+    if (!ring || !entries) {
+        return 0;
+    }
+
+    int count = 0;
+    uint32_t pos = sip_log_oldest_pos();
+    while (count < max_entries && sip_log_read_record(&pos, &entries[count], NULL)) {
+        // Use > to exclude entries at exactly since_timestamp (already seen)
+        if (entries[count].timestamp > since_timestamp) {
+            count++;
+        }
+    }
+    return count;
+}
+
+static void sip_log_drain_task(void* arg)
+{
+    (void)arg;
+    static sip_log_entry_t entry;
+    uint32_t pos = sip_log_oldest_pos();
+    uint32_t expected_seq = 0;
+
+    while (1) {
+        sip_log_type_t type;
+        while (sip_log_read_record(&pos, &entry, &type)) {
+            if (entry.seq != expected_seq) {
+                ESP_LOGW(TAG, "%lu log records overwritten before they were printed",
+                         (unsigned long)(entry.seq - expected_seq));
+            }
+            expected_seq = entry.seq + 1;
+
+            switch (type) {
+                case SIP_LOG_ERROR:
+                    NTP_LOGE("SIP", "%s", entry.message);
+                    break;
+                case SIP_LOG_WARNING:
+                    NTP_LOGW("SIP", "%s", entry.message);
+                    break;
+                case SIP_LOG_INFO:
+                    NTP_LOGI("SIP", "%s", entry.message);
+                    break;
+                default:
+                    NTP_LOGI("SIP", "[%s] %s", entry.type, entry.message);
+                    break;
+            }
+        }
+        vTaskDelay(pdMS_TO_TICKS(SIP_LOG_DRAIN_PERIOD_MS));
+    }
+}
+
+void sip_log_init(void)
+{
+    if (ring) {
+        return;
+    }
+
+    ring = heap_caps_malloc(SIP_LOG_RING_SIZE, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (!ring) {
+        ESP_LOGW(TAG, "No PSRAM for the log ring - using internal RAM");
+        ring = heap_caps_malloc(SIP_LOG_RING_SIZE, MALLOC_CAP_8BIT);
+    }
+    if (!ring) {
+        ESP_LOGE(TAG, "Failed to allocate the log ring - SIP log disabled");
+        return;
+    }
+    for (uint32_t block = 0; block < SIP_LOG_RING_SIZE; block += SIP_LOG_BLOCK_SIZE) {
+        sip_log_record_t* pad = (sip_log_record_t*)(ring + block);
+        memset(pad, 0, sizeof(*pad));
+        pad->type = SIP_LOG_TYPE_PAD;
+        pad->commit = block;
+    }
+    __atomic_store_n(&write_pos, SIP_LOG_RING_SIZE, __ATOMIC_RELEASE);
+
+    if (xTaskCreate(sip_log_drain_task, "sip_log", SIP_LOG_DRAIN_STACK, NULL,
+                    SIP_LOG_DRAIN_PRIORITY, NULL) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create log drain task - records only visible in the web log");
+    }
+
+    ESP_LOGI(TAG, "SIP log ring: %d KB", SIP_LOG_RING_SIZE / 1024);
+}
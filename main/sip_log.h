@@ -0,0 +1,63 @@
+#ifndef SIP_LOG_H
+#define SIP_LOG_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define SIP_LOG_MAX_MESSAGE_LEN 256     // Including the terminator; longer messages are truncated
+
+/**
+ * Log record type
+ */
+typedef enum {
+    SIP_LOG_INFO = 0,
+    SIP_LOG_WARNING,
+    SIP_LOG_ERROR,
+    SIP_LOG_SENT,
+    SIP_LOG_RECEIVED
+} sip_log_type_t;
+
+/**
+ * A log record as handed to readers (formatted on read)
+ */
+typedef struct {
+    uint32_t seq;        // Monotonic sequence number, gaps mean overwritten records
+    uint64_t timestamp;  // NTP time in ms once synced, otherwise ms since boot
+    char type[16];
+    char message[SIP_LOG_MAX_MESSAGE_LEN];
+} sip_log_entry_t;
+
+/**
+ * Allocate the log ring (PSRAM when available) and start the console drain task
+ */
+void sip_log_init(void);
+
+/**
+ * Append a record
+ *
+ * Never yields or waits for a reader: concurrent writers are serialised by
+ * a spinlock held for one copy, readers validate their copy instead of
+ * locking. The message is copied as-is, timestamping is a single timer read
+ * and all formatting happens in the reader.
+ *
+ * @param type Record type
+ * @param message NUL-terminated text
+ */
+void sip_log_write(sip_log_type_t type, const char* message);
+
+/**
+ * Name of a record type ("info", "error", ...)
+ */
+const char* sip_log_type_name(sip_log_type_t type);
+
+/**
+ * Copy the oldest records newer than a timestamp, oldest first
+ *
+ * @param entries Output array
+ * @param max_entries Size of the output array
+ * @param since_timestamp Only records with a later timestamp are returned
+ * @return Number of records copied
+ */
+int sip_get_log_entries(sip_log_entry_t* entries, int max_entries, uint64_t since_timestamp);
+
+#endif // SIP_LOG_H
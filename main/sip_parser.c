@@ -0,0 +1,411 @@
+#include "sip_parser.h"
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+
+typedef struct {
+    const char* name;
+    uint8_t len;
+    sip_method_t method;
+} sip_method_entry_t;
+
+static const sip_method_entry_t method_table[] = {
+    { "INVITE",    6, SIP_METHOD_INVITE },
+    { "ACK",       3, SIP_METHOD_ACK },
+    { "BYE",       3, SIP_METHOD_BYE },
+    { "CANCEL",    6, SIP_METHOD_CANCEL },
+    { "OPTIONS",   7, SIP_METHOD_OPTIONS },
+    { "REGISTER",  8, SIP_METHOD_REGISTER },
+    { "INFO",      4, SIP_METHOD_INFO },
+    { "UPDATE",    6, SIP_METHOD_UPDATE },
+    { "PRACK",     5, SIP_METHOD_PRACK },
+    { "SUBSCRIBE", 9, SIP_METHOD_SUBSCRIBE },
+    { "NOTIFY",    6, SIP_METHOD_NOTIFY },
+    { "MESSAGE",   7, SIP_METHOD_MESSAGE },
+    { "REFER",     5, SIP_METHOD_REFER },
+};
+
+typedef struct {
+    const char* name;
+    uint8_t len;
+    sip_header_id_t id;
+} sip_header_entry_t;
+
+// Long forms; compact forms are handled separately (RFC 3261 §7.3.3)
+static const sip_header_entry_t header_table[] = {
+    { "Via",                3,  SIP_HDR_VIA },
+    { "From",               4,  SIP_HDR_FROM },
+    { "To",                 2,  SIP_HDR_TO },
+    { "Call-ID",            7,  SIP_HDR_CALL_ID },
+    { "CSeq",               4,  SIP_HDR_CSEQ },
+    { "Contact",            7,  SIP_HDR_CONTACT },
+    { "Content-Type",       12, SIP_HDR_CONTENT_TYPE },
+    { "Content-Length",     14, SIP_HDR_CONTENT_LENGTH },
+    { "WWW-Authenticate",   16, SIP_HDR_WWW_AUTHENTICATE },
+    { "Proxy-Authenticate", 18, SIP_HDR_PROXY_AUTHENTICATE },
+    { "Require",            7,  SIP_HDR_REQUIRE },
+    { "Supported",          9,  SIP_HDR_SUPPORTED },
+    { "Expires",            7,  SIP_HDR_EXPIRES },
+    { "Allow",              5,  SIP_HDR_ALLOW },
+    { "Record-Route",       12, SIP_HDR_RECORD_ROUTE },
+    { "Retry-After",        11, SIP_HDR_RETRY_AFTER },
+};
+
+static sip_method_t lookup_method(const char* token, size_t len)
+{
+    for (size_t i = 0; i < sizeof(method_table) / sizeof(method_table[0]); i++) {
+        if (method_table[i].len == len && memcmp(method_table[i].name, token, len) == 0) {
+            return method_table[i].method;
+        }
+    }
+    return SIP_METHOD_UNKNOWN;
+}
+
+static sip_header_id_t lookup_header(const char* name, size_t len)
+{
+    if (len == 1) {
+        switch (tolower((unsigned char)name[0])) {
+            case 'v': return SIP_HDR_VIA;
+            case 'f': return SIP_HDR_FROM;
+            case 't': return SIP_HDR_TO;
+            case 'i': return SIP_HDR_CALL_ID;
+            case 'm': return SIP_HDR_CONTACT;
+            case 'c': return SIP_HDR_CONTENT_TYPE;
+            case 'l': return SIP_HDR_CONTENT_LENGTH;
+            case 'k': return SIP_HDR_SUPPORTED;
+            default:  return SIP_HDR_OTHER;
+        }
+    }
+
+    for (size_t i = 0; i < sizeof(header_table) / sizeof(header_table[0]); i++) {
+        if (header_table[i].len == len && strncasecmp(header_table[i].name, name, len) == 0) {
+            return header_table[i].id;
+        }
+    }
+    return SIP_HDR_OTHER;
+}
+
+#define SIP_NUMBER_MAX  0x7FFFFFFFu     // Fits long where long is 32 bits (ESP32)
+
+// Parse an unsigned decimal number; returns -1 if there is none or it
+// exceeds SIP_NUMBER_MAX. Checked before each step, so nothing overflows.
+static long parse_number(const char* p, const char* end, const char** after)
+{
+    uint32_t value = 0;
+    bool digits = false;
+    while (p < end && (*p == ' ' || *p == '\t')) {
+        p++;
+    }
+    while (p < end && *p >= '0' && *p <= '9') {
+        uint32_t digit = (uint32_t)(*p - '0');
+        if (value > (SIP_NUMBER_MAX - digit) / 10) {
+            return -1;
+        }
+        value = value * 10 + digit;
+        digits = true;
+        p++;
+    }
+    if (after) {
+        *after = p;
+    }
+    return digits ? (long)value : -1;
+}
+
+// Find the end of the current line; *next is set past the line terminator
+static const char* line_end(const char* p, const char* end, const char** next)
+{
+    const char* nl = memchr(p, '\n', end - p);
+    if (!nl) {
+        *next = end;
+        return end;
+    }
+    *next = nl + 1;
+    return (nl > p && nl[-1] == '\r') ? nl - 1 : nl;
+}
+
+static bool parse_start_line(const char* p, const char* eol, sip_message_t* msg)
+{
+    if (eol - p >= 12 && memcmp(p, "SIP/2.0 ", 8) == 0) {
+        const char* after;
+        long code = parse_number(p + 8, eol, &after);
+        if (code < 100 || code > 699) {
+            return false;
+        }
+        msg->is_response = true;
+        msg->status_code = (int)code;
+        while (after < eol && *after == ' ') {
+            after++;
+        }
+        msg->reason = after;
+        msg->reason_len = eol - after;
+        return true;
+    }
+
+    const char* sp1 = memchr(p, ' ', eol - p);
+    if (!sp1 || sp1 == p) {
+        return false;
+    }
+    const char* uri = sp1 + 1;
+    const char* sp2 = memchr(uri, ' ', eol - uri);
+    if (!sp2 || sp2 == uri || eol - (sp2 + 1) != 7 || memcmp(sp2 + 1, "SIP/2.0", 7) != 0) {
+        return false;
+    }
+
+    msg->is_response = false;
+    msg->method_name = p;
+    msg->method_name_len = sp1 - p;
+    msg->method = lookup_method(p, sp1 - p);
+    msg->request_uri = uri;
+    msg->request_uri_len = sp2 - uri;
+    return true;
+}
+
+bool sip_parse_message(const char* data, size_t len, sip_message_t* msg)
+{
+    if (!data || !msg) {
+        return false;
+    }
+    memset(msg, 0, sizeof(*msg));
+
+    const char* end = data + len;
+    const char* p = data;
+    const char* next;
+
+    // Tolerate leading CRLFs (keep-alives, RFC 3261 §7.5)
+    while (p < end && (*p == '\r' || *p == '\n')) {
+        p++;
+    }
+    if (p >= end) {
+        return false;
+    }
+
+    const char* eol = line_end(p, end, &next);
+    if (!parse_start_line(p, eol, msg)) {
+        return false;
+    }
+    p = next;
+
+    long content_length = -1;
+    sip_header_t* last = NULL;
+
+    while (p < end) {
+        eol = line_end(p, end, &next);
+
+        // Empty line ends the header section
+        if (eol == p) {
+            p = next;
+            break;
+        }
+
+        // Folded continuation line extends the previous header
+        if (*p == ' ' || *p == '\t') {
+            if (last) {
+                const char* value_end = eol;
+                while (value_end > p && (value_end[-1] == ' ' || value_end[-1] == '\t')) {
+                    value_end--;
+                }
+                last->value_len = value_end - last->value;
+            }
+            p = next;
+            continue;
+        }
+
+        const char* colon = memchr(p, ':', eol - p);
+        if (!colon) {
+            return false;
+        }
+
+        const char* name_end = colon;
+        while (name_end > p && (name_end[-1] == ' ' || name_end[-1] == '\t')) {
+            name_end--;
+        }
+        const char* value = colon + 1;
+        while (value < eol && (*value == ' ' || *value == '\t')) {
+            value++;
+        }
+        const char* value_end = eol;
+        while (value_end > value && (value_end[-1] == ' ' || value_end[-1] == '\t')) {
+            value_end--;
+        }
+
+        sip_header_id_t id = lookup_header(p, name_end - p);
+
+        if (id == SIP_HDR_CONTENT_LENGTH) {
+            content_length = parse_number(value, value_end, NULL);
+        } else if (id == SIP_HDR_CSEQ && msg->cseq_num == 0) {
+            const char* after;
+            long num = parse_number(value, value_end, &after);
+            if (num > 0) {
+                msg->cseq_num = (int)num;
+                while (after < value_end && (*after == ' ' || *after == '\t')) {
+                    after++;
+                }
+                msg->cseq_method = lookup_method(after, value_end - after);
+            }
+        }
+
+        if (msg->header_count < SIP_MAX_HEADERS) {
+            last = &msg->headers[msg->header_count++];
+            last->id = id;
+            last->name = p;
+            last->name_len = name_end - p;
+            last->value = value;
+            last->value_len = value_end - value;
+        } else {
+            last = NULL;
+        }
+
+        p = next;
+    }
+
+    msg->body = p;
+    msg->body_len = end - p;
+    if (content_length >= 0 && (size_t)content_length < msg->body_len) {
+        msg->body_len = content_length;
+    }
+    return true;
+}
+
+const sip_header_t* sip_msg_header(const sip_message_t* msg, sip_header_id_t id)
+{
+    for (int i = 0; i < msg->header_count; i++) {
+        if (msg->headers[i].id == id) {
+            return &msg->headers[i];
+        }
+    }
+    return NULL;
+}
+
+bool sip_msg_copy_header(const sip_message_t* msg, sip_header_id_t id, char* dest, size_t dest_size)
+{
+    const sip_header_t* header = sip_msg_header(msg, id);
+    if (!header || header->value_len >= dest_size) {
+        return false;
+    }
+    memcpy(dest, header->value, header->value_len);
+    dest[header->value_len] = '\0';
+    return true;
+}
+
+bool sip_header_param(const sip_header_t* header, const char* name, const char** value, size_t* value_len)
+{
+    if (!header) {
+        return false;
+    }
+
+    size_t name_len = strlen(name);
+    const char* p = header->value;
+    const char* end = header->value + header->value_len;
+    bool in_quotes = false;
+    int angle_depth = 0;
+
+    while (p < end) {
+        char c = *p++;
+        if (c == '"') {
+            in_quotes = !in_quotes;
+        } else if (in_quotes) {
+            continue;
+        } else if (c == '<') {
+            angle_depth++;
+        } else if (c == '>') {
+            angle_depth--;
+        } else if (c == ',' && angle_depth == 0) {
+            break;  // Only the first entry of a comma-separated header
+        } else if (c == ';' && angle_depth == 0) {
+            while (p < end && *p == ' ') {
+                p++;
+            }
+            if ((size_t)(end - p) >= name_len && strncasecmp(p, name, name_len) == 0) {
+                const char* q = p + name_len;
+                while (q < end && *q == ' ') {
+                    q++;
+                }
+                if (q == end || *q == ';' || *q == ',') {
+                    // Flag parameter without value (e.g. ;rport)
+                    *value = q;
+                    *value_len = 0;
+                    return true;
+                }
+                if (*q == '=') {
+                    q++;
+                    while (q < end && *q == ' ') {
+                        q++;
+                    }
+                    const char* v = q;
+                    while (q < end && *q != ';' && *q != ',' && *q != ' ' && *q != '>') {
+                        q++;
+                    }
+                    *value = v;
+                    *value_len = q - v;
+                    return true;
+                }
+            }
+        }
+    }
+    return false;
+}
+
+bool sip_header_copy_param(const sip_header_t* header, const char* name, char* dest, size_t dest_size)
+{
+    const char* value;
+    size_t value_len;
+    if (!sip_header_param(header, name, &value, &value_len) || value_len >= dest_size) {
+        return false;
+    }
+    memcpy(dest, value, value_len);
+    dest[value_len] = '\0';
+    return true;
+}
+
+bool sip_header_copy_uri(const sip_header_t* header, char* dest, size_t dest_size)
+{
+    if (!header) {
+        return false;
+    }
+
+    // The display name may be a quoted string holding '<' of its own
+    const char* end = header->value + header->value_len;
+    const char* start = NULL;
+    bool in_quotes = false;
+    for (const char* p = header->value; p < end && !start; p++) {
+        if (*p == '"') {
+            in_quotes = !in_quotes;
+        } else if (*p == '\\' && in_quotes) {
+            p++;
+        } else if (*p == '<' && !in_quotes) {
+            start = p;
+        }
+    }
+    const char* stop;
+    if (start) {
+        start++;
+        stop = memchr(start, '>', end - start);
+        if (!stop) {
+            return false;
+        }
+    } else {
+        start = header->value;
+        stop = memchr(start, ';', end - start);
+        if (!stop) {
+            stop = end;
+        }
+    }
+
+    size_t len = stop - start;
+    if (len == 0 || len >= dest_size) {
+        return false;
+    }
+    memcpy(dest, start, len);
+    dest[len] = '\0';
+    return true;
+}
+
+const char* sip_method_name(sip_method_t method)
+{
+    for (size_t i = 0; i < sizeof(method_table) / sizeof(method_table[0]); i++) {
+        if (method_table[i].method == method) {
+            return method_table[i].name;
+        }
+    }
+    return "UNKNOWN";
+}
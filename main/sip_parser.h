@@ -0,0 +1,144 @@
+#ifndef SIP_PARSER_H
+#define SIP_PARSER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// Headers beyond this count are skipped (known headers are looked up first-match)
+#define SIP_MAX_HEADERS 32
+
+/**
+ * SIP request methods
+ */
+typedef enum {
+    SIP_METHOD_UNKNOWN = 0,
+    SIP_METHOD_INVITE,
+    SIP_METHOD_ACK,
+    SIP_METHOD_BYE,
+    SIP_METHOD_CANCEL,
+    SIP_METHOD_OPTIONS,
+    SIP_METHOD_REGISTER,
+    SIP_METHOD_INFO,
+    SIP_METHOD_UPDATE,
+    SIP_METHOD_PRACK,
+    SIP_METHOD_SUBSCRIBE,
+    SIP_METHOD_NOTIFY,
+    SIP_METHOD_MESSAGE,
+    SIP_METHOD_REFER
+} sip_method_t;
+
+/**
+ * Header names the SIP client looks at (long and compact forms map to the same id)
+ */
+typedef enum {
+    SIP_HDR_OTHER = 0,
+    SIP_HDR_VIA,                // Via / v
+    SIP_HDR_FROM,               // From / f
+    SIP_HDR_TO,                 // To / t
+    SIP_HDR_CALL_ID,            // Call-ID / i
+    SIP_HDR_CSEQ,
+    SIP_HDR_CONTACT,            // Contact / m
+    SIP_HDR_CONTENT_TYPE,       // Content-Type / c
+    SIP_HDR_CONTENT_LENGTH,     // Content-Length / l
+    SIP_HDR_WWW_AUTHENTICATE,
+    SIP_HDR_PROXY_AUTHENTICATE,
+    SIP_HDR_REQUIRE,
+    SIP_HDR_SUPPORTED,          // Supported / k
+    SIP_HDR_EXPIRES,
+    SIP_HDR_ALLOW,
+    SIP_HDR_RECORD_ROUTE,
+    SIP_HDR_RETRY_AFTER
+} sip_header_id_t;
+
+/**
+ * One header: value points into the message buffer (not NUL-terminated)
+ */
+typedef struct {
+    sip_header_id_t id;
+    const char* name;
+    uint16_t name_len;
+    const char* value;
+    uint16_t value_len;
+} sip_header_t;
+
+/**
+ * Parsed SIP message - an index over the receive buffer, nothing is copied
+ */
+typedef struct {
+    bool is_response;
+    int status_code;            // Responses: 100-699
+    const char* reason;         // Responses: reason phrase
+    uint16_t reason_len;
+    sip_method_t method;        // Requests: method
+    const char* method_name;    // Requests: method token as received
+    uint16_t method_name_len;
+    const char* request_uri;    // Requests: Request-URI
+    uint16_t request_uri_len;
+    int cseq_num;               // From CSeq
+    sip_method_t cseq_method;   // From CSeq
+    sip_header_t headers[SIP_MAX_HEADERS];
+    uint8_t header_count;
+    const char* body;
+    size_t body_len;
+} sip_message_t;
+
+/**
+ * Parse a SIP message in a single pass
+ * Classifies the start line (status code or method), indexes all headers by
+ * name (including compact forms) and locates the body using Content-Length.
+ *
+ * @param data Message buffer (must stay valid while msg is used)
+ * @param len Message length in bytes
+ * @param msg Parsed message
+ * @return true if the start line and header section are well formed
+ */
+bool sip_parse_message(const char* data, size_t len, sip_message_t* msg);
+
+/**
+ * Find the first header with the given id
+ *
+ * @return Header or NULL if absent
+ */
+const sip_header_t* sip_msg_header(const sip_message_t* msg, sip_header_id_t id);
+
+/**
+ * Copy a header value into a NUL-terminated buffer
+ *
+ * @return true if the header exists and fits
+ */
+bool sip_msg_copy_header(const sip_message_t* msg, sip_header_id_t id, char* dest, size_t dest_size);
+
+/**
+ * Find a ;name=value parameter in a header value (e.g. tag, branch, received)
+ * Parameters inside <...> (URI parameters) and quoted strings are skipped.
+ *
+ * @param header Header to search
+ * @param name Parameter name (case-insensitive)
+ * @param value Receives a pointer to the value (not NUL-terminated)
+ * @param value_len Receives the value length
+ * @return true if the parameter is present
+ */
+bool sip_header_param(const sip_header_t* header, const char* name, const char** value, size_t* value_len);
+
+/**
+ * Copy a header parameter into a NUL-terminated buffer
+ *
+ * @return true if the parameter exists and fits
+ */
+bool sip_header_copy_param(const sip_header_t* header, const char* name, char* dest, size_t dest_size);
+
+/**
+ * Copy the URI of a name-addr header (From, To, Contact): the part inside
+ * <...>, or the bare value up to the first ';' when there are no brackets
+ *
+ * @return true if a URI was found and fits
+ */
+bool sip_header_copy_uri(const sip_header_t* header, char* dest, size_t dest_size);
+
+/**
+ * Method token for a method enum ("INVITE", ...)
+ */
+const char* sip_method_name(sip_method_t method);
+
+#endif // SIP_PARSER_H
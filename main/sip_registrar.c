@@ -0,0 +1,260 @@
+#include "sip_registrar.h"
+#include "esp_log.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const char *TAG = "SIP_REGISTRAR";
+
+static sip_registrar_t registrars[SIP_REGISTRAR_MAX];
+static int registrar_count = 0;
+static int active = 0;
+static char current_list[SIP_REGISTRAR_MAX * SIP_REGISTRAR_HOST_LEN];
+
+static bool time_reached(uint32_t now, uint32_t deadline)
+{
+    return (int32_t)(now - deadline) >= 0;
+}
+
+static bool on_hold(const sip_registrar_t* r, uint32_t now)
+{
+    return r->failures > 0 && !time_reached(now, r->hold_until);
+}
+
+// true if a ranks before b as a failover target
+static bool better(int a, int b)
+{
+    const sip_registrar_t* ra = &registrars[a];
+    const sip_registrar_t* rb = &registrars[b];
+    if ((ra->failures == 0) != (rb->failures == 0)) {
+        return ra->failures == 0;
+    }
+    if (ra->srtt_ms != rb->srtt_ms) {
+        return ra->srtt_ms < rb->srtt_ms;
+    }
+    return a < b;
+}
+
+// Best registrar other than @p skip; the one coming off hold first if all are held
+static int best_other(int skip, uint32_t now)
+{
+    int best = -1;
+    for (int i = 0; i < registrar_count; i++) {
+        if (i != skip && !on_hold(&registrars[i], now) && (best < 0 || better(i, best))) {
+            best = i;
+        }
+    }
+    if (best >= 0) {
+        return best;
+    }
+
+    for (int i = 0; i < registrar_count; i++) {
+        if (best < 0 || (int32_t)(registrars[i].hold_until - registrars[best].hold_until) < 0) {
+            best = i;
+        }
+    }
+    return best < 0 ? 0 : best;
+}
+
+int sip_registrar_set_list(const char* list)
+{
+    if (!list) {
+        list = "";
+    }
+    if (strcmp(list, current_list) == 0) {
+        return registrar_count;
+    }
+    snprintf(current_list, sizeof(current_list), "%s", list);
+
+    memset(registrars, 0, sizeof(registrars));
+    registrar_count = 0;
+    active = 0;
+
+    const char* p = list;
+    while (*p && registrar_count < SIP_REGISTRAR_MAX) {
+        while (*p == ',' || *p == ' ') {
+            p++;
+        }
+        size_t len = strcspn(p, ", ");
+        if (len == 0) {
+            break;
+        }
+
+        sip_registrar_t* r = &registrars[registrar_count];
+        size_t host_len = len;
+        const char* colon = memchr(p, ':', len);
+        if (colon) {
+            host_len = (size_t)(colon - p);
+            r->port = (uint16_t)strtoul(colon + 1, NULL, 10);
+        }
+        if (host_len > 0 && host_len < sizeof(r->host)) {
+            memcpy(r->host, p, host_len);
+            r->host[host_len] = '\0';
+            r->srtt_ms = SIP_REGISTRAR_NO_RTT;
+            registrar_count++;
+        }
+        p += len;
+    }
+
+    ESP_LOGI(TAG, "%d registrar(s) configured", registrar_count);
+    return registrar_count;
+}
+
+int sip_registrar_count(void)
+{
+    return registrar_count;
+}
+
+int sip_registrar_active(void)
+{
+    return active;
+}
+
+const sip_registrar_t* sip_registrar_get(int index)
+{
+    if (index < 0 || index >= registrar_count) {
+        return NULL;
+    }
+    return &registrars[index];
+}
+
+void sip_registrar_use(int index)
+{
+    if (index >= 0 && index < registrar_count && index != active) {
+        ESP_LOGI(TAG, "Returning to registrar %s", registrars[index].host);
+        active = index;
+    }
+}
+
+int sip_registrar_select(uint32_t now_ms)
+{
+    if (registrar_count > 1 && on_hold(&registrars[active], now_ms)) {
+        active = best_other(active, now_ms);
+    }
+    return active;
+}
+
+void sip_registrar_on_answer(int index, uint32_t rtt_ms)
+{
+    if (index < 0 || index >= registrar_count) {
+        return;
+    }
+    sip_registrar_t* r = &registrars[index];
+    r->failures = 0;
+    r->answered++;
+    if (rtt_ms != SIP_REGISTRAR_NO_RTT) {
+        // Smoothed like TCP's SRTT (RFC 6298, alpha 1/8)
+        r->srtt_ms = r->srtt_ms == SIP_REGISTRAR_NO_RTT ? rtt_ms : (7 * r->srtt_ms + rtt_ms) / 8;
+    }
+}
+
+int sip_registrar_on_failure(int index, uint32_t now_ms)
+{
+    if (index < 0 || index >= registrar_count) {
+        return active;
+    }
+    sip_registrar_t* r = &registrars[index];
+    r->failures++;
+    r->answered = 0;
+
+    uint32_t hold = SIP_REGISTRAR_HOLD_MS;
+    for (uint32_t i = 1; i < r->failures && hold < SIP_REGISTRAR_HOLD_MAX_MS; i++) {
+        hold *= 2;
+    }
+    if (hold > SIP_REGISTRAR_HOLD_MAX_MS) {
+        hold = SIP_REGISTRAR_HOLD_MAX_MS;
+    }
+    r->hold_until = now_ms + hold;
+
+    if (index == active && registrar_count > 1) {
+        int next = best_other(index, now_ms);
+        if (!on_hold(&registrars[next], now_ms)) {
+            ESP_LOGW(TAG, "Registrar %s failed - failing over to %s", r->host, registrars[next].host);
+            active = next;
+        }
+    }
+    return active;
+}
+
+int sip_registrar_preferred(void)
+{
+    if (active != 0 && registrars[0].failures == 0 && registrars[0].answered >= SIP_REGISTRAR_RECOVER_PROBES) {
+        return 0;
+    }
+    return -1;
+}
+
+int sip_registrar_probe_due(uint32_t now_ms)
+{
+    if (registrar_count < 2) {
+        return -1;
+    }
+
+    for (int i = 0; i < registrar_count; i++) {
+        sip_registrar_t* r = &registrars[i];
+        if (r->probing && time_reached(now_ms, r->probe_sent_at + SIP_REGISTRAR_PROBE_TIMEOUT_MS)) {
+            r->probing = false;
+            // Became the active one meanwhile: the registration decides about it
+            if (i != active) {
+                sip_registrar_on_failure(i, now_ms);
+            }
+        }
+    }
+
+    // One probe in flight at a time keeps the extra traffic to a trickle
+    for (int i = 0; i < registrar_count; i++) {
+        if (registrars[i].probing) {
+            return -1;
+        }
+    }
+    for (int i = 0; i < registrar_count; i++) {
+        sip_registrar_t* r = &registrars[i];
+        if (i != active && time_reached(now_ms, r->next_probe_at)) {
+            r->probing = true;
+            r->probe_sent_at = now_ms;
+            r->next_probe_at = now_ms + SIP_REGISTRAR_PROBE_MS;
+            return i;
+        }
+    }
+    return -1;
+}
+
+void sip_registrar_on_probe_answer(int index, uint32_t now_ms)
+{
+    if (index < 0 || index >= registrar_count || !registrars[index].probing) {
+        return;
+    }
+    registrars[index].probing = false;
+    sip_registrar_on_answer(index, now_ms - registrars[index].probe_sent_at);
+}
+
+uint32_t sip_registrar_next_ms(uint32_t now_ms)
+{
+    if (registrar_count < 2) {
+        return UINT32_MAX;
+    }
+
+    // While a probe is in flight nothing else is sent, so only its timeout
+    // counts; standbys that fell due meanwhile would otherwise read as 0
+    for (int i = 0; i < registrar_count; i++) {
+        const sip_registrar_t* r = &registrars[i];
+        if (r->probing) {
+            uint32_t deadline = r->probe_sent_at + SIP_REGISTRAR_PROBE_TIMEOUT_MS;
+            return time_reached(now_ms, deadline) ? 0 : deadline - now_ms;
+        }
+    }
+
+    uint32_t wait = UINT32_MAX;
+    for (int i = 0; i < registrar_count; i++) {
+        const sip_registrar_t* r = &registrars[i];
+        if (i == active) {
+            continue;
+        }
+        uint32_t deadline = r->next_probe_at;
+        uint32_t remaining = time_reached(now_ms, deadline) ? 0 : deadline - now_ms;
+        if (remaining < wait) {
+            wait = remaining;
+        }
+    }
+    return wait;
+}
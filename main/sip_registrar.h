@@ -0,0 +1,106 @@
+#ifndef SIP_REGISTRAR_H
+#define SIP_REGISTRAR_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define SIP_REGISTRAR_MAX               4
+#define SIP_REGISTRAR_HOST_LEN          64
+#define SIP_REGISTRAR_HOLD_MS           30000   // A failed registrar is passed over at least this long
+#define SIP_REGISTRAR_HOLD_MAX_MS       300000  // Hold doubles with every further failure up to this
+#define SIP_REGISTRAR_PROBE_MS          30000   // Each standby registrar is probed this often
+#define SIP_REGISTRAR_PROBE_TIMEOUT_MS  2000    // Unanswered standby probe counts as a failure
+#define SIP_REGISTRAR_RECOVER_PROBES    3       // Answers in a row before returning to a preferred registrar
+#define SIP_REGISTRAR_NO_RTT            UINT32_MAX
+
+typedef struct {
+    char host[SIP_REGISTRAR_HOST_LEN];
+    uint16_t port;              // From "host:port", 0 = configured port
+    uint32_t srtt_ms;           // Smoothed round trip, SIP_REGISTRAR_NO_RTT until measured
+    uint32_t failures;          // Consecutive timeouts and unanswered probes
+    uint32_t hold_until;        // Passed over until then while failures > 0
+    uint32_t answered;          // Consecutive answers
+    bool probing;               // Standby probe in flight
+    uint32_t probe_sent_at;
+    uint32_t next_probe_at;
+} sip_registrar_t;
+
+/**
+ * Set the registrar list: "host[:port]" entries separated by commas, in
+ * order of preference. Scores are kept if the list did not change.
+ *
+ * @return Number of registrars
+ */
+int sip_registrar_set_list(const char* list);
+
+int sip_registrar_count(void);
+
+/**
+ * Index of the registrar in use (0 if the list is empty)
+ */
+int sip_registrar_active(void);
+
+/**
+ * @return Registrar at @p index, or NULL
+ */
+const sip_registrar_t* sip_registrar_get(int index);
+
+/**
+ * Make @p index the active registrar (sticky return)
+ */
+void sip_registrar_use(int index);
+
+/**
+ * Registrar to register with now: the active one unless it is on hold
+ * after failures, else the best of the others (see sip_registrar_on_failure)
+ *
+ * @return New active index
+ */
+int sip_registrar_select(uint32_t now_ms);
+
+/**
+ * The registrar answered a request
+ *
+ * @param rtt_ms Measured round trip, or SIP_REGISTRAR_NO_RTT
+ */
+void sip_registrar_on_answer(int index, uint32_t rtt_ms);
+
+/**
+ * The registrar did not answer (transaction timeout, connection refused,
+ * lost keep-alives). It is put on hold; if it was the active one, the next
+ * is chosen right away: registrars without failures first, then by round
+ * trip (unmeasured last), then by list order.
+ *
+ * @return Active index afterwards (unchanged if there is no alternative)
+ */
+int sip_registrar_on_failure(int index, uint32_t now_ms);
+
+/**
+ * Sticky return: the primary (first in the list) once it has answered
+ * SIP_REGISTRAR_RECOVER_PROBES probes in a row. Otherwise the active
+ * registrar is kept, even if a standby has a shorter round trip.
+ *
+ * @return Index to move to, or -1 to stay
+ */
+int sip_registrar_preferred(void);
+
+/**
+ * Standby probing: times out the probe in flight, then picks the next
+ * standby due for a probe and marks it sent
+ *
+ * @return Index of the standby to send an OPTIONS to, or -1
+ */
+int sip_registrar_probe_due(uint32_t now_ms);
+
+/**
+ * Response to a standby probe
+ */
+void sip_registrar_on_probe_answer(int index, uint32_t now_ms);
+
+/**
+ * Milliseconds until sip_registrar_probe_due() has something to do,
+ * UINT32_MAX with fewer than two registrars
+ */
+uint32_t sip_registrar_next_ms(uint32_t now_ms);
+
+#endif // SIP_REGISTRAR_H
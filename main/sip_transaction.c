@@ -0,0 +1,425 @@
+#include "sip_transaction.h"
+#include "esp_log.h"
+#include <string.h>
+#include <stdio.h>
+
+static const char *TAG = "SIP_TXN";
+
+#define SIP_TXN_MAX         12      // Concurrent client + server transactions (forked INVITEs and their CANCELs)
+#define SIP_TXN_MSG_SIZE    1536    // Largest message kept for retransmission
+#define SIP_TXN_BRANCH_LEN  64
+#define SIP_TXN_CALL_ID_LEN 128
+
+// RFC 3261 §17 state names; TRYING doubles as "Calling" for INVITE clients
+typedef enum {
+    TXN_FREE = 0,
+    TXN_TRYING,
+    TXN_PROCEEDING,
+    TXN_COMPLETED,
+    TXN_CONFIRMED
+} txn_state_t;
+
+typedef struct {
+    txn_state_t state;
+    bool server;
+    sip_method_t method;
+    char branch[SIP_TXN_BRANCH_LEN];
+    char call_id[SIP_TXN_CALL_ID_LEN];  // With cseq: matches the ACK for a 2xx (new branch)
+    uint32_t cseq;
+    int status_code;
+
+    // Retransmission timer (A, E or G); interval 0 = not armed
+    uint32_t retransmit_at;
+    uint32_t interval;
+
+    // Timeout (B, F, H) or clean-up (D, I, J, K) timer
+    uint32_t expire_at;
+    bool expiry_is_timeout;
+
+    // Client: the request, then the ACK once an INVITE is completed
+    // Server: the last response sent
+    uint16_t msg_len;
+    char msg[SIP_TXN_MSG_SIZE];
+} sip_txn_t;
+
+static sip_txn_t txn_table[SIP_TXN_MAX];
+static sip_txn_send_fn txn_send = NULL;
+static sip_txn_timeout_fn txn_on_timeout = NULL;
+static bool txn_reliable = false;
+
+static bool time_reached(uint32_t now, uint32_t deadline)
+{
+    return (int32_t)(now - deadline) >= 0;
+}
+
+// Top Via branch of a message; false if it has none
+static bool msg_branch(const sip_message_t* msg, char* branch, size_t size)
+{
+    return sip_header_copy_param(sip_msg_header(msg, SIP_HDR_VIA), "branch", branch, size) &&
+           branch[0] != '\0';
+}
+
+static sip_txn_t* txn_find(bool server, sip_method_t method, const char* branch)
+{
+    for (int i = 0; i < SIP_TXN_MAX; i++) {
+        sip_txn_t* t = &txn_table[i];
+        if (t->state != TXN_FREE && t->server == server && t->method == method &&
+            strcmp(t->branch, branch) == 0) {
+            return t;
+        }
+    }
+    return NULL;
+}
+
+// The ACK for a 2xx carries a new branch; match it on Call-ID and CSeq instead
+static sip_txn_t* txn_find_invite_for_ack(const sip_message_t* ack)
+{
+    char call_id[SIP_TXN_CALL_ID_LEN];
+    if (!sip_msg_copy_header(ack, SIP_HDR_CALL_ID, call_id, sizeof(call_id))) {
+        return NULL;
+    }
+    for (int i = 0; i < SIP_TXN_MAX; i++) {
+        sip_txn_t* t = &txn_table[i];
+        if (t->state != TXN_FREE && t->server && t->method == SIP_METHOD_INVITE &&
+            t->cseq == (uint32_t)ack->cseq_num && strcmp(t->call_id, call_id) == 0) {
+            return t;
+        }
+    }
+    return NULL;
+}
+
+// Free slot, else the completed transaction closest to its clean-up
+static sip_txn_t* txn_alloc(void)
+{
+    sip_txn_t* victim = NULL;
+    for (int i = 0; i < SIP_TXN_MAX; i++) {
+        sip_txn_t* t = &txn_table[i];
+        if (t->state == TXN_FREE) {
+            return t;
+        }
+        if ((t->state == TXN_COMPLETED || t->state == TXN_CONFIRMED) && !t->expiry_is_timeout &&
+            (!victim || (int32_t)(t->expire_at - victim->expire_at) < 0)) {
+            victim = t;
+        }
+    }
+    if (victim) {
+        ESP_LOGD(TAG, "Table full - recycling completed %s transaction",
+                 sip_method_name(victim->method));
+    }
+    return victim;
+}
+
+static bool txn_store(sip_txn_t* t, const char* data, size_t len)
+{
+    if (len > sizeof(t->msg)) {
+        t->msg_len = 0;
+        ESP_LOGW(TAG, "%u byte message too large to keep for retransmission", (unsigned)len);
+        return false;
+    }
+    memcpy(t->msg, data, len);
+    t->msg_len = (uint16_t)len;
+    return true;
+}
+
+static void txn_arm_retransmit(sip_txn_t* t, uint32_t now, uint32_t interval)
+{
+    t->interval = interval;
+    t->retransmit_at = now + interval;
+}
+
+// Clean-up delay of a completed transaction: absorbing retransmissions is
+// only needed when the transport may duplicate messages
+static uint32_t txn_linger(uint32_t delay)
+{
+    return txn_reliable ? 0 : delay;
+}
+
+static void txn_set_expiry(sip_txn_t* t, uint32_t now, uint32_t delay, bool is_timeout)
+{
+    t->expire_at = now + delay;
+    t->expiry_is_timeout = is_timeout;
+}
+
+static int txn_transmit(const char* data, size_t len)
+{
+    return txn_send ? txn_send(data, len) : -1;
+}
+
+void sip_txn_init(sip_txn_send_fn send, sip_txn_timeout_fn on_timeout)
+{
+    txn_send = send;
+    txn_on_timeout = on_timeout;
+    sip_txn_reset();
+}
+
+void sip_txn_set_reliable(bool reliable)
+{
+    txn_reliable = reliable;
+}
+
+void sip_txn_reset(void)
+{
+    memset(txn_table, 0, sizeof(txn_table));
+}
+
+// A response we send: store it in its server transaction and start G/H or J
+static void txn_send_response(const sip_message_t* msg, const char* branch,
+                              const char* data, size_t len, uint32_t now)
+{
+    sip_txn_t* t = txn_find(true, msg->cseq_method, branch);
+    if (!t) {
+        return;
+    }
+
+    txn_store(t, data, len);
+    t->status_code = msg->status_code;
+
+    if (msg->status_code < 200) {
+        t->state = TXN_PROCEEDING;
+        return;
+    }
+
+    t->state = TXN_COMPLETED;
+    if (t->method == SIP_METHOD_INVITE) {
+        // Repeat the final response until the ACK arrives (Timer G), give up after Timer H.
+        // A 2xx is retransmitted on the same schedule (RFC 3261 §13.3.1.4).
+        if (!txn_reliable || msg->status_code < 300) {
+            txn_arm_retransmit(t, now, SIP_TXN_T1_MS);
+        }
+        txn_set_expiry(t, now, SIP_TXN_TIMEOUT_MS, true);
+    } else {
+        // Keep the response for request retransmissions until Timer J
+        t->interval = 0;
+        txn_set_expiry(t, now, txn_linger(SIP_TXN_TIMEOUT_MS), false);
+    }
+}
+
+// A request we send: open a client transaction (A/B or E/F)
+static void txn_send_request(const sip_message_t* msg, const char* branch,
+                             const char* data, size_t len, uint32_t now)
+{
+    if (msg->method == SIP_METHOD_ACK) {
+        // ACK for a non-2xx response shares the INVITE's branch; keep it so a
+        // retransmitted final response can be ACKed again (Timer D)
+        sip_txn_t* t = txn_find(false, SIP_METHOD_INVITE, branch);
+        if (t && t->state == TXN_COMPLETED) {
+            txn_store(t, data, len);
+        }
+        return;
+    }
+
+    if (txn_find(false, msg->method, branch)) {
+        ESP_LOGW(TAG, "%s with branch %s already in progress", sip_method_name(msg->method), branch);
+        return;
+    }
+
+    sip_txn_t* t = txn_alloc();
+    if (!t) {
+        ESP_LOGW(TAG, "No free transaction - %s sent without retransmission",
+                 sip_method_name(msg->method));
+        return;
+    }
+
+    memset(t, 0, sizeof(*t));
+    if (!txn_store(t, data, len)) {
+        return;
+    }
+    t->state = TXN_TRYING;
+    t->server = false;
+    t->method = msg->method;
+    snprintf(t->branch, sizeof(t->branch), "%s", branch);
+    sip_msg_copy_header(msg, SIP_HDR_CALL_ID, t->call_id, sizeof(t->call_id));
+    t->cseq = (uint32_t)msg->cseq_num;
+    if (!txn_reliable) {
+        txn_arm_retransmit(t, now, SIP_TXN_T1_MS);
+    }
+    txn_set_expiry(t, now, SIP_TXN_TIMEOUT_MS, true);
+}
+
+int sip_txn_send(const char* data, size_t len, uint32_t now_ms)
+{
+    sip_message_t msg;
+    char branch[SIP_TXN_BRANCH_LEN];
+
+    if (sip_parse_message(data, len, &msg) && msg_branch(&msg, branch, sizeof(branch))) {
+        if (msg.is_response) {
+            txn_send_response(&msg, branch, data, len, now_ms);
+        } else {
+            txn_send_request(&msg, branch, data, len, now_ms);
+        }
+    }
+
+    return txn_transmit(data, len);
+}
+
+static sip_txn_disposition_t txn_receive_response(const sip_message_t* msg, const char* branch,
+                                                  uint32_t now)
+{
+    sip_txn_t* t = txn_find(false, msg->cseq_method, branch);
+    if (!t) {
+        // No transaction: first response after clean-up, or a 2xx retransmission
+        // that the transaction user answers with its own ACK
+        return SIP_TXN_DELIVER;
+    }
+
+    if (t->state == TXN_COMPLETED) {
+        // Final response already delivered; an INVITE gets its ACK again
+        if (t->method == SIP_METHOD_INVITE && msg->status_code >= 300 && t->msg_len > 0) {
+            txn_transmit(t->msg, t->msg_len);
+        }
+        ESP_LOGD(TAG, "Absorbed retransmitted %d for %s", msg->status_code, sip_method_name(t->method));
+        return SIP_TXN_ABSORBED;
+    }
+
+    t->status_code = msg->status_code;
+
+    if (msg->status_code < 200) {
+        t->state = TXN_PROCEEDING;
+        if (t->method == SIP_METHOD_INVITE) {
+            // Stop Timer A; how long to ring is up to the transaction user
+            t->interval = 0;
+            txn_set_expiry(t, now, SIP_TXN_TIMEOUT_MS, false);
+        } else if (t->interval > 0) {
+            // Timer E continues at T2 once the request is known to have arrived
+            txn_arm_retransmit(t, now, SIP_TXN_T2_MS);
+        }
+        return SIP_TXN_DELIVER;
+    }
+
+    if (t->method == SIP_METHOD_INVITE && msg->status_code < 300) {
+        // 2xx ends the INVITE transaction; the ACK belongs to the dialog
+        t->state = TXN_FREE;
+        return SIP_TXN_DELIVER;
+    }
+
+    // Final response: absorb retransmissions for Timer D (INVITE) or K
+    t->state = TXN_COMPLETED;
+    t->interval = 0;
+    t->msg_len = 0;
+    txn_set_expiry(t, now, txn_linger(t->method == SIP_METHOD_INVITE ? SIP_TXN_TIMEOUT_MS : SIP_TXN_T4_MS),
+                   false);
+    return SIP_TXN_DELIVER;
+}
+
+static sip_txn_disposition_t txn_receive_request(const sip_message_t* msg, const char* branch,
+                                                 uint32_t now)
+{
+    if (msg->method == SIP_METHOD_ACK) {
+        sip_txn_t* t = txn_find(true, SIP_METHOD_INVITE, branch);
+        if (!t) {
+            t = txn_find_invite_for_ack(msg);
+        }
+        if (!t) {
+            return SIP_TXN_DELIVER;
+        }
+        if (t->state == TXN_CONFIRMED) {
+            return SIP_TXN_ABSORBED;
+        }
+        // Stop Timers G and H; absorb further ACKs until Timer I
+        t->state = TXN_CONFIRMED;
+        t->interval = 0;
+        txn_set_expiry(t, now, txn_linger(SIP_TXN_T4_MS), false);
+        return SIP_TXN_DELIVER;
+    }
+
+    sip_txn_t* t = txn_find(true, msg->method, branch);
+    if (t) {
+        // Retransmitted request: repeat the last response, if any
+        if (t->msg_len > 0) {
+            txn_transmit(t->msg, t->msg_len);
+        }
+        ESP_LOGD(TAG, "Absorbed retransmitted %s", sip_method_name(msg->method));
+        return SIP_TXN_ABSORBED;
+    }
+
+    t = txn_alloc();
+    if (!t) {
+        ESP_LOGW(TAG, "No free transaction for incoming %s", sip_method_name(msg->method));
+        return SIP_TXN_DELIVER;
+    }
+
+    memset(t, 0, sizeof(*t));
+    t->state = (msg->method == SIP_METHOD_INVITE) ? TXN_PROCEEDING : TXN_TRYING;
+    t->server = true;
+    t->method = msg->method;
+    snprintf(t->branch, sizeof(t->branch), "%s", branch);
+    sip_msg_copy_header(msg, SIP_HDR_CALL_ID, t->call_id, sizeof(t->call_id));
+    t->cseq = (uint32_t)msg->cseq_num;
+    // Safety net in case the transaction user never answers
+    txn_set_expiry(t, now, SIP_TXN_TIMEOUT_MS, false);
+    return SIP_TXN_DELIVER;
+}
+
+sip_txn_disposition_t sip_txn_receive(const sip_message_t* msg, uint32_t now_ms)
+{
+    char branch[SIP_TXN_BRANCH_LEN];
+    if (!msg_branch(msg, branch, sizeof(branch))) {
+        return SIP_TXN_DELIVER;
+    }
+    return msg->is_response ? txn_receive_response(msg, branch, now_ms)
+                            : txn_receive_request(msg, branch, now_ms);
+}
+
+void sip_txn_process(uint32_t now_ms)
+{
+    for (int i = 0; i < SIP_TXN_MAX; i++) {
+        sip_txn_t* t = &txn_table[i];
+        if (t->state == TXN_FREE) {
+            continue;
+        }
+
+        if (time_reached(now_ms, t->expire_at)) {
+            sip_method_t method = t->method;
+            bool server = t->server;
+            int status_code = t->status_code;
+            bool notify = t->expiry_is_timeout;
+            char call_id[SIP_TXN_CALL_ID_LEN];
+            memcpy(call_id, t->call_id, sizeof(call_id));
+
+            // Free before the callback: it may send or reset the table
+            t->state = TXN_FREE;
+            if (notify) {
+                ESP_LOGW(TAG, "%s %s transaction timed out", sip_method_name(method),
+                         server ? "server" : "client");
+                if (txn_on_timeout) {
+                    txn_on_timeout(method, server, status_code, call_id);
+                }
+            }
+            continue;
+        }
+
+        if (t->interval > 0 && t->msg_len > 0 && time_reached(now_ms, t->retransmit_at)) {
+            txn_transmit(t->msg, t->msg_len);
+
+            // INVITE requests back off without limit (Timer A); non-INVITE
+            // requests (E) and INVITE responses (G) are capped at T2
+            uint32_t next = t->interval * 2;
+            if (!(t->method == SIP_METHOD_INVITE && !t->server) && next > SIP_TXN_T2_MS) {
+                next = SIP_TXN_T2_MS;
+            }
+            txn_arm_retransmit(t, now_ms, next);
+            ESP_LOGD(TAG, "Retransmitted %s, next in %lu ms", sip_method_name(t->method),
+                     (unsigned long)next);
+        }
+    }
+}
+
+uint32_t sip_txn_next_timer_ms(uint32_t now_ms)
+{
+    uint32_t wait = UINT32_MAX;
+    for (int i = 0; i < SIP_TXN_MAX; i++) {
+        const sip_txn_t* t = &txn_table[i];
+        if (t->state == TXN_FREE) {
+            continue;
+        }
+        uint32_t deadlines[2] = { t->expire_at, t->retransmit_at };
+        int count = (t->interval > 0 && t->msg_len > 0) ? 2 : 1;
+        for (int j = 0; j < count; j++) {
+            uint32_t remaining = time_reached(now_ms, deadlines[j]) ? 0 : deadlines[j] - now_ms;
+            if (remaining < wait) {
+                wait = remaining;
+            }
+        }
+    }
+    return wait;
+}
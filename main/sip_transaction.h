@@ -0,0 +1,97 @@
+#ifndef SIP_TRANSACTION_H
+#define SIP_TRANSACTION_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "sip_parser.h"
+
+// RFC 3261 §17 timer base values (unreliable transport)
+#define SIP_TXN_T1_MS           500     // RTT estimate, first retransmission interval
+#define SIP_TXN_T2_MS           4000    // Retransmission cap for non-INVITE requests and INVITE responses
+#define SIP_TXN_T4_MS           5000    // Maximum time a message stays in the network
+#define SIP_TXN_TIMEOUT_MS      (64 * SIP_TXN_T1_MS)    // Timers B, F, H and J
+
+/**
+ * What the caller should do with a received message
+ */
+typedef enum {
+    SIP_TXN_DELIVER,    // New request or response: hand it to the transaction user
+    SIP_TXN_ABSORBED    // Retransmission, already answered by the transaction layer
+} sip_txn_disposition_t;
+
+/**
+ * Transmit a message to the peer (initial send and retransmissions)
+ *
+ * @return Bytes sent, or -1 on failure
+ */
+typedef int (*sip_txn_send_fn)(const char* data, size_t len);
+
+/**
+ * Transaction timed out (Timer B/F for requests we sent, Timer H when the
+ * ACK for our final response to an INVITE never arrived)
+ *
+ * @param method Method of the transaction
+ * @param server true for a server transaction
+ * @param status_code Last response sent (server) or received (client), 0 if none
+ * @param call_id Call-ID of the transaction
+ */
+typedef void (*sip_txn_timeout_fn)(sip_method_t method, bool server, int status_code,
+                                   const char* call_id);
+
+/**
+ * Install the transport and timeout callbacks and clear the table
+ */
+void sip_txn_init(sip_txn_send_fn send, sip_txn_timeout_fn on_timeout);
+
+/**
+ * Select the timer set for the transport: over TCP and TLS requests and
+ * non-2xx responses are not retransmitted and completed transactions are
+ * released at once (Timers D, I, J and K are zero). A 2xx to an INVITE is
+ * still repeated until its ACK arrives.
+ */
+void sip_txn_set_reliable(bool reliable);
+
+/**
+ * Drop all transactions without notification (socket closed, reinit)
+ */
+void sip_txn_reset(void);
+
+/**
+ * Send a request or response through the transaction layer
+ *
+ * Requests other than ACK open a client transaction keyed by their Via
+ * branch and are retransmitted until answered. An ACK for a non-2xx final
+ * response is kept by its INVITE transaction and repeated if the response
+ * is retransmitted. Responses are stored in the matching server transaction
+ * so retransmitted requests can be answered again.
+ *
+ * @param data Complete message
+ * @param len Message length
+ * @param now_ms Current time in milliseconds
+ * @return Bytes sent, or -1 on failure
+ */
+int sip_txn_send(const char* data, size_t len, uint32_t now_ms);
+
+/**
+ * Match a received message against the transaction table
+ *
+ * Retransmitted requests are answered with the last response sent,
+ * retransmitted final responses to an INVITE are ACKed again, and both are
+ * reported as absorbed. Anything else creates or advances a transaction
+ * and is delivered.
+ */
+sip_txn_disposition_t sip_txn_receive(const sip_message_t* msg, uint32_t now_ms);
+
+/**
+ * Run expired timers: retransmissions (A, E, G), timeouts (B, F, H) and
+ * clean-up of completed transactions (D, I, J, K)
+ */
+void sip_txn_process(uint32_t now_ms);
+
+/**
+ * Milliseconds until the next transaction timer, UINT32_MAX if none
+ */
+uint32_t sip_txn_next_timer_ms(uint32_t now_ms);
+
+#endif // SIP_TRANSACTION_H
@@ -0,0 +1,543 @@
+#include "sip_transport.h"
+#include "esp_log.h"
+#include "esp_attr.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "mbedtls/ssl.h"
+#include "mbedtls/entropy.h"
+#include "mbedtls/ctr_drbg.h"
+#include "mbedtls/net_sockets.h"
+#include "esp_crt_bundle.h"
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+
+static const char *TAG = "SIP_TRANSPORT";
+
+#define SIP_UDP_PORT                5060
+#define STREAM_CONNECT_TIMEOUT_MS   5000
+#define STREAM_IO_TIMEOUT_MS        1000    // Per blocking send, and per read while handshaking
+#define TLS_HANDSHAKE_TIMEOUT_MS    10000
+
+static sip_transport_type_t transport_type = SIP_TRANSPORT_UDP;
+static bool transport_open = false;
+static int udp_socket = -1;
+
+// Connection for TCP and TLS; input is buffered until a whole message is in
+static int stream_socket = -1;
+static EXT_RAM_BSS_ATTR char stream_buf[SIP_TRANSPORT_MAX_MESSAGE];
+static size_t stream_len = 0;
+static bool stream_nonblocking = false;     // Reads stop blocking once the handshake is done
+static bool stream_pong = false;            // CRLF seen between messages since last asked
+
+// TLS: the configuration lives as long as the firmware, the context as long
+// as a connection, and the session across connections for resumption
+static mbedtls_ssl_config tls_conf;
+static mbedtls_entropy_context tls_entropy;
+static mbedtls_ctr_drbg_context tls_drbg;
+static mbedtls_ssl_context tls_ssl;
+static mbedtls_ssl_session tls_session;
+static bool tls_configured = false;
+static bool tls_active = false;
+static bool tls_session_saved = false;
+
+static uint32_t now_ms(void)
+{
+    return xTaskGetTickCount() * portTICK_PERIOD_MS;
+}
+
+static bool is_stream(void)
+{
+    return transport_type != SIP_TRANSPORT_UDP;
+}
+
+static bool name_equals(const char* name, size_t len, const char* expected)
+{
+    return len == strlen(expected) && strncasecmp(name, expected, len) == 0;
+}
+
+// Length of the message at the start of buf: headers up to the blank line
+// plus Content-Length (or its compact form "l") bytes of body.
+// 0 if the message is not complete yet, -1 if it can never fit.
+static int frame_length(const char* buf, size_t len)
+{
+    size_t header_end = 0;
+    for (size_t i = 0; i + 3 < len; i++) {
+        if (buf[i] == '\r' && buf[i + 1] == '\n' && buf[i + 2] == '\r' && buf[i + 3] == '\n') {
+            header_end = i + 4;
+            break;
+        }
+    }
+    if (header_end == 0) {
+        return len >= SIP_TRANSPORT_MAX_MESSAGE ? -1 : 0;
+    }
+
+    size_t content_length = 0;
+    const char* line = memchr(buf, '\n', header_end) + 1;   // Skip the start line
+    const char* end = buf + header_end - 2;
+    while (line < end) {
+        const char* eol = memchr(line, '\n', end - line + 1);
+        const char* colon = memchr(line, ':', eol - line);
+        if (colon) {
+            size_t name_len = colon - line;
+            while (name_len > 0 && (line[name_len - 1] == ' ' || line[name_len - 1] == '\t')) {
+                name_len--;
+            }
+            if (name_equals(line, name_len, "Content-Length") || name_equals(line, name_len, "l")) {
+                const char* p = colon + 1;
+                while (p < eol && (*p == ' ' || *p == '\t')) {
+                    p++;
+                }
+                content_length = 0;
+                while (p < eol && *p >= '0' && *p <= '9' && content_length < SIP_TRANSPORT_MAX_MESSAGE) {
+                    content_length = content_length * 10 + (size_t)(*p - '0');
+                    p++;
+                }
+            }
+        }
+        line = eol + 1;
+    }
+
+    size_t total = header_end + content_length;
+    if (total >= SIP_TRANSPORT_MAX_MESSAGE) {
+        return -1;
+    }
+    return total <= len ? (int)total : 0;
+}
+
+// BIO callbacks: plain lwip socket calls on the connection
+static int tls_bio_send(void* ctx, const unsigned char* buf, size_t len)
+{
+    int sent = send(*(int*)ctx, buf, len, 0);
+    if (sent < 0) {
+        return (errno == EAGAIN || errno == EWOULDBLOCK) ? MBEDTLS_ERR_SSL_WANT_WRITE
+                                                         : MBEDTLS_ERR_NET_SEND_FAILED;
+    }
+    return sent;
+}
+
+static int tls_bio_recv(void* ctx, unsigned char* buf, size_t len)
+{
+    int received = recv(*(int*)ctx, buf, len, stream_nonblocking ? MSG_DONTWAIT : 0);
+    if (received == 0) {
+        return MBEDTLS_ERR_NET_CONN_RESET;
+    }
+    if (received < 0) {
+        return (errno == EAGAIN || errno == EWOULDBLOCK) ? MBEDTLS_ERR_SSL_WANT_READ
+                                                         : MBEDTLS_ERR_NET_RECV_FAILED;
+    }
+    return received;
+}
+
+// One-time TLS client configuration: server certificates are checked
+// against the ESP-IDF CA bundle
+static bool tls_configure(void)
+{
+    if (tls_configured) {
+        return true;
+    }
+
+    mbedtls_ssl_config_init(&tls_conf);
+    mbedtls_entropy_init(&tls_entropy);
+    mbedtls_ctr_drbg_init(&tls_drbg);
+    mbedtls_ssl_session_init(&tls_session);
+
+    int ret = mbedtls_ctr_drbg_seed(&tls_drbg, mbedtls_entropy_func, &tls_entropy,
+                                    (const unsigned char*)"sip_tls", 7);
+    if (ret == 0) {
+        ret = mbedtls_ssl_config_defaults(&tls_conf, MBEDTLS_SSL_IS_CLIENT,
+                                          MBEDTLS_SSL_TRANSPORT_STREAM, MBEDTLS_SSL_PRESET_DEFAULT);
+    }
+    if (ret != 0) {
+        ESP_LOGE(TAG, "TLS configuration failed: -0x%04x", -ret);
+        mbedtls_ssl_config_free(&tls_conf);
+        mbedtls_ctr_drbg_free(&tls_drbg);
+        mbedtls_entropy_free(&tls_entropy);
+        return false;
+    }
+
+    mbedtls_ssl_conf_authmode(&tls_conf, MBEDTLS_SSL_VERIFY_REQUIRED);
+    mbedtls_ssl_conf_rng(&tls_conf, mbedtls_ctr_drbg_random, &tls_drbg);
+    if (esp_crt_bundle_attach(&tls_conf) != ESP_OK) {
+        ESP_LOGW(TAG, "CA bundle not available - TLS servers cannot be verified");
+    }
+
+    tls_configured = true;
+    return true;
+}
+
+static void tls_end(void)
+{
+    if (!tls_active) {
+        return;
+    }
+    mbedtls_ssl_close_notify(&tls_ssl);
+    mbedtls_ssl_free(&tls_ssl);
+    tls_active = false;
+}
+
+// Handshake on the connected stream socket, offering the last session for
+// an abbreviated handshake (session ticket or ID)
+static bool tls_start(const char* host)
+{
+    if (!tls_configure()) {
+        return false;
+    }
+
+    mbedtls_ssl_init(&tls_ssl);
+    tls_active = true;
+
+    int ret = mbedtls_ssl_setup(&tls_ssl, &tls_conf);
+    if (ret == 0) {
+        ret = mbedtls_ssl_set_hostname(&tls_ssl, host);
+    }
+    if (ret != 0) {
+        ESP_LOGE(TAG, "TLS setup failed: -0x%04x", -ret);
+        tls_end();
+        return false;
+    }
+    mbedtls_ssl_set_bio(&tls_ssl, &stream_socket, tls_bio_send, tls_bio_recv, NULL);
+
+    bool resuming = tls_session_saved && mbedtls_ssl_set_session(&tls_ssl, &tls_session) == 0;
+
+    uint32_t start = now_ms();
+    while ((ret = mbedtls_ssl_handshake(&tls_ssl)) != 0) {
+        if ((ret != MBEDTLS_ERR_SSL_WANT_READ && ret != MBEDTLS_ERR_SSL_WANT_WRITE) ||
+            now_ms() - start >= TLS_HANDSHAKE_TIMEOUT_MS) {
+            uint32_t flags = mbedtls_ssl_get_verify_result(&tls_ssl);
+            ESP_LOGE(TAG, "TLS handshake with %s failed: -0x%04x (verify flags 0x%lx)",
+                     host, -ret, (unsigned long)flags);
+            tls_end();
+            // A rejected session must not be offered again
+            mbedtls_ssl_session_free(&tls_session);
+            mbedtls_ssl_session_init(&tls_session);
+            tls_session_saved = false;
+            return false;
+        }
+    }
+
+    ESP_LOGI(TAG, "TLS connected to %s (%s, %s) in %lu ms%s", host,
+             mbedtls_ssl_get_version(&tls_ssl), mbedtls_ssl_get_ciphersuite(&tls_ssl),
+             (unsigned long)(now_ms() - start), resuming ? ", session offered for resumption" : "");
+
+    mbedtls_ssl_session_free(&tls_session);
+    mbedtls_ssl_session_init(&tls_session);
+    tls_session_saved = mbedtls_ssl_get_session(&tls_ssl, &tls_session) == 0;
+    return true;
+}
+
+static void stream_close(void)
+{
+    tls_end();
+    if (stream_socket >= 0) {
+        close(stream_socket);
+        stream_socket = -1;
+    }
+    stream_len = 0;
+    stream_nonblocking = false;
+    stream_pong = false;
+}
+
+// Connect with a timeout, then leave the socket blocking with I/O timeouts
+static bool stream_connect(const struct sockaddr_in* server)
+{
+    stream_socket = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (stream_socket < 0) {
+        ESP_LOGE(TAG, "Error creating SIP %s socket", sip_transport_name());
+        return false;
+    }
+
+    int flags = fcntl(stream_socket, F_GETFL, 0);
+    fcntl(stream_socket, F_SETFL, flags | O_NONBLOCK);
+
+    int ret = connect(stream_socket, (const struct sockaddr*)server, sizeof(*server));
+    if (ret < 0 && errno == EINPROGRESS) {
+        fd_set write_fds;
+        FD_ZERO(&write_fds);
+        FD_SET(stream_socket, &write_fds);
+        struct timeval tv = {
+            .tv_sec = STREAM_CONNECT_TIMEOUT_MS / 1000,
+            .tv_usec = (STREAM_CONNECT_TIMEOUT_MS % 1000) * 1000,
+        };
+        int error = ETIMEDOUT;
+        socklen_t error_len = sizeof(error);
+        if (select(stream_socket + 1, NULL, &write_fds, NULL, &tv) > 0) {
+            getsockopt(stream_socket, SOL_SOCKET, SO_ERROR, &error, &error_len);
+        }
+        ret = error == 0 ? 0 : -1;
+        errno = error;
+    }
+    if (ret < 0) {
+        ESP_LOGW(TAG, "SIP %s connect to %s:%u failed: errno %d", sip_transport_name(),
+                 inet_ntoa(server->sin_addr), ntohs(server->sin_port), errno);
+        stream_close();
+        return false;
+    }
+
+    fcntl(stream_socket, F_SETFL, flags & ~O_NONBLOCK);
+    struct timeval io_timeout = {
+        .tv_sec = STREAM_IO_TIMEOUT_MS / 1000,
+        .tv_usec = (STREAM_IO_TIMEOUT_MS % 1000) * 1000,
+    };
+    setsockopt(stream_socket, SOL_SOCKET, SO_SNDTIMEO, &io_timeout, sizeof(io_timeout));
+    setsockopt(stream_socket, SOL_SOCKET, SO_RCVTIMEO, &io_timeout, sizeof(io_timeout));
+    int nodelay = 1;
+    setsockopt(stream_socket, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+    return true;
+}
+
+bool sip_transport_open(sip_transport_type_t type)
+{
+    sip_transport_close();
+    transport_type = type;
+
+    if (is_stream()) {
+        transport_open = true;
+        ESP_LOGI(TAG, "SIP transport %s ready, connecting on first use", sip_transport_name());
+        return true;
+    }
+
+    udp_socket = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (udp_socket < 0) {
+        ESP_LOGE(TAG, "Error creating SIP socket");
+        return false;
+    }
+
+    struct sockaddr_in local_addr;
+    memset(&local_addr, 0, sizeof(local_addr));
+    local_addr.sin_family = AF_INET;
+    local_addr.sin_addr.s_addr = INADDR_ANY;
+    local_addr.sin_port = htons(SIP_UDP_PORT);
+
+    if (bind(udp_socket, (struct sockaddr*)&local_addr, sizeof(local_addr)) < 0) {
+        ESP_LOGE(TAG, "Error binding SIP socket to port %d", SIP_UDP_PORT);
+        close(udp_socket);
+        udp_socket = -1;
+        return false;
+    }
+
+    transport_open = true;
+    return true;
+}
+
+void sip_transport_close(void)
+{
+    stream_close();
+    if (udp_socket >= 0) {
+        close(udp_socket);
+        udp_socket = -1;
+    }
+    transport_open = false;
+}
+
+bool sip_transport_connect(const char* host, const struct sockaddr_in* server)
+{
+    if (!transport_open) {
+        return false;
+    }
+    if (!is_stream() || stream_socket >= 0) {
+        return true;
+    }
+
+    uint32_t start = now_ms();
+    if (!stream_connect(server)) {
+        return false;
+    }
+    if (transport_type == SIP_TRANSPORT_TLS && !tls_start(host)) {
+        stream_close();
+        return false;
+    }
+    stream_nonblocking = true;
+
+    ESP_LOGI(TAG, "SIP %s connection to %s:%u up in %lu ms (local port %u)", sip_transport_name(),
+             inet_ntoa(server->sin_addr), ntohs(server->sin_port),
+             (unsigned long)(now_ms() - start), sip_transport_local_port());
+    return true;
+}
+
+void sip_transport_disconnect(void)
+{
+    stream_close();
+}
+
+int sip_transport_send(const char* host, const struct sockaddr_in* server, const char* data, size_t len)
+{
+    if (!transport_open) {
+        return -1;
+    }
+
+    if (!is_stream()) {
+        return sendto(udp_socket, data, len, 0, (const struct sockaddr*)server, sizeof(*server));
+    }
+
+    if (!sip_transport_connect(host, server)) {
+        return -1;
+    }
+
+    // A message is written whole; a partial write leaves the stream unframed
+    size_t done = 0;
+    while (done < len) {
+        int ret;
+        if (tls_active) {
+            // Blocking socket: WANT_WRITE means the send timed out
+            ret = mbedtls_ssl_write(&tls_ssl, (const unsigned char*)data + done, len - done);
+        } else {
+            ret = send(stream_socket, data + done, len - done, 0);
+        }
+        if (ret <= 0) {
+            ESP_LOGW(TAG, "SIP %s send failed (%d) - dropping connection", sip_transport_name(), ret);
+            stream_close();
+            return -1;
+        }
+        done += (size_t)ret;
+    }
+    return (int)len;
+}
+
+// Append whatever the connection has without blocking
+// Returns bytes read, 0 if none are pending, -1 if the connection is gone
+static int stream_read(void)
+{
+    size_t space = sizeof(stream_buf) - stream_len;
+    int ret;
+    if (tls_active) {
+        ret = mbedtls_ssl_read(&tls_ssl, (unsigned char*)stream_buf + stream_len, space);
+        if (ret == MBEDTLS_ERR_SSL_WANT_READ || ret == MBEDTLS_ERR_SSL_WANT_WRITE) {
+            return 0;
+        }
+    } else {
+        ret = recv(stream_socket, stream_buf + stream_len, space, MSG_DONTWAIT);
+        if (ret < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            return 0;
+        }
+    }
+    if (ret <= 0) {
+        return -1;
+    }
+    stream_len += (size_t)ret;
+    return ret;
+}
+
+int sip_transport_receive(char* buf, size_t size)
+{
+    if (!transport_open) {
+        return 0;
+    }
+
+    if (!is_stream()) {
+        int len = recv(udp_socket, buf, size - 1, MSG_DONTWAIT);
+        if (len <= 0) {
+            return 0;
+        }
+        buf[len] = '\0';
+        return len;
+    }
+
+    if (stream_socket < 0) {
+        return 0;
+    }
+
+    while (1) {
+        // CRLF keep-alives (RFC 5626 §4.4.1) may sit between messages
+        size_t skip = 0;
+        while (skip < stream_len && (stream_buf[skip] == '\r' || stream_buf[skip] == '\n')) {
+            skip++;
+        }
+        if (skip > 0) {
+            memmove(stream_buf, stream_buf + skip, stream_len - skip);
+            stream_len -= skip;
+            stream_pong = true;
+        }
+
+        int frame = stream_len > 0 ? frame_length(stream_buf, stream_len) : 0;
+        if (frame < 0 || (size_t)frame >= size) {
+            ESP_LOGE(TAG, "Oversized or unframed message on SIP %s connection - dropping it",
+                     sip_transport_name());
+            stream_close();
+            return -1;
+        }
+        if (frame > 0) {
+            memcpy(buf, stream_buf, frame);
+            buf[frame] = '\0';
+            stream_len -= (size_t)frame;
+            memmove(stream_buf, stream_buf + frame, stream_len);
+            return frame;
+        }
+
+        int ret = stream_read();
+        if (ret == 0) {
+            return 0;
+        }
+        if (ret < 0) {
+            ESP_LOGW(TAG, "SIP %s connection closed by peer", sip_transport_name());
+            stream_close();
+            return -1;
+        }
+    }
+}
+
+bool sip_transport_pong_received(void)
+{
+    bool pong = stream_pong;
+    stream_pong = false;
+    return pong;
+}
+
+bool sip_transport_is_open(void)
+{
+    return transport_open;
+}
+
+bool sip_transport_is_connected(void)
+{
+    return transport_open && (!is_stream() || stream_socket >= 0);
+}
+
+int sip_transport_fd(void)
+{
+    return is_stream() ? stream_socket : udp_socket;
+}
+
+bool sip_transport_reliable(void)
+{
+    return is_stream();
+}
+
+sip_transport_type_t sip_transport_type(void)
+{
+    return transport_type;
+}
+
+const char* sip_transport_name(void)
+{
+    switch (transport_type) {
+        case SIP_TRANSPORT_TCP: return "TCP";
+        case SIP_TRANSPORT_TLS: return "TLS";
+        default:                return "UDP";
+    }
+}
+
+uint16_t sip_transport_local_port(void)
+{
+    int fd = sip_transport_fd();
+    if (fd < 0) {
+        return SIP_UDP_PORT;
+    }
+    struct sockaddr_in local_addr;
+    socklen_t addr_len = sizeof(local_addr);
+    if (getsockname(fd, (struct sockaddr*)&local_addr, &addr_len) != 0) {
+        return SIP_UDP_PORT;
+    }
+    return ntohs(local_addr.sin_port);
+}
+
+sip_transport_type_t sip_transport_from_string(const char* name)
+{
+    if (name && strcasecmp(name, "tcp") == 0) {
+        return SIP_TRANSPORT_TCP;
+    }
+    if (name && strcasecmp(name, "tls") == 0) {
+        return SIP_TRANSPORT_TLS;
+    }
+    return SIP_TRANSPORT_UDP;
+}
@@ -0,0 +1,104 @@
+#ifndef SIP_TRANSPORT_H
+#define SIP_TRANSPORT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "lwip/sockets.h"
+
+#define SIP_TRANSPORT_MAX_MESSAGE   4096    // Largest message received over any transport
+#define SIP_TLS_DEFAULT_PORT        5061
+
+typedef enum {
+    SIP_TRANSPORT_UDP = 0,      // Datagrams to and from local port 5060
+    SIP_TRANSPORT_TCP,          // One persistent connection to the server
+    SIP_TRANSPORT_TLS           // TCP with TLS (mbedtls), session resumed on reconnect
+} sip_transport_type_t;
+
+/**
+ * Open the transport. UDP binds port 5060; TCP and TLS connect on the
+ * first send or sip_transport_connect().
+ *
+ * @return false if the socket cannot be created or bound
+ */
+bool sip_transport_open(sip_transport_type_t type);
+
+/**
+ * Close the socket or connection and discard buffered input
+ * The TLS session is kept so the next connection can resume it.
+ */
+void sip_transport_close(void);
+
+/**
+ * Connect to the server if the transport is connection-oriented and not
+ * connected yet (no-op for UDP)
+ *
+ * @param host Server name, used for TLS server name indication and verification
+ * @param server Resolved server address
+ * @return true once connected (always for UDP)
+ */
+bool sip_transport_connect(const char* host, const struct sockaddr_in* server);
+
+/**
+ * Drop the connection but stay open; the next send reconnects
+ */
+void sip_transport_disconnect(void);
+
+/**
+ * Send one complete message, connecting first if needed
+ *
+ * @return Bytes sent, or -1 on failure (a failed stream send drops the connection)
+ */
+int sip_transport_send(const char* host, const struct sockaddr_in* server, const char* data, size_t len);
+
+/**
+ * Receive one complete message without blocking
+ *
+ * Stream transports are framed by Content-Length; CRLF keep-alives between
+ * messages are skipped. Call again until it returns 0: several messages
+ * may arrive in one segment or TLS record.
+ *
+ * @param buf Destination, NUL-terminated on success
+ * @param size Buffer size
+ * @return Message length, 0 if no complete message is available, -1 if the
+ *         connection was closed by the peer or broke (it is then dropped)
+ */
+int sip_transport_receive(char* buf, size_t size);
+
+/**
+ * true once after a CRLF keep-alive pong arrived on the connection
+ * (RFC 5626 §4.4.1); always false for UDP
+ */
+bool sip_transport_pong_received(void);
+
+bool sip_transport_is_open(void);
+bool sip_transport_is_connected(void);
+
+/**
+ * Descriptor to wait on for input, -1 if none
+ */
+int sip_transport_fd(void);
+
+/**
+ * true for TCP and TLS: no retransmissions (RFC 3261 §17.1.1.2)
+ */
+bool sip_transport_reliable(void);
+
+sip_transport_type_t sip_transport_type(void);
+
+/**
+ * Via transport token: "UDP", "TCP" or "TLS"
+ */
+const char* sip_transport_name(void);
+
+/**
+ * Local port of the socket (the connection's port for TCP and TLS)
+ */
+uint16_t sip_transport_local_port(void);
+
+/**
+ * Parse "udp", "tcp" or "tls" (case-insensitive); UDP for anything else
+ */
+sip_transport_type_t sip_transport_from_string(const char* name);
+
+#endif // SIP_TRANSPORT_H
@@ -0,0 +1,192 @@
+#include "sip_writer.h"
+#include <stdio.h>
+#include <string.h>
+
+// Width reserved for the Content-Length value (right-aligned, space padded)
+#define CONTENT_LENGTH_WIDTH 6
+
+void sip_dialog_init(sip_dialog_t* d, const char* user, const char* domain, const char* local_ip,
+                     const char* contact_ip, const char* transport, uint16_t port,
+                     const char* remote_uri, const char* call_id, uint32_t local_tag)
+{
+    memset(d, 0, sizeof(*d));
+    sip_dialog_set_address(d, user, local_ip, contact_ip, transport, port);
+    snprintf(d->from, sizeof(d->from), "<sip:%s@%s>;tag=%lu", user, domain, (unsigned long)local_tag);
+    snprintf(d->to, sizeof(d->to), "<%s>", remote_uri);
+    snprintf(d->call_id, sizeof(d->call_id), "%s", call_id);
+    snprintf(d->request_uri, sizeof(d->request_uri), "%s", remote_uri);
+    d->cseq = 1;
+}
+
+void sip_dialog_set_address(sip_dialog_t* d, const char* user, const char* local_ip, const char* contact_ip,
+                            const char* transport, uint16_t port)
+{
+    snprintf(d->transport, sizeof(d->transport), "%s", transport);
+    snprintf(d->via_sent_by, sizeof(d->via_sent_by), "%s:%u", local_ip, port);
+    if (strcmp(transport, "UDP") == 0) {
+        snprintf(d->contact, sizeof(d->contact), "<sip:%s@%s:%u>", user, contact_ip, port);
+    } else {
+        // Lower case in URIs (RFC 3261 §19.1.1)
+        snprintf(d->contact, sizeof(d->contact), "<sip:%s@%s:%u;transport=%s>", user, contact_ip, port,
+                 strcmp(transport, "TLS") == 0 ? "tls" : "tcp");
+    }
+}
+
+void sip_dialog_set_remote_tag(sip_dialog_t* d, const char* tag, size_t tag_len)
+{
+    if (tag_len == 0 || strstr(d->to, ";tag=")) {
+        return;
+    }
+    size_t len = strlen(d->to);
+    if (len + 5 + tag_len < sizeof(d->to)) {
+        memcpy(d->to + len, ";tag=", 5);
+        memcpy(d->to + len + 5, tag, tag_len);
+        d->to[len + 5 + tag_len] = '\0';
+    }
+}
+
+void sip_writer_init(sip_writer_t* w, char* buf, size_t size)
+{
+    w->buf = buf;
+    w->size = size;
+    w->len = 0;
+    w->content_length_pos = 0;
+    w->body_start = 0;
+    w->overflow = (size == 0);
+}
+
+void sip_writer_append_n(sip_writer_t* w, const char* text, size_t len)
+{
+    // Always keep one byte for the terminating NUL
+    if (w->overflow || len >= w->size - w->len) {
+        w->overflow = true;
+        return;
+    }
+    memcpy(w->buf + w->len, text, len);
+    w->len += len;
+}
+
+void sip_writer_append(sip_writer_t* w, const char* text)
+{
+    sip_writer_append_n(w, text, strlen(text));
+}
+
+void sip_writer_append_uint(sip_writer_t* w, uint32_t value)
+{
+    char digits[10];
+    size_t n = 0;
+    do {
+        digits[sizeof(digits) - 1 - n++] = (char)('0' + value % 10);
+        value /= 10;
+    } while (value > 0);
+    sip_writer_append_n(w, digits + sizeof(digits) - n, n);
+}
+
+void sip_writer_request_line(sip_writer_t* w, const char* method, const char* uri)
+{
+    sip_writer_append(w, method);
+    sip_writer_append_n(w, " ", 1);
+    sip_writer_append(w, uri);
+    sip_writer_append_n(w, " SIP/2.0\r\n", 10);
+}
+
+void sip_writer_status_line(sip_writer_t* w, int code, const char* reason)
+{
+    sip_writer_append_n(w, "SIP/2.0 ", 8);
+    sip_writer_append_uint(w, (uint32_t)code);
+    sip_writer_append_n(w, " ", 1);
+    sip_writer_append(w, reason);
+    sip_writer_append_n(w, "\r\n", 2);
+}
+
+void sip_writer_header_n(sip_writer_t* w, const char* name, const char* value, size_t len)
+{
+    sip_writer_append(w, name);
+    sip_writer_append_n(w, ": ", 2);
+    sip_writer_append_n(w, value, len);
+    sip_writer_append_n(w, "\r\n", 2);
+}
+
+void sip_writer_header(sip_writer_t* w, const char* name, const char* value)
+{
+    sip_writer_header_n(w, name, value, strlen(value));
+}
+
+void sip_writer_header_uint(sip_writer_t* w, const char* name, uint32_t value)
+{
+    sip_writer_append(w, name);
+    sip_writer_append_n(w, ": ", 2);
+    sip_writer_append_uint(w, value);
+    sip_writer_append_n(w, "\r\n", 2);
+}
+
+void sip_writer_via(sip_writer_t* w, const char* transport, const char* sent_by, uint32_t branch)
+{
+    sip_writer_append_n(w, "Via: SIP/2.0/", 13);
+    sip_writer_append(w, transport);
+    sip_writer_append_n(w, " ", 1);
+    sip_writer_append(w, sent_by);
+    sip_writer_append_n(w, ";branch=z9hG4bK", 15);
+    sip_writer_append_uint(w, branch);
+    sip_writer_append_n(w, ";rport\r\n", 8);
+}
+
+void sip_writer_cseq(sip_writer_t* w, uint32_t num, const char* method)
+{
+    sip_writer_append_n(w, "CSeq: ", 6);
+    sip_writer_append_uint(w, num);
+    sip_writer_append_n(w, " ", 1);
+    sip_writer_append(w, method);
+    sip_writer_append_n(w, "\r\n", 2);
+}
+
+void sip_writer_dialog_request(sip_writer_t* w, const sip_dialog_t* d, const char* method,
+                               uint32_t cseq, uint32_t branch)
+{
+    sip_writer_request_line(w, method, d->request_uri);
+    sip_writer_via(w, d->transport, d->via_sent_by, branch);
+    sip_writer_append_n(w, "Max-Forwards: 70\r\n", 18);
+    sip_writer_header(w, "From", d->from);
+    sip_writer_header(w, "To", d->to);
+    sip_writer_header(w, "Call-ID", d->call_id);
+    sip_writer_cseq(w, cseq, method);
+    sip_writer_header(w, "Contact", d->contact);
+}
+
+void sip_writer_begin_body(sip_writer_t* w, const char* content_type)
+{
+    if (content_type) {
+        sip_writer_header(w, "Content-Type", content_type);
+    }
+    sip_writer_append_n(w, "Content-Length:", 15);
+    w->content_length_pos = w->len;
+    sip_writer_append_n(w, "      \r\n\r\n", CONTENT_LENGTH_WIDTH + 4);
+    w->body_start = w->len;
+}
+
+int sip_writer_finish(sip_writer_t* w)
+{
+    if (w->content_length_pos == 0) {
+        sip_writer_append_n(w, "Content-Length: 0\r\n\r\n", 21);
+    }
+    if (w->overflow) {
+        if (w->size > 0) {
+            w->buf[0] = '\0';
+        }
+        return -1;
+    }
+
+    if (w->content_length_pos > 0) {
+        // Fill the reserved field right-aligned; leading blanks are
+        // allowed whitespace after the colon
+        size_t body_len = w->len - w->body_start;
+        char* p = w->buf + w->content_length_pos + CONTENT_LENGTH_WIDTH;
+        do {
+            *--p = (char)('0' + body_len % 10);
+            body_len /= 10;
+        } while (body_len > 0 && p > w->buf + w->content_length_pos + 1);
+    }
+
+    w->buf[w->len] = '\0';
+    return (int)w->len;
+}
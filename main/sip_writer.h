@@ -0,0 +1,135 @@
+#ifndef SIP_WRITER_H
+#define SIP_WRITER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define SIP_USER_AGENT      "ESP32-Doorbell/1.0"
+#define SIP_ALLOW_METHODS   "INVITE, ACK, CANCEL, BYE, NOTIFY, REFER, MESSAGE, OPTIONS, INFO, SUBSCRIBE"
+
+/**
+ * Dialog-invariant header values, formatted once when the dialog (or the
+ * registration) is created and copied verbatim into every message
+ */
+typedef struct {
+    char transport[4];          // Via transport: "UDP", "TCP" or "TLS"
+    char via_sent_by[32];       // "192.168.1.10:5060"
+    char from[160];             // Local side: "<sip:user@domain>;tag=..."
+    char to[256];               // Remote side: "<sip:target>" plus ";tag=..." once known
+    char call_id[128];
+    char contact[96];           // "<sip:user@ip:5060>", plus ";transport=tcp" on TCP or TLS
+    char request_uri[128];      // Remote target for requests within the dialog
+    uint32_t cseq;              // CSeq of the last request we sent
+} sip_dialog_t;
+
+/**
+ * Bounds-checked message builder over a caller-provided buffer
+ * Appends stop at the first overflow; sip_writer_finish() then reports it.
+ */
+typedef struct {
+    char* buf;
+    size_t size;
+    size_t len;
+    size_t content_length_pos;  // Offset of the reserved Content-Length digits (0 = no body)
+    size_t body_start;
+    bool overflow;
+} sip_writer_t;
+
+/**
+ * Set up the dialog strings for a request we originate (UAC)
+ *
+ * @param d Dialog to initialize
+ * @param user Local user name
+ * @param domain Local domain (registrar)
+ * @param local_ip Address placed in Via
+ * @param contact_ip Address placed in Contact (public address behind NAT)
+ * @param transport Via transport token ("UDP", "TCP" or "TLS")
+ * @param port Local port placed in Via and Contact
+ * @param remote_uri Target URI (To header and initial Request-URI)
+ * @param call_id Call-ID
+ * @param local_tag From tag
+ */
+void sip_dialog_init(sip_dialog_t* d, const char* user, const char* domain, const char* local_ip,
+                     const char* contact_ip, const char* transport, uint16_t port,
+                     const char* remote_uri, const char* call_id, uint32_t local_tag);
+
+/**
+ * Re-format Via and Contact (e.g. after learning the public address or
+ * opening a new connection)
+ */
+void sip_dialog_set_address(sip_dialog_t* d, const char* user, const char* local_ip, const char* contact_ip,
+                            const char* transport, uint16_t port);
+
+/**
+ * Record the remote tag from a response (appended to the To value once)
+ */
+void sip_dialog_set_remote_tag(sip_dialog_t* d, const char* tag, size_t tag_len);
+
+/**
+ * Start a message in the given buffer
+ */
+void sip_writer_init(sip_writer_t* w, char* buf, size_t size);
+
+/**
+ * "METHOD uri SIP/2.0"
+ */
+void sip_writer_request_line(sip_writer_t* w, const char* method, const char* uri);
+
+/**
+ * "SIP/2.0 code reason"
+ */
+void sip_writer_status_line(sip_writer_t* w, int code, const char* reason);
+
+/**
+ * Append raw text (must already contain its CRLFs)
+ */
+void sip_writer_append(sip_writer_t* w, const char* text);
+void sip_writer_append_n(sip_writer_t* w, const char* text, size_t len);
+void sip_writer_append_uint(sip_writer_t* w, uint32_t value);
+
+/**
+ * "Name: value\r\n"
+ */
+void sip_writer_header(sip_writer_t* w, const char* name, const char* value);
+void sip_writer_header_n(sip_writer_t* w, const char* name, const char* value, size_t len);
+void sip_writer_header_uint(sip_writer_t* w, const char* name, uint32_t value);
+
+/**
+ * "Via: SIP/2.0/<transport> <sent_by>;branch=z9hG4bK<branch>;rport\r\n"
+ */
+void sip_writer_via(sip_writer_t* w, const char* transport, const char* sent_by, uint32_t branch);
+
+/**
+ * "CSeq: <num> <method>\r\n"
+ */
+void sip_writer_cseq(sip_writer_t* w, uint32_t num, const char* method);
+
+/**
+ * Request line plus Via, Max-Forwards, From, To, Call-ID, CSeq and Contact
+ * from the dialog
+ *
+ * @param w Writer
+ * @param d Dialog
+ * @param method Request method
+ * @param cseq CSeq number to use
+ * @param branch Via branch for this transaction
+ */
+void sip_writer_dialog_request(sip_writer_t* w, const sip_dialog_t* d, const char* method,
+                               uint32_t cseq, uint32_t branch);
+
+/**
+ * Start the body: writes Content-Type (if given), a reserved Content-Length
+ * field and the blank line. Append the body afterwards; the length is filled
+ * in by sip_writer_finish() so body and headers are written in one pass.
+ */
+void sip_writer_begin_body(sip_writer_t* w, const char* content_type);
+
+/**
+ * Complete the message (Content-Length: 0 if no body was started)
+ *
+ * @return Message length, or -1 if the buffer overflowed
+ */
+int sip_writer_finish(sip_writer_t* w);
+
+#endif // SIP_WRITER_H
@@ -19,6 +19,9 @@
 #include "cert_manager.h"
 #include "dtmf_decoder.h"
 #include "ota_handler.h"
+#include "call_trace.h"
+#include "rtcp.h"
+#include "media_engine.h"
 
 // Use the same SAN constants as cert_manager
 #define CERT_SAN_COUNT_MAX 16
@@ -127,6 +130,10 @@ static const httpd_uri_t sip_test_call_uri;
 static const httpd_uri_t sip_log_uri;
 static const httpd_uri_t sip_connect_uri;
 static const httpd_uri_t sip_disconnect_uri;
+static const httpd_uri_t trace_uri;
+static const httpd_uri_t media_quality_uri;
+static const httpd_uri_t media_dsp_get_uri;
+static const httpd_uri_t media_dsp_post_uri;
 static const httpd_uri_t wifi_config_get_uri;
 static const httpd_uri_t wifi_config_post_uri;
 static const httpd_uri_t wifi_state_uri;
@@ -189,6 +196,12 @@ void web_api_register_handlers(httpd_handle_t server) {
     if (httpd_register_uri_handler(server, &sip_log_uri) == ESP_OK) registered_count++; else failed_count++;
     if (httpd_register_uri_handler(server, &sip_connect_uri) == ESP_OK) registered_count++; else failed_count++;
     if (httpd_register_uri_handler(server, &sip_disconnect_uri) == ESP_OK) registered_count++; else failed_count++;
+
+    // Register call latency trace, media quality and capture processing handlers (4 endpoints)
+    if (httpd_register_uri_handler(server, &trace_uri) == ESP_OK) registered_count++; else failed_count++;
+    if (httpd_register_uri_handler(server, &media_quality_uri) == ESP_OK) registered_count++; else failed_count++;
+    if (httpd_register_uri_handler(server, &media_dsp_get_uri) == ESP_OK) registered_count++; else failed_count++;
+    if (httpd_register_uri_handler(server, &media_dsp_post_uri) == ESP_OK) registered_count++; else failed_count++;
     
     // Register WiFi API handlers (5 endpoints)
     if (httpd_register_uri_handler(server, &wifi_config_get_uri) == ESP_OK) registered_count++; else failed_count++;
@@ -260,7 +273,7 @@ void web_api_register_handlers(httpd_handle_t server) {
     if (failed_count > 0) {
         ESP_LOGW(TAG, "Some API handlers failed to register. Server may have limited functionality.");
     } else {
-        ESP_LOGI(TAG, "All 48 API handlers registered successfully");
+        ESP_LOGI(TAG, "All %d API handlers registered successfully", registered_count);
     }
 }
 
@@ -278,7 +291,7 @@ static esp_err_t get_sip_state_handler(httpd_req_t *req)
     httpd_resp_set_type(req, "application/json");
     
     // Use sip_get_status which returns complete status including state name
-    char status_buffer[512];
+    char status_buffer[1536];
     sip_get_status(status_buffer, sizeof(status_buffer));
     
     httpd_resp_send(req, status_buffer, strlen(status_buffer));
@@ -307,6 +320,8 @@ static esp_err_t get_sip_config_handler(httpd_req_t *req)
     cJSON_AddStringToObject(root, "server", sip_server ? sip_server : "");
     cJSON_AddStringToObject(root, "username", username ? username : "");
     cJSON_AddStringToObject(root, "password", password ? password : "");
+    cJSON_AddStringToObject(root, "transport", sip_get_transport());
+    cJSON_AddBoolToObject(root, "dns_srv", sip_get_dns_srv());
 
     char *json_string = cJSON_Print(root);
     httpd_resp_send(req, json_string, strlen(json_string));
@@ -351,6 +366,8 @@ static esp_err_t post_sip_config_handler(httpd_req_t *req)
     const cJSON *sip_server = cJSON_GetObjectItem(root, "server");
     const cJSON *username = cJSON_GetObjectItem(root, "username");
     const cJSON *password = cJSON_GetObjectItem(root, "password");
+    const cJSON *transport = cJSON_GetObjectItem(root, "transport");
+    const cJSON *dns_srv = cJSON_GetObjectItem(root, "dns_srv");
 
     if (cJSON_IsString(target1) && (target1->valuestring != NULL)) {
         sip_set_target1(target1->valuestring);
@@ -367,12 +384,19 @@ static esp_err_t post_sip_config_handler(httpd_req_t *req)
     if (cJSON_IsString(password) && (password->valuestring != NULL)) {
         sip_set_password(password->valuestring);
     }
+    if (cJSON_IsString(transport) && (transport->valuestring != NULL)) {
+        sip_set_transport(transport->valuestring);
+    }
+    if (cJSON_IsBool(dns_srv)) {
+        sip_set_dns_srv(cJSON_IsTrue(dns_srv));
+    }
 
     cJSON_Delete(root);
 
     // Save the updated configuration to NVS
     sip_save_config(sip_get_server(), sip_get_username(), sip_get_password(),
-                   sip_get_target1(), sip_get_target2(), 5060); // Using default port
+                   sip_get_target1(), sip_get_target2(), 5060, // Using default port (5061 for TLS)
+                   sip_transport_from_string(sip_get_transport()), sip_get_dns_srv());
 
     sip_reinit(); // Re-initialize SIP client with new settings
 
@@ -519,6 +543,7 @@ static esp_err_t get_sip_log_handler(httpd_req_t *req)
             break;
         }
         // Use double for timestamp to preserve precision in JSON
+        cJSON_AddNumberToObject(entry, "seq", entries[i].seq);
         cJSON_AddNumberToObject(entry, "timestamp", (double)entries[i].timestamp);
         cJSON_AddStringToObject(entry, "type", entries[i].type);
         cJSON_AddStringToObject(entry, "message", entries[i].message);
@@ -543,6 +568,313 @@ static esp_err_t get_sip_log_handler(httpd_req_t *req)
     return ESP_OK;
 }
 
+// Doorbell-to-audio latency: breakdown of the last call and histograms over
+// all calls since boot; ?format=bin returns the raw trace ring instead
+static esp_err_t get_trace_handler(httpd_req_t *req)
+{
+    // Check authentication (don't extend session for diagnostics polling)
+    if (auth_filter(req, false) != ESP_OK) {
+        return ESP_FAIL;
+    }
+
+    char query[32];
+    char format[8] = {0};
+    if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK) {
+        httpd_query_key_value(query, "format", format, sizeof(format));
+    }
+
+    if (strcmp(format, "bin") == 0) {
+        size_t size = call_trace_export_size();
+        uint8_t *buf = malloc(size);
+        if (!buf) {
+            httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Out of memory");
+            return ESP_FAIL;
+        }
+        size_t len = call_trace_export(buf, size);
+        httpd_resp_set_type(req, "application/octet-stream");
+        httpd_resp_set_hdr(req, "Content-Disposition", "attachment; filename=\"call_trace.bin\"");
+        httpd_resp_send(req, (const char *)buf, len);
+        free(buf);
+        return ESP_OK;
+    }
+
+    httpd_resp_set_type(req, "application/json");
+    cJSON *root = cJSON_CreateObject();
+
+    // Last call: offset of every trace point from the press, and the step
+    // from the previous trace point that occurred
+    call_trace_call_t call;
+    call_trace_get_last_call(&call);
+    cJSON *call_obj = cJSON_AddObjectToObject(root, "last_call");
+    cJSON_AddNumberToObject(call_obj, "id", call.call_id);
+    cJSON_AddBoolToObject(call_obj, "complete", call.complete);
+    cJSON *events = cJSON_AddArrayToObject(call_obj, "events");
+    uint32_t previous_us = 0;
+    for (int i = 0; call.call_id != 0 && i < CALL_TRACE_EVENT_COUNT; i++) {
+        if (call.offset_us[i] == UINT32_MAX) {
+            continue;
+        }
+        cJSON *event = cJSON_CreateObject();
+        cJSON_AddStringToObject(event, "event", call_trace_event_name((call_trace_event_t)i));
+        cJSON_AddNumberToObject(event, "offset_us", call.offset_us[i]);
+        cJSON_AddNumberToObject(event, "step_us", call.offset_us[i] - previous_us);
+        cJSON_AddItemToArray(events, event);
+        previous_us = call.offset_us[i];
+    }
+
+    // Running histograms: bucket i counts offsets in [2^i, 2^(i+1)) ms
+    cJSON *histograms = cJSON_AddObjectToObject(root, "histograms");
+    for (int i = 0; i < CALL_TRACE_EVENT_COUNT; i++) {
+        call_trace_hist_t hist;
+        call_trace_get_histogram((call_trace_event_t)i, &hist);
+        cJSON *hist_obj = cJSON_AddObjectToObject(histograms, call_trace_event_name((call_trace_event_t)i));
+        cJSON_AddNumberToObject(hist_obj, "count", hist.count);
+        if (hist.count > 0) {
+            cJSON_AddNumberToObject(hist_obj, "min_us", hist.min_us);
+            cJSON_AddNumberToObject(hist_obj, "avg_us", (double)(hist.sum_us / hist.count));
+            cJSON_AddNumberToObject(hist_obj, "max_us", hist.max_us);
+        }
+        cJSON *buckets = cJSON_AddArrayToObject(hist_obj, "buckets_log2_ms");
+        for (int b = 0; b < CALL_TRACE_HIST_BUCKETS; b++) {
+            cJSON_AddItemToArray(buckets, cJSON_CreateNumber(hist.buckets[b]));
+        }
+    }
+
+    char *json_string = cJSON_PrintUnformatted(root);
+    cJSON_Delete(root);
+    if (!json_string) {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Out of memory");
+        return ESP_FAIL;
+    }
+    httpd_resp_send(req, json_string, strlen(json_string));
+    free(json_string);
+    return ESP_OK;
+}
+
+// Media quality from RTP/RTCP: live values of the current (or last) call
+// and summaries of the most recent calls, newest first
+static esp_err_t get_media_quality_handler(httpd_req_t *req)
+{
+    // Check authentication (don't extend session for diagnostics polling)
+    if (auth_filter(req, false) != ESP_OK) {
+        return ESP_FAIL;
+    }
+
+    httpd_resp_set_type(req, "application/json");
+    cJSON *root = cJSON_CreateObject();
+
+    rtcp_quality_t q;
+    rtcp_get_quality(&q);
+    cJSON *live = cJSON_AddObjectToObject(root, "live");
+    cJSON_AddBoolToObject(live, "active", q.active);
+    cJSON_AddNumberToObject(live, "duration_ms", q.duration_ms);
+    cJSON_AddNumberToObject(live, "rtt_ms", q.rtt_valid ? (double)q.rtt_ms : -1);
+    cJSON_AddNumberToObject(live, "max_rtt_ms", q.max_rtt_ms);
+    cJSON_AddNumberToObject(live, "reports_sent", q.reports_sent);
+    cJSON_AddNumberToObject(live, "reports_received", q.reports_received);
+
+    cJSON *rx = cJSON_AddObjectToObject(live, "rx");
+    cJSON_AddNumberToObject(rx, "packets", q.rx_packets);
+    cJSON_AddNumberToObject(rx, "expected", q.rx_expected);
+    cJSON_AddNumberToObject(rx, "lost", q.rx_lost);
+    cJSON_AddNumberToObject(rx, "fraction_lost_pct", q.rx_fraction_lost * 100.0 / 256);
+    cJSON_AddNumberToObject(rx, "jitter_ms", q.rx_jitter_ms);
+    cJSON_AddNumberToObject(rx, "mos", q.mos_rx);
+
+    cJSON *tx = cJSON_AddObjectToObject(live, "tx");
+    cJSON_AddNumberToObject(tx, "packets", q.tx_packets);
+    cJSON_AddNumberToObject(tx, "octets", q.tx_octets);
+    cJSON_AddBoolToObject(tx, "reported", q.tx_report_seen);
+    if (q.tx_report_seen) {
+        cJSON_AddNumberToObject(tx, "lost", q.tx_lost);
+        cJSON_AddNumberToObject(tx, "fraction_lost_pct", q.tx_fraction_lost * 100.0 / 256);
+        cJSON_AddNumberToObject(tx, "jitter_ms", q.tx_jitter_ms);
+        cJSON_AddNumberToObject(tx, "mos", q.mos_tx);
+    }
+
+    // Local pipeline: capture health and capture-to-wire latency
+    media_engine_stats_t media;
+    media_engine_get_stats(&media);
+    cJSON *pipeline = cJSON_AddObjectToObject(live, "pipeline");
+    cJSON_AddNumberToObject(pipeline, "capture_underruns", media.capture_underruns);
+    cJSON_AddNumberToObject(pipeline, "capture_overruns", media.capture_overruns);
+    cJSON_AddNumberToObject(pipeline, "capture_to_wire_us", media.capture_to_wire_us);
+    cJSON_AddNumberToObject(pipeline, "avg_capture_to_wire_us", media.avg_capture_to_wire_us);
+    cJSON_AddNumberToObject(pipeline, "max_capture_to_wire_us", media.max_capture_to_wire_us);
+    cJSON_AddNumberToObject(pipeline, "missed_ticks", media.missed_ticks);
+    cJSON_AddNumberToObject(pipeline, "max_cycle_us", media.max_cycle_us);
+
+    media_dsp_config_t dsp_config;
+    media_dsp_stats_t dsp;
+    media_engine_get_dsp_config(&dsp_config);
+    media_engine_get_dsp_stats(&dsp);
+    cJSON *aec = cJSON_AddObjectToObject(pipeline, "aec");
+    cJSON_AddBoolToObject(aec, "enabled", dsp_config.aec.enabled);
+    cJSON_AddNumberToObject(aec, "tail_ms", dsp_config.aec.tail_ms);
+    cJSON_AddNumberToObject(aec, "delay_ms", dsp_config.aec.delay_ms);
+    cJSON_AddNumberToObject(aec, "erle_db", dsp.aec.erle_db);
+    cJSON_AddNumberToObject(aec, "adapt_frames", dsp.aec.adapt_frames);
+    cJSON_AddNumberToObject(aec, "double_talk_frames", dsp.aec.double_talk_frames);
+    cJSON_AddNumberToObject(aec, "bypass_frames", dsp.aec.bypass_frames);
+    cJSON_AddNumberToObject(aec, "resyncs", dsp.aec.resyncs);
+    cJSON *ns = cJSON_AddObjectToObject(pipeline, "ns");
+    cJSON_AddBoolToObject(ns, "enabled", dsp_config.ns_enabled);
+    cJSON_AddNumberToObject(ns, "noise_floor_dbfs", dsp.ns.noise_floor_db);
+    cJSON_AddNumberToObject(ns, "attenuation_db", dsp.ns.attenuation_db);
+    cJSON *agc = cJSON_AddObjectToObject(pipeline, "agc");
+    cJSON_AddBoolToObject(agc, "enabled", dsp_config.agc_enabled);
+    cJSON_AddNumberToObject(agc, "gain_db", dsp.agc.gain_db);
+    cJSON_AddNumberToObject(agc, "level_dbfs", dsp.agc.level_dbfs);
+    cJSON_AddNumberToObject(agc, "speech_frames", dsp.agc.speech_frames);
+    cJSON_AddNumberToObject(agc, "limited_blocks", dsp.agc.limited_blocks);
+
+    cJSON *calls = cJSON_AddArrayToObject(root, "calls");
+    rtcp_call_summary_t summary;
+    for (int i = 0; rtcp_get_call_summary(i, &summary); i++) {
+        cJSON *call = cJSON_CreateObject();
+        cJSON_AddNumberToObject(call, "id", summary.call_id);
+        cJSON_AddNumberToObject(call, "duration_ms", summary.duration_ms);
+        cJSON_AddNumberToObject(call, "rx_packets", summary.rx_packets);
+        cJSON_AddNumberToObject(call, "rx_lost", summary.rx_lost);
+        cJSON_AddNumberToObject(call, "rx_loss_pct", summary.rx_loss_pct);
+        cJSON_AddNumberToObject(call, "rx_max_jitter_ms", summary.rx_max_jitter_ms);
+        cJSON_AddNumberToObject(call, "tx_lost", summary.tx_lost);
+        cJSON_AddNumberToObject(call, "tx_loss_pct", summary.tx_loss_pct);
+        cJSON_AddNumberToObject(call, "avg_rtt_ms", summary.rtt_valid ? (double)summary.avg_rtt_ms : -1);
+        cJSON_AddNumberToObject(call, "max_rtt_ms", summary.rtt_valid ? (double)summary.max_rtt_ms : -1);
+        cJSON_AddNumberToObject(call, "mos", summary.mos);
+        cJSON_AddNumberToObject(call, "min_mos", summary.min_mos);
+        cJSON_AddItemToArray(calls, call);
+    }
+
+    char *json_string = cJSON_PrintUnformatted(root);
+    cJSON_Delete(root);
+    if (!json_string) {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Out of memory");
+        return ESP_FAIL;
+    }
+    httpd_resp_send(req, json_string, strlen(json_string));
+    free(json_string);
+    return ESP_OK;
+}
+
+static esp_err_t get_media_dsp_handler(httpd_req_t *req)
+{
+    // Check authentication (don't extend session for status polling)
+    if (auth_filter(req, false) != ESP_OK) {
+        return ESP_FAIL;
+    }
+
+    httpd_resp_set_type(req, "application/json");
+    cJSON *root = cJSON_CreateObject();
+
+    media_dsp_config_t config;
+    media_engine_get_dsp_config(&config);
+
+    cJSON_AddBoolToObject(root, "aec_enabled", config.aec.enabled);
+    cJSON_AddNumberToObject(root, "aec_tail_ms", config.aec.tail_ms);
+    cJSON_AddNumberToObject(root, "aec_delay_ms", config.aec.delay_ms);
+    cJSON_AddNumberToObject(root, "aec_dt_threshold_pct", config.aec.dt_threshold_pct);
+    cJSON_AddBoolToObject(root, "ns_enabled", config.ns_enabled);
+    cJSON_AddBoolToObject(root, "agc_enabled", config.agc_enabled);
+
+    char *json_string = cJSON_Print(root);
+    httpd_resp_send(req, json_string, strlen(json_string));
+    free(json_string);
+    cJSON_Delete(root);
+    return ESP_OK;
+}
+
+static esp_err_t post_media_dsp_handler(httpd_req_t *req)
+{
+    // Check authentication (extend session for user action)
+    if (auth_filter(req, true) != ESP_OK) {
+        return ESP_FAIL;
+    }
+
+    char buf[256];
+    int remaining = req->content_len;
+    if (remaining > sizeof(buf) - 1) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Content too long");
+        return ESP_FAIL;
+    }
+
+    int ret = httpd_req_recv(req, buf, remaining);
+    if (ret <= 0) {
+        if (ret == HTTPD_SOCK_ERR_TIMEOUT) {
+            httpd_resp_send_408(req);
+        }
+        return ESP_FAIL;
+    }
+    buf[ret] = '\0';
+
+    cJSON *root = cJSON_Parse(buf);
+    if (root == NULL) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid JSON");
+        return ESP_FAIL;
+    }
+
+    // Start with the current settings; only the fields given change
+    media_dsp_config_t config;
+    media_engine_get_dsp_config(&config);
+
+    const cJSON *aec_enabled = cJSON_GetObjectItem(root, "aec_enabled");
+    const cJSON *aec_tail_ms = cJSON_GetObjectItem(root, "aec_tail_ms");
+    const cJSON *aec_delay_ms = cJSON_GetObjectItem(root, "aec_delay_ms");
+    const cJSON *aec_dt_threshold_pct = cJSON_GetObjectItem(root, "aec_dt_threshold_pct");
+    const cJSON *ns_enabled = cJSON_GetObjectItem(root, "ns_enabled");
+    const cJSON *agc_enabled = cJSON_GetObjectItem(root, "agc_enabled");
+
+    if (cJSON_IsNumber(aec_tail_ms)) {
+        if (aec_tail_ms->valueint < AEC_MIN_TAIL_MS || aec_tail_ms->valueint > AEC_MAX_TAIL_MS) {
+            cJSON_Delete(root);
+            httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Echo tail must be 16-128 ms");
+            return ESP_FAIL;
+        }
+        config.aec.tail_ms = (uint16_t)aec_tail_ms->valueint;
+    }
+    if (cJSON_IsNumber(aec_delay_ms)) {
+        if (aec_delay_ms->valueint < 0 || aec_delay_ms->valueint > AEC_MAX_DELAY_MS) {
+            cJSON_Delete(root);
+            httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Echo delay must be 0-160 ms");
+            return ESP_FAIL;
+        }
+        config.aec.delay_ms = (uint16_t)aec_delay_ms->valueint;
+    }
+    if (cJSON_IsNumber(aec_dt_threshold_pct)) {
+        if (aec_dt_threshold_pct->valueint < 10 || aec_dt_threshold_pct->valueint > 100) {
+            cJSON_Delete(root);
+            httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Double-talk threshold must be 10-100%");
+            return ESP_FAIL;
+        }
+        config.aec.dt_threshold_pct = (uint8_t)aec_dt_threshold_pct->valueint;
+    }
+    if (cJSON_IsBool(aec_enabled)) {
+        config.aec.enabled = cJSON_IsTrue(aec_enabled);
+    }
+    if (cJSON_IsBool(ns_enabled)) {
+        config.ns_enabled = cJSON_IsTrue(ns_enabled);
+    }
+    if (cJSON_IsBool(agc_enabled)) {
+        config.agc_enabled = cJSON_IsTrue(agc_enabled);
+    }
+    cJSON_Delete(root);
+
+    if (!media_engine_save_dsp_config(&config)) {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Failed to save settings");
+        return ESP_FAIL;
+    }
+
+    ESP_LOGI(TAG, "Capture processing updated: AEC %s, NS %s, AGC %s",
+             config.aec.enabled ? "on" : "off", config.ns_enabled ? "on" : "off",
+             config.agc_enabled ? "on" : "off");
+
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_send(req, "{\"status\":\"success\",\"message\":\"Capture processing updated\"}",
+                    strlen("{\"status\":\"success\",\"message\":\"Capture processing updated\"}"));
+    return ESP_OK;
+}
+
 static esp_err_t post_sip_connect_handler(httpd_req_t *req)
 {
     // Check authentication (extend session for user action)
@@ -2020,6 +2352,7 @@ static esp_err_t get_dtmf_logs_handler(httpd_req_t *req)
         }
         
         // Use double for timestamp to preserve precision in JSON
+        cJSON_AddNumberToObject(entry, "seq", entries[i].seq);
         cJSON_AddNumberToObject(entry, "timestamp", (double)entries[i].timestamp);
         
         // Add type as string
@@ -3331,6 +3664,34 @@ static const httpd_uri_t sip_disconnect_uri = {
     .user_ctx  = NULL
 };
 
+static const httpd_uri_t trace_uri = {
+    .uri       = "/api/trace",
+    .method    = HTTP_GET,
+    .handler   = get_trace_handler,
+    .user_ctx  = NULL
+};
+
+static const httpd_uri_t media_quality_uri = {
+    .uri       = "/api/media/quality",
+    .method    = HTTP_GET,
+    .handler   = get_media_quality_handler,
+    .user_ctx  = NULL
+};
+
+static const httpd_uri_t media_dsp_get_uri = {
+    .uri       = "/api/media/dsp",
+    .method    = HTTP_GET,
+    .handler   = get_media_dsp_handler,
+    .user_ctx  = NULL
+};
+
+static const httpd_uri_t media_dsp_post_uri = {
+    .uri       = "/api/media/dsp",
+    .method    = HTTP_POST,
+    .handler   = post_media_dsp_handler,
+    .user_ctx  = NULL
+};
+
 // WiFi API URI handlers
 static const httpd_uri_t wifi_config_get_uri = {
     .uri = "/api/wifi/config", .method = HTTP_GET, .handler = get_wifi_config_handler, .user_ctx = NULL
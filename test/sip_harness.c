@@ -0,0 +1,737 @@
+#include "sip_harness.h"
+#include "sip_client.h"
+#include "sip_parser.h"
+#include "dtmf_decoder.h"
+#include "ntp_sync.h"
+#include "mbedtls/md5.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#define PBX_USER            "doorbell"
+#define PBX_PASSWORD        "secret"
+#define PBX_REALM           "pbx.test"
+#define PBX_MAX_TARGETS     8
+#define PBX_MAX_CALLS       8
+#define PBX_MESSAGE_SIZE    4096
+
+// ============================================================================
+// Device fakes
+// ============================================================================
+
+static led_state_t led_state = LED_STATE_INIT;
+static int64_t led_times[LED_STATE_IDLE + 1];
+static int dtmf_events;
+
+void led_handler_set_state(led_state_t state)
+{
+    __atomic_store_n(&led_state, state, __ATOMIC_SEQ_CST);
+    __atomic_store_n(&led_times[state], esp_timer_get_time(), __ATOMIC_SEQ_CST);
+}
+
+led_state_t led_handler_get_current_state(void)
+{
+    return __atomic_load_n(&led_state, __ATOMIC_SEQ_CST);
+}
+
+void dtmf_reset_call_state(void)
+{
+}
+
+void dtmf_process_telephone_event(uint8_t event)
+{
+    __atomic_add_fetch(&dtmf_events, 1, __ATOMIC_SEQ_CST);
+}
+
+bool ntp_is_synced(void)
+{
+    return false;
+}
+
+uint64_t ntp_get_timestamp_ms(void)
+{
+    return 0;
+}
+
+int ntp_log_timestamp(char* buffer, size_t buffer_len)
+{
+    return 0;
+}
+
+int64_t harness_led_time_us(led_state_t state)
+{
+    return __atomic_load_n(&led_times[state], __ATOMIC_SEQ_CST);
+}
+
+// Timeouts are real time, whatever esp_timer runs on
+static int64_t real_ms(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (int64_t)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+int64_t harness_wait_led(led_state_t state, int64_t since_us, uint32_t timeout_ms)
+{
+    int64_t end = real_ms() + timeout_ms;
+    for (;;) {
+        int64_t changed = harness_led_time_us(state);
+        if (changed != 0 && changed >= since_us) {
+            return changed;
+        }
+        if (real_ms() >= end) {
+            return 0;
+        }
+        pbx_poll(1);
+    }
+}
+
+int harness_dtmf_events(void)
+{
+    return __atomic_load_n(&dtmf_events, __ATOMIC_SEQ_CST);
+}
+
+// ============================================================================
+// PBX stand-in
+// ============================================================================
+
+typedef struct {
+    char user[32];
+    pbx_behaviour_t behaviour;
+    uint32_t answer_ms;
+} pbx_target_t;
+
+// What a response echoes from its request
+typedef struct {
+    char via[512];              // Every Via, as header lines
+    char from[192];
+    char to[192];
+    char call_id[128];
+    char cseq[48];
+} pbx_headers_t;
+
+typedef struct {
+    bool used;
+    bool answered;
+    bool ended;
+    const pbx_target_t* target;
+    pbx_headers_t invite;       // To carries our tag
+    char contact[128];          // The client's Contact URI
+    int64_t due_us;             // Final response due, 0 if none
+    int due_status;
+} pbx_call_t;
+
+static int udp_sock = -1;
+static int listen_sock = -1;
+static int stream_sock = -1;
+static int rtp_sock = -1;
+static uint16_t port;
+static uint16_t rtp_port;
+static struct sockaddr_in client_addr;
+static struct sockaddr_in stream_peer;
+static const struct sockaddr_in* source;    // Of the message being handled
+
+static char stream_buf[PBX_MESSAGE_SIZE * 2];
+static size_t stream_len;
+
+static pbx_target_t targets[PBX_MAX_TARGETS];
+static int target_count;
+static pbx_call_t calls[PBX_MAX_CALLS];
+static pbx_call_t* last_answered;
+
+static uint32_t expires_s = 3600;
+static char nonce[32];
+static uint32_t nonce_count;    // Highest nc seen with the current nonce
+static uint32_t next_id = 1;
+
+static pbx_stats_t stats;
+
+static uint16_t bound_port(int sock)
+{
+    struct sockaddr_in addr;
+    socklen_t len = sizeof(addr);
+    getsockname(sock, (struct sockaddr*)&addr, &len);
+    return ntohs(addr.sin_port);
+}
+
+static int open_socket(int type, uint16_t at)
+{
+    int sock = socket(AF_INET, type, 0);
+    int on = 1;
+    setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    struct sockaddr_in addr = { .sin_family = AF_INET, .sin_port = htons(at) };
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(sock, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+        close(sock);
+        return -1;
+    }
+    fcntl(sock, F_SETFL, fcntl(sock, F_GETFL, 0) | O_NONBLOCK);
+    return sock;
+}
+
+bool pbx_start(void)
+{
+    // UDP on any free port that is free for TCP as well
+    for (int attempt = 0; attempt < 20 && listen_sock < 0; attempt++) {
+        if (udp_sock >= 0) {
+            close(udp_sock);
+        }
+        udp_sock = open_socket(SOCK_DGRAM, 0);
+        port = bound_port(udp_sock);
+        listen_sock = open_socket(SOCK_STREAM, port);
+    }
+    if (listen_sock < 0 || listen(listen_sock, 1) < 0) {
+        return false;
+    }
+    rtp_sock = open_socket(SOCK_DGRAM, 0);
+    rtp_port = bound_port(rtp_sock);
+    snprintf(nonce, sizeof(nonce), "pbx%08x", (unsigned)next_id++);
+    return rtp_sock >= 0;
+}
+
+uint16_t pbx_port(void)
+{
+    return port;
+}
+
+void pbx_set_expires(uint32_t seconds)
+{
+    expires_s = seconds;
+}
+
+void pbx_add_target(const char* user, pbx_behaviour_t behaviour, uint32_t answer_ms)
+{
+    if (target_count < PBX_MAX_TARGETS) {
+        pbx_target_t* t = &targets[target_count++];
+        snprintf(t->user, sizeof(t->user), "%s", user);
+        t->behaviour = behaviour;
+        t->answer_ms = answer_ms;
+    }
+}
+
+const pbx_stats_t* pbx_stats(void)
+{
+    return &stats;
+}
+
+static void pbx_send(const char* data, size_t len)
+{
+    if (stream_sock >= 0) {
+        send(stream_sock, data, len, MSG_NOSIGNAL);
+    } else {
+        sendto(udp_sock, data, len, 0, (struct sockaddr*)&client_addr, sizeof(client_addr));
+    }
+}
+
+static void copy_value(const sip_header_t* h, char* dest, size_t size)
+{
+    snprintf(dest, size, "%.*s", h ? (int)h->value_len : 0, h ? h->value : "");
+}
+
+// The top Via gets received and rport filled in, as a registrar does (RFC 3581)
+static void pbx_headers(const sip_message_t* msg, pbx_headers_t* h)
+{
+    memset(h, 0, sizeof(*h));
+    size_t used = 0;
+    for (int i = 0; i < msg->header_count; i++) {
+        const sip_header_t* v = &msg->headers[i];
+        if (v->id != SIP_HDR_VIA || used >= sizeof(h->via)) {
+            continue;
+        }
+        const char* value;
+        size_t value_len;
+        if (used == 0 && source && sip_header_param(v, "rport", &value, &value_len) && value_len == 0) {
+            size_t before = (size_t)(value - v->value);
+            used += snprintf(h->via + used, sizeof(h->via) - used, "Via: %.*s=%u;received=%s%.*s\r\n",
+                             (int)before, v->value, (unsigned)ntohs(source->sin_port),
+                             inet_ntoa(source->sin_addr), (int)(v->value_len - before), value);
+        } else {
+            used += snprintf(h->via + used, sizeof(h->via) - used, "Via: %.*s\r\n", (int)v->value_len, v->value);
+        }
+    }
+    copy_value(sip_msg_header(msg, SIP_HDR_FROM), h->from, sizeof(h->from));
+    copy_value(sip_msg_header(msg, SIP_HDR_TO), h->to, sizeof(h->to));
+    copy_value(sip_msg_header(msg, SIP_HDR_CALL_ID), h->call_id, sizeof(h->call_id));
+    copy_value(sip_msg_header(msg, SIP_HDR_CSEQ), h->cseq, sizeof(h->cseq));
+}
+
+static const sip_header_t* find_header(const sip_message_t* msg, const char* name)
+{
+    for (int i = 0; i < msg->header_count; i++) {
+        const sip_header_t* h = &msg->headers[i];
+        if (h->name_len == strlen(name) && strncasecmp(h->name, name, h->name_len) == 0) {
+            return h;
+        }
+    }
+    return NULL;
+}
+
+static void pbx_respond(const pbx_headers_t* h, int status, const char* reason, const char* extra,
+                        const char* body)
+{
+    char out[PBX_MESSAGE_SIZE];
+    size_t body_len = body ? strlen(body) : 0;
+    int len = snprintf(out, sizeof(out),
+                       "SIP/2.0 %d %s\r\n%sFrom: %s\r\nTo: %s\r\nCall-ID: %s\r\nCSeq: %s\r\n%s%s"
+                       "Content-Length: %zu\r\n\r\n%s",
+                       status, reason, h->via, h->from, h->to, h->call_id, h->cseq, extra ? extra : "",
+                       body ? "Content-Type: application/sdp\r\n" : "", body_len, body ? body : "");
+    pbx_send(out, (size_t)len);
+}
+
+static void md5_hex(const char* input, char out[33])
+{
+    unsigned char hash[16];
+    mbedtls_md5((const unsigned char*)input, strlen(input), hash);
+    for (int i = 0; i < 16; i++) {
+        sprintf(out + i * 2, "%02x", hash[i]);
+    }
+}
+
+// key=value or key="value" in a Digest header
+static bool digest_param(const sip_header_t* h, const char* key, char* out, size_t size)
+{
+    size_t key_len = strlen(key);
+    const char* end = h->value + h->value_len;
+    for (const char* p = h->value; p + key_len < end; p++) {
+        if ((p == h->value || p[-1] == ' ' || p[-1] == ',') && strncasecmp(p, key, key_len) == 0 &&
+            p[key_len] == '=') {
+            const char* v = p + key_len + 1;
+            bool quoted = v < end && *v == '"';
+            v += quoted;
+            const char* stop = v;
+            while (stop < end && (quoted ? *stop != '"' : (*stop != ',' && *stop != ' '))) {
+                stop++;
+            }
+            snprintf(out, size, "%.*s", (int)(stop - v), v);
+            return true;
+        }
+    }
+    return false;
+}
+
+// The REGISTER's digest answers the current nonce with a higher nc
+static bool pbx_authorized(const sip_message_t* msg)
+{
+    const sip_header_t* auth = find_header(msg, "Authorization");
+    char user[32], realm[32], got_nonce[64], uri[96], response[40], qop[16], nc[12], cnonce[40];
+    if (!auth || !digest_param(auth, "username", user, sizeof(user)) ||
+        !digest_param(auth, "realm", realm, sizeof(realm)) ||
+        !digest_param(auth, "nonce", got_nonce, sizeof(got_nonce)) ||
+        !digest_param(auth, "uri", uri, sizeof(uri)) ||
+        !digest_param(auth, "response", response, sizeof(response)) ||
+        !digest_param(auth, "qop", qop, sizeof(qop)) || !digest_param(auth, "nc", nc, sizeof(nc)) ||
+        !digest_param(auth, "cnonce", cnonce, sizeof(cnonce)) || strcmp(got_nonce, nonce) != 0) {
+        return false;
+    }
+
+    char input[256], ha1[33], ha2[33], expected[33];
+    snprintf(input, sizeof(input), "%s:%s:%s", PBX_USER, PBX_REALM, PBX_PASSWORD);
+    md5_hex(input, ha1);
+    snprintf(input, sizeof(input), "REGISTER:%s", uri);
+    md5_hex(input, ha2);
+    snprintf(input, sizeof(input), "%s:%s:%s:%s:%s:%s", ha1, nonce, nc, cnonce, qop, ha2);
+    md5_hex(input, expected);
+    if (strcmp(user, PBX_USER) != 0 || strcmp(response, expected) != 0) {
+        return false;
+    }
+
+    uint32_t count = (uint32_t)strtoul(nc, NULL, 16);
+    if (count <= nonce_count) {
+        stats.nc_reused++;
+        return false;
+    }
+    nonce_count = count;
+    return true;
+}
+
+static void pbx_register(const sip_message_t* msg, const pbx_headers_t* h)
+{
+    stats.registers++;
+    if (!pbx_authorized(msg)) {
+        char challenge[160];
+        snprintf(challenge, sizeof(challenge),
+                 "WWW-Authenticate: Digest realm=\"%s\", nonce=\"%s\", qop=\"auth\", algorithm=MD5\r\n",
+                 PBX_REALM, nonce);
+        stats.challenges++;
+        pbx_respond(h, 401, "Unauthorized", challenge, NULL);
+        return;
+    }
+
+    const sip_header_t* contact = sip_msg_header(msg, SIP_HDR_CONTACT);
+    char extra[256];
+    snprintf(extra, sizeof(extra), "Contact: %.*s;expires=%u\r\nExpires: %u\r\n",
+             contact ? (int)contact->value_len : 0, contact ? contact->value : "",
+             (unsigned)expires_s, (unsigned)expires_s);
+    stats.registered++;
+    stats.register_ok_us = esp_timer_get_time();
+    pbx_respond(h, 200, "OK", extra, NULL);
+}
+
+static const char* pbx_sdp(void)
+{
+    static char sdp[384];
+    snprintf(sdp, sizeof(sdp),
+             "v=0\r\n"
+             "o=pbx 1 1 IN IP4 127.0.0.1\r\n"
+             "s=pbx\r\n"
+             "c=IN IP4 127.0.0.1\r\n"
+             "t=0 0\r\n"
+             "m=audio %u RTP/AVP 0 101\r\n"
+             "a=rtpmap:0 PCMU/8000\r\n"
+             "a=rtpmap:101 telephone-event/8000\r\n"
+             "a=fmtp:101 0-15\r\n"
+             "a=ptime:20\r\n"
+             "a=sendrecv\r\n",
+             (unsigned)rtp_port);
+    return sdp;
+}
+
+static pbx_call_t* pbx_call_find(const char* call_id)
+{
+    for (int i = 0; i < PBX_MAX_CALLS; i++) {
+        if (calls[i].used && strcmp(calls[i].invite.call_id, call_id) == 0) {
+            return &calls[i];
+        }
+    }
+    return NULL;
+}
+
+static void pbx_call_answer(pbx_call_t* call)
+{
+    char contact[96];
+    snprintf(contact, sizeof(contact), "Contact: <sip:%s@127.0.0.1:%u>\r\n", call->target->user, (unsigned)port);
+    stats.answered++;
+    stats.answer_us = esp_timer_get_time();
+    stats.first_rtp_us = 0;
+    call->answered = true;
+    last_answered = call;
+    pbx_respond(&call->invite, 200, "OK", contact, pbx_sdp());
+}
+
+static void pbx_invite(const sip_message_t* msg, const pbx_headers_t* h)
+{
+    pbx_call_t* call = pbx_call_find(h->call_id);
+    if (call) {
+        return;     // Retransmission, already answered with 100 at least
+    }
+    for (int i = 0; i < PBX_MAX_CALLS && !call; i++) {
+        if (!calls[i].used || calls[i].ended) {
+            call = &calls[i];
+        }
+    }
+    if (!call) {
+        pbx_respond(h, 486, "Busy Here", NULL, NULL);
+        return;
+    }
+
+    stats.invites++;
+    stats.invite_us = esp_timer_get_time();
+    memset(call, 0, sizeof(*call));
+    call->used = true;
+    call->invite = *h;
+    size_t to_len = strlen(call->invite.to);
+    snprintf(call->invite.to + to_len, sizeof(call->invite.to) - to_len, ";tag=pbx%u", (unsigned)next_id++);
+    sip_header_copy_uri(sip_msg_header(msg, SIP_HDR_CONTACT), call->contact, sizeof(call->contact));
+
+    // sip:<user>@host
+    const char* user = msg->request_uri + 4;
+    size_t user_len = strcspn(user, "@;>");
+    for (int i = 0; i < target_count; i++) {
+        if (strlen(targets[i].user) == user_len && strncmp(targets[i].user, user, user_len) == 0) {
+            call->target = &targets[i];
+        }
+    }
+    if (!call->target) {
+        call->ended = true;
+        pbx_respond(&call->invite, 404, "Not Found", NULL, NULL);
+        return;
+    }
+
+    pbx_respond(h, 100, "Trying", NULL, NULL);
+    stats.provisional_us = esp_timer_get_time();
+    if (call->target->behaviour == PBX_EARLY_MEDIA) {
+        pbx_respond(&call->invite, 183, "Session Progress", NULL, pbx_sdp());
+    } else {
+        pbx_respond(&call->invite, 180, "Ringing", NULL, NULL);
+    }
+    if (call->target->behaviour != PBX_NO_ANSWER) {
+        call->due_status = call->target->behaviour == PBX_BUSY ? 486 : 200;
+        call->due_us = esp_timer_get_time() + (int64_t)call->target->answer_ms * 1000;
+    }
+}
+
+static void pbx_cancel(const pbx_headers_t* h)
+{
+    stats.cancels++;
+    pbx_call_t* call = pbx_call_find(h->call_id);
+    if (!call) {
+        pbx_respond(h, 481, "Call/Transaction Does Not Exist", NULL, NULL);
+        return;
+    }
+    pbx_respond(h, 200, "OK", NULL, NULL);
+    if (call->answered || call->ended || call->target->behaviour == PBX_ANSWER_LATE) {
+        return;     // Our 200 crossed the CANCEL (or is about to)
+    }
+    call->due_us = 0;
+    call->ended = true;
+    stats.terminated++;
+    pbx_respond(&call->invite, 487, "Request Terminated", NULL, NULL);
+}
+
+static void pbx_handle(const char* data, size_t len)
+{
+    sip_message_t msg;
+    if (!sip_parse_message(data, len, &msg)) {
+        return;
+    }
+    if (msg.is_response) {
+        return;     // To our BYE
+    }
+
+    pbx_headers_t h;
+    pbx_headers(&msg, &h);
+    pbx_call_t* call;
+    switch (msg.method) {
+        case SIP_METHOD_REGISTER:
+            pbx_register(&msg, &h);
+            break;
+        case SIP_METHOD_INVITE:
+            pbx_invite(&msg, &h);
+            break;
+        case SIP_METHOD_ACK:
+            stats.acks++;
+            break;
+        case SIP_METHOD_CANCEL:
+            pbx_cancel(&h);
+            break;
+        case SIP_METHOD_BYE:
+            stats.byes++;
+            call = pbx_call_find(h.call_id);
+            if (call) {
+                call->ended = true;
+            }
+            pbx_respond(&h, 200, "OK", NULL, NULL);
+            break;
+        case SIP_METHOD_OPTIONS:
+            stats.options++;
+            pbx_respond(&h, 200, "OK", NULL, NULL);
+            break;
+        default:
+            pbx_respond(&h, 200, "OK", NULL, NULL);
+            break;
+    }
+}
+
+// Complete messages on the TCP connection; a double CRLF ping gets its pong
+static int pbx_stream_messages(void)
+{
+    int handled = 0;
+    for (;;) {
+        size_t skip = 0;
+        while (skip + 4 <= stream_len && memcmp(stream_buf + skip, "\r\n\r\n", 4) == 0) {
+            stats.pings++;
+            send(stream_sock, "\r\n", 2, MSG_NOSIGNAL);
+            skip += 4;
+        }
+        while (skip < stream_len && (stream_buf[skip] == '\r' || stream_buf[skip] == '\n')) {
+            skip++;
+        }
+        memmove(stream_buf, stream_buf + skip, stream_len - skip);
+        stream_len -= skip;
+
+        stream_buf[stream_len] = '\0';
+        const char* end = strstr(stream_buf, "\r\n\r\n");
+        if (!end) {
+            return handled;
+        }
+        size_t header_len = (size_t)(end - stream_buf) + 4;
+        size_t body_len = 0;
+        const char* length = strstr(stream_buf, "\r\nContent-Length:");
+        if (length && length < end) {
+            body_len = strtoul(length + 17, NULL, 10);
+        }
+        if (header_len + body_len > stream_len) {
+            return handled;
+        }
+        source = &stream_peer;
+        pbx_handle(stream_buf, header_len + body_len);
+        handled++;
+        memmove(stream_buf, stream_buf + header_len + body_len, stream_len - header_len - body_len);
+        stream_len -= header_len + body_len;
+    }
+}
+
+// Everything readable now, and every response due
+static int pbx_service(void)
+{
+    int handled = 0;
+    char buf[PBX_MESSAGE_SIZE];
+    struct sockaddr_in from;
+    socklen_t from_len = sizeof(from);
+    int len;
+
+    while ((len = (int)recvfrom(udp_sock, buf, sizeof(buf) - 1, 0, (struct sockaddr*)&from, &from_len)) > 0) {
+        client_addr = from;
+        buf[len] = '\0';
+        if (strspn(buf, "\r\n") == (size_t)len) {
+            stats.pings++;
+        } else {
+            source = &client_addr;
+            pbx_handle(buf, (size_t)len);
+        }
+        handled++;
+        from_len = sizeof(from);
+    }
+
+    int accepted = accept(listen_sock, NULL, NULL);
+    if (accepted >= 0) {
+        if (stream_sock >= 0) {
+            close(stream_sock);
+        }
+        fcntl(accepted, F_SETFL, fcntl(accepted, F_GETFL, 0) | O_NONBLOCK);
+        stream_sock = accepted;
+        stream_len = 0;
+        socklen_t peer_len = sizeof(stream_peer);
+        getpeername(accepted, (struct sockaddr*)&stream_peer, &peer_len);
+        stats.connections++;
+    }
+    if (stream_sock >= 0) {
+        while ((len = (int)recv(stream_sock, stream_buf + stream_len,
+                                sizeof(stream_buf) - 1 - stream_len, 0)) > 0) {
+            stream_len += (size_t)len;
+            handled += pbx_stream_messages();
+        }
+        if (len == 0) {
+            close(stream_sock);
+            stream_sock = -1;
+        }
+    }
+
+    while (recv(rtp_sock, buf, sizeof(buf), 0) > 0) {
+        stats.rtp_packets++;
+        if (stats.answer_us && !stats.first_rtp_us) {
+            stats.first_rtp_us = esp_timer_get_time();
+        }
+    }
+
+    int64_t now = esp_timer_get_time();
+    for (int i = 0; i < PBX_MAX_CALLS; i++) {
+        pbx_call_t* call = &calls[i];
+        if (call->used && call->due_us && now >= call->due_us) {
+            call->due_us = 0;
+            if (call->due_status == 200) {
+                pbx_call_answer(call);
+            } else {
+                call->ended = true;
+                pbx_respond(&call->invite, call->due_status, "Busy Here", NULL, NULL);
+            }
+        }
+    }
+    return handled;
+}
+
+int pbx_poll(uint32_t timeout_ms)
+{
+    int handled = pbx_service();
+    int64_t end = real_ms() + timeout_ms;
+    for (int64_t left = timeout_ms; left > 0; left = end - real_ms()) {
+        struct pollfd fds[4] = {
+            { .fd = udp_sock, .events = POLLIN },
+            { .fd = listen_sock, .events = POLLIN },
+            { .fd = rtp_sock, .events = POLLIN },
+            { .fd = stream_sock, .events = POLLIN },
+        };
+        // Responses fall due on esp_timer time: look again every millisecond
+        poll(fds, stream_sock >= 0 ? 4 : 3, 1);
+        handled += pbx_service();
+    }
+    return handled;
+}
+
+bool pbx_pending(void)
+{
+    struct pollfd fds[2] = {
+        { .fd = udp_sock, .events = POLLIN },
+        { .fd = stream_sock, .events = POLLIN },
+    };
+    return poll(fds, stream_sock >= 0 ? 2 : 1, 0) > 0;
+}
+
+bool pbx_hang_up(void)
+{
+    pbx_call_t* call = last_answered;
+    if (!call || call->ended) {
+        return false;
+    }
+    call->ended = true;
+
+    char out[PBX_MESSAGE_SIZE];
+    int len = snprintf(out, sizeof(out),
+                       "BYE %s SIP/2.0\r\n"
+                       "Via: SIP/2.0/%s 127.0.0.1:%u;branch=z9hG4bKpbx%u\r\n"
+                       "Max-Forwards: 70\r\n"
+                       "From: %s\r\n"
+                       "To: %s\r\n"
+                       "Call-ID: %s\r\n"
+                       "CSeq: 1 BYE\r\n"
+                       "Content-Length: 0\r\n\r\n",
+                       call->contact, stream_sock >= 0 ? "TCP" : "UDP", (unsigned)port, (unsigned)next_id++,
+                       call->invite.to, call->invite.from, call->invite.call_id);
+    pbx_send(out, (size_t)len);
+    return true;
+}
+
+void pbx_drop_connection(void)
+{
+    if (stream_sock >= 0) {
+        close(stream_sock);
+        stream_sock = -1;
+        stream_len = 0;
+    }
+}
+
+// ============================================================================
+// Client
+// ============================================================================
+
+bool harness_start(sip_transport_type_t transport, const char* targets1, const char* targets2)
+{
+    if (!pbx_start()) {
+        return false;
+    }
+    sip_save_config("127.0.0.1", PBX_USER, PBX_PASSWORD, targets1 ? targets1 : "", targets2 ? targets2 : "",
+                    pbx_port(), transport, false);
+    sip_client_init();
+
+    int64_t since = esp_timer_get_time();
+    sip_connect();
+    return harness_wait_led(LED_STATE_SIP_REGISTERED, since, 5000) != 0;
+}
+
+void harness_settle(void)
+{
+    TaskHandle_t task = host_task_find("sip_task");
+    do {
+        host_task_wait_blocked(task);
+    } while (pbx_poll(0) > 0 || pbx_pending());
+}
+
+void harness_run_for(uint32_t ms, uint32_t step_ms)
+{
+    for (uint32_t done = 0; done < ms; done += step_ms) {
+        host_clock_advance((int64_t)step_ms * 1000);
+        harness_settle();
+    }
+}
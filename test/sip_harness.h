@@ -0,0 +1,100 @@
+#ifndef SIP_HARNESS_H
+#define SIP_HARNESS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "led_handler.h"
+#include "sip_transport.h"
+
+// sip_client.c on the host: fakes for the device modules it drives (LED,
+// DTMF decoder, NTP) and a PBX stand-in on loopback that registers it and
+// answers its calls. The stand-in runs on the test's thread, inside
+// pbx_poll(); nothing happens between calls.
+//
+// sip_client.c keeps its state in file statics and its task cannot be
+// stopped, so each test program runs one client from harness_start() on.
+
+// LED fake: every state change is kept with its esp_timer time
+
+// When the LED last changed to @p state, 0 if it never did
+int64_t harness_led_time_us(led_state_t state);
+
+// Run the PBX until the LED changes to @p state after @p since_us; returns
+// the time of that change, or 0 on timeout
+int64_t harness_wait_led(led_state_t state, int64_t since_us, uint32_t timeout_ms);
+
+// Telephone events handed to the DTMF decoder
+int harness_dtmf_events(void);
+
+// PBX stand-in: registrar with digest authentication (qop=auth, nc checked)
+// and the extensions added with pbx_add_target()
+
+typedef enum {
+    PBX_ANSWER,             // 180, then 200 after answer_ms
+    PBX_EARLY_MEDIA,        // 183 with SDP, then 200 after answer_ms
+    PBX_BUSY,               // 180, then 486 after answer_ms
+    PBX_NO_ANSWER,          // 180, then nothing until CANCEL (487)
+    PBX_ANSWER_LATE,        // Like PBX_ANSWER, but the 200 crosses a CANCEL
+} pbx_behaviour_t;
+
+typedef struct {
+    int registers;              // REGISTER requests received
+    int challenges;             // 401s sent for them
+    int registered;             // 200s sent for them
+    int nc_reused;              // Authenticated REGISTERs with a nonce count that did not increase
+    int invites;                // New INVITEs (retransmissions not counted)
+    int answered;               // 200s sent for INVITEs
+    int acks;
+    int cancels;
+    int terminated;             // 487s sent after a CANCEL
+    int byes;                   // BYEs received
+    int options;
+    int pings;                  // CRLF keep-alives
+    int connections;            // TCP connections accepted
+    int rtp_packets;            // RTP received from the client
+    int64_t register_ok_us;     // When the last 200 to a REGISTER went out
+    int64_t invite_us;          // When the last new INVITE arrived
+    int64_t provisional_us;     // When the last 180/183 went out
+    int64_t answer_us;          // When the last 200 to an INVITE went out
+    int64_t first_rtp_us;       // First RTP from the client after answer_us
+} pbx_stats_t;
+
+// Listen on a free loopback port: UDP, and TCP on the same port number
+bool pbx_start(void);
+uint16_t pbx_port(void);
+
+// Expires granted to registrations (default 3600 s)
+void pbx_set_expires(uint32_t expires_s);
+
+// Calls to sip:<user>@... behave as @p behaviour
+void pbx_add_target(const char* user, pbx_behaviour_t behaviour, uint32_t answer_ms);
+
+// Handle what arrives within @p timeout_ms and what falls due; returns the
+// number of messages handled
+int pbx_poll(uint32_t timeout_ms);
+
+// Whether a message is waiting for the PBX
+bool pbx_pending(void);
+
+// Send BYE in the last answered call (the callee hangs up)
+bool pbx_hang_up(void);
+
+// Close the client's TCP connection, as a restarting server would
+void pbx_drop_connection(void);
+
+const pbx_stats_t* pbx_stats(void);
+
+// Configure the client for the PBX (user "doorbell", targets as given),
+// start it and have it register at once. Returns when it is registered,
+// false on timeout.
+bool harness_start(sip_transport_type_t transport, const char* targets1, const char* targets2);
+
+// On the simulated clock (host_clock_simulate() before harness_start()):
+// let the SIP task and the PBX exchange everything that is due now
+void harness_settle(void);
+
+// On the simulated clock: move it on by @p ms in steps of @p step_ms,
+// settling after each
+void harness_run_for(uint32_t ms, uint32_t step_ms);
+
+#endif // SIP_HARNESS_H
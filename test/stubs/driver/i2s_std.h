@@ -0,0 +1,112 @@
+#ifndef I2S_STD_H
+#define I2S_STD_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+
+// Host build: the parts of the I2S standard-mode driver that
+// audio_backend_i2s.c uses. There is no implementation in the stubs; the
+// test that links the I2S backend fakes the driver and its DMA.
+
+typedef struct i2s_channel_obj_t* i2s_chan_handle_t;
+
+typedef enum {
+    I2S_NUM_0,
+    I2S_NUM_1,
+} i2s_port_t;
+
+typedef enum {
+    I2S_ROLE_MASTER,
+    I2S_ROLE_SLAVE,
+} i2s_role_t;
+
+typedef enum {
+    I2S_DATA_BIT_WIDTH_8BIT = 8,
+    I2S_DATA_BIT_WIDTH_16BIT = 16,
+    I2S_DATA_BIT_WIDTH_24BIT = 24,
+    I2S_DATA_BIT_WIDTH_32BIT = 32,
+} i2s_data_bit_width_t;
+
+typedef enum {
+    I2S_SLOT_MODE_MONO = 1,
+    I2S_SLOT_MODE_STEREO = 2,
+} i2s_slot_mode_t;
+
+#define I2S_GPIO_UNUSED     (-1)
+
+typedef struct {
+    i2s_port_t id;
+    i2s_role_t role;
+    uint32_t dma_desc_num;
+    uint32_t dma_frame_num;
+    bool auto_clear;
+} i2s_chan_config_t;
+
+#define I2S_CHANNEL_DEFAULT_CONFIG(i2s_num, i2s_role) { \
+        .id = (i2s_num), \
+        .role = (i2s_role), \
+        .dma_desc_num = 6, \
+        .dma_frame_num = 240, \
+        .auto_clear = false, \
+    }
+
+typedef struct {
+    uint32_t sample_rate_hz;
+} i2s_std_clk_config_t;
+
+typedef struct {
+    i2s_data_bit_width_t data_bit_width;
+    i2s_slot_mode_t slot_mode;
+} i2s_std_slot_config_t;
+
+typedef struct {
+    int mclk;
+    int bclk;
+    int ws;
+    int dout;
+    int din;
+    struct {
+        uint32_t mclk_inv : 1;
+        uint32_t bclk_inv : 1;
+        uint32_t ws_inv : 1;
+    } invert_flags;
+} i2s_std_gpio_config_t;
+
+typedef struct {
+    i2s_std_clk_config_t clk_cfg;
+    i2s_std_slot_config_t slot_cfg;
+    i2s_std_gpio_config_t gpio_cfg;
+} i2s_std_config_t;
+
+#define I2S_STD_CLK_DEFAULT_CONFIG(rate)    { .sample_rate_hz = (rate) }
+#define I2S_STD_PHILIPS_SLOT_DEFAULT_CONFIG(bits, mode) { .data_bit_width = (bits), .slot_mode = (mode) }
+
+typedef struct {
+    void* dma_buf;              // The DMA buffer just completed
+    size_t size;                // In bytes
+} i2s_event_data_t;
+
+typedef bool (*i2s_isr_callback_t)(i2s_chan_handle_t handle, i2s_event_data_t* event, void* user_ctx);
+
+typedef struct {
+    i2s_isr_callback_t on_recv;
+    i2s_isr_callback_t on_recv_q_ovf;
+    i2s_isr_callback_t on_sent;
+    i2s_isr_callback_t on_send_q_ovf;
+} i2s_event_callbacks_t;
+
+esp_err_t i2s_new_channel(const i2s_chan_config_t* chan_cfg, i2s_chan_handle_t* ret_tx_handle,
+                          i2s_chan_handle_t* ret_rx_handle);
+esp_err_t i2s_del_channel(i2s_chan_handle_t handle);
+esp_err_t i2s_channel_init_std_mode(i2s_chan_handle_t handle, const i2s_std_config_t* std_cfg);
+esp_err_t i2s_channel_register_event_callback(i2s_chan_handle_t handle, const i2s_event_callbacks_t* callbacks,
+                                              void* user_data);
+esp_err_t i2s_channel_enable(i2s_chan_handle_t handle);
+esp_err_t i2s_channel_disable(i2s_chan_handle_t handle);
+esp_err_t i2s_channel_write(i2s_chan_handle_t handle, const void* src, size_t size, size_t* bytes_written,
+                            uint32_t timeout_ms);
+
+#endif // I2S_STD_H
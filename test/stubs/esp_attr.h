@@ -0,0 +1,9 @@
+#ifndef ESP_ATTR_H
+#define ESP_ATTR_H
+
+// Host build: placement attributes have no meaning
+#define IRAM_ATTR
+#define DRAM_ATTR
+#define EXT_RAM_BSS_ATTR
+
+#endif // ESP_ATTR_H
@@ -0,0 +1,10 @@
+#ifndef ESP_CPU_H
+#define ESP_CPU_H
+
+// Host build: one core
+static inline int esp_cpu_get_core_id(void)
+{
+    return 0;
+}
+
+#endif // ESP_CPU_H
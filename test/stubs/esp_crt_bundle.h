@@ -0,0 +1,9 @@
+#ifndef ESP_CRT_BUNDLE_H
+#define ESP_CRT_BUNDLE_H
+
+#include "esp_err.h"
+
+// Host build: there is no CA bundle (host_mbedtls.c)
+esp_err_t esp_crt_bundle_attach(void* conf);
+
+#endif // ESP_CRT_BUNDLE_H
@@ -0,0 +1,30 @@
+#ifndef ESP_HEAP_CAPS_H
+#define ESP_HEAP_CAPS_H
+
+#include <stdlib.h>
+#include <stdint.h>
+
+// Host build: one heap, whatever the capabilities asked for
+
+#define MALLOC_CAP_8BIT     (1 << 2)
+#define MALLOC_CAP_INTERNAL (1 << 11)
+#define MALLOC_CAP_SPIRAM   (1 << 10)
+
+static inline void* heap_caps_malloc(size_t size, uint32_t caps)
+{
+    (void)caps;
+    return malloc(size);
+}
+
+static inline void* heap_caps_calloc(size_t n, size_t size, uint32_t caps)
+{
+    (void)caps;
+    return calloc(n, size);
+}
+
+static inline void heap_caps_free(void* ptr)
+{
+    free(ptr);
+}
+
+#endif // ESP_HEAP_CAPS_H
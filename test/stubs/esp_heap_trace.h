@@ -0,0 +1,25 @@
+#ifndef ESP_HEAP_TRACE_H
+#define ESP_HEAP_TRACE_H
+
+#include <stddef.h>
+#include "esp_err.h"
+
+// Host build (host_heap_trace.c): counts malloc/calloc/realloc/free calls
+// made by code linked with -Wl,--wrap=malloc,--wrap=calloc,--wrap=realloc,--wrap=free
+// (see CMakeLists.txt). Allocations inside libc itself are not seen.
+
+typedef enum {
+    HEAP_TRACE_ALL,
+    HEAP_TRACE_LEAKS,
+} heap_trace_mode_t;
+
+esp_err_t heap_trace_start(heap_trace_mode_t mode);
+esp_err_t heap_trace_stop(void);
+
+// Allocations (malloc, calloc and realloc) between start and stop
+size_t heap_trace_get_count(void);
+
+// Host only: frees between start and stop
+size_t host_heap_trace_get_frees(void);
+
+#endif // ESP_HEAP_TRACE_H
@@ -0,0 +1,24 @@
+#ifndef ESP_LOG_H
+#define ESP_LOG_H
+
+// Host build: logging is compiled out unless HOST_TEST_VERBOSE is defined.
+// The arguments are still checked against the format, and count as used.
+#include <stdio.h>
+
+#ifdef HOST_TEST_VERBOSE
+#define ESP_LOG_HOST(level, tag, format, ...) printf("%s %s: " format "\n", level, tag, ##__VA_ARGS__)
+#else
+#define ESP_LOG_HOST(level, tag, format, ...) do { \
+        if (0) { \
+            printf("%s: " format "\n", tag, ##__VA_ARGS__); \
+        } \
+    } while (0)
+#endif
+
+#define ESP_LOGE(tag, format, ...) ESP_LOG_HOST("E", tag, format, ##__VA_ARGS__)
+#define ESP_LOGW(tag, format, ...) ESP_LOG_HOST("W", tag, format, ##__VA_ARGS__)
+#define ESP_LOGI(tag, format, ...) ESP_LOG_HOST("I", tag, format, ##__VA_ARGS__)
+#define ESP_LOGD(tag, format, ...) ESP_LOG_HOST("D", tag, format, ##__VA_ARGS__)
+#define ESP_LOGV(tag, format, ...) ESP_LOG_HOST("V", tag, format, ##__VA_ARGS__)
+
+#endif // ESP_LOG_H
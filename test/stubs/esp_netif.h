@@ -0,0 +1,29 @@
+#ifndef ESP_NETIF_H
+#define ESP_NETIF_H
+
+#include <stdint.h>
+#include "esp_err.h"
+
+// Host build: one interface, whose address is loopback (host_stubs.c)
+
+typedef struct esp_netif_obj esp_netif_t;
+
+typedef struct {
+    uint32_t addr;              // Network byte order
+} esp_ip4_addr_t;
+
+typedef struct {
+    esp_ip4_addr_t ip;
+    esp_ip4_addr_t netmask;
+    esp_ip4_addr_t gw;
+} esp_netif_ip_info_t;
+
+#define esp_ip4_addr_get_byte(ipaddr, idx) (((const uint8_t*)(&(ipaddr)->addr))[idx])
+#define IP2STR(ipaddr) esp_ip4_addr_get_byte(ipaddr, 0), esp_ip4_addr_get_byte(ipaddr, 1), \
+                       esp_ip4_addr_get_byte(ipaddr, 2), esp_ip4_addr_get_byte(ipaddr, 3)
+#define IPSTR "%d.%d.%d.%d"
+
+esp_netif_t* esp_netif_get_handle_from_ifkey(const char* if_key);
+esp_err_t esp_netif_get_ip_info(esp_netif_t* esp_netif, esp_netif_ip_info_t* ip_info);
+
+#endif // ESP_NETIF_H
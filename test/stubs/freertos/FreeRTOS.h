@@ -0,0 +1,36 @@
+#ifndef FREERTOS_H
+#define FREERTOS_H
+
+#include <stdint.h>
+
+// Host build: tasks are POSIX threads (host_freertos.c). Every critical
+// section takes one recursive lock, like a single core with interrupts off.
+
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef uint32_t TickType_t;
+
+#define pdFALSE                 0
+#define pdTRUE                  1
+#define pdFAIL                  pdFALSE
+#define pdPASS                  pdTRUE
+#define portMAX_DELAY           ((TickType_t)0xFFFFFFFFu)
+#define portTICK_PERIOD_MS      1
+#define pdMS_TO_TICKS(ms)       ((TickType_t)(ms))
+
+typedef struct {
+    int owner;
+} portMUX_TYPE;
+
+void host_critical_enter(void);
+void host_critical_exit(void);
+
+#define portMUX_INITIALIZER_UNLOCKED    { 0 }
+#define portENTER_CRITICAL(mux)         ((void)(mux), host_critical_enter())
+#define portEXIT_CRITICAL(mux)          ((void)(mux), host_critical_exit())
+#define portENTER_CRITICAL_ISR(mux)     portENTER_CRITICAL(mux)
+#define portEXIT_CRITICAL_ISR(mux)      portEXIT_CRITICAL(mux)
+#define portENTER_CRITICAL_SAFE(mux)    portENTER_CRITICAL(mux)
+#define portEXIT_CRITICAL_SAFE(mux)     portEXIT_CRITICAL(mux)
+
+#endif // FREERTOS_H
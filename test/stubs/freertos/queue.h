@@ -0,0 +1,15 @@
+#ifndef FREERTOS_QUEUE_H
+#define FREERTOS_QUEUE_H
+
+#include "freertos/FreeRTOS.h"
+
+typedef struct host_queue* QueueHandle_t;
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size);
+BaseType_t xQueueSend(QueueHandle_t queue, const void* item, TickType_t ticks);
+BaseType_t xQueueSendFromISR(QueueHandle_t queue, const void* item, BaseType_t* woken);
+BaseType_t xQueueReceive(QueueHandle_t queue, void* item, TickType_t ticks);
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue);
+void vQueueDelete(QueueHandle_t queue);
+
+#endif // FREERTOS_QUEUE_H
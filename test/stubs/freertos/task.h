@@ -0,0 +1,30 @@
+#ifndef FREERTOS_TASK_H
+#define FREERTOS_TASK_H
+
+#include "freertos/FreeRTOS.h"
+
+typedef struct host_task* TaskHandle_t;
+typedef void (*TaskFunction_t)(void*);
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t function, const char* name, uint32_t stack_depth,
+                                   void* param, UBaseType_t priority, TaskHandle_t* handle, BaseType_t core);
+BaseType_t xTaskCreate(TaskFunction_t function, const char* name, uint32_t stack_depth, void* param,
+                       UBaseType_t priority, TaskHandle_t* handle);
+void vTaskDelete(TaskHandle_t task);
+void vTaskDelay(TickType_t ticks);
+TickType_t xTaskGetTickCount(void);
+TaskHandle_t xTaskGetCurrentTaskHandle(void);
+BaseType_t xTaskNotifyGive(TaskHandle_t task);
+uint32_t ulTaskNotifyTake(BaseType_t clear_on_exit, TickType_t ticks);
+
+#define taskYIELD()             host_task_yield()
+void host_task_yield(void);
+
+// Host only: the task created under @p name (NULL if none)
+TaskHandle_t host_task_find(const char* name);
+
+// Host only: wait until @p task is blocked in the kernel (notification,
+// semaphore, queue or delay) with nothing there to wake it
+void host_task_wait_blocked(TaskHandle_t task);
+
+#endif // FREERTOS_TASK_H
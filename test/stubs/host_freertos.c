@@ -0,0 +1,685 @@
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "freertos/queue.h"
+#include "esp_timer.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sched.h>
+#include <stdint.h>
+#include <sys/select.h>
+
+// FreeRTOS and esp_timer on POSIX threads. One kernel lock guards every
+// task, semaphore, queue and timer, and one condition variable wakes every
+// waiter, which then checks whether what it waits for has happened. Slow,
+// but simple enough to trust in a test.
+//
+// Timer callbacks run with the kernel lock held, like the esp_timer task
+// that preempts every other: all timers due at once fire before any task
+// they wake gets to run. A callback must not block.
+
+#define HOST_TASK_NAME_LEN  16
+#define HOST_MAX_TASKS      16
+#define HOST_MAX_TIMERS     16
+
+typedef bool (*host_ready_t)(void* arg);
+
+struct host_task {
+    char name[HOST_TASK_NAME_LEN];
+    pthread_t thread;
+    TaskFunction_t function;
+    void* param;
+    uint32_t notifications;
+    bool blocked;               // Waiting in the kernel for ready(ready_arg)
+    host_ready_t ready;
+    void* ready_arg;
+};
+
+struct host_semaphore {
+    UBaseType_t count;
+    UBaseType_t max;
+};
+
+struct host_queue {
+    UBaseType_t length;
+    UBaseType_t item_size;
+    UBaseType_t head;
+    UBaseType_t count;
+    uint8_t* items;
+};
+
+struct host_timer {
+    esp_timer_create_args_t args;
+    bool armed;
+    int64_t due_us;
+    uint64_t period_us;         // 0: one-shot
+};
+
+static pthread_mutex_t kernel_lock;
+static pthread_cond_t kernel_changed;
+static pthread_once_t kernel_once = PTHREAD_ONCE_INIT;
+static pthread_mutex_t critical_lock;
+
+static struct host_task tasks[HOST_MAX_TASKS];
+static int task_count = 0;
+static __thread struct host_task* current_task = NULL;
+
+static struct host_timer timers[HOST_MAX_TIMERS];
+static int timer_count = 0;
+static pthread_t timer_thread;
+static bool timer_thread_started = false;
+
+static struct timespec clock_start;
+static bool clock_simulated = false;
+static int64_t simulated_us = 0;
+
+static void kernel_init(void)
+{
+    pthread_condattr_t cond_attr;
+    pthread_condattr_init(&cond_attr);
+    pthread_condattr_setclock(&cond_attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&kernel_changed, &cond_attr);
+
+    pthread_mutexattr_t mutex_attr;
+    pthread_mutexattr_init(&mutex_attr);
+    pthread_mutexattr_settype(&mutex_attr, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(&kernel_lock, &mutex_attr);
+    pthread_mutex_init(&critical_lock, &mutex_attr);
+
+    clock_gettime(CLOCK_MONOTONIC, &clock_start);
+}
+
+static void kernel_enter(void)
+{
+    pthread_once(&kernel_once, kernel_init);
+    pthread_mutex_lock(&kernel_lock);
+}
+
+static void kernel_exit(void)
+{
+    pthread_mutex_unlock(&kernel_lock);
+}
+
+void host_critical_enter(void)
+{
+    pthread_once(&kernel_once, kernel_init);
+    pthread_mutex_lock(&critical_lock);
+}
+
+void host_critical_exit(void)
+{
+    pthread_mutex_unlock(&critical_lock);
+}
+
+static int64_t real_time_us(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (int64_t)(now.tv_sec - clock_start.tv_sec) * 1000000 + (now.tv_nsec - clock_start.tv_nsec) / 1000;
+}
+
+// Kernel lock held
+static int64_t now_us(void)
+{
+    return clock_simulated ? simulated_us : real_time_us();
+}
+
+int64_t esp_timer_get_time(void)
+{
+    kernel_enter();
+    int64_t now = now_us();
+    kernel_exit();
+    return now;
+}
+
+// The calling thread's task; threads the kernel did not create (main())
+// get one on first use. Kernel lock held.
+static struct host_task* self(void)
+{
+    if (!current_task && task_count < HOST_MAX_TASKS) {
+        current_task = &tasks[task_count++];
+        memset(current_task, 0, sizeof(*current_task));
+        strcpy(current_task->name, "main");
+        current_task->thread = pthread_self();
+    }
+    return current_task;
+}
+
+// Block until ready(arg) or @p ticks have passed; kernel lock held
+static bool wait_for(host_ready_t ready, void* arg, TickType_t ticks)
+{
+    struct host_task* task = self();
+    int64_t deadline_us = now_us() + (int64_t)ticks * 1000;
+    bool result;
+    for (;;) {
+        if (ready(arg)) {
+            result = true;
+            break;
+        }
+        if (ticks != portMAX_DELAY && now_us() >= deadline_us) {
+            result = false;
+            break;
+        }
+        // Announced once for host_task_wait_blocked(): announcing again after
+        // every wake-up would wake every other waiter, which would announce
+        // in turn, and the tasks would never sleep
+        if (!task->blocked) {
+            task->blocked = true;
+            task->ready = ready;
+            task->ready_arg = arg;
+            pthread_cond_broadcast(&kernel_changed);
+        }
+        if (ticks == portMAX_DELAY || clock_simulated) {
+            pthread_cond_wait(&kernel_changed, &kernel_lock);
+        } else {
+            int64_t wait_us = deadline_us - real_time_us();
+            struct timespec deadline;
+            clock_gettime(CLOCK_MONOTONIC, &deadline);
+            deadline.tv_sec += wait_us / 1000000;
+            deadline.tv_nsec += (wait_us % 1000000) * 1000;
+            if (deadline.tv_nsec >= 1000000000) {
+                deadline.tv_sec++;
+                deadline.tv_nsec -= 1000000000;
+            }
+            pthread_cond_timedwait(&kernel_changed, &kernel_lock, &deadline);
+        }
+    }
+    task->blocked = false;
+    return result;
+}
+
+// Tasks
+
+static void* task_main(void* arg)
+{
+    current_task = arg;
+    current_task->function(current_task->param);
+    return NULL;
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t function, const char* name, uint32_t stack_depth,
+                                   void* param, UBaseType_t priority, TaskHandle_t* handle, BaseType_t core)
+{
+    (void)stack_depth;
+    (void)priority;
+    (void)core;
+    kernel_enter();
+    if (task_count >= HOST_MAX_TASKS) {
+        kernel_exit();
+        return pdFAIL;
+    }
+    struct host_task* task = &tasks[task_count++];
+    memset(task, 0, sizeof(*task));
+    strncpy(task->name, name ? name : "", HOST_TASK_NAME_LEN - 1);
+    task->function = function;
+    task->param = param;
+    if (handle) {
+        *handle = task;
+    }
+    pthread_create(&task->thread, NULL, task_main, task);
+    pthread_detach(task->thread);
+    kernel_exit();
+    return pdPASS;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t function, const char* name, uint32_t stack_depth, void* param,
+                       UBaseType_t priority, TaskHandle_t* handle)
+{
+    return xTaskCreatePinnedToCore(function, name, stack_depth, param, priority, handle, 0);
+}
+
+// Another task cannot be stopped from outside: its entry is only renamed,
+// so host_task_find() does not hand it out again
+void vTaskDelete(TaskHandle_t task)
+{
+    kernel_enter();
+    struct host_task* target = task ? task : self();
+    target->name[0] = '\0';
+    kernel_exit();
+    if (!task || task == current_task) {
+        pthread_exit(NULL);
+    }
+}
+
+static bool never(void* arg)
+{
+    (void)arg;
+    return false;
+}
+
+void vTaskDelay(TickType_t ticks)
+{
+    kernel_enter();
+    wait_for(never, NULL, ticks);
+    kernel_exit();
+}
+
+TickType_t xTaskGetTickCount(void)
+{
+    return (TickType_t)(esp_timer_get_time() / 1000);
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void)
+{
+    kernel_enter();
+    struct host_task* task = self();
+    kernel_exit();
+    return task;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task)
+{
+    kernel_enter();
+    task->notifications++;
+    pthread_cond_broadcast(&kernel_changed);
+    kernel_exit();
+    return pdPASS;
+}
+
+static bool notified(void* arg)
+{
+    return ((struct host_task*)arg)->notifications > 0;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear_on_exit, TickType_t ticks)
+{
+    kernel_enter();
+    struct host_task* task = self();
+    uint32_t value = 0;
+    if (wait_for(notified, task, ticks)) {
+        value = task->notifications;
+        task->notifications = clear_on_exit ? 0 : value - 1;
+    }
+    kernel_exit();
+    return value;
+}
+
+void host_task_yield(void)
+{
+    sched_yield();
+}
+
+TaskHandle_t host_task_find(const char* name)
+{
+    kernel_enter();
+    struct host_task* found = NULL;
+    for (int i = 0; i < task_count && !found; i++) {
+        if (strcmp(tasks[i].name, name) == 0) {
+            found = &tasks[i];
+        }
+    }
+    kernel_exit();
+    return found;
+}
+
+void host_task_wait_blocked(TaskHandle_t task)
+{
+    kernel_enter();
+    while (!task->blocked || task->ready(task->ready_arg)) {
+        pthread_cond_wait(&kernel_changed, &kernel_lock);
+    }
+    kernel_exit();
+}
+
+// select() (lwip/sockets.h): the system one on the real clock. On the
+// simulated clock the timeout is simulated time, and the caller waits in the
+// kernel like any task, so host_task_wait_blocked() sees it sleeping; a
+// socket becoming ready is no kernel event, so it looks again every
+// millisecond.
+
+struct select_wait {
+    int nfds;
+    fd_set read;
+    fd_set write;
+    fd_set except;
+    int64_t deadline_us;
+};
+
+// Kernel lock held
+static bool select_ready(void* arg)
+{
+    struct select_wait* wait = arg;
+    if (now_us() >= wait->deadline_us) {
+        return true;
+    }
+    fd_set read = wait->read;
+    fd_set write = wait->write;
+    fd_set except = wait->except;
+    struct timeval zero = { 0, 0 };
+    return select(wait->nfds, &read, &write, &except, &zero) != 0;
+}
+
+int host_select(int nfds, fd_set* read, fd_set* write, fd_set* except, struct timeval* timeout)
+{
+    kernel_enter();
+    if (!clock_simulated) {
+        kernel_exit();
+        return select(nfds, read, write, except, timeout);
+    }
+
+    struct select_wait wait = { .nfds = nfds, .deadline_us = INT64_MAX };
+    FD_ZERO(&wait.read);
+    FD_ZERO(&wait.write);
+    FD_ZERO(&wait.except);
+    if (read) {
+        wait.read = *read;
+    }
+    if (write) {
+        wait.write = *write;
+    }
+    if (except) {
+        wait.except = *except;
+    }
+    if (timeout) {
+        wait.deadline_us = now_us() + (int64_t)timeout->tv_sec * 1000000 + timeout->tv_usec;
+    }
+
+    struct host_task* task = self();
+    while (!select_ready(&wait)) {
+        if (!task->blocked) {
+            task->blocked = true;
+            task->ready = select_ready;
+            task->ready_arg = &wait;
+            pthread_cond_broadcast(&kernel_changed);
+        }
+        struct timespec deadline;
+        clock_gettime(CLOCK_MONOTONIC, &deadline);
+        deadline.tv_nsec += 1000000;
+        if (deadline.tv_nsec >= 1000000000) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000;
+        }
+        pthread_cond_timedwait(&kernel_changed, &kernel_lock, &deadline);
+    }
+    task->blocked = false;
+    kernel_exit();
+
+    struct timeval zero = { 0, 0 };
+    return select(nfds, read, write, except, &zero);
+}
+
+// Semaphores: a mutex is a semaphore of one that starts given
+
+static SemaphoreHandle_t semaphore_create(UBaseType_t count, UBaseType_t max)
+{
+    SemaphoreHandle_t semaphore = calloc(1, sizeof(*semaphore));
+    if (semaphore) {
+        semaphore->count = count;
+        semaphore->max = max;
+    }
+    return semaphore;
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void)
+{
+    return semaphore_create(1, 1);
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinary(void)
+{
+    return semaphore_create(0, 1);
+}
+
+static bool semaphore_available(void* arg)
+{
+    return ((SemaphoreHandle_t)arg)->count > 0;
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t ticks)
+{
+    kernel_enter();
+    bool taken = wait_for(semaphore_available, semaphore, ticks);
+    if (taken) {
+        semaphore->count--;
+    }
+    kernel_exit();
+    return taken ? pdTRUE : pdFALSE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore)
+{
+    kernel_enter();
+    bool given = semaphore->count < semaphore->max;
+    if (given) {
+        semaphore->count++;
+        pthread_cond_broadcast(&kernel_changed);
+    }
+    kernel_exit();
+    return given ? pdTRUE : pdFALSE;
+}
+
+void vSemaphoreDelete(SemaphoreHandle_t semaphore)
+{
+    free(semaphore);
+}
+
+// Queues
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size)
+{
+    QueueHandle_t queue = calloc(1, sizeof(*queue));
+    if (!queue) {
+        return NULL;
+    }
+    queue->items = calloc(length, item_size);
+    if (!queue->items) {
+        free(queue);
+        return NULL;
+    }
+    queue->length = length;
+    queue->item_size = item_size;
+    return queue;
+}
+
+static bool queue_has_space(void* arg)
+{
+    QueueHandle_t queue = arg;
+    return queue->count < queue->length;
+}
+
+static bool queue_has_item(void* arg)
+{
+    return ((QueueHandle_t)arg)->count > 0;
+}
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void* item, TickType_t ticks)
+{
+    kernel_enter();
+    bool sent = wait_for(queue_has_space, queue, ticks);
+    if (sent) {
+        UBaseType_t tail = (queue->head + queue->count) % queue->length;
+        memcpy(queue->items + tail * queue->item_size, item, queue->item_size);
+        queue->count++;
+        pthread_cond_broadcast(&kernel_changed);
+    }
+    kernel_exit();
+    return sent ? pdTRUE : pdFALSE;
+}
+
+BaseType_t xQueueSendFromISR(QueueHandle_t queue, const void* item, BaseType_t* woken)
+{
+    if (woken) {
+        *woken = pdFALSE;
+    }
+    return xQueueSend(queue, item, 0);
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void* item, TickType_t ticks)
+{
+    kernel_enter();
+    bool received = wait_for(queue_has_item, queue, ticks);
+    if (received) {
+        memcpy(item, queue->items + queue->head * queue->item_size, queue->item_size);
+        queue->head = (queue->head + 1) % queue->length;
+        queue->count--;
+        pthread_cond_broadcast(&kernel_changed);
+    }
+    kernel_exit();
+    return received ? pdTRUE : pdFALSE;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue)
+{
+    kernel_enter();
+    UBaseType_t count = queue->count;
+    kernel_exit();
+    return count;
+}
+
+void vQueueDelete(QueueHandle_t queue)
+{
+    if (queue) {
+        free(queue->items);
+        free(queue);
+    }
+}
+
+// esp_timer: callbacks run on the timer thread in real time, or on the
+// thread calling host_clock_advance() in simulated time
+
+// The armed timer due first, or NULL; kernel lock held
+static struct host_timer* next_timer(void)
+{
+    struct host_timer* next = NULL;
+    for (int i = 0; i < timer_count; i++) {
+        if (timers[i].armed && (!next || timers[i].due_us < next->due_us)) {
+            next = &timers[i];
+        }
+    }
+    return next;
+}
+
+// Rearm a periodic timer, disarm a one-shot, then run the callback
+static void fire(struct host_timer* timer)
+{
+    if (timer->period_us) {
+        timer->due_us += timer->period_us;
+    } else {
+        timer->armed = false;
+    }
+    timer->args.callback(timer->args.arg);
+}
+
+static void* timer_main(void* arg)
+{
+    (void)arg;
+    kernel_enter();
+    for (;;) {
+        struct host_timer* timer = next_timer();
+        if (clock_simulated || !timer) {
+            pthread_cond_wait(&kernel_changed, &kernel_lock);
+            continue;
+        }
+        int64_t wait_us = timer->due_us - real_time_us();
+        if (wait_us > 0) {
+            struct timespec deadline;
+            clock_gettime(CLOCK_MONOTONIC, &deadline);
+            deadline.tv_sec += wait_us / 1000000;
+            deadline.tv_nsec += (wait_us % 1000000) * 1000;
+            if (deadline.tv_nsec >= 1000000000) {
+                deadline.tv_sec++;
+                deadline.tv_nsec -= 1000000000;
+            }
+            pthread_cond_timedwait(&kernel_changed, &kernel_lock, &deadline);
+            continue;
+        }
+        fire(timer);
+    }
+    return NULL;
+}
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t* args, esp_timer_handle_t* handle)
+{
+    if (!args || !args->callback || !handle) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    kernel_enter();
+    if (timer_count >= HOST_MAX_TIMERS) {
+        kernel_exit();
+        return ESP_ERR_NO_MEM;
+    }
+    struct host_timer* timer = &timers[timer_count++];
+    memset(timer, 0, sizeof(*timer));
+    timer->args = *args;
+    *handle = timer;
+    if (!timer_thread_started) {
+        pthread_create(&timer_thread, NULL, timer_main, NULL);
+        pthread_detach(timer_thread);
+        timer_thread_started = true;
+    }
+    kernel_exit();
+    return ESP_OK;
+}
+
+static esp_err_t timer_start(esp_timer_handle_t timer, uint64_t timeout_us, uint64_t period_us)
+{
+    kernel_enter();
+    if (timer->armed) {
+        kernel_exit();
+        return ESP_ERR_INVALID_STATE;
+    }
+    timer->armed = true;
+    timer->due_us = now_us() + (int64_t)timeout_us;
+    timer->period_us = period_us;
+    pthread_cond_broadcast(&kernel_changed);
+    kernel_exit();
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout_us)
+{
+    return timer_start(timer, timeout_us, 0);
+}
+
+esp_err_t esp_timer_start_periodic(esp_timer_handle_t timer, uint64_t period_us)
+{
+    return timer_start(timer, period_us, period_us);
+}
+
+esp_err_t esp_timer_stop(esp_timer_handle_t timer)
+{
+    kernel_enter();
+    esp_err_t err = timer->armed ? ESP_OK : ESP_ERR_INVALID_STATE;
+    timer->armed = false;
+    kernel_exit();
+    return err;
+}
+
+esp_err_t esp_timer_delete(esp_timer_handle_t timer)
+{
+    kernel_enter();
+    timer->armed = false;
+    timer->args.callback = NULL;
+    kernel_exit();
+    return ESP_OK;
+}
+
+void host_clock_simulate(int64_t start_us)
+{
+    kernel_enter();
+    clock_simulated = true;
+    simulated_us = start_us;
+    pthread_cond_broadcast(&kernel_changed);
+    kernel_exit();
+}
+
+void host_clock_advance(int64_t us)
+{
+    kernel_enter();
+    int64_t target_us = simulated_us + us;
+    for (;;) {
+        struct host_timer* timer = next_timer();
+        if (!timer || timer->due_us > target_us) {
+            break;
+        }
+        if (timer->due_us > simulated_us) {
+            simulated_us = timer->due_us;
+        }
+        fire(timer);
+    }
+    simulated_us = target_us;
+    pthread_cond_broadcast(&kernel_changed);
+    kernel_exit();
+}
@@ -0,0 +1,72 @@
+#include "esp_heap_trace.h"
+#include <stdbool.h>
+#include <stdlib.h>
+
+// The linker sends the traced target's calls here and the real allocator
+// is reached through __real_*. Counting is atomic: any task may allocate.
+
+void* __real_malloc(size_t size);
+void* __real_calloc(size_t count, size_t size);
+void* __real_realloc(void* ptr, size_t size);
+void __real_free(void* ptr);
+
+static bool tracing;
+static size_t allocs;
+static size_t frees;
+
+static void traced(size_t* counter)
+{
+    if (__atomic_load_n(&tracing, __ATOMIC_RELAXED)) {
+        __atomic_fetch_add(counter, 1, __ATOMIC_RELAXED);
+    }
+}
+
+void* __wrap_malloc(size_t size)
+{
+    traced(&allocs);
+    return __real_malloc(size);
+}
+
+void* __wrap_calloc(size_t count, size_t size)
+{
+    traced(&allocs);
+    return __real_calloc(count, size);
+}
+
+void* __wrap_realloc(void* ptr, size_t size)
+{
+    traced(&allocs);
+    return __real_realloc(ptr, size);
+}
+
+void __wrap_free(void* ptr)
+{
+    if (ptr) {
+        traced(&frees);
+    }
+    __real_free(ptr);
+}
+
+esp_err_t heap_trace_start(heap_trace_mode_t mode)
+{
+    __atomic_store_n(&allocs, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&frees, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&tracing, true, __ATOMIC_SEQ_CST);
+    return ESP_OK;
+}
+
+esp_err_t heap_trace_stop(void)
+{
+    __atomic_store_n(&tracing, false, __ATOMIC_SEQ_CST);
+    return ESP_OK;
+}
+
+size_t heap_trace_get_count(void)
+{
+    return __atomic_load_n(&allocs, __ATOMIC_RELAXED);
+}
+
+size_t host_heap_trace_get_frees(void)
+{
+    return __atomic_load_n(&frees, __ATOMIC_RELAXED);
+}
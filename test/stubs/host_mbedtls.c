@@ -0,0 +1,199 @@
+#include "mbedtls/md5.h"
+#include "mbedtls/ssl.h"
+#include "mbedtls/entropy.h"
+#include "mbedtls/ctr_drbg.h"
+#include "esp_crt_bundle.h"
+#include <stdint.h>
+#include <string.h>
+
+// MD5 (RFC 1321), one shot
+
+static const uint32_t md5_k[64] = {
+    0xd76aa478, 0xe8c7b756, 0x242070db, 0xc1bdceee, 0xf57c0faf, 0x4787c62a, 0xa8304613, 0xfd469501,
+    0x698098d8, 0x8b44f7af, 0xffff5bb1, 0x895cd7be, 0x6b901122, 0xfd987193, 0xa679438e, 0x49b40821,
+    0xf61e2562, 0xc040b340, 0x265e5a51, 0xe9b6c7aa, 0xd62f105d, 0x02441453, 0xd8a1e681, 0xe7d3fbc8,
+    0x21e1cde6, 0xc33707d6, 0xf4d50d87, 0x455a14ed, 0xa9e3e905, 0xfcefa3f8, 0x676f02d9, 0x8d2a4c8a,
+    0xfffa3942, 0x8771f681, 0x6d9d6122, 0xfde5380c, 0xa4beea44, 0x4bdecfa9, 0xf6bb4b60, 0xbebfbc70,
+    0x289b7ec6, 0xeaa127fa, 0xd4ef3085, 0x04881d05, 0xd9d4d039, 0xe6db99e5, 0x1fa27cf8, 0xc4ac5665,
+    0xf4292244, 0x432aff97, 0xab9423a7, 0xfc93a039, 0x655b59c3, 0x8f0ccc92, 0xffeff47d, 0x85845dd1,
+    0x6fa87e4f, 0xfe2ce6e0, 0xa3014314, 0x4e0811a1, 0xf7537e82, 0xbd3af235, 0x2ad7d2bb, 0xeb86d391,
+};
+
+static const uint8_t md5_r[64] = {
+    7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22,
+    5, 9, 14, 20, 5, 9, 14, 20, 5, 9, 14, 20, 5, 9, 14, 20,
+    4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23,
+    6, 10, 15, 21, 6, 10, 15, 21, 6, 10, 15, 21, 6, 10, 15, 21,
+};
+
+static void md5_block(uint32_t h[4], const unsigned char block[64])
+{
+    uint32_t w[16];
+    for (int i = 0; i < 16; i++) {
+        w[i] = (uint32_t)block[i * 4] | (uint32_t)block[i * 4 + 1] << 8 |
+               (uint32_t)block[i * 4 + 2] << 16 | (uint32_t)block[i * 4 + 3] << 24;
+    }
+    uint32_t a = h[0], b = h[1], c = h[2], d = h[3];
+    for (int i = 0; i < 64; i++) {
+        uint32_t f;
+        int g;
+        if (i < 16) {
+            f = (b & c) | (~b & d);
+            g = i;
+        } else if (i < 32) {
+            f = (d & b) | (~d & c);
+            g = (5 * i + 1) % 16;
+        } else if (i < 48) {
+            f = b ^ c ^ d;
+            g = (3 * i + 5) % 16;
+        } else {
+            f = c ^ (b | ~d);
+            g = (7 * i) % 16;
+        }
+        uint32_t rotated = a + f + md5_k[i] + w[g];
+        a = d;
+        d = c;
+        c = b;
+        b += (rotated << md5_r[i]) | (rotated >> (32 - md5_r[i]));
+    }
+    h[0] += a;
+    h[1] += b;
+    h[2] += c;
+    h[3] += d;
+}
+
+int mbedtls_md5(const unsigned char* input, size_t ilen, unsigned char output[16])
+{
+    uint32_t h[4] = { 0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476 };
+    size_t done = 0;
+    for (; ilen - done >= 64; done += 64) {
+        md5_block(h, input + done);
+    }
+
+    // Last partial block, the 0x80 pad and the length in bits
+    unsigned char tail[128] = { 0 };
+    size_t rest = ilen - done;
+    memcpy(tail, input + done, rest);
+    tail[rest] = 0x80;
+    size_t tail_len = rest < 56 ? 64 : 128;
+    uint64_t bits = (uint64_t)ilen * 8;
+    for (int i = 0; i < 8; i++) {
+        tail[tail_len - 8 + i] = (unsigned char)(bits >> (8 * i));
+    }
+    md5_block(h, tail);
+    if (tail_len == 128) {
+        md5_block(h, tail + 64);
+    }
+
+    for (int i = 0; i < 4; i++) {
+        for (int j = 0; j < 4; j++) {
+            output[i * 4 + j] = (unsigned char)(h[i] >> (8 * j));
+        }
+    }
+    return 0;
+}
+
+// TLS: unavailable, so the client falls back as on a device whose TLS
+// configuration failed
+
+void mbedtls_entropy_init(mbedtls_entropy_context* ctx) { (void)ctx; }
+void mbedtls_entropy_free(mbedtls_entropy_context* ctx) { (void)ctx; }
+
+int mbedtls_entropy_func(void* data, unsigned char* output, size_t len)
+{
+    return MBEDTLS_ERR_CTR_DRBG_ENTROPY_SOURCE_FAILED;
+}
+
+void mbedtls_ctr_drbg_init(mbedtls_ctr_drbg_context* ctx) { (void)ctx; }
+void mbedtls_ctr_drbg_free(mbedtls_ctr_drbg_context* ctx) { (void)ctx; }
+
+int mbedtls_ctr_drbg_seed(mbedtls_ctr_drbg_context* ctx, int (*f_entropy)(void*, unsigned char*, size_t),
+                          void* p_entropy, const unsigned char* custom, size_t len)
+{
+    return MBEDTLS_ERR_CTR_DRBG_ENTROPY_SOURCE_FAILED;
+}
+
+int mbedtls_ctr_drbg_random(void* p_rng, unsigned char* output, size_t output_len)
+{
+    return MBEDTLS_ERR_CTR_DRBG_ENTROPY_SOURCE_FAILED;
+}
+
+void mbedtls_ssl_config_init(mbedtls_ssl_config* conf) { (void)conf; }
+void mbedtls_ssl_config_free(mbedtls_ssl_config* conf) { (void)conf; }
+
+int mbedtls_ssl_config_defaults(mbedtls_ssl_config* conf, int endpoint, int transport, int preset)
+{
+    return MBEDTLS_ERR_SSL_FEATURE_UNAVAILABLE;
+}
+
+void mbedtls_ssl_conf_authmode(mbedtls_ssl_config* conf, int authmode) {}
+void mbedtls_ssl_conf_rng(mbedtls_ssl_config* conf, int (*f_rng)(void*, unsigned char*, size_t), void* p_rng) {}
+
+void mbedtls_ssl_init(mbedtls_ssl_context* ssl) { (void)ssl; }
+void mbedtls_ssl_free(mbedtls_ssl_context* ssl) { (void)ssl; }
+
+int mbedtls_ssl_setup(mbedtls_ssl_context* ssl, const mbedtls_ssl_config* conf)
+{
+    return MBEDTLS_ERR_SSL_FEATURE_UNAVAILABLE;
+}
+
+int mbedtls_ssl_set_hostname(mbedtls_ssl_context* ssl, const char* hostname)
+{
+    return MBEDTLS_ERR_SSL_FEATURE_UNAVAILABLE;
+}
+
+void mbedtls_ssl_set_bio(mbedtls_ssl_context* ssl, void* p_bio, mbedtls_ssl_send_t* f_send,
+                         mbedtls_ssl_recv_t* f_recv, mbedtls_ssl_recv_timeout_t* f_recv_timeout) {}
+
+int mbedtls_ssl_handshake(mbedtls_ssl_context* ssl)
+{
+    return MBEDTLS_ERR_SSL_FEATURE_UNAVAILABLE;
+}
+
+uint32_t mbedtls_ssl_get_verify_result(const mbedtls_ssl_context* ssl)
+{
+    return 0;
+}
+
+const char* mbedtls_ssl_get_version(const mbedtls_ssl_context* ssl)
+{
+    return "none";
+}
+
+const char* mbedtls_ssl_get_ciphersuite(const mbedtls_ssl_context* ssl)
+{
+    return "none";
+}
+
+int mbedtls_ssl_write(mbedtls_ssl_context* ssl, const unsigned char* buf, size_t len)
+{
+    return MBEDTLS_ERR_SSL_FEATURE_UNAVAILABLE;
+}
+
+int mbedtls_ssl_read(mbedtls_ssl_context* ssl, unsigned char* buf, size_t len)
+{
+    return MBEDTLS_ERR_SSL_FEATURE_UNAVAILABLE;
+}
+
+int mbedtls_ssl_close_notify(mbedtls_ssl_context* ssl)
+{
+    return 0;
+}
+
+void mbedtls_ssl_session_init(mbedtls_ssl_session* session) { (void)session; }
+void mbedtls_ssl_session_free(mbedtls_ssl_session* session) { (void)session; }
+
+int mbedtls_ssl_set_session(mbedtls_ssl_context* ssl, const mbedtls_ssl_session* session)
+{
+    return MBEDTLS_ERR_SSL_FEATURE_UNAVAILABLE;
+}
+
+int mbedtls_ssl_get_session(const mbedtls_ssl_context* ssl, mbedtls_ssl_session* session)
+{
+    return MBEDTLS_ERR_SSL_FEATURE_UNAVAILABLE;
+}
+
+esp_err_t esp_crt_bundle_attach(void* conf)
+{
+    return ESP_ERR_NOT_FOUND;
+}
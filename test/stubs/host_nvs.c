@@ -0,0 +1,179 @@
+#include "nvs.h"
+#include <stdbool.h>
+#include <string.h>
+#include <stdio.h>
+
+// Entries keyed by namespace and key; integers are stored as decimal text
+// with their width, so a get of the wrong type fails like it does on target
+
+#define HOST_NVS_ENTRIES    64
+#define HOST_NVS_NAME_LEN   16
+#define HOST_NVS_VALUE_LEN  256
+#define HOST_NVS_HANDLES    8
+
+typedef struct {
+    char space[HOST_NVS_NAME_LEN];
+    char key[HOST_NVS_NAME_LEN];
+    char type;                  // 'b' u8, 'h' u16, 'w' u32, 's' string
+    char value[HOST_NVS_VALUE_LEN];
+} host_nvs_entry_t;
+
+static host_nvs_entry_t entries[HOST_NVS_ENTRIES];
+static int entry_count = 0;
+static char handles[HOST_NVS_HANDLES][HOST_NVS_NAME_LEN];
+static nvs_open_mode_t handle_modes[HOST_NVS_HANDLES];
+
+void host_nvs_clear(void)
+{
+    entry_count = 0;
+}
+
+esp_err_t nvs_open(const char* name, nvs_open_mode_t mode, nvs_handle_t* handle)
+{
+    bool exists = false;
+    for (int i = 0; i < entry_count; i++) {
+        exists |= strcmp(entries[i].space, name) == 0;
+    }
+    if (!exists && mode == NVS_READONLY) {
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+    for (int i = 0; i < HOST_NVS_HANDLES; i++) {
+        if (!handles[i][0]) {
+            snprintf(handles[i], HOST_NVS_NAME_LEN, "%s", name);
+            handle_modes[i] = mode;
+            *handle = (nvs_handle_t)i + 1;
+            return ESP_OK;
+        }
+    }
+    return ESP_ERR_NO_MEM;
+}
+
+void nvs_close(nvs_handle_t handle)
+{
+    if (handle >= 1 && handle <= HOST_NVS_HANDLES) {
+        handles[handle - 1][0] = '\0';
+    }
+}
+
+esp_err_t nvs_commit(nvs_handle_t handle)
+{
+    (void)handle;
+    return ESP_OK;
+}
+
+static host_nvs_entry_t* find(nvs_handle_t handle, const char* key, bool create)
+{
+    if (handle < 1 || handle > HOST_NVS_HANDLES || !handles[handle - 1][0]) {
+        return NULL;
+    }
+    const char* space = handles[handle - 1];
+    for (int i = 0; i < entry_count; i++) {
+        if (strcmp(entries[i].space, space) == 0 && strcmp(entries[i].key, key) == 0) {
+            return &entries[i];
+        }
+    }
+    if (!create || handle_modes[handle - 1] != NVS_READWRITE || entry_count >= HOST_NVS_ENTRIES) {
+        return NULL;
+    }
+    host_nvs_entry_t* entry = &entries[entry_count++];
+    snprintf(entry->space, sizeof(entry->space), "%s", space);
+    snprintf(entry->key, sizeof(entry->key), "%s", key);
+    return entry;
+}
+
+static esp_err_t get_number(nvs_handle_t handle, const char* key, char type, uint32_t* value)
+{
+    host_nvs_entry_t* entry = find(handle, key, false);
+    if (!entry || entry->type != type) {
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+    unsigned long parsed = 0;
+    sscanf(entry->value, "%lu", &parsed);
+    *value = (uint32_t)parsed;
+    return ESP_OK;
+}
+
+static esp_err_t set_number(nvs_handle_t handle, const char* key, char type, uint32_t value)
+{
+    host_nvs_entry_t* entry = find(handle, key, true);
+    if (!entry) {
+        return ESP_FAIL;
+    }
+    entry->type = type;
+    snprintf(entry->value, sizeof(entry->value), "%lu", (unsigned long)value);
+    return ESP_OK;
+}
+
+esp_err_t nvs_get_u8(nvs_handle_t handle, const char* key, uint8_t* value)
+{
+    uint32_t v;
+    esp_err_t err = get_number(handle, key, 'b', &v);
+    if (err == ESP_OK) {
+        *value = (uint8_t)v;
+    }
+    return err;
+}
+
+esp_err_t nvs_get_u16(nvs_handle_t handle, const char* key, uint16_t* value)
+{
+    uint32_t v;
+    esp_err_t err = get_number(handle, key, 'h', &v);
+    if (err == ESP_OK) {
+        *value = (uint16_t)v;
+    }
+    return err;
+}
+
+esp_err_t nvs_get_u32(nvs_handle_t handle, const char* key, uint32_t* value)
+{
+    return get_number(handle, key, 'w', value);
+}
+
+esp_err_t nvs_set_u8(nvs_handle_t handle, const char* key, uint8_t value)
+{
+    return set_number(handle, key, 'b', value);
+}
+
+esp_err_t nvs_set_u16(nvs_handle_t handle, const char* key, uint16_t value)
+{
+    return set_number(handle, key, 'h', value);
+}
+
+esp_err_t nvs_set_u32(nvs_handle_t handle, const char* key, uint32_t value)
+{
+    return set_number(handle, key, 'w', value);
+}
+
+// Like the target: with value NULL only the needed length is returned
+esp_err_t nvs_get_str(nvs_handle_t handle, const char* key, char* value, size_t* length)
+{
+    host_nvs_entry_t* entry = find(handle, key, false);
+    if (!entry || entry->type != 's') {
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+    size_t needed = strlen(entry->value) + 1;
+    if (!value) {
+        *length = needed;
+        return ESP_OK;
+    }
+    if (*length < needed) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    memcpy(value, entry->value, needed);
+    *length = needed;
+    return ESP_OK;
+}
+
+esp_err_t nvs_set_str(nvs_handle_t handle, const char* key, const char* value)
+{
+    if (strlen(value) >= HOST_NVS_VALUE_LEN) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    host_nvs_entry_t* entry = find(handle, key, true);
+    if (!entry) {
+        return ESP_FAIL;
+    }
+    entry->type = 's';
+    snprintf(entry->value, sizeof(entry->value), "%s", value);
+    return ESP_OK;
+}
@@ -0,0 +1,89 @@
+#include "esp_random.h"
+#include "esp_err.h"
+#include "esp_netif.h"
+#include "lwip/dns.h"
+#include "lwip/sockets.h"
+#include <string.h>
+
+// xorshift32: repeatable runs, so a failing test fails the same way again
+static uint32_t random_state = 0x12345678;
+
+uint32_t esp_random(void)
+{
+    random_state ^= random_state << 13;
+    random_state ^= random_state >> 17;
+    random_state ^= random_state << 5;
+    return random_state;
+}
+
+void esp_fill_random(void* buf, size_t len)
+{
+    uint8_t* p = buf;
+    for (size_t i = 0; i < len; i++) {
+        p[i] = (uint8_t)esp_random();
+    }
+}
+
+const char* esp_err_to_name(esp_err_t code)
+{
+    switch (code) {
+        case ESP_OK: return "ESP_OK";
+        case ESP_FAIL: return "ESP_FAIL";
+        case ESP_ERR_NO_MEM: return "ESP_ERR_NO_MEM";
+        case ESP_ERR_INVALID_ARG: return "ESP_ERR_INVALID_ARG";
+        case ESP_ERR_INVALID_STATE: return "ESP_ERR_INVALID_STATE";
+        case ESP_ERR_INVALID_SIZE: return "ESP_ERR_INVALID_SIZE";
+        case ESP_ERR_NOT_FOUND: return "ESP_ERR_NOT_FOUND";
+        case ESP_ERR_TIMEOUT: return "ESP_ERR_TIMEOUT";
+        case ESP_ERR_NVS_NOT_FOUND: return "ESP_ERR_NVS_NOT_FOUND";
+        default: return "UNKNOWN ERROR";
+    }
+}
+
+// esp_netif: the station interface has the loopback address
+
+struct esp_netif_obj {
+    int unused;
+};
+
+static esp_netif_t station;
+
+esp_netif_t* esp_netif_get_handle_from_ifkey(const char* if_key)
+{
+    return strcmp(if_key, "WIFI_STA_DEF") == 0 ? &station : NULL;
+}
+
+esp_err_t esp_netif_get_ip_info(esp_netif_t* esp_netif, esp_netif_ip_info_t* ip_info)
+{
+    if (esp_netif != &station || !ip_info) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    memset(ip_info, 0, sizeof(*ip_info));
+    ip_info->ip.addr = htonl(INADDR_LOOPBACK);
+    ip_info->netmask.addr = htonl(0xFF000000);
+    return ESP_OK;
+}
+
+// lwIP DNS server setting
+
+static ip_addr_t dns_server;
+static uint16_t dns_server_port = 53;
+
+const ip_addr_t* dns_getserver(uint8_t numdns)
+{
+    return numdns == 0 ? &dns_server : NULL;
+}
+
+uint16_t host_dns_server_port(void)
+{
+    return dns_server_port;
+}
+
+void host_dns_set_server(const char* ip, uint16_t port)
+{
+    memset(&dns_server, 0, sizeof(dns_server));
+    if (ip) {
+        inet_pton(AF_INET, ip, &dns_server.u_addr.ip4.addr);
+    }
+    dns_server_port = port;
+}
@@ -0,0 +1,33 @@
+#ifndef LWIP_DNS_H
+#define LWIP_DNS_H
+
+#include <stdint.h>
+
+// Host build: the DNS server lwIP would have from DHCP, none until a test
+// sets one (host_stubs.c)
+
+typedef struct {
+    uint32_t addr;              // Network byte order
+} ip4_addr_t;
+
+typedef struct {
+    union {
+        ip4_addr_t ip4;
+    } u_addr;
+    uint8_t type;
+} ip_addr_t;
+
+#define IPADDR_TYPE_V4      0
+#define IP_IS_V4(ipaddr)    ((ipaddr)->type == IPADDR_TYPE_V4)
+#define ip_2_ip4(ipaddr)    (&((ipaddr)->u_addr.ip4))
+
+// lwIP has 53 (lwip/prot/dns.h); a test's stub resolver listens elsewhere
+#define DNS_SERVER_PORT     host_dns_server_port()
+
+const ip_addr_t* dns_getserver(uint8_t numdns);
+uint16_t host_dns_server_port(void);
+
+// Host only: send queries to @p ip (dotted IPv4, NULL for none) on @p port
+void host_dns_set_server(const char* ip, uint16_t port);
+
+#endif // LWIP_DNS_H
@@ -0,0 +1,7 @@
+#ifndef LWIP_NETDB_H
+#define LWIP_NETDB_H
+
+// Host build: the system resolver API
+#include <netdb.h>
+
+#endif // LWIP_NETDB_H
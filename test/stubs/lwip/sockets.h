@@ -0,0 +1,20 @@
+#ifndef LWIP_SOCKETS_H
+#define LWIP_SOCKETS_H
+
+// Host build: lwIP's BSD socket API is the system one, with the C library
+// headers lwIP's arch.h brings along
+#include <sys/socket.h>
+#include <sys/select.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// select() waits on the simulated clock when a test runs one (host_freertos.c)
+int host_select(int nfds, fd_set* read, fd_set* write, fd_set* except, struct timeval* timeout);
+#define select host_select
+
+#endif // LWIP_SOCKETS_H
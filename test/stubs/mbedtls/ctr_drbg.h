@@ -0,0 +1,21 @@
+#ifndef MBEDTLS_CTR_DRBG_H
+#define MBEDTLS_CTR_DRBG_H
+
+#include <stddef.h>
+
+// Host build: seeding always fails, so TLS is unavailable and a test sees
+// the same fallback as a device whose TLS configuration fails
+
+#define MBEDTLS_ERR_CTR_DRBG_ENTROPY_SOURCE_FAILED -0x0034
+
+typedef struct {
+    int unused;
+} mbedtls_ctr_drbg_context;
+
+void mbedtls_ctr_drbg_init(mbedtls_ctr_drbg_context* ctx);
+void mbedtls_ctr_drbg_free(mbedtls_ctr_drbg_context* ctx);
+int mbedtls_ctr_drbg_seed(mbedtls_ctr_drbg_context* ctx, int (*f_entropy)(void*, unsigned char*, size_t),
+                          void* p_entropy, const unsigned char* custom, size_t len);
+int mbedtls_ctr_drbg_random(void* p_rng, unsigned char* output, size_t output_len);
+
+#endif // MBEDTLS_CTR_DRBG_H
@@ -0,0 +1,10 @@
+#ifndef MBEDTLS_MD5_H
+#define MBEDTLS_MD5_H
+
+#include <stddef.h>
+
+// Host build: a plain RFC 1321 MD5 (host_mbedtls.c), enough for digest
+// authentication
+int mbedtls_md5(const unsigned char* input, size_t ilen, unsigned char output[16]);
+
+#endif // MBEDTLS_MD5_H
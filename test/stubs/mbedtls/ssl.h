@@ -0,0 +1,60 @@
+#ifndef MBEDTLS_SSL_H
+#define MBEDTLS_SSL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Host build: the client API sip_transport.c uses, never reached past a
+// failed mbedtls_ctr_drbg_seed() (host_mbedtls.c)
+
+#define MBEDTLS_ERR_SSL_WANT_READ       -0x6900
+#define MBEDTLS_ERR_SSL_WANT_WRITE      -0x6880
+#define MBEDTLS_ERR_SSL_FEATURE_UNAVAILABLE -0x7080
+
+#define MBEDTLS_SSL_IS_CLIENT           0
+#define MBEDTLS_SSL_TRANSPORT_STREAM    0
+#define MBEDTLS_SSL_PRESET_DEFAULT      0
+#define MBEDTLS_SSL_VERIFY_REQUIRED     2
+
+typedef int mbedtls_ssl_send_t(void* ctx, const unsigned char* buf, size_t len);
+typedef int mbedtls_ssl_recv_t(void* ctx, unsigned char* buf, size_t len);
+typedef int mbedtls_ssl_recv_timeout_t(void* ctx, unsigned char* buf, size_t len, uint32_t timeout);
+
+typedef struct {
+    int unused;
+} mbedtls_ssl_config;
+
+typedef struct {
+    int unused;
+} mbedtls_ssl_context;
+
+typedef struct {
+    int unused;
+} mbedtls_ssl_session;
+
+void mbedtls_ssl_config_init(mbedtls_ssl_config* conf);
+void mbedtls_ssl_config_free(mbedtls_ssl_config* conf);
+int mbedtls_ssl_config_defaults(mbedtls_ssl_config* conf, int endpoint, int transport, int preset);
+void mbedtls_ssl_conf_authmode(mbedtls_ssl_config* conf, int authmode);
+void mbedtls_ssl_conf_rng(mbedtls_ssl_config* conf, int (*f_rng)(void*, unsigned char*, size_t), void* p_rng);
+
+void mbedtls_ssl_init(mbedtls_ssl_context* ssl);
+void mbedtls_ssl_free(mbedtls_ssl_context* ssl);
+int mbedtls_ssl_setup(mbedtls_ssl_context* ssl, const mbedtls_ssl_config* conf);
+int mbedtls_ssl_set_hostname(mbedtls_ssl_context* ssl, const char* hostname);
+void mbedtls_ssl_set_bio(mbedtls_ssl_context* ssl, void* p_bio, mbedtls_ssl_send_t* f_send,
+                         mbedtls_ssl_recv_t* f_recv, mbedtls_ssl_recv_timeout_t* f_recv_timeout);
+int mbedtls_ssl_handshake(mbedtls_ssl_context* ssl);
+uint32_t mbedtls_ssl_get_verify_result(const mbedtls_ssl_context* ssl);
+const char* mbedtls_ssl_get_version(const mbedtls_ssl_context* ssl);
+const char* mbedtls_ssl_get_ciphersuite(const mbedtls_ssl_context* ssl);
+int mbedtls_ssl_write(mbedtls_ssl_context* ssl, const unsigned char* buf, size_t len);
+int mbedtls_ssl_read(mbedtls_ssl_context* ssl, unsigned char* buf, size_t len);
+int mbedtls_ssl_close_notify(mbedtls_ssl_context* ssl);
+
+void mbedtls_ssl_session_init(mbedtls_ssl_session* session);
+void mbedtls_ssl_session_free(mbedtls_ssl_session* session);
+int mbedtls_ssl_set_session(mbedtls_ssl_context* ssl, const mbedtls_ssl_session* session);
+int mbedtls_ssl_get_session(const mbedtls_ssl_context* ssl, mbedtls_ssl_session* session);
+
+#endif // MBEDTLS_SSL_H
@@ -0,0 +1,33 @@
+#ifndef NVS_H
+#define NVS_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_err.h"
+
+// Host build: an in-memory store (host_nvs.c), empty at start; tests that
+// need saved settings write them first
+
+typedef uint32_t nvs_handle_t;
+
+typedef enum {
+    NVS_READONLY,
+    NVS_READWRITE,
+} nvs_open_mode_t;
+
+esp_err_t nvs_open(const char* name, nvs_open_mode_t mode, nvs_handle_t* handle);
+void nvs_close(nvs_handle_t handle);
+esp_err_t nvs_commit(nvs_handle_t handle);
+esp_err_t nvs_get_u8(nvs_handle_t handle, const char* key, uint8_t* value);
+esp_err_t nvs_get_u16(nvs_handle_t handle, const char* key, uint16_t* value);
+esp_err_t nvs_get_u32(nvs_handle_t handle, const char* key, uint32_t* value);
+esp_err_t nvs_get_str(nvs_handle_t handle, const char* key, char* value, size_t* length);
+esp_err_t nvs_set_u8(nvs_handle_t handle, const char* key, uint8_t value);
+esp_err_t nvs_set_u16(nvs_handle_t handle, const char* key, uint16_t value);
+esp_err_t nvs_set_u32(nvs_handle_t handle, const char* key, uint32_t value);
+esp_err_t nvs_set_str(nvs_handle_t handle, const char* key, const char* value);
+
+// Host only: forget everything stored
+void host_nvs_clear(void);
+
+#endif // NVS_H
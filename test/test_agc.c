@@ -0,0 +1,255 @@
+#include "agc.h"
+#include "test_signals.h"
+#include "test_support.h"
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <math.h>
+
+// The same synthetic talker at different distances from the microphone.
+// Speech levels are the mean power of 20 ms frames above the AGC's gate;
+// the AGC steers its own, peak-weighted, level estimate, which reads a few
+// dB higher on speech with pauses.
+
+#define SECONDS         20
+#define SAMPLES         (SECONDS * SIGNAL_RATE)
+#define FRAMES          (SAMPLES / AGC_FRAME_SAMPLES)
+#define LIMIT           29204   // AGC_LIMIT_DBFS of full scale
+#define GATE_DBFS       -50.0   // The AGC's speech gate
+
+static float speech[SAMPLES];
+static int16_t in[SAMPLES];
+static int16_t out[SAMPLES];
+static agc_t agc;
+
+// Speech scaled by a gain that steps to @p gain2 at @p step_s, over a
+// little background noise
+static void make_input(double gain, double gain2, double step_s)
+{
+    signal_srand(77);
+    for (size_t i = 0; i < SAMPLES; i++) {
+        double g = i < step_s * SIGNAL_RATE ? gain : gain2;
+        in[i] = signal_to_pcm(speech[i] * g + signal_noise() * 3);
+    }
+}
+
+static void run(void)
+{
+    agc_init(&agc, true);
+    for (int f = 0; f < FRAMES; f++) {
+        size_t at = (size_t)f * AGC_FRAME_SAMPLES;
+        agc_process(&agc, in + at, out + at, AGC_FRAME_SAMPLES);
+    }
+}
+
+// Mean power of the frames in [from_s, to_s) where the talker is loud
+// enough to count, in dBFS
+static double speech_level_dbfs(const int16_t* x, double from_s, double to_s)
+{
+    double sum = 0;
+    int frames = 0;
+    for (int f = (int)(from_s * 50); f < (int)(to_s * 50); f++) {
+        size_t at = (size_t)f * AGC_FRAME_SAMPLES;
+        double power = signal_energy(in, at, at + AGC_FRAME_SAMPLES) / AGC_FRAME_SAMPLES;
+        if (10 * log10(power / (32768.0 * 32768.0)) >= GATE_DBFS) {
+            sum += signal_energy(x, at, at + AGC_FRAME_SAMPLES) / AGC_FRAME_SAMPLES;
+            frames++;
+        }
+    }
+    return 10 * log10(sum / frames / (32768.0 * 32768.0));
+}
+
+static int peak(const int16_t* x, size_t from, size_t to)
+{
+    int p = 0;
+    for (size_t i = from; i < to; i++) {
+        p = abs(x[i]) > p ? abs(x[i]) : p;
+    }
+    return p;
+}
+
+// Talkers 20 dB apart come out at the same level, the tracked one on target
+static void test_levels_converge(void)
+{
+    static const double gains[] = { 0.1, 0.32, 1.0 };
+    double levels[3];
+    for (int i = 0; i < 3; i++) {
+        make_input(gains[i], gains[i], SECONDS);
+        run();
+        double before = speech_level_dbfs(in, 5, SECONDS);
+        levels[i] = speech_level_dbfs(out, 5, SECONDS);
+        agc_stats_t stats;
+        agc_get_stats(&agc, &stats);
+        printf("  talker at %.1f dBFS -> %.1f dBFS, gain %+.1f dB\n", before, levels[i], stats.gain_db);
+        CHECK(peak(out, 0, SAMPLES) <= LIMIT);
+        CHECK_EQ_INT(stats.frames, FRAMES);
+        CHECK(stats.speech_frames > FRAMES / 4);
+        CHECK(fabsf(stats.gain_db + stats.level_dbfs - AGC_TARGET_DBFS) < 0.5f);
+        CHECK(levels[i] > AGC_TARGET_DBFS - 9.0 && levels[i] < AGC_TARGET_DBFS);
+    }
+    CHECK(fabs(levels[0] - levels[2]) <= 1.5);
+    CHECK(fabs(levels[1] - levels[2]) <= 1.5);
+}
+
+// Gains stop at AGC_MAX_GAIN_DB and AGC_MIN_GAIN_DB
+static void test_gain_range(void)
+{
+    // A steady tone at -45 dBFS, just above the gate
+    agc_stats_t stats;
+    for (size_t i = 0; i < SAMPLES; i++) {
+        in[i] = signal_to_pcm(sqrt(2) * pow(10, -45 / 20.0) * 32768 * sin(2 * M_PI * 400 * i / SIGNAL_RATE));
+    }
+    run();
+    agc_get_stats(&agc, &stats);
+    CHECK(stats.level_dbfs + AGC_MAX_GAIN_DB < AGC_TARGET_DBFS);
+    CHECK(fabsf(stats.gain_db - AGC_MAX_GAIN_DB) < 0.01f);
+
+    // A full-scale square wave
+    for (size_t i = 0; i < SAMPLES; i++) {
+        in[i] = (i / 8) % 2 ? 32767 : -32767;
+    }
+    run();
+    agc_get_stats(&agc, &stats);
+    CHECK(stats.level_dbfs + AGC_MIN_GAIN_DB > AGC_TARGET_DBFS);
+    CHECK(fabsf(stats.gain_db - AGC_MIN_GAIN_DB) < 0.01f);
+    CHECK(peak(out, SIGNAL_RATE, SAMPLES) <= lrint(pow(10, AGC_MIN_GAIN_DB / 20.0) * 32767) + 1);
+}
+
+// The talker steps up by 20 dB: the gain comes down to where the louder
+// talker alone would have it within the first syllable, and no sample
+// crosses the ceiling meanwhile
+static void test_level_step(void)
+{
+    agc_stats_t stats;
+    make_input(1.0, 1.0, SECONDS);
+    run();
+    agc_get_stats(&agc, &stats);
+    const float loud_gain = stats.gain_db;
+
+    make_input(0.1, 1.0, 10);
+    agc_init(&agc, true);
+    int settled_at = -1;
+    for (int f = 0; f < FRAMES; f++) {
+        size_t at = (size_t)f * AGC_FRAME_SAMPLES;
+        agc_process(&agc, in + at, out + at, AGC_FRAME_SAMPLES);
+        agc_get_stats(&agc, &stats);
+        if (f >= 10 * 50 && settled_at < 0 && stats.gain_db < loud_gain + 3.0f) {
+            settled_at = f - 10 * 50;
+        }
+    }
+    int after_step = peak(out, 10 * SIGNAL_RATE, 11 * SIGNAL_RATE);
+    printf("  gain within 3 dB after %d ms, peak %.1f dBFS\n", settled_at * 20, 20 * log10(after_step / 32768.0));
+    CHECK(settled_at >= 0 && settled_at <= 25);
+    CHECK(fabsf(stats.gain_db - loud_gain) < 1.5f);
+    CHECK(peak(out, 0, SAMPLES) <= LIMIT);
+}
+
+// Clicks on quiet background (a door slam, a knock on the housing) barely
+// move the frame power, so the gain stays up; the limiter takes each one
+// to the ceiling from its first sample
+static void test_limiter_on_clicks(void)
+{
+    agc_init(&agc, true);
+    int16_t frame[AGC_FRAME_SAMPLES];
+    int16_t result[AGC_FRAME_SAMPLES];
+    int worst = 0;
+    for (int f = 0; f < 500; f++) {
+        for (int i = 0; i < AGC_FRAME_SAMPLES; i++) {
+            frame[i] = (i / 8) % 2 ? 400 : -400;
+        }
+        if (f >= 250 && f % 10 == 0) {
+            frame[f % AGC_FRAME_SAMPLES] = 32767;
+        }
+        agc_process(&agc, frame, result, AGC_FRAME_SAMPLES);
+        int p = peak(result, 0, AGC_FRAME_SAMPLES);
+        worst = p > worst ? p : worst;
+    }
+    agc_stats_t stats;
+    agc_get_stats(&agc, &stats);
+    printf("  gain %+.1f dB, peak %d, %u blocks limited\n", stats.gain_db, worst, (unsigned)stats.limited_blocks);
+    CHECK(stats.gain_db > 6.0f);
+    CHECK(worst <= LIMIT);
+    CHECK(worst >= LIMIT - 8);
+    CHECK(stats.limited_blocks >= 25);
+}
+
+// Pauses hold the gain: background noise is not brought up
+static void test_pause_holds_gain(void)
+{
+    // A quiet talker, then only noise from 10 s on
+    make_input(0.05, 0.0, 10);
+    agc_init(&agc, true);
+    agc_stats_t stats;
+    float gain_after_speech = 0.0f;
+    for (int f = 0; f < FRAMES; f++) {
+        size_t at = (size_t)f * AGC_FRAME_SAMPLES;
+        agc_process(&agc, in + at, out + at, AGC_FRAME_SAMPLES);
+        if (f == 10 * 50) {
+            agc_get_stats(&agc, &stats);
+            gain_after_speech = stats.gain_db;
+        }
+    }
+    CHECK(gain_after_speech > 10.0f);
+    agc_get_stats(&agc, &stats);
+    CHECK(fabsf(stats.gain_db - gain_after_speech) < 0.01f);
+    CHECK(peak(out, 11 * SIGNAL_RATE, SAMPLES) < 3 * 20);
+}
+
+// Increases are slew limited to AGC_GAIN_RISE_DB per frame (10 dB/s)
+static void test_gain_rise_rate(void)
+{
+    make_input(0.006, 0.006, SECONDS);
+    agc_init(&agc, true);
+    agc_stats_t stats;
+    float previous = 0.0f;
+    for (int f = 0; f < FRAMES; f++) {
+        size_t at = (size_t)f * AGC_FRAME_SAMPLES;
+        agc_process(&agc, in + at, out + at, AGC_FRAME_SAMPLES);
+        agc_get_stats(&agc, &stats);
+        CHECK(stats.gain_db - previous <= 0.2f + 1e-4f);
+        previous = stats.gain_db;
+    }
+}
+
+static void test_passthrough(void)
+{
+    make_input(0.3, 0.3, SECONDS);
+    agc_init(&agc, false);
+    for (int f = 0; f < 50; f++) {
+        size_t at = (size_t)f * AGC_FRAME_SAMPLES;
+        agc_process(&agc, in + at, out + at, AGC_FRAME_SAMPLES);
+    }
+    CHECK(memcmp(in, out, 50 * AGC_FRAME_SAMPLES * sizeof(int16_t)) == 0);
+    agc_stats_t stats;
+    agc_get_stats(&agc, &stats);
+    CHECK_EQ_INT(stats.frames, 0);
+
+    // Blocks shorter than a frame, and in place
+    agc_init(&agc, true);
+    memcpy(out, in, sizeof(in));
+    for (size_t at = 0; at + 37 <= SAMPLES; at += 37) {
+        agc_process(&agc, out + at, out + at, 37);
+    }
+    CHECK(peak(out, 0, SAMPLES) <= LIMIT);
+    agc_process(&agc, in, out, 0);
+}
+
+int main(void)
+{
+    signal_talker(speech, SAMPLES, 170, 11, 0.75);
+    for (size_t i = 0; i < SAMPLES; i++) {
+        speech[i] *= 32767;
+    }
+
+    setvbuf(stdout, NULL, _IOLBF, 0);
+    RUN_TEST(test_levels_converge);
+    RUN_TEST(test_gain_range);
+    RUN_TEST(test_level_step);
+    RUN_TEST(test_limiter_on_clicks);
+    RUN_TEST(test_pause_holds_gain);
+    RUN_TEST(test_gain_rise_rate);
+    RUN_TEST(test_passthrough);
+    return TEST_RESULT();
+}
@@ -0,0 +1,269 @@
+#include "audio_handler.h"
+#include "audio_backend.h"
+#include "g711.h"
+#include "test_signals.h"
+#include "test_support.h"
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// The host audio devices behind audio_handler: a WAV (or raw) file source
+// and sink, and the loopback delay line. Speech from a file goes through
+// capture, G.711 and playback into another file, frame by frame as the media
+// engine would move it, and comes out the same every run.
+
+#define SPEECH_SECONDS      3
+#define SPEECH_SAMPLES      (SPEECH_SECONDS * SAMPLE_RATE)
+#define SPEECH_FRAMES       (SPEECH_SAMPLES / DMA_BUF_LEN)
+
+static int16_t speech[SPEECH_SAMPLES];
+static char source_path[64];
+static char sink_path[64];
+static char raw_path[64];
+
+static void temp_path(char* path, size_t size, const char* name)
+{
+    snprintf(path, size, "/tmp/%s_XXXXXX", name);
+    int fd = mkstemp(path);
+    CHECK(fd >= 0);
+    if (fd >= 0) {
+        close(fd);
+    }
+}
+
+static void put16(uint8_t* p, uint16_t v)
+{
+    p[0] = v;
+    p[1] = v >> 8;
+}
+
+static void put32(uint8_t* p, uint32_t v)
+{
+    p[0] = v;
+    p[1] = v >> 8;
+    p[2] = v >> 16;
+    p[3] = v >> 24;
+}
+
+static uint32_t get32(const uint8_t* p)
+{
+    return p[0] | (p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static void write_samples(FILE* f, const int16_t* samples, size_t count)
+{
+    for (size_t i = 0; i < count; i++) {
+        uint8_t b[2];
+        put16(b, (uint16_t)samples[i]);
+        fwrite(b, 1, 2, f);
+    }
+}
+
+// A WAV with a LIST chunk before the data, as editors write them
+static void write_wav(const char* path, const int16_t* samples, size_t count)
+{
+    static const char list[] = "INFOISFT\x06\0\0\0host\0\0";
+    uint32_t data_bytes = (uint32_t)(count * 2);
+    uint8_t header[44 + 8 + sizeof(list) - 1];
+    uint8_t* p = header;
+    memcpy(p, "RIFF", 4);
+    put32(p + 4, (uint32_t)(sizeof(header) - 8 + data_bytes));
+    memcpy(p + 8, "WAVEfmt ", 8);
+    put32(p + 16, 16);
+    put16(p + 20, 1);
+    put16(p + 22, 1);
+    put32(p + 24, SAMPLE_RATE);
+    put32(p + 28, SAMPLE_RATE * 2);
+    put16(p + 32, 2);
+    put16(p + 34, 16);
+    p += 36;
+    memcpy(p, "LIST", 4);
+    put32(p + 4, sizeof(list) - 1);
+    memcpy(p + 8, list, sizeof(list) - 1);
+    p += 8 + sizeof(list) - 1;
+    memcpy(p, "data", 4);
+    put32(p + 4, data_bytes);
+
+    FILE* f = fopen(path, "wb");
+    CHECK(f != NULL);
+    if (f) {
+        fwrite(header, 1, sizeof(header), f);
+        write_samples(f, samples, count);
+        fclose(f);
+    }
+}
+
+// Samples of a WAV written by the sink; its header must describe them
+static size_t read_wav(const char* path, int16_t* samples, size_t max)
+{
+    FILE* f = fopen(path, "rb");
+    CHECK(f != NULL);
+    if (!f) {
+        return 0;
+    }
+    uint8_t header[44];
+    size_t got = fread(header, 1, sizeof(header), f);
+    CHECK_EQ_INT((int)got, 44);
+    CHECK(memcmp(header, "RIFF", 4) == 0 && memcmp(header + 8, "WAVEfmt ", 8) == 0);
+    CHECK(memcmp(header + 36, "data", 4) == 0);
+    CHECK_EQ_INT((int)get32(header + 24), SAMPLE_RATE);
+    uint32_t count = get32(header + 40) / 2;
+    CHECK_EQ_INT((int)get32(header + 4), (int)(36 + count * 2));
+
+    size_t n = 0;
+    uint8_t b[2];
+    while (n < max && fread(b, 1, 2, f) == 2) {
+        samples[n++] = (int16_t)(b[0] | (b[1] << 8));
+    }
+    fclose(f);
+    CHECK_EQ_INT((int)n, (int)count);
+    return n;
+}
+
+static void test_file_source_plays_the_wav(void)
+{
+    audio_backend_file_configure(source_path, NULL, false);
+    CHECK(audio_handler_set_backend(&audio_backend_file));
+    CHECK_EQ_STR(audio_handler_backend_name(), "file");
+    audio_start_recording();
+
+    int16_t frame[DMA_BUF_LEN];
+    bool same = true;
+    for (int f = 0; f < SPEECH_FRAMES; f++) {
+        CHECK_EQ_INT((int)audio_read(frame, DMA_BUF_LEN), DMA_BUF_LEN);
+        same &= memcmp(frame, speech + f * DMA_BUF_LEN, sizeof(frame)) == 0;
+    }
+    CHECK(same);
+    CHECK(!audio_backend_file_eof());
+
+    // Used up: silence, like a quiet room
+    CHECK_EQ_INT((int)audio_read(frame, DMA_BUF_LEN), DMA_BUF_LEN);
+    CHECK(audio_backend_file_eof());
+    CHECK(signal_energy(frame, 0, DMA_BUF_LEN) == 0);
+    audio_stop_recording();
+}
+
+static void test_raw_source_loops(void)
+{
+    FILE* f = fopen(raw_path, "wb");
+    CHECK(f != NULL);
+    if (!f) {
+        return;
+    }
+    write_samples(f, speech, DMA_BUF_LEN + 40);     // Not a whole number of frames
+    fclose(f);
+
+    audio_backend_file_configure(raw_path, NULL, true);
+    CHECK(audio_handler_set_backend(&audio_backend_file));
+    audio_start_recording();
+    int16_t frames[3 * DMA_BUF_LEN];
+    for (int i = 0; i < 3; i++) {
+        audio_read(frames + i * DMA_BUF_LEN, DMA_BUF_LEN);
+    }
+    audio_stop_recording();
+
+    bool same = true;
+    for (int i = 0; i < 3 * DMA_BUF_LEN; i++) {
+        same &= frames[i] == speech[i % (DMA_BUF_LEN + 40)];
+    }
+    CHECK(same);
+    CHECK(!audio_backend_file_eof());
+}
+
+// Capture -> G.711 -> playback, one 20 ms frame per tick through the
+// borrowed-frame path the media engine uses
+static void test_speech_through_g711(void)
+{
+    audio_backend_file_configure(source_path, sink_path, false);
+    CHECK(audio_handler_set_backend(&audio_backend_file));
+    audio_start_recording();
+    audio_start_playback();
+
+    for (int f = 0; f < SPEECH_FRAMES; f++) {
+        audio_frame_t frame;
+        CHECK(audio_capture_borrow(&frame));
+        CHECK_EQ_INT((int)frame.count, DMA_BUF_LEN);
+        uint8_t payload[DMA_BUF_LEN];
+        int16_t decoded[DMA_BUF_LEN];
+        g711_encode_block(G711_ULAW, frame.samples, payload, frame.count);
+        audio_capture_release();
+        g711_decode_block(G711_ULAW, payload, decoded, DMA_BUF_LEN);
+        CHECK_EQ_INT((int)audio_write(decoded, DMA_BUF_LEN), DMA_BUF_LEN);
+    }
+    audio_stop_playback();
+    audio_stop_recording();
+    CHECK(audio_handler_set_backend(&audio_backend_null));     // Closes the files
+
+    static int16_t played[SPEECH_SAMPLES + 1];
+    size_t count = read_wav(sink_path, played, SPEECH_SAMPLES + 1);
+    CHECK_EQ_INT((int)count, SPEECH_SAMPLES);
+
+    double error = 0;
+    for (size_t i = 0; i < count; i++) {
+        double d = (double)played[i] - speech[i];
+        error += d * d;
+    }
+    double snr = signal_db(signal_energy(speech, 0, SPEECH_SAMPLES), error);
+    printf("  speech through the file backend and G.711 u-law: SNR %.1f dB\n", snr);
+    CHECK(snr > 30);
+}
+
+// Playback comes back after AUDIO_LOOPBACK_DELAY_FRAMES frames of silence
+static void test_loopback_delay(void)
+{
+    CHECK(audio_handler_set_backend(&audio_backend_loopback));
+    CHECK_EQ_STR(audio_handler_backend_name(), "loopback");
+    audio_start_recording();
+    audio_start_playback();
+
+    const int frames = AUDIO_LOOPBACK_DELAY_FRAMES + 10;
+    bool delayed = true;
+    for (int f = 0; f < frames; f++) {
+        int16_t in[DMA_BUF_LEN];
+        audio_write(speech + f * DMA_BUF_LEN, DMA_BUF_LEN);
+        CHECK_EQ_INT((int)audio_read(in, DMA_BUF_LEN), DMA_BUF_LEN);
+        if (f < AUDIO_LOOPBACK_DELAY_FRAMES) {
+            delayed &= signal_energy(in, 0, DMA_BUF_LEN) == 0;
+        } else {
+            delayed &= memcmp(in, speech + (f - AUDIO_LOOPBACK_DELAY_FRAMES) * DMA_BUF_LEN, sizeof(in)) == 0;
+        }
+    }
+    CHECK(delayed);
+    audio_stop_playback();
+    audio_stop_recording();
+}
+
+static void test_missing_file_falls_back_to_null(void)
+{
+    audio_backend_file_configure("/nonexistent/speech.wav", NULL, false);
+    CHECK(!audio_handler_set_backend(&audio_backend_file));
+    CHECK_EQ_STR(audio_handler_backend_name(), "null");
+}
+
+int main(void)
+{
+    setvbuf(stdout, NULL, _IOLBF, 0);
+    static float talker[SPEECH_SAMPLES];
+    signal_talker(talker, SPEECH_SAMPLES, 120, 7, 0.9);
+    for (int i = 0; i < SPEECH_SAMPLES; i++) {
+        speech[i] = signal_to_pcm(talker[i] * 16000);
+    }
+    temp_path(source_path, sizeof(source_path), "speech_in");
+    temp_path(sink_path, sizeof(sink_path), "speech_out");
+    temp_path(raw_path, sizeof(raw_path), "speech_raw");
+    write_wav(source_path, speech, SPEECH_SAMPLES);
+
+    RUN_TEST(test_file_source_plays_the_wav);
+    RUN_TEST(test_raw_source_loops);
+    RUN_TEST(test_speech_through_g711);
+    RUN_TEST(test_loopback_delay);
+    RUN_TEST(test_missing_file_falls_back_to_null);
+
+    unlink(source_path);
+    unlink(sink_path);
+    unlink(raw_path);
+    return TEST_RESULT();
+}
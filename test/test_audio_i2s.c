@@ -0,0 +1,346 @@
+#include "audio_handler.h"
+#include "audio_backend.h"
+#include "driver/i2s_std.h"
+#include "esp_timer.h"
+#include "test_support.h"
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+// The I2S backend's capture ring against a fake driver: its "DMA" fills the
+// DMA_BUF_COUNT descriptors in turn and calls the receive callback, as the
+// interrupt would, and a media tick borrows frames on the simulated clock.
+// Borrowing must never wait, lent frames must be the DMA buffers themselves
+// and stay intact until returned, and what capture drops or misses must
+// show in the overrun and underrun counters while capture-to-borrow latency
+// stays within AUDIO_CAPTURE_MAX_QUEUED frames.
+
+#define START_US            1000000
+#define FRAME_US            (DMA_BUF_LEN * 1000000LL / SAMPLE_RATE)
+#define TICK_PHASE_US       7000        // Media tick after the DMA completion
+#define RUN_TICKS           500         // 10 s
+#define BORROW_LIMIT_NS     100000      // Loose, for a loaded build machine
+
+// ============================================================================
+// Fake driver
+// ============================================================================
+
+struct i2s_channel_obj_t {
+    bool enabled;
+    i2s_isr_callback_t on_recv;
+    void* user_ctx;
+};
+
+static struct i2s_channel_obj_t tx_channel;
+static struct i2s_channel_obj_t rx_channel;
+static i2s_chan_config_t channel_config;
+static int16_t dma[DMA_BUF_COUNT][DMA_BUF_LEN];
+static uint32_t dma_frames = 0;             // Completed since boot
+
+esp_err_t i2s_new_channel(const i2s_chan_config_t* chan_cfg, i2s_chan_handle_t* ret_tx_handle,
+                          i2s_chan_handle_t* ret_rx_handle)
+{
+    channel_config = *chan_cfg;
+    memset(&tx_channel, 0, sizeof(tx_channel));
+    memset(&rx_channel, 0, sizeof(rx_channel));
+    *ret_tx_handle = &tx_channel;
+    *ret_rx_handle = &rx_channel;
+    return ESP_OK;
+}
+
+esp_err_t i2s_del_channel(i2s_chan_handle_t handle)
+{
+    return ESP_OK;
+}
+
+esp_err_t i2s_channel_init_std_mode(i2s_chan_handle_t handle, const i2s_std_config_t* std_cfg)
+{
+    return std_cfg->clk_cfg.sample_rate_hz == SAMPLE_RATE ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+esp_err_t i2s_channel_register_event_callback(i2s_chan_handle_t handle, const i2s_event_callbacks_t* callbacks,
+                                              void* user_data)
+{
+    handle->on_recv = callbacks->on_recv;
+    handle->user_ctx = user_data;
+    return ESP_OK;
+}
+
+esp_err_t i2s_channel_enable(i2s_chan_handle_t handle)
+{
+    if (handle->enabled) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    handle->enabled = true;
+    return ESP_OK;
+}
+
+esp_err_t i2s_channel_disable(i2s_chan_handle_t handle)
+{
+    handle->enabled = false;
+    return ESP_OK;
+}
+
+esp_err_t i2s_channel_write(i2s_chan_handle_t handle, const void* src, size_t size, size_t* bytes_written,
+                            uint32_t timeout_ms)
+{
+    *bytes_written = handle->enabled ? size : 0;
+    return ESP_OK;
+}
+
+// Sample i of DMA frame n: sample 0 is the frame number, the rest follow from it
+static int16_t pattern(int16_t first, int i)
+{
+    return i == 0 ? first : (int16_t)((first * 131 + i) & 0x7FFF);
+}
+
+static bool frame_consistent(const int16_t* samples)
+{
+    for (int i = 1; i < DMA_BUF_LEN; i++) {
+        if (samples[i] != pattern(samples[0], i)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// The DMA completes the next descriptor and the receive interrupt fires
+static void dma_complete(void)
+{
+    int16_t* buf = dma[dma_frames % DMA_BUF_COUNT];
+    int16_t first = (int16_t)(dma_frames & 0x7FFF);
+    for (int i = 0; i < DMA_BUF_LEN; i++) {
+        buf[i] = pattern(first, i);
+    }
+    dma_frames++;
+    if (rx_channel.enabled && rx_channel.on_recv) {
+        i2s_event_data_t event = { .dma_buf = buf, .size = sizeof(dma[0]) };
+        rx_channel.on_recv(&rx_channel, &event, rx_channel.user_ctx);
+    }
+}
+
+// ============================================================================
+// Tests
+// ============================================================================
+
+static int64_t now_ns(void)
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (int64_t)t.tv_sec * 1000000000 + t.tv_nsec;
+}
+
+static int64_t slowest_borrow_ns = 0;
+
+static bool borrow(audio_frame_t* frame)
+{
+    int64_t start = now_ns();
+    bool ok = audio_capture_borrow(frame);
+    int64_t took = now_ns() - start;
+    if (took > slowest_borrow_ns) {
+        slowest_borrow_ns = took;
+    }
+    return ok;
+}
+
+static void restart_capture(void)
+{
+    audio_stop_recording();
+    audio_start_recording();
+}
+
+static void test_driver_configured(void)
+{
+    CHECK(audio_handler_set_backend(&audio_backend_i2s));
+    CHECK_EQ_STR(audio_handler_backend_name(), "i2s");
+    CHECK_EQ_INT((int)channel_config.dma_desc_num, DMA_BUF_COUNT);
+    CHECK_EQ_INT((int)channel_config.dma_frame_num, DMA_BUF_LEN);
+    CHECK(channel_config.auto_clear);
+    CHECK(rx_channel.on_recv != NULL);
+}
+
+// Nothing captured yet, or a peripheral that stopped clocking: no frame,
+// at once, counted as an underrun
+static void test_borrow_never_waits(void)
+{
+    restart_capture();
+    audio_capture_stats_t before;
+    audio_get_capture_stats(&before);
+    audio_frame_t frame;
+    for (int i = 0; i < 50; i++) {
+        CHECK(!borrow(&frame));
+    }
+    audio_capture_stats_t after;
+    audio_get_capture_stats(&after);
+    CHECK_EQ_INT((int)(after.underruns - before.underruns), 50);
+    CHECK_EQ_INT((int)(after.frames - before.frames), 0);
+}
+
+static void test_frames_lent_in_place(void)
+{
+    restart_capture();
+    dma_complete();
+    audio_frame_t frame;
+    CHECK(borrow(&frame));
+    CHECK(frame.samples == dma[(dma_frames - 1) % DMA_BUF_COUNT]);
+    CHECK_EQ_INT((int)frame.count, DMA_BUF_LEN);
+    CHECK_EQ_INT(frame.samples[0], (int16_t)((dma_frames - 1) & 0x7FFF));
+    CHECK(frame_consistent(frame.samples));
+    CHECK_EQ_INT((int)frame.captured_us, (int)esp_timer_get_time());
+    audio_capture_release();
+    CHECK(!borrow(&frame));
+}
+
+// Capture not collected: only the newest AUDIO_CAPTURE_MAX_QUEUED frames
+// are kept, the rest count as overruns
+static void test_overrun_keeps_newest(void)
+{
+    restart_capture();
+    audio_capture_stats_t before;
+    audio_get_capture_stats(&before);
+    for (int i = 0; i < 5; i++) {
+        dma_complete();
+    }
+    audio_frame_t frame;
+    for (int i = AUDIO_CAPTURE_MAX_QUEUED; i > 0; i--) {
+        CHECK(borrow(&frame));
+        CHECK_EQ_INT(frame.samples[0], (int16_t)((dma_frames - i) & 0x7FFF));
+        audio_capture_release();
+    }
+    CHECK(!borrow(&frame));
+
+    audio_capture_stats_t after;
+    audio_get_capture_stats(&after);
+    CHECK_EQ_INT((int)(after.overruns - before.overruns), 5 - AUDIO_CAPTURE_MAX_QUEUED);
+}
+
+typedef struct {
+    const char* name;
+    int64_t dma_period_us;
+    int ptime_frames;           // Frames held before the packet goes out (and they are returned)
+    int stall_every;            // Ticks; 0 = never
+    int stall_ticks;            // Ticks the media task misses then
+    bool dma_stopped;
+} scenario_t;
+
+static void run(const scenario_t* s)
+{
+    restart_capture();
+    audio_capture_stats_t before;
+    audio_get_capture_stats(&before);
+
+    int64_t next_dma = esp_timer_get_time() + s->dma_period_us;
+    int64_t next_tick = esp_timer_get_time() + FRAME_US + TICK_PHASE_US;
+    audio_frame_t held[AUDIO_MAX_BORROWED];
+    int16_t held_first[AUDIO_MAX_BORROWED];
+    int held_count = 0;
+    int ticks = 0;
+    int64_t max_latency = 0;
+    bool intact = true;
+
+    for (int tick = 0; tick < RUN_TICKS;) {
+        if (!s->dma_stopped && next_dma <= next_tick) {
+            host_clock_advance(next_dma - esp_timer_get_time());
+            dma_complete();
+            next_dma += s->dma_period_us;
+            continue;
+        }
+        host_clock_advance(next_tick - esp_timer_get_time());
+        next_tick += FRAME_US;
+        bool stalled = s->stall_every && tick % s->stall_every < s->stall_ticks;
+        tick++;
+        if (stalled) {
+            continue;
+        }
+        ticks++;
+
+        audio_frame_t frame;
+        if (!borrow(&frame)) {
+            continue;
+        }
+        int64_t latency = esp_timer_get_time() - frame.captured_us;
+        max_latency = latency > max_latency ? latency : max_latency;
+        intact &= frame_consistent(frame.samples);
+        held[held_count] = frame;
+        held_first[held_count] = frame.samples[0];
+        held_count++;
+        if (held_count == s->ptime_frames) {
+            // Encoded into the packet: the DMA must not have touched them
+            for (int i = 0; i < held_count; i++) {
+                intact &= held[i].samples[0] == held_first[i] && frame_consistent(held[i].samples);
+                audio_capture_release();
+            }
+            held_count = 0;
+        }
+    }
+    while (held_count-- > 0) {
+        audio_capture_release();
+    }
+
+    audio_capture_stats_t after;
+    audio_get_capture_stats(&after);
+    uint32_t frames = after.frames - before.frames;
+    uint32_t underruns = after.underruns - before.underruns;
+    uint32_t overruns = after.overruns - before.overruns;
+    printf("  %-28s %6lu %9lu %8lu %11.1f\n", s->name, (unsigned long)frames, (unsigned long)underruns,
+           (unsigned long)overruns, max_latency / 1000.0);
+
+    CHECK(intact);
+    CHECK_EQ_INT((int)(frames + underruns), ticks);
+    CHECK(max_latency <= AUDIO_CAPTURE_MAX_QUEUED * FRAME_US);
+    if (s->dma_stopped) {
+        CHECK_EQ_INT((int)frames, 0);
+    } else if (s->dma_period_us == FRAME_US && s->stall_every == 0) {
+        CHECK_EQ_INT((int)underruns, 0);
+        CHECK_EQ_INT((int)overruns, 0);
+        CHECK_EQ_INT((int)max_latency, TICK_PHASE_US);
+    }
+    if (s->stall_every || s->dma_period_us < FRAME_US) {
+        CHECK(overruns > 0);
+    }
+    if (s->dma_period_us > FRAME_US) {
+        CHECK(underruns > 0);
+    }
+}
+
+static void test_media_ticks(void)
+{
+    static const scenario_t scenarios[] = {
+        { "in step, ptime 20", FRAME_US, 1, 0, 0, false },
+        { "in step, ptime 60", FRAME_US, 3, 0, 0, false },
+        { "media task stalls 100 ms/2s", FRAME_US, 1, 100, 5, false },
+        { "DMA clock 1% fast", FRAME_US - FRAME_US / 100, 1, 0, 0, false },
+        { "DMA clock 1% slow", FRAME_US + FRAME_US / 100, 3, 0, 0, false },
+        { "DMA stopped", FRAME_US, 1, 0, 0, true },
+    };
+    printf("  10 s of media ticks            frames underruns overruns latency(ms)\n");
+    for (size_t i = 0; i < sizeof(scenarios) / sizeof(scenarios[0]); i++) {
+        run(&scenarios[i]);
+    }
+    printf("  slowest borrow: %lld ns\n", (long long)slowest_borrow_ns);
+    CHECK(slowest_borrow_ns < BORROW_LIMIT_NS);
+}
+
+static void test_playback_write(void)
+{
+    int16_t frame[DMA_BUF_LEN] = { 0 };
+    CHECK_EQ_INT((int)audio_write(frame, DMA_BUF_LEN), 0);
+    audio_start_playback();
+    CHECK_EQ_INT((int)audio_write(frame, DMA_BUF_LEN), DMA_BUF_LEN);
+    audio_stop_playback();
+}
+
+int main(void)
+{
+    setvbuf(stdout, NULL, _IOLBF, 0);
+    host_clock_simulate(START_US);
+    RUN_TEST(test_driver_configured);
+    RUN_TEST(test_borrow_never_waits);
+    RUN_TEST(test_frames_lent_in_place);
+    RUN_TEST(test_overrun_keeps_newest);
+    RUN_TEST(test_media_ticks);
+    RUN_TEST(test_playback_write);
+    return TEST_RESULT();
+}
@@ -0,0 +1,299 @@
+#include "dns_cache.h"
+#include "lwip/dns.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "test_support.h"
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+
+// dns_cache_resolve() must never wait on the network. A stub resolver on
+// loopback answers every query only after RESOLVER_LATENCY_MS (real time);
+// the cache's clock is the simulated one, so TTLs expire when the test says.
+// After each step the test waits for the refresh task to go back to sleep,
+// which is when it has stored what it looked up.
+
+#define START_US                1000000
+#define RESOLVER_LATENCY_MS     300
+#define RESOLVE_LIMIT_US        30000   // A tenth of the resolver's latency
+#define TTL_S                   60
+
+typedef struct {
+    const char* name;
+    uint16_t type;              // 1: A, 33: SRV
+    uint8_t addr[4];
+    uint16_t port;              // SRV
+    const char* target;         // SRV
+    bool present;               // NXDOMAIN otherwise
+} record_t;
+
+static record_t records[] = {
+    { "pbx.example", 1, { 192, 0, 2, 10 }, 0, NULL, true },
+    { "_sip._udp.pbx.example", 33, { 0 }, 5070, "sip.pbx.example", true },
+    { "sip.pbx.example", 1, { 192, 0, 2, 20 }, 0, NULL, true },
+    { "late.example", 1, { 192, 0, 2, 30 }, 0, NULL, false },
+};
+
+static int resolver_sock;
+static int queries = 0;
+static TaskHandle_t refresh_task;
+
+static size_t put_name(uint8_t* out, const char* name)
+{
+    size_t pos = 0;
+    while (*name) {
+        const char* dot = strchr(name, '.');
+        size_t len = dot ? (size_t)(dot - name) : strlen(name);
+        out[pos++] = (uint8_t)len;
+        memcpy(out + pos, name, len);
+        pos += len;
+        name += len + (dot ? 1 : 0);
+    }
+    out[pos++] = 0;
+    return pos;
+}
+
+static size_t put_u16(uint8_t* out, uint16_t value)
+{
+    out[0] = value >> 8;
+    out[1] = value & 0xFF;
+    return 2;
+}
+
+// Answer one query: the record for the question's name and type, else NXDOMAIN
+static size_t answer(const uint8_t* query, size_t len, uint8_t* out)
+{
+    char name[128] = "";
+    size_t pos = 12;
+    size_t name_len = 0;
+    while (pos < len && query[pos] != 0 && name_len + query[pos] + 2 < sizeof(name)) {
+        if (name_len > 0) {
+            name[name_len++] = '.';
+        }
+        memcpy(name + name_len, query + pos + 1, query[pos]);
+        name_len += query[pos];
+        name[name_len] = '\0';
+        pos += 1 + query[pos];
+    }
+    pos++;
+    uint16_t qtype = (uint16_t)((query[pos] << 8) | query[pos + 1]);
+    pos += 4;
+
+    const record_t* found = NULL;
+    for (size_t i = 0; i < sizeof(records) / sizeof(records[0]); i++) {
+        if (records[i].present && records[i].type == qtype && strcmp(records[i].name, name) == 0) {
+            found = &records[i];
+        }
+    }
+
+    memcpy(out, query, pos);                        // Header and question
+    put_u16(out + 2, found ? 0x8180 : 0x8183);      // Response, RA; NXDOMAIN
+    put_u16(out + 6, found ? 1 : 0);
+    put_u16(out + 8, 0);
+    put_u16(out + 10, 0);
+    if (!found) {
+        return pos;
+    }
+
+    pos += put_u16(out + pos, 0xC00C);              // The question's name
+    pos += put_u16(out + pos, found->type);
+    pos += put_u16(out + pos, 1);
+    pos += put_u16(out + pos, 0);
+    pos += put_u16(out + pos, TTL_S);
+    size_t rdlength_at = pos;
+    pos += 2;
+    if (found->type == 1) {
+        memcpy(out + pos, found->addr, 4);
+        pos += 4;
+    } else {
+        pos += put_u16(out + pos, 10);              // Priority
+        pos += put_u16(out + pos, 5);               // Weight
+        pos += put_u16(out + pos, found->port);
+        pos += put_name(out + pos, found->target);
+    }
+    put_u16(out + rdlength_at, (uint16_t)(pos - rdlength_at - 2));
+    return pos;
+}
+
+static void* resolver_main(void* arg)
+{
+    for (;;) {
+        uint8_t query[512];
+        uint8_t response[512];
+        struct sockaddr_in from;
+        socklen_t from_len = sizeof(from);
+        int len = recvfrom(resolver_sock, query, sizeof(query), 0, (struct sockaddr*)&from, &from_len);
+        if (len < 12) {
+            continue;
+        }
+        usleep(RESOLVER_LATENCY_MS * 1000);
+        size_t out_len = answer(query, (size_t)len, response);
+        __atomic_add_fetch(&queries, 1, __ATOMIC_SEQ_CST);
+        sendto(resolver_sock, response, out_len, 0, (struct sockaddr*)&from, from_len);
+    }
+    return NULL;
+}
+
+static void start_resolver(void)
+{
+    resolver_sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+    };
+    bind(resolver_sock, (struct sockaddr*)&addr, sizeof(addr));
+    socklen_t len = sizeof(addr);
+    getsockname(resolver_sock, (struct sockaddr*)&addr, &len);
+    host_dns_set_server("127.0.0.1", ntohs(addr.sin_port));
+
+    pthread_t thread;
+    pthread_create(&thread, NULL, resolver_main, NULL);
+}
+
+static int answered(void)
+{
+    return __atomic_load_n(&queries, __ATOMIC_SEQ_CST);
+}
+
+static int64_t real_us(void)
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (int64_t)t.tv_sec * 1000000 + t.tv_nsec / 1000;
+}
+
+static int64_t slowest_us = 0;
+
+// dns_cache_resolve(), checked to return well within the resolver's latency
+static bool resolve(const char* host, struct sockaddr_in* addr)
+{
+    int64_t start = real_us();
+    bool ok = dns_cache_resolve(host, 5060, addr);
+    int64_t took = real_us() - start;
+    if (took > slowest_us) {
+        slowest_us = took;
+    }
+    CHECK(took < RESOLVE_LIMIT_US);
+    return ok;
+}
+
+static void check_addr(const struct sockaddr_in* addr, const char* ip, uint16_t port)
+{
+    char text[INET_ADDRSTRLEN];
+    inet_ntop(AF_INET, &addr->sin_addr, text, sizeof(text));
+    CHECK_EQ_STR(text, ip);
+    CHECK_EQ_INT(ntohs(addr->sin_port), port);
+}
+
+static void test_cold_miss_does_not_wait(void)
+{
+    struct sockaddr_in addr;
+    CHECK(!resolve("pbx.example", &addr));
+    host_task_wait_blocked(refresh_task);
+    CHECK_EQ_INT(answered(), 1);
+
+    CHECK(resolve("pbx.example", &addr));
+    check_addr(&addr, "192.0.2.10", 5060);
+    CHECK_EQ_INT(answered(), 1);
+}
+
+static void test_literal_never_queries(void)
+{
+    struct sockaddr_in addr;
+    CHECK(resolve("10.1.2.3", &addr));
+    check_addr(&addr, "10.1.2.3", 5060);
+    CHECK_EQ_INT(answered(), 1);
+}
+
+// An expired negative entry stays negative until the refresh task has asked
+// again, and the name resolves after that
+static void test_negative_entry_refreshed_in_background(void)
+{
+    struct sockaddr_in addr;
+    int before = answered();
+    CHECK(!resolve("late.example", &addr));
+    host_task_wait_blocked(refresh_task);
+    CHECK_EQ_INT(answered(), before + 1);
+
+    CHECK(!resolve("late.example", &addr));     // Negative hit, no query
+    host_task_wait_blocked(refresh_task);
+    CHECK_EQ_INT(answered(), before + 1);
+
+    records[3].present = true;
+    host_clock_advance(31 * 1000000LL);
+    CHECK(!resolve("late.example", &addr));
+    host_task_wait_blocked(refresh_task);
+    CHECK_EQ_INT(answered(), before + 2);
+
+    CHECK(resolve("late.example", &addr));
+    check_addr(&addr, "192.0.2.30", 5060);
+}
+
+// Past its TTL the old address is served at once; the new one after the refresh
+static void test_expired_entry_served_while_refreshing(void)
+{
+    struct sockaddr_in addr;
+    records[0].addr[3] = 11;
+    host_clock_advance((TTL_S + 1) * 1000000LL);
+    CHECK(resolve("pbx.example", &addr));
+    host_task_wait_blocked(refresh_task);
+
+    CHECK(resolve("pbx.example", &addr));
+    check_addr(&addr, "192.0.2.11", 5060);
+}
+
+// Turning SRV on keeps the entries: the A record's address is served until
+// the SRV lookup has replaced it
+static void test_srv_change_keeps_entries(void)
+{
+    struct sockaddr_in addr;
+    int before = answered();
+    dns_cache_set_srv_service("_sip._udp");
+    CHECK(resolve("pbx.example", &addr));
+    check_addr(&addr, "192.0.2.11", 5060);
+    host_task_wait_blocked(refresh_task);
+    CHECK(answered() > before);
+
+    CHECK(resolve("pbx.example", &addr));
+    check_addr(&addr, "192.0.2.20", 5070);
+}
+
+static void test_flush_keeps_entries(void)
+{
+    struct sockaddr_in addr;
+    int before = answered();
+    dns_cache_flush();
+    CHECK(resolve("pbx.example", &addr));
+    check_addr(&addr, "192.0.2.20", 5070);
+    host_task_wait_blocked(refresh_task);
+    CHECK(answered() > before);
+
+    CHECK(resolve("pbx.example", &addr));
+    check_addr(&addr, "192.0.2.20", 5070);
+}
+
+int main(void)
+{
+    setvbuf(stdout, NULL, _IOLBF, 0);
+    host_clock_simulate(START_US);
+    start_resolver();
+    dns_cache_init();
+    refresh_task = host_task_find("dns_refresh");
+    CHECK(refresh_task != NULL);
+    host_task_wait_blocked(refresh_task);
+
+    RUN_TEST(test_cold_miss_does_not_wait);
+    RUN_TEST(test_literal_never_queries);
+    RUN_TEST(test_negative_entry_refreshed_in_background);
+    RUN_TEST(test_expired_entry_served_while_refreshing);
+    RUN_TEST(test_srv_change_keeps_entries);
+    RUN_TEST(test_flush_keeps_entries);
+
+    printf("  slowest dns_cache_resolve(): %lld us (resolver answers in %d ms)\n",
+           (long long)slowest_us, RESOLVER_LATENCY_MS);
+    return TEST_RESULT();
+}
@@ -0,0 +1,302 @@
+#include "echo_canceller.h"
+#include "test_signals.h"
+#include "test_support.h"
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+// A far-end talker is played into a room; the microphone picks it up
+// through a decaying impulse response that changes at 20 s, plus a local
+// talker from 10 to 15 s (double-talk) and 23 to 26 s, plus a little noise.
+// ERLE is measured over frames where only the far end talks.
+
+#define SECONDS         30
+#define SAMPLES         (SECONDS * SIGNAL_RATE)
+#define FRAMES          (SAMPLES / AEC_FRAME_SAMPLES)
+#define PATH_CHANGE_S   20
+#define IR_TAPS         440     // 55 ms
+#define ECHO_GAIN       0.12    // About 12 dB echo return loss
+#define LOUD_ECHO_GAIN  0.35    // About 2.5 dB
+
+typedef struct {
+    int16_t far[SAMPLES];
+    int16_t mic[SAMPLES];
+    int16_t local[SAMPLES];     // The local talker's share of the microphone
+    int16_t out[SAMPLES];
+} scenario_t;
+
+static scenario_t scenario;
+static aec_t aec;
+
+static bool local_talks(double t)
+{
+    return (t >= 10 && t < 15) || (t >= 23 && t < 26);
+}
+
+// @p white replaces the far-end talker by white noise; the echo arrives
+// @p extra_delay samples later than the room alone would make it
+static void make_scenario(double echo_gain, bool white, size_t extra_delay)
+{
+    static float far[SAMPLES];
+    static float local[SAMPLES];
+    static float h1[IR_TAPS];
+    static float h2[IR_TAPS];
+
+    if (white) {
+        signal_srand(5);
+        for (size_t i = 0; i < SAMPLES; i++) {
+            far[i] = (float)(signal_noise() * 0.5);
+        }
+    } else {
+        signal_talker(far, SAMPLES, 120, 1, 0.8);
+    }
+    signal_talker(local, SAMPLES, 210, 7, 0.8);
+    for (size_t i = 0; i < SAMPLES; i++) {
+        if (!local_talks(i / (double)SIGNAL_RATE)) {
+            local[i] = 0;
+        }
+    }
+
+    // Direct path after 6 and 7 ms, then reflections
+    signal_srand(3);
+    for (int k = 0; k < IR_TAPS; k++) {
+        h1[k] = k < 48 ? 0.0f : (float)(exp(-(k - 48) / 90.0) * signal_noise() * 0.5);
+    }
+    h1[48] = 0.6f;
+    h1[50] = -0.3f;
+    signal_srand(4);
+    for (int k = 0; k < IR_TAPS; k++) {
+        h2[k] = k < 56 ? 0.0f : (float)(exp(-(k - 56) / 110.0) * signal_noise() * 0.5);
+    }
+    h2[56] = 0.5f;
+    h2[59] = 0.25f;
+
+    signal_srand(9);
+    for (size_t i = 0; i < SAMPLES; i++) {
+        const float* h = i < PATH_CHANGE_S * SIGNAL_RATE ? h1 : h2;
+        double echo = 0;
+        for (size_t k = 0; k < IR_TAPS && k + extra_delay <= i; k++) {
+            echo += h[k] * far[i - extra_delay - k];
+        }
+        scenario.far[i] = signal_to_pcm(far[i] * 20000);
+        scenario.local[i] = signal_to_pcm(local[i] * 0.5 * 20000);
+        scenario.mic[i] = signal_to_pcm((echo * echo_gain + local[i] * 0.5 + signal_noise() * 0.001) * 20000);
+    }
+}
+
+// One far-end frame played, then the capture that goes with it, as the
+// media engine does
+static void run(uint16_t tail_ms, uint16_t delay_ms)
+{
+    aec_config_t config = {
+        .enabled = true,
+        .tail_ms = tail_ms,
+        .delay_ms = delay_ms,
+        .dt_threshold_pct = AEC_DEFAULT_DT_PCT,
+    };
+    aec_init(&aec, &config);
+    for (int f = 0; f < FRAMES; f++) {
+        size_t at = (size_t)f * AEC_FRAME_SAMPLES;
+        aec_far_end(&aec, scenario.far + at, AEC_FRAME_SAMPLES);
+        aec_process(&aec, scenario.mic + at, scenario.out + at, AEC_FRAME_SAMPLES);
+    }
+}
+
+// ERLE over frames in [from_s, to_s) where the far end talks alone
+static double erle_db(double from_s, double to_s)
+{
+    double mic = 0;
+    double out = 0;
+    for (int f = (int)(from_s * 50); f < (int)(to_s * 50); f++) {
+        size_t at = (size_t)f * AEC_FRAME_SAMPLES;
+        size_t end = at + AEC_FRAME_SAMPLES;
+        if (signal_energy(scenario.local, at, end) == 0 &&
+            signal_energy(scenario.far, at, end) > AEC_FRAME_SAMPLES * 300.0 * 300.0) {
+            mic += signal_energy(scenario.mic, at, end);
+            out += signal_energy(scenario.out, at, end);
+        }
+    }
+    return signal_db(mic, out);
+}
+
+// Echo and noise relative to the local talker during double-talk, before
+// (@p after false) or after the canceller
+static double double_talk_residual_db(bool after)
+{
+    double local = 0;
+    double residual = 0;
+    for (size_t i = 10 * SIGNAL_RATE; i < 15 * SIGNAL_RATE; i++) {
+        double d = (after ? scenario.out[i] : scenario.mic[i]) - scenario.local[i];
+        local += (double)scenario.local[i] * scenario.local[i];
+        residual += d * d;
+    }
+    return signal_db(residual, local);
+}
+
+static void test_converges_on_speech(void)
+{
+    make_scenario(ECHO_GAIN, false, 0);
+    run(AEC_DEFAULT_TAIL_MS, 0);
+
+    double converged = erle_db(2, PATH_CHANGE_S);
+    double after_change = erle_db(PATH_CHANGE_S + 1, SECONDS);
+    printf("  ERLE %.1f dB, %.1f dB after the path change\n", converged, after_change);
+    CHECK(converged >= 18.0);
+    CHECK(after_change >= 10.0);
+
+    aec_stats_t stats;
+    aec_get_stats(&aec, &stats);
+    CHECK_EQ_INT(stats.frames, FRAMES);
+    CHECK_EQ_INT(stats.resyncs, 0);
+    CHECK(stats.updates > 0);
+    CHECK(stats.adapt_frames > FRAMES / 4);
+    CHECK(stats.erle_db >= 8.0f);
+
+    // The output is never louder than what the microphone picked up
+    for (int f = 0; f < FRAMES; f++) {
+        size_t at = (size_t)f * AEC_FRAME_SAMPLES;
+        CHECK(signal_energy(scenario.out, at, at + AEC_FRAME_SAMPLES) <=
+              signal_energy(scenario.mic, at, at + AEC_FRAME_SAMPLES));
+    }
+}
+
+// The local talker goes through while the echo under it is reduced, and
+// the filter does not diverge on it
+static void test_double_talk(void)
+{
+    make_scenario(ECHO_GAIN, false, 0);
+    run(AEC_DEFAULT_TAIL_MS, 0);
+
+    double before = double_talk_residual_db(false);
+    double after = double_talk_residual_db(true);
+    printf("  echo to local talker %.1f -> %.1f dB\n", before, after);
+    CHECK(after <= before - 3.0);
+
+    aec_stats_t stats;
+    aec_get_stats(&aec, &stats);
+    CHECK(stats.double_talk_frames >= 100);
+    // Still converged after both stretches of local speech
+    CHECK(erle_db(26, SECONDS) >= 12.0);
+}
+
+// Little echo return loss: the double-talk threshold still holds
+static void test_loud_echo(void)
+{
+    make_scenario(LOUD_ECHO_GAIN, false, 0);
+    run(AEC_DEFAULT_TAIL_MS, 0);
+
+    double converged = erle_db(2, PATH_CHANGE_S);
+    printf("  ERLE %.1f dB\n", converged);
+    CHECK(converged >= 15.0);
+    CHECK(double_talk_residual_db(true) <= double_talk_residual_db(false) - 3.0);
+}
+
+// A white far end excites every bin: the filter gets close to the room
+static void test_white_noise(void)
+{
+    make_scenario(ECHO_GAIN, true, 0);
+    run(AEC_DEFAULT_TAIL_MS, 0);
+
+    double converged = erle_db(5, PATH_CHANGE_S);
+    printf("  ERLE %.1f dB\n", converged);
+    CHECK(converged >= 25.0);
+}
+
+// An echo 100 ms late only fits a 64 ms tail with the bulk delay set
+static void test_bulk_delay(void)
+{
+    make_scenario(ECHO_GAIN, false, 800);
+    run(AEC_DEFAULT_TAIL_MS, 80);
+    double with_delay = erle_db(2, PATH_CHANGE_S);
+    run(AEC_DEFAULT_TAIL_MS, 0);
+    double without = erle_db(2, PATH_CHANGE_S);
+    printf("  ERLE %.1f dB with the bulk delay, %.1f dB without\n", with_delay, without);
+    CHECK(with_delay >= 15.0);
+    CHECK(without <= with_delay - 10.0);
+
+    // The longest tail covers it on its own
+    run(AEC_MAX_TAIL_MS, 0);
+    CHECK(erle_db(2, PATH_CHANGE_S) >= 8.0);
+}
+
+// Capture lost before the canceller: aec_skip keeps the pairing, so the
+// filter stays converged; missing playout is taken as silence
+static void test_skip_and_resync(void)
+{
+    make_scenario(ECHO_GAIN, false, 0);
+    aec_config_t config = { .enabled = true, .tail_ms = AEC_DEFAULT_TAIL_MS, .dt_threshold_pct = AEC_DEFAULT_DT_PCT };
+    aec_init(&aec, &config);
+    for (int f = 0; f < FRAMES; f++) {
+        size_t at = (size_t)f * AEC_FRAME_SAMPLES;
+        aec_far_end(&aec, scenario.far + at, AEC_FRAME_SAMPLES);
+        if (f % 100 == 50) {
+            aec_skip(&aec, AEC_FRAME_SAMPLES);
+            memcpy(scenario.out + at, scenario.mic + at, AEC_FRAME_SAMPLES * sizeof(int16_t));
+        } else {
+            aec_process(&aec, scenario.mic + at, scenario.out + at, AEC_FRAME_SAMPLES);
+        }
+    }
+    aec_stats_t stats;
+    aec_get_stats(&aec, &stats);
+    CHECK_EQ_INT(stats.resyncs, 0);
+    CHECK_EQ_INT(stats.frames, FRAMES - FRAMES / 100);
+    CHECK(erle_db(2, PATH_CHANGE_S) >= 10.0);
+
+    // Capture with no playout behind it
+    int16_t frame[AEC_FRAME_SAMPLES];
+    aec_process(&aec, scenario.mic, frame, AEC_FRAME_SAMPLES);
+    aec_get_stats(&aec, &stats);
+    CHECK_EQ_INT(stats.resyncs, 1);
+}
+
+static void test_disabled_and_partial_blocks(void)
+{
+    make_scenario(ECHO_GAIN, false, 0);
+    aec_config_t config = { .enabled = false, .tail_ms = AEC_DEFAULT_TAIL_MS, .dt_threshold_pct = AEC_DEFAULT_DT_PCT };
+    aec_init(&aec, &config);
+    int16_t out[AEC_FRAME_SAMPLES];
+    for (int f = 0; f < 100; f++) {
+        size_t at = (size_t)f * AEC_FRAME_SAMPLES;
+        aec_far_end(&aec, scenario.far + at, AEC_FRAME_SAMPLES);
+        aec_process(&aec, scenario.mic + at, out, AEC_FRAME_SAMPLES);
+        CHECK(memcmp(out, scenario.mic + at, sizeof(out)) == 0);
+    }
+
+    // Enabled: samples after the last whole block pass through unchanged
+    config.enabled = true;
+    aec_init(&aec, &config);
+    const size_t count = 5 * AEC_BLOCK_SAMPLES - 10;
+    for (int f = 0; f < 500; f++) {
+        size_t at = (size_t)f * count;
+        aec_far_end(&aec, scenario.far + at, count);
+        aec_process(&aec, scenario.mic + at, out, count);
+        size_t whole = count - count % AEC_BLOCK_SAMPLES;
+        CHECK(memcmp(out + whole, scenario.mic + at + whole, (count - whole) * sizeof(int16_t)) == 0);
+    }
+
+    // Out-of-range settings are clamped
+    config.tail_ms = 1000;
+    config.delay_ms = 1000;
+    aec_init(&aec, &config);
+    CHECK_EQ_INT(aec.config.tail_ms, AEC_MAX_TAIL_MS);
+    CHECK_EQ_INT(aec.partitions, AEC_MAX_PARTITIONS);
+    CHECK_EQ_INT(aec.config.delay_ms, AEC_MAX_DELAY_MS);
+    config.tail_ms = 1;
+    aec_init(&aec, &config);
+    CHECK_EQ_INT(aec.config.tail_ms, AEC_MIN_TAIL_MS);
+}
+
+int main(void)
+{
+    setvbuf(stdout, NULL, _IOLBF, 0);
+    RUN_TEST(test_converges_on_speech);
+    RUN_TEST(test_double_talk);
+    RUN_TEST(test_loud_echo);
+    RUN_TEST(test_white_noise);
+    RUN_TEST(test_bulk_delay);
+    RUN_TEST(test_skip_and_resync);
+    RUN_TEST(test_disabled_and_partial_blocks);
+    return TEST_RESULT();
+}
@@ -0,0 +1,162 @@
+#include "fft.h"
+#include "test_signals.h"
+#include "test_support.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+// Against a double-precision DFT of the same input. Inputs are scaled by
+// 2^6 like the echo canceller's, well inside the headroom of a 256-point
+// transform.
+
+static double forward_snr_db(uint16_t n)
+{
+    fft_complex_t data[FFT_MAX_SIZE];
+    double re[FFT_MAX_SIZE];
+    double im[FFT_MAX_SIZE];
+    for (uint16_t i = 0; i < n; i++) {
+        re[i] = (double)(int32_t)(signal_noise() * 32767) * 64;
+        im[i] = (double)(int32_t)(signal_noise() * 32767) * 64;
+        data[i].re = (int32_t)re[i];
+        data[i].im = (int32_t)im[i];
+    }
+    fft_forward(data, n);
+
+    double error = 0;
+    double power = 0;
+    for (uint16_t k = 0; k < n; k++) {
+        double sr = 0;
+        double si = 0;
+        for (uint16_t t = 0; t < n; t++) {
+            double angle = -2 * M_PI * k * t / n;
+            sr += re[t] * cos(angle) - im[t] * sin(angle);
+            si += re[t] * sin(angle) + im[t] * cos(angle);
+        }
+        error += (data[k].re - sr) * (data[k].re - sr) + (data[k].im - si) * (data[k].im - si);
+        power += sr * sr + si * si;
+    }
+    return signal_db(power, error);
+}
+
+static void test_forward_matches_dft(void)
+{
+    signal_srand(7);
+    for (uint16_t n = 4; n <= FFT_MAX_SIZE; n *= 2) {
+        double snr = forward_snr_db(n);
+        if (snr < 90.0) {
+            printf("  n=%u: SNR %.1f dB\n", n, snr);
+        }
+        CHECK(snr >= 90.0);
+    }
+}
+
+// The inverse scales by 1/n: a round trip returns the input to within Q15
+// twiddle rounding, 2^-14 of full scale
+static void test_round_trip(void)
+{
+    signal_srand(11);
+    for (uint16_t n = 2; n <= FFT_MAX_SIZE; n *= 2) {
+        fft_complex_t data[FFT_MAX_SIZE];
+        int32_t original[FFT_MAX_SIZE];
+        for (uint16_t i = 0; i < n; i++) {
+            original[i] = (int32_t)(signal_noise() * 32767) * 64;
+            data[i].re = original[i];
+            data[i].im = 0;
+        }
+        fft_forward(data, n);
+        fft_inverse(data, n);
+
+        int32_t worst = 0;
+        for (uint16_t i = 0; i < n; i++) {
+            int32_t re_error = abs(data[i].re - original[i]);
+            int32_t im_error = abs(data[i].im);
+            worst = re_error > worst ? re_error : worst;
+            worst = im_error > worst ? im_error : worst;
+        }
+        if (worst > (32767 * 64) >> 14) {
+            printf("  n=%u: worst error %d\n", n, worst);
+        }
+        CHECK(worst <= (32767 * 64) >> 14);
+    }
+}
+
+static void test_known_spectra(void)
+{
+    const uint16_t n = 64;
+    fft_complex_t data[FFT_MAX_SIZE];
+
+    // Impulse: flat
+    for (uint16_t i = 0; i < n; i++) {
+        data[i].re = i == 0 ? 1000000 : 0;
+        data[i].im = 0;
+    }
+    fft_forward(data, n);
+    for (uint16_t k = 0; k < n; k++) {
+        CHECK(abs(data[k].re - 1000000) <= 1);
+        CHECK(abs(data[k].im) <= 1);
+    }
+
+    // Constant: everything in bin 0
+    for (uint16_t i = 0; i < n; i++) {
+        data[i].re = 10000;
+        data[i].im = 0;
+    }
+    fft_forward(data, n);
+    CHECK_EQ_INT(data[0].re, 10000 * n);
+    for (uint16_t k = 1; k < n; k++) {
+        CHECK(abs(data[k].re) <= 2 && abs(data[k].im) <= 2);
+    }
+
+    // Real cosine at bin 5: half the amplitude times n in bins 5 and n - 5,
+    // nothing elsewhere above 2^-16 of that
+    const double peak = 500000.0 * n;
+    for (uint16_t i = 0; i < n; i++) {
+        data[i].re = (int32_t)lrint(1000000 * cos(2 * M_PI * 5 * i / n));
+        data[i].im = 0;
+    }
+    fft_forward(data, n);
+    for (uint16_t k = 0; k < n; k++) {
+        double expected = (k == 5 || k == n - 5) ? peak : 0.0;
+        CHECK(fabs(data[k].re - expected) < peak / 65536);
+        CHECK(fabs((double)data[k].im) < peak / 65536);
+    }
+
+    // Sine at bin 3 is imaginary: -i in bin 3, +i in bin n - 3
+    for (uint16_t i = 0; i < n; i++) {
+        data[i].re = (int32_t)lrint(1000000 * sin(2 * M_PI * 3 * i / n));
+        data[i].im = 0;
+    }
+    fft_forward(data, n);
+    CHECK(fabs(data[3].im + peak) < peak / 65536);
+    CHECK(fabs(data[n - 3].im - peak) < peak / 65536);
+    CHECK(fabs((double)data[3].re) < peak / 65536);
+}
+
+// Full-scale input at the documented headroom does not overflow
+static void test_headroom(void)
+{
+    const uint16_t n = FFT_MAX_SIZE;
+    fft_complex_t data[FFT_MAX_SIZE];
+    const int32_t peak = (1 << (31 - 8)) - 1;
+    for (uint16_t i = 0; i < n; i++) {
+        data[i].re = peak;
+        data[i].im = 0;
+    }
+    fft_forward(data, n);
+    CHECK(data[0].re > 0);
+    CHECK(fabs((double)data[0].re - (double)peak * n) < 8);
+    fft_inverse(data, n);
+    for (uint16_t i = 0; i < n; i++) {
+        CHECK(abs(data[i].re - peak) <= 2);
+    }
+}
+
+int main(void)
+{
+    RUN_TEST(test_forward_matches_dft);
+    RUN_TEST(test_round_trip);
+    RUN_TEST(test_known_spectra);
+    RUN_TEST(test_headroom);
+    return TEST_RESULT();
+}
@@ -0,0 +1,304 @@
+#include "g711.h"
+#include "test_signals.h"
+#include "test_support.h"
+#include <stdint.h>
+#include <time.h>
+
+// The codec must stay bit exact with the ITU-T G.191 reference, which other
+// ends (and their test vectors) are built on. The reference routines below
+// are the G.191 loops, one sample at a time, kept as close to the original
+// as C allows.
+
+static uint8_t ref_alaw_compress(int16_t lin)
+{
+    int16_t ix = lin < 0 ? (int16_t)((~lin) >> 4) : (int16_t)(lin >> 4);
+    if (ix > 15) {
+        int16_t iexp = 1;
+        while (ix > 16 + 15) {
+            ix >>= 1;
+            iexp++;
+        }
+        ix -= 16;
+        ix += iexp << 4;
+    }
+    if (lin >= 0) {
+        ix |= 0x0080;
+    }
+    return (uint8_t)(ix ^ 0x0055);
+}
+
+static int16_t ref_alaw_expand(uint8_t code)
+{
+    int16_t ix = (code ^ 0x0055) & 0x007F;
+    int16_t iexp = ix >> 4;
+    int16_t mant = ix & 0x000F;
+    if (iexp > 0) {
+        mant = mant + 16;
+    }
+    mant = (mant << 4) + 0x0008;
+    if (iexp > 1) {
+        mant = mant << (iexp - 1);
+    }
+    return code > 127 ? mant : -mant;
+}
+
+static uint8_t ref_ulaw_compress(int16_t lin)
+{
+    int16_t absno = lin < 0 ? ((~lin) >> 2) + 33 : (lin >> 2) + 33;
+    if (absno > 0x1FFF) {
+        absno = 0x1FFF;
+    }
+    int16_t i = absno >> 6;
+    int16_t segno = 1;
+    while (i != 0) {
+        segno++;
+        i >>= 1;
+    }
+    int16_t high_nibble = 0x0008 - segno;
+    int16_t low_nibble = 0x000F - ((absno >> segno) & 0x000F);
+    int16_t out = (high_nibble << 4) | low_nibble;
+    if (lin >= 0) {
+        out |= 0x0080;
+    }
+    return (uint8_t)out;
+}
+
+static int16_t ref_ulaw_expand(uint8_t code)
+{
+    int16_t sign = code < 0x0080 ? -1 : 1;
+    int16_t mantissa = ~code;
+    int16_t exponent = (mantissa >> 4) & 0x0007;
+    int16_t segment = exponent + 1;
+    mantissa = mantissa & 0x000F;
+    int16_t step = 4 << segment;
+    return sign * ((0x0080 << exponent) + step * mantissa + step / 2 - 4 * 33);
+}
+
+static void test_ulaw_matches_reference(void)
+{
+    for (int32_t s = INT16_MIN; s <= INT16_MAX; s++) {
+        if (g711_ulaw_encode((int16_t)s) != ref_ulaw_compress((int16_t)s)) {
+            CHECK_EQ_INT(g711_ulaw_encode((int16_t)s), ref_ulaw_compress((int16_t)s));
+            printf("  at sample %d\n", (int)s);
+            return;
+        }
+    }
+    for (int code = 0; code < 256; code++) {
+        CHECK_EQ_INT(g711_ulaw_decode((uint8_t)code), ref_ulaw_expand((uint8_t)code));
+    }
+}
+
+static void test_alaw_matches_reference(void)
+{
+    for (int32_t s = INT16_MIN; s <= INT16_MAX; s++) {
+        if (g711_alaw_encode((int16_t)s) != ref_alaw_compress((int16_t)s)) {
+            CHECK_EQ_INT(g711_alaw_encode((int16_t)s), ref_alaw_compress((int16_t)s));
+            printf("  at sample %d\n", (int)s);
+            return;
+        }
+    }
+    for (int code = 0; code < 256; code++) {
+        CHECK_EQ_INT(g711_alaw_decode((uint8_t)code), ref_alaw_expand((uint8_t)code));
+    }
+}
+
+// Decoded values are the centres of their intervals, so they encode back to
+// the same code; μ-law has two zeros and 0x7F (-0) comes back as 0xFF (+0)
+static void test_decoded_values_encode_back(void)
+{
+    for (int code = 0; code < 256; code++) {
+        CHECK_EQ_INT(g711_alaw_encode(g711_alaw_decode((uint8_t)code)), code);
+        if (code != 0x7F) {
+            CHECK_EQ_INT(g711_ulaw_encode(g711_ulaw_decode((uint8_t)code)), code);
+        }
+    }
+    CHECK_EQ_INT(g711_ulaw_encode(g711_ulaw_decode(0x7F)), 0xFF);
+}
+
+static void test_silence_and_extremes(void)
+{
+    CHECK_EQ_INT(g711_ulaw_encode(0), 0xFF);
+    CHECK_EQ_INT(g711_alaw_encode(0), 0xD5);
+    CHECK_EQ_INT(g711_ulaw_encode(INT16_MAX), 0x80);
+    CHECK_EQ_INT(g711_ulaw_encode(INT16_MIN), 0x00);
+    CHECK_EQ_INT(g711_alaw_encode(INT16_MAX), 0xAA);
+    CHECK_EQ_INT(g711_alaw_encode(INT16_MIN), 0x2A);
+    CHECK_EQ_INT(g711_ulaw_decode(0x80), 32124);
+    CHECK_EQ_INT(g711_alaw_decode(0xAA), 32256);
+}
+
+// Odd lengths cover the unrolled decode loop and its tail
+static void test_blocks_match_samples(void)
+{
+    int16_t pcm[163];
+    uint8_t encoded[163];
+    int16_t decoded[163];
+    for (int i = 0; i < 163; i++) {
+        pcm[i] = (int16_t)(i * 397 - 30000);
+    }
+
+    for (int law = G711_ULAW; law <= G711_ALAW; law++) {
+        for (size_t count = 0; count <= 163; count += 7) {
+            memset(encoded, 0x5A, sizeof(encoded));
+            memset(decoded, 0x5A, sizeof(decoded));
+            g711_encode_block((g711_law_t)law, pcm, encoded, count);
+            g711_decode_block((g711_law_t)law, encoded, decoded, count);
+            for (size_t i = 0; i < count; i++) {
+                uint8_t code = law == G711_ALAW ? g711_alaw_encode(pcm[i]) : g711_ulaw_encode(pcm[i]);
+                int16_t sample = law == G711_ALAW ? g711_alaw_decode(code) : g711_ulaw_decode(code);
+                CHECK_EQ_INT(encoded[i], code);
+                CHECK_EQ_INT(decoded[i], sample);
+            }
+            if (count < 163) {
+                CHECK_EQ_INT(encoded[count], 0x5A);
+                CHECK_EQ_INT((uint16_t)decoded[count], 0x5A5A);
+            }
+        }
+    }
+}
+
+static void test_payload_types(void)
+{
+    g711_law_t law = G711_ALAW;
+    CHECK(g711_law_from_payload_type(G711_PT_PCMU, &law));
+    CHECK_EQ_INT(law, G711_ULAW);
+    CHECK(g711_law_from_payload_type(G711_PT_PCMA, &law));
+    CHECK_EQ_INT(law, G711_ALAW);
+    CHECK(!g711_law_from_payload_type(101, &law));
+    CHECK(!g711_law_from_payload_type(18, &law));
+    CHECK_EQ_INT(law, G711_ALAW);
+}
+
+// The codec this replaced in rtp_handler.c, as it was: a μ-law encoder
+// searching the segment bit by bit (on the wrong scale, which makes no
+// difference to its speed), and a per-sample lookup in a 256-entry decode
+// table (filled from the reference here; the old one had two wrong entries)
+static int16_t old_mulaw_decode_table[256];
+
+static __attribute__((noinline)) uint8_t old_linear_to_mulaw(int16_t sample)
+{
+    const uint16_t MULAW_MAX = 0x1FFF;
+    const uint16_t MULAW_BIAS = 33;
+    uint16_t mask = 0x1000;
+    uint8_t sign = (sample < 0) ? 0x80 : 0;
+    uint8_t position = 12;
+    uint8_t lsb = 0;
+
+    if (sign)
+        sample = -sample;
+
+    sample += MULAW_BIAS;
+    if (sample > MULAW_MAX)
+        sample = MULAW_MAX;
+
+    for (; ((sample & mask) != mask && position >= 5); mask >>= 1, position--);
+
+    lsb = (sample >> (position - 4)) & 0x0f;
+    return (~(sign | ((position - 5) << 4) | lsb));
+}
+
+static void old_encode(const int16_t* in, uint8_t* out, size_t count)
+{
+    for (size_t i = 0; i < count; i++) {
+        out[i] = old_linear_to_mulaw(in[i]);
+    }
+}
+
+static void old_decode(const uint8_t* in, int16_t* out, size_t count)
+{
+    for (size_t i = 0; i < count; i++) {
+        out[i] = old_mulaw_decode_table[in[i]];
+    }
+}
+
+#define BENCH_FRAME     160
+#define BENCH_FRAMES    1000
+#define BENCH_RUNS      7
+
+static int16_t bench_pcm[BENCH_FRAME * BENCH_FRAMES];
+static uint8_t bench_codes[BENCH_FRAME * BENCH_FRAMES];
+static int16_t bench_out[BENCH_FRAME * BENCH_FRAMES];
+
+static int64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// Best of several runs over 20 s of speech, one 20 ms frame per call as the
+// media task does it
+static double encode_ns(g711_law_t law, bool old)
+{
+    int64_t best = INT64_MAX;
+    for (int run = 0; run < BENCH_RUNS; run++) {
+        int64_t start = now_ns();
+        for (size_t f = 0; f < BENCH_FRAMES; f++) {
+            size_t at = f * BENCH_FRAME;
+            if (old) {
+                old_encode(bench_pcm + at, bench_codes + at, BENCH_FRAME);
+            } else {
+                g711_encode_block(law, bench_pcm + at, bench_codes + at, BENCH_FRAME);
+            }
+        }
+        int64_t elapsed = now_ns() - start;
+        best = elapsed < best ? elapsed : best;
+    }
+    return (double)best / (BENCH_FRAME * BENCH_FRAMES);
+}
+
+static double decode_ns(g711_law_t law, bool old)
+{
+    int64_t best = INT64_MAX;
+    for (int run = 0; run < BENCH_RUNS; run++) {
+        int64_t start = now_ns();
+        for (size_t f = 0; f < BENCH_FRAMES; f++) {
+            size_t at = f * BENCH_FRAME;
+            if (old) {
+                old_decode(bench_codes + at, bench_out + at, BENCH_FRAME);
+            } else {
+                g711_decode_block(law, bench_codes + at, bench_out + at, BENCH_FRAME);
+            }
+        }
+        int64_t elapsed = now_ns() - start;
+        best = elapsed < best ? elapsed : best;
+    }
+    return (double)best / (BENCH_FRAME * BENCH_FRAMES);
+}
+
+// Reports host ns/sample against the old codec. Timings are only printed:
+// they say how the two compare, not what the ESP32 takes.
+static void test_report_speed_against_old_codec(void)
+{
+    float talker[BENCH_FRAME * BENCH_FRAMES];
+    signal_talker(talker, BENCH_FRAME * BENCH_FRAMES, 120, 4, 0.8);
+    for (size_t i = 0; i < BENCH_FRAME * BENCH_FRAMES; i++) {
+        bench_pcm[i] = signal_to_pcm(talker[i] * 16000);
+    }
+    for (int code = 0; code < 256; code++) {
+        old_mulaw_decode_table[code] = ref_ulaw_expand((uint8_t)code);
+    }
+
+    double old_enc = encode_ns(G711_ULAW, true);
+    double old_dec = decode_ns(G711_ULAW, true);
+    printf("  codec                   encode ns/sample   decode ns/sample\n");
+    printf("  %-22s  %6.2f             %6.2f\n", "old PCMU (per sample)", old_enc, old_dec);
+    for (int law = G711_ULAW; law <= G711_ALAW; law++) {
+        double enc = encode_ns((g711_law_t)law, false);
+        double dec = decode_ns((g711_law_t)law, false);
+        printf("  %-22s  %6.2f  %4.1fx      %6.2f  %4.1fx\n", law == G711_ULAW ? "PCMU block" : "PCMA block",
+               enc, old_enc / enc, dec, old_dec / dec);
+    }
+}
+
+int main(void)
+{
+    RUN_TEST(test_ulaw_matches_reference);
+    RUN_TEST(test_alaw_matches_reference);
+    RUN_TEST(test_decoded_values_encode_back);
+    RUN_TEST(test_silence_and_extremes);
+    RUN_TEST(test_blocks_match_samples);
+    RUN_TEST(test_payload_types);
+    RUN_TEST(test_report_speed_against_old_codec);
+    return TEST_RESULT();
+}
@@ -0,0 +1,364 @@
+#include "jitter_buffer.h"
+#include "test_support.h"
+#include <stdint.h>
+#include <stdbool.h>
+
+// Traces are simulated at 8 kHz with 10 ms playout ticks, as rtp_handler.c
+// runs the buffer. Every payload byte holds the number of the 10 ms frame
+// it belongs to, so the played stream shows whether frames come out
+// complete, in order and on their tick.
+
+#define CLOCK_RATE      8000
+#define FRAME_MS        10
+#define FRAME_SAMPLES   80
+#define MAX_PACKETS     610
+
+typedef struct {
+    uint16_t seq;
+    uint32_t timestamp;
+    uint16_t len;
+    int64_t arrival_us;
+    bool dropped;
+} trace_packet_t;
+
+typedef struct {
+    uint32_t ok;
+    uint32_t missing;
+    uint32_t out_of_order;      // Frames played twice, backwards or torn
+    uint32_t short_frames;
+    uint32_t rebuffers_after_start; // Underruns, the one at the end of the trace included
+    jb_stats_t stats;
+} trace_result_t;
+
+static trace_packet_t packets[MAX_PACKETS];
+
+// Packets of ptime_ms sent back to back; the caller adds delays and drops
+static int make_trace(uint16_t ptime_ms, int count)
+{
+    uint32_t samples = CLOCK_RATE / 1000 * ptime_ms;
+    for (int i = 0; i < count; i++) {
+        packets[i].seq = (uint16_t)(1000 + i);
+        packets[i].timestamp = 50000 + i * samples;
+        packets[i].len = (uint16_t)samples;
+        packets[i].arrival_us = (int64_t)i * ptime_ms * 1000;
+        packets[i].dropped = false;
+    }
+    return count;
+}
+
+static void fill_payload(const trace_packet_t* p, uint8_t* payload)
+{
+    for (uint16_t i = 0; i < p->len; i++) {
+        uint32_t sample = p->timestamp - 50000 + i;
+        payload[i] = (uint8_t)(sample / FRAME_SAMPLES);
+    }
+}
+
+// Deliver packets as they arrive (in arrival order) and pull one frame per
+// 10 ms tick until every packet has had time to play out
+static trace_result_t run_trace(jitter_buffer_t* jb, int count)
+{
+    trace_result_t r = {0};
+    int64_t last_arrival = 0;
+    for (int i = 0; i < count; i++) {
+        if (packets[i].arrival_us > last_arrival) {
+            last_arrival = packets[i].arrival_us;
+        }
+    }
+
+    bool delivered[MAX_PACKETS] = {0};
+    bool started = false;
+    uint8_t previous = 0;
+    for (int64_t now = 0; now <= last_arrival + 500000; now += FRAME_MS * 1000) {
+        for (;;) {
+            int next = -1;
+            for (int i = 0; i < count; i++) {
+                if (!delivered[i] && packets[i].arrival_us <= now &&
+                    (next < 0 || packets[i].arrival_us < packets[next].arrival_us)) {
+                    next = i;
+                }
+            }
+            if (next < 0) {
+                break;
+            }
+            delivered[next] = true;
+            if (packets[next].dropped) {
+                continue;
+            }
+            uint8_t payload[JB_MAX_PACKET_FRAMES * JB_MAX_PAYLOAD];
+            fill_payload(&packets[next], payload);
+            jb_put(jb, packets[next].seq, packets[next].timestamp, 0, payload, packets[next].len,
+                   packets[next].arrival_us);
+        }
+
+        uint8_t frame[JB_MAX_PAYLOAD];
+        size_t len = 0;
+        uint8_t pt = 0xFF;
+        uint32_t rebuffers = jb->stats.rebuffers;
+        jb_result_t result = jb_get(jb, frame, &len, &pt);
+        if (result == JB_FRAME_BUFFERING) {
+            if (jb->stats.rebuffers != rebuffers) {
+                r.rebuffers_after_start++;
+            }
+            continue;
+        }
+        if (result == JB_FRAME_MISSING) {
+            r.missing++;
+            continue;
+        }
+        r.ok++;
+        // Frames come out whole and each one later than the one before
+        if ((started && (int8_t)(frame[0] - previous) <= 0) || frame[len - 1] != frame[0] || pt != 0) {
+            r.out_of_order++;
+        }
+        if (len != FRAME_SAMPLES) {
+            r.short_frames++;
+        }
+        started = true;
+        previous = frame[0];
+    }
+    jb_get_stats(jb, &r.stats);
+    return r;
+}
+
+// Every packetization a peer may use plays out whole: no lost, shed or
+// short frames. The only underruns are one while the jitter estimate
+// settles and the one at the end of the trace.
+static void test_any_ptime_plays_every_frame(void)
+{
+    static const uint16_t ptimes[] = { 10, 20, 30, 40, 60, 120 };
+    for (size_t p = 0; p < sizeof(ptimes) / sizeof(ptimes[0]); p++) {
+        jitter_buffer_t jb;
+        jb_init(&jb, CLOCK_RATE, FRAME_MS);
+        int count = make_trace(ptimes[p], 3000 / ptimes[p]);
+        // A little network jitter, as on any real path
+        for (int i = 0; i < count; i++) {
+            packets[i].arrival_us += (i * 7919 % 5) * 1000;
+        }
+
+        trace_result_t r = run_trace(&jb, count);
+        uint32_t frames = (uint32_t)count * ptimes[p] / FRAME_MS;
+        if (r.ok != frames || r.missing != 0 || r.out_of_order != 0 || r.short_frames != 0 ||
+            r.rebuffers_after_start > 2 || r.stats.discarded != 0 || r.stats.received != (uint32_t)count) {
+            printf("ptime %u ms: ok %u/%u missing %u out of order %u short %u rebuffers %u discarded %u\n",
+                   ptimes[p], (unsigned)r.ok, (unsigned)frames, (unsigned)r.missing,
+                   (unsigned)r.out_of_order, (unsigned)r.short_frames,
+                   (unsigned)r.rebuffers_after_start, (unsigned)r.stats.discarded);
+            test_failures++;
+        }
+    }
+}
+
+// 5 ms packets: two of them fill one buffered frame
+static void test_packets_shorter_than_a_frame(void)
+{
+    jitter_buffer_t jb;
+    jb_init(&jb, CLOCK_RATE, FRAME_MS);
+    int count = make_trace(5, 400);
+    trace_result_t r = run_trace(&jb, count);
+    CHECK_EQ_INT(r.ok, 200);
+    CHECK_EQ_INT(r.missing, 0);
+    CHECK_EQ_INT(r.out_of_order, 0);
+    CHECK_EQ_INT(r.short_frames, 0);
+}
+
+// Reorder trace: every fifth packet swaps with its successor on the way.
+// The first swap comes before any jitter was seen and is late; the delay
+// grows by it and every later swap is put back in order.
+static void test_reorder_trace(void)
+{
+    jitter_buffer_t jb;
+    jb_init(&jb, CLOCK_RATE, FRAME_MS);
+    int count = make_trace(20, 150);
+    for (int i = 5; i + 1 < count; i += 5) {
+        int64_t t = packets[i].arrival_us;
+        packets[i].arrival_us = packets[i + 1].arrival_us + 1000;
+        packets[i + 1].arrival_us = t;
+    }
+
+    trace_result_t r = run_trace(&jb, count);
+    CHECK_EQ_INT(r.stats.late, 1);
+    CHECK_EQ_INT(r.ok, 300 - 2);
+    CHECK_EQ_INT(r.out_of_order, 0);
+    CHECK(r.missing <= 10);
+}
+
+// Loss trace: single losses and a burst of three 40 ms packets. Each loss
+// costs exactly the frames of the lost packets, played as a gap (a
+// missing frame, or an underrun when nothing else is buffered).
+static void test_loss_trace(void)
+{
+    jitter_buffer_t jb;
+    jb_init(&jb, CLOCK_RATE, FRAME_MS);
+    int count = make_trace(40, 100);
+    static const int lost[] = { 10, 33, 60, 61, 62 };
+    for (size_t i = 0; i < sizeof(lost) / sizeof(lost[0]); i++) {
+        packets[lost[i]].dropped = true;
+    }
+
+    trace_result_t r = run_trace(&jb, count);
+    CHECK_EQ_INT(r.ok, (100 - 5) * 4);
+    CHECK_EQ_INT(r.out_of_order, 0);
+    CHECK_EQ_INT(r.stats.received, 100 - 5);
+    CHECK_EQ_INT(r.stats.late, 0);
+}
+
+// A packet that turns up after its frames were played is counted late;
+// one that repeats a packet is discarded
+static void test_late_and_duplicate(void)
+{
+    jitter_buffer_t jb;
+    jb_init(&jb, CLOCK_RATE, FRAME_MS);
+    int count = make_trace(20, 100);
+    packets[20].arrival_us += 300000;
+    packets[count] = packets[40];
+    packets[count].arrival_us += 2000;
+    count++;
+
+    trace_result_t r = run_trace(&jb, count);
+    CHECK_EQ_INT(r.stats.late, 1);
+    CHECK_EQ_INT(r.stats.discarded, 1);
+    CHECK_EQ_INT(r.ok, 99 * 2);
+    CHECK_EQ_INT(r.out_of_order, 0);
+}
+
+// A copy of a packet that turns up after its frames were played is a
+// duplicate, not a late packet: the playout delay stays where it was
+static void test_duplicate_after_playout(void)
+{
+    jitter_buffer_t jb;
+    jb_init(&jb, CLOCK_RATE, FRAME_MS);
+    int count = make_trace(20, 100);
+    trace_result_t clean = run_trace(&jb, count);
+
+    jb_init(&jb, CLOCK_RATE, FRAME_MS);
+    packets[count] = packets[30];
+    packets[count].arrival_us += 200000;
+    count++;
+    trace_result_t r = run_trace(&jb, count);
+    CHECK_EQ_INT(r.stats.late, 0);
+    CHECK_EQ_INT(r.stats.discarded, 1);
+    CHECK_EQ_INT(r.stats.received, 100);
+    CHECK_EQ_INT(r.stats.target_delay_ms, clean.stats.target_delay_ms);
+    CHECK_EQ_INT(r.ok, clean.ok);
+    CHECK_EQ_INT(r.missing, 0);
+}
+
+// Steady jitter raises the playout delay to cover it, within the ring
+static void test_delay_follows_jitter(void)
+{
+    jitter_buffer_t jb;
+    jb_init(&jb, CLOCK_RATE, FRAME_MS);
+    int count = make_trace(20, 300);
+    for (int i = 0; i < count; i++) {
+        packets[i].arrival_us += (i % 2) ? 30000 : 0;
+    }
+
+    trace_result_t r = run_trace(&jb, count);
+    CHECK(r.stats.target_delay_ms >= 50);
+    CHECK(r.stats.target_delay_ms <= JB_MAX_DELAY_FRAMES * FRAME_MS);
+    CHECK_EQ_INT(r.out_of_order, 0);
+    CHECK(r.stats.late <= 2);
+    CHECK(r.ok >= 600 - 2 * 2);
+}
+
+static uint32_t trace_random(uint32_t* state)
+{
+    *state = *state * 1103515245u + 12345u;
+    return *state >> 8;
+}
+
+// Burst traces over a WiFi-like path: random delay up to max_jitter_ms,
+// plus every 50th packet held back with the next few queued behind it.
+// Reports the playout delay the buffer settled on against what was lost,
+// and checks the trade stays sensible.
+static void test_report_delay_against_loss(void)
+{
+    static const uint16_t jitters[] = { 0, 10, 30, 60, 100 };
+    static const uint16_t ptimes[] = { 20, 60 };
+    printf("  ptime  jitter  delay   played  lost+late  rebuffers\n");
+    for (size_t p = 0; p < sizeof(ptimes) / sizeof(ptimes[0]); p++) {
+        for (size_t j = 0; j < sizeof(jitters) / sizeof(jitters[0]); j++) {
+            jitter_buffer_t jb;
+            jb_init(&jb, CLOCK_RATE, FRAME_MS);
+            int count = make_trace(ptimes[p], 6000 / ptimes[p]);
+            uint32_t rng = 1 + (uint32_t)(p * 7 + j);
+            for (int i = 0; i < count; i++) {
+                if (jitters[j] > 0) {
+                    packets[i].arrival_us += (int64_t)(trace_random(&rng) % (jitters[j] * 1000u));
+                }
+                if (i % 50 == 49) {
+                    // Burst: this and the next packets arrive together
+                    for (int k = i; k < i + 3 && k < count; k++) {
+                        packets[k].arrival_us = packets[i].arrival_us + jitters[j] * 1000;
+                    }
+                    i += 2;
+                }
+            }
+
+            trace_result_t r = run_trace(&jb, count);
+            uint32_t frames = (uint32_t)count * ptimes[p] / FRAME_MS;
+            uint32_t lost_pct10 = (frames - r.ok) * 1000 / frames;
+            printf("  %3u ms  %3u ms  %3u ms  %5u  %3u.%u%%    %u\n", ptimes[p], jitters[j],
+                   r.stats.target_delay_ms, (unsigned)r.ok, (unsigned)(lost_pct10 / 10),
+                   (unsigned)(lost_pct10 % 10), (unsigned)r.rebuffers_after_start);
+            CHECK_EQ_INT(r.out_of_order, 0);
+            // Delay stays within two packets plus three times the jitter,
+            // and bursts cost no more than a few percent of the frames
+            CHECK(r.stats.target_delay_ms <= 2 * ptimes[p] + 3 * jitters[j] + 20);
+            CHECK(lost_pct10 <= 50);
+        }
+    }
+}
+
+// A sender that restarts its timestamps is followed instead of being
+// taken for a burst of lost frames
+static void test_timestamp_jump_resets(void)
+{
+    jitter_buffer_t jb;
+    jb_init(&jb, CLOCK_RATE, FRAME_MS);
+    int count = make_trace(20, 100);
+    for (int i = 50; i < count; i++) {
+        packets[i].timestamp += 0x40000000;
+    }
+
+    uint8_t payload[160];
+    memset(payload, 0, sizeof(payload));
+    for (int i = 0; i < count; i++) {
+        jb_put(&jb, packets[i].seq, packets[i].timestamp, 0, payload, packets[i].len, packets[i].arrival_us);
+        uint8_t frame[JB_MAX_PAYLOAD];
+        size_t len;
+        jb_get(&jb, frame, &len, NULL);
+        jb_get(&jb, frame, &len, NULL);
+    }
+    jb_stats_t stats;
+    jb_get_stats(&jb, &stats);
+    CHECK_EQ_INT(stats.received, count);
+    CHECK(stats.lost < 4);
+}
+
+static void test_rejects_empty_and_oversized(void)
+{
+    jitter_buffer_t jb;
+    jb_init(&jb, CLOCK_RATE, FRAME_MS);
+    static uint8_t payload[(JB_MAX_PACKET_FRAMES + 1) * JB_MAX_PAYLOAD];
+    CHECK(!jb_put(&jb, 1, 0, 0, payload, 0, 0));
+    CHECK(!jb_put(&jb, 1, 0, 0, payload, (JB_MAX_PACKET_FRAMES + 1) * FRAME_SAMPLES, 0));
+    CHECK(jb_put(&jb, 1, 0, 0, payload, JB_MAX_PACKET_FRAMES * FRAME_SAMPLES, 0));
+    CHECK_EQ_INT(jb.stats.discarded, 2);
+}
+
+int main(void)
+{
+    RUN_TEST(test_any_ptime_plays_every_frame);
+    RUN_TEST(test_packets_shorter_than_a_frame);
+    RUN_TEST(test_reorder_trace);
+    RUN_TEST(test_loss_trace);
+    RUN_TEST(test_late_and_duplicate);
+    RUN_TEST(test_duplicate_after_playout);
+    RUN_TEST(test_delay_follows_jitter);
+    RUN_TEST(test_report_delay_against_loss);
+    RUN_TEST(test_timestamp_jump_resets);
+    RUN_TEST(test_rejects_empty_and_oversized);
+    return TEST_RESULT();
+}
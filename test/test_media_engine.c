@@ -0,0 +1,338 @@
+#include "media_engine.h"
+#include "audio_handler.h"
+#include "rtp_handler.h"
+#include "g711.h"
+#include "nvs.h"
+#include "esp_heap_trace.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "test_support.h"
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+
+// A call against a remote on loopback UDP, on the simulated clock. Each
+// frame the remote sends what the network delivers before the next tick,
+// then time moves on by 20 ms: the pacing timer wakes the media task, and
+// the test waits for its pass to finish and collects what the engine sent.
+
+#define START_US        1000000
+#define STEP_US         (MEDIA_FRAME_MS * 1000)
+#define REMOTE_SSRC     0x5EED0001u
+#define MAX_SENT        4000
+
+typedef struct {
+    int sock;
+    uint16_t port;
+    uint16_t local_port;        // The engine's RTP port
+    uint16_t next_seq;          // Next packet the remote sends
+    uint32_t jitter_ms;         // Network delay of its packets: 0..jitter_ms
+    int received;
+    int64_t arrival_us[MAX_SENT];
+    uint16_t seq[MAX_SENT];
+    uint32_t timestamp[MAX_SENT];
+    uint16_t payload_len[MAX_SENT];
+    uint8_t payload_type[MAX_SENT];
+} remote_t;
+
+static remote_t remote;
+static TaskHandle_t media_task;
+static uint32_t jitter_seed = 99;
+
+static uint16_t bound_port(int sock)
+{
+    struct sockaddr_in addr;
+    socklen_t len = sizeof(addr);
+    getsockname(sock, (struct sockaddr*)&addr, &len);
+    return ntohs(addr.sin_port);
+}
+
+static int open_socket(uint16_t port)
+{
+    int sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    struct sockaddr_in addr = { .sin_family = AF_INET, .sin_port = htons(port) };
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(sock, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+        close(sock);
+        return -1;
+    }
+    fcntl(sock, F_SETFL, fcntl(sock, F_GETFL, 0) | O_NONBLOCK);
+    return sock;
+}
+
+static void put32(uint8_t* p, uint32_t v)
+{
+    p[0] = v >> 24;
+    p[1] = v >> 16;
+    p[2] = v >> 8;
+    p[3] = v;
+}
+
+static uint32_t get32(const uint8_t* p)
+{
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static uint32_t network_delay_ms(void)
+{
+    jitter_seed = jitter_seed * 1664525u + 1013904223u;
+    return remote.jitter_ms ? (jitter_seed >> 8) % (remote.jitter_ms + 1) : 0;
+}
+
+static void start_call(uint32_t jitter_ms)
+{
+    memset(&remote, 0, sizeof(remote));
+    remote.sock = open_socket(0);
+    remote.port = bound_port(remote.sock);
+    int probe = open_socket(0);
+    remote.local_port = bound_port(probe);
+    close(probe);
+    remote.jitter_ms = jitter_ms;
+    CHECK(media_engine_start("127.0.0.1", remote.port, remote.local_port));
+    media_task = host_task_find("media_task");
+    CHECK(media_task != NULL);
+}
+
+// A 20 ms PCMU packet of a 400 Hz tone
+static void remote_send(uint16_t seq)
+{
+    uint8_t packet[12 + MEDIA_FRAME_SAMPLES];
+    uint32_t ts = 3000 + (uint32_t)seq * MEDIA_FRAME_SAMPLES;
+    packet[0] = 0x80;
+    packet[1] = G711_PT_PCMU;
+    packet[2] = seq >> 8;
+    packet[3] = seq;
+    put32(packet + 4, ts);
+    put32(packet + 8, REMOTE_SSRC);
+    int16_t pcm[MEDIA_FRAME_SAMPLES];
+    for (int i = 0; i < MEDIA_FRAME_SAMPLES; i++) {
+        pcm[i] = (int16_t)(8000 * sin(2 * M_PI * 400 * (ts + i) / 8000.0));
+    }
+    g711_encode_block(G711_ULAW, pcm, packet + 12, MEDIA_FRAME_SAMPLES);
+
+    struct sockaddr_in addr = { .sin_family = AF_INET, .sin_port = htons(remote.local_port) };
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    sendto(remote.sock, packet, sizeof(packet), 0, (struct sockaddr*)&addr, sizeof(addr));
+}
+
+static void remote_collect(void)
+{
+    uint8_t packet[RTP_PACKET_MAX_SIZE];
+    int len;
+    while ((len = (int)recv(remote.sock, packet, sizeof(packet), 0)) > 0) {
+        uint8_t pt = packet[1] & 0x7F;
+        if (len < 12 || (pt != G711_PT_PCMU && pt != G711_PT_PCMA) || remote.received >= MAX_SENT) {
+            continue;
+        }
+        int i = remote.received++;
+        remote.arrival_us[i] = esp_timer_get_time();
+        remote.seq[i] = (uint16_t)((packet[2] << 8) | packet[3]);
+        remote.timestamp[i] = get32(packet + 4);
+        remote.payload_len[i] = (uint16_t)(len - 12);
+        remote.payload_type[i] = pt;
+    }
+}
+
+// Move time on by @p us and let the media task run the ticks that fell due.
+// Timers due within one step all fire before the task gets to run.
+static void step(int64_t us)
+{
+    host_clock_advance(us);
+    host_task_wait_blocked(media_task);
+    remote_collect();
+}
+
+// Run the call for @p frames ticks; the remote sends one packet per frame
+// unless @p remote_sends is false. Packets leave the remote on the frame
+// clock and arrive up to jitter_ms later.
+static void run(int frames, bool remote_sends)
+{
+    static int64_t due_us[MAX_SENT];
+    int64_t start = esp_timer_get_time();
+    int queued = 0;
+    int delivered = 0;
+    for (int f = 0; f < frames; f++) {
+        if (remote_sends && queued < MAX_SENT) {
+            due_us[queued] = start + (int64_t)f * STEP_US + network_delay_ms() * 1000;
+            queued++;
+        }
+
+        // Whatever arrives before the next tick; late packets overtaken by
+        // earlier ones arrive out of order
+        int64_t tick = esp_timer_get_time() + STEP_US;
+        for (int i = delivered; i < queued; i++) {
+            if (due_us[i] <= tick && due_us[i] != INT64_MAX) {
+                remote_send((uint16_t)(remote.next_seq + i));
+                due_us[i] = INT64_MAX;
+            }
+        }
+        while (delivered < queued && due_us[delivered] == INT64_MAX) {
+            delivered++;
+        }
+        step(STEP_US);
+    }
+    remote.next_seq += (uint16_t)queued;
+}
+
+static void end_call(void)
+{
+    media_engine_stop();
+    close(remote.sock);
+}
+
+// 50 packets a second each way, on a 20 ms grid, with no gaps in sequence
+// or timestamp, while the remote's packets arrive with up to 30 ms of jitter
+static void test_fifty_packets_each_way(void)
+{
+    const int seconds = 60;
+    start_call(30);
+    run(seconds * 50, true);
+
+    // Sent: one packet per tick, every simulated second
+    CHECK_EQ_INT(remote.received, seconds * 50);
+    for (int s = 0; s < seconds; s++) {
+        int in_second = 0;
+        for (int i = 0; i < remote.received; i++) {
+            int64_t t = remote.arrival_us[i] - START_US - STEP_US;
+            in_second += t >= (int64_t)s * 1000000 && t < (int64_t)(s + 1) * 1000000;
+        }
+        CHECK_EQ_INT(in_second, 50);
+    }
+    int64_t worst_gap_error = 0;
+    for (int i = 1; i < remote.received; i++) {
+        int64_t gap_error = llabs(remote.arrival_us[i] - remote.arrival_us[i - 1] - STEP_US);
+        worst_gap_error = gap_error > worst_gap_error ? gap_error : worst_gap_error;
+        CHECK_EQ_INT((uint16_t)(remote.seq[i] - remote.seq[i - 1]), 1);
+        CHECK_EQ_INT(remote.timestamp[i] - remote.timestamp[i - 1], MEDIA_FRAME_SAMPLES);
+        CHECK_EQ_INT(remote.payload_len[i], MEDIA_FRAME_SAMPLES);
+    }
+
+    // Received: everything played out once the jitter buffer has filled
+    media_engine_stats_t stats;
+    media_engine_get_stats(&stats);
+    rtp_stats_t rtp;
+    rtp_get_stats(&rtp);
+    printf("  sent %lu, played %lu of %d, jitter buffer %u ms, late %lu, tick jitter %lu us\n",
+           (unsigned long)stats.frames_sent, (unsigned long)stats.frames_received, seconds * 50,
+           rtp.jitter_buffer.target_delay_ms, (unsigned long)rtp.jitter_buffer.late,
+           (unsigned long)stats.max_tick_jitter_us);
+    CHECK(worst_gap_error <= 1000);
+    CHECK_EQ_INT(stats.frames_sent, seconds * 50);
+    CHECK_EQ_INT(stats.send_errors, 0);
+    CHECK_EQ_INT(stats.capture_underruns, 0);
+    CHECK_EQ_INT(stats.missed_ticks, 0);
+    CHECK(stats.max_tick_jitter_us <= 1000);
+    CHECK_EQ_INT(rtp.packets_received, seconds * 50);
+    CHECK(stats.frames_received + 10 >= (uint32_t)seconds * 50);
+    CHECK(rtp.jitter_buffer.late <= (uint32_t)seconds);
+    CHECK(media_engine_get_last_rx_ms() + 100 >= (uint32_t)(START_US / 1000 + seconds * 1000));
+    end_call();
+    CHECK(!media_engine_is_running());
+}
+
+// Once the call is up, a minute of audio both ways, with a DTMF digit
+// every five seconds, never touches the heap: packets come from the RTP
+// pool and every buffer on the media path is static
+static void test_call_makes_no_allocations(void)
+{
+    start_call(30);
+    run(50, true);
+
+    heap_trace_start(HEAP_TRACE_ALL);
+    for (int s = 0; s < 60; s++) {
+        if (s % 5 == 0) {
+            CHECK(rtp_send_dtmf('0' + s / 5 % 10) > 0);
+        }
+        run(50, true);
+    }
+    heap_trace_stop();
+
+    media_engine_stats_t stats;
+    media_engine_get_stats(&stats);
+    printf("  %lu frames sent, %zu allocations, %zu frees\n", (unsigned long)stats.frames_sent,
+           heap_trace_get_count(), host_heap_trace_get_frees());
+    CHECK_EQ_INT(stats.frames_sent, 61 * 50);
+    CHECK(stats.frames_received >= 60 * 50);
+    CHECK_EQ_INT(heap_trace_get_count(), 0);
+    CHECK_EQ_INT(host_heap_trace_get_frees(), 0);
+    end_call();
+}
+
+// 40 ms packets: two frames per packet, 25 packets a second
+static void test_ptime_40(void)
+{
+    media_engine_set_codec(G711_PT_PCMA, 101, 40);
+    start_call(0);
+    run(500, true);
+
+    CHECK_EQ_INT(remote.received, 250);
+    for (int i = 1; i < remote.received; i++) {
+        CHECK_EQ_INT(remote.arrival_us[i] - remote.arrival_us[i - 1], 2 * STEP_US);
+        CHECK_EQ_INT(remote.timestamp[i] - remote.timestamp[i - 1], 2 * MEDIA_FRAME_SAMPLES);
+        CHECK_EQ_INT(remote.payload_len[i], 2 * MEDIA_FRAME_SAMPLES);
+        CHECK_EQ_INT(remote.payload_type[i], G711_PT_PCMA);
+    }
+    media_engine_stats_t stats;
+    media_engine_get_stats(&stats);
+    CHECK_EQ_INT(stats.frames_sent, 250);
+    end_call();
+}
+
+// A tick that comes 40 ms late is counted as missed and as tick jitter;
+// the pipeline then goes on at 50 packets a second
+static void test_missed_ticks(void)
+{
+    start_call(0);
+    run(50, true);
+    step(3 * STEP_US);
+    run(50, true);
+
+    media_engine_stats_t stats;
+    media_engine_get_stats(&stats);
+    CHECK_EQ_INT(stats.missed_ticks, 2);
+    CHECK_EQ_INT(stats.max_tick_jitter_us, 2 * STEP_US);
+    CHECK_EQ_INT(remote.received, 100 + 1);
+    end_call();
+}
+
+// Early media: the remote is played out, nothing is sent; the answer
+// turns sending on without restarting the engine
+static void test_receive_only_then_answer(void)
+{
+    media_engine_set_direction(MEDIA_DIR_RECVONLY);
+    start_call(0);
+    run(100, true);
+    CHECK_EQ_INT(remote.received, 0);
+    media_engine_stats_t stats;
+    media_engine_get_stats(&stats);
+    CHECK(stats.frames_received >= 90);
+
+    media_engine_set_direction(MEDIA_DIR_SENDRECV);
+    run(100, true);
+    CHECK_EQ_INT(remote.received, 100);
+    end_call();
+}
+
+int main(void)
+{
+    setvbuf(stdout, NULL, _IOLBF, 0);
+    host_clock_simulate(START_US);
+    audio_handler_init();
+    rtp_init();
+    media_engine_init();
+
+    RUN_TEST(test_fifty_packets_each_way);
+    RUN_TEST(test_call_makes_no_allocations);
+    RUN_TEST(test_ptime_40);
+    RUN_TEST(test_missed_ticks);
+    RUN_TEST(test_receive_only_then_answer);
+    return TEST_RESULT();
+}
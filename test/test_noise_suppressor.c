@@ -0,0 +1,232 @@
+#include "noise_suppressor.h"
+#include "test_signals.h"
+#include "test_support.h"
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+// 20 s of synthetic speech peaking near -12 dBFS, mixed with one of three
+// door-station backgrounds at a given SNR. Output is compared with the
+// clean speech and the noise NS_HOP_SAMPLES earlier; the first second is
+// left out while the noise estimate settles.
+
+#define SECONDS         20
+#define SAMPLES         (SECONDS * SIGNAL_RATE)
+#define SETTLE          SIGNAL_RATE
+
+typedef enum {
+    NOISE_WIND,
+    NOISE_TRAFFIC,
+    NOISE_FAN_HUM,
+} noise_kind_t;
+
+static float speech[SAMPLES];
+static float noise[SAMPLES];
+static int16_t in[SAMPLES];
+static int16_t out[SAMPLES];
+static ns_t ns;
+
+// Wind: low-passed rumble in slow gusts. Traffic: lower rumble with a car
+// passing every 7 s. Fan and hum: white noise plus 150 and 300 Hz.
+static void make_noise(noise_kind_t kind)
+{
+    signal_srand(100 + kind);
+    double lp = 0;
+    double lp2 = 0;
+    for (size_t i = 0; i < SAMPLES; i++) {
+        double t = i / (double)SIGNAL_RATE;
+        double w = signal_noise();
+        if (kind == NOISE_WIND) {
+            lp += 0.05 * (w - lp);
+            lp2 += 0.05 * (lp - lp2);
+            double gust = 0.6 + 0.4 * sin(2 * M_PI * 0.3 * t) * sin(2 * M_PI * 0.07 * t + 1);
+            noise[i] = (float)(lp2 * gust * 8);
+        } else if (kind == NOISE_TRAFFIC) {
+            lp += 0.02 * (w - lp);
+            double car = 1 + 1.5 * exp(-pow(fmod(t, 7) - 3.5, 2) / 1.5);
+            noise[i] = (float)((lp * 6 + 0.15 * w) * car);
+        } else {
+            noise[i] = (float)(0.5 * w + 0.3 * sin(2 * M_PI * 150 * t) + 0.2 * sin(2 * M_PI * 300 * t));
+        }
+    }
+}
+
+static double float_energy(const float* x, size_t from, size_t to)
+{
+    double sum = 0;
+    for (size_t i = from; i < to; i++) {
+        sum += (double)x[i] * x[i];
+    }
+    return sum;
+}
+
+// Speech plus @p kind noise at @p snr_db, run through the suppressor
+static void run(noise_kind_t kind, double snr_db)
+{
+    make_noise(kind);
+    double k = sqrt(float_energy(speech, SETTLE, SAMPLES) / float_energy(noise, SETTLE, SAMPLES) /
+                    pow(10, snr_db / 10));
+    for (size_t i = 0; i < SAMPLES; i++) {
+        noise[i] *= (float)k;
+        in[i] = signal_to_pcm(speech[i] + noise[i]);
+    }
+    ns_init(&ns, true);
+    for (size_t at = 0; at + NS_FRAME_SAMPLES <= SAMPLES; at += NS_FRAME_SAMPLES) {
+        ns_process(&ns, in + at, out + at, NS_FRAME_SAMPLES);
+    }
+}
+
+// Output SNR against the delayed clean speech
+static double output_snr_db(void)
+{
+    double signal = 0;
+    double error = 0;
+    for (size_t i = SETTLE; i < SAMPLES; i++) {
+        double s = speech[i - NS_HOP_SAMPLES];
+        signal += s * s;
+        error += (out[i] - s) * (out[i] - s);
+    }
+    return signal_db(signal, error);
+}
+
+// Output relative to input over frames where nobody talks
+static double pause_noise_db(void)
+{
+    double before = 0;
+    double after = 0;
+    for (size_t at = SETTLE; at + NS_FRAME_SAMPLES <= SAMPLES; at += NS_FRAME_SAMPLES) {
+        size_t from = at - NS_HOP_SAMPLES;
+        if (float_energy(speech, from, from + NS_FRAME_SAMPLES) == 0) {
+            before += float_energy(noise, from, from + NS_FRAME_SAMPLES);
+            after += signal_energy(out, at, at + NS_FRAME_SAMPLES);
+        }
+    }
+    return signal_db(after, before);
+}
+
+static void test_noise_reduction(void)
+{
+    static const char* names[] = { "wind", "traffic", "fan+hum" };
+    for (int kind = NOISE_WIND; kind <= NOISE_FAN_HUM; kind++) {
+        for (int snr = 0; snr <= 10; snr += 5) {
+            run((noise_kind_t)kind, snr);
+            double gain = output_snr_db() - snr;
+            double pauses = pause_noise_db();
+            printf("  %-8s SNR %2d dB: %+5.1f dB, noise in pauses %5.1f dB\n", names[kind], snr, gain, pauses);
+            CHECK(gain >= 4.0);
+            CHECK(pauses <= -8.0);
+
+            // Never more than the gain floor
+            ns_stats_t stats;
+            ns_get_stats(&ns, &stats);
+            CHECK(stats.attenuation_db >= -15.0f);
+            CHECK(stats.attenuation_db <= 0.0f);
+        }
+    }
+}
+
+// White noise at a known level: the floor estimate reads it back
+static void test_noise_floor_estimate(void)
+{
+    for (int level = -60; level <= -20; level += 20) {
+        // Uniform noise has an RMS of 1/sqrt(3)
+        double amplitude = pow(10, level / 20.0) * 32768 * sqrt(3);
+        signal_srand(21);
+        ns_init(&ns, true);
+        for (size_t at = 0; at + NS_FRAME_SAMPLES <= 5 * SIGNAL_RATE; at += NS_FRAME_SAMPLES) {
+            for (size_t i = 0; i < NS_FRAME_SAMPLES; i++) {
+                in[at + i] = signal_to_pcm(signal_noise() * amplitude);
+            }
+            ns_process(&ns, in + at, out + at, NS_FRAME_SAMPLES);
+        }
+        ns_stats_t stats;
+        ns_get_stats(&ns, &stats);
+        printf("  %d dBFS noise: floor %.1f dBFS, attenuation %.1f dB\n", level, stats.noise_floor_db,
+               stats.attenuation_db);
+        CHECK(fabsf(stats.noise_floor_db - level) <= 1.5f);
+        CHECK(stats.attenuation_db <= -12.0f);
+        CHECK_EQ_INT(stats.hops, 5 * SIGNAL_RATE / NS_HOP_SAMPLES);
+    }
+}
+
+// A tone far above the noise comes through unchanged, NS_HOP_SAMPLES late
+static void test_clean_signal_delayed(void)
+{
+    signal_srand(33);
+    for (size_t i = 0; i < SAMPLES; i++) {
+        double t = i / (double)SIGNAL_RATE;
+        // A second of quiet noise to learn from, then a sweep over it
+        double tone = i < SETTLE ? 0 : 10000 * sin(2 * M_PI * (300 + 80 * t) * t);
+        in[i] = signal_to_pcm(tone + signal_noise() * 30);
+    }
+    ns_init(&ns, true);
+    for (size_t at = 0; at + NS_FRAME_SAMPLES <= SAMPLES; at += NS_FRAME_SAMPLES) {
+        ns_process(&ns, in + at, out + at, NS_FRAME_SAMPLES);
+    }
+
+    double best_db = -100;
+    int best_delay = -1;
+    for (int delay = 0; delay <= 2 * NS_HOP_SAMPLES; delay++) {
+        double signal = 0;
+        double error = 0;
+        for (size_t i = 2 * SETTLE; i < SAMPLES; i++) {
+            signal += (double)in[i - delay] * in[i - delay];
+            error += (double)(out[i] - in[i - delay]) * (out[i] - in[i - delay]);
+        }
+        if (signal_db(signal, error) > best_db) {
+            best_db = signal_db(signal, error);
+            best_delay = delay;
+        }
+    }
+    printf("  delay %d samples, %.1f dB from the input\n", best_delay, best_db);
+    CHECK_EQ_INT(best_delay, NS_HOP_SAMPLES);
+    CHECK(best_db >= 25.0);
+}
+
+static void test_silence_and_passthrough(void)
+{
+    // Digital silence stays silent
+    memset(in, 0, sizeof(in));
+    ns_init(&ns, true);
+    for (size_t at = 0; at + NS_FRAME_SAMPLES <= 2 * SIGNAL_RATE; at += NS_FRAME_SAMPLES) {
+        ns_process(&ns, in + at, out + at, NS_FRAME_SAMPLES);
+    }
+    CHECK(signal_energy(out, 0, 2 * SIGNAL_RATE) == 0);
+    ns_stats_t stats;
+    ns_get_stats(&ns, &stats);
+    CHECK(stats.noise_floor_db <= -90.0f);
+    CHECK(!isnan(stats.attenuation_db));
+
+    // Disabled: unchanged and undelayed
+    for (size_t i = 0; i < NS_FRAME_SAMPLES; i++) {
+        in[i] = (int16_t)(i * 97);
+    }
+    ns_init(&ns, false);
+    ns_process(&ns, in, out, NS_FRAME_SAMPLES);
+    CHECK(memcmp(in, out, NS_FRAME_SAMPLES * sizeof(int16_t)) == 0);
+
+    // Enabled: a partial hop at the end passes through, in place too
+    ns_init(&ns, true);
+    memcpy(out, in, NS_FRAME_SAMPLES * sizeof(int16_t));
+    ns_process(&ns, out, out, NS_HOP_SAMPLES + 30);
+    CHECK(memcmp(out + NS_HOP_SAMPLES, in + NS_HOP_SAMPLES, 30 * sizeof(int16_t)) == 0);
+    ns_get_stats(&ns, &stats);
+    CHECK_EQ_INT(stats.hops, 1);
+}
+
+int main(void)
+{
+    signal_talker(speech, SAMPLES, 170, 11, 0.75);
+    for (size_t i = 0; i < SAMPLES; i++) {
+        speech[i] *= 8000;
+    }
+
+    setvbuf(stdout, NULL, _IOLBF, 0);
+    RUN_TEST(test_noise_reduction);
+    RUN_TEST(test_noise_floor_estimate);
+    RUN_TEST(test_clean_signal_delayed);
+    RUN_TEST(test_silence_and_passthrough);
+    return TEST_RESULT();
+}
@@ -0,0 +1,440 @@
+#include "rtcp.h"
+#include "test_support.h"
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <math.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+
+// Reports go over real UDP sockets on the loopback interface; the test plays
+// the remote end with its own socket. Times are synthetic esp_timer values.
+
+#define LOCAL_SSRC      0x11223344u
+#define REMOTE_SSRC     0xCAFEF00Du
+#define CLOCK_RATE      8000
+#define START_US        1000000
+
+typedef struct {
+    int sock;
+    uint16_t port;                  // The remote's RTCP port
+    uint16_t local_port;            // Ours
+} peer_t;
+
+static uint16_t bound_port(int sock)
+{
+    struct sockaddr_in addr;
+    socklen_t len = sizeof(addr);
+    getsockname(sock, (struct sockaddr*)&addr, &len);
+    return ntohs(addr.sin_port);
+}
+
+static int open_socket(uint16_t port)
+{
+    int sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    struct sockaddr_in addr = { .sin_family = AF_INET, .sin_port = htons(port) };
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    struct timeval tv = { .tv_sec = 1 };
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    if (bind(sock, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+        close(sock);
+        return -1;
+    }
+    return sock;
+}
+
+// The remote's socket, and a free port for ours
+static bool start_call(peer_t* peer, int64_t now_us)
+{
+    peer->sock = open_socket(0);
+    int probe = open_socket(0);
+    if (peer->sock < 0 || probe < 0) {
+        return false;
+    }
+    peer->port = bound_port(peer->sock);
+    peer->local_port = bound_port(probe);
+    close(probe);
+    return rtcp_start("127.0.0.1", peer->port, peer->local_port, LOCAL_SSRC, CLOCK_RATE, now_us);
+}
+
+static void end_call(peer_t* peer, int64_t now_us)
+{
+    rtcp_stop(now_us);
+    close(peer->sock);
+}
+
+static int peer_receive(peer_t* peer, uint8_t* buf, size_t size)
+{
+    return (int)recv(peer->sock, buf, size, 0);
+}
+
+static void peer_send(peer_t* peer, const uint8_t* buf, size_t len)
+{
+    struct sockaddr_in addr = { .sin_family = AF_INET, .sin_port = htons(peer->local_port) };
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    sendto(peer->sock, buf, len, 0, (struct sockaddr*)&addr, sizeof(addr));
+}
+
+static void put32(uint8_t* p, uint32_t v)
+{
+    p[0] = v >> 24;
+    p[1] = v >> 16;
+    p[2] = v >> 8;
+    p[3] = v;
+}
+
+static uint32_t get32(const uint8_t* p)
+{
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+// Poll until the next report goes out; the interval is randomised
+static int64_t poll_until_report(int64_t now_us, uint32_t playout_delay_ms)
+{
+    rtcp_quality_t q;
+    rtcp_get_quality(&q);
+    uint32_t sent = q.reports_sent;
+    for (int i = 0; i < 1000 && q.reports_sent == sent; i++) {
+        now_us += 20000;
+        rtcp_poll(now_us, playout_delay_ms);
+        rtcp_get_quality(&q);
+    }
+    return now_us;
+}
+
+// The remote's receiver report about our stream: one block with the given
+// loss, jitter and LSR/DLSR
+static size_t build_rr(uint8_t* p, uint8_t fraction, int32_t lost, uint32_t jitter, uint32_t lsr, uint32_t dlsr)
+{
+    p[0] = 0x81;
+    p[1] = RTCP_PT_RR;
+    p[2] = 0;
+    p[3] = 7;
+    put32(p + 4, REMOTE_SSRC);
+    put32(p + 8, LOCAL_SSRC);
+    put32(p + 12, ((uint32_t)fraction << 24) | ((uint32_t)lost & 0xFFFFFF));
+    put32(p + 16, 1000);
+    put32(p + 20, jitter);
+    put32(p + 24, lsr);
+    put32(p + 28, dlsr);
+    return 32;
+}
+
+static void test_mos_estimate(void)
+{
+    float best = rtcp_mos_estimate(0, 0.0f);
+    CHECK(best > 4.40f && best < 4.42f);
+
+    // Worse with every millisecond and every lost packet
+    float previous = best;
+    for (uint32_t delay = 50; delay <= 600; delay += 50) {
+        float mos = rtcp_mos_estimate(delay, 0.0f);
+        CHECK(mos < previous);
+        previous = mos;
+    }
+    previous = best;
+    for (int loss = 1; loss <= 20; loss++) {
+        float mos = rtcp_mos_estimate(40, (float)loss);
+        CHECK(mos < previous);
+        previous = mos;
+    }
+
+    // The delay impairment sets in beyond 177 ms; 1% loss costs noticeably
+    CHECK(rtcp_mos_estimate(150, 0.0f) > 4.3f);
+    CHECK(rtcp_mos_estimate(400, 0.0f) < 3.7f);
+    CHECK(rtcp_mos_estimate(60, 1.0f) < 4.1f);
+    CHECK(rtcp_mos_estimate(60, 100.0f) < 1.1f);
+    CHECK(rtcp_mos_estimate(100000, 100.0f) == 1.0f);
+}
+
+// Loss and jitter of the remote stream, across a sequence wrap, with a
+// duplicate, a stray packet from far away and a telephone-event
+static void test_receive_statistics(void)
+{
+    peer_t peer;
+    CHECK(start_call(&peer, START_US));
+
+    int64_t now = START_US;
+    uint32_t timestamp = 16000;
+    uint16_t seq = 65500;
+    for (int i = 0; i < 100; i++, seq++, timestamp += 160) {
+        // Arrivals alternate between on time and 10 ms late
+        int64_t arrival = now + i * 20000 + (i % 2) * 10000;
+        if (i == 10 || i == 40 || i == 41 || i == 77) {
+            continue;
+        }
+        rtcp_on_rtp_received(REMOTE_SSRC, seq, timestamp, true, arrival);
+        if (i == 50) {
+            rtcp_on_rtp_received(REMOTE_SSRC, seq, timestamp, true, arrival + 1000);
+        }
+        if (i == 60) {
+            // A single jump is not believed
+            rtcp_on_rtp_received(REMOTE_SSRC, (uint16_t)(seq + 20000), timestamp, true, arrival);
+        }
+        if (i == 70) {
+            rtcp_on_rtp_received(REMOTE_SSRC, seq, timestamp - 800, false, arrival);
+        }
+    }
+    now += 100 * 20000;
+    rtcp_poll(now, 60);
+
+    rtcp_quality_t q;
+    rtcp_get_quality(&q);
+    CHECK(q.active);
+    CHECK_EQ_INT(q.local_ssrc, LOCAL_SSRC);
+    CHECK_EQ_INT(q.remote_ssrc, REMOTE_SSRC);
+    CHECK_EQ_INT(q.rx_expected, 100);
+    // 96 sent and received, plus the duplicate and the event repeat
+    CHECK_EQ_INT(q.rx_packets, 98);
+    CHECK_EQ_INT(q.rx_lost, 2);
+    // |D| is 80 timestamp units every packet: J converges on 10 ms
+    CHECK(q.rx_jitter_ms >= 9 && q.rx_jitter_ms <= 10);
+    CHECK_EQ_INT(q.duration_ms, 2000);
+
+    // A jump confirmed by the next packet restarts the sequence there
+    rtcp_on_rtp_received(REMOTE_SSRC, 30000, timestamp, true, now);
+    rtcp_on_rtp_received(REMOTE_SSRC, 30001, timestamp + 160, true, now + 20000);
+    rtcp_on_rtp_received(REMOTE_SSRC, 30002, timestamp + 320, true, now + 40000);
+    rtcp_poll(now + 40000, 60);
+    rtcp_get_quality(&q);
+    CHECK_EQ_INT(q.rx_expected, 2);
+    CHECK_EQ_INT(q.rx_lost, 0);
+
+    // A new SSRC starts over
+    rtcp_on_rtp_received(0x5555, 7, 0, true, now + 60000);
+    rtcp_poll(now + 60000, 60);
+    rtcp_get_quality(&q);
+    CHECK_EQ_INT(q.remote_ssrc, 0x5555);
+    CHECK_EQ_INT(q.rx_expected, 1);
+    CHECK_EQ_INT(q.rx_packets, 1);
+    CHECK_EQ_INT(q.rx_jitter_ms, 0);
+
+    end_call(&peer, now + 60000);
+}
+
+// Our sender report with a block for the remote, read back on the wire;
+// the remote's report of our stream gives the round trip
+static void test_report_exchange(void)
+{
+    peer_t peer;
+    CHECK(start_call(&peer, START_US));
+
+    int64_t now = START_US;
+    for (int i = 0; i < 50; i++) {
+        now += 20000;
+        rtcp_on_rtp_sent(1000 + i * 160, 160, now);
+        rtcp_on_rtp_received(REMOTE_SSRC, (uint16_t)(100 + i), i * 160, true, now);
+    }
+    int64_t sent_at = poll_until_report(now, 60);
+    // The first report comes after half the minimum interval, randomised
+    CHECK(sent_at - START_US >= RTCP_MIN_INTERVAL_MS / 2 * 500 / 1.21828);
+    CHECK(sent_at - START_US <= RTCP_MIN_INTERVAL_MS / 2 * 1500 / 1.21828 + 20000);
+
+    uint8_t buf[RTCP_PACKET_MAX_SIZE];
+    int len = peer_receive(&peer, buf, sizeof(buf));
+    CHECK(len >= 52 + 8);
+    if (len < 52 + 8) {
+        end_call(&peer, sent_at);
+        return;
+    }
+
+    // SR with one report block
+    CHECK_EQ_INT(buf[0], 0x81);
+    CHECK_EQ_INT(buf[1], RTCP_PT_SR);
+    CHECK_EQ_INT((buf[2] << 8) | buf[3], 12);
+    CHECK_EQ_INT(get32(buf + 4), LOCAL_SSRC);
+    uint32_t sr_ntp_middle = (get32(buf + 8) << 16) | (get32(buf + 12) >> 16);
+    CHECK_EQ_INT(get32(buf + 16), 1000 + 49 * 160 + (uint32_t)((sent_at - now) * CLOCK_RATE / 1000000));
+    CHECK_EQ_INT(get32(buf + 20), 50);
+    CHECK_EQ_INT(get32(buf + 24), 50 * 160);
+    CHECK_EQ_INT(get32(buf + 28), REMOTE_SSRC);
+    CHECK_EQ_INT(get32(buf + 32), 0);                   // Nothing lost
+    CHECK_EQ_INT(get32(buf + 36), 149);                 // Highest sequence
+    CHECK_EQ_INT(get32(buf + 44), 0);                   // No SR from the remote yet
+    CHECK_EQ_INT(get32(buf + 48), 0);
+
+    // SDES with the CNAME, padded to 32 bits
+    const uint8_t* sdes = buf + 52;
+    char cname[32];
+    snprintf(cname, sizeof(cname), "doorstation-%08x", LOCAL_SSRC);
+    CHECK_EQ_INT(sdes[0], 0x81);
+    CHECK_EQ_INT(sdes[1], RTCP_PT_SDES);
+    CHECK_EQ_INT(get32(sdes + 4), LOCAL_SSRC);
+    CHECK_EQ_INT(sdes[8], 1);
+    CHECK_EQ_INT(sdes[9], strlen(cname));
+    CHECK(memcmp(sdes + 10, cname, strlen(cname)) == 0);
+    CHECK_EQ_INT(len, 52 + ((sdes[2] << 8) | sdes[3]) * 4 + 4);
+    CHECK_EQ_INT(len % 4, 0);
+
+    // The remote held our SR for 500 ms; the network took 80 ms round trip
+    uint8_t rr[64];
+    size_t rr_len = build_rr(rr, 64, 3, 160, sr_ntp_middle, 32768);
+    peer_send(&peer, rr, rr_len);
+    int64_t answered_at = sent_at + 580000;
+    rtcp_poll(answered_at, 60);
+
+    rtcp_quality_t q;
+    rtcp_get_quality(&q);
+    CHECK_EQ_INT(q.reports_received, 1);
+    CHECK(q.tx_report_seen);
+    CHECK_EQ_INT(q.tx_fraction_lost, 64);
+    CHECK_EQ_INT(q.tx_lost, 3);
+    CHECK_EQ_INT(q.tx_jitter_ms, 20);
+    CHECK(q.rtt_valid);
+    CHECK(q.rtt_ms >= 79 && q.rtt_ms <= 80);
+    CHECK_EQ_INT(q.max_rtt_ms, q.rtt_ms);
+    // 25% loss towards the remote
+    CHECK(q.mos_tx < 2.5f);
+    CHECK(q.mos_rx > 4.0f);
+
+    // A report with an LSR from before a clock step gives no round trip
+    rr_len = build_rr(rr, 64, 3, 160, sr_ntp_middle + 0x10000000, 0);
+    peer_send(&peer, rr, rr_len);
+    rtcp_poll(answered_at + 20000, 60);
+    rtcp_get_quality(&q);
+    CHECK_EQ_INT(q.reports_received, 2);
+    CHECK(q.rtt_ms >= 79 && q.rtt_ms <= 80);
+
+    // Blocks about some other source are not about us
+    rr_len = build_rr(rr, 255, 1000, 8000, 0, 0);
+    put32(rr + 8, 0x99999999);
+    peer_send(&peer, rr, rr_len);
+    rtcp_poll(answered_at + 40000, 60);
+    rtcp_get_quality(&q);
+    CHECK_EQ_INT(q.reports_received, 3);
+    CHECK_EQ_INT(q.tx_fraction_lost, 64);
+
+    // Malformed: wrong version, and a length beyond the datagram
+    rr_len = build_rr(rr, 255, 1000, 8000, 0, 0);
+    rr[0] = 0x41;
+    peer_send(&peer, rr, rr_len);
+    rr_len = build_rr(rr, 255, 1000, 8000, 0, 0);
+    rr[3] = 20;
+    peer_send(&peer, rr, rr_len);
+    rtcp_poll(answered_at + 60000, 60);
+    rtcp_get_quality(&q);
+    CHECK_EQ_INT(q.reports_received, 3);
+    CHECK_EQ_INT(q.tx_fraction_lost, 64);
+
+    // The remote's SR is echoed in our next block as LSR, with the time we
+    // held it as DLSR
+    uint8_t sr[28] = { 0x80, RTCP_PT_SR, 0, 6 };
+    put32(sr + 4, REMOTE_SSRC);
+    put32(sr + 8, 0xE1234567);
+    put32(sr + 12, 0x89ABCDEF);
+    peer_send(&peer, sr, sizeof(sr));
+    int64_t sr_at = answered_at + 80000;
+    rtcp_poll(sr_at, 60);
+    int64_t next_at = poll_until_report(sr_at, 60);
+
+    len = peer_receive(&peer, buf, sizeof(buf));
+    CHECK(len >= 52);
+    if (len >= 52) {
+        // Still an SR: we sent RTP since the report before this one
+        CHECK_EQ_INT(buf[1], RTCP_PT_SR);
+        CHECK_EQ_INT(get32(buf + 44), 0x456789AB);
+        uint32_t expected_dlsr = (uint32_t)(((uint64_t)(next_at - sr_at) << 16) / 1000000);
+        CHECK_EQ_INT(get32(buf + 48), expected_dlsr);
+    }
+
+    // Two intervals without RTP: a receiver report
+    next_at = poll_until_report(next_at, 60);
+    len = peer_receive(&peer, buf, sizeof(buf));
+    CHECK(len >= 32);
+    CHECK_EQ_INT(buf[1], RTCP_PT_RR);
+    CHECK_EQ_INT((buf[2] << 8) | buf[3], 7);
+    CHECK_EQ_INT(get32(buf + 8), REMOTE_SSRC);
+
+    end_call(&peer, next_at);
+}
+
+// BYE closes the last compound; every call leaves a summary, newest first
+static void test_call_history(void)
+{
+    rtcp_call_summary_t before;
+    bool had_call = rtcp_get_call_summary(0, &before);
+    uint32_t first_id = had_call ? before.call_id + 1 : 1;
+
+    peer_t peer;
+    CHECK(start_call(&peer, START_US));
+    int64_t now = START_US;
+    for (int i = 0; i < 500; i++) {
+        now += 20000;
+        if (i % 10 != 3) {
+            rtcp_on_rtp_received(REMOTE_SSRC, (uint16_t)i, i * 160, true, now);
+        }
+        rtcp_on_rtp_sent(i * 160, 160, now);
+    }
+    rtcp_poll(now, 60);
+    rtcp_stop(now);
+
+    uint8_t buf[RTCP_PACKET_MAX_SIZE];
+    int last = 0;
+    int len;
+    while ((len = peer_receive(&peer, buf, sizeof(buf))) > 0) {
+        last = len;
+        if (buf[last - 8 + 1] == RTCP_PT_BYE) {
+            break;
+        }
+    }
+    CHECK(last >= 28);
+    CHECK_EQ_INT(buf[last - 8], 0x81);
+    CHECK_EQ_INT(buf[last - 7], RTCP_PT_BYE);
+    CHECK_EQ_INT(get32(buf + last - 4), LOCAL_SSRC);
+    close(peer.sock);
+
+    rtcp_quality_t q;
+    rtcp_get_quality(&q);
+    CHECK(!q.active);
+
+    rtcp_call_summary_t summary;
+    CHECK(rtcp_get_call_summary(0, &summary));
+    CHECK_EQ_INT(summary.call_id, first_id);
+    CHECK_EQ_INT(summary.duration_ms, 10000);
+    CHECK_EQ_INT(summary.rx_packets, 450);
+    CHECK_EQ_INT(summary.rx_lost, 50);
+    CHECK(fabsf(summary.rx_loss_pct - 10.0f) < 0.01f);
+    CHECK(!summary.rtt_valid);
+    CHECK(summary.mos < 3.5f);
+    CHECK(summary.min_mos <= summary.mos + 0.5f);
+
+    // A second call pushes the first one down
+    CHECK(start_call(&peer, now));
+    end_call(&peer, now + 3000000);
+    CHECK(rtcp_get_call_summary(0, &summary));
+    CHECK_EQ_INT(summary.call_id, first_id + 1);
+    CHECK_EQ_INT(summary.duration_ms, 3000);
+    CHECK_EQ_INT(summary.rx_packets, 0);
+    CHECK(rtcp_get_call_summary(1, &summary));
+    CHECK_EQ_INT(summary.call_id, first_id);
+    CHECK(!rtcp_get_call_summary(RTCP_CALL_HISTORY, &summary));
+    CHECK(!rtcp_get_call_summary(-1, &summary));
+    CHECK(!rtcp_get_call_summary(0, NULL));
+
+    // Stopped: updates are ignored
+    rtcp_on_rtp_received(REMOTE_SSRC, 1, 0, true, now);
+    rtcp_poll(now, 60);
+    rtcp_stop(now);
+    CHECK(rtcp_get_call_summary(0, &summary));
+    CHECK_EQ_INT(summary.call_id, first_id + 1);
+}
+
+static void test_invalid_remote(void)
+{
+    CHECK(!rtcp_start("not-an-address", 5005, 0, LOCAL_SSRC, CLOCK_RATE, START_US));
+    rtcp_quality_t q;
+    rtcp_get_quality(&q);
+    CHECK(!q.active);
+}
+
+int main(void)
+{
+    RUN_TEST(test_mos_estimate);
+    RUN_TEST(test_receive_statistics);
+    RUN_TEST(test_report_exchange);
+    RUN_TEST(test_call_history);
+    RUN_TEST(test_invalid_remote);
+    return TEST_RESULT();
+}
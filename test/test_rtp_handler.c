@@ -0,0 +1,205 @@
+#include "rtp_handler.h"
+#include "g711.h"
+#include "test_support.h"
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+
+// RTP headers as they appear on the wire, parsed through rtp_header_t, and a
+// session on loopback UDP: what rtp_handler sends and what it accepts.
+
+static int peer_sock = -1;
+static uint16_t peer_port;
+static uint16_t local_port;
+static int last_event = -1;
+
+static int open_socket(void)
+{
+    int sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    struct sockaddr_in addr = { .sin_family = AF_INET };
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    bind(sock, (struct sockaddr*)&addr, sizeof(addr));
+    fcntl(sock, F_SETFL, fcntl(sock, F_GETFL, 0) | O_NONBLOCK);
+    return sock;
+}
+
+static uint16_t bound_port(int sock)
+{
+    struct sockaddr_in addr;
+    socklen_t len = sizeof(addr);
+    getsockname(sock, (struct sockaddr*)&addr, &len);
+    return ntohs(addr.sin_port);
+}
+
+static void on_event(uint8_t event)
+{
+    last_event = event;
+}
+
+static void start_session(void)
+{
+    peer_sock = open_socket();
+    peer_port = bound_port(peer_sock);
+    int probe = open_socket();
+    local_port = bound_port(probe);
+    close(probe);
+    CHECK(rtp_start_session("127.0.0.1", peer_port, local_port));
+}
+
+static void stop_session(void)
+{
+    rtp_stop_session();
+    close(peer_sock);
+}
+
+static void peer_send(const uint8_t* packet, size_t len)
+{
+    struct sockaddr_in addr = { .sin_family = AF_INET, .sin_port = htons(local_port) };
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    sendto(peer_sock, packet, len, 0, (struct sockaddr*)&addr, sizeof(addr));
+}
+
+static int peer_recv(uint8_t* packet, size_t size)
+{
+    // Loopback delivery is immediate, but give the kernel a moment
+    for (int i = 0; i < 100; i++) {
+        int len = (int)recv(peer_sock, packet, size, 0);
+        if (len > 0) {
+            return len;
+        }
+        usleep(1000);
+    }
+    return -1;
+}
+
+// A PCMU packet: V=2, no padding/extension/CSRCs, M=0, PT 0
+static size_t make_pcmu(uint8_t* packet, uint8_t first, uint16_t seq)
+{
+    static const uint8_t header[12] = { 0x80, 0x00, 0, 0, 0x00, 0x00, 0x10, 0x00, 0x12, 0x34, 0x56, 0x78 };
+    memcpy(packet, header, sizeof(header));
+    packet[0] = first;
+    packet[2] = seq >> 8;
+    packet[3] = seq;
+    uint32_t ts = 0x1000 + (uint32_t)seq * 160;
+    packet[4] = ts >> 24;
+    packet[5] = ts >> 16;
+    packet[6] = ts >> 8;
+    packet[7] = ts;
+    memset(packet + 12, 0xFF, 160); // mu-law silence
+    return 12 + 160;
+}
+
+static void test_parse_wire_header(void)
+{
+    static const uint8_t pcmu[12] = { 0x80, 0x00, 0x12, 0x34, 0x00, 0x00, 0x00, 0xA0, 0xDE, 0xAD, 0xBE, 0xEF };
+    const rtp_header_t* h = (const rtp_header_t*)pcmu;
+    CHECK_EQ_INT(sizeof(rtp_header_t), 12);
+    CHECK_EQ_INT(RTP_HDR_VERSION(h), 2);
+    CHECK_EQ_INT(RTP_HDR_PADDING(h), 0);
+    CHECK_EQ_INT(RTP_HDR_EXTENSION(h), 0);
+    CHECK_EQ_INT(RTP_HDR_CSRC_COUNT(h), 0);
+    CHECK_EQ_INT(RTP_HDR_MARKER(h), 0);
+    CHECK_EQ_INT(RTP_HDR_PAYLOAD_TYPE(h), 0);
+    CHECK_EQ_INT(ntohs(h->sequence), 0x1234);
+    CHECK_EQ_INT(ntohl(h->timestamp), 160);
+    CHECK_EQ_INT(ntohl(h->ssrc), 0xDEADBEEF);
+
+    // Start of a telephone-event: marker set, dynamic PT 101
+    static const uint8_t event[12] = { 0x80, 0xE5, 0xFF, 0xFE, 0, 0, 0, 0, 0, 0, 0, 1 };
+    h = (const rtp_header_t*)event;
+    CHECK_EQ_INT(RTP_HDR_VERSION(h), 2);
+    CHECK_EQ_INT(RTP_HDR_MARKER(h), 1);
+    CHECK_EQ_INT(RTP_HDR_PAYLOAD_TYPE(h), 101);
+    CHECK_EQ_INT(ntohs(h->sequence), 0xFFFE);
+
+    // Every flag in the first octet
+    static const uint8_t flags[12] = { 0xB3, 0x08 };
+    h = (const rtp_header_t*)flags;
+    CHECK_EQ_INT(RTP_HDR_VERSION(h), 2);
+    CHECK_EQ_INT(RTP_HDR_PADDING(h), 1);
+    CHECK_EQ_INT(RTP_HDR_EXTENSION(h), 1);
+    CHECK_EQ_INT(RTP_HDR_CSRC_COUNT(h), 3);
+    CHECK_EQ_INT(RTP_HDR_MARKER(h), 0);
+    CHECK_EQ_INT(RTP_HDR_PAYLOAD_TYPE(h), G711_PT_PCMA);
+}
+
+// The headers we build read back as V=2 with the PT and marker asked for
+static void test_sent_header(void)
+{
+    start_session();
+    uint8_t packet[RTP_PACKET_MAX_SIZE];
+    int16_t pcm[160] = { 0 };
+
+    CHECK(rtp_send_audio(pcm, 160) > 0);
+    CHECK_EQ_INT(peer_recv(packet, sizeof(packet)), 12 + 160);
+    CHECK_EQ_INT(packet[0], 0x80);
+    CHECK_EQ_INT(packet[1], G711_PT_PCMU);
+    uint16_t first_seq = (uint16_t)((packet[2] << 8) | packet[3]);
+
+    rtp_set_payload_types(G711_PT_PCMA, 101);
+    CHECK(rtp_send_audio(pcm, 160) > 0);
+    CHECK_EQ_INT(peer_recv(packet, sizeof(packet)), 12 + 160);
+    CHECK_EQ_INT(packet[1], G711_PT_PCMA);
+    CHECK_EQ_INT((uint16_t)((packet[2] << 8) | packet[3]), (uint16_t)(first_seq + 1));
+
+    rtp_packet_t pooled;
+    uint8_t* payload = rtp_packet_begin(&pooled, 101, true);
+    memset(payload, 0, 4);
+    CHECK(rtp_packet_send(&pooled, 4, 0) > 0);
+    CHECK_EQ_INT(peer_recv(packet, sizeof(packet)), 12 + 4);
+    const rtp_header_t* h = (const rtp_header_t*)packet;
+    CHECK_EQ_INT(packet[0], 0x80);
+    CHECK_EQ_INT(packet[1], 0xE5);
+    CHECK_EQ_INT(RTP_HDR_MARKER(h), 1);
+    CHECK_EQ_INT(RTP_HDR_PAYLOAD_TYPE(h), 101);
+    stop_session();
+}
+
+// Compliant packets from a remote are received and played; version 0 and
+// runts are dropped
+static void test_receive_compliant_packets(void)
+{
+    start_session();
+    uint8_t packet[12 + 160];
+    for (uint16_t seq = 0; seq < 10; seq++) {
+        peer_send(packet, make_pcmu(packet, 0x80, seq));
+    }
+    peer_send(packet, make_pcmu(packet, 0x00, 10));  // Version 0
+    peer_send(packet, 8);                            // Shorter than a header
+    usleep(10000);
+
+    int16_t samples[320];
+    int played = 0;
+    for (int i = 0; i < 20; i++) {
+        played += rtp_receive_audio(samples, 320) > 0;
+    }
+    rtp_stats_t stats;
+    rtp_get_stats(&stats);
+    CHECK_EQ_INT(stats.packets_received, 10);
+    CHECK_EQ_INT(stats.jitter_buffer.received, 10);
+    CHECK(played > 0);
+
+    // An RFC 4733 end-of-event for digit 5 (marker on the first packet)
+    uint8_t event[16] = { 0x80, 0xE5, 0, 20, 0, 0, 0x20, 0, 0x12, 0x34, 0x56, 0x78, 5, 0x80 | 10, 0x03, 0x20 };
+    rtp_set_telephone_event_callback(on_event);
+    peer_send(event, sizeof(event));
+    usleep(10000);
+    rtp_receive_audio(samples, 320);
+    CHECK_EQ_INT(last_event, 5);
+    rtp_set_telephone_event_callback(NULL);
+    stop_session();
+}
+
+int main(void)
+{
+    rtp_init();
+    RUN_TEST(test_parse_wire_header);
+    RUN_TEST(test_sent_header);
+    RUN_TEST(test_receive_compliant_packets);
+    return TEST_RESULT();
+}
@@ -0,0 +1,310 @@
+#include "sdp.h"
+#include "sip_writer.h"
+#include "test_support.h"
+#include <stdint.h>
+#include <stdbool.h>
+
+// Offers as the PBXs we are deployed behind send them (addresses and
+// session ids changed). Each has something the negotiation must look past:
+// GSM and a maxptime on Asterisk, Opus and a 48 kHz telephone-event first
+// on FreeSWITCH, G.722 and G.729 first on a FritzBox.
+
+static const char asterisk_offer[] =
+    "v=0\r\n"
+    "o=- 1432896513 1432896513 IN IP4 192.168.1.10\r\n"
+    "s=Asterisk\r\n"
+    "c=IN IP4 192.168.1.10\r\n"
+    "t=0 0\r\n"
+    "m=audio 16384 RTP/AVP 8 0 3 101\r\n"
+    "a=rtpmap:8 PCMA/8000\r\n"
+    "a=rtpmap:0 PCMU/8000\r\n"
+    "a=rtpmap:3 GSM/8000\r\n"
+    "a=rtpmap:101 telephone-event/8000\r\n"
+    "a=fmtp:101 0-16\r\n"
+    "a=ptime:20\r\n"
+    "a=maxptime:150\r\n"
+    "a=sendrecv\r\n";
+
+static const char freeswitch_offer[] =
+    "v=0\r\n"
+    "o=FreeSWITCH 1700000000 1700000001 IN IP4 10.0.0.5\r\n"
+    "s=FreeSWITCH\r\n"
+    "c=IN IP4 10.0.0.5\r\n"
+    "t=0 0\r\n"
+    "m=audio 24578 RTP/AVP 102 9 0 8 104 101\r\n"
+    "a=rtpmap:102 opus/48000/2\r\n"
+    "a=fmtp:102 useinbandfec=1; maxaveragebitrate=30000; ptime=20; minptime=10; maxptime=40\r\n"
+    "a=rtpmap:9 G722/8000\r\n"
+    "a=rtpmap:0 PCMU/8000\r\n"
+    "a=rtpmap:8 PCMA/8000\r\n"
+    "a=rtpmap:104 telephone-event/48000\r\n"
+    "a=fmtp:104 0-16\r\n"
+    "a=rtpmap:101 telephone-event/8000\r\n"
+    "a=fmtp:101 0-16\r\n"
+    "a=ptime:20\r\n"
+    "a=rtcp:24579 IN IP4 10.0.0.5\r\n";
+
+// Written with bare LFs, as SIP ALGs that rewrite the body sometimes leave
+// it; the parser takes either
+static const char fritzbox_offer[] =
+    "v=0\n"
+    "o=- 24961 24961 IN IP4 192.168.178.1\n"
+    "s=-\n"
+    "c=IN IP4 192.168.178.1\n"
+    "t=0 0\n"
+    "m=audio 7078 RTP/AVP 9 18 8 0 101\n"
+    "a=rtpmap:9 G722/8000\n"
+    "a=rtpmap:18 G729/8000\n"
+    "a=fmtp:18 annexb=no\n"
+    "a=rtpmap:8 PCMA/8000\n"
+    "a=rtpmap:0 PCMU/8000\n"
+    "a=rtpmap:101 telephone-event/8000\n"
+    "a=fmtp:101 0-15\n"
+    "a=sendrecv\n"
+    "a=rtcp-mux\n"
+    "a=ptime:30\n";
+
+static bool negotiate(const char* sdp, sdp_media_t* media, sdp_negotiated_t* result)
+{
+    if (!sdp_parse(sdp, strlen(sdp), media)) {
+        return false;
+    }
+    return sdp_negotiate(media, result);
+}
+
+static void test_asterisk(void)
+{
+    sdp_media_t media;
+    sdp_negotiated_t result;
+
+    CHECK(negotiate(asterisk_offer, &media, &result));
+    CHECK_EQ_INT(media.port, 16384);
+    CHECK_EQ_INT(media.format_count, 4);
+    CHECK_EQ_INT(media.formats[2].codec, SDP_CODEC_UNKNOWN);
+    CHECK_EQ_INT(result.codec, SDP_CODEC_PCMA);
+    CHECK_EQ_INT(result.audio_pt, 8);
+    CHECK_EQ_INT(result.event_pt, 101);
+    CHECK_EQ_INT(result.ptime, 20);
+    CHECK_EQ_INT(result.direction, SDP_DIR_SENDRECV);
+    CHECK_EQ_STR(result.address, "192.168.1.10");
+    CHECK_EQ_INT(result.port, 16384);
+}
+
+static void test_freeswitch(void)
+{
+    sdp_media_t media;
+    sdp_negotiated_t result;
+
+    CHECK(negotiate(freeswitch_offer, &media, &result));
+    CHECK_EQ_INT(media.formats[0].codec, SDP_CODEC_UNKNOWN);
+    CHECK_EQ_INT(media.formats[4].clock_rate, 48000);
+    CHECK_EQ_INT(result.codec, SDP_CODEC_PCMU);
+    CHECK_EQ_INT(result.audio_pt, 0);
+    CHECK_EQ_INT(result.event_pt, 101);
+    CHECK_EQ_STR(result.address, "10.0.0.5");
+    CHECK_EQ_INT(result.port, 24578);
+}
+
+static void test_fritzbox(void)
+{
+    sdp_media_t media;
+    sdp_negotiated_t result;
+
+    CHECK(negotiate(fritzbox_offer, &media, &result));
+    CHECK_EQ_INT(result.codec, SDP_CODEC_PCMA);
+    CHECK_EQ_INT(result.audio_pt, 8);
+    CHECK_EQ_INT(result.event_pt, 101);
+    CHECK_EQ_STR(result.address, "192.168.178.1");
+    CHECK_EQ_INT(result.port, 7078);
+
+    // We send whole 20 ms frames and never longer packets than asked for
+    CHECK_EQ_INT(result.remote_ptime, 30);
+    CHECK_EQ_INT(result.ptime, 20);
+}
+
+static void test_ptime_clamping(void)
+{
+    static const struct {
+        uint16_t asked;
+        uint16_t sent;
+    } cases[] = {
+        { 0, 20 }, { 5, 20 }, { 10, 20 }, { 20, 20 }, { 30, 20 }, { 40, 40 },
+        { 50, 40 }, { 60, 60 }, { 80, 60 }, { 1000, 60 },
+    };
+    sdp_media_t media;
+    sdp_negotiated_t result;
+
+    CHECK(sdp_parse(asterisk_offer, strlen(asterisk_offer), &media));
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        media.ptime = cases[i].asked;
+        CHECK(sdp_negotiate(&media, &result));
+        CHECK_EQ_INT(result.remote_ptime, cases[i].asked);
+        if (result.ptime != cases[i].sent) {
+            printf("  ptime %u\n", cases[i].asked);
+            CHECK_EQ_INT(result.ptime, cases[i].sent);
+        }
+    }
+}
+
+// Media-level c= and direction win over the session level; a video stream
+// ahead of the audio, and its attributes, are ignored
+static void test_levels_and_other_streams(void)
+{
+    static const char sdp[] =
+        "v=0\r\n"
+        "o=- 1 1 IN IP4 10.1.1.1\r\n"
+        "s=-\r\n"
+        "c=IN IP4 10.1.1.1\r\n"
+        "t=0 0\r\n"
+        "a=sendonly\r\n"
+        "m=video 9000 RTP/AVP 96\r\n"
+        "c=IN IP4 10.9.9.9\r\n"
+        "a=rtpmap:96 H264/90000\r\n"
+        "a=ptime:33\r\n"
+        "a=inactive\r\n"
+        "m=audio 4000 RTP/AVP 0\r\n"
+        "c=IN IP4 10.2.2.2/127\r\n"
+        "a=recvonly\r\n";
+    sdp_media_t media;
+    sdp_negotiated_t result;
+
+    CHECK(negotiate(sdp, &media, &result));
+    CHECK_EQ_STR(media.address, "10.2.2.2");
+    CHECK_EQ_INT(media.direction, SDP_DIR_RECVONLY);
+    CHECK_EQ_INT(media.ptime, 0);
+    CHECK_EQ_INT(result.direction, SDP_DIR_SENDONLY);
+    CHECK_EQ_INT(result.event_pt, SDP_PT_NONE);
+    CHECK_EQ_STR(result.address, "10.2.2.2");
+}
+
+static void test_hold(void)
+{
+    static const char sendonly[] =
+        "v=0\r\nc=IN IP4 192.168.1.10\r\nt=0 0\r\nm=audio 16384 RTP/AVP 0\r\na=sendonly\r\n";
+    static const char inactive[] =
+        "v=0\r\nc=IN IP4 192.168.1.10\r\nt=0 0\r\nm=audio 16384 RTP/AVP 0\r\na=inactive\r\n";
+    static const char rfc2543[] =
+        "v=0\r\nc=IN IP4 0.0.0.0\r\nt=0 0\r\nm=audio 16384 RTP/AVP 0\r\n";
+    static const char rfc2543_recvonly[] =
+        "v=0\r\nc=IN IP4 0.0.0.0\r\nt=0 0\r\nm=audio 16384 RTP/AVP 0\r\na=recvonly\r\n";
+    sdp_media_t media;
+    sdp_negotiated_t result;
+
+    CHECK(negotiate(sendonly, &media, &result));
+    CHECK_EQ_INT(result.direction, SDP_DIR_RECVONLY);
+    CHECK(negotiate(inactive, &media, &result));
+    CHECK_EQ_INT(result.direction, SDP_DIR_INACTIVE);
+    CHECK(negotiate(rfc2543, &media, &result));
+    CHECK_EQ_INT(result.direction, SDP_DIR_RECVONLY);
+    CHECK(negotiate(rfc2543_recvonly, &media, &result));
+    CHECK_EQ_INT(result.direction, SDP_DIR_INACTIVE);
+}
+
+static void test_rejections(void)
+{
+    static const char no_common_codec[] =
+        "v=0\r\nc=IN IP4 10.0.0.1\r\nt=0 0\r\nm=audio 5000 RTP/AVP 18 9\r\n"
+        "a=rtpmap:18 G729/8000\r\na=rtpmap:9 G722/8000\r\n";
+    static const char wideband_pcmu[] =
+        "v=0\r\nc=IN IP4 10.0.0.1\r\nt=0 0\r\nm=audio 5000 RTP/AVP 96\r\na=rtpmap:96 PCMU/16000\r\n";
+    static const char rejected[] =
+        "v=0\r\nc=IN IP4 10.0.0.1\r\nt=0 0\r\nm=audio 0 RTP/AVP 0\r\n";
+    static const char ipv6[] =
+        "v=0\r\nc=IN IP6 2001:db8::1\r\nt=0 0\r\nm=audio 5000 RTP/AVP 0\r\n";
+    static const char video_only[] =
+        "v=0\r\nc=IN IP4 10.0.0.1\r\nt=0 0\r\nm=video 5000 RTP/AVP 96\r\n";
+    sdp_media_t media;
+    sdp_negotiated_t result;
+
+    CHECK(!negotiate(no_common_codec, &media, &result));
+    CHECK(!negotiate(wideband_pcmu, &media, &result));
+    CHECK(!negotiate(rejected, &media, &result));
+    CHECK(!negotiate(ipv6, &media, &result));
+    CHECK(!sdp_parse(video_only, strlen(video_only), &media));
+    CHECK(!sdp_parse("", 0, &media));
+}
+
+static const sdp_local_t local = {
+    .address = "192.168.1.50",
+    .port = 40000,
+    .session_id = 1234,
+    .session_version = 2,
+    .session_name = "doorbell",
+    .direction = SDP_DIR_SENDRECV,
+};
+
+static void test_offer(void)
+{
+    char buf[512];
+    sip_writer_t w;
+    sip_writer_init(&w, buf, sizeof(buf));
+    sdp_write_offer(&w, &local);
+    CHECK(!w.overflow);
+    buf[w.len] = '\0';
+
+    CHECK_EQ_STR(buf,
+                 "v=0\r\n"
+                 "o=- 1234 2 IN IP4 192.168.1.50\r\n"
+                 "s=doorbell\r\n"
+                 "c=IN IP4 192.168.1.50\r\n"
+                 "t=0 0\r\n"
+                 "m=audio 40000 RTP/AVP 0 8 101\r\n"
+                 "a=rtpmap:0 PCMU/8000\r\n"
+                 "a=rtpmap:8 PCMA/8000\r\n"
+                 "a=rtpmap:101 telephone-event/8000\r\n"
+                 "a=fmtp:101 0-15\r\n"
+                 "a=ptime:20\r\n"
+                 "a=sendrecv\r\n");
+
+    // Our own offer, read as the far end would, negotiates PCMU
+    sdp_media_t media;
+    sdp_negotiated_t result;
+    CHECK(negotiate(buf, &media, &result));
+    CHECK_EQ_INT(result.codec, SDP_CODEC_PCMU);
+    CHECK_EQ_INT(result.event_pt, SDP_DEFAULT_EVENT_PT);
+    CHECK_EQ_INT(result.port, 40000);
+}
+
+// The answer carries the offerer's payload type numbers
+static void test_answer(void)
+{
+    sdp_media_t media;
+    sdp_negotiated_t result;
+    CHECK(negotiate(freeswitch_offer, &media, &result));
+
+    sdp_local_t held = local;
+    held.direction = SDP_DIR_SENDONLY;
+    char buf[512];
+    sip_writer_t w;
+    sip_writer_init(&w, buf, sizeof(buf));
+    sdp_write_answer(&w, &held, &result);
+    CHECK(!w.overflow);
+    buf[w.len] = '\0';
+
+    CHECK(strstr(buf, "m=audio 40000 RTP/AVP 0 101\r\n") != NULL);
+    CHECK(strstr(buf, "a=rtpmap:0 PCMU/8000\r\n") != NULL);
+    CHECK(strstr(buf, "a=rtpmap:101 telephone-event/8000\r\na=fmtp:101 0-15\r\n") != NULL);
+    CHECK(strstr(buf, "a=sendonly\r\n") != NULL);
+    CHECK(strstr(buf, "PCMA") == NULL);
+
+    result.event_pt = SDP_PT_NONE;
+    sip_writer_init(&w, buf, sizeof(buf));
+    sdp_write_answer(&w, &local, &result);
+    buf[w.len] = '\0';
+    CHECK(strstr(buf, "m=audio 40000 RTP/AVP 0\r\n") != NULL);
+    CHECK(strstr(buf, "telephone-event") == NULL);
+}
+
+int main(void)
+{
+    RUN_TEST(test_asterisk);
+    RUN_TEST(test_freeswitch);
+    RUN_TEST(test_fritzbox);
+    RUN_TEST(test_ptime_clamping);
+    RUN_TEST(test_levels_and_other_streams);
+    RUN_TEST(test_hold);
+    RUN_TEST(test_rejections);
+    RUN_TEST(test_offer);
+    RUN_TEST(test_answer);
+    return TEST_RESULT();
+}
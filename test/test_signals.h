@@ -0,0 +1,106 @@
+#ifndef TEST_SIGNALS_H
+#define TEST_SIGNALS_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <math.h>
+
+// Synthetic audio for the DSP tests, at 8 kHz. Everything is generated
+// from a fixed seed, so a failing run fails the same way again.
+
+#define SIGNAL_RATE     8000
+
+static uint32_t signal_seed = 1;
+
+static inline void signal_srand(uint32_t seed)
+{
+    signal_seed = seed ? seed : 1;
+}
+
+// Uniform in [0, 1)
+static inline double signal_uniform(void)
+{
+    signal_seed = signal_seed * 1664525u + 1013904223u;
+    return (signal_seed >> 8) / 16777216.0;
+}
+
+// Uniform in [-1, 1)
+static inline double signal_noise(void)
+{
+    return signal_uniform() * 2.0 - 1.0;
+}
+
+// Speech-like signal with peaks at +-1: syllables of glottal pulses (one
+// in five unvoiced) through two resonators at random formants, with short
+// gaps inside words and longer pauses between them
+static inline void signal_talker(float* out, size_t n, double f0_base, uint32_t seed, double talk_fraction)
+{
+    signal_srand(seed);
+    double phase = 0;
+    double y1[2] = { 0 };
+    double y2[2] = { 0 };
+    size_t i = 0;
+    while (i < n) {
+        size_t syllable = (size_t)(SIGNAL_RATE * (0.12 + 0.2 * signal_uniform()));
+        size_t pause = signal_uniform() > talk_fraction ? (size_t)(SIGNAL_RATE * (0.2 + 0.5 * signal_uniform()))
+                                                        : (size_t)(SIGNAL_RATE * 0.03);
+        double f1 = 300 + 500 * signal_uniform();
+        double f2 = 900 + 1500 * signal_uniform();
+        double f0 = f0_base * (0.85 + 0.3 * signal_uniform());
+        int voiced = signal_uniform() < 0.8;
+        double r = 0.97;
+        double c1 = 2 * r * cos(2 * M_PI * f1 / SIGNAL_RATE);
+        double c2 = 2 * r * cos(2 * M_PI * f2 / SIGNAL_RATE);
+
+        for (size_t k = 0; k < syllable && i < n; k++, i++) {
+            double envelope = sin(M_PI * k / syllable);
+            double source;
+            phase += f0 / SIGNAL_RATE;
+            if (voiced) {
+                source = phase >= 1 ? (phase -= 1, 8.0) : 0.0;
+                source += signal_noise() * 0.05;
+            } else {
+                source = signal_noise() * 0.6;
+            }
+            double a = source + c1 * y1[0] - r * r * y1[1];
+            y1[1] = y1[0];
+            y1[0] = a;
+            double b = a + c2 * y2[0] - r * r * y2[1];
+            y2[1] = y2[0];
+            y2[0] = b;
+            out[i] = (float)(b * envelope);
+        }
+        for (size_t k = 0; k < pause && i < n; k++, i++) {
+            out[i] = 0;
+        }
+    }
+
+    double peak = 0;
+    for (size_t k = 0; k < n; k++) {
+        peak = fabs(out[k]) > peak ? fabs(out[k]) : peak;
+    }
+    for (size_t k = 0; k < n && peak > 0; k++) {
+        out[k] /= peak;
+    }
+}
+
+static inline int16_t signal_to_pcm(double v)
+{
+    return (int16_t)(v > 32767 ? 32767 : v < -32768 ? -32768 : lrint(v));
+}
+
+static inline double signal_energy(const int16_t* x, size_t from, size_t to)
+{
+    double sum = 0;
+    for (size_t i = from; i < to; i++) {
+        sum += (double)x[i] * x[i];
+    }
+    return sum;
+}
+
+static inline double signal_db(double numerator, double denominator)
+{
+    return 10 * log10(numerator / denominator);
+}
+
+#endif // TEST_SIGNALS_H
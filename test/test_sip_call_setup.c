@@ -0,0 +1,105 @@
+#include "sip_client.h"
+#include "sip_harness.h"
+#include "sip_log.h"
+#include "esp_timer.h"
+#include "test_support.h"
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+// The make-call path from a bell press to the INVITE arriving at the PBX,
+// in real time on loopback. While registered and idle the client keeps an
+// INVITE ready for each bell target, so a press to a configured target only
+// patches the ids (and the digest) and sends; a target that is not
+// configured is built on the press, for comparison. On a desktop CPU both
+// are dominated by waking the SIP task; the difference is the target's
+// string formatting, DNS and (after a 401) the second INVITE.
+
+#define CALLS               20
+#define INVITE_LIMIT_US     5000
+
+static int compare(const void* a, const void* b)
+{
+    int64_t x = *(const int64_t*)a;
+    int64_t y = *(const int64_t*)b;
+    return (x > y) - (x < y);
+}
+
+static sip_log_entry_t entries[512];
+
+// Log records since @p since_ms that start with @p prefix
+static int count_logged(const char* prefix, uint64_t since_ms)
+{
+    int count = sip_get_log_entries(entries, 512, since_ms);
+    int found = 0;
+    for (int i = 0; i < count; i++) {
+        if (strncmp(entries[i].message, prefix, strlen(prefix)) == 0) {
+            found++;
+        }
+    }
+    return found;
+}
+
+// Press-to-INVITE of each call to @p target, checked to have gone out
+// pre-armed or not; sorted
+static int measure(const char* target, bool prearmed, int64_t* us)
+{
+    int count = 0;
+    for (int i = 0; i < CALLS; i++) {
+        int invites = pbx_stats()->invites;
+        int64_t pressed = esp_timer_get_time();
+        sip_client_make_call(target);
+        CHECK(harness_wait_led(LED_STATE_CALL_ACTIVE, pressed, 2000) != 0);
+        CHECK_EQ_INT(pbx_stats()->invites, invites + 1);
+        CHECK_EQ_INT(count_logged("Pre-armed INVITE sent", (uint64_t)(pressed / 1000) - 1), prearmed);
+        int64_t invite = pbx_stats()->invite_us;
+        CHECK(invite >= pressed);
+        if (invite >= pressed && count < CALLS) {
+            us[count++] = invite - pressed;
+        }
+
+        int64_t bye = esp_timer_get_time();
+        CHECK(pbx_hang_up());
+        CHECK(harness_wait_led(LED_STATE_IDLE, bye, 1000) != 0);
+        pbx_poll(20);   // The SIP task re-arms the template once idle
+    }
+    qsort(us, count, sizeof(us[0]), compare);
+    return count;
+}
+
+static void report(const char* name, const int64_t* us, int count)
+{
+    CHECK(count == CALLS);
+    if (count > 0) {
+        printf("  %-24s %6lld %6lld %6lld\n", name, (long long)us[0], (long long)us[count / 2],
+               (long long)us[count - 1]);
+    }
+}
+
+static void test_press_to_invite(void)
+{
+    int64_t armed[CALLS];
+    int64_t built[CALLS];
+
+    int armed_count = measure("201", true, armed);
+    int built_count = measure("202", false, built);
+
+    printf("  make_call -> INVITE (us)    min median    max\n");
+    report("pre-armed (bell target)", armed, armed_count);
+    report("built on the press", built, built_count);
+    if (armed_count > 0) {
+        CHECK(armed[armed_count / 2] < INVITE_LIMIT_US);
+    }
+}
+
+int main(void)
+{
+    setvbuf(stdout, NULL, _IOLBF, 0);
+    pbx_add_target("201", PBX_ANSWER, 20);
+    pbx_add_target("202", PBX_ANSWER, 20);
+    CHECK(harness_start(SIP_TRANSPORT_UDP, "201", NULL));
+    pbx_poll(20);
+    RUN_TEST(test_press_to_invite);
+    return TEST_RESULT();
+}
@@ -0,0 +1,226 @@
+#include "sip_dialog_table.h"
+#include "sip_parser.h"
+#include "test_support.h"
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+static bool insert(sip_dialog_table_t* t, const char* call_id, const char* tag, int value)
+{
+    return sip_dialog_table_insert(t, call_id, strlen(call_id), tag, strlen(tag), value);
+}
+
+static int find(const sip_dialog_table_t* t, const char* call_id, const char* tag)
+{
+    return sip_dialog_table_find(t, call_id, strlen(call_id), tag, strlen(tag));
+}
+
+static void remove_key(sip_dialog_table_t* t, const char* call_id, const char* tag)
+{
+    sip_dialog_table_remove(t, call_id, strlen(call_id), tag, strlen(tag));
+}
+
+// Route a message the way sip_client.c does: Call-ID plus our tag, the To
+// tag of a request and the From tag of a response
+static int route(const sip_dialog_table_t* t, const char* text)
+{
+    sip_message_t msg;
+    if (!sip_parse_message(text, strlen(text), &msg)) {
+        return -2;
+    }
+    const sip_header_t* call_id = sip_msg_header(&msg, SIP_HDR_CALL_ID);
+    const char* tag;
+    size_t tag_len;
+    if (!call_id || !sip_header_param(sip_msg_header(&msg, msg.is_response ? SIP_HDR_FROM : SIP_HDR_TO),
+                                      "tag", &tag, &tag_len)) {
+        return -1;
+    }
+    return sip_dialog_table_find(t, call_id->value, call_id->value_len, tag, tag_len);
+}
+
+// An incoming call is up while the bell starts an outgoing one; each
+// request and response finds its own dialog straight from the receive
+// buffer, and one ending leaves the other in place
+static void test_two_dialogs_route_messages(void)
+{
+    static sip_dialog_table_t table;
+    sip_dialog_table_clear(&table);
+    CHECK(insert(&table, "in-7f3a@192.168.1.10", "d00rbe11", 0));
+    CHECK(insert(&table, "out-1234@192.168.1.50", "4242", 1));
+
+    static const char bye_incoming[] =
+        "BYE sip:doorbell@192.168.1.50 SIP/2.0\r\n"
+        "Via: SIP/2.0/UDP 192.168.1.10;branch=z9hG4bKx\r\n"
+        "From: <sip:100@pbx>;tag=as1\r\n"
+        "To: <sip:doorbell@pbx>;tag=d00rbe11\r\n"
+        "Call-ID: in-7f3a@192.168.1.10\r\n"
+        "CSeq: 2 BYE\r\n\r\n";
+    static const char ok_outgoing[] =
+        "SIP/2.0 200 OK\r\n"
+        "Via: SIP/2.0/UDP 192.168.1.50;branch=z9hG4bK9\r\n"
+        "From: <sip:doorbell@pbx>;tag=4242\r\n"
+        "To: <sip:200@pbx>;tag=fs77\r\n"
+        "Call-ID: out-1234@192.168.1.50\r\n"
+        "CSeq: 1 INVITE\r\n\r\n";
+    static const char bye_wrong_tag[] =
+        "BYE sip:doorbell@192.168.1.50 SIP/2.0\r\n"
+        "Via: SIP/2.0/UDP 192.168.1.10;branch=z9hG4bKy\r\n"
+        "From: <sip:100@pbx>;tag=as1\r\n"
+        "To: <sip:doorbell@pbx>;tag=4242\r\n"
+        "Call-ID: in-7f3a@192.168.1.10\r\n"
+        "CSeq: 3 BYE\r\n\r\n";
+
+    CHECK_EQ_INT(route(&table, bye_incoming), 0);
+    CHECK_EQ_INT(route(&table, ok_outgoing), 1);
+    CHECK_EQ_INT(route(&table, bye_wrong_tag), -1);
+
+    remove_key(&table, "in-7f3a@192.168.1.10", "d00rbe11");
+    CHECK_EQ_INT(route(&table, bye_incoming), -1);
+    CHECK_EQ_INT(route(&table, ok_outgoing), 1);
+    CHECK_EQ_INT(table.count, 1);
+}
+
+// Forked legs of one call share the Call-ID; the tag tells them apart, and
+// neither key is a prefix match for the other
+static void test_same_call_id(void)
+{
+    static sip_dialog_table_t table;
+    sip_dialog_table_clear(&table);
+    CHECK(insert(&table, "call", "a", 3));
+    CHECK(insert(&table, "call", "ab", 4));
+    CHECK(insert(&table, "cal", "la", 5));
+    CHECK(insert(&table, "call", "", 6));
+
+    CHECK_EQ_INT(find(&table, "call", "a"), 3);
+    CHECK_EQ_INT(find(&table, "call", "ab"), 4);
+    CHECK_EQ_INT(find(&table, "cal", "la"), 5);
+    CHECK_EQ_INT(find(&table, "call", ""), 6);
+    CHECK_EQ_INT(find(&table, "call", "b"), -1);
+    CHECK_EQ_INT(find(&table, "cal", "l"), -1);
+    CHECK_EQ_INT(table.count, 4);
+
+    // Inserting an existing key updates it
+    CHECK(insert(&table, "call", "a", 9));
+    CHECK_EQ_INT(find(&table, "call", "a"), 9);
+    CHECK_EQ_INT(table.count, 4);
+}
+
+// Two keys in the same bucket: removing the first must not cut the probe
+// chain to the second, and the freed slot is reused
+static void test_colliding_dialogs(void)
+{
+    static sip_dialog_table_t table;
+    char first[32];
+    char second[32];
+    int bucket = -1;
+
+    // Find two Call-IDs that land in the same slot
+    sip_dialog_table_clear(&table);
+    snprintf(first, sizeof(first), "collide-0");
+    CHECK(insert(&table, first, "t", 0));
+    for (int i = 0; i < SIP_DIALOG_TABLE_SLOTS; i++) {
+        if (table.slots[i].state != 0) {
+            bucket = i;
+        }
+    }
+    for (int n = 1; n < 10000; n++) {
+        static sip_dialog_table_t probe;
+        sip_dialog_table_clear(&probe);
+        snprintf(second, sizeof(second), "collide-%d", n);
+        insert(&probe, second, "t", 0);
+        if (probe.slots[bucket].state != 0) {
+            break;
+        }
+    }
+
+    CHECK(insert(&table, second, "t", 1));
+    CHECK_EQ_INT(find(&table, second, "t"), 1);
+    remove_key(&table, first, "t");
+    CHECK_EQ_INT(find(&table, first, "t"), -1);
+    CHECK_EQ_INT(find(&table, second, "t"), 1);
+
+    CHECK(insert(&table, first, "t", 2));
+    CHECK_EQ_INT(find(&table, first, "t"), 2);
+    CHECK_EQ_INT(find(&table, second, "t"), 1);
+    CHECK_EQ_INT(table.count, 2);
+}
+
+static void test_limits(void)
+{
+    static sip_dialog_table_t table;
+    char call_id[SIP_DIALOG_CALL_ID_LEN + 1];
+    char tag[SIP_DIALOG_TAG_LEN + 1];
+    sip_dialog_table_clear(&table);
+
+    memset(call_id, 'c', sizeof(call_id) - 1);
+    call_id[sizeof(call_id) - 1] = '\0';
+    memset(tag, 't', sizeof(tag) - 1);
+    tag[sizeof(tag) - 1] = '\0';
+    CHECK(!insert(&table, call_id, "t", 0));
+    CHECK(!insert(&table, "c", tag, 0));
+    CHECK_EQ_INT(find(&table, call_id, "t"), -1);
+    CHECK(!insert(&table, "c", "t", -1));
+
+    call_id[SIP_DIALOG_CALL_ID_LEN - 1] = '\0';
+    tag[SIP_DIALOG_TAG_LEN - 1] = '\0';
+    CHECK(insert(&table, call_id, tag, 7));
+    CHECK_EQ_INT(find(&table, call_id, tag), 7);
+
+    // One slot always stays empty so a failed lookup ends
+    sip_dialog_table_clear(&table);
+    char key[16];
+    for (int i = 0; i < SIP_DIALOG_TABLE_SLOTS - 1; i++) {
+        snprintf(key, sizeof(key), "full-%d", i);
+        CHECK(insert(&table, key, "t", i));
+    }
+    CHECK(!insert(&table, "one-too-many", "t", 99));
+    CHECK_EQ_INT(find(&table, "one-too-many", "t"), -1);
+    for (int i = 0; i < SIP_DIALOG_TABLE_SLOTS - 1; i++) {
+        snprintf(key, sizeof(key), "full-%d", i);
+        CHECK_EQ_INT(find(&table, key, "t"), i);
+    }
+    remove_key(&table, "full-3", "t");
+    CHECK(insert(&table, "one-too-many", "t", 99));
+    CHECK_EQ_INT(find(&table, "one-too-many", "t"), 99);
+}
+
+// Many calls over a long uptime, two dialogs at a time overlapping: deleted
+// slots must not pile up until every lookup walks the whole table
+static void test_churn(void)
+{
+    static sip_dialog_table_t table;
+    sip_dialog_table_clear(&table);
+    char key[32];
+    char previous[32] = "";
+
+    for (int call = 0; call < 20000; call++) {
+        snprintf(key, sizeof(key), "%08x@10.0.0.%d", (unsigned)(call * 2654435761u), call % 250);
+        CHECK(insert(&table, key, "tag", call & 0x3FFF));
+        if (previous[0]) {
+            CHECK_EQ_INT(find(&table, previous, "tag"), (call - 1) & 0x3FFF);
+            remove_key(&table, previous, "tag");
+        }
+        snprintf(previous, sizeof(previous), "%s", key);
+        if (test_failures > 0) {
+            printf("  call %d\n", call);
+            return;
+        }
+    }
+    CHECK_EQ_INT(table.count, 1);
+
+    int empty = 0;
+    for (int i = 0; i < SIP_DIALOG_TABLE_SLOTS; i++) {
+        empty += table.slots[i].state == 0;
+    }
+    CHECK(empty >= SIP_DIALOG_TABLE_SLOTS / 2);
+}
+
+int main(void)
+{
+    RUN_TEST(test_two_dialogs_route_messages);
+    RUN_TEST(test_same_call_id);
+    RUN_TEST(test_colliding_dialogs);
+    RUN_TEST(test_limits);
+    RUN_TEST(test_churn);
+    return TEST_RESULT();
+}
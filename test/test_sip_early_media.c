@@ -0,0 +1,98 @@
+#include "sip_client.h"
+#include "sip_harness.h"
+#include "media_engine.h"
+#include "esp_timer.h"
+#include "test_support.h"
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+// From the PBX's 200 OK to the first RTP packet the client sends, with and
+// without early media, in real time on loopback. With a 183 carrying SDP
+// the media engine is already running receive-only when the 200 arrives,
+// so the first packet only waits for the next 20 ms frame; without it the
+// engine starts on the 200.
+
+#define CALLS               10
+#define ANSWER_MS           300
+#define EARLY_MAX_US        40000   // Two frames: loose, for a loaded build machine
+
+static int compare(const void* a, const void* b)
+{
+    int64_t x = *(const int64_t*)a;
+    int64_t y = *(const int64_t*)b;
+    return (x > y) - (x < y);
+}
+
+// Answer-to-first-audio of each call to @p target; sorted
+static int measure(const char* target, bool early, int64_t* us)
+{
+    int count = 0;
+    for (int i = 0; i < CALLS; i++) {
+        int sent_before = pbx_stats()->rtp_packets;
+        int64_t pressed = esp_timer_get_time();
+        sip_client_make_call(target);
+        int64_t end = esp_timer_get_time() + 1000000;
+        while (pbx_stats()->provisional_us < pressed && esp_timer_get_time() < end) {
+            pbx_poll(1);
+        }
+
+        // Early media runs receive-only until the answer; otherwise nothing
+        // yet. Either way the client sends no audio before it.
+        pbx_poll(ANSWER_MS / 3);
+        CHECK_EQ_INT(media_engine_is_running(), early);
+        CHECK_EQ_INT(pbx_stats()->rtp_packets, sent_before);
+
+        CHECK(harness_wait_led(LED_STATE_CALL_ACTIVE, pressed, 2000) != 0);
+        end = esp_timer_get_time() + 500000;
+        while (pbx_stats()->first_rtp_us == 0 && esp_timer_get_time() < end) {
+            pbx_poll(1);
+        }
+        const pbx_stats_t* stats = pbx_stats();
+        CHECK(stats->first_rtp_us >= stats->answer_us);
+        if (stats->first_rtp_us >= stats->answer_us && count < CALLS) {
+            us[count++] = stats->first_rtp_us - stats->answer_us;
+        }
+
+        int64_t bye = esp_timer_get_time();
+        CHECK(pbx_hang_up());
+        CHECK(harness_wait_led(LED_STATE_IDLE, bye, 1000) != 0);
+        pbx_poll(20);
+    }
+    qsort(us, count, sizeof(us[0]), compare);
+    return count;
+}
+
+static void report(const char* name, const int64_t* us, int count)
+{
+    CHECK(count == CALLS);
+    if (count > 0) {
+        printf("  %-24s %6lld %6lld %6lld\n", name, (long long)us[0], (long long)us[count / 2],
+               (long long)us[count - 1]);
+    }
+}
+
+static void test_answer_to_first_audio(void)
+{
+    int64_t early[CALLS];
+    int64_t plain[CALLS];
+    int early_count = measure("201", true, early);
+    int plain_count = measure("202", false, plain);
+
+    printf("  200 OK -> first RTP (us)    min median    max\n");
+    report("183 with SDP, then 200", early, early_count);
+    report("180, then 200", plain, plain_count);
+    if (early_count > 0) {
+        CHECK(early[early_count - 1] < EARLY_MAX_US);
+    }
+}
+
+int main(void)
+{
+    setvbuf(stdout, NULL, _IOLBF, 0);
+    pbx_add_target("201", PBX_EARLY_MEDIA, ANSWER_MS);
+    pbx_add_target("202", PBX_ANSWER, ANSWER_MS);
+    CHECK(harness_start(SIP_TRANSPORT_UDP, "201", NULL));
+    RUN_TEST(test_answer_to_first_audio);
+    return TEST_RESULT();
+}
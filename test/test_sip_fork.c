@@ -0,0 +1,127 @@
+#include "sip_client.h"
+#include "sip_harness.h"
+#include "esp_timer.h"
+#include "test_support.h"
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+// A bell with several targets rings them all at once and the first 200 OK
+// wins, against stand-ins for the phones on the PBX, in real time on
+// loopback. Measured: press to call active, and from the winner's 200 to
+// every other leg being cleaned up (CANCEL answered with 487, or ACK and
+// BYE for a 200 that crossed the CANCEL).
+
+#define CALLS               5
+#define ANSWER_MS           100
+#define BUSY_MS             50
+#define LATE_MS             150
+#define CLEANUP_TIMEOUT_MS  1000
+#define SLACK_US            50000   // Loose, for a loaded build machine
+
+typedef struct {
+    const char* name;
+    const char* targets;
+    int invites;
+    int cancels;            // Expected per call
+    int terminated;         // 487s
+    int byes;               // For a late 200, before we hang up
+} scenario_t;
+
+static const scenario_t scenarios[] = {
+    { "answer + no answer", "301,302", 2, 1, 1, 0 },
+    { "busy, answer, no answer", "303,301,302", 3, 1, 1, 0 },
+    { "answer + late 200", "301,304", 2, 1, 0, 1 },
+};
+
+static int compare(const void* a, const void* b)
+{
+    int64_t x = *(const int64_t*)a;
+    int64_t y = *(const int64_t*)b;
+    return (x > y) - (x < y);
+}
+
+static bool cleaned_up(const pbx_stats_t* start, const scenario_t* s)
+{
+    const pbx_stats_t* now = pbx_stats();
+    return now->cancels - start->cancels == s->cancels && now->terminated - start->terminated == s->terminated &&
+           now->byes - start->byes == s->byes;
+}
+
+static void run(const scenario_t* s)
+{
+    int64_t to_answer[CALLS];
+    int64_t to_clean[CALLS];
+    int count = 0;
+
+    for (int i = 0; i < CALLS; i++) {
+        pbx_stats_t start = *pbx_stats();
+        int64_t pressed = esp_timer_get_time();
+        sip_client_make_call(s->targets);
+        int64_t active = harness_wait_led(LED_STATE_CALL_ACTIVE, pressed, 2000);
+        CHECK(active != 0);
+        int64_t answered = pbx_stats()->answer_us;
+
+        int64_t end = esp_timer_get_time() + CLEANUP_TIMEOUT_MS * 1000;
+        while (!cleaned_up(&start, s) && esp_timer_get_time() < end) {
+            pbx_poll(1);
+        }
+        int64_t cleaned = esp_timer_get_time();
+        pbx_poll(LATE_MS);      // Nothing else may follow
+
+        const pbx_stats_t* stats = pbx_stats();
+        CHECK_EQ_INT(stats->invites - start.invites, s->invites);
+        CHECK_EQ_INT(stats->cancels - start.cancels, s->cancels);
+        CHECK_EQ_INT(stats->terminated - start.terminated, s->terminated);
+        CHECK_EQ_INT(stats->byes - start.byes, s->byes);
+        CHECK_EQ_INT(sip_client_get_state(), SIP_STATE_CONNECTED);
+        if (active != 0 && cleaned_up(&start, s) && count < CALLS) {
+            to_answer[count] = active - pressed;
+            to_clean[count] = cleaned - answered;
+            count++;
+        }
+
+        // We hang up: one more BYE, to the winner
+        sip_client_hangup();
+        end = esp_timer_get_time() + 1000000;
+        while (pbx_stats()->byes - start.byes < s->byes + 1 && esp_timer_get_time() < end) {
+            pbx_poll(1);
+        }
+        CHECK_EQ_INT(pbx_stats()->byes - start.byes, s->byes + 1);
+        pbx_poll(20);
+        CHECK_EQ_INT(sip_client_get_state(), SIP_STATE_REGISTERED);
+    }
+
+    CHECK(count == CALLS);
+    if (count > 0) {
+        qsort(to_answer, count, sizeof(to_answer[0]), compare);
+        qsort(to_clean, count, sizeof(to_clean[0]), compare);
+        printf("  %-26s %8lld %8lld %8lld %8lld\n", s->name, (long long)to_answer[0],
+               (long long)to_answer[count / 2], (long long)to_clean[0], (long long)to_clean[count / 2]);
+        // A late 200 only arrives LATE_MS - ANSWER_MS after the winner's
+        int64_t wait_us = s->byes ? (LATE_MS - ANSWER_MS) * 1000 : 0;
+        CHECK(to_answer[count / 2] < ANSWER_MS * 1000 + SLACK_US);
+        CHECK(to_clean[count / 2] < wait_us + SLACK_US);
+    }
+}
+
+static void test_first_answer_wins(void)
+{
+    printf("  %-26s %17s %17s\n", "", "press -> active", "200 -> cleaned up");
+    printf("  %-26s %8s %8s %8s %8s\n", "(us)", "min", "median", "min", "median");
+    for (size_t i = 0; i < sizeof(scenarios) / sizeof(scenarios[0]); i++) {
+        run(&scenarios[i]);
+    }
+}
+
+int main(void)
+{
+    setvbuf(stdout, NULL, _IOLBF, 0);
+    pbx_add_target("301", PBX_ANSWER, ANSWER_MS);
+    pbx_add_target("302", PBX_NO_ANSWER, 0);
+    pbx_add_target("303", PBX_BUSY, BUSY_MS);
+    pbx_add_target("304", PBX_ANSWER_LATE, LATE_MS);
+    CHECK(harness_start(SIP_TRANSPORT_UDP, "301,302", "301,304"));
+    RUN_TEST(test_first_answer_wins);
+    return TEST_RESULT();
+}
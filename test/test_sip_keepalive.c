@@ -0,0 +1,236 @@
+#include "sip_keepalive.h"
+#include "test_support.h"
+#include <stdint.h>
+#include <stdbool.h>
+
+// The scheduler is polled every 100 ms like the SIP task does. The NAT
+// model forgets our UDP binding after a fixed idle time and hands out a new
+// public port on the next packet; the registrar reports the port it sees in
+// every OPTIONS response, and a REGISTER re-establishes the binding.
+
+#define STEP_MS             100
+#define PUBLIC_ADDRESS      "203.0.113.7"
+
+typedef struct {
+    uint32_t lifetime_ms;           // UINT32_MAX: never expires
+    uint32_t last_out;
+    uint16_t port;
+    uint32_t rtt_ms;
+    bool answer;                    // Registrar reachable
+    uint32_t reregisters;
+    uint32_t options;
+    uint32_t crlfs;
+} nat_t;
+
+static uint32_t now;
+
+// Start from scratch: the learned state is only kept for the same kind of
+// transport, so switching kinds twice resets it
+static void fresh_start(bool stream, nat_t* nat)
+{
+    sip_keepalive_start(!stream, NULL, 0, now);
+    sip_keepalive_start(stream, PUBLIC_ADDRESS, nat->port, now);
+    nat->last_out = now;
+}
+
+static void nat_outbound(nat_t* nat)
+{
+    if (nat->lifetime_ms != UINT32_MAX && now - nat->last_out > nat->lifetime_ms) {
+        nat->port++;
+    }
+    nat->last_out = now;
+}
+
+static void run_udp(nat_t* nat, uint32_t duration_ms)
+{
+    uint32_t end = now + duration_ms;
+    while (now < end) {
+        now += STEP_MS;
+        sip_keepalive_action_t action = sip_keepalive_poll(now);
+        if (action == SIP_KEEPALIVE_SEND_CRLF) {
+            nat->crlfs++;
+            nat_outbound(nat);
+        } else if (action == SIP_KEEPALIVE_SEND_OPTIONS) {
+            nat->options++;
+            nat_outbound(nat);
+            if (nat->answer && sip_keepalive_on_response(PUBLIC_ADDRESS, nat->port, now + nat->rtt_ms) ==
+                SIP_KEEPALIVE_REREGISTER) {
+                action = SIP_KEEPALIVE_REREGISTER;
+            }
+        }
+        if (action == SIP_KEEPALIVE_REREGISTER) {
+            nat->reregisters++;
+            nat_outbound(nat);
+            if (nat->answer) {
+                sip_keepalive_start(false, PUBLIC_ADDRESS, nat->port, now);
+            }
+        }
+    }
+}
+
+// The interval grows while the binding holds, and settles 20% below the
+// first interval that lost it; after that the binding is never lost again
+static void test_udp_learns_nat_lifetime(void)
+{
+    // Probes go out at 20, 25, ... 45 s gaps plus the round trip; 50 s is lost
+    nat_t nat = { .lifetime_ms = 47000, .port = 40000, .rtt_ms = 30, .answer = true };
+    now = 1000;
+    fresh_start(false, &nat);
+    run_udp(&nat, 3600 * 1000);
+
+    sip_keepalive_stats_t stats;
+    sip_keepalive_get_stats(&stats);
+    CHECK(stats.running);
+    CHECK(!stats.stream);
+    CHECK(stats.interval_learned);
+    CHECK_EQ_INT(stats.interval_ms, 40000);
+    CHECK_EQ_INT(stats.binding_changes, 1);
+    CHECK_EQ_INT(nat.reregisters, 1);
+    CHECK_EQ_INT(stats.probes_lost, 0);
+    CHECK_EQ_INT(stats.last_rtt_ms, 30);
+
+    // Once learned, two in three probes are a bare CRLF
+    CHECK(nat.crlfs > nat.options);
+}
+
+// A NAT that keeps bindings for longer than we probe: stop at the maximum
+static void test_udp_interval_caps(void)
+{
+    nat_t nat = { .lifetime_ms = UINT32_MAX, .port = 40000, .rtt_ms = 30, .answer = true };
+    now = 1000;
+    fresh_start(false, &nat);
+    run_udp(&nat, 6 * 3600 * 1000);
+
+    sip_keepalive_stats_t stats;
+    sip_keepalive_get_stats(&stats);
+    CHECK(stats.interval_learned);
+    CHECK_EQ_INT(stats.interval_ms, SIP_KEEPALIVE_UDP_MAX_MS);
+    CHECK_EQ_INT(stats.binding_changes, 0);
+    CHECK_EQ_INT(nat.reregisters, 0);
+}
+
+// Unanswered probes: one retry SIP_KEEPALIVE_RETRY_MS after the first is
+// lost, then re-register
+static void test_udp_lost_probes(void)
+{
+    nat_t nat = { .lifetime_ms = UINT32_MAX, .port = 40000, .answer = false };
+    now = 0;
+    fresh_start(false, &nat);
+
+    uint32_t first = SIP_KEEPALIVE_UDP_INITIAL_MS;
+    uint32_t reregister_at = 0;
+    while (now < first + 60000 && !reregister_at) {
+        now += STEP_MS;
+        if (sip_keepalive_poll(now) == SIP_KEEPALIVE_REREGISTER) {
+            reregister_at = now;
+        }
+    }
+    CHECK_EQ_INT(reregister_at,
+                 first + SIP_KEEPALIVE_TIMEOUT_MS + SIP_KEEPALIVE_RETRY_MS + SIP_KEEPALIVE_TIMEOUT_MS);
+
+    sip_keepalive_stats_t stats;
+    sip_keepalive_get_stats(&stats);
+    CHECK_EQ_INT(stats.probes_sent, 2);
+    CHECK_EQ_INT(stats.probes_lost, 2);
+    CHECK_EQ_INT(stats.reregisters, 1);
+    CHECK_EQ_INT(stats.probes_answered, 0);
+}
+
+// Responses that do not belong to a probe in flight change nothing
+static void test_stray_responses(void)
+{
+    nat_t nat = { .lifetime_ms = UINT32_MAX, .port = 40000 };
+    now = 0;
+    fresh_start(false, &nat);
+
+    CHECK_EQ_INT(sip_keepalive_on_response(PUBLIC_ADDRESS, 50000, now), SIP_KEEPALIVE_IDLE);
+    sip_keepalive_on_pong(now);
+    sip_keepalive_stats_t stats;
+    sip_keepalive_get_stats(&stats);
+    CHECK_EQ_INT(stats.probes_answered, 0);
+    CHECK_EQ_INT(stats.binding_changes, 0);
+    CHECK_EQ_INT(sip_keepalive_next_ms(now), SIP_KEEPALIVE_UDP_INITIAL_MS);
+
+    sip_keepalive_stop();
+    CHECK_EQ_INT(sip_keepalive_poll(now + SIP_KEEPALIVE_UDP_INITIAL_MS), SIP_KEEPALIVE_IDLE);
+    CHECK_EQ_INT(sip_keepalive_next_ms(now), UINT32_MAX);
+}
+
+// TCP/TLS: CRLF pings while the registrar pongs; a registrar that never
+// pongs is probed with OPTIONS from then on, without counting a loss
+static void test_stream_pong_fallback(void)
+{
+    nat_t nat = { .port = 5060 };
+    now = 0;
+    fresh_start(true, &nat);
+
+    now = SIP_KEEPALIVE_STREAM_MS;
+    CHECK_EQ_INT(sip_keepalive_poll(now), SIP_KEEPALIVE_SEND_CRLF);
+    sip_keepalive_on_pong(now + 40);
+
+    now += SIP_KEEPALIVE_STREAM_MS + 40;
+    CHECK_EQ_INT(sip_keepalive_poll(now), SIP_KEEPALIVE_SEND_CRLF);
+    sip_keepalive_stats_t stats;
+    sip_keepalive_get_stats(&stats);
+    CHECK(stats.pong_supported);
+    CHECK_EQ_INT(stats.last_rtt_ms, 40);
+
+    // New connection to a registrar without pongs
+    fresh_start(true, &nat);
+    now += SIP_KEEPALIVE_STREAM_MS;
+    CHECK_EQ_INT(sip_keepalive_poll(now), SIP_KEEPALIVE_SEND_CRLF);
+    now += SIP_KEEPALIVE_TIMEOUT_MS;
+    CHECK_EQ_INT(sip_keepalive_poll(now), SIP_KEEPALIVE_SEND_OPTIONS);
+    CHECK_EQ_INT(sip_keepalive_on_response(NULL, 0, now + 25), SIP_KEEPALIVE_IDLE);
+
+    sip_keepalive_get_stats(&stats);
+    CHECK(!stats.pong_supported);
+    CHECK_EQ_INT(stats.probes_lost, 0);
+    CHECK_EQ_INT(stats.probes_answered, 1);
+    CHECK_EQ_INT(stats.interval_ms, SIP_KEEPALIVE_STREAM_MS);
+}
+
+// The histogram holds the last SIP_KEEPALIVE_RTT_WINDOW round trips
+static void test_rtt_histogram(void)
+{
+    static const uint32_t rtts[] = { 10, 60, 700, 3000 };
+    static const int buckets[] = { 0, 2, 5, 7 };
+    nat_t nat = { .port = 5060 };
+    now = 0;
+    fresh_start(true, &nat);
+
+    for (int i = 0; i < 4; i++) {
+        now += SIP_KEEPALIVE_STREAM_MS + 5000;
+        CHECK_EQ_INT(sip_keepalive_poll(now), SIP_KEEPALIVE_SEND_CRLF);
+        sip_keepalive_on_pong(now + rtts[i]);
+    }
+    sip_keepalive_stats_t stats;
+    sip_keepalive_get_stats(&stats);
+    for (int i = 0; i < 4; i++) {
+        CHECK_EQ_INT(stats.rtt_histogram[buckets[i]], 1);
+    }
+
+    for (int i = 0; i < SIP_KEEPALIVE_RTT_WINDOW; i++) {
+        now += SIP_KEEPALIVE_STREAM_MS + 5000;
+        sip_keepalive_poll(now);
+        sip_keepalive_on_pong(now + 300);
+    }
+    sip_keepalive_get_stats(&stats);
+    CHECK_EQ_INT(stats.rtt_histogram[4], SIP_KEEPALIVE_RTT_WINDOW);
+    int total = 0;
+    for (int i = 0; i < SIP_KEEPALIVE_RTT_BUCKETS; i++) {
+        total += stats.rtt_histogram[i];
+    }
+    CHECK_EQ_INT(total, SIP_KEEPALIVE_RTT_WINDOW);
+}
+
+int main(void)
+{
+    RUN_TEST(test_udp_learns_nat_lifetime);
+    RUN_TEST(test_udp_interval_caps);
+    RUN_TEST(test_udp_lost_probes);
+    RUN_TEST(test_stray_responses);
+    RUN_TEST(test_stream_pong_fallback);
+    RUN_TEST(test_rtt_histogram);
+    return TEST_RESULT();
+}
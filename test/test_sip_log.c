@@ -0,0 +1,166 @@
+#define _GNU_SOURCE     // RUSAGE_THREAD
+
+#include "sip_log.h"
+#include "ntp_sync.h"
+#include "test_support.h"
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+
+// sip_log_write() is called from the SIP task on every message sent and
+// received, so it must cost well under a microsecond and never give up the
+// CPU. The console drain task runs alongside (its output is compiled out on
+// the host), reading the ring without a lock while the test writes.
+
+#define WRITES          20000
+#define BENCH_RUNS      7
+#define WRITE_LIMIT_NS  1000    // Loose, for a loaded build machine
+
+bool ntp_is_synced(void)
+{
+    return false;
+}
+
+uint64_t ntp_get_timestamp_ms(void)
+{
+    return 0;
+}
+
+int ntp_log_timestamp(char* buffer, size_t buffer_len)
+{
+    return 0;
+}
+
+static int64_t now_ns(void)
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (int64_t)t.tv_sec * 1000000000 + t.tv_nsec;
+}
+
+// Times this thread gave up the CPU of its own accord (blocked or yielded)
+static long voluntary_switches(void)
+{
+    struct rusage usage;
+    getrusage(RUSAGE_THREAD, &usage);
+    return usage.ru_nvcsw;
+}
+
+#define MAX_ENTRIES     2048    // More than the ring holds
+
+static sip_log_entry_t entries[MAX_ENTRIES];
+
+static void test_read_back(void)
+{
+    sip_log_write(SIP_LOG_SENT, "REGISTER sip:pbx.example SIP/2.0");
+    sip_log_write(SIP_LOG_RECEIVED, "SIP/2.0 401 Unauthorized");
+    sip_log_write(SIP_LOG_ERROR, "Registration failed");
+
+    int count = sip_get_log_entries(entries, MAX_ENTRIES, 0);
+    CHECK_EQ_INT(count, 3);
+    CHECK_EQ_STR(entries[0].type, "sent");
+    CHECK_EQ_STR(entries[0].message, "REGISTER sip:pbx.example SIP/2.0");
+    CHECK_EQ_STR(entries[1].type, "received");
+    CHECK_EQ_STR(entries[2].type, "error");
+    CHECK_EQ_STR(entries[2].message, "Registration failed");
+    CHECK_EQ_INT(entries[1].seq, entries[0].seq + 1);
+    CHECK_EQ_INT(entries[2].seq, entries[1].seq + 1);
+}
+
+static void test_long_message_truncated(void)
+{
+    char message[SIP_LOG_MAX_MESSAGE_LEN + 100];
+    memset(message, 'x', sizeof(message) - 1);
+    message[sizeof(message) - 1] = '\0';
+    sip_log_write(SIP_LOG_INFO, message);
+
+    int count = sip_get_log_entries(entries, MAX_ENTRIES, 0);
+    CHECK(count > 0);
+    CHECK_EQ_INT((int)strlen(entries[count - 1].message), SIP_LOG_MAX_MESSAGE_LEN - 1);
+}
+
+// Once the writers have gone round the ring, readers get the newest records
+// without a gap, up to the last one written
+static void test_wrap_keeps_newest(void)
+{
+    char message[64];
+    for (int i = 0; i < 2000; i++) {
+        snprintf(message, sizeof(message), "record %d", i);
+        sip_log_write(SIP_LOG_INFO, message);
+    }
+
+    int count = sip_get_log_entries(entries, MAX_ENTRIES, 0);
+    CHECK(count > 100 && count < MAX_ENTRIES);
+    for (int i = 1; i < count; i++) {
+        CHECK_EQ_INT(entries[i].seq, entries[i - 1].seq + 1);
+    }
+    if (count > 0) {
+        CHECK_EQ_STR(entries[count - 1].message, "record 1999");
+    }
+}
+
+// Best of BENCH_RUNS: ns per write of @p message, and how often the writing
+// thread blocked or yielded in all the runs
+static double bench(const char* message, long* switches)
+{
+    double best = 1e30;
+    *switches = 0;
+    for (int run = 0; run < BENCH_RUNS; run++) {
+        long before = voluntary_switches();
+        int64_t start = now_ns();
+        for (int i = 0; i < WRITES; i++) {
+            sip_log_write(SIP_LOG_SENT, message);
+        }
+        int64_t took = now_ns() - start;
+        *switches += voluntary_switches() - before;
+        double per_write = (double)took / WRITES;
+        if (per_write < best) {
+            best = per_write;
+        }
+    }
+    return best;
+}
+
+static void test_write_speed(void)
+{
+    static const char short_line[] = "SIP/2.0 100 Trying";
+    static const char request_line[] =
+        "INVITE sip:201@pbx.example SIP/2.0 (Call-ID a84b4c76e66710@192.0.2.4, CSeq 314159)";
+    char full[SIP_LOG_MAX_MESSAGE_LEN];
+    memset(full, 'v', sizeof(full) - 1);
+    full[sizeof(full) - 1] = '\0';
+
+    struct {
+        const char* name;
+        const char* message;
+    } cases[] = {
+        { "short status line", short_line },
+        { "request line + ids", request_line },
+        { "full 255 bytes", full },
+    };
+
+    printf("  sip_log_write             bytes  ns/write  yields\n");
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        long switches;
+        double ns = bench(cases[i].message, &switches);
+        printf("  %-24s %6zu %9.1f %7ld\n", cases[i].name, strlen(cases[i].message), ns, switches);
+        CHECK(ns < WRITE_LIMIT_NS);
+        CHECK_EQ_INT((int)switches, 0);
+    }
+}
+
+int main(void)
+{
+    setvbuf(stdout, NULL, _IOLBF, 0);
+    sip_log_init();
+    usleep(2000);   // Readers skip records stamped 0 ms (since_timestamp 0)
+    RUN_TEST(test_read_back);
+    RUN_TEST(test_long_message_truncated);
+    RUN_TEST(test_wrap_keeps_newest);
+    RUN_TEST(test_write_speed);
+    return TEST_RESULT();
+}
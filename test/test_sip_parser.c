@@ -0,0 +1,502 @@
+#include "sip_parser.h"
+#include "esp_heap_trace.h"
+#include "test_support.h"
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+
+// Messages are written the way they arrive from the wire; several are cut
+// down from the RFC 4475 torture tests where the parser has to be lenient
+
+static bool parse(const char* text, sip_message_t* msg)
+{
+    return sip_parse_message(text, strlen(text), msg);
+}
+
+static const char* header_value(const sip_message_t* msg, sip_header_id_t id, char* buf, size_t size)
+{
+    if (!sip_msg_copy_header(msg, id, buf, size)) {
+        return "(missing)";
+    }
+    return buf;
+}
+
+static void test_invite_from_pbx(void)
+{
+    static const char invite[] =
+        "INVITE sip:doorbell@192.168.1.50:5060;transport=udp SIP/2.0\r\n"
+        "Via: SIP/2.0/UDP 192.168.1.10:5060;branch=z9hG4bK6c2a1b7f;rport\r\n"
+        "Max-Forwards: 70\r\n"
+        "From: \"Front Door\" <sip:100@192.168.1.10>;tag=as5f3e1c2a\r\n"
+        "To: <sip:doorbell@192.168.1.50:5060>\r\n"
+        "Contact: <sip:100@192.168.1.10:5060>\r\n"
+        "Call-ID: 3c26700f3b1e4cbd@192.168.1.10\r\n"
+        "CSeq: 102 INVITE\r\n"
+        "Allow: INVITE, ACK, CANCEL, OPTIONS, BYE, REFER, NOTIFY, INFO\r\n"
+        "Content-Type: application/sdp\r\n"
+        "Content-Length: 10\r\n"
+        "\r\n"
+        "v=0\r\no=- 1\r\n";
+    sip_message_t msg;
+    char buf[128];
+
+    CHECK(parse(invite, &msg));
+    CHECK(!msg.is_response);
+    CHECK_EQ_INT(msg.method, SIP_METHOD_INVITE);
+    CHECK_EQ_INT(msg.request_uri_len, strlen("sip:doorbell@192.168.1.50:5060;transport=udp"));
+    CHECK(memcmp(msg.request_uri, "sip:doorbell@192.168.1.50:5060;transport=udp", msg.request_uri_len) == 0);
+    CHECK_EQ_INT(msg.cseq_num, 102);
+    CHECK_EQ_INT(msg.cseq_method, SIP_METHOD_INVITE);
+    CHECK_EQ_INT(msg.header_count, 10);
+    CHECK_EQ_STR(header_value(&msg, SIP_HDR_CALL_ID, buf, sizeof(buf)), "3c26700f3b1e4cbd@192.168.1.10");
+    CHECK_EQ_STR(header_value(&msg, SIP_HDR_CONTENT_TYPE, buf, sizeof(buf)), "application/sdp");
+
+    // The body stops at Content-Length, not at the end of the datagram
+    CHECK_EQ_INT(msg.body_len, 10);
+    CHECK(memcmp(msg.body, "v=0\r\no=- 1", 10) == 0);
+
+    const sip_header_t* via = sip_msg_header(&msg, SIP_HDR_VIA);
+    CHECK(sip_header_copy_param(via, "branch", buf, sizeof(buf)));
+    CHECK_EQ_STR(buf, "z9hG4bK6c2a1b7f");
+    const char* value;
+    size_t value_len = 99;
+    CHECK(sip_header_param(via, "rport", &value, &value_len));
+    CHECK_EQ_INT(value_len, 0);
+
+    const sip_header_t* from = sip_msg_header(&msg, SIP_HDR_FROM);
+    CHECK(sip_header_copy_param(from, "tag", buf, sizeof(buf)));
+    CHECK_EQ_STR(buf, "as5f3e1c2a");
+    CHECK(sip_header_copy_uri(from, buf, sizeof(buf)));
+    CHECK_EQ_STR(buf, "sip:100@192.168.1.10");
+
+    // The To of an initial INVITE has no tag, and ;transport inside <> is
+    // a URI parameter, not a header parameter
+    const sip_header_t* to = sip_msg_header(&msg, SIP_HDR_TO);
+    CHECK(!sip_header_param(to, "tag", &value, &value_len));
+    CHECK(sip_header_copy_uri(to, buf, sizeof(buf)));
+    CHECK_EQ_STR(buf, "sip:doorbell@192.168.1.50:5060");
+}
+
+static void test_response(void)
+{
+    static const char ok[] =
+        "SIP/2.0 401 Unauthorized\r\n"
+        "Via: SIP/2.0/UDP 192.168.1.50:5060;branch=z9hG4bKabc;received=10.0.0.7;rport=40123\r\n"
+        "From: <sip:doorbell@pbx.example>;tag=1234\r\n"
+        "To: <sip:doorbell@pbx.example>;tag=srv99\r\n"
+        "Call-ID: reg-1\r\n"
+        "CSeq: 7 REGISTER\r\n"
+        "WWW-Authenticate: Digest realm=\"pbx\", nonce=\"a;b,c\", algorithm=MD5, qop=\"auth\"\r\n"
+        "Content-Length: 0\r\n"
+        "\r\n";
+    sip_message_t msg;
+    char buf[64];
+
+    CHECK(parse(ok, &msg));
+    CHECK(msg.is_response);
+    CHECK_EQ_INT(msg.status_code, 401);
+    CHECK_EQ_INT(msg.reason_len, strlen("Unauthorized"));
+    CHECK(memcmp(msg.reason, "Unauthorized", msg.reason_len) == 0);
+    CHECK_EQ_INT(msg.cseq_num, 7);
+    CHECK_EQ_INT(msg.cseq_method, SIP_METHOD_REGISTER);
+    CHECK_EQ_INT(msg.body_len, 0);
+
+    const sip_header_t* via = sip_msg_header(&msg, SIP_HDR_VIA);
+    CHECK(sip_header_copy_param(via, "received", buf, sizeof(buf)));
+    CHECK_EQ_STR(buf, "10.0.0.7");
+    CHECK(sip_header_copy_param(via, "rport", buf, sizeof(buf)));
+    CHECK_EQ_STR(buf, "40123");
+    CHECK(sip_header_copy_param(sip_msg_header(&msg, SIP_HDR_TO), "tag", buf, sizeof(buf)));
+    CHECK_EQ_STR(buf, "srv99");
+
+    // Too small a buffer is a failure, not a truncated copy
+    CHECK(!sip_header_copy_param(via, "received", buf, 8));
+    CHECK(!sip_msg_copy_header(&msg, SIP_HDR_CALL_ID, buf, 5));
+    CHECK(sip_msg_copy_header(&msg, SIP_HDR_CALL_ID, buf, 6));
+    CHECK(sip_msg_header(&msg, SIP_HDR_WWW_AUTHENTICATE) != NULL);
+    CHECK(sip_msg_header(&msg, SIP_HDR_PROXY_AUTHENTICATE) == NULL);
+}
+
+// Compact forms, case-insensitive names, whitespace around the colon,
+// folded lines, bare LF line ends and leading CRLF keep-alives
+static void test_lenient_forms(void)
+{
+    static const char bye[] =
+        "\r\n\r\n"
+        "BYE sip:doorbell@192.168.1.50 SIP/2.0\n"
+        "v: SIP/2.0/UDP 192.168.1.10;branch=z9hG4bK1\n"
+        "f: <sip:100@pbx>;tag=a\n"
+        "t:<sip:doorbell@pbx>;tag=b\n"
+        "i  :  compact-call-id  \n"
+        "cseq: 3\n"
+        " BYE\n"
+        "SUBJECT: folded\n"
+        "\tover two lines\n"
+        "l: 0\n"
+        "\n";
+    sip_message_t msg;
+    char buf[64];
+
+    CHECK(parse(bye, &msg));
+    CHECK_EQ_INT(msg.method, SIP_METHOD_BYE);
+    CHECK(sip_msg_header(&msg, SIP_HDR_VIA) != NULL);
+    CHECK(sip_msg_header(&msg, SIP_HDR_FROM) != NULL);
+    CHECK_EQ_STR(header_value(&msg, SIP_HDR_TO, buf, sizeof(buf)), "<sip:doorbell@pbx>;tag=b");
+    CHECK_EQ_STR(header_value(&msg, SIP_HDR_CALL_ID, buf, sizeof(buf)), "compact-call-id");
+    CHECK_EQ_STR(header_value(&msg, SIP_HDR_CSEQ, buf, sizeof(buf)), "3\n BYE");
+    CHECK_EQ_INT(msg.cseq_num, 3);
+    CHECK_EQ_INT(msg.body_len, 0);
+
+    const sip_header_t* subject = NULL;
+    for (int i = 0; i < msg.header_count; i++) {
+        if (msg.headers[i].name_len == 7 && memcmp(msg.headers[i].name, "SUBJECT", 7) == 0) {
+            subject = &msg.headers[i];
+        }
+    }
+    CHECK(subject != NULL);
+    if (subject) {
+        CHECK_EQ_INT(subject->id, SIP_HDR_OTHER);
+        CHECK_EQ_INT(subject->value_len, strlen("folded\n\tover two lines"));
+    }
+}
+
+static void test_unknown_method_and_headers(void)
+{
+    static const char publish[] =
+        "PUBLISH sip:presence@pbx SIP/2.0\r\n"
+        "Event: presence\r\n"
+        "CSeq: 1 PUBLISH\r\n"
+        "\r\n";
+    sip_message_t msg;
+
+    CHECK(parse(publish, &msg));
+    CHECK_EQ_INT(msg.method, SIP_METHOD_UNKNOWN);
+    CHECK_EQ_INT(msg.method_name_len, 7);
+    CHECK(memcmp(msg.method_name, "PUBLISH", 7) == 0);
+    CHECK_EQ_INT(msg.cseq_method, SIP_METHOD_UNKNOWN);
+    CHECK_EQ_INT(msg.headers[0].id, SIP_HDR_OTHER);
+    CHECK_EQ_STR(sip_method_name(SIP_METHOD_REFER), "REFER");
+    CHECK_EQ_STR(sip_method_name(SIP_METHOD_UNKNOWN), "UNKNOWN");
+}
+
+static void test_rejects_malformed(void)
+{
+    sip_message_t msg;
+
+    CHECK(!parse("", &msg));
+    CHECK(!parse("\r\n\r\n", &msg));
+    CHECK(!parse("SIP/2.0 99 Too Low\r\n\r\n", &msg));
+    CHECK(!parse("SIP/2.0 700 Too High\r\n\r\n", &msg));
+    CHECK(!parse("INVITE sip:a@b SIP/3.0\r\n\r\n", &msg));
+    CHECK(!parse("INVITE sip:a@b\r\n\r\n", &msg));
+    CHECK(!parse(" sip:a@b SIP/2.0\r\n\r\n", &msg));
+    CHECK(!parse("OPTIONS sip:a@b SIP/2.0\r\nNo colon here\r\n\r\n", &msg));
+    CHECK(!sip_parse_message(NULL, 0, &msg));
+}
+
+// A Content-Length larger than what arrived leaves the body as received;
+// headers past SIP_MAX_HEADERS are skipped but the body is still found
+static void test_limits(void)
+{
+    static const char truncated[] =
+        "MESSAGE sip:a@b SIP/2.0\r\n"
+        "Content-Length: 500\r\n"
+        "\r\n"
+        "short";
+    sip_message_t msg;
+
+    CHECK(parse(truncated, &msg));
+    CHECK_EQ_INT(msg.body_len, 5);
+
+    char many[4096];
+    size_t len = (size_t)snprintf(many, sizeof(many), "OPTIONS sip:a@b SIP/2.0\r\n");
+    for (int i = 0; i < SIP_MAX_HEADERS + 8; i++) {
+        len += (size_t)snprintf(many + len, sizeof(many) - len, "X-Filler-%d: %d\r\n", i, i);
+    }
+    len += (size_t)snprintf(many + len, sizeof(many) - len, "CSeq: 9 OPTIONS\r\nContent-Length: 2\r\n\r\nok");
+
+    CHECK(sip_parse_message(many, len, &msg));
+    CHECK_EQ_INT(msg.header_count, SIP_MAX_HEADERS);
+    CHECK_EQ_INT(msg.cseq_num, 9);
+    CHECK_EQ_INT(msg.body_len, 2);
+    CHECK(memcmp(msg.body, "ok", 2) == 0);
+}
+
+// Display names may hold ';', ',' and '<' inside quotes; only the first
+// entry of a comma-separated Contact is searched
+static void test_params_skip_quotes_and_uris(void)
+{
+    static const char notify[] =
+        "NOTIFY sip:a@b SIP/2.0\r\n"
+        "From: \"Door \\\"A\\\"; Gate, <Side>\" <sip:gate@pbx;tag=uri-param>;tag=real\r\n"
+        "Contact: <sip:a@10.0.0.1>;expires=60, <sip:b@10.0.0.2>;expires=3600;q=0.5\r\n"
+        "To: sip:doorbell@pbx;tag=bare\r\n"
+        "\r\n";
+    sip_message_t msg;
+    char buf[64];
+
+    CHECK(parse(notify, &msg));
+    const sip_header_t* from = sip_msg_header(&msg, SIP_HDR_FROM);
+    CHECK(sip_header_copy_param(from, "TAG", buf, sizeof(buf)));
+    CHECK_EQ_STR(buf, "real");
+    CHECK(sip_header_copy_uri(from, buf, sizeof(buf)));
+    CHECK_EQ_STR(buf, "sip:gate@pbx;tag=uri-param");
+
+    const sip_header_t* contact = sip_msg_header(&msg, SIP_HDR_CONTACT);
+    CHECK(sip_header_copy_param(contact, "expires", buf, sizeof(buf)));
+    CHECK_EQ_STR(buf, "60");
+    CHECK(!sip_header_copy_param(contact, "q", buf, sizeof(buf)));
+
+    const sip_header_t* to = sip_msg_header(&msg, SIP_HDR_TO);
+    CHECK(sip_header_copy_uri(to, buf, sizeof(buf)));
+    CHECK_EQ_STR(buf, "sip:doorbell@pbx");
+    CHECK(sip_header_copy_param(to, "tag", buf, sizeof(buf)));
+    CHECK_EQ_STR(buf, "bare");
+}
+
+// Numbers past 2^31 - 1 are refused rather than wrapped: long is 32 bits
+// on the ESP32, and CSeq numbers are limited to 2^31 (RFC 3261 §8.1.1.5)
+static void test_number_overflow(void)
+{
+    sip_message_t msg;
+
+    CHECK(parse("OPTIONS sip:a@b SIP/2.0\r\nCSeq: 2147483647 OPTIONS\r\n\r\n", &msg));
+    CHECK_EQ_INT(msg.cseq_num, 2147483647);
+    CHECK_EQ_INT(msg.cseq_method, SIP_METHOD_OPTIONS);
+
+    CHECK(parse("OPTIONS sip:a@b SIP/2.0\r\nCSeq: 2147483648 OPTIONS\r\n\r\n", &msg));
+    CHECK_EQ_INT(msg.cseq_num, 0);
+    CHECK(parse("OPTIONS sip:a@b SIP/2.0\r\nCSeq: 99999999999999999999999 OPTIONS\r\n\r\n", &msg));
+    CHECK_EQ_INT(msg.cseq_num, 0);
+
+    // 2^32 + 2 would wrap to 2 in 32 bits; refused, the whole body is kept
+    CHECK(parse("MESSAGE sip:a@b SIP/2.0\r\nContent-Length: 4294967298\r\n\r\nhello", &msg));
+    CHECK_EQ_INT(msg.body_len, 5);
+
+    CHECK(!parse("SIP/2.0 4294967496 OK\r\n\r\n", &msg));
+}
+
+// Benchmark corpus: messages as PBXs and phones send them (Asterisk,
+// FreeSWITCH, a Fritz!Box, a Yealink phone), headers in their order
+static const char* const corpus[] = {
+    "INVITE sip:doorbell@192.168.1.50:5060 SIP/2.0\r\n"
+    "Via: SIP/2.0/UDP 192.168.1.10:5060;branch=z9hG4bK3a1c5e07;rport\r\n"
+    "Max-Forwards: 70\r\n"
+    "From: \"Reception\" <sip:100@192.168.1.10>;tag=as2b6d2a41\r\n"
+    "To: <sip:doorbell@192.168.1.50:5060>\r\n"
+    "Contact: <sip:100@192.168.1.10:5060>\r\n"
+    "Call-ID: 5b0fa4e21d3c1f7a0c2e3c4d1f2a3b4c@192.168.1.10:5060\r\n"
+    "CSeq: 102 INVITE\r\n"
+    "User-Agent: Asterisk PBX 18.20.0\r\n"
+    "Date: Thu, 15 Oct 2026 09:12:44 GMT\r\n"
+    "Allow: INVITE, ACK, CANCEL, OPTIONS, BYE, REFER, SUBSCRIBE, NOTIFY, INFO, PUBLISH, MESSAGE\r\n"
+    "Supported: replaces, timer\r\n"
+    "Content-Type: application/sdp\r\n"
+    "Content-Length: 265\r\n"
+    "\r\n"
+    "v=0\r\n"
+    "o=root 1742057511 1742057511 IN IP4 192.168.1.10\r\n"
+    "s=Asterisk PBX 18.20.0\r\n"
+    "c=IN IP4 192.168.1.10\r\n"
+    "t=0 0\r\n"
+    "m=audio 14562 RTP/AVP 0 8 101\r\n"
+    "a=rtpmap:0 PCMU/8000\r\n"
+    "a=rtpmap:8 PCMA/8000\r\n"
+    "a=rtpmap:101 telephone-event/8000\r\n"
+    "a=fmtp:101 0-16\r\n"
+    "a=ptime:20\r\n"
+    "a=maxptime:150\r\n"
+    "a=sendrecv\r\n",
+
+    "SIP/2.0 401 Unauthorized\r\n"
+    "Via: SIP/2.0/UDP 192.168.1.50:5060;branch=z9hG4bK-524287-1---4a1c2b3d;received=192.168.1.50;rport=5060\r\n"
+    "From: <sip:doorbell@pbx.example.com>;tag=8f3c2a1b\r\n"
+    "To: <sip:doorbell@pbx.example.com>;tag=as1e2d3c4b\r\n"
+    "Call-ID: reg-7f1e2d3c4b5a@192.168.1.50\r\n"
+    "CSeq: 1 REGISTER\r\n"
+    "Server: Asterisk PBX 18.20.0\r\n"
+    "Allow: INVITE, ACK, CANCEL, OPTIONS, BYE, REFER, SUBSCRIBE, NOTIFY, INFO, PUBLISH, MESSAGE\r\n"
+    "Supported: replaces, timer\r\n"
+    "WWW-Authenticate: Digest algorithm=MD5, realm=\"asterisk\", nonce=\"1a2b3c4d\", qop=\"auth\"\r\n"
+    "Content-Length: 0\r\n"
+    "\r\n",
+
+    "SIP/2.0 200 OK\r\n"
+    "Via: SIP/2.0/UDP 192.168.1.50:5060;rport=5060;branch=z9hG4bK-91b2c3d4;received=192.168.1.50\r\n"
+    "From: \"Doorbell\" <sip:doorbell@192.168.1.1>;tag=4d3c2b1a\r\n"
+    "To: <sip:**611@192.168.1.1>;tag=B2B7E3D4F1A2C3B4\r\n"
+    "Call-ID: 9e8d7c6b5a4f3e2d@192.168.1.50\r\n"
+    "CSeq: 2 INVITE\r\n"
+    "Contact: <sip:**611@192.168.1.1:5060>\r\n"
+    "Record-Route: <sip:192.168.1.1;lr>\r\n"
+    "Allow: INVITE, ACK, OPTIONS, CANCEL, BYE, UPDATE, PRACK, INFO, SUBSCRIBE, NOTIFY, REFER, MESSAGE\r\n"
+    "Supported: 100rel, replaces, timer\r\n"
+    "User-Agent: FRITZ!OS\r\n"
+    "Content-Type: application/sdp\r\n"
+    "Content-Length: 213\r\n"
+    "\r\n"
+    "v=0\r\n"
+    "o=user 6231 6231 IN IP4 192.168.1.1\r\n"
+    "s=call\r\n"
+    "c=IN IP4 192.168.1.1\r\n"
+    "t=0 0\r\n"
+    "m=audio 7078 RTP/AVP 0 101\r\n"
+    "a=rtpmap:0 PCMU/8000\r\n"
+    "a=rtpmap:101 telephone-event/8000\r\n"
+    "a=fmtp:101 0-15\r\n"
+    "a=sendrecv\r\n"
+    "a=rtcp:7079\r\n"
+    "a=ptime:20\r\n",
+
+    "SIP/2.0 183 Session Progress\r\n"
+    "Via: SIP/2.0/UDP 192.168.1.50:5060;rport=5060;branch=z9hG4bK-1c2d3e4f\r\n"
+    "Record-Route: <sip:10.0.0.5;lr;ftag=7a8b9c0d>\r\n"
+    "From: <sip:doorbell@voip.example.net>;tag=7a8b9c0d\r\n"
+    "To: <sip:201@voip.example.net>;tag=Q2y7BvH3meKtF\r\n"
+    "Call-ID: 2f3e4d5c6b7a@192.168.1.50\r\n"
+    "CSeq: 21 INVITE\r\n"
+    "Contact: <sip:201@10.0.0.5:5080;transport=udp>\r\n"
+    "User-Agent: FreeSWITCH-mod_sofia/1.10.11-release\r\n"
+    "Accept: application/sdp\r\n"
+    "Allow: INVITE, ACK, BYE, CANCEL, OPTIONS, MESSAGE, INFO, UPDATE, REGISTER, REFER, NOTIFY\r\n"
+    "Supported: timer, path, replaces\r\n"
+    "Allow-Events: talk, hold, conference, refer\r\n"
+    "Content-Type: application/sdp\r\n"
+    "Content-Disposition: session\r\n"
+    "Content-Length: 232\r\n"
+    "Remote-Party-ID: \"201\" <sip:201@voip.example.net>;party=calling;privacy=off;screen=no\r\n"
+    "\r\n"
+    "v=0\r\n"
+    "o=FreeSWITCH 1760500000 1760500001 IN IP4 10.0.0.5\r\n"
+    "s=FreeSWITCH\r\n"
+    "c=IN IP4 10.0.0.5\r\n"
+    "t=0 0\r\n"
+    "m=audio 24680 RTP/AVP 0 101\r\n"
+    "a=rtpmap:0 PCMU/8000\r\n"
+    "a=rtpmap:101 telephone-event/8000\r\n"
+    "a=fmtp:101 0-16\r\n"
+    "a=ptime:20\r\n"
+    "a=rtcp:24681 IN IP4 10.0.0.5\r\n",
+
+    "OPTIONS sip:doorbell@192.168.1.50:5060 SIP/2.0\r\n"
+    "Via: SIP/2.0/UDP 192.168.1.10:5060;branch=z9hG4bK0a1b2c3d;rport\r\n"
+    "Max-Forwards: 70\r\n"
+    "From: \"asterisk\" <sip:asterisk@192.168.1.10>;tag=as0f1e2d3c\r\n"
+    "To: <sip:doorbell@192.168.1.50:5060>\r\n"
+    "Contact: <sip:asterisk@192.168.1.10:5060>\r\n"
+    "Call-ID: 4e5f6a7b8c9d0e1f@192.168.1.10:5060\r\n"
+    "CSeq: 102 OPTIONS\r\n"
+    "User-Agent: Asterisk PBX 18.20.0\r\n"
+    "Date: Thu, 15 Oct 2026 09:13:04 GMT\r\n"
+    "Allow: INVITE, ACK, CANCEL, OPTIONS, BYE, REFER, SUBSCRIBE, NOTIFY, INFO, PUBLISH, MESSAGE\r\n"
+    "Supported: replaces, timer\r\n"
+    "Content-Length: 0\r\n"
+    "\r\n",
+
+    "BYE sip:doorbell@192.168.1.50:5060 SIP/2.0\r\n"
+    "Via: SIP/2.0/UDP 192.168.1.23:5062;branch=z9hG4bK1957207548\r\n"
+    "From: \"Hall\" <sip:202@192.168.1.10>;tag=1340497105\r\n"
+    "To: <sip:doorbell@192.168.1.10>;tag=6f7e8d9c\r\n"
+    "Call-ID: 0_2315426530@192.168.1.23\r\n"
+    "CSeq: 3 BYE\r\n"
+    "Contact: <sip:202@192.168.1.23:5062>\r\n"
+    "Max-Forwards: 70\r\n"
+    "User-Agent: Yealink SIP-T46U 108.86.0.45\r\n"
+    "Content-Length: 0\r\n"
+    "\r\n",
+
+    "NOTIFY sip:doorbell@192.168.1.50:5060 SIP/2.0\r\n"
+    "v: SIP/2.0/UDP 10.0.0.5:5080;branch=z9hG4bKa1b2c3d4e5f6\r\n"
+    "f: <sip:doorbell@voip.example.net>;tag=aB3cD4eF5\r\n"
+    "t: <sip:doorbell@voip.example.net>\r\n"
+    "i: 7c8d9e0f-1a2b-3c4d-5e6f-7a8b9c0d1e2f\r\n"
+    "CSeq: 118 NOTIFY\r\n"
+    "m: <sip:mwi@10.0.0.5:5080>\r\n"
+    "Max-Forwards: 70\r\n"
+    "Event: message-summary\r\n"
+    "Subscription-State: active\r\n"
+    "c: application/simple-message-summary\r\n"
+    "l: 42\r\n"
+    "\r\n"
+    "Messages-Waiting: no\r\n"
+    "Voice-Message: 0/0\r\n",
+};
+
+#define CORPUS_SIZE     (sizeof(corpus) / sizeof(corpus[0]))
+#define BENCH_ROUNDS    20000
+#define BENCH_RUNS      7
+#define BENCH_LIMIT_NS  20000   // Per message, loose: a slow build machine
+
+static int64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// What the SIP task does with each message it receives: parse it, then
+// read the transaction and dialog keys
+static bool parse_and_read_keys(const char* text, size_t len)
+{
+    sip_message_t msg;
+    char branch[64];
+    char tag[64];
+    char call_id[128];
+    if (!sip_parse_message(text, len, &msg)) {
+        return false;
+    }
+    return sip_header_copy_param(sip_msg_header(&msg, SIP_HDR_VIA), "branch", branch, sizeof(branch)) &&
+           sip_header_copy_param(sip_msg_header(&msg, SIP_HDR_FROM), "tag", tag, sizeof(tag)) &&
+           sip_msg_copy_header(&msg, SIP_HDR_CALL_ID, call_id, sizeof(call_id)) &&
+           msg.cseq_num > 0;
+}
+
+// Host ns per message, best of several runs, and heap use over the corpus:
+// the parser only indexes the receive buffer, so it must not allocate
+static void test_parse_benchmark(void)
+{
+    size_t lens[CORPUS_SIZE];
+    for (size_t m = 0; m < CORPUS_SIZE; m++) {
+        lens[m] = strlen(corpus[m]);
+        CHECK(parse_and_read_keys(corpus[m], lens[m]));
+    }
+
+    heap_trace_start(HEAP_TRACE_ALL);
+    printf("  message                          bytes   ns/message\n");
+    for (size_t m = 0; m < CORPUS_SIZE; m++) {
+        int64_t best = INT64_MAX;
+        for (int run = 0; run < BENCH_RUNS; run++) {
+            int64_t start = now_ns();
+            for (int round = 0; round < BENCH_ROUNDS; round++) {
+                parse_and_read_keys(corpus[m], lens[m]);
+            }
+            int64_t elapsed = now_ns() - start;
+            best = elapsed < best ? elapsed : best;
+        }
+        double per_message = (double)best / BENCH_ROUNDS;
+        const char* eol = strstr(corpus[m], "\r\n");
+        int line_len = (int)(eol - corpus[m]) < 30 ? (int)(eol - corpus[m]) : 30;
+        printf("  %-30.*s  %5zu   %8.0f\n", line_len, corpus[m], lens[m], per_message);
+        CHECK(per_message < BENCH_LIMIT_NS);
+    }
+    heap_trace_stop();
+
+    printf("  %zu allocations over %d messages\n", heap_trace_get_count(),
+           (int)(CORPUS_SIZE * BENCH_ROUNDS * BENCH_RUNS));
+    CHECK_EQ_INT(heap_trace_get_count(), 0);
+    CHECK_EQ_INT(host_heap_trace_get_frees(), 0);
+}
+
+int main(void)
+{
+    RUN_TEST(test_invite_from_pbx);
+    RUN_TEST(test_response);
+    RUN_TEST(test_lenient_forms);
+    RUN_TEST(test_unknown_method_and_headers);
+    RUN_TEST(test_rejects_malformed);
+    RUN_TEST(test_limits);
+    RUN_TEST(test_params_skip_quotes_and_uris);
+    RUN_TEST(test_number_overflow);
+    RUN_TEST(test_parse_benchmark);
+    return TEST_RESULT();
+}
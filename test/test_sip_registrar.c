@@ -0,0 +1,213 @@
+#include "sip_registrar.h"
+#include "test_support.h"
+#include <stdint.h>
+#include <stdbool.h>
+
+// The registrar table is module state; every test installs its own list,
+// going through an empty one so scores from an earlier test never carry over
+
+static void use_list(const char* list)
+{
+    sip_registrar_set_list("");
+    sip_registrar_set_list(list);
+}
+
+static void test_list_parsing(void)
+{
+    CHECK_EQ_INT(sip_registrar_set_list(""), 0);
+    CHECK_EQ_INT(sip_registrar_set_list("pbx1.example:5070, pbx2.example ,10.0.0.3"), 3);
+    CHECK_EQ_STR(sip_registrar_get(0)->host, "pbx1.example");
+    CHECK_EQ_INT(sip_registrar_get(0)->port, 5070);
+    CHECK_EQ_STR(sip_registrar_get(1)->host, "pbx2.example");
+    CHECK_EQ_INT(sip_registrar_get(1)->port, 0);
+    CHECK_EQ_STR(sip_registrar_get(2)->host, "10.0.0.3");
+    CHECK_EQ_INT(sip_registrar_get(2)->srtt_ms, SIP_REGISTRAR_NO_RTT);
+    CHECK(sip_registrar_get(3) == NULL);
+    CHECK(sip_registrar_get(-1) == NULL);
+
+    CHECK_EQ_INT(sip_registrar_set_list("a,b,c,d,e,f"), SIP_REGISTRAR_MAX);
+    CHECK_EQ_INT(sip_registrar_set_list(",, ,"), 0);
+    CHECK_EQ_INT(sip_registrar_set_list(NULL), 0);
+
+    // A host that does not fit is left out rather than cut short
+    char list[SIP_REGISTRAR_HOST_LEN + 16];
+    memset(list, 'x', SIP_REGISTRAR_HOST_LEN);
+    snprintf(list + SIP_REGISTRAR_HOST_LEN, sizeof(list) - SIP_REGISTRAR_HOST_LEN, ",ok");
+    CHECK_EQ_INT(sip_registrar_set_list(list), 1);
+    CHECK_EQ_STR(sip_registrar_get(0)->host, "ok");
+}
+
+// Setting the same list again keeps what was learned about it
+static void test_same_list_keeps_scores(void)
+{
+    use_list("pbx1,pbx2");
+    sip_registrar_on_answer(1, 50);
+    sip_registrar_on_failure(0, 0);
+    CHECK_EQ_INT(sip_registrar_active(), 1);
+
+    CHECK_EQ_INT(sip_registrar_set_list("pbx1,pbx2"), 2);
+    CHECK_EQ_INT(sip_registrar_active(), 1);
+    CHECK_EQ_INT(sip_registrar_get(1)->srtt_ms, 50);
+    CHECK_EQ_INT(sip_registrar_get(0)->failures, 1);
+
+    sip_registrar_set_list("pbx1,pbx3");
+    CHECK_EQ_INT(sip_registrar_active(), 0);
+    CHECK_EQ_INT(sip_registrar_get(0)->failures, 0);
+}
+
+// Failover goes to registrars without failures first, then by round trip,
+// unmeasured ones last
+static void test_failover_ranking(void)
+{
+    use_list("pbx1,pbx2,pbx3,pbx4");
+    sip_registrar_on_answer(1, 80);
+    sip_registrar_on_answer(2, 40);
+    sip_registrar_on_answer(2, 40);
+
+    CHECK_EQ_INT(sip_registrar_on_failure(0, 1000), 2);
+    CHECK_EQ_INT(sip_registrar_on_failure(2, 1000), 1);
+    CHECK_EQ_INT(sip_registrar_on_failure(1, 1000), 3);
+
+    // A failing standby does not move the active registrar
+    CHECK_EQ_INT(sip_registrar_on_failure(0, 2000), 3);
+
+    // Everything failed: stay for now; registering then goes to the one
+    // whose hold ends first (list order on a tie), and stays there once
+    // its hold is over
+    CHECK_EQ_INT(sip_registrar_on_failure(3, 3000), 3);
+    CHECK_EQ_INT(sip_registrar_select(3000), 1);
+    CHECK_EQ_INT(sip_registrar_select(1000 + SIP_REGISTRAR_HOLD_MS), 1);
+}
+
+static void test_srtt_smoothing(void)
+{
+    use_list("pbx1,pbx2");
+    sip_registrar_on_answer(0, 100);
+    CHECK_EQ_INT(sip_registrar_get(0)->srtt_ms, 100);
+    sip_registrar_on_answer(0, 180);
+    CHECK_EQ_INT(sip_registrar_get(0)->srtt_ms, 110);
+    sip_registrar_on_answer(0, SIP_REGISTRAR_NO_RTT);
+    CHECK_EQ_INT(sip_registrar_get(0)->srtt_ms, 110);
+    CHECK_EQ_INT(sip_registrar_get(0)->answered, 3);
+}
+
+// The hold doubles with every further failure, up to the maximum
+static void test_hold_backoff(void)
+{
+    use_list("pbx1,pbx2");
+    uint32_t hold = SIP_REGISTRAR_HOLD_MS;
+    for (int i = 0; i < 8; i++) {
+        sip_registrar_on_failure(1, 0);
+        CHECK_EQ_INT(sip_registrar_get(1)->hold_until, hold);
+        hold = hold * 2 > SIP_REGISTRAR_HOLD_MAX_MS ? SIP_REGISTRAR_HOLD_MAX_MS : hold * 2;
+    }
+    sip_registrar_on_answer(1, SIP_REGISTRAR_NO_RTT);
+    CHECK_EQ_INT(sip_registrar_get(1)->failures, 0);
+}
+
+// Back to the primary only after SIP_REGISTRAR_RECOVER_PROBES answers in a
+// row; a faster standby is not a reason to move
+static void test_sticky_return(void)
+{
+    use_list("pbx1,pbx2,pbx3");
+    sip_registrar_on_failure(0, 0);
+    CHECK_EQ_INT(sip_registrar_active(), 1);
+    sip_registrar_on_answer(2, 5);
+    CHECK_EQ_INT(sip_registrar_preferred(), -1);
+
+    for (int i = 0; i < SIP_REGISTRAR_RECOVER_PROBES - 1; i++) {
+        sip_registrar_on_answer(0, 30);
+        CHECK_EQ_INT(sip_registrar_preferred(), -1);
+    }
+    sip_registrar_on_failure(0, 0);
+    for (int i = 0; i < SIP_REGISTRAR_RECOVER_PROBES - 1; i++) {
+        sip_registrar_on_answer(0, 30);
+    }
+    CHECK_EQ_INT(sip_registrar_preferred(), -1);
+    sip_registrar_on_answer(0, 30);
+    CHECK_EQ_INT(sip_registrar_preferred(), 0);
+
+    sip_registrar_use(0);
+    CHECK_EQ_INT(sip_registrar_active(), 0);
+    CHECK_EQ_INT(sip_registrar_preferred(), -1);
+}
+
+// Standbys are probed one at a time; an unanswered probe is a failure
+static void test_probing(void)
+{
+    use_list("pbx1,pbx2,pbx3");
+    CHECK_EQ_INT(sip_registrar_next_ms(0), 0);
+
+    CHECK_EQ_INT(sip_registrar_probe_due(0), 1);
+    CHECK_EQ_INT(sip_registrar_probe_due(0), -1);
+    CHECK_EQ_INT(sip_registrar_next_ms(0), SIP_REGISTRAR_PROBE_TIMEOUT_MS);
+    sip_registrar_on_probe_answer(1, 25);
+    CHECK_EQ_INT(sip_registrar_get(1)->srtt_ms, 25);
+
+    CHECK_EQ_INT(sip_registrar_probe_due(100), 2);
+    CHECK_EQ_INT(sip_registrar_probe_due(100 + SIP_REGISTRAR_PROBE_TIMEOUT_MS), -1);
+    CHECK_EQ_INT(sip_registrar_get(2)->failures, 1);
+    CHECK(!sip_registrar_get(2)->probing);
+
+    // Answers to probes that are not in flight are ignored
+    sip_registrar_on_probe_answer(2, 5000);
+    CHECK_EQ_INT(sip_registrar_get(2)->failures, 1);
+
+    CHECK_EQ_INT(sip_registrar_next_ms(3000), SIP_REGISTRAR_PROBE_MS - 3000);
+    CHECK_EQ_INT(sip_registrar_probe_due(SIP_REGISTRAR_PROBE_MS), 1);
+
+    sip_registrar_set_list("pbx1");
+    CHECK_EQ_INT(sip_registrar_probe_due(SIP_REGISTRAR_PROBE_MS * 2), -1);
+    CHECK_EQ_INT(sip_registrar_next_ms(0), UINT32_MAX);
+}
+
+// The primary goes down for ten minutes: registration fails over at the
+// first timeout and returns once the primary has answered its probes again
+static void test_outage_scenario(void)
+{
+    use_list("pbx1,pbx2");
+    const uint32_t down_from = 60000;
+    const uint32_t down_until = down_from + 600000;
+    uint32_t failover_at = 0;
+    uint32_t return_at = 0;
+
+    for (uint32_t now = 0; now < 1800000; now += 100) {
+        // The SIP task's registration timeout is Timer F
+        if (now == down_from + 32000) {
+            sip_registrar_on_failure(sip_registrar_active(), now);
+            CHECK_EQ_INT(sip_registrar_select(now), 1);
+            failover_at = now;
+        }
+        int probe = sip_registrar_probe_due(now);
+        if (probe >= 0) {
+            bool up = probe != 0 || now < down_from || now >= down_until;
+            if (up) {
+                sip_registrar_on_probe_answer(probe, now + 20);
+            }
+        }
+        int preferred = sip_registrar_preferred();
+        if (preferred >= 0 && !return_at) {
+            sip_registrar_use(preferred);
+            return_at = now;
+        }
+    }
+
+    CHECK_EQ_INT(failover_at, down_from + 32000);
+    CHECK(return_at >= down_until);
+    CHECK(return_at <= down_until + SIP_REGISTRAR_RECOVER_PROBES * SIP_REGISTRAR_PROBE_MS + 1000);
+    CHECK_EQ_INT(sip_registrar_active(), 0);
+    CHECK_EQ_INT(sip_registrar_get(0)->failures, 0);
+}
+
+int main(void)
+{
+    RUN_TEST(test_list_parsing);
+    RUN_TEST(test_same_list_keeps_scores);
+    RUN_TEST(test_failover_ranking);
+    RUN_TEST(test_srtt_smoothing);
+    RUN_TEST(test_hold_backoff);
+    RUN_TEST(test_sticky_return);
+    RUN_TEST(test_probing);
+    RUN_TEST(test_outage_scenario);
+    return TEST_RESULT();
+}
@@ -0,0 +1,76 @@
+#include "sip_client.h"
+#include "sip_harness.h"
+#include "esp_timer.h"
+#include "test_support.h"
+#include <stdint.h>
+#include <stdbool.h>
+
+// An hour registered with the PBX stand-in, on the simulated clock in one
+// second steps: how many round trips the registrar sees. Only the first
+// registration is challenged; each refresh goes out at 80% of the granted
+// expiry and answers the cached nonce with the next nonce count.
+
+#define START_US        1000000
+#define EXPIRES_S       600
+#define REFRESH_S       (EXPIRES_S * 80 / 100)
+#define HOUR_S          3600
+#define MAX_REFRESHES   16
+
+static void test_first_registration(void)
+{
+    CHECK(sip_is_registered());
+    CHECK_EQ_INT(pbx_stats()->registers, 2);
+    CHECK_EQ_INT(pbx_stats()->challenges, 1);
+    CHECK_EQ_INT(pbx_stats()->registered, 1);
+}
+
+static void test_hour_of_refreshes(void)
+{
+    int64_t refreshed_us[MAX_REFRESHES];
+    int refreshes = 0;
+    int64_t last_us = pbx_stats()->register_ok_us;
+    pbx_stats_t start = *pbx_stats();
+    bool stayed_registered = true;
+
+    for (int s = 0; s < HOUR_S; s++) {
+        harness_run_for(1000, 1000);
+        stayed_registered &= sip_is_registered();
+        if (pbx_stats()->register_ok_us != last_us && refreshes < MAX_REFRESHES) {
+            last_us = pbx_stats()->register_ok_us;
+            refreshed_us[refreshes++] = last_us;
+        }
+    }
+
+    const pbx_stats_t* end = pbx_stats();
+    int registers = end->registers - start.registers;
+    printf("  expires %d s, one hour: %d REGISTER round trips (%d challenged), %d OPTIONS round trips, "
+           "%d CRLF keep-alives\n", EXPIRES_S, registers, end->challenges - start.challenges,
+           end->options - start.options, end->pings - start.pings);
+
+    CHECK(stayed_registered);
+    CHECK_EQ_INT(refreshes, HOUR_S / REFRESH_S);
+    CHECK_EQ_INT(registers, refreshes);
+    CHECK_EQ_INT(end->challenges, 1);
+    CHECK_EQ_INT(end->nc_reused, 0);
+
+    // Every refresh at 80% of the expiry after the one before
+    int64_t previous_us = start.register_ok_us;
+    for (int i = 0; i < refreshes; i++) {
+        int64_t interval_ms = (refreshed_us[i] - previous_us) / 1000;
+        CHECK(interval_ms >= REFRESH_S * 1000 && interval_ms <= (REFRESH_S + 1) * 1000);
+        previous_us = refreshed_us[i];
+    }
+}
+
+int main(void)
+{
+    setvbuf(stdout, NULL, _IOLBF, 0);
+    host_clock_simulate(START_US);
+    pbx_set_expires(EXPIRES_S);
+    CHECK(harness_start(SIP_TRANSPORT_UDP, "201", NULL));
+    harness_settle();
+
+    RUN_TEST(test_first_registration);
+    RUN_TEST(test_hour_of_refreshes);
+    return TEST_RESULT();
+}
@@ -0,0 +1,130 @@
+#include "sip_client.h"
+#include "sip_harness.h"
+#include "esp_timer.h"
+#include "test_support.h"
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+// How long the SIP task takes from a datagram (or a command from another
+// task) reaching it to the state change it causes, against the PBX stand-in
+// on loopback in real time. The task sleeps in select() on its socket and
+// the command queue's wake socket, so the delay is the wake-up plus the
+// handling, and it must not cost CPU while nothing happens.
+
+#define CALLS               20
+#define MEDIAN_LIMIT_US     2000    // Loose, for a loaded build machine
+#define MAX_LIMIT_US        50000
+
+typedef struct {
+    const char* name;
+    int count;
+    int64_t us[CALLS];
+} latency_t;
+
+static void record(latency_t* l, int64_t from_us, int64_t to_us)
+{
+    CHECK(from_us > 0 && to_us >= from_us);
+    if (from_us > 0 && to_us >= from_us && l->count < CALLS) {
+        l->us[l->count++] = to_us - from_us;
+    }
+}
+
+static int compare(const void* a, const void* b)
+{
+    int64_t x = *(const int64_t*)a;
+    int64_t y = *(const int64_t*)b;
+    return (x > y) - (x < y);
+}
+
+static void report(latency_t* l)
+{
+    CHECK(l->count > 0);
+    if (l->count == 0) {
+        return;
+    }
+    qsort(l->us, l->count, sizeof(l->us[0]), compare);
+    int64_t median = l->us[l->count / 2];
+    int64_t max = l->us[l->count - 1];
+    printf("  %-34s %6lld %6lld %6lld\n", l->name, (long long)l->us[0], (long long)median, (long long)max);
+    CHECK(median < MEDIAN_LIMIT_US);
+    CHECK(max < MAX_LIMIT_US);
+}
+
+static int64_t cpu_us(void)
+{
+    struct timespec t;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &t);
+    return (int64_t)t.tv_sec * 1000000 + t.tv_nsec / 1000;
+}
+
+static latency_t registered = { .name = "200 to REGISTER -> registered" };
+
+static void test_register(void)
+{
+    CHECK(harness_start(SIP_TRANSPORT_UDP, "201", NULL));
+    CHECK(sip_is_registered());
+    CHECK_EQ_INT(pbx_stats()->challenges, 1);
+    record(&registered, pbx_stats()->register_ok_us, harness_led_time_us(LED_STATE_SIP_REGISTERED));
+}
+
+// Registered and idle, the task waits for its next deadline (keep-alive,
+// refresh) without spinning: two seconds cost next to no CPU
+static void test_idle_costs_no_cpu(void)
+{
+    int64_t cpu = cpu_us();
+    usleep(2000000);
+    int64_t used = cpu_us() - cpu;
+    printf("  CPU while idle: %lld us in 2 s\n", (long long)used);
+    CHECK(used < 40000);
+    pbx_poll(10);
+}
+
+static void test_call_latency(void)
+{
+    latency_t command = { .name = "make_call -> calling (queue)" };
+    latency_t invite = { .name = "make_call -> INVITE at the PBX" };
+    latency_t ringing = { .name = "180 -> ringing" };
+    latency_t answered = { .name = "200 to INVITE -> call active" };
+    latency_t ended = { .name = "BYE -> idle" };
+
+    for (int i = 0; i < CALLS; i++) {
+        int invites = pbx_stats()->invites;
+        int64_t pressed = esp_timer_get_time();
+        sip_client_make_call("201");
+        int64_t calling = harness_wait_led(LED_STATE_CALL_OUTGOING, pressed, 1000);
+        record(&command, pressed, calling);
+
+        int64_t active = harness_wait_led(LED_STATE_CALL_ACTIVE, pressed, 2000);
+        CHECK_EQ_INT(pbx_stats()->invites, invites + 1);
+        record(&invite, pressed, pbx_stats()->invite_us);
+        record(&ringing, pbx_stats()->provisional_us, harness_led_time_us(LED_STATE_RINGING));
+        record(&answered, pbx_stats()->answer_us, active);
+        CHECK_EQ_INT(sip_client_get_state(), SIP_STATE_CONNECTED);
+
+        int64_t bye = esp_timer_get_time();
+        CHECK(pbx_hang_up());
+        record(&ended, bye, harness_wait_led(LED_STATE_IDLE, bye, 1000));
+        CHECK_EQ_INT(sip_client_get_state(), SIP_STATE_REGISTERED);
+        pbx_poll(20);
+    }
+
+    printf("  signalling latency (us)             min median    max\n");
+    report(&registered);
+    report(&command);
+    report(&invite);
+    report(&ringing);
+    report(&answered);
+    report(&ended);
+}
+
+int main(void)
+{
+    pbx_add_target("201", PBX_ANSWER, 100);
+    RUN_TEST(test_register);
+    RUN_TEST(test_idle_costs_no_cpu);
+    RUN_TEST(test_call_latency);
+    return TEST_RESULT();
+}
@@ -0,0 +1,110 @@
+#include "sip_client.h"
+#include "sip_harness.h"
+#include "esp_timer.h"
+#include "test_support.h"
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+// SIP over TCP against the PBX stand-in, in real time on loopback: the one
+// connection carries REGISTER and calls, and when the server closes it the
+// client connects again and registers at once. Measured: from the close to
+// the 200 to the new REGISTER.
+
+#define RECONNECTS          10
+#define REGISTERED_LIMIT_US 50000   // Loose, for a loaded build machine
+
+static int compare(const void* a, const void* b)
+{
+    int64_t x = *(const int64_t*)a;
+    int64_t y = *(const int64_t*)b;
+    return (x > y) - (x < y);
+}
+
+// Run the PBX until a REGISTER after @p since_us has been accepted and the
+// client has taken the 200; when the PBX sent it, 0 on timeout
+static int64_t wait_registered(int64_t since_us, uint32_t timeout_ms)
+{
+    int64_t end = esp_timer_get_time() + (int64_t)timeout_ms * 1000;
+    while ((pbx_stats()->register_ok_us < since_us || !sip_is_registered()) && esp_timer_get_time() < end) {
+        pbx_poll(1);
+    }
+    return pbx_stats()->register_ok_us >= since_us ? pbx_stats()->register_ok_us : 0;
+}
+
+static void test_one_connection_for_everything(void)
+{
+    CHECK(sip_is_registered());
+    CHECK_EQ_INT(pbx_stats()->connections, 1);
+
+    int64_t pressed = esp_timer_get_time();
+    sip_client_make_call("201");
+    CHECK(harness_wait_led(LED_STATE_CALL_ACTIVE, pressed, 2000) != 0);
+    int64_t bye = esp_timer_get_time();
+    CHECK(pbx_hang_up());
+    CHECK(harness_wait_led(LED_STATE_IDLE, bye, 1000) != 0);
+    CHECK_EQ_INT(pbx_stats()->connections, 1);
+}
+
+static void test_reconnect_to_registered(void)
+{
+    int64_t us[RECONNECTS];
+    int count = 0;
+    pbx_stats_t start = *pbx_stats();
+
+    for (int i = 0; i < RECONNECTS; i++) {
+        pbx_poll(20);
+        int64_t dropped = esp_timer_get_time();
+        pbx_drop_connection();
+        int64_t registered = wait_registered(dropped, 2000);
+        CHECK(registered != 0);
+        if (registered != 0) {
+            us[count++] = registered - dropped;
+        }
+        CHECK(sip_is_registered());
+    }
+
+    const pbx_stats_t* end = pbx_stats();
+    CHECK_EQ_INT(end->connections - start.connections, RECONNECTS);
+    CHECK(count == RECONNECTS);
+    if (count > 0) {
+        qsort(us, count, sizeof(us[0]), compare);
+        printf("  close -> registered (us)    min median    max\n");
+        printf("  %-24s %6lld %6lld %6lld   (%d REGISTERs, %d challenged)\n", "TCP", (long long)us[0],
+               (long long)us[count / 2], (long long)us[count - 1], end->registers - start.registers,
+               end->challenges - start.challenges);
+        CHECK(us[count / 2] < REGISTERED_LIMIT_US);
+    }
+}
+
+// A call survives the connection: the client registers again over a new
+// one and the PBX's BYE reaches it there
+static void test_call_survives_reconnect(void)
+{
+    int64_t pressed = esp_timer_get_time();
+    sip_client_make_call("201");
+    CHECK(harness_wait_led(LED_STATE_CALL_ACTIVE, pressed, 2000) != 0);
+
+    int connections = pbx_stats()->connections;
+    int64_t dropped = esp_timer_get_time();
+    pbx_drop_connection();
+    CHECK(wait_registered(dropped, 2000) != 0);
+    CHECK_EQ_INT(pbx_stats()->connections, connections + 1);
+    CHECK_EQ_INT(sip_client_get_state(), SIP_STATE_CONNECTED);
+
+    int64_t bye = esp_timer_get_time();
+    CHECK(pbx_hang_up());
+    CHECK(harness_wait_led(LED_STATE_IDLE, bye, 1000) != 0);
+    CHECK_EQ_INT(sip_client_get_state(), SIP_STATE_REGISTERED);
+}
+
+int main(void)
+{
+    setvbuf(stdout, NULL, _IOLBF, 0);
+    pbx_add_target("201", PBX_ANSWER, 20);
+    CHECK(harness_start(SIP_TRANSPORT_TCP, "201", NULL));
+    RUN_TEST(test_one_connection_for_everything);
+    RUN_TEST(test_reconnect_to_registered);
+    RUN_TEST(test_call_survives_reconnect);
+    return TEST_RESULT();
+}
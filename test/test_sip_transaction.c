@@ -0,0 +1,337 @@
+#include "sip_transaction.h"
+#include "sip_parser.h"
+#include "test_support.h"
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+// The transport is a log of what the transaction layer sent and when; time
+// is driven by hand in 100 ms steps, like sip_client.c's receive timeout
+
+#define MAX_SENT 64
+
+typedef struct {
+    uint32_t at_ms;
+    char start_line[48];
+} sent_t;
+
+static sent_t sent[MAX_SENT];
+static int sent_count;
+static uint32_t now;
+
+static int timeouts;
+static sip_method_t timeout_method;
+static bool timeout_server;
+static int timeout_status;
+static char timeout_call_id[64];
+
+static int record_send(const char* data, size_t len)
+{
+    if (sent_count < MAX_SENT) {
+        const char* eol = memchr(data, '\r', len);
+        size_t n = eol ? (size_t)(eol - data) : len;
+        if (n >= sizeof(sent[0].start_line)) {
+            n = sizeof(sent[0].start_line) - 1;
+        }
+        memcpy(sent[sent_count].start_line, data, n);
+        sent[sent_count].start_line[n] = '\0';
+        sent[sent_count].at_ms = now;
+        sent_count++;
+    }
+    return (int)len;
+}
+
+static void record_timeout(sip_method_t method, bool server, int status_code, const char* call_id)
+{
+    timeouts++;
+    timeout_method = method;
+    timeout_server = server;
+    timeout_status = status_code;
+    snprintf(timeout_call_id, sizeof(timeout_call_id), "%s", call_id);
+}
+
+static void setup(bool reliable)
+{
+    sip_txn_init(record_send, record_timeout);
+    sip_txn_set_reliable(reliable);
+    sent_count = 0;
+    timeouts = 0;
+    now = 1000;
+}
+
+static void advance_to(uint32_t t)
+{
+    while (now < t) {
+        now += 100;
+        sip_txn_process(now);
+    }
+}
+
+// Request or response with the headers the transaction layer keys on
+static size_t format(char* buf, size_t size, const char* start_line, const char* branch,
+                     const char* call_id, int cseq, const char* cseq_method)
+{
+    return (size_t)snprintf(buf, size,
+                            "%s\r\n"
+                            "Via: SIP/2.0/UDP 192.168.1.50:5060;branch=%s;rport\r\n"
+                            "From: <sip:doorbell@pbx>;tag=1\r\n"
+                            "To: <sip:100@pbx>\r\n"
+                            "Call-ID: %s\r\n"
+                            "CSeq: %d %s\r\n"
+                            "Content-Length: 0\r\n"
+                            "\r\n",
+                            start_line, branch, call_id, cseq, cseq_method);
+}
+
+static void send_msg(const char* start_line, const char* branch, const char* call_id, int cseq,
+                     const char* cseq_method)
+{
+    char buf[512];
+    size_t len = format(buf, sizeof(buf), start_line, branch, call_id, cseq, cseq_method);
+    CHECK_EQ_INT(sip_txn_send(buf, len, now), (int)len);
+}
+
+static sip_txn_disposition_t receive(const char* start_line, const char* branch, const char* call_id,
+                                     int cseq, const char* cseq_method)
+{
+    static char buf[512];
+    sip_message_t msg;
+    size_t len = format(buf, sizeof(buf), start_line, branch, call_id, cseq, cseq_method);
+    if (!sip_parse_message(buf, len, &msg)) {
+        CHECK(false);
+        return SIP_TXN_DELIVER;
+    }
+    return sip_txn_receive(&msg, now);
+}
+
+static void check_sent_times(const uint32_t* expected, int count)
+{
+    CHECK_EQ_INT(sent_count, count);
+    for (int i = 0; i < count && i < sent_count; i++) {
+        if (sent[i].at_ms != expected[i]) {
+            printf("  send %d (%s)\n", i, sent[i].start_line);
+            CHECK_EQ_INT(sent[i].at_ms, expected[i]);
+        }
+    }
+}
+
+// Timer E doubles from T1 and is capped at T2; Timer F ends it at 64*T1
+static void test_non_invite_client_timeout(void)
+{
+    setup(false);
+    send_msg("REGISTER sip:pbx SIP/2.0", "z9hG4bKreg1", "reg-call", 5, "REGISTER");
+    CHECK_EQ_INT(sip_txn_next_timer_ms(now), SIP_TXN_T1_MS);
+
+    advance_to(1000 + SIP_TXN_TIMEOUT_MS + 500);
+    static const uint32_t expected[] = {
+        1000, 1500, 2500, 4500, 8500, 12500, 16500, 20500, 24500, 28500, 32500,
+    };
+    check_sent_times(expected, sizeof(expected) / sizeof(expected[0]));
+
+    CHECK_EQ_INT(timeouts, 1);
+    CHECK_EQ_INT(timeout_method, SIP_METHOD_REGISTER);
+    CHECK(!timeout_server);
+    CHECK_EQ_INT(timeout_status, 0);
+    CHECK_EQ_STR(timeout_call_id, "reg-call");
+    CHECK_EQ_INT(sip_txn_next_timer_ms(now), UINT32_MAX);
+}
+
+// A provisional response moves retransmission to T2; the final response
+// stops it, and retransmissions of the final response are absorbed
+static void test_non_invite_client_answered(void)
+{
+    setup(false);
+    send_msg("OPTIONS sip:pbx SIP/2.0", "z9hG4bKopt", "opt-call", 1, "OPTIONS");
+    advance_to(1600);
+    CHECK_EQ_INT(sent_count, 2);
+
+    CHECK_EQ_INT(receive("SIP/2.0 100 Trying", "z9hG4bKopt", "opt-call", 1, "OPTIONS"), SIP_TXN_DELIVER);
+    advance_to(1600 + SIP_TXN_T2_MS);
+    CHECK_EQ_INT(sent_count, 3);
+    CHECK_EQ_INT(sent[2].at_ms, 1600 + SIP_TXN_T2_MS);
+
+    CHECK_EQ_INT(receive("SIP/2.0 200 OK", "z9hG4bKopt", "opt-call", 1, "OPTIONS"), SIP_TXN_DELIVER);
+    CHECK_EQ_INT(receive("SIP/2.0 200 OK", "z9hG4bKopt", "opt-call", 1, "OPTIONS"), SIP_TXN_ABSORBED);
+    advance_to(now + SIP_TXN_T4_MS + 200);
+    CHECK_EQ_INT(sent_count, 3);
+    CHECK_EQ_INT(timeouts, 0);
+
+    // Timer K has run: a late copy is new again
+    CHECK_EQ_INT(receive("SIP/2.0 200 OK", "z9hG4bKopt", "opt-call", 1, "OPTIONS"), SIP_TXN_DELIVER);
+}
+
+// Timer A doubles without a cap until Timer B
+static void test_invite_client_timeout(void)
+{
+    setup(false);
+    send_msg("INVITE sip:100@pbx SIP/2.0", "z9hG4bKinv", "inv-call", 1, "INVITE");
+    advance_to(1000 + SIP_TXN_TIMEOUT_MS + 500);
+
+    static const uint32_t expected[] = { 1000, 1500, 2500, 4500, 8500, 16500, 32500 };
+    check_sent_times(expected, sizeof(expected) / sizeof(expected[0]));
+    CHECK_EQ_INT(timeouts, 1);
+    CHECK_EQ_INT(timeout_method, SIP_METHOD_INVITE);
+}
+
+// After 180 the INVITE is not retransmitted and does not time out with a
+// notification: how long to ring is the caller's decision
+static void test_invite_client_ringing(void)
+{
+    setup(false);
+    send_msg("INVITE sip:100@pbx SIP/2.0", "z9hG4bKring", "ring-call", 1, "INVITE");
+    CHECK_EQ_INT(receive("SIP/2.0 180 Ringing", "z9hG4bKring", "ring-call", 1, "INVITE"), SIP_TXN_DELIVER);
+    advance_to(1000 + 2 * SIP_TXN_TIMEOUT_MS);
+    CHECK_EQ_INT(sent_count, 1);
+    CHECK_EQ_INT(timeouts, 0);
+}
+
+// A non-2xx final response is ACKed by the caller through sip_txn_send;
+// the transaction repeats that ACK for every retransmitted response
+static void test_invite_client_rejected(void)
+{
+    setup(false);
+    send_msg("INVITE sip:100@pbx SIP/2.0", "z9hG4bKbusy", "busy-call", 1, "INVITE");
+    CHECK_EQ_INT(receive("SIP/2.0 486 Busy Here", "z9hG4bKbusy", "busy-call", 1, "INVITE"), SIP_TXN_DELIVER);
+    send_msg("ACK sip:100@pbx SIP/2.0", "z9hG4bKbusy", "busy-call", 1, "ACK");
+    CHECK_EQ_INT(sent_count, 2);
+
+    advance_to(3000);
+    CHECK_EQ_INT(sent_count, 2);
+    CHECK_EQ_INT(receive("SIP/2.0 486 Busy Here", "z9hG4bKbusy", "busy-call", 1, "INVITE"), SIP_TXN_ABSORBED);
+    CHECK_EQ_INT(sent_count, 3);
+    CHECK_EQ_STR(sent[2].start_line, "ACK sip:100@pbx SIP/2.0");
+    CHECK_EQ_INT(timeouts, 0);
+}
+
+// A 2xx ends the client transaction; its retransmissions go to the dialog,
+// which ACKs them itself
+static void test_invite_client_answered(void)
+{
+    setup(false);
+    send_msg("INVITE sip:100@pbx SIP/2.0", "z9hG4bKok", "ok-call", 1, "INVITE");
+    CHECK_EQ_INT(receive("SIP/2.0 200 OK", "z9hG4bKok", "ok-call", 1, "INVITE"), SIP_TXN_DELIVER);
+    CHECK_EQ_INT(receive("SIP/2.0 200 OK", "z9hG4bKok", "ok-call", 1, "INVITE"), SIP_TXN_DELIVER);
+    CHECK_EQ_INT(sip_txn_next_timer_ms(now), UINT32_MAX);
+    advance_to(5000);
+    CHECK_EQ_INT(sent_count, 1);
+}
+
+// A retransmitted request is answered from the server transaction
+static void test_non_invite_server(void)
+{
+    setup(false);
+    CHECK_EQ_INT(receive("OPTIONS sip:doorbell@192.168.1.50 SIP/2.0", "z9hG4bKsrv", "s-call", 9, "OPTIONS"),
+                 SIP_TXN_DELIVER);
+    // Not answered yet: absorbed without a response
+    CHECK_EQ_INT(receive("OPTIONS sip:doorbell@192.168.1.50 SIP/2.0", "z9hG4bKsrv", "s-call", 9, "OPTIONS"),
+                 SIP_TXN_ABSORBED);
+    CHECK_EQ_INT(sent_count, 0);
+
+    send_msg("SIP/2.0 200 OK", "z9hG4bKsrv", "s-call", 9, "OPTIONS");
+    CHECK_EQ_INT(receive("OPTIONS sip:doorbell@192.168.1.50 SIP/2.0", "z9hG4bKsrv", "s-call", 9, "OPTIONS"),
+                 SIP_TXN_ABSORBED);
+    CHECK_EQ_INT(sent_count, 2);
+    CHECK_EQ_STR(sent[1].start_line, "SIP/2.0 200 OK");
+
+    // Timer J
+    advance_to(now + SIP_TXN_TIMEOUT_MS + 100);
+    CHECK_EQ_INT(timeouts, 0);
+    CHECK_EQ_INT(receive("OPTIONS sip:doorbell@192.168.1.50 SIP/2.0", "z9hG4bKsrv", "s-call", 9, "OPTIONS"),
+                 SIP_TXN_DELIVER);
+}
+
+// Timer G repeats a final response (capped at T2) until the ACK, which for
+// a 2xx carries a new branch and is matched on Call-ID and CSeq
+static void test_invite_server_answered(void)
+{
+    setup(false);
+    CHECK_EQ_INT(receive("INVITE sip:doorbell@192.168.1.50 SIP/2.0", "z9hG4bKin", "in-call", 20, "INVITE"),
+                 SIP_TXN_DELIVER);
+    send_msg("SIP/2.0 180 Ringing", "z9hG4bKin", "in-call", 20, "INVITE");
+    CHECK_EQ_INT(receive("INVITE sip:doorbell@192.168.1.50 SIP/2.0", "z9hG4bKin", "in-call", 20, "INVITE"),
+                 SIP_TXN_ABSORBED);
+    CHECK_EQ_STR(sent[1].start_line, "SIP/2.0 180 Ringing");
+
+    send_msg("SIP/2.0 200 OK", "z9hG4bKin", "in-call", 20, "INVITE");
+    advance_to(now + 7600);
+    static const uint32_t expected[] = { 1000, 1000, 1000, 1500, 2500, 4500, 8500 };
+    check_sent_times(expected, sizeof(expected) / sizeof(expected[0]));
+
+    CHECK_EQ_INT(receive("ACK sip:doorbell@192.168.1.50 SIP/2.0", "z9hG4bKack", "in-call", 20, "ACK"),
+                 SIP_TXN_DELIVER);
+    CHECK_EQ_INT(receive("ACK sip:doorbell@192.168.1.50 SIP/2.0", "z9hG4bKack", "in-call", 20, "ACK"),
+                 SIP_TXN_ABSORBED);
+    advance_to(now + SIP_TXN_TIMEOUT_MS + 100);
+    CHECK_EQ_INT(sent_count, 7);
+    CHECK_EQ_INT(timeouts, 0);
+}
+
+// No ACK at all: Timer H reports the final response that went unacknowledged
+static void test_invite_server_no_ack(void)
+{
+    setup(false);
+    receive("INVITE sip:doorbell@192.168.1.50 SIP/2.0", "z9hG4bKlost", "lost-call", 1, "INVITE");
+    send_msg("SIP/2.0 603 Decline", "z9hG4bKlost", "lost-call", 1, "INVITE");
+    advance_to(1000 + SIP_TXN_TIMEOUT_MS + 100);
+
+    CHECK_EQ_INT(timeouts, 1);
+    CHECK(timeout_server);
+    CHECK_EQ_INT(timeout_method, SIP_METHOD_INVITE);
+    CHECK_EQ_INT(timeout_status, 603);
+    CHECK_EQ_STR(timeout_call_id, "lost-call");
+    for (int i = 1; i < sent_count; i++) {
+        CHECK(sent[i].at_ms - sent[i - 1].at_ms <= SIP_TXN_T2_MS);
+    }
+}
+
+// Over TCP/TLS only the 2xx to an INVITE is repeated, and completed
+// transactions are released at once
+static void test_reliable_transport(void)
+{
+    setup(true);
+    send_msg("REGISTER sip:pbx SIP/2.0", "z9hG4bKtcp", "tcp-call", 1, "REGISTER");
+    advance_to(1000 + SIP_TXN_TIMEOUT_MS - 100);
+    CHECK_EQ_INT(sent_count, 1);
+    CHECK_EQ_INT(receive("SIP/2.0 200 OK", "z9hG4bKtcp", "tcp-call", 1, "REGISTER"), SIP_TXN_DELIVER);
+    advance_to(now + 100);
+    CHECK_EQ_INT(receive("SIP/2.0 200 OK", "z9hG4bKtcp", "tcp-call", 1, "REGISTER"), SIP_TXN_DELIVER);
+    CHECK_EQ_INT(timeouts, 0);
+
+    receive("INVITE sip:doorbell@10.0.0.2 SIP/2.0", "z9hG4bKtin", "tin-call", 1, "INVITE");
+    send_msg("SIP/2.0 200 OK", "z9hG4bKtin", "tin-call", 1, "INVITE");
+    int before = sent_count;
+    advance_to(now + 600);
+    CHECK_EQ_INT(sent_count, before + 1);
+}
+
+// A forked INVITE's CANCEL shares its branch; the method keeps them apart
+static void test_cancel_beside_invite(void)
+{
+    setup(false);
+    send_msg("INVITE sip:100@pbx SIP/2.0", "z9hG4bKfork", "fork-call", 1, "INVITE");
+    receive("SIP/2.0 180 Ringing", "z9hG4bKfork", "fork-call", 1, "INVITE");
+    send_msg("CANCEL sip:100@pbx SIP/2.0", "z9hG4bKfork", "fork-call", 1, "CANCEL");
+
+    CHECK_EQ_INT(receive("SIP/2.0 200 OK", "z9hG4bKfork", "fork-call", 1, "CANCEL"), SIP_TXN_DELIVER);
+    CHECK_EQ_INT(receive("SIP/2.0 487 Request Terminated", "z9hG4bKfork", "fork-call", 1, "INVITE"),
+                 SIP_TXN_DELIVER);
+    CHECK_EQ_INT(receive("SIP/2.0 487 Request Terminated", "z9hG4bKfork", "fork-call", 1, "INVITE"),
+                 SIP_TXN_ABSORBED);
+    CHECK_EQ_INT(receive("SIP/2.0 200 OK", "z9hG4bKfork", "fork-call", 1, "CANCEL"), SIP_TXN_ABSORBED);
+}
+
+int main(void)
+{
+    RUN_TEST(test_non_invite_client_timeout);
+    RUN_TEST(test_non_invite_client_answered);
+    RUN_TEST(test_invite_client_timeout);
+    RUN_TEST(test_invite_client_ringing);
+    RUN_TEST(test_invite_client_rejected);
+    RUN_TEST(test_invite_client_answered);
+    RUN_TEST(test_non_invite_server);
+    RUN_TEST(test_invite_server_answered);
+    RUN_TEST(test_invite_server_no_ack);
+    RUN_TEST(test_reliable_transport);
+    RUN_TEST(test_cancel_beside_invite);
+    return TEST_RESULT();
+}
@@ -0,0 +1,316 @@
+#include "sip_writer.h"
+#include "sip_parser.h"
+#include "esp_heap_trace.h"
+#include "test_support.h"
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <time.h>
+
+#define CANARY 0xA5
+
+static void make_dialog(sip_dialog_t* d)
+{
+    sip_dialog_init(d, "doorbell", "pbx.example", "192.168.1.50", "203.0.113.7", "UDP", 5060,
+                    "sip:100@pbx.example", "c0ffee@192.168.1.50", 4242);
+}
+
+// Writes a BYE with an SDP-sized body into buf; returns sip_writer_finish()
+static int write_bye(char* buf, size_t size)
+{
+    sip_dialog_t d;
+    sip_writer_t w;
+    make_dialog(&d);
+    sip_writer_init(&w, buf, size);
+    sip_writer_dialog_request(&w, &d, "BYE", 3, 77);
+    sip_writer_header(&w, "User-Agent", SIP_USER_AGENT);
+    sip_writer_begin_body(&w, "text/plain");
+    sip_writer_append(&w, "goodbye");
+    return sip_writer_finish(&w);
+}
+
+static void test_dialog_strings(void)
+{
+    sip_dialog_t d;
+    make_dialog(&d);
+
+    CHECK_EQ_STR(d.transport, "UDP");
+    CHECK_EQ_STR(d.via_sent_by, "192.168.1.50:5060");
+    CHECK_EQ_STR(d.from, "<sip:doorbell@pbx.example>;tag=4242");
+    CHECK_EQ_STR(d.to, "<sip:100@pbx.example>");
+    CHECK_EQ_STR(d.contact, "<sip:doorbell@203.0.113.7:5060>");
+    CHECK_EQ_STR(d.request_uri, "sip:100@pbx.example");
+    CHECK_EQ_INT(d.cseq, 1);
+
+    // The remote tag is taken once; a later (forked) tag does not stack
+    sip_dialog_set_remote_tag(&d, "abc123", 6);
+    sip_dialog_set_remote_tag(&d, "other", 5);
+    CHECK_EQ_STR(d.to, "<sip:100@pbx.example>;tag=abc123");
+
+    sip_dialog_set_address(&d, "doorbell", "10.0.0.2", "10.0.0.2", "TLS", 5061);
+    CHECK_EQ_STR(d.transport, "TLS");
+    CHECK_EQ_STR(d.via_sent_by, "10.0.0.2:5061");
+    CHECK_EQ_STR(d.contact, "<sip:doorbell@10.0.0.2:5061;transport=tls>");
+    sip_dialog_set_address(&d, "doorbell", "10.0.0.2", "10.0.0.2", "TCP", 5060);
+    CHECK_EQ_STR(d.contact, "<sip:doorbell@10.0.0.2:5060;transport=tcp>");
+}
+
+static void test_request_layout(void)
+{
+    char buf[1024];
+    int len = write_bye(buf, sizeof(buf));
+
+    static const char expected[] =
+        "BYE sip:100@pbx.example SIP/2.0\r\n"
+        "Via: SIP/2.0/UDP 192.168.1.50:5060;branch=z9hG4bK77;rport\r\n"
+        "Max-Forwards: 70\r\n"
+        "From: <sip:doorbell@pbx.example>;tag=4242\r\n"
+        "To: <sip:100@pbx.example>\r\n"
+        "Call-ID: c0ffee@192.168.1.50\r\n"
+        "CSeq: 3 BYE\r\n"
+        "Contact: <sip:doorbell@203.0.113.7:5060>\r\n"
+        "User-Agent: " SIP_USER_AGENT "\r\n"
+        "Content-Type: text/plain\r\n"
+        "Content-Length:     7\r\n"
+        "\r\n"
+        "goodbye";
+    CHECK_EQ_INT(len, strlen(expected));
+    CHECK_EQ_STR(buf, expected);
+}
+
+// What we write must read back through our own parser the same way
+static void test_parses_back(void)
+{
+    char buf[1024];
+    int len = write_bye(buf, sizeof(buf));
+    sip_message_t msg;
+    char value[64];
+
+    CHECK(len > 0);
+    CHECK(sip_parse_message(buf, (size_t)len, &msg));
+    CHECK_EQ_INT(msg.method, SIP_METHOD_BYE);
+    CHECK_EQ_INT(msg.cseq_num, 3);
+    CHECK_EQ_INT(msg.cseq_method, SIP_METHOD_BYE);
+    CHECK_EQ_INT(msg.body_len, 7);
+    CHECK(sip_header_copy_param(sip_msg_header(&msg, SIP_HDR_VIA), "branch", value, sizeof(value)));
+    CHECK_EQ_STR(value, "z9hG4bK77");
+    CHECK(sip_header_copy_param(sip_msg_header(&msg, SIP_HDR_FROM), "tag", value, sizeof(value)));
+    CHECK_EQ_STR(value, "4242");
+}
+
+static void test_response_without_body(void)
+{
+    char buf[256];
+    sip_writer_t w;
+    sip_writer_init(&w, buf, sizeof(buf));
+    sip_writer_status_line(&w, 486, "Busy Here");
+    sip_writer_cseq(&w, 4294967295u, "INVITE");
+    sip_writer_header_uint(&w, "Expires", 0);
+    sip_writer_header_n(&w, "Call-ID", "abcdef", 3);
+    int len = sip_writer_finish(&w);
+
+    CHECK_EQ_STR(buf,
+                 "SIP/2.0 486 Busy Here\r\n"
+                 "CSeq: 4294967295 INVITE\r\n"
+                 "Expires: 0\r\n"
+                 "Call-ID: abc\r\n"
+                 "Content-Length: 0\r\n"
+                 "\r\n");
+    CHECK_EQ_INT(len, strlen(buf));
+}
+
+// Every buffer too small by any amount fails cleanly: -1, an empty string,
+// and nothing written past the end
+static void test_overflow_at_every_size(void)
+{
+    char full[1024];
+    int needed = write_bye(full, sizeof(full));
+    CHECK(needed > 0);
+
+    unsigned char buf[1024 + 16];
+    for (int size = 0; size <= needed + 1; size++) {
+        memset(buf, CANARY, sizeof(buf));
+        int len = write_bye((char*)buf, (size_t)size);
+        bool clean = true;
+        for (size_t i = (size_t)size; i < sizeof(buf); i++) {
+            clean &= buf[i] == CANARY;
+        }
+        if (size > needed) {
+            CHECK_EQ_INT(len, needed);
+        } else if (len != -1 || (size > 0 && buf[0] != '\0')) {
+            printf("  size %d: returned %d\n", size, len);
+            CHECK(false);
+        }
+        CHECK(clean);
+    }
+}
+
+static void test_long_body(void)
+{
+    static char body[20000];
+    static char buf[sizeof(body) + 256];
+    memset(body, 'x', sizeof(body) - 1);
+    body[sizeof(body) - 1] = '\0';
+
+    sip_writer_t w;
+    sip_writer_init(&w, buf, sizeof(buf));
+    sip_writer_request_line(&w, "MESSAGE", "sip:a@b");
+    sip_writer_begin_body(&w, "text/plain");
+    sip_writer_append(&w, body);
+    int len = sip_writer_finish(&w);
+
+    sip_message_t msg;
+    CHECK(len > 0);
+    CHECK(sip_parse_message(buf, (size_t)len, &msg));
+    CHECK_EQ_INT(msg.body_len, sizeof(body) - 1);
+    CHECK(strstr(buf, "Content-Length: 19999\r\n") != NULL);
+}
+
+#define BENCH_MESSAGES  20000
+#define BENCH_RUNS      7
+
+typedef struct {
+    const char* ip;
+    uint16_t rtp_port;
+    uint32_t session_id;
+} offer_t;
+
+// An INVITE with its SDP offer, the way sip_client.c writes it
+static int writer_invite(char* buf, size_t size, const sip_dialog_t* d, const offer_t* o, uint32_t branch)
+{
+    sip_writer_t w;
+    sip_writer_init(&w, buf, size);
+    sip_writer_dialog_request(&w, d, "INVITE", d->cseq, branch);
+    sip_writer_append(&w,
+                      "Allow: " SIP_ALLOW_METHODS "\r\n"
+                      "User-Agent: " SIP_USER_AGENT "\r\n");
+    sip_writer_begin_body(&w, "application/sdp");
+    sip_writer_append(&w, "v=0\r\no=- ");
+    sip_writer_append_uint(&w, o->session_id);
+    sip_writer_append(&w, " ");
+    sip_writer_append_uint(&w, o->session_id);
+    sip_writer_append(&w, " IN IP4 ");
+    sip_writer_append(&w, o->ip);
+    sip_writer_append(&w, "\r\ns=ESP32 Doorbell Call\r\nc=IN IP4 ");
+    sip_writer_append(&w, o->ip);
+    sip_writer_append(&w, "\r\nt=0 0\r\nm=audio ");
+    sip_writer_append_uint(&w, o->rtp_port);
+    sip_writer_append(&w,
+                      " RTP/AVP 0 8 101\r\n"
+                      "a=rtpmap:0 PCMU/8000\r\n"
+                      "a=rtpmap:8 PCMA/8000\r\n"
+                      "a=rtpmap:101 telephone-event/8000\r\n"
+                      "a=fmtp:101 0-16\r\n"
+                      "a=ptime:20\r\n"
+                      "a=sendrecv\r\n");
+    return sip_writer_finish(&w);
+}
+
+// The same INVITE built the way the client did before sip_writer: the body
+// formatted first for its length, then everything in one snprintf()
+static int snprintf_invite(char* buf, size_t size, const sip_dialog_t* d, const offer_t* o, uint32_t branch)
+{
+    char body[512];
+    int body_len = snprintf(body, sizeof(body),
+                            "v=0\r\n"
+                            "o=- %lu %lu IN IP4 %s\r\n"
+                            "s=ESP32 Doorbell Call\r\n"
+                            "c=IN IP4 %s\r\n"
+                            "t=0 0\r\n"
+                            "m=audio %u RTP/AVP 0 8 101\r\n"
+                            "a=rtpmap:0 PCMU/8000\r\n"
+                            "a=rtpmap:8 PCMA/8000\r\n"
+                            "a=rtpmap:101 telephone-event/8000\r\n"
+                            "a=fmtp:101 0-16\r\n"
+                            "a=ptime:20\r\n"
+                            "a=sendrecv\r\n",
+                            (unsigned long)o->session_id, (unsigned long)o->session_id, o->ip, o->ip,
+                            (unsigned)o->rtp_port);
+    if (body_len < 0 || body_len >= (int)sizeof(body)) {
+        return -1;
+    }
+    int len = snprintf(buf, size,
+                       "INVITE %s SIP/2.0\r\n"
+                       "Via: SIP/2.0/%s %s;branch=z9hG4bK%lu;rport\r\n"
+                       "Max-Forwards: 70\r\n"
+                       "From: %s\r\n"
+                       "To: %s\r\n"
+                       "Call-ID: %s\r\n"
+                       "CSeq: %lu INVITE\r\n"
+                       "Contact: %s\r\n"
+                       "Allow: " SIP_ALLOW_METHODS "\r\n"
+                       "User-Agent: " SIP_USER_AGENT "\r\n"
+                       "Content-Type: application/sdp\r\n"
+                       "Content-Length: %5d\r\n"
+                       "\r\n"
+                       "%s",
+                       d->request_uri, d->transport, d->via_sent_by, (unsigned long)branch, d->from, d->to,
+                       d->call_id, (unsigned long)d->cseq, d->contact, body_len, body);
+    return (len < 0 || len >= (int)size) ? -1 : len;
+}
+
+static int64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+typedef int (*build_fn)(char* buf, size_t size, const sip_dialog_t* d, const offer_t* o, uint32_t branch);
+
+// Best of several runs, host ns per message
+static double build_ns(build_fn build, const sip_dialog_t* d, const offer_t* o)
+{
+    static char buf[1500];
+    int64_t best = INT64_MAX;
+    for (int run = 0; run < BENCH_RUNS; run++) {
+        int64_t start = now_ns();
+        for (uint32_t i = 0; i < BENCH_MESSAGES; i++) {
+            build(buf, sizeof(buf), d, o, 0x10000000u + i);
+        }
+        int64_t elapsed = now_ns() - start;
+        best = elapsed < best ? elapsed : best;
+    }
+    return (double)best / BENCH_MESSAGES;
+}
+
+// Reports host ns per INVITE against the snprintf() builder, after checking
+// both write the same bytes; sip_writer must not touch the heap. Timings
+// are only printed: they compare the two, they are not what the ESP32 takes.
+static void test_report_speed_against_snprintf(void)
+{
+    sip_dialog_t d;
+    make_dialog(&d);
+    sip_dialog_set_remote_tag(&d, "as5f3e1c2a", 10);
+    offer_t offer = { "203.0.113.7", 5004, 3141592653u };
+
+    char expected[1500];
+    char actual[1500];
+    int expected_len = snprintf_invite(expected, sizeof(expected), &d, &offer, 0x12345678);
+    int actual_len = writer_invite(actual, sizeof(actual), &d, &offer, 0x12345678);
+    CHECK(expected_len > 0);
+    CHECK_EQ_INT(actual_len, expected_len);
+    CHECK_EQ_STR(actual, expected);
+
+    heap_trace_start(HEAP_TRACE_ALL);
+    double writer = build_ns(writer_invite, &d, &offer);
+    heap_trace_stop();
+    CHECK_EQ_INT(heap_trace_get_count(), 0);
+    double formatted = build_ns(snprintf_invite, &d, &offer);
+
+    printf("  INVITE with SDP (%d bytes)   ns/message\n", actual_len);
+    printf("  %-28s  %8.0f\n", "snprintf", formatted);
+    printf("  %-28s  %8.0f  %4.1fx\n", "sip_writer", writer, formatted / writer);
+}
+
+int main(void)
+{
+    RUN_TEST(test_dialog_strings);
+    RUN_TEST(test_request_layout);
+    RUN_TEST(test_parses_back);
+    RUN_TEST(test_response_without_body);
+    RUN_TEST(test_overflow_at_every_size);
+    RUN_TEST(test_long_body);
+    RUN_TEST(test_report_speed_against_snprintf);
+    return TEST_RESULT();
+}
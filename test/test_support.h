@@ -0,0 +1,45 @@
+#ifndef TEST_SUPPORT_H
+#define TEST_SUPPORT_H
+
+#include <stdio.h>
+#include <string.h>
+
+// Minimal checks for the host tests: each failed check is reported with
+// its location, and main() returns TEST_RESULT() so ctest sees the outcome
+
+static int test_failures = 0;
+
+#define CHECK(cond) do { \
+        if (!(cond)) { \
+            printf("%s:%d: CHECK failed: %s\n", __FILE__, __LINE__, #cond); \
+            test_failures++; \
+        } \
+    } while (0)
+
+#define CHECK_EQ_INT(actual, expected) do { \
+        long long _a = (long long)(actual); \
+        long long _e = (long long)(expected); \
+        if (_a != _e) { \
+            printf("%s:%d: %s is %lld, expected %lld\n", __FILE__, __LINE__, #actual, _a, _e); \
+            test_failures++; \
+        } \
+    } while (0)
+
+#define CHECK_EQ_STR(actual, expected) do { \
+        const char* _a = (actual); \
+        const char* _e = (expected); \
+        if (strcmp(_a, _e) != 0) { \
+            printf("%s:%d: %s is \"%s\", expected \"%s\"\n", __FILE__, __LINE__, #actual, _a, _e); \
+            test_failures++; \
+        } \
+    } while (0)
+
+#define RUN_TEST(fn) do { \
+        int _before = test_failures; \
+        fn(); \
+        printf("%s %s\n", test_failures == _before ? "ok  " : "FAIL", #fn); \
+    } while (0)
+
+#define TEST_RESULT() (test_failures == 0 ? 0 : 1)
+
+#endif // TEST_SUPPORT_H